@@ -16,4 +16,6 @@
 #include <DirectXMath.h>
 #include <DirectXPackedVector.h>
 
-#include "Logger.h"
\ No newline at end of file
+#include "Logger.h"
+#include "Profiler.h"
+#include "FrameArena.h"
\ No newline at end of file
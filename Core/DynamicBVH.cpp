@@ -0,0 +1,545 @@
+﻿#include "DynamicBVH.h"
+#include "Jobs/JobSystem.h"
+
+#include <algorithm>
+
+namespace
+{
+    BVHBox Union(const BVHBox& a, const BVHBox& b)
+    {
+        return {
+            { (std::min)(a.Min.x, b.Min.x), (std::min)(a.Min.y, b.Min.y), (std::min)(a.Min.z, b.Min.z) },
+            { (std::max)(a.Max.x, b.Max.x), (std::max)(a.Max.y, b.Max.y), (std::max)(a.Max.z, b.Max.z) }
+        };
+    }
+
+    // Half the surface area, only ever compared or summed
+    float Area(const BVHBox& box)
+    {
+        float x = box.Max.x - box.Min.x;
+        float y = box.Max.y - box.Min.y;
+        float z = box.Max.z - box.Min.z;
+        return x * y + y * z + z * x;
+    }
+
+    bool Contains(const BVHBox& outer, const BVHBox& inner)
+    {
+        return outer.Min.x <= inner.Min.x && outer.Min.y <= inner.Min.y && outer.Min.z <= inner.Min.z
+            && outer.Max.x >= inner.Max.x && outer.Max.y >= inner.Max.y && outer.Max.z >= inner.Max.z;
+    }
+
+    bool Overlaps(const BVHBox& a, const BVHBox& b)
+    {
+        return a.Min.x <= b.Max.x && a.Min.y <= b.Max.y && a.Min.z <= b.Max.z
+            && a.Max.x >= b.Min.x && a.Max.y >= b.Min.y && a.Max.z >= b.Min.z;
+    }
+
+    bool Overlaps(const BVHSphere& sphere, const BVHBox& box)
+    {
+        float x = sphere.Center.x - (std::clamp)(sphere.Center.x, box.Min.x, box.Max.x);
+        float y = sphere.Center.y - (std::clamp)(sphere.Center.y, box.Min.y, box.Max.y);
+        float z = sphere.Center.z - (std::clamp)(sphere.Center.z, box.Min.z, box.Max.z);
+        return x * x + y * y + z * z <= sphere.Radius * sphere.Radius;
+    }
+
+    struct RaySetup
+    {
+        float Origin[3];
+        float InvDirection[3];
+    };
+
+    RaySetup MakeRaySetup(const BVHRay& ray)
+    {
+        // Zero direction components would turn the slabs into NaNs, a tiny one gives the same answer
+        RaySetup setup;
+        const float* origin = &ray.Origin.x;
+        const float* direction = &ray.Direction.x;
+        for(int axis = 0; axis < 3; axis++)
+        {
+            float component = fabsf(direction[axis]) < 1e-20f ? (direction[axis] < 0.0f ? -1e-20f : 1e-20f) : direction[axis];
+            setup.Origin[axis] = origin[axis];
+            setup.InvDirection[axis] = 1.0f / component;
+        }
+        return setup;
+    }
+
+    // Slab test, entry is clamped to the ray start
+    bool IntersectRay(const RaySetup& ray, const BVHBox& box, float maxDistance, float& entry)
+    {
+        const float* boxMin = &box.Min.x;
+        const float* boxMax = &box.Max.x;
+        float tMin = 0.0f;
+        float tMax = maxDistance;
+        for(int axis = 0; axis < 3; axis++)
+        {
+            float t0 = (boxMin[axis] - ray.Origin[axis]) * ray.InvDirection[axis];
+            float t1 = (boxMax[axis] - ray.Origin[axis]) * ray.InvDirection[axis];
+            tMin = (std::max)(tMin, (std::min)(t0, t1));
+            tMax = (std::min)(tMax, (std::max)(t0, t1));
+        }
+        entry = tMin;
+        return tMin <= tMax;
+    }
+
+    // A depth first traversal never holds more than height + 1 nodes
+    template<typename T>
+    class TraversalStack
+    {
+    public:
+        TraversalStack(uint32_t height)
+        {
+            if(height + 1 > BVH_STACK_SIZE)
+            {
+                m_heap.resize(height + 1);
+                m_data = m_heap.data();
+            }
+        }
+
+        void Push(const T& value) { m_data[m_count++] = value; }
+        T Pop() { return m_data[--m_count]; }
+        bool IsEmpty() const { return m_count == 0; }
+
+    private:
+        T m_local[BVH_STACK_SIZE];
+        std::vector<T> m_heap;
+        T* m_data = m_local;
+        uint32_t m_count = 0;
+    };
+
+    template<typename Function>
+    void RunParallel(uint32_t count, uint32_t grainSize, const Function& function)
+    {
+        if(JobSystem::Get() && count > grainSize)
+            JobSystem::Get()->ParallelFor(count, grainSize, function);
+        else
+            function(0, count);
+    }
+
+    void QueryBatch(uint32_t count, std::vector<uint32_t>& results, std::vector<uint32_t>& offsets, const std::function<void(uint32_t query, std::vector<uint32_t>& results)>& query)
+    {
+        // Every job gathers the results of its queries, they are concatenated in query order afterwards
+        uint32_t jobCount = (count + BVH_QUERY_GRAIN_SIZE - 1) / BVH_QUERY_GRAIN_SIZE;
+        std::vector<std::vector<uint32_t>> jobResults(jobCount);
+        offsets.assign(count + 1, 0);
+
+        RunParallel(jobCount, 1, [&](uint32_t begin, uint32_t end)
+        {
+            for(uint32_t job = begin; job < end; job++)
+            {
+                uint32_t queryEnd = (std::min)((job + 1) * BVH_QUERY_GRAIN_SIZE, count);
+                for(uint32_t i = job * BVH_QUERY_GRAIN_SIZE; i < queryEnd; i++)
+                {
+                    size_t previousSize = jobResults[job].size();
+                    query(i, jobResults[job]);
+                    offsets[i + 1] = (uint32_t)(jobResults[job].size() - previousSize);
+                }
+            }
+        });
+
+        for(uint32_t i = 0; i < count; i++)
+            offsets[i + 1] += offsets[i];
+
+        results.clear();
+        results.reserve(offsets[count]);
+        for(const auto& jobResult : jobResults)
+            results.insert(results.end(), jobResult.begin(), jobResult.end());
+    }
+}
+
+uint32_t DynamicBVH::Insert(const BVHBox& box, uint32_t userData)
+{
+    uint32_t leaf = AllocateNode();
+    m_nodes[leaf].Box = box;
+    m_nodes[leaf].UserData = userData;
+    InsertLeaf(leaf);
+    m_proxyCount++;
+    return leaf;
+}
+
+void DynamicBVH::Remove(uint32_t proxy)
+{
+    if(!IsLeafProxy(proxy))
+    {
+        LOG(Error, "DynamicBVH : removing an invalid proxy");
+        return;
+    }
+
+    RemoveLeaf(proxy);
+    FreeNode(proxy);
+    m_proxyCount--;
+}
+
+void DynamicBVH::Update(uint32_t proxy, const BVHBox& box)
+{
+    if(!IsLeafProxy(proxy))
+    {
+        LOG(Error, "DynamicBVH : updating an invalid proxy");
+        return;
+    }
+
+    // Small moves, like gizmo drags, only shrink the ancestors. Leaving the parent box would grow them, the leaf looks for a better place instead.
+    uint32_t parent = m_nodes[proxy].Parent;
+    if(parent == NullNode || Contains(m_nodes[parent].Box, box))
+    {
+        m_nodes[proxy].Box = box;
+        Refit(parent);
+        return;
+    }
+
+    RemoveLeaf(proxy);
+    m_nodes[proxy].Box = box;
+    InsertLeaf(proxy);
+}
+
+void DynamicBVH::Clear()
+{
+    m_nodes.clear();
+    m_root = NullNode;
+    m_freeList = NullNode;
+    m_proxyCount = 0;
+}
+
+float DynamicBVH::GetAreaRatio() const
+{
+    if(m_root == NullNode || m_nodes[m_root].IsLeaf())
+        return 0.0f;
+
+    float area = 0.0f;
+    for(const Node& node : m_nodes)
+    {
+        if(node.Height != UINT32_MAX && !node.IsLeaf())
+            area += Area(node.Box);
+    }
+
+    float rootArea = Area(m_nodes[m_root].Box);
+    return rootArea > 0.0f ? area / rootArea : 0.0f;
+}
+
+template<typename Overlaps>
+void DynamicBVH::Query(const Overlaps& overlaps, std::vector<uint32_t>& results) const
+{
+    if(m_root == NullNode)
+        return;
+
+    TraversalStack<uint32_t> stack(GetHeight());
+    stack.Push(m_root);
+    while(!stack.IsEmpty())
+    {
+        const Node& node = m_nodes[stack.Pop()];
+        if(!overlaps(node.Box))
+            continue;
+
+        if(node.IsLeaf())
+        {
+            results.push_back(node.UserData);
+        }
+        else
+        {
+            stack.Push(node.Right);
+            stack.Push(node.Left);
+        }
+    }
+}
+
+void DynamicBVH::QueryBox(const BVHBox& box, std::vector<uint32_t>& results) const
+{
+    Query([&box](const BVHBox& nodeBox) { return Overlaps(box, nodeBox); }, results);
+}
+
+void DynamicBVH::QuerySphere(const BVHSphere& sphere, std::vector<uint32_t>& results) const
+{
+    Query([&sphere](const BVHBox& nodeBox) { return Overlaps(sphere, nodeBox); }, results);
+}
+
+bool DynamicBVH::Raycast(const BVHRay& ray, const BVHLeafRaycast& leafRaycast, BVHRayHit& hit) const
+{
+    struct Entry
+    {
+        uint32_t Node;
+        float Distance;
+    };
+
+    hit = BVHRayHit();
+    RaySetup setup = MakeRaySetup(ray);
+    float closest = ray.MaxDistance;
+
+    float entry;
+    if(m_root == NullNode || !IntersectRay(setup, m_nodes[m_root].Box, closest, entry))
+        return false;
+
+    TraversalStack<Entry> stack(GetHeight());
+    stack.Push({ m_root, entry });
+    while(!stack.IsEmpty())
+    {
+        Entry current = stack.Pop();
+        if(current.Distance > closest)
+            continue;
+
+        const Node& node = m_nodes[current.Node];
+        if(node.IsLeaf())
+        {
+            float distance = leafRaycast(ray, node.UserData, closest);
+            if(distance < closest)
+            {
+                closest = distance;
+                hit.UserData = node.UserData;
+                hit.Distance = distance;
+            }
+            continue;
+        }
+
+        // The nearest child goes on top so its hits can discard the other one
+        float leftEntry, rightEntry;
+        bool leftHit = IntersectRay(setup, m_nodes[node.Left].Box, closest, leftEntry);
+        bool rightHit = IntersectRay(setup, m_nodes[node.Right].Box, closest, rightEntry);
+        if(leftHit && rightHit && leftEntry > rightEntry)
+        {
+            stack.Push({ node.Left, leftEntry });
+            stack.Push({ node.Right, rightEntry });
+        }
+        else
+        {
+            if(rightHit)
+                stack.Push({ node.Right, rightEntry });
+            if(leftHit)
+                stack.Push({ node.Left, leftEntry });
+        }
+    }
+
+    return hit.UserData != UINT32_MAX;
+}
+
+void DynamicBVH::QueryBoxes(const BVHBox* boxes, uint32_t count, std::vector<uint32_t>& results, std::vector<uint32_t>& offsets) const
+{
+    PROFILE_FUNCTION();
+
+    QueryBatch(count, results, offsets, [this, boxes](uint32_t query, std::vector<uint32_t>& queryResults) { QueryBox(boxes[query], queryResults); });
+}
+
+void DynamicBVH::QuerySpheres(const BVHSphere* spheres, uint32_t count, std::vector<uint32_t>& results, std::vector<uint32_t>& offsets) const
+{
+    PROFILE_FUNCTION();
+
+    QueryBatch(count, results, offsets, [this, spheres](uint32_t query, std::vector<uint32_t>& queryResults) { QuerySphere(spheres[query], queryResults); });
+}
+
+void DynamicBVH::Raycast(const BVHRay* rays, uint32_t count, const BVHLeafRaycast& leafRaycast, BVHRayHit* hits) const
+{
+    PROFILE_FUNCTION();
+
+    RunParallel(count, BVH_QUERY_GRAIN_SIZE, [&](uint32_t begin, uint32_t end)
+    {
+        for(uint32_t i = begin; i < end; i++)
+            Raycast(rays[i], leafRaycast, hits[i]);
+    });
+}
+
+uint32_t DynamicBVH::AllocateNode()
+{
+    if(m_freeList == NullNode)
+    {
+        m_nodes.emplace_back();
+        return (uint32_t)m_nodes.size() - 1;
+    }
+
+    uint32_t node = m_freeList;
+    m_freeList = m_nodes[node].Left;
+    m_nodes[node] = Node();
+    return node;
+}
+
+void DynamicBVH::FreeNode(uint32_t node)
+{
+    m_nodes[node] = Node();
+    m_nodes[node].Left = m_freeList;
+    m_nodes[node].Height = UINT32_MAX;
+    m_freeList = node;
+}
+
+bool DynamicBVH::IsLeafProxy(uint32_t proxy) const
+{
+    return proxy < m_nodes.size() && m_nodes[proxy].Height == 0;
+}
+
+void DynamicBVH::InsertLeaf(uint32_t leaf)
+{
+    if(m_root == NullNode)
+    {
+        m_root = leaf;
+        m_nodes[leaf].Parent = NullNode;
+        return;
+    }
+
+    uint32_t sibling = FindBestSibling(m_nodes[leaf].Box);
+    uint32_t oldParent = m_nodes[sibling].Parent;
+
+    uint32_t parent = AllocateNode();
+    Node& parentNode = m_nodes[parent];
+    parentNode.Parent = oldParent;
+    parentNode.Left = sibling;
+    parentNode.Right = leaf;
+    m_nodes[sibling].Parent = parent;
+    m_nodes[leaf].Parent = parent;
+
+    if(oldParent == NullNode)
+        m_root = parent;
+    else if(m_nodes[oldParent].Left == sibling)
+        m_nodes[oldParent].Left = parent;
+    else
+        m_nodes[oldParent].Right = parent;
+
+    Refit(parent);
+}
+
+void DynamicBVH::RemoveLeaf(uint32_t leaf)
+{
+    if(leaf == m_root)
+    {
+        m_root = NullNode;
+        return;
+    }
+
+    uint32_t parent = m_nodes[leaf].Parent;
+    uint32_t grandParent = m_nodes[parent].Parent;
+    uint32_t sibling = m_nodes[parent].Left == leaf ? m_nodes[parent].Right : m_nodes[parent].Left;
+
+    m_nodes[sibling].Parent = grandParent;
+    m_nodes[leaf].Parent = NullNode;
+    FreeNode(parent);
+
+    if(grandParent == NullNode)
+    {
+        m_root = sibling;
+        return;
+    }
+
+    if(m_nodes[grandParent].Left == parent)
+        m_nodes[grandParent].Left = sibling;
+    else
+        m_nodes[grandParent].Right = sibling;
+
+    Refit(grandParent);
+}
+
+uint32_t DynamicBVH::FindBestSibling(const BVHBox& box)
+{
+    // Branch and bound (Bittner et al.) : a sibling costs its enlarged area plus the enlargement of all its ancestors.
+    // No sibling in a subtree costs less than the leaf area plus the inherited cost of its root, the candidates are
+    // visited by increasing lower bound and the search stops once the lowest one can't beat the best sibling found.
+    auto IsWorse = [](const SiblingCandidate& a, const SiblingCandidate& b) { return a.InheritedCost > b.InheritedCost; };
+
+    float leafArea = Area(box);
+    uint32_t best = m_root;
+    float bestCost = FLT_MAX;
+
+    m_siblingCandidates.clear();
+    m_siblingCandidates.push_back({ m_root, 0.0f });
+    while(!m_siblingCandidates.empty())
+    {
+        std::pop_heap(m_siblingCandidates.begin(), m_siblingCandidates.end(), IsWorse);
+        SiblingCandidate candidate = m_siblingCandidates.back();
+        m_siblingCandidates.pop_back();
+
+        if(leafArea + candidate.InheritedCost >= bestCost)
+            break;
+
+        const Node& node = m_nodes[candidate.Node];
+        float combinedArea = Area(Union(node.Box, box));
+        float cost = combinedArea + candidate.InheritedCost;
+        if(cost < bestCost)
+        {
+            bestCost = cost;
+            best = candidate.Node;
+        }
+
+        if(node.IsLeaf())
+            continue;
+
+        float childInheritedCost = candidate.InheritedCost + combinedArea - Area(node.Box);
+        if(leafArea + childInheritedCost >= bestCost)
+            continue;
+
+        m_siblingCandidates.push_back({ node.Left, childInheritedCost });
+        std::push_heap(m_siblingCandidates.begin(), m_siblingCandidates.end(), IsWorse);
+        m_siblingCandidates.push_back({ node.Right, childInheritedCost });
+        std::push_heap(m_siblingCandidates.begin(), m_siblingCandidates.end(), IsWorse);
+    }
+
+    return best;
+}
+
+void DynamicBVH::Refit(uint32_t node)
+{
+    while(node != NullNode)
+    {
+        Node& current = m_nodes[node];
+        current.Box = Union(m_nodes[current.Left].Box, m_nodes[current.Right].Box);
+        current.Height = 1 + (std::max)(m_nodes[current.Left].Height, m_nodes[current.Right].Height);
+
+        Rotate(node);
+        node = m_nodes[node].Parent;
+    }
+}
+
+void DynamicBVH::Rotate(uint32_t node)
+{
+    // Kopta et al. : swapping a child with a grandchild on the other side leaves this node box as is but changes the area of the other child,
+    // the swap shrinking it the most is applied
+    uint32_t left = m_nodes[node].Left;
+    uint32_t right = m_nodes[node].Right;
+
+    uint32_t bestChild = NullNode;
+    uint32_t bestGrandChild = NullNode;
+    float bestGain = 0.0f;
+
+    auto Evaluate = [&](uint32_t child, uint32_t inner)
+    {
+        const Node& innerNode = m_nodes[inner];
+        if(innerNode.IsLeaf())
+            return;
+
+        float innerArea = Area(innerNode.Box);
+        const BVHBox& childBox = m_nodes[child].Box;
+        // Swapping with Left keeps Right under the inner node and the other way around
+        float leftGain = innerArea - Area(Union(childBox, m_nodes[innerNode.Right].Box));
+        float rightGain = innerArea - Area(Union(childBox, m_nodes[innerNode.Left].Box));
+        if(leftGain > bestGain)
+        {
+            bestGain = leftGain;
+            bestChild = child;
+            bestGrandChild = innerNode.Left;
+        }
+        if(rightGain > bestGain)
+        {
+            bestGain = rightGain;
+            bestChild = child;
+            bestGrandChild = innerNode.Right;
+        }
+    };
+
+    Evaluate(left, right);
+    Evaluate(right, left);
+    if(bestChild == NullNode)
+        return;
+
+    uint32_t inner = m_nodes[bestGrandChild].Parent;
+    Node& current = m_nodes[node];
+    Node& innerNode = m_nodes[inner];
+
+    if(current.Left == bestChild)
+        current.Left = bestGrandChild;
+    else
+        current.Right = bestGrandChild;
+
+    if(innerNode.Left == bestGrandChild)
+        innerNode.Left = bestChild;
+    else
+        innerNode.Right = bestChild;
+
+    m_nodes[bestChild].Parent = inner;
+    m_nodes[bestGrandChild].Parent = node;
+
+    innerNode.Box = Union(m_nodes[innerNode.Left].Box, m_nodes[innerNode.Right].Box);
+    innerNode.Height = 1 + (std::max)(m_nodes[innerNode.Left].Height, m_nodes[innerNode.Right].Height);
+    current.Height = 1 + (std::max)(m_nodes[current.Left].Height, m_nodes[current.Right].Height);
+}
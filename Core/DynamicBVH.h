@@ -0,0 +1,114 @@
+﻿#pragma once
+#include "Core.h"
+
+#include <cfloat>
+
+// Depth handled by the traversal stacks without allocating, deeper trees fall back to the heap
+#define BVH_STACK_SIZE 64
+// Queries per job of the batched queries
+#define BVH_QUERY_GRAIN_SIZE 64
+
+struct BVHBox
+{
+    DirectX::XMFLOAT3 Min;
+    DirectX::XMFLOAT3 Max;
+};
+
+struct BVHSphere
+{
+    DirectX::XMFLOAT3 Center;
+    float Radius;
+};
+
+// Direction does not have to be normalized, distances are in units of its length
+struct BVHRay
+{
+    DirectX::XMFLOAT3 Origin;
+    DirectX::XMFLOAT3 Direction;
+    float MaxDistance = FLT_MAX;
+};
+
+struct BVHRayHit
+{
+    uint32_t UserData = UINT32_MAX;
+    float Distance = FLT_MAX;
+};
+
+// Exact distance of the ray to the object of a leaf, maxDistance when it misses it. The batched raycasts call it from several threads.
+using BVHLeafRaycast = std::function<float(const BVHRay& ray, uint32_t userData, float maxDistance)>;
+
+// Dynamic AABB tree, leaves are inserted next to the sibling with the lowest SAH cost and every refitted node
+// tries the child / grandchild rotation that shrinks its children the most, so the tree keeps its quality without rebuilds.
+// Proxies are the leaf node indices and stay valid until removed. Queries are const and can run from several threads.
+class DynamicBVH
+{
+public:
+    uint32_t Insert(const BVHBox& box, uint32_t userData);
+    void Remove(uint32_t proxy);
+    // Refits the leaf and its ancestors in place while it stays inside its parent box, reinserts it otherwise
+    void Update(uint32_t proxy, const BVHBox& box);
+    void Clear();
+
+    uint32_t GetUserData(uint32_t proxy) const { return m_nodes[proxy].UserData; }
+    const BVHBox& GetBox(uint32_t proxy) const { return m_nodes[proxy].Box; }
+    uint32_t GetProxyCount() const { return m_proxyCount; }
+    uint32_t GetHeight() const { return m_root != NullNode ? m_nodes[m_root].Height : 0; }
+    // Box of every leaf, inverted when the tree is empty
+    BVHBox GetBounds() const { return m_root != NullNode ? m_nodes[m_root].Box : BVHBox{ { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } }; }
+    // Summed area of the internal nodes over the root one, what the insertions and rotations keep low
+    float GetAreaRatio() const;
+
+    // Append the user data of the leaves overlapping the shape
+    void QueryBox(const BVHBox& box, std::vector<uint32_t>& results) const;
+    void QuerySphere(const BVHSphere& sphere, std::vector<uint32_t>& results) const;
+    // Closest leaf hit, the nodes are visited front to back and the leaf test only has to look before the closest hit so far
+    bool Raycast(const BVHRay& ray, const BVHLeafRaycast& leafRaycast, BVHRayHit& hit) const;
+
+    // Batched versions spread over the job system. The results of query i are results[offsets[i], offsets[i + 1]),
+    // in the order the single query gives them.
+    void QueryBoxes(const BVHBox* boxes, uint32_t count, std::vector<uint32_t>& results, std::vector<uint32_t>& offsets) const;
+    void QuerySpheres(const BVHSphere* spheres, uint32_t count, std::vector<uint32_t>& results, std::vector<uint32_t>& offsets) const;
+    void Raycast(const BVHRay* rays, uint32_t count, const BVHLeafRaycast& leafRaycast, BVHRayHit* hits) const;
+
+private:
+    static constexpr uint32_t NullNode = UINT32_MAX;
+
+    struct Node
+    {
+        BVHBox Box;
+        uint32_t Parent = NullNode;
+        uint32_t Left = NullNode; // Next free node on free nodes
+        uint32_t Right = NullNode;
+        uint32_t Height = 0; // 0 on leaves, UINT32_MAX on free nodes
+        uint32_t UserData = UINT32_MAX;
+
+        bool IsLeaf() const { return Left == NullNode; }
+    };
+
+    uint32_t AllocateNode();
+    void FreeNode(uint32_t node);
+    bool IsLeafProxy(uint32_t proxy) const;
+
+    void InsertLeaf(uint32_t leaf);
+    void RemoveLeaf(uint32_t leaf);
+    uint32_t FindBestSibling(const BVHBox& box);
+    // Recomputes the boxes and heights from node up to the root, rotating every node on the way
+    void Refit(uint32_t node);
+    void Rotate(uint32_t node);
+
+    template<typename Overlaps>
+    void Query(const Overlaps& overlaps, std::vector<uint32_t>& results) const;
+
+    // Nodes left to visit by FindBestSibling, kept between insertions so the search does not allocate
+    struct SiblingCandidate
+    {
+        uint32_t Node;
+        float InheritedCost; // Enlargement of the ancestors when the sibling is in this subtree
+    };
+    std::vector<SiblingCandidate> m_siblingCandidates;
+
+    std::vector<Node> m_nodes;
+    uint32_t m_root = NullNode;
+    uint32_t m_freeList = NullNode;
+    uint32_t m_proxyCount = 0;
+};
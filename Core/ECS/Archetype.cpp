@@ -0,0 +1,124 @@
+﻿#include "Archetype.h"
+
+namespace
+{
+    constexpr size_t ChunkAlignment = 64;
+
+    uint32_t AlignUp(uint32_t value, uint32_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+}
+
+Archetype::Archetype(ComponentMask mask, const ComponentInfo* componentInfos) : m_mask(mask), m_componentInfos(componentInfos)
+{
+    uint32_t rowSize = sizeof(Entity);
+    for(uint32_t type = 0; type < (uint32_t)ComponentType::Count; type++)
+    {
+        if(m_mask & ComponentBit((ComponentType)type))
+            rowSize += (uint32_t)m_componentInfos[type].Size;
+    }
+
+    // Shrink the capacity until every array fits once aligned
+    m_chunkCapacity = std::max(ARCHETYPE_CHUNK_SIZE / rowSize, 1u);
+    while(true)
+    {
+        uint32_t offset = sizeof(Entity) * m_chunkCapacity;
+        for(uint32_t type = 0; type < (uint32_t)ComponentType::Count; type++)
+        {
+            if((m_mask & ComponentBit((ComponentType)type)) == 0)
+                continue;
+
+            offset = AlignUp(offset, (uint32_t)m_componentInfos[type].Alignment);
+            m_componentOffsets[type] = offset;
+            offset += (uint32_t)m_componentInfos[type].Size * m_chunkCapacity;
+        }
+
+        if(offset <= ARCHETYPE_CHUNK_SIZE || m_chunkCapacity == 1)
+            break;
+
+        m_chunkCapacity--;
+    }
+}
+
+Archetype::~Archetype()
+{
+    while(m_count > 0)
+        RemoveRow(m_count - 1);
+
+    for(auto chunk : m_chunks)
+        ::operator delete(chunk, std::align_val_t(ChunkAlignment));
+
+    m_chunks.clear();
+}
+
+uint32_t Archetype::GetChunkEntityCount(uint32_t chunkIdx) const
+{
+    uint32_t first = chunkIdx * m_chunkCapacity;
+    if(first >= m_count)
+        return 0;
+
+    return std::min(m_count - first, m_chunkCapacity);
+}
+
+void* Archetype::GetComponent(ComponentType type, uint32_t row)
+{
+    if(!Has(type))
+        return nullptr;
+
+    std::byte* chunk = m_chunks[row / m_chunkCapacity];
+    return chunk + m_componentOffsets[(uint32_t)type] + (row % m_chunkCapacity) * m_componentInfos[(uint32_t)type].Size;
+}
+
+uint32_t Archetype::AllocateRow(Entity entity)
+{
+    uint32_t row = m_count;
+    if(row / m_chunkCapacity >= m_chunks.size())
+        m_chunks.push_back(static_cast<std::byte*>(::operator new(ARCHETYPE_CHUNK_SIZE, std::align_val_t(ChunkAlignment))));
+
+    GetEntities(row / m_chunkCapacity)[row % m_chunkCapacity] = entity;
+    m_count++;
+
+    return row;
+}
+
+Entity Archetype::RemoveRow(uint32_t row)
+{
+    uint32_t last = m_count - 1;
+
+    for(uint32_t type = 0; type < (uint32_t)ComponentType::Count; type++)
+    {
+        if((m_mask & ComponentBit((ComponentType)type)) == 0)
+            continue;
+
+        auto& info = m_componentInfos[type];
+        void* removed = GetComponent((ComponentType)type, row);
+        info.Destroy(removed);
+
+        if(row != last)
+        {
+            void* moved = GetComponent((ComponentType)type, last);
+            info.MoveConstruct(removed, moved);
+            info.Destroy(moved);
+        }
+    }
+
+    Entity movedEntity = {};
+    if(row != last)
+    {
+        movedEntity = GetEntity(last);
+        GetEntities(row / m_chunkCapacity)[row % m_chunkCapacity] = movedEntity;
+    }
+
+    m_count--;
+
+    // Keep one spare chunk around to avoid thrashing when an entity goes back and forth
+    uint32_t usedChunks = (m_count + m_chunkCapacity - 1) / m_chunkCapacity;
+    while(m_chunks.size() > usedChunks + 1)
+    {
+        ::operator delete(m_chunks.back(), std::align_val_t(ChunkAlignment));
+        m_chunks.pop_back();
+    }
+
+    return movedEntity;
+}
@@ -0,0 +1,50 @@
+﻿#pragma once
+#include <Core.h>
+
+#include "Component.h"
+#include "Entity.h"
+
+#define ARCHETYPE_CHUNK_SIZE (16 * 1024)
+
+// Stores every entity sharing the same set of components.
+// Entities are packed in fixed size chunks, each chunk holding one contiguous array per component type (SoA).
+class Archetype
+{
+public:
+    Archetype(ComponentMask mask, const ComponentInfo* componentInfos);
+    ~Archetype();
+
+    Archetype(const Archetype&) = delete;
+    Archetype& operator=(const Archetype&) = delete;
+
+    ComponentMask GetMask() const { return m_mask; }
+    bool Has(ComponentType type) const { return (m_mask & ComponentBit(type)) != 0; }
+    bool Matches(ComponentMask required) const { return (m_mask & required) == required; }
+
+    uint32_t GetCount() const { return m_count; }
+    uint32_t GetChunkCount() const { return (uint32_t)m_chunks.size(); }
+    uint32_t GetChunkCapacity() const { return m_chunkCapacity; }
+    uint32_t GetChunkEntityCount(uint32_t chunkIdx) const;
+
+    Entity* GetEntities(uint32_t chunkIdx) { return reinterpret_cast<Entity*>(m_chunks[chunkIdx]); }
+    Entity GetEntity(uint32_t row) { return GetEntities(row / m_chunkCapacity)[row % m_chunkCapacity]; }
+
+    template<typename T>
+    T* GetComponentArray(uint32_t chunkIdx) { return reinterpret_cast<T*>(m_chunks[chunkIdx] + m_componentOffsets[(uint32_t)T::Type]); }
+
+    void* GetComponent(ComponentType type, uint32_t row);
+
+    // Reserves a row for the entity, components memory is left uninitialized and must be constructed by the caller
+    uint32_t AllocateRow(Entity entity);
+    // Destroys the row components and moves the last row into it, returns the entity that moved (invalid if none)
+    Entity RemoveRow(uint32_t row);
+
+private:
+    ComponentMask m_mask;
+    const ComponentInfo* m_componentInfos;
+    uint32_t m_componentOffsets[(uint32_t)ComponentType::Count] = {};
+    uint32_t m_chunkCapacity = 0;
+    uint32_t m_count = 0;
+
+    std::vector<std::byte*> m_chunks;
+};
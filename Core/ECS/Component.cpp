@@ -1,9 +0,0 @@
-﻿#include "Component.h"
-
-Component::Component()
-{
-}
-
-Component::~Component()
-{
-}
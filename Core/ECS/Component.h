@@ -1,9 +1,42 @@
 ﻿#pragma once
 #include <Core.h>
 
-class Component
+// Every component type gets a compile time id, used as its bit in archetype masks
+enum class ComponentType : uint32_t
 {
-public:
-    Component();
-    virtual ~Component();
+    Transform,
+    Mesh,
+    PointLight,
+    Count
 };
+
+using ComponentMask = uint64_t;
+
+static_assert((uint32_t)ComponentType::Count <= 64, "ComponentMask can only hold 64 component types");
+
+constexpr ComponentMask ComponentBit(ComponentType type) { return 1ull << (uint32_t)type; }
+
+template<typename... Ts>
+constexpr ComponentMask ComponentsMask() { return (ComponentMask(0) | ... | ComponentBit(Ts::Type)); }
+
+// Type erased lifetime functions, so archetypes can store components in raw chunk memory
+struct ComponentInfo
+{
+    size_t Size = 0;
+    size_t Alignment = 1;
+    void (*Construct)(void* dst) = nullptr;
+    void (*MoveConstruct)(void* dst, void* src) = nullptr;
+    void (*Destroy)(void* ptr) = nullptr;
+};
+
+template<typename T>
+ComponentInfo MakeComponentInfo()
+{
+    ComponentInfo info;
+    info.Size = sizeof(T);
+    info.Alignment = alignof(T);
+    info.Construct = [](void* dst) { new (dst) T(); };
+    info.MoveConstruct = [](void* dst, void* src) { new (dst) T(std::move(*static_cast<T*>(src))); };
+    info.Destroy = [](void* ptr) { static_cast<T*>(ptr)->~T(); };
+    return info;
+}
@@ -0,0 +1,12 @@
+﻿#pragma once
+#include <Core.h>
+
+struct Entity
+{
+    uint32_t Index = UINT32_MAX;
+    uint32_t Generation = 0;
+
+    bool IsValid() const { return Index != UINT32_MAX; }
+    bool operator==(const Entity& other) const { return Index == other.Index && Generation == other.Generation; }
+    bool operator!=(const Entity& other) const { return !(*this == other); }
+};
@@ -1,10 +1,16 @@
 ﻿#include "GameObject.h"
+#include "Scene.h"
 
-GameObject::GameObject(std::string name) : m_name(name)
+GameObject::GameObject(Scene* scene, Entity entity) : m_scene(scene), m_entity(entity)
 {
 }
 
-GameObject::~GameObject()
+std::string GameObject::GetName() const
 {
-    m_components.clear();
+    return m_scene ? m_scene->GetName(m_entity) : std::string();
+}
+
+bool GameObject::IsValid() const
+{
+    return m_scene && m_scene->IsAlive(m_entity);
 }
@@ -1,37 +1,32 @@
 ﻿#pragma once
 #include <Core.h>
 
-#include "Component.h"
+#include "Entity.h"
 
+class Scene;
+
+// Lightweight handle on a scene entity, components live in the scene archetypes
 class GameObject
 {
 public:
-    GameObject(std::string name);
-    ~GameObject();
+    GameObject() = default;
+    GameObject(Scene* scene, Entity entity);
 
-    std::string GetName() { return m_name; }
+    std::string GetName() const;
+    Entity GetEntity() const { return m_entity; }
+    bool IsValid() const;
 
+    // Returned pointers stay valid until the entity components change (add/remove)
     template<typename T>
-    std::shared_ptr<T> AddComponent()
-    {
-        std::shared_ptr<T> newComp = std::make_shared<T>();
-        m_components.emplace_back(newComp);
-        return newComp;
-    }
+    T* AddComponent();
 
     template<typename T>
-    std::shared_ptr<T> GetComponent()
-    {
-        for(auto component : m_components)
-        {
-            if(auto typedComponent = std::dynamic_pointer_cast<T>(component))
-                return typedComponent;
-        }
+    T* GetComponent() const;
 
-        return nullptr;
-    }
+    bool operator==(const GameObject& other) const { return m_scene == other.m_scene && m_entity == other.m_entity; }
+    bool operator!=(const GameObject& other) const { return !(*this == other); }
 
 private:
-    std::string m_name;
-    std::vector<std::shared_ptr<Component>> m_components;
+    Scene* m_scene = nullptr;
+    Entity m_entity;
 };
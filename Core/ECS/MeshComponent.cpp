@@ -7,4 +7,11 @@ MeshComponent::MeshComponent()
 
 MeshComponent::~MeshComponent()
 {
+}
+
+void MeshComponent::SetRenderItem(std::shared_ptr<RenderItem> renderItem)
+{
+    m_renderItem = renderItem;
+    if(m_renderItem)
+        m_material = m_renderItem->GetMaterial();
 }
\ No newline at end of file
@@ -3,15 +3,21 @@
 #include "../Rendering/RenderItem.h"
 #include "Component.h"
 
-class MeshComponent : public Component
+class MeshComponent
 {
 public:
+    static constexpr ComponentType Type = ComponentType::Mesh;
+
     MeshComponent();
-    ~MeshComponent() override;
+    ~MeshComponent();
 
-    void SetRenderItem(std::shared_ptr<RenderItem> renderItem) { m_renderItem = renderItem; }
-    std::shared_ptr<RenderItem> GetRenderItem() { return m_renderItem; }
+    // Starts with the render item material, the entities sharing a render item can each set their own
+    void SetRenderItem(std::shared_ptr<RenderItem> renderItem);
+    const std::shared_ptr<RenderItem>& GetRenderItem() const { return m_renderItem; }
+    void SetMaterial(const Material& material) { m_material = material; }
+    const Material& GetMaterial() const { return m_material; }
     
 private:
     std::shared_ptr<RenderItem> m_renderItem;
+    Material m_material;
 };
@@ -3,11 +3,13 @@
 #include "Component.h"
 #include "../../Rendering/RenderingLayouts.h"
 
-class PointLightComponent : public Component
+class PointLightComponent
 {
 public:
+    static constexpr ComponentType Type = ComponentType::PointLight;
+
     PointLightComponent();
-    ~PointLightComponent() override;
+    ~PointLightComponent();
 
     PointLight m_pointLight;
 };
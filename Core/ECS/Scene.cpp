@@ -2,31 +2,188 @@
 
 Scene::Scene(std::string name) : m_name(name)
 {
+    // Root archetype, entities without any component
+    GetOrCreateArchetype(0);
 }
 
 Scene::~Scene()
 {
     m_gameObjects.clear();
+    m_archetypesByMask.clear();
+    m_archetypes.clear();
 }
 
-std::shared_ptr<GameObject> Scene::CreateGameObject(std::string name, DirectX::XMFLOAT3 position, DirectX::XMFLOAT3 rotation, DirectX::XMFLOAT3 scale)
+GameObject Scene::CreateGameObject(std::string name, DirectX::XMFLOAT3 position, DirectX::XMFLOAT3 rotation, DirectX::XMFLOAT3 scale)
 {
     name += "_";
     name += std::to_string(m_gameObjects.size());
-    std::shared_ptr<GameObject> go = std::make_shared<GameObject>(name);
+    GameObject go(this, CreateEntity(name));
     m_gameObjects.emplace_back(go);
 
-    auto tfComp = go->AddComponent<TransformComponent>();
-    DirectX::XMMATRIX mat = DirectX::XMMatrixIdentity();
-    mat *= DirectX::XMMatrixRotationRollPitchYaw(DirectX::XMConvertToRadians(rotation.x), DirectX::XMConvertToRadians(rotation.y),DirectX::XMConvertToRadians(rotation.z));
-    mat *= DirectX::XMMatrixScaling(scale.x, scale.y, scale.z);
-    mat *= DirectX::XMMatrixTranslation(position.x, position.y, position.z);
-    DirectX::XMStoreFloat4x4(&tfComp->m_transform, mat);
-    
+    go.AddComponent<TransformComponent>();
+    DirectX::XMFLOAT4 quaternion;
+    DirectX::XMStoreFloat4(&quaternion, DirectX::XMQuaternionRotationRollPitchYaw(DirectX::XMConvertToRadians(rotation.x), DirectX::XMConvertToRadians(rotation.y),DirectX::XMConvertToRadians(rotation.z)));
+    m_transformHierarchy.SetLocalTransform(go.GetEntity(), position, quaternion, scale);
+
     return go;
 }
 
-void Scene::RemoveGameObject(std::shared_ptr<GameObject> goToRemove)
+void Scene::RemoveGameObject(GameObject goToRemove)
 {
     m_gameObjects.erase(std::remove(m_gameObjects.begin(), m_gameObjects.end(), goToRemove), m_gameObjects.end());
+    DestroyEntity(goToRemove.GetEntity());
+}
+
+Entity Scene::CreateEntity(const std::string& name)
+{
+    uint32_t index;
+    if(!m_freeEntities.empty())
+    {
+        index = m_freeEntities.back();
+        m_freeEntities.pop_back();
+    }
+    else
+    {
+        index = (uint32_t)m_entities.size();
+        m_entities.emplace_back();
+    }
+
+    Entity entity;
+    entity.Index = index;
+    entity.Generation = m_entities[index].Generation;
+
+    auto& record = m_entities[index];
+    record.Archetype = m_archetypesByMask[0];
+    record.Row = record.Archetype->AllocateRow(entity);
+    record.Name = name;
+
+    return entity;
+}
+
+void Scene::DestroyEntity(Entity entity)
+{
+    if(!IsAlive(entity))
+        return;
+
+    m_transformHierarchy.RemoveNode(entity);
+
+    auto& record = m_entities[entity.Index];
+    Entity moved = record.Archetype->RemoveRow(record.Row);
+    if(moved.IsValid())
+        m_entities[moved.Index].Row = record.Row;
+
+    record.Archetype = nullptr;
+    record.Name.clear();
+    record.ChangeFlags = 0;
+    record.Generation++;
+    m_freeEntities.push_back(entity.Index);
+    m_destroyedEntities.push_back(entity);
+}
+
+bool Scene::IsAlive(Entity entity) const
+{
+    return entity.Index < m_entities.size() && m_entities[entity.Index].Archetype != nullptr && m_entities[entity.Index].Generation == entity.Generation;
+}
+
+Entity Scene::GetEntity(uint32_t index) const
+{
+    Entity entity;
+    if(index < m_entities.size() && m_entities[index].Archetype != nullptr)
+    {
+        entity.Index = index;
+        entity.Generation = m_entities[index].Generation;
+    }
+    return entity;
+}
+
+const std::string& Scene::GetName(Entity entity) const
+{
+    static const std::string emptyName;
+    return IsAlive(entity) ? m_entities[entity.Index].Name : emptyName;
+}
+
+void Scene::MarkDirty(Entity entity, EntityChange change)
+{
+    if(!IsAlive(entity))
+        return;
+
+    auto& record = m_entities[entity.Index];
+    if(record.ChangeFlags == 0)
+        m_changedEntities.push_back(entity);
+
+    record.ChangeFlags |= (uint32_t)change;
+}
+
+uint32_t Scene::GetChangeFlags(Entity entity) const
+{
+    return IsAlive(entity) ? m_entities[entity.Index].ChangeFlags : 0;
+}
+
+void Scene::ClearChanges()
+{
+    for(auto entity : m_changedEntities)
+    {
+        if(IsAlive(entity))
+            m_entities[entity.Index].ChangeFlags = 0;
+    }
+
+    m_changedEntities.clear();
+    m_destroyedEntities.clear();
+}
+
+void Scene::UpdateTransforms()
+{
+    PROFILE_FUNCTION();
+
+    m_transformHierarchy.Update();
+
+    for(auto entity : m_transformHierarchy.GetUpdatedEntities())
+    {
+        if(auto tfComp = GetComponent<TransformComponent>(entity))
+        {
+            tfComp->m_transform = m_transformHierarchy.GetWorldMatrix(entity);
+            MarkDirty(entity, EntityChange::Transform);
+        }
+    }
+}
+
+Archetype* Scene::GetOrCreateArchetype(ComponentMask mask)
+{
+    auto it = m_archetypesByMask.find(mask);
+    if(it != m_archetypesByMask.end())
+        return it->second;
+
+    auto archetype = std::make_unique<Archetype>(mask, m_componentInfos);
+    Archetype* archetypePtr = archetype.get();
+    m_archetypes.emplace_back(std::move(archetype));
+    m_archetypesByMask.emplace(mask, archetypePtr);
+
+    return archetypePtr;
+}
+
+void Scene::MoveEntity(Entity entity, Archetype* destination)
+{
+    auto& record = m_entities[entity.Index];
+    Archetype* source = record.Archetype;
+    uint32_t sourceRow = record.Row;
+
+    uint32_t destinationRow = destination->AllocateRow(entity);
+    for(uint32_t type = 0; type < (uint32_t)ComponentType::Count; type++)
+    {
+        if(!destination->Has((ComponentType)type))
+            continue;
+
+        void* dst = destination->GetComponent((ComponentType)type, destinationRow);
+        if(source->Has((ComponentType)type))
+            m_componentInfos[type].MoveConstruct(dst, source->GetComponent((ComponentType)type, sourceRow));
+        else
+            m_componentInfos[type].Construct(dst);
+    }
+
+    Entity moved = source->RemoveRow(sourceRow);
+    if(moved.IsValid())
+        m_entities[moved.Index].Row = sourceRow;
+
+    record.Archetype = destination;
+    record.Row = destinationRow;
 }
@@ -1,11 +1,23 @@
 ﻿#pragma once
 #include <Core.h>
+#include <unordered_map>
 
+#include "Archetype.h"
+#include "Entity.h"
 #include "GameObject.h"
 #include "TransformComponent.h"
 #include "MeshComponent.h"
 #include "Component.h"
 #include "PointLightComponent.h"
+#include "TransformHierarchy.h"
+
+// What changed on an entity since the last ClearChanges, consumed by the renderer extraction
+enum class EntityChange : uint32_t
+{
+    None = 0,
+    Components = 1 << 0,
+    Transform = 1 << 1
+};
 
 class Scene
 {
@@ -13,14 +25,150 @@ public:
     Scene(std::string name);
     ~Scene();
 
-    std::shared_ptr<GameObject> CreateGameObject(std::string name,
+    GameObject CreateGameObject(std::string name,
         DirectX::XMFLOAT3 position = { 0.0f, 0.0f, 0.0f },
         DirectX::XMFLOAT3 rotation = { 0.0f, 0.0f, 0.0f },
         DirectX::XMFLOAT3 scale = { 1.0f, 1.0f, 1.0f });
-    void RemoveGameObject(std::shared_ptr<GameObject> goToRemove);
+    void RemoveGameObject(GameObject goToRemove);
+
+    Entity CreateEntity(const std::string& name);
+    void DestroyEntity(Entity entity);
+    bool IsAlive(Entity entity) const;
+    // Live entity stored at index, invalid when the index is free
+    Entity GetEntity(uint32_t index) const;
+    const std::string& GetName(Entity entity) const;
+
+    // Transforms are written in place, callers must flag them so the render world picks them up
+    void MarkDirty(Entity entity, EntityChange change);
+    uint32_t GetChangeFlags(Entity entity) const;
+    const std::vector<Entity>& GetChangedEntities() const { return m_changedEntities; }
+    const std::vector<Entity>& GetDestroyedEntities() const { return m_destroyedEntities; }
+    void ClearChanges();
+
+    // Local transforms are edited through the hierarchy, UpdateTransforms pushes the new world matrices to the components
+    TransformHierarchy& GetTransformHierarchy() { return m_transformHierarchy; }
+    void UpdateTransforms();
+
+    template<typename T>
+    T* AddComponent(Entity entity)
+    {
+        if(!IsAlive(entity))
+            return nullptr;
+
+        m_componentInfos[(uint32_t)T::Type] = MakeComponentInfo<T>();
+
+        auto& record = m_entities[entity.Index];
+        ComponentMask mask = record.Archetype->GetMask() | ComponentBit(T::Type);
+        if(mask != record.Archetype->GetMask())
+        {
+            MoveEntity(entity, GetOrCreateArchetype(mask));
+            MarkDirty(entity, EntityChange::Components);
+        }
+
+        if constexpr (std::is_same_v<T, TransformComponent>)
+            m_transformHierarchy.AddNode(entity);
+
+        return GetComponent<T>(entity);
+    }
+
+    template<typename T>
+    void RemoveComponent(Entity entity)
+    {
+        if(!IsAlive(entity))
+            return;
+
+        auto& record = m_entities[entity.Index];
+        ComponentMask mask = record.Archetype->GetMask() & ~ComponentBit(T::Type);
+        if(mask != record.Archetype->GetMask())
+        {
+            MoveEntity(entity, GetOrCreateArchetype(mask));
+            MarkDirty(entity, EntityChange::Components);
+        }
+
+        if constexpr (std::is_same_v<T, TransformComponent>)
+            m_transformHierarchy.RemoveNode(entity);
+    }
+
+    template<typename T>
+    T* GetComponent(Entity entity)
+    {
+        if(!IsAlive(entity))
+            return nullptr;
 
-    std::vector<std::shared_ptr<GameObject>> m_gameObjects;
+        auto& record = m_entities[entity.Index];
+        return static_cast<T*>(record.Archetype->GetComponent(T::Type, record.Row));
+    }
+
+    // Calls func(Ts&...) or func(Entity, Ts&...) for every entity owning all the requested components,
+    // walking the matching archetypes chunk by chunk.
+    template<typename... Ts, typename F>
+    void Each(F&& func)
+    {
+        constexpr ComponentMask required = ComponentsMask<Ts...>();
+
+        for(auto& archetype : m_archetypes)
+        {
+            if(!archetype->Matches(required) || archetype->GetCount() == 0)
+                continue;
+
+            for(uint32_t chunkIdx = 0; chunkIdx < archetype->GetChunkCount(); chunkIdx++)
+            {
+                EachInChunk(func, archetype->GetChunkEntityCount(chunkIdx), archetype->GetEntities(chunkIdx),
+                    archetype->template GetComponentArray<Ts>(chunkIdx)...);
+            }
+        }
+    }
+
+    std::vector<GameObject> m_gameObjects;
 
 private:
+    struct EntityRecord
+    {
+        Archetype* Archetype = nullptr;
+        uint32_t Row = 0;
+        uint32_t Generation = 0;
+        uint32_t ChangeFlags = 0;
+        std::string Name;
+    };
+
+    template<typename F, typename... Ts>
+    static void EachInChunk(F& func, uint32_t count, Entity* entities, Ts*... componentArrays)
+    {
+        for(uint32_t i = 0; i < count; i++)
+        {
+            if constexpr (std::is_invocable_v<F&, Entity, Ts&...>)
+                func(entities[i], componentArrays[i]...);
+            else
+                func(componentArrays[i]...);
+        }
+    }
+
+    Archetype* GetOrCreateArchetype(ComponentMask mask);
+    void MoveEntity(Entity entity, Archetype* destination);
+
     std::string m_name;
+
+    ComponentInfo m_componentInfos[(uint32_t)ComponentType::Count];
+    std::vector<std::unique_ptr<Archetype>> m_archetypes;
+    std::unordered_map<ComponentMask, Archetype*> m_archetypesByMask;
+
+    std::vector<EntityRecord> m_entities;
+    std::vector<uint32_t> m_freeEntities;
+
+    std::vector<Entity> m_changedEntities;
+    std::vector<Entity> m_destroyedEntities;
+
+    TransformHierarchy m_transformHierarchy;
 };
+
+template<typename T>
+T* GameObject::AddComponent()
+{
+    return m_scene ? m_scene->AddComponent<T>(m_entity) : nullptr;
+}
+
+template<typename T>
+T* GameObject::GetComponent() const
+{
+    return m_scene ? m_scene->GetComponent<T>(m_entity) : nullptr;
+}
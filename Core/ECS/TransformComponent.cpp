@@ -2,6 +2,7 @@
 
 TransformComponent::TransformComponent()
 {
+    DirectX::XMStoreFloat4x4(&m_transform, DirectX::XMMatrixIdentity());
 }
 
 TransformComponent::~TransformComponent()
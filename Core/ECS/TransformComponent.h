@@ -1,11 +1,14 @@
 ﻿#pragma once
 #include "Component.h"
 
-class TransformComponent : public Component
+class TransformComponent
 {
 public:
+    static constexpr ComponentType Type = ComponentType::Transform;
+
     TransformComponent();
-    ~TransformComponent() override;
+    ~TransformComponent();
 
+    // World matrix, written by the scene transform hierarchy
     DirectX::XMFLOAT4X4 m_transform;
 };
@@ -0,0 +1,440 @@
+﻿#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "Jobs/JobSystem.h"
+
+using namespace DirectX;
+
+#define TRANSFORM_BATCH_SIZE 4
+#define TRANSFORM_BATCHES_PER_JOB 64
+
+TransformHierarchy::TransformHierarchy()
+{
+}
+
+TransformHierarchy::~TransformHierarchy()
+{
+}
+
+uint32_t TransformHierarchy::GetNode(Entity entity) const
+{
+    if(entity.Index >= m_entityNodes.size())
+        return InvalidNode;
+
+    uint32_t node = m_entityNodes[entity.Index];
+    if(node == InvalidNode || m_entities[node] != entity)
+        return InvalidNode;
+
+    return node;
+}
+
+void TransformHierarchy::AddNode(Entity entity)
+{
+    if(HasNode(entity))
+        return;
+
+    if(entity.Index >= m_entityNodes.size())
+        m_entityNodes.resize(entity.Index + 1, InvalidNode);
+
+    uint32_t node = (uint32_t)m_entities.size();
+    m_entityNodes[entity.Index] = node;
+    m_entities.emplace_back(entity);
+    m_parents.emplace_back(InvalidNode);
+
+    m_positionsX.emplace_back(0.0f);
+    m_positionsY.emplace_back(0.0f);
+    m_positionsZ.emplace_back(0.0f);
+    m_rotationsX.emplace_back(0.0f);
+    m_rotationsY.emplace_back(0.0f);
+    m_rotationsZ.emplace_back(0.0f);
+    m_rotationsW.emplace_back(1.0f);
+    m_scalesX.emplace_back(1.0f);
+    m_scalesY.emplace_back(1.0f);
+    m_scalesZ.emplace_back(1.0f);
+
+    XMFLOAT4X4 identity;
+    XMStoreFloat4x4(&identity, XMMatrixIdentity());
+    m_worlds.emplace_back(identity);
+    m_dirty.emplace_back(1);
+
+    // Appended as a root, depth order is only broken if roots aren't the last level
+    m_orderDirty = true;
+}
+
+void TransformHierarchy::RemoveNode(Entity entity)
+{
+    uint32_t node = GetNode(entity);
+    if(node == InvalidNode)
+        return;
+
+    uint32_t last = (uint32_t)m_entities.size() - 1;
+    for(uint32_t i = 0; i <= last; i++)
+    {
+        if(m_parents[i] == node)
+        {
+            m_parents[i] = InvalidNode;
+            m_dirty[i] = 1;
+        }
+        else if(m_parents[i] == last)
+        {
+            m_parents[i] = node;
+        }
+    }
+
+    auto SwapRemove = [node, last](auto& values)
+    {
+        values[node] = values[last];
+        values.pop_back();
+    };
+
+    m_entityNodes[entity.Index] = InvalidNode;
+    if(node != last)
+        m_entityNodes[m_entities[last].Index] = node;
+
+    SwapRemove(m_entities);
+    SwapRemove(m_parents);
+    SwapRemove(m_positionsX);
+    SwapRemove(m_positionsY);
+    SwapRemove(m_positionsZ);
+    SwapRemove(m_rotationsX);
+    SwapRemove(m_rotationsY);
+    SwapRemove(m_rotationsZ);
+    SwapRemove(m_rotationsW);
+    SwapRemove(m_scalesX);
+    SwapRemove(m_scalesY);
+    SwapRemove(m_scalesZ);
+    SwapRemove(m_worlds);
+    SwapRemove(m_dirty);
+
+    m_orderDirty = true;
+}
+
+void TransformHierarchy::SetParent(Entity child, Entity parent)
+{
+    uint32_t childNode = GetNode(child);
+    if(childNode == InvalidNode)
+        return;
+
+    uint32_t parentNode = GetNode(parent);
+    for(uint32_t ancestor = parentNode; ancestor != InvalidNode; ancestor = m_parents[ancestor])
+    {
+        if(ancestor == childNode)
+        {
+            LOG(Error, "TransformHierarchy : can't parent a node to one of its descendants");
+            return;
+        }
+    }
+
+    m_parents[childNode] = parentNode;
+    m_dirty[childNode] = 1;
+    m_orderDirty = true;
+}
+
+Entity TransformHierarchy::GetParent(Entity entity) const
+{
+    uint32_t node = GetNode(entity);
+    if(node == InvalidNode || m_parents[node] == InvalidNode)
+        return {};
+
+    return m_entities[m_parents[node]];
+}
+
+void TransformHierarchy::SetLocalPosition(Entity entity, const XMFLOAT3& position)
+{
+    uint32_t node = GetNode(entity);
+    if(node == InvalidNode)
+        return;
+
+    m_positionsX[node] = position.x;
+    m_positionsY[node] = position.y;
+    m_positionsZ[node] = position.z;
+    m_dirty[node] = 1;
+}
+
+void TransformHierarchy::SetLocalRotation(Entity entity, const XMFLOAT4& rotation)
+{
+    uint32_t node = GetNode(entity);
+    if(node == InvalidNode)
+        return;
+
+    XMFLOAT4 q;
+    XMStoreFloat4(&q, XMQuaternionNormalize(XMLoadFloat4(&rotation)));
+    m_rotationsX[node] = q.x;
+    m_rotationsY[node] = q.y;
+    m_rotationsZ[node] = q.z;
+    m_rotationsW[node] = q.w;
+    m_dirty[node] = 1;
+}
+
+void TransformHierarchy::SetLocalScale(Entity entity, const XMFLOAT3& scale)
+{
+    uint32_t node = GetNode(entity);
+    if(node == InvalidNode)
+        return;
+
+    m_scalesX[node] = scale.x;
+    m_scalesY[node] = scale.y;
+    m_scalesZ[node] = scale.z;
+    m_dirty[node] = 1;
+}
+
+void TransformHierarchy::SetLocalTransform(Entity entity, const XMFLOAT3& position, const XMFLOAT4& rotation, const XMFLOAT3& scale)
+{
+    SetLocalPosition(entity, position);
+    SetLocalRotation(entity, rotation);
+    SetLocalScale(entity, scale);
+}
+
+XMFLOAT3 TransformHierarchy::GetLocalPosition(Entity entity) const
+{
+    uint32_t node = GetNode(entity);
+    if(node == InvalidNode)
+        return { 0.0f, 0.0f, 0.0f };
+
+    return { m_positionsX[node], m_positionsY[node], m_positionsZ[node] };
+}
+
+XMFLOAT4 TransformHierarchy::GetLocalRotation(Entity entity) const
+{
+    uint32_t node = GetNode(entity);
+    if(node == InvalidNode)
+        return { 0.0f, 0.0f, 0.0f, 1.0f };
+
+    return { m_rotationsX[node], m_rotationsY[node], m_rotationsZ[node], m_rotationsW[node] };
+}
+
+XMFLOAT3 TransformHierarchy::GetLocalScale(Entity entity) const
+{
+    uint32_t node = GetNode(entity);
+    if(node == InvalidNode)
+        return { 1.0f, 1.0f, 1.0f };
+
+    return { m_scalesX[node], m_scalesY[node], m_scalesZ[node] };
+}
+
+const XMFLOAT4X4& TransformHierarchy::GetWorldMatrix(Entity entity) const
+{
+    static const XMFLOAT4X4 identity(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+
+    uint32_t node = GetNode(entity);
+    return node == InvalidNode ? identity : m_worlds[node];
+}
+
+void TransformHierarchy::Update()
+{
+    PROFILE_FUNCTION();
+
+    m_updatedEntities.clear();
+
+    if(m_orderDirty)
+        SortByDepth();
+
+    // Parents come first, a single forward pass pushes the dirty flags down the whole tree
+    uint32_t nodeCount = (uint32_t)m_entities.size();
+    for(uint32_t node = 0; node < nodeCount; node++)
+    {
+        if(!m_dirty[node] && m_parents[node] != InvalidNode && m_dirty[m_parents[node]])
+            m_dirty[node] = 1;
+    }
+
+    // Batches never straddle two levels, a node must see its parent final world matrix
+    for(uint32_t level = 0; level + 1 < m_levelStarts.size(); level++)
+    {
+        m_levelDirtyNodes.clear();
+        for(uint32_t node = m_levelStarts[level]; node < m_levelStarts[level + 1]; node++)
+        {
+            if(m_dirty[node])
+                m_levelDirtyNodes.emplace_back(node);
+        }
+
+        uint32_t dirtyCount = (uint32_t)m_levelDirtyNodes.size();
+        uint32_t batchCount = (dirtyCount + TRANSFORM_BATCH_SIZE - 1) / TRANSFORM_BATCH_SIZE;
+        auto ComposeBatches = [this, dirtyCount](uint32_t begin, uint32_t end)
+        {
+            for(uint32_t batch = begin; batch < end; batch++)
+            {
+                uint32_t first = batch * TRANSFORM_BATCH_SIZE;
+                ComposeBatch(&m_levelDirtyNodes[first], std::min(dirtyCount - first, (uint32_t)TRANSFORM_BATCH_SIZE));
+            }
+        };
+
+        // Nodes of a level only read the previous levels, their batches can run on any worker
+        if(JobSystem::Get() && batchCount > TRANSFORM_BATCHES_PER_JOB)
+            JobSystem::Get()->ParallelFor(batchCount, TRANSFORM_BATCHES_PER_JOB, ComposeBatches);
+        else
+            ComposeBatches(0, batchCount);
+    }
+
+    for(uint32_t node = 0; node < nodeCount; node++)
+    {
+        if(m_dirty[node])
+        {
+            m_updatedEntities.emplace_back(m_entities[node]);
+            m_dirty[node] = 0;
+        }
+    }
+}
+
+void TransformHierarchy::SortByDepth()
+{
+    uint32_t nodeCount = (uint32_t)m_entities.size();
+
+    std::vector<uint32_t> depths(nodeCount, InvalidNode);
+    uint32_t maxDepth = 0;
+    for(uint32_t node = 0; node < nodeCount; node++)
+    {
+        // Walk up until a node with a known depth, then fill the chain back down
+        uint32_t depth = 0;
+        uint32_t ancestor = node;
+        while(ancestor != InvalidNode && depths[ancestor] == InvalidNode)
+        {
+            ancestor = m_parents[ancestor];
+            depth++;
+        }
+
+        uint32_t baseDepth = ancestor == InvalidNode ? 0 : depths[ancestor] + 1;
+        for(uint32_t current = node; current != ancestor; current = m_parents[current])
+            depths[current] = baseDepth + --depth;
+
+        maxDepth = std::max(maxDepth, depths[node]);
+    }
+
+    std::vector<uint32_t> order(nodeCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&depths](uint32_t a, uint32_t b) { return depths[a] < depths[b]; });
+
+    std::vector<uint32_t> newNodes(nodeCount);
+    for(uint32_t i = 0; i < nodeCount; i++)
+        newNodes[order[i]] = i;
+
+    auto Permute = [&order](auto& values)
+    {
+        auto sorted = values;
+        for(uint32_t i = 0; i < order.size(); i++)
+            sorted[i] = values[order[i]];
+        values.swap(sorted);
+    };
+
+    Permute(m_entities);
+    Permute(m_parents);
+    Permute(m_positionsX);
+    Permute(m_positionsY);
+    Permute(m_positionsZ);
+    Permute(m_rotationsX);
+    Permute(m_rotationsY);
+    Permute(m_rotationsZ);
+    Permute(m_rotationsW);
+    Permute(m_scalesX);
+    Permute(m_scalesY);
+    Permute(m_scalesZ);
+    Permute(m_worlds);
+    Permute(m_dirty);
+
+    m_levelStarts.clear();
+    for(uint32_t node = 0; node < nodeCount; node++)
+    {
+        if(m_parents[node] != InvalidNode)
+            m_parents[node] = newNodes[m_parents[node]];
+
+        m_entityNodes[m_entities[node].Index] = node;
+
+        uint32_t depth = depths[order[node]];
+        while(m_levelStarts.size() <= depth)
+            m_levelStarts.emplace_back(node);
+    }
+    m_levelStarts.emplace_back(nodeCount);
+
+    m_orderDirty = false;
+}
+
+void TransformHierarchy::ComposeBatch(const uint32_t* nodes, uint32_t count)
+{
+    // Missing lanes repeat the last node, they compute the same matrix and are never stored
+    uint32_t n[TRANSFORM_BATCH_SIZE];
+    for(uint32_t lane = 0; lane < TRANSFORM_BATCH_SIZE; lane++)
+        n[lane] = nodes[std::min(lane, count - 1)];
+
+    auto Gather = [&n](const std::vector<float>& values)
+    {
+        return XMVectorSet(values[n[0]], values[n[1]], values[n[2]], values[n[3]]);
+    };
+
+    XMVECTOR qx = Gather(m_rotationsX);
+    XMVECTOR qy = Gather(m_rotationsY);
+    XMVECTOR qz = Gather(m_rotationsZ);
+    XMVECTOR qw = Gather(m_rotationsW);
+    XMVECTOR sx = Gather(m_scalesX);
+    XMVECTOR sy = Gather(m_scalesY);
+    XMVECTOR sz = Gather(m_scalesZ);
+
+    XMVECTOR one = XMVectorSplatOne();
+    XMVECTOR two = XMVectorReplicate(2.0f);
+
+    XMVECTOR xx = XMVectorMultiply(qx, qx);
+    XMVECTOR yy = XMVectorMultiply(qy, qy);
+    XMVECTOR zz = XMVectorMultiply(qz, qz);
+    XMVECTOR xy = XMVectorMultiply(qx, qy);
+    XMVECTOR xz = XMVectorMultiply(qx, qz);
+    XMVECTOR yz = XMVectorMultiply(qy, qz);
+    XMVECTOR xw = XMVectorMultiply(qx, qw);
+    XMVECTOR yw = XMVectorMultiply(qy, qw);
+    XMVECTOR zw = XMVectorMultiply(qz, qw);
+
+    // Local = Scale * Rotation * Translation, one lane per node, L[row][column]
+    XMVECTOR L[4][3];
+    L[0][0] = XMVectorMultiply(sx, XMVectorNegativeMultiplySubtract(two, XMVectorAdd(yy, zz), one));
+    L[0][1] = XMVectorMultiply(sx, XMVectorMultiply(two, XMVectorAdd(xy, zw)));
+    L[0][2] = XMVectorMultiply(sx, XMVectorMultiply(two, XMVectorSubtract(xz, yw)));
+    L[1][0] = XMVectorMultiply(sy, XMVectorMultiply(two, XMVectorSubtract(xy, zw)));
+    L[1][1] = XMVectorMultiply(sy, XMVectorNegativeMultiplySubtract(two, XMVectorAdd(xx, zz), one));
+    L[1][2] = XMVectorMultiply(sy, XMVectorMultiply(two, XMVectorAdd(yz, xw)));
+    L[2][0] = XMVectorMultiply(sz, XMVectorMultiply(two, XMVectorAdd(xz, yw)));
+    L[2][1] = XMVectorMultiply(sz, XMVectorMultiply(two, XMVectorSubtract(yz, xw)));
+    L[2][2] = XMVectorMultiply(sz, XMVectorNegativeMultiplySubtract(two, XMVectorAdd(xx, yy), one));
+    L[3][0] = Gather(m_positionsX);
+    L[3][1] = Gather(m_positionsY);
+    L[3][2] = Gather(m_positionsZ);
+
+    // Transpose the parents world matrices so P[row][column] holds that element for the 4 lanes
+    XMMATRIX parents[TRANSFORM_BATCH_SIZE];
+    for(uint32_t lane = 0; lane < TRANSFORM_BATCH_SIZE; lane++)
+    {
+        uint32_t parent = m_parents[n[lane]];
+        parents[lane] = parent == InvalidNode ? XMMatrixIdentity() : XMLoadFloat4x4(&m_worlds[parent]);
+    }
+
+    XMVECTOR P[4][4];
+    for(uint32_t row = 0; row < 4; row++)
+    {
+        XMMATRIX rows = XMMatrixTranspose(XMMATRIX(parents[0].r[row], parents[1].r[row], parents[2].r[row], parents[3].r[row]));
+        for(uint32_t column = 0; column < 4; column++)
+            P[row][column] = rows.r[column];
+    }
+
+    // World = Local * ParentWorld, the local last column is (0, 0, 0, 1)
+    XMVECTOR W[4][4];
+    for(uint32_t row = 0; row < 4; row++)
+    {
+        for(uint32_t column = 0; column < 4; column++)
+        {
+            XMVECTOR value = row == 3 ? P[3][column] : XMVectorZero();
+            value = XMVectorMultiplyAdd(L[row][0], P[0][column], value);
+            value = XMVectorMultiplyAdd(L[row][1], P[1][column], value);
+            value = XMVectorMultiplyAdd(L[row][2], P[2][column], value);
+            W[row][column] = value;
+        }
+    }
+
+    XMMATRIX worlds[TRANSFORM_BATCH_SIZE];
+    for(uint32_t row = 0; row < 4; row++)
+    {
+        XMMATRIX lanes = XMMatrixTranspose(XMMATRIX(W[row][0], W[row][1], W[row][2], W[row][3]));
+        for(uint32_t lane = 0; lane < TRANSFORM_BATCH_SIZE; lane++)
+            worlds[lane].r[row] = lanes.r[lane];
+    }
+
+    for(uint32_t lane = 0; lane < count; lane++)
+        XMStoreFloat4x4(&m_worlds[nodes[lane]], worlds[lane]);
+}
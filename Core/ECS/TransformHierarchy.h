@@ -0,0 +1,66 @@
+﻿#pragma once
+#include <Core.h>
+
+#include "Entity.h"
+
+// Local TRS of every transform stored as SoA, nodes sorted by depth so parents always come before their children.
+// World matrices of dirty nodes (and their descendants) are composed 4 at a time, level by level.
+class TransformHierarchy
+{
+public:
+    static constexpr uint32_t InvalidNode = UINT32_MAX;
+
+    TransformHierarchy();
+    ~TransformHierarchy();
+
+    void AddNode(Entity entity);
+    // Children of a removed node become roots
+    void RemoveNode(Entity entity);
+    bool HasNode(Entity entity) const { return GetNode(entity) != InvalidNode; }
+
+    // Keeps the child local transform, an invalid parent makes it a root
+    void SetParent(Entity child, Entity parent);
+    Entity GetParent(Entity entity) const;
+
+    void SetLocalPosition(Entity entity, const DirectX::XMFLOAT3& position);
+    void SetLocalRotation(Entity entity, const DirectX::XMFLOAT4& rotation);
+    void SetLocalScale(Entity entity, const DirectX::XMFLOAT3& scale);
+    void SetLocalTransform(Entity entity, const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT4& rotation, const DirectX::XMFLOAT3& scale);
+    DirectX::XMFLOAT3 GetLocalPosition(Entity entity) const;
+    DirectX::XMFLOAT4 GetLocalRotation(Entity entity) const;
+    DirectX::XMFLOAT3 GetLocalScale(Entity entity) const;
+    const DirectX::XMFLOAT4X4& GetWorldMatrix(Entity entity) const;
+
+    void Update();
+    // Entities whose world matrix changed during the last Update
+    const std::vector<Entity>& GetUpdatedEntities() const { return m_updatedEntities; }
+
+private:
+    uint32_t GetNode(Entity entity) const;
+    void SortByDepth();
+    void ComposeBatch(const uint32_t* nodes, uint32_t count);
+
+    std::vector<uint32_t> m_entityNodes; // Indexed by entity index
+    std::vector<Entity> m_entities;
+    std::vector<uint32_t> m_parents;
+
+    std::vector<float> m_positionsX;
+    std::vector<float> m_positionsY;
+    std::vector<float> m_positionsZ;
+    std::vector<float> m_rotationsX;
+    std::vector<float> m_rotationsY;
+    std::vector<float> m_rotationsZ;
+    std::vector<float> m_rotationsW;
+    std::vector<float> m_scalesX;
+    std::vector<float> m_scalesY;
+    std::vector<float> m_scalesZ;
+
+    std::vector<DirectX::XMFLOAT4X4> m_worlds;
+    std::vector<uint8_t> m_dirty;
+
+    std::vector<uint32_t> m_levelStarts; // First node of each depth, plus the node count
+    std::vector<uint32_t> m_levelDirtyNodes;
+    bool m_orderDirty = false;
+
+    std::vector<Entity> m_updatedEntities;
+};
@@ -0,0 +1,59 @@
+﻿#include "FrameArena.h"
+
+#include "Logger.h"
+
+FrameArena::FrameArena(size_t capacity) : m_capacity(capacity)
+{
+    m_memory = static_cast<uint8_t*>(::operator new(m_capacity, std::align_val_t(alignof(std::max_align_t))));
+}
+
+FrameArena::~FrameArena()
+{
+    for(auto& [block, alignment] : m_overflowBlocks)
+        ::operator delete(block, std::align_val_t(alignment));
+
+    ::operator delete(m_memory, std::align_val_t(alignof(std::max_align_t)));
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+    // The block is only aligned to max_align_t, align the address rather than the offset
+    uintptr_t base = reinterpret_cast<uintptr_t>(m_memory);
+    size_t alignedOffset = ((base + m_offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+    if(alignedOffset + size <= m_capacity)
+    {
+        m_offset = alignedOffset + size;
+        return m_memory + alignedOffset;
+    }
+
+    if(m_overflowBlocks.empty())
+        LOG(Warning, "FrameArena : capacity of " + std::to_string(m_capacity) + " bytes exceeded, spilling to the heap for this frame");
+
+    alignment = alignment > alignof(std::max_align_t) ? alignment : alignof(std::max_align_t);
+    void* block = ::operator new(size, std::align_val_t(alignment));
+    m_overflowBlocks.emplace_back(block, alignment);
+    m_overflowBytes += size + alignment;
+
+    return block;
+}
+
+void FrameArena::Reset()
+{
+    if(!m_overflowBlocks.empty())
+    {
+        for(auto& [block, alignment] : m_overflowBlocks)
+            ::operator delete(block, std::align_val_t(alignment));
+        m_overflowBlocks.clear();
+
+        size_t newCapacity = m_capacity;
+        while(newCapacity < m_offset + m_overflowBytes)
+            newCapacity *= 2;
+
+        ::operator delete(m_memory, std::align_val_t(alignof(std::max_align_t)));
+        m_memory = static_cast<uint8_t*>(::operator new(newCapacity, std::align_val_t(alignof(std::max_align_t))));
+        m_capacity = newCapacity;
+    }
+
+    m_offset = 0;
+    m_overflowBytes = 0;
+}
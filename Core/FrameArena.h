@@ -0,0 +1,87 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+#define FRAME_ARENA_SIZE (1024 * 1024)
+
+// Bump allocator for data that only lives for one frame, everything is released at once by Reset.
+// Not thread safe, meant to be used from the render thread.
+class FrameArena
+{
+public:
+    FrameArena(size_t capacity = FRAME_ARENA_SIZE);
+    ~FrameArena();
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    template<typename T>
+    T* Allocate(size_t count)
+    {
+        return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    // Allocations that did not fit spill to the heap, the next Reset grows the block so the following frames don't
+    void Reset();
+
+    size_t GetUsedBytes() const { return m_offset + m_overflowBytes; }
+    size_t GetCapacity() const { return m_capacity; }
+
+private:
+    uint8_t* m_memory = nullptr;
+    size_t m_capacity = 0;
+    size_t m_offset = 0;
+
+    std::vector<std::pair<void*, size_t>> m_overflowBlocks;
+    size_t m_overflowBytes = 0;
+};
+
+// Standard allocator on top of a FrameArena, deallocate is a no-op since the arena is reset as a whole
+template<typename T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    ArenaAllocator() = default;
+    ArenaAllocator(FrameArena& arena) : m_arena(&arena) {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.GetArena()) {}
+
+    T* allocate(size_t count)
+    {
+        if(!m_arena)
+            throw std::bad_alloc();
+
+        return m_arena->Allocate<T>(count);
+    }
+
+    void deallocate(T*, size_t) {}
+
+    FrameArena* GetArena() const { return m_arena; }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.GetArena(); }
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.GetArena(); }
+
+private:
+    FrameArena* m_arena = nullptr;
+};
+
+// Containers must be constructed with the arena, their content is invalid once the arena is reset
+template<typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
+
+template<typename K, typename V, typename Hash = std::hash<K>>
+using FrameHashMap = std::unordered_map<K, V, Hash, std::equal_to<K>, ArenaAllocator<std::pair<const K, V>>>;
@@ -0,0 +1,309 @@
+﻿#include "JobSystem.h"
+
+struct Job
+{
+    // Either a Run function or a ParallelFor range
+    std::function<void()> Function;
+    JobSystem::RangeFunction Range = nullptr;
+    const void* Context = nullptr;
+    uint32_t Begin = 0;
+    uint32_t End = 0;
+    JobCounter* Counter = nullptr;
+    std::atomic<uint32_t> NextFree { UINT32_MAX }; // In the pool free stack
+};
+
+namespace
+{
+    thread_local uint32_t t_queueIndex = UINT32_MAX;
+    thread_local uint32_t t_stealSeed = 0x9E3779B9u;
+
+    uint32_t NextStealVictim()
+    {
+        // xorshift, good enough to spread the thieves
+        t_stealSeed ^= t_stealSeed << 13;
+        t_stealSeed ^= t_stealSeed >> 17;
+        t_stealSeed ^= t_stealSeed << 5;
+        return t_stealSeed;
+    }
+
+    constexpr uint32_t IdleSpinCount = 64;
+    constexpr uint32_t NoFreeJob = UINT32_MAX;
+}
+
+JobSystem* JobSystem::s_jobSystem = nullptr;
+
+JobSystem::JobSystem(uint32_t workerCount)
+{
+    // Queue 0 belongs to the thread creating the system
+    t_queueIndex = 0;
+
+    m_jobPool = std::make_unique<Job[]>(JOB_POOL_CAPACITY);
+    for(uint32_t i = 0; i < JOB_POOL_CAPACITY; i++)
+        m_jobPool[i].NextFree.store(i + 1 < JOB_POOL_CAPACITY ? i + 1 : NoFreeJob, std::memory_order_relaxed);
+    m_freeJobs.store(0, std::memory_order_relaxed);
+
+    for(uint32_t i = 0; i <= workerCount; i++)
+        m_queues.emplace_back(std::make_unique<WorkStealingDeque<Job*, JOB_QUEUE_CAPACITY>>());
+
+    for(uint32_t i = 0; i < workerCount; i++)
+        m_workers.emplace_back(&JobSystem::WorkerLoop, this, i + 1);
+
+    LOG(Debug, "JobSystem : started " + std::to_string(workerCount) + " workers");
+}
+
+JobSystem::~JobSystem()
+{
+    m_running = false;
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_wakeCondition.notify_all();
+    }
+
+    for(auto& worker : m_workers)
+        worker.join();
+
+    // Anything left behind still has to run, counters may be waited on
+    while(TryExecuteOne()) {}
+
+    t_queueIndex = UINT32_MAX;
+    s_jobSystem = nullptr;
+}
+
+JobSystem* JobSystem::Get()
+{
+    return s_jobSystem;
+}
+
+void JobSystem::Create(uint32_t workerCount)
+{
+    if(s_jobSystem)
+        throw std::exception("Job System already created");
+
+    if(workerCount == 0)
+        workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+    s_jobSystem = new JobSystem(workerCount);
+}
+
+void JobSystem::Release()
+{
+    if(!s_jobSystem)
+        return;
+
+    delete s_jobSystem;
+}
+
+void JobSystem::Run(std::function<void()> function, JobCounter* counter, JobCounter* dependency)
+{
+    Job* job = AllocateJob();
+    job->Function = std::move(function);
+    job->Counter = counter;
+
+    if(counter)
+        counter->m_count.fetch_add(1, std::memory_order_relaxed);
+
+    if(dependency)
+    {
+        // Parked on the dependency, the last job of the group submits it
+        std::lock_guard<std::mutex> lock(dependency->m_continuationsMutex);
+        if(!dependency->IsDone())
+        {
+            dependency->m_continuations.emplace_back(job);
+            return;
+        }
+    }
+
+    Submit(job);
+}
+
+void JobSystem::ParallelFor(uint32_t count, uint32_t grainSize, RangeFunction function, const void* context)
+{
+    if(count == 0)
+        return;
+
+    grainSize = std::max(grainSize, 1u);
+    if(count <= grainSize)
+    {
+        function(context, 0, count);
+        return;
+    }
+
+    JobCounter counter;
+    for(uint32_t begin = grainSize; begin < count; begin += grainSize)
+    {
+        Job* job = AllocateJob();
+        job->Range = function;
+        job->Context = context;
+        job->Begin = begin;
+        job->End = std::min(begin + grainSize, count);
+        job->Counter = &counter;
+        counter.m_count.fetch_add(1, std::memory_order_relaxed);
+        Submit(job);
+    }
+
+    // The caller takes the first range itself rather than waiting idle
+    function(context, 0, grainSize);
+    Wait(counter);
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+    while(!counter.IsDone())
+    {
+        if(!TryExecuteOne())
+            std::this_thread::yield();
+    }
+
+    // The last job may still be releasing the continuations, don't let the caller destroy the counter under it
+    std::lock_guard<std::mutex> lock(counter.m_continuationsMutex);
+}
+
+void JobSystem::WorkerLoop(uint32_t queueIndex)
+{
+    t_queueIndex = queueIndex;
+    t_stealSeed ^= queueIndex * 0x85EBCA6Bu;
+    Profiler::SetThreadName("Worker " + std::to_string(queueIndex));
+
+    uint32_t idleCount = 0;
+    while(m_running)
+    {
+        if(TryExecuteOne())
+        {
+            idleCount = 0;
+            continue;
+        }
+
+        if(++idleCount < IdleSpinCount)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Timed wait, a submit racing with going to sleep only costs a millisecond
+        m_sleepingWorkers.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            if(m_running)
+                m_wakeCondition.wait_for(lock, std::chrono::milliseconds(1));
+        }
+        m_sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+        idleCount = 0;
+    }
+}
+
+Job* JobSystem::AllocateJob()
+{
+    uint64_t head = m_freeJobs.load(std::memory_order_acquire);
+    while(true)
+    {
+        uint32_t index = (uint32_t)head;
+        if(index == NoFreeJob)
+            return new Job();
+
+        uint32_t next = m_jobPool[index].NextFree.load(std::memory_order_relaxed);
+        uint64_t newHead = (((head >> 32) + 1) << 32) | next;
+        if(m_freeJobs.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire))
+            return &m_jobPool[index];
+    }
+}
+
+void JobSystem::FreeJob(Job* job)
+{
+    if(job < m_jobPool.get() || job >= m_jobPool.get() + JOB_POOL_CAPACITY)
+    {
+        delete job;
+        return;
+    }
+
+    job->Function = nullptr;
+    job->Range = nullptr;
+    job->Counter = nullptr;
+
+    uint32_t index = (uint32_t)(job - m_jobPool.get());
+    uint64_t head = m_freeJobs.load(std::memory_order_relaxed);
+    while(true)
+    {
+        job->NextFree.store((uint32_t)head, std::memory_order_relaxed);
+        uint64_t newHead = (((head >> 32) + 1) << 32) | index;
+        if(m_freeJobs.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed))
+            return;
+    }
+}
+
+void JobSystem::Submit(Job* job)
+{
+    uint32_t queueIndex = t_queueIndex;
+    if(queueIndex == UINT32_MAX || !m_queues[queueIndex]->Push(job))
+    {
+        // Unknown thread or full deque, run it right away
+        Execute(job);
+        return;
+    }
+
+    if(m_sleepingWorkers.load(std::memory_order_relaxed) > 0)
+        m_wakeCondition.notify_one();
+}
+
+bool JobSystem::TryExecuteOne()
+{
+    Job* job = nullptr;
+
+    uint32_t queueIndex = t_queueIndex;
+    if(queueIndex != UINT32_MAX && m_queues[queueIndex]->Pop(job))
+    {
+        Execute(job);
+        return true;
+    }
+
+    uint32_t queueCount = (uint32_t)m_queues.size();
+    uint32_t start = NextStealVictim() % queueCount;
+    for(uint32_t i = 0; i < queueCount; i++)
+    {
+        uint32_t victim = (start + i) % queueCount;
+        if(victim != queueIndex && m_queues[victim]->Steal(job))
+        {
+            Execute(job);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void JobSystem::Execute(Job* job)
+{
+    if(job->Range)
+        job->Range(job->Context, job->Begin, job->End);
+    else
+        job->Function();
+
+    // Freed before completing, the counter may release a waiter that destroys the system
+    JobCounter* counter = job->Counter;
+    FreeJob(job);
+    Complete(counter);
+}
+
+void JobSystem::Complete(JobCounter* counter)
+{
+    if(!counter)
+        return;
+
+    // Not the last one, a plain decrement is enough
+    int32_t count = counter->m_count.load(std::memory_order_relaxed);
+    while(count > 1)
+    {
+        if(counter->m_count.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+            return;
+    }
+
+    // Reaching zero happens under the lock so parked jobs and waiters see a consistent counter
+    std::vector<Job*> continuations;
+    {
+        std::lock_guard<std::mutex> lock(counter->m_continuationsMutex);
+        if(counter->m_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            continuations.swap(counter->m_continuations);
+    }
+
+    for(auto job : continuations)
+        Submit(job);
+}
@@ -0,0 +1,90 @@
+﻿#pragma once
+#include <Core.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "WorkStealingDeque.h"
+
+#define JOB_QUEUE_CAPACITY 4096
+// Jobs recycled without touching the heap, past that many in flight they are allocated
+#define JOB_POOL_CAPACITY 4096
+
+struct Job;
+
+// Counts the jobs of a group still running, jobs depending on the group are released once it reaches zero
+class JobCounter
+{
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool IsDone() const { return m_count.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<int32_t> m_count { 0 };
+    std::mutex m_continuationsMutex;
+    std::vector<Job*> m_continuations;
+};
+
+// Work stealing job system, one deque per worker plus one for the thread that created it.
+// Jobs must be submitted from that thread or from inside other jobs.
+class JobSystem
+{
+private:
+    JobSystem(uint32_t workerCount);
+    ~JobSystem();
+
+public:
+    static JobSystem* Get();
+    // 0 workers uses every hardware thread but the calling one
+    static void Create(uint32_t workerCount = 0);
+    static void Release();
+
+    using RangeFunction = void (*)(const void* context, uint32_t begin, uint32_t end);
+
+    // counter is incremented now and decremented once the job has run, the job starts only after dependency is done.
+    // Functions too large for the std::function small buffer allocate, per frame work goes through ParallelFor.
+    void Run(std::function<void()> function, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+
+    // Splits [0, count) in ranges of at most grainSize and waits for all of them, the caller takes part in the work.
+    // The ranges only reference the function, nothing is allocated.
+    template<typename Function>
+    void ParallelFor(uint32_t count, uint32_t grainSize, const Function& function)
+    {
+        ParallelFor(count, grainSize, [](const void* context, uint32_t begin, uint32_t end) { (*(const Function*)context)(begin, end); }, &function);
+    }
+    void ParallelFor(uint32_t count, uint32_t grainSize, RangeFunction function, const void* context);
+
+    // Runs pending jobs until the counter reaches zero instead of blocking
+    void Wait(JobCounter& counter);
+
+    uint32_t GetWorkerCount() const { return (uint32_t)m_workers.size(); }
+
+private:
+    void WorkerLoop(uint32_t queueIndex);
+    Job* AllocateJob();
+    void FreeJob(Job* job);
+    void Submit(Job* job);
+    bool TryExecuteOne();
+    void Execute(Job* job);
+    void Complete(JobCounter* counter);
+
+    std::vector<std::thread> m_workers;
+    std::vector<std::unique_ptr<WorkStealingDeque<Job*, JOB_QUEUE_CAPACITY>>> m_queues;
+
+    // Lock free stack of the free pool jobs, a tag in the high bits against ABA
+    std::unique_ptr<Job[]> m_jobPool;
+    std::atomic<uint64_t> m_freeJobs;
+
+    std::atomic<bool> m_running { true };
+    std::atomic<uint32_t> m_sleepingWorkers { 0 };
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wakeCondition;
+
+    static JobSystem* s_jobSystem;
+};
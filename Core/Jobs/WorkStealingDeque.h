@@ -0,0 +1,79 @@
+﻿#pragma once
+#include <Core.h>
+#include <atomic>
+
+// Chase-Lev deque with a fixed power of two capacity.
+// The owner thread pushes and pops at the bottom (LIFO), any other thread steals from the top (FIFO).
+template<typename T, uint32_t Capacity>
+class WorkStealingDeque
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "WorkStealingDeque capacity must be a power of two");
+
+public:
+    // Owner only, fails when the deque is full
+    bool Push(T item)
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        int64_t top = m_top.load(std::memory_order_acquire);
+        if(bottom - top >= (int64_t)Capacity)
+            return false;
+
+        m_items[bottom & Mask].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Owner only
+    bool Pop(T& item)
+    {
+        int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = m_top.load(std::memory_order_relaxed);
+
+        if(top > bottom)
+        {
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        item = m_items[bottom & Mask].load(std::memory_order_relaxed);
+        if(top == bottom)
+        {
+            // Last item, race against the thieves for it
+            bool won = m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+
+        return true;
+    }
+
+    // Any thread
+    bool Steal(T& item)
+    {
+        int64_t top = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+        if(top >= bottom)
+            return false;
+
+        item = m_items[top & Mask].load(std::memory_order_relaxed);
+        return m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    bool IsEmpty() const
+    {
+        return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr int64_t Mask = Capacity - 1;
+
+    // Top and bottom on their own cache lines, thieves hammer top while the owner works on bottom
+    alignas(64) std::atomic<int64_t> m_top { 0 };
+    alignas(64) std::atomic<int64_t> m_bottom { 0 };
+    alignas(64) std::atomic<T> m_items[Capacity];
+};
@@ -5,57 +5,248 @@
 #include <filesystem>
 #include <fstream>
 
-void Logger::Log(LogType logType, const std::string& content)
+namespace
 {
-    HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-    std::string logPrefix;
+    struct LogMessage
+    {
+        LogType Type;
+        uint32_t ThreadId;
+        uint32_t Length;
+        std::chrono::system_clock::time_point Time;
+        char Text[LOG_MESSAGE_SIZE];
+    };
 
-    switch (logType)
+    // Bounded MPMC queue from Dmitry Vyukov, used here with a single consumer
+    class LogQueue
     {
-    case LogType::Debug:
-        logPrefix = "[Debug] ";
-        SetConsoleTextAttribute(hConsole, 10);
-        break;
-    case LogType::Warning:
-        logPrefix = "[Warning] ";
-        SetConsoleTextAttribute(hConsole, 14);
-        break;
-    case LogType::Error:
-        logPrefix = "[Error] ";
-        SetConsoleTextAttribute(hConsole, 12);
-        break;
-    default:
-        logPrefix = "[Debug] ";
-        SetConsoleTextAttribute(hConsole, 15);
-        break;
-    }
+    public:
+        LogQueue()
+        {
+            for(size_t i = 0; i < LOG_QUEUE_CAPACITY; i++)
+                m_cells[i].Sequence.store(i, std::memory_order_relaxed);
+        }
+
+        bool Enqueue(LogType type, const std::string& content)
+        {
+            Cell* cell;
+            size_t position = m_enqueuePosition.load(std::memory_order_relaxed);
+            while(true)
+            {
+                cell = &m_cells[position & Mask];
+                size_t sequence = cell->Sequence.load(std::memory_order_acquire);
+                intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+                if(difference == 0)
+                {
+                    if(m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if(difference < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    position = m_enqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+
+            auto& message = cell->Message;
+            message.Type = type;
+            message.ThreadId = (uint32_t)GetCurrentThreadId();
+            message.Time = std::chrono::system_clock::now();
+            message.Length = (uint32_t)(std::min)(content.size(), (size_t)LOG_MESSAGE_SIZE);
+            memcpy(message.Text, content.data(), message.Length);
+
+            cell->Sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Writer thread only
+        bool Dequeue(LogMessage& message)
+        {
+            Cell* cell = &m_cells[m_dequeuePosition & Mask];
+            if(cell->Sequence.load(std::memory_order_acquire) != m_dequeuePosition + 1)
+                return false;
+
+            message = cell->Message;
+            cell->Sequence.store(m_dequeuePosition + Mask + 1, std::memory_order_release);
+            m_dequeuePosition++;
+            return true;
+        }
+
+        size_t GetEnqueuedCount() const { return m_enqueuePosition.load(std::memory_order_acquire); }
+
+    private:
+        static constexpr size_t Mask = LOG_QUEUE_CAPACITY - 1;
+        static_assert((LOG_QUEUE_CAPACITY & Mask) == 0, "LOG_QUEUE_CAPACITY must be a power of two");
+
+        struct Cell
+        {
+            std::atomic<size_t> Sequence;
+            LogMessage Message;
+        };
+
+        alignas(64) std::atomic<size_t> m_enqueuePosition { 0 };
+        alignas(64) size_t m_dequeuePosition = 0;
+        alignas(64) Cell m_cells[LOG_QUEUE_CAPACITY];
+    };
 
-    std::cout << logPrefix << content << std::endl;
-    m_logMessages.push_back(logPrefix + content);
+    LogQueue s_queue;
+    std::ofstream s_file;
+    uint64_t s_fileSize = 0;
 
-    if(logType == LogType::Error)
+    void WriteMessage(const LogMessage& message)
     {
-        WriteLogsToFile();
+        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+        const char* logPrefix;
+
+        switch (message.Type)
+        {
+        case LogType::Debug:
+            logPrefix = "[Debug] ";
+            SetConsoleTextAttribute(hConsole, 10);
+            break;
+        case LogType::Warning:
+            logPrefix = "[Warning] ";
+            SetConsoleTextAttribute(hConsole, 14);
+            break;
+        case LogType::Error:
+            logPrefix = "[Error] ";
+            SetConsoleTextAttribute(hConsole, 12);
+            break;
+        default:
+            logPrefix = "[Debug] ";
+            SetConsoleTextAttribute(hConsole, 15);
+            break;
+        }
+
+        std::string content(message.Text, message.Length);
+        std::cout << logPrefix << content << '\n';
+
+        if(s_file.is_open())
+        {
+            std::time_t time = std::chrono::system_clock::to_time_t(message.Time);
+            auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(message.Time.time_since_epoch()).count() % 1000;
+            std::tm localTime;
+            localtime_s(&localTime, &time);
+
+            char timestamp[32];
+            snprintf(timestamp, sizeof(timestamp), "%02d:%02d:%02d.%03d ", localTime.tm_hour, localTime.tm_min, localTime.tm_sec, (int)milliseconds);
+
+            std::string line = std::string(timestamp) + "[" + std::to_string(message.ThreadId) + "] " + logPrefix + content + "\n";
+            s_file << line;
+            s_fileSize += line.size();
+        }
     }
 }
 
-void Logger::WriteLogsToFile()
+void Logger::Initialize(const std::string& logDirectory)
 {
-    Log(LogType::Debug, "Writing Logs to file");
+    if(m_running)
+        return;
 
-    std::filesystem::path currentDir = std::filesystem::current_path(); // filesystem is C++ 17 only
-    std::filesystem::path logDir = currentDir / "Log";
-    std::filesystem::create_directory(logDir);
+    m_logDirectory = logDirectory;
+    std::filesystem::create_directory(m_logDirectory);
 
-    std::filesystem::path logFilePath = logDir / "Log.txt";
-    std::ofstream file(logFilePath.string());
-    if (file.is_open()) {
-        for (const auto& log : m_logMessages) {
-            file << log << std::endl;
-        }
-        file.close();
-    }
-    else {
+    std::filesystem::path logFilePath = std::filesystem::path(m_logDirectory) / "Log.txt";
+    s_fileSize = std::filesystem::exists(logFilePath) ? std::filesystem::file_size(logFilePath) : 0;
+    s_file.open(logFilePath.string(), std::ios::app);
+    if(!s_file.is_open())
         std::cerr << "Failed to open log file." << std::endl;
+
+    m_running = true;
+    m_writerThread = std::thread(&Logger::WriterLoop);
+}
+
+void Logger::Shutdown()
+{
+    if(!m_running)
+        return;
+
+    m_running = false;
+    m_writerThread.join();
+
+    s_file.close();
+}
+
+void Logger::Flush()
+{
+    if(!m_running)
+        return;
+
+    uint64_t target = s_queue.GetEnqueuedCount();
+    while(m_writtenCount.load(std::memory_order_acquire) < target)
+        std::this_thread::yield();
+}
+
+void Logger::Log(LogType logType, const std::string& content)
+{
+    if(!s_queue.Enqueue(logType, content))
+        m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Logger::WriterLoop()
+{
+    LogMessage message;
+    uint64_t reportedDropped = 0;
+
+    while(true)
+    {
+        // Read before draining, the last pass after a shutdown request must see every message
+        bool running = m_running.load(std::memory_order_acquire);
+
+        // Bounded batches so drops and flushes are reported while producers keep the ring busy
+        uint64_t written = 0;
+        while(written < LOG_QUEUE_CAPACITY && s_queue.Dequeue(message))
+        {
+            WriteMessage(message);
+            written++;
+        }
+
+        uint64_t dropped = m_droppedCount.load(std::memory_order_relaxed);
+        if(dropped != reportedDropped)
+        {
+            LogMessage droppedMessage = {};
+            droppedMessage.Type = LogType::Warning;
+            droppedMessage.ThreadId = (uint32_t)GetCurrentThreadId();
+            droppedMessage.Time = std::chrono::system_clock::now();
+            std::string text = "Logger : dropped " + std::to_string(dropped - reportedDropped) + " messages, queue full";
+            droppedMessage.Length = (uint32_t)(std::min)(text.size(), (size_t)LOG_MESSAGE_SIZE);
+            memcpy(droppedMessage.Text, text.data(), droppedMessage.Length);
+            WriteMessage(droppedMessage);
+            reportedDropped = dropped;
+        }
+
+        if(written > 0)
+        {
+            std::cout.flush();
+            s_file.flush();
+            m_writtenCount.fetch_add(written, std::memory_order_release);
+
+            if(s_fileSize > LOG_FILE_MAX_SIZE)
+                RotateFiles();
+        }
+
+        if(!running && written == 0)
+            break;
+
+        if(written == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
     }
-}
\ No newline at end of file
+}
+
+void Logger::RotateFiles()
+{
+    // Log.txt -> Log.1.txt -> ... -> Log.N.txt, the oldest one is dropped
+    s_file.close();
+
+    std::filesystem::path logDir = m_logDirectory;
+    std::error_code error;
+    std::filesystem::remove(logDir / ("Log." + std::to_string(LOG_FILE_COUNT) + ".txt"), error);
+    for(int i = LOG_FILE_COUNT - 1; i >= 1; i--)
+        std::filesystem::rename(logDir / ("Log." + std::to_string(i) + ".txt"), logDir / ("Log." + std::to_string(i + 1) + ".txt"), error);
+    std::filesystem::rename(logDir / "Log.txt", logDir / "Log.1.txt", error);
+
+    s_file.open((logDir / "Log.txt").string(), std::ios::app);
+    s_fileSize = 0;
+}
@@ -1,6 +1,9 @@
 ﻿#pragma once
 
+#include <atomic>
 #include <chrono>
+#include <string>
+#include <thread>
 #include <vector>
 
 enum class LogType
@@ -10,19 +13,50 @@ enum class LogType
     Error
 };
 
+// Levels below this one are compiled out
+#ifndef LOG_COMPILE_LEVEL
+    #define LOG_COMPILE_LEVEL 0
+#endif
+
+#define LOG_MESSAGE_SIZE 256
+#define LOG_QUEUE_CAPACITY 4096
+#define LOG_FILE_MAX_SIZE (4 * 1024 * 1024)
+#define LOG_FILE_COUNT 4
+
+// Callers only push fixed size messages into a lock-free ring, formatting, console and file output happen on the writer thread.
+// Messages are dropped (and counted) when the ring is full rather than stalling the caller.
 class Logger {
 public:
+    static void Initialize(const std::string& logDirectory = "Log");
+    // Drains the ring and stops the writer thread
+    static void Shutdown();
+    // Blocks until every message logged so far is written
+    static void Flush();
+
+    static void SetLevel(LogType type) { m_level.store((int)type, std::memory_order_relaxed); }
+    static bool IsEnabled(LogType type) { return (int)type >= m_level.load(std::memory_order_relaxed); }
+
     static void Log(LogType type, const std::string& content);
-    static void WriteLogsToFile();
+    static uint64_t GetDroppedCount() { return m_droppedCount.load(std::memory_order_relaxed); }
 
 private:
-    inline static std::vector<std::string> m_logMessages;
-};
+    static void WriterLoop();
+    static void RotateFiles();
 
-#define LOG(type, content) Logger::Log(LogType::type, content)
+    inline static std::atomic<int> m_level { (int)LogType::Debug };
+    inline static std::atomic<uint64_t> m_droppedCount { 0 };
+    inline static std::atomic<uint64_t> m_writtenCount { 0 };
+    inline static std::atomic<bool> m_running { false };
+    inline static std::thread m_writerThread;
+    inline static std::string m_logDirectory;
+};
 
-#define PROFILE_BEGIN() auto profile_start_time = std::chrono::high_resolution_clock::now()
-#define PROFILE_END_AND_LOG(type, content) \
-auto profile_end_time = std::chrono::high_resolution_clock::now(); \
-auto profile_duration = std::chrono::duration_cast<std::chrono::microseconds>(profile_end_time - profile_start_time).count(); \
-LOG(type, std::string(content) + " Duration: " + std::to_string(profile_duration) + " microseconds")
+// The content expression is only evaluated when the level passes both filters
+#define LOG(type, content) \
+do { \
+    if constexpr ((int)LogType::type >= LOG_COMPILE_LEVEL) \
+    { \
+        if(Logger::IsEnabled(LogType::type)) \
+            Logger::Log(LogType::type, content); \
+    } \
+} while(0)
@@ -0,0 +1,62 @@
+﻿#include "MappedFile.h"
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const std::string& filePath)
+{
+    Close();
+
+    m_file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(m_file == INVALID_HANDLE_VALUE)
+    {
+        LOG(Error, "MappedFile : failed to open " + filePath);
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        LOG(Error, "MappedFile : empty or unreadable file " + filePath);
+        Close();
+        return false;
+    }
+    m_size = (uint64_t)fileSize.QuadPart;
+
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(!m_mapping)
+    {
+        LOG(Error, "MappedFile : failed to create the file mapping of " + filePath);
+        Close();
+        return false;
+    }
+
+    m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if(!m_data)
+    {
+        LOG(Error, "MappedFile : failed to map " + filePath);
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if(m_data)
+        UnmapViewOfFile(m_data);
+
+    if(m_mapping)
+        CloseHandle(m_mapping);
+
+    if(m_file != INVALID_HANDLE_VALUE)
+        CloseHandle(m_file);
+
+    m_data = nullptr;
+    m_mapping = nullptr;
+    m_file = INVALID_HANDLE_VALUE;
+    m_size = 0;
+}
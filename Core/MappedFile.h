@@ -0,0 +1,26 @@
+﻿#pragma once
+#include "Core.h"
+
+// Read-only memory mapping of a whole file, unmapped on destruction
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& filePath);
+    void Close();
+
+    const uint8_t* GetData() const { return m_data; }
+    uint64_t GetSize() const { return m_size; }
+    bool IsOpen() const { return m_data != nullptr; }
+
+private:
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+    const uint8_t* m_data = nullptr;
+    uint64_t m_size = 0;
+};
@@ -0,0 +1,199 @@
+﻿#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <intrin.h>
+#include <thread>
+
+#include "Logger.h"
+
+namespace
+{
+    thread_local ProfilerThreadBuffer* t_buffer = nullptr;
+
+    constexpr uint64_t EventsMask = PROFILER_EVENTS_PER_THREAD - 1;
+    static_assert((PROFILER_EVENTS_PER_THREAD & EventsMask) == 0, "PROFILER_EVENTS_PER_THREAD must be a power of two");
+
+    void WriteJsonString(std::ofstream& file, const std::string& value)
+    {
+        file << '"';
+        for(char c : value)
+        {
+            if(c == '"' || c == '\\')
+                file << '\\';
+            file << c;
+        }
+        file << '"';
+    }
+}
+
+void Profiler::Initialize()
+{
+    // Invariant TSC, calibrated once against the steady clock
+    auto clockStart = std::chrono::steady_clock::now();
+    uint64_t ticksStart = __rdtsc();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    auto clockEnd = std::chrono::steady_clock::now();
+    uint64_t ticksEnd = __rdtsc();
+
+    double seconds = std::chrono::duration<double>(clockEnd - clockStart).count();
+    m_ticksPerSecond = (uint64_t)((double)(ticksEnd - ticksStart) / seconds);
+    m_startTicks = ticksEnd;
+
+    SetThreadName("Main");
+
+    constexpr uint32_t calibrationScopes = 100000;
+    uint64_t calibrationStart = Now();
+    for(uint32_t i = 0; i < calibrationScopes; i++)
+    {
+        ProfileScope scope("Profiler Calibration");
+    }
+    uint64_t calibrationTicks = Now() - calibrationStart;
+    m_scopeOverheadNs = TicksToMicroseconds(calibrationTicks) * 1000.0 / calibrationScopes;
+
+    // Nobody reads the rings yet, drop the calibration events
+    t_buffer->Head.store(0, std::memory_order_release);
+
+    LOG(Debug, "Profiler : " + std::to_string(m_scopeOverheadNs) + " ns per scope");
+}
+
+void Profiler::SetThreadName(const std::string& name)
+{
+    auto buffer = GetThreadBuffer();
+    std::lock_guard<std::mutex> lock(m_buffersMutex);
+    buffer->ThreadName = name;
+}
+
+void Profiler::BeginFrame()
+{
+    m_frameStarts[m_frameCount % PROFILER_FRAME_HISTORY] = Now();
+    m_frameCount++;
+}
+
+uint64_t Profiler::Now()
+{
+    return __rdtsc();
+}
+
+void Profiler::BeginScope()
+{
+    GetThreadBuffer()->Depth++;
+}
+
+void Profiler::EndScope(const char* name, uint64_t begin)
+{
+    uint64_t end = Now();
+    auto buffer = t_buffer;
+
+    buffer->Depth--;
+
+    uint64_t head = buffer->Head.load(std::memory_order_relaxed);
+    ProfileEvent& event = buffer->Events[head & EventsMask];
+    event.Name = name;
+    event.Begin = begin;
+    event.End = end;
+    event.Depth = buffer->Depth;
+    buffer->Head.store(head + 1, std::memory_order_release);
+}
+
+bool Profiler::GetLastFrame(std::vector<ProfileThreadEvents>& threads, uint64_t& frameBegin, uint64_t& frameEnd)
+{
+    threads.clear();
+    if(m_frameCount < 2)
+        return false;
+
+    frameBegin = m_frameStarts[(m_frameCount - 2) % PROFILER_FRAME_HISTORY];
+    frameEnd = m_frameStarts[(m_frameCount - 1) % PROFILER_FRAME_HISTORY];
+
+    std::lock_guard<std::mutex> lock(m_buffersMutex);
+    for(auto& buffer : m_buffers)
+    {
+        ProfileThreadEvents threadEvents;
+        threadEvents.ThreadName = buffer->ThreadName;
+        CopyEvents(*buffer, frameBegin, frameEnd, threadEvents.Events);
+        if(!threadEvents.Events.empty())
+            threads.emplace_back(std::move(threadEvents));
+    }
+
+    return true;
+}
+
+void Profiler::ExportChromeTrace(const std::string& filePath)
+{
+    std::ofstream file(filePath);
+    if(!file.is_open())
+    {
+        LOG(Error, "Profiler : failed to open " + filePath);
+        return;
+    }
+
+    auto Timestamp = [](uint64_t ticks) { return TicksToMicroseconds(ticks > m_startTicks ? ticks - m_startTicks : 0); };
+
+    file << "{\"traceEvents\":[";
+    bool first = true;
+
+    std::lock_guard<std::mutex> lock(m_buffersMutex);
+    std::vector<ProfileEvent> events;
+    for(auto& buffer : m_buffers)
+    {
+        file << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->ThreadId << ",\"args\":{\"name\":";
+        WriteJsonString(file, buffer->ThreadName.empty() ? "Thread " + std::to_string(buffer->ThreadId) : buffer->ThreadName);
+        file << "}}";
+        first = false;
+
+        events.clear();
+        CopyEvents(*buffer, 0, UINT64_MAX, events);
+        for(const auto& event : events)
+        {
+            file << ",\n{\"name\":";
+            WriteJsonString(file, event.Name);
+            file << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->ThreadId << ",\"ts\":" << Timestamp(event.Begin) << ",\"dur\":" << TicksToMicroseconds(event.End - event.Begin) << "}";
+        }
+    }
+
+    uint64_t firstFrame = m_frameCount > PROFILER_FRAME_HISTORY ? m_frameCount - PROFILER_FRAME_HISTORY : 0;
+    for(uint64_t frame = firstFrame; frame < m_frameCount; frame++)
+        file << ",\n{\"name\":\"Frame " << frame << "\",\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":0,\"ts\":" << Timestamp(m_frameStarts[frame % PROFILER_FRAME_HISTORY]) << "}";
+
+    file << "\n]}\n";
+    file.close();
+
+    LOG(Debug, "Profiler : exported trace to " + filePath);
+}
+
+ProfilerThreadBuffer* Profiler::GetThreadBuffer()
+{
+    if(t_buffer)
+        return t_buffer;
+
+    auto buffer = std::make_unique<ProfilerThreadBuffer>();
+    buffer->Events = std::make_unique<ProfileEvent[]>(PROFILER_EVENTS_PER_THREAD);
+
+    std::lock_guard<std::mutex> lock(m_buffersMutex);
+    buffer->ThreadId = (uint32_t)m_buffers.size();
+    t_buffer = buffer.get();
+    m_buffers.emplace_back(std::move(buffer));
+
+    return t_buffer;
+}
+
+void Profiler::CopyEvents(ProfilerThreadBuffer& buffer, uint64_t begin, uint64_t end, std::vector<ProfileEvent>& events)
+{
+    uint64_t head = buffer.Head.load(std::memory_order_acquire);
+    uint64_t first = head > PROFILER_EVENTS_PER_THREAD ? head - PROFILER_EVENTS_PER_THREAD : 0;
+
+    size_t copyStart = events.size();
+    for(uint64_t i = first; i < head; i++)
+        events.emplace_back(buffer.Events[i & EventsMask]);
+
+    // The owner kept writing while copying, the oldest slots may have been overwritten
+    uint64_t newHead = buffer.Head.load(std::memory_order_acquire);
+    uint64_t overwritten = newHead > first + PROFILER_EVENTS_PER_THREAD ? newHead - first - PROFILER_EVENTS_PER_THREAD : 0;
+    events.erase(events.begin() + copyStart, events.begin() + copyStart + std::min<uint64_t>(overwritten, head - first));
+
+    events.erase(std::remove_if(events.begin() + copyStart, events.end(), [begin, end](const ProfileEvent& event)
+    {
+        return event.End <= begin || event.Begin >= end;
+    }), events.end());
+}
@@ -0,0 +1,105 @@
+﻿#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef PROFILER_ENABLED
+    #define PROFILER_ENABLED 1
+#endif
+
+#define PROFILER_EVENTS_PER_THREAD (16 * 1024)
+#define PROFILER_FRAME_HISTORY 8
+
+struct ProfileEvent
+{
+    const char* Name; // Must outlive the profiler, string literals or __FUNCTION__
+    uint64_t Begin;
+    uint64_t End;
+    uint32_t Depth;
+};
+
+// Single writer ring, only the owning thread records, readers copy and drop what got overwritten meanwhile
+struct ProfilerThreadBuffer
+{
+    std::string ThreadName;
+    uint32_t ThreadId = 0;
+    uint32_t Depth = 0;
+    std::atomic<uint64_t> Head { 0 };
+    std::unique_ptr<ProfileEvent[]> Events;
+};
+
+struct ProfileThreadEvents
+{
+    std::string ThreadName;
+    std::vector<ProfileEvent> Events;
+};
+
+class Profiler
+{
+public:
+    // Calibrates the timestamp counter and measures the cost of a scope
+    static void Initialize();
+    static void SetThreadName(const std::string& name);
+    static void BeginFrame();
+
+    static uint64_t Now();
+    static void BeginScope();
+    static void EndScope(const char* name, uint64_t begin);
+
+    static double TicksToMicroseconds(uint64_t ticks) { return (double)ticks * 1000000.0 / (double)m_ticksPerSecond; }
+    static double GetScopeOverheadNs() { return m_scopeOverheadNs; }
+
+    // Events of every thread recorded during the last completed frame
+    static bool GetLastFrame(std::vector<ProfileThreadEvents>& threads, uint64_t& frameBegin, uint64_t& frameEnd);
+    // Everything still held by the thread rings, viewable in chrome://tracing or Perfetto
+    static void ExportChromeTrace(const std::string& filePath);
+
+private:
+    static ProfilerThreadBuffer* GetThreadBuffer();
+    static void CopyEvents(ProfilerThreadBuffer& buffer, uint64_t begin, uint64_t end, std::vector<ProfileEvent>& events);
+
+    inline static std::mutex m_buffersMutex;
+    inline static std::vector<std::unique_ptr<ProfilerThreadBuffer>> m_buffers;
+
+    inline static uint64_t m_frameStarts[PROFILER_FRAME_HISTORY] = {};
+    inline static uint64_t m_frameCount = 0;
+
+    inline static uint64_t m_startTicks = 0;
+    inline static uint64_t m_ticksPerSecond = 1;
+    inline static double m_scopeOverheadNs = 0.0;
+};
+
+class ProfileScope
+{
+public:
+    ProfileScope(const char* name) : m_name(name)
+    {
+        Profiler::BeginScope();
+        m_begin = Profiler::Now();
+    }
+
+    ~ProfileScope()
+    {
+        Profiler::EndScope(m_name, m_begin);
+    }
+
+private:
+    const char* m_name;
+    uint64_t m_begin;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#if PROFILER_ENABLED
+    #define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+    #define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+    #define PROFILE_FRAME() Profiler::BeginFrame()
+#else
+    #define PROFILE_SCOPE(name)
+    #define PROFILE_FUNCTION()
+    #define PROFILE_FRAME()
+#endif
@@ -12,6 +12,8 @@ ResourcesManager::~ResourcesManager()
 
 std::shared_ptr<Texture> ResourcesManager::LoadTexture(const std::string& texPath, Uploader& uploader, Image& img)
 {
+    PROFILE_FUNCTION();
+
     if(texPath.empty())
         return nullptr;
     
@@ -10,6 +10,7 @@
 
 #include "Image.h"
 #include "InputSystem.h"
+#include "Jobs/JobSystem.h"
 #include "Rendering/LightingRenderPass.h"
 #include "Rendering/ShaderCompiler.h"
 #include "RHI/Buffer.h"
@@ -23,10 +24,14 @@ CorvusEditor::CorvusEditor()
 {
     LOG(Debug, "Starting Corvus Editor");
 
+    Profiler::Initialize();
+
     InputSystem::Create();
     InputSystem::Get()->AddListener(this);
     InputSystem::Get()->ShowCursor(false);
 
+    JobSystem::Create();
+
     int defaultWidth = 1380;
     int defaultHeight = 960;
 
@@ -40,6 +45,7 @@ CorvusEditor::CorvusEditor()
     m_renderer = std::make_shared<D3D12Renderer>(m_window->GetHandle());
 
     m_resourceManager = std::make_shared<ResourcesManager>(m_renderer);
+    m_renderGraphExecutor = std::make_shared<RenderGraphExecutor>(m_renderer);
 
     m_shadowRenderPass = std::make_shared<ShadowRenderPass>();
     m_shadowRenderPass->Initialize(m_renderer, m_shadowMapResolution, m_shadowMapResolution);
@@ -61,6 +67,8 @@ CorvusEditor::CorvusEditor()
     m_renderer->CreateShaderResourceView(m_sceneRenderTexture);
 
     m_scene = std::make_shared<Scene>("DemoScene");
+    m_renderWorld = std::make_shared<RenderWorld>(m_renderer);
+    m_lightClustering = std::make_shared<LightClustering>(m_renderer);
 
     // ----------------------------------------------- ASSETS DEMO ------------------------------------------------
     
@@ -75,7 +83,7 @@ CorvusEditor::CorvusEditor()
 
         AddModelToScene("DamagedHelmet", "Assets/DamagedHelmet.gltf", "Assets/DamagedHelmet_albedo.jpg",
             "Assets/DamagedHelmet_normal.jpg", "Assets/DamagedHelmet_metalRoughness.jpg",
-            { -3.0f, 0.0f, 0.0f }, { 90.0f, 0.0f, 0.0f });
+            { -3.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f });
 
         AddLightToScene({ -4.5f, 1.0f, 0.0f }, {}, true);
 
@@ -122,12 +130,6 @@ CorvusEditor::CorvusEditor()
         }
     }
 
-    for(auto pair : m_meshesInstancesCount)
-    {
-        auto instancesBuffer = m_renderer->CreateBuffer(sizeof(InstanceData) * pair.second, sizeof(InstanceData), BufferType::Structured, false);
-        m_meshesInstancesBuffers.emplace(pair.first, instancesBuffer);
-    }
-
     m_startTime = clock();
 
     m_window->Maximize();
@@ -147,14 +149,19 @@ CorvusEditor::~CorvusEditor()
 
     InputSystem::Get()->RemoveListener(this);
     InputSystem::Release();
+
+    JobSystem::Release();
     
-    Logger::WriteLogsToFile();
+    Logger::Flush();
 }
 
 void CorvusEditor::Run()
 {
     while(m_window->IsRunning())
     {
+        PROFILE_FRAME();
+        PROFILE_SCOPE("Frame");
+
         InputSystem::Get()->Update();
 
         // ------------------------------------------------------------- Scene Constants Update --------------------------------------------------------------------
@@ -179,122 +186,185 @@ void CorvusEditor::Run()
         m_camera.UpdateViewMatrix();
         m_camera.UpdateInvViewProjMatrix(m_viewportCachedSize.x, m_viewportCachedSize.y);
 
-        // ----------------------------------------------------------- ECS data -> renderer ----------------------------------------------------------
-        
-        std::unordered_map<std::string, RenderMeshData> renderMeshesData;
-        std::vector<PointLight> pointLights;
-        for(const auto go : m_scene->m_gameObjects)
+        // ------------------------------------------------------------- Lights Update --------------------------------------------------------------------
+        if(m_movePointLights)
         {
-            if(const auto tfComp = go->GetComponent<TransformComponent>())
+            auto posY = cos(m_elapsedTime * m_movePointLightsSpeed) * 10.0f;
+            auto& transformHierarchy = m_scene->GetTransformHierarchy();
+            m_scene->Each<TransformComponent, PointLightComponent>([&](Entity entity, TransformComponent&, PointLightComponent&)
             {
-                if(const auto meshComp = go->GetComponent<MeshComponent>())
-                {
-                    auto renderItem = meshComp->GetRenderItem();
+                auto position = transformHierarchy.GetLocalPosition(entity);
+                position.y = posY;
+                transformHierarchy.SetLocalPosition(entity, position);
+            });
+        }
 
-                    auto idRmd = renderMeshesData.find(renderItem->GetMeshIdentifier());
-                    if(idRmd != renderMeshesData.end()) // RMD already exists for this mesh, let's add the transform only
-                    {
-                        auto& rmd = idRmd->second;
-                        rmd.InstancesTransforms.emplace_back(tfComp->m_transform);
-                    }
-                    else
-                    {
-                        RenderMeshData rmd;
-                        rmd.MeshIdentifier = renderItem->GetMeshIdentifier();
-                        rmd.InstancesTransforms.emplace_back(tfComp->m_transform);
-                        rmd.Material = renderItem->GetMaterial();
-                        rmd.Primitives = renderItem->GetPrimitives();
-                        rmd.InstancesDataBuffer = m_meshesInstancesBuffers.find(renderItem->GetMeshIdentifier())->second;
-                        renderMeshesData.emplace(renderItem->GetMeshIdentifier(), rmd);
-                    }
-                }
+        // ----------------------------------------------------------- ECS data -> renderer ----------------------------------------------------------
 
-                if(const auto pointLightComp = go->GetComponent<PointLightComponent>())
-                {
-                    pointLightComp->m_pointLight.Position = { tfComp->m_transform.m[3][0], tfComp->m_transform.m[3][1], tfComp->m_transform.m[3][2] };
-                    pointLights.emplace_back(pointLightComp->m_pointLight);
-                }
-            }
-        }
+        m_scene->UpdateTransforms();
+        m_renderWorld->Sync(*m_scene);
 
-        std::vector<RenderMeshData> RMDs;
-        for(auto idRdm : renderMeshesData)
-            RMDs.emplace_back(idRdm.second);
-        
-        // ------------------------------------------------------------- Lights Update --------------------------------------------------------------------
-        for(auto& pointLight : pointLights)
+        DirectionalLightInfo directionalInfo;
+        directionalInfo.Direction = { m_dirLightDirection[0], m_dirLightDirection[1], m_dirLightDirection[2] };
+        directionalInfo.Intensity = m_dirLightIntensity;
+
+        // Cascades fitted to the camera and to the bounds of every mesh instance, each one culls its own casters
+        ShadowCascade shadowCascades[SHADOW_CASCADE_COUNT];
+        CascadedShadows::Compute(m_camera.GetViewMatrix(), m_camera.GetProjMatrix(), directionalInfo.Direction, m_renderWorld->GetBVH().GetBounds(),
+            m_shadowMapResolution, shadowCascades);
+
+        RenderWorldView worldView;
+        worldView.Lod = LodSelection::MakeView(m_camera.GetPosition(), m_camera.GetProjMatrix(), m_viewportCachedSize.y);
+        DirectX::XMStoreFloat4x4(&worldView.CameraViewProj, m_camera.GetViewMatrix() * m_camera.GetProjMatrix());
+        for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+            worldView.CascadeViewProjs[cascade] = shadowCascades[cascade].ViewProj;
+        worldView.OcclusionCulling = m_enableOcclusionCulling;
+        m_renderWorld->Upload(m_renderer->GetFrameIndex(), worldView);
+        const auto& RMDs = m_renderWorld->GetRenderMeshesData();
+
+        auto& frameArena = m_renderer->GetFrameArena();
+
+        FrameVector<PointLight> pointLights(frameArena);
+        if(m_enablePointLights)
         {
-            if(m_movePointLights)
+            const auto& worldPointLights = m_renderWorld->GetPointLights();
+            pointLights.assign(worldPointLights.begin(), worldPointLights.end());
+            for(auto& pointLight : pointLights)
             {
-                auto pos = pointLight.Position;
-                auto posY = cos(m_elapsedTime * m_movePointLightsSpeed) * 10.0f;
-                pointLight.Position = { pos.x, posY, pos.z };
+                pointLight.ConstantAttenuation = m_testLightConstAttenuation;
+                pointLight.LinearAttenuation = m_testLightLinearAttenuation;
+                pointLight.QuadraticAttenuation = m_testLightQuadraticAttenuation;
             }
-            
-            pointLight.ConstantAttenuation = m_testLightConstAttenuation;
-            pointLight.LinearAttenuation = m_testLightLinearAttenuation;
-            pointLight.QuadraticAttenuation = m_testLightQuadraticAttenuation;
         }
 
+        m_lightClustering->Build(pointLights.data(), (uint32_t)pointLights.size(), m_camera, m_viewportCachedSize.x, m_viewportCachedSize.y);
+        m_lightClustering->Upload(m_renderer->GetFrameIndex());
+
         // --------------------------------------------------------- Global Pass Datas -----------------------------------------------------------------
-        std::vector<PointLight> pl = {};
         GlobalPassData passData = {};
         passData.DeltaTime = dt;
         passData.ElapsedTime = m_elapsedTime;
         passData.ViewMode = m_viewMode;
-        passData.PointLights = m_enablePointLights ? pointLights : pl;
-        passData.DirectionalInfo.Direction = { m_dirLightDirection[0], m_dirLightDirection[1], m_dirLightDirection[2] };
-        passData.DirectionalInfo.Intensity = m_dirLightIntensity;
+        passData.PointLights = std::move(pointLights);
+        passData.LightClusters = m_lightClustering->GetBuffers(m_renderer->GetFrameIndex());
+        passData.DirectionalInfo = directionalInfo;
         passData.ViewportSizeX = m_viewportCachedSize.x;
         passData.ViewportSizeY = m_viewportCachedSize.y;
         passData.IrradianceMap = m_skyboxPass->GetEnvironmentMaps().DiffuseIrradianceMap;
         passData.PrefilterEnvMap = m_skyboxPass->GetEnvironmentMaps().PrefilterEnvMap;
         passData.BRDFLut = m_skyboxPass->GetEnvironmentMaps().BRDFLut;
         passData.EnableShadows = m_enableShadows;
+        std::copy(std::begin(shadowCascades), std::end(shadowCascades), passData.ShadowCascades);
+        passData.ShadowCacheKeys = m_renderWorld->GetShadowCacheKeys();
+        passData.CameraDrawList = &m_renderWorld->GetCameraDrawList();
 
-        // ------------------------------------------------------------- Render Passes --------------------------------------------------------------------
+        // ------------------------------------------------------------- Render Graph --------------------------------------------------------------------
 
         auto commandList = m_renderer->GetCurrentCommandList();
         auto backbuffer = m_renderer->GetBackBuffer();
-        
-        commandList->Begin();
-        commandList->ImageBarrier(backbuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
-        commandList->SetViewport(0, 0, width, height);
-        commandList->BindRenderTargets({ backbuffer }, nullptr);
-        commandList->ClearRenderTarget(backbuffer, 0.0f, 0.0f, 0.0f, 1.0f);
-        commandList->ClearRenderTarget(m_sceneRenderTexture, 0.0f, 0.0f, 0.0f, 1.0f);
-
-        RenderTargetInfo rtInfo;
-        rtInfo.RenderTexture = m_sceneRenderTexture;
-        
+
+        passData.ShadowMap = m_shadowRenderPass->GetShadowMap();
+        passData.GBuffer = m_GBufferRenderPass->GetGBuffer();
+        const GBuffer& gbuffer = passData.GBuffer;
+
+        // Passes declare what they read and write, the graph orders them, culls the unused ones and issues the barriers
+        m_renderGraph.Reset();
+        uint32_t backbufferResource = m_renderGraph.ImportTexture("Backbuffer", backbuffer);
+        uint32_t sceneResource = m_renderGraph.ImportTexture("Scene", m_sceneRenderTexture);
+        uint32_t albedoResource = m_renderGraph.ImportTexture("Albedo", gbuffer.AlbedoRenderTarget);
+        uint32_t normalResource = m_renderGraph.ImportTexture("Normal", gbuffer.NormalRenderTarget);
+        uint32_t metallicRoughnessResource = m_renderGraph.ImportTexture("MetallicRoughness", gbuffer.MetallicRoughnessRenderTarget);
+        uint32_t depthResource = m_renderGraph.ImportTexture("Depth", gbuffer.DepthBuffer);
+        m_renderGraph.MarkOutput(backbufferResource, D3D12_RESOURCE_STATE_PRESENT);
+
+        uint32_t shadowMapResource = RENDER_GRAPH_INVALID;
         if(m_enableShadows)
         {
-            m_shadowRenderPass->Pass(m_renderer, passData, m_camera, RMDs, rtInfo);
-            passData.ShadowMap = m_shadowRenderPass->GetShadowMap();
+            shadowMapResource = m_renderGraph.ImportTexture("ShadowMap", passData.ShadowMap.DepthBuffer);
+            uint32_t pass = m_renderGraph.AddPass("Shadows", [&]() { m_shadowRenderPass->Pass(m_renderer, passData, m_camera, RMDs, {}); });
+            m_renderGraph.Write(pass, shadowMapResource, D3D12_RESOURCE_STATE_DEPTH_WRITE);
         }
 
-        m_GBufferRenderPass->Pass(m_renderer, passData, m_camera, RMDs, rtInfo);
-        passData.GBuffer = m_GBufferRenderPass->GetGBuffer();
+        {
+            uint32_t pass = m_renderGraph.AddPass("GBuffer", [&]() { m_GBufferRenderPass->Pass(m_renderer, passData, m_camera, RMDs, {}); });
+            m_renderGraph.Write(pass, albedoResource, D3D12_RESOURCE_STATE_RENDER_TARGET);
+            m_renderGraph.Write(pass, normalResource, D3D12_RESOURCE_STATE_RENDER_TARGET);
+            m_renderGraph.Write(pass, metallicRoughnessResource, D3D12_RESOURCE_STATE_RENDER_TARGET);
+            m_renderGraph.Write(pass, depthResource, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+        }
 
+        uint32_t SSAOResource = RENDER_GRAPH_INVALID;
         if(m_enableSSAO)
-            m_SSAORenderPass->Pass(m_renderer, passData, m_camera, RMDs, rtInfo);
-        
-        m_deferredLightingPass->Pass(m_renderer, passData, m_camera, RMDs, rtInfo);
+        {
+            SSAOResource = m_renderGraph.CreateTexture("SSAO", m_renderGraphExecutor->MakeTextureDesc((std::max)(1u, (uint32_t)m_viewportCachedSize.x / 2),
+                (std::max)(1u, (uint32_t)m_viewportCachedSize.y / 2), SSAO_TEXTURE_FORMAT, TextureType::Storage));
+            uint32_t pass = m_renderGraph.AddPass("SSAO", [&, SSAOResource]()
+            {
+                RenderTargetInfo rtInfo;
+                rtInfo.RenderTexture = m_renderGraph.GetTexture(SSAOResource);
+                m_SSAORenderPass->Pass(m_renderer, passData, m_camera, RMDs, rtInfo);
+            });
+            m_renderGraph.Read(pass, depthResource, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+            m_renderGraph.Write(pass, SSAOResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        }
+
+        {
+            uint32_t pass = m_renderGraph.AddPass("Lighting", [&]()
+            {
+                commandList->ClearRenderTarget(m_sceneRenderTexture, 0.0f, 0.0f, 0.0f, 1.0f);
+
+                RenderTargetInfo rtInfo;
+                rtInfo.RenderTexture = m_sceneRenderTexture;
+                m_deferredLightingPass->Pass(m_renderer, passData, m_camera, RMDs, rtInfo);
+            });
+            m_renderGraph.Read(pass, albedoResource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            m_renderGraph.Read(pass, normalResource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            m_renderGraph.Read(pass, metallicRoughnessResource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            m_renderGraph.Read(pass, depthResource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            if(m_enableShadows)
+                m_renderGraph.Read(pass, shadowMapResource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            m_renderGraph.Write(pass, sceneResource, D3D12_RESOURCE_STATE_RENDER_TARGET);
+        }
 
         if(m_enableSkyBox)
         {
-            rtInfo.DepthBuffer = m_GBufferRenderPass->GetGBuffer().DepthBuffer;
-            m_skyboxPass->Pass(m_renderer, passData, m_camera, {}, rtInfo);
+            uint32_t pass = m_renderGraph.AddPass("SkyBox", [&]()
+            {
+                RenderTargetInfo rtInfo;
+                rtInfo.RenderTexture = m_sceneRenderTexture;
+                rtInfo.DepthBuffer = gbuffer.DepthBuffer;
+                m_skyboxPass->Pass(m_renderer, passData, m_camera, {}, rtInfo);
+            });
+            m_renderGraph.Read(pass, depthResource, D3D12_RESOURCE_STATE_DEPTH_READ);
+            m_renderGraph.Write(pass, sceneResource, D3D12_RESOURCE_STATE_RENDER_TARGET);
         }
 
-        // ------------------------------------------------------------- UI Rendering --------------------------------------------------------------------
-        
-        commandList->BindRenderTargets({ backbuffer }, nullptr);
-        m_renderer->BeginImGuiFrame();
-        RenderUI((float)width, (float)height);
-        m_renderer->EndImGuiFrame();
-        
-        commandList->ImageBarrier(backbuffer, D3D12_RESOURCE_STATE_PRESENT);
+        {
+            // The UI shows the scene and the debug views, it is the only pass writing to the backbuffer
+            uint32_t pass = m_renderGraph.AddPass("UI", [&]()
+            {
+                commandList->SetViewport(0, 0, width, height);
+                commandList->BindRenderTargets({ backbuffer }, nullptr);
+                commandList->ClearRenderTarget(backbuffer, 0.0f, 0.0f, 0.0f, 1.0f);
+
+                m_renderer->BeginImGuiFrame();
+                RenderUI((float)width, (float)height);
+                m_renderer->EndImGuiFrame();
+            }, true);
+            m_renderGraph.Read(pass, sceneResource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            m_renderGraph.Read(pass, albedoResource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            m_renderGraph.Read(pass, normalResource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            m_renderGraph.Read(pass, metallicRoughnessResource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            m_renderGraph.Read(pass, depthResource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            if(m_enableShadows)
+                m_renderGraph.Read(pass, shadowMapResource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            if(m_enableSSAO)
+                m_renderGraph.Read(pass, SSAOResource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            m_renderGraph.Write(pass, backbufferResource, D3D12_RESOURCE_STATE_RENDER_TARGET);
+        }
+
+        commandList->Begin();
+        m_renderGraphExecutor->Execute(m_renderGraph);
         commandList->End();
         m_renderer->ExecuteCommandBuffers({ commandList }, D3D12_COMMAND_LIST_TYPE_DIRECT);
 
@@ -317,44 +387,36 @@ std::shared_ptr<RenderItem> CorvusEditor::AddModelToScene(std::string name, cons
     Image normalImg;
     Image mrImg;
 
+    // The model is shared by every entity loading the same file, the textures go to this entity only
+    Material material = model->GetMaterial();
     if(!albedoPath.empty())
     {
         auto albedoTexture = m_resourceManager->LoadTexture(albedoPath, uploader, albedoImg);
-        model->GetMaterial().HasAlbedo = true;
-        model->GetMaterial().Albedo = albedoTexture;
+        material.HasAlbedo = true;
+        material.Albedo = albedoTexture;
     }
 
     if(!normalPath.empty())
     {
         auto normalTexture = m_resourceManager->LoadTexture(normalPath, uploader, normalImg);
-        model->GetMaterial().HasNormal = true;
-        model->GetMaterial().Normal = normalTexture;
+        material.HasNormal = true;
+        material.Normal = normalTexture;
     }
 
     if(!mrPath.empty())
     {
         auto mrTexture = m_resourceManager->LoadTexture(mrPath, uploader, mrImg);
-        model->GetMaterial().HasMetallicRoughness = true;
-        model->GetMaterial().MetallicRoughness = mrTexture;
+        material.HasMetallicRoughness = true;
+        material.MetallicRoughness = mrTexture;
     }
 
     if(uploader.HasCommands())
         m_renderer->FlushUploader(uploader);
 
-    auto idRmd = m_meshesInstancesCount.find(modelPath);
-    if(idRmd != m_meshesInstancesCount.end())
-    {
-        int& count = idRmd->second;
-        count++;
-    }
-    else
-    {
-        m_meshesInstancesCount.emplace(modelPath, 1);
-    }
-
     auto go = m_scene->CreateGameObject(name, position, rotation, scale);
-    auto meshComp = go->AddComponent<MeshComponent>();
+    auto meshComp = go.AddComponent<MeshComponent>();
     meshComp->SetRenderItem(model);
+    meshComp->SetMaterial(material);
     
     return model;
 }
@@ -380,12 +442,14 @@ void CorvusEditor::AddLightToScene(DirectX::XMFLOAT3 position, DirectX::XMFLOAT4
     pointLight.QuadraticAttenuation = m_testLightQuadraticAttenuation;
     
     auto go = m_scene->CreateGameObject("PointLight", position);
-    auto lightComp = go->AddComponent<PointLightComponent>();
+    auto lightComp = go.AddComponent<PointLightComponent>();
     lightComp->m_pointLight = pointLight;
 }
 
 void CorvusEditor::RenderUI(float width, float height)
 {
+    PROFILE_FUNCTION();
+
     if(ImGui::BeginMainMenuBar())
     {
         if (ImGui::BeginMenu("File"))
@@ -446,8 +510,35 @@ void CorvusEditor::RenderUI(float width, float height)
 
         ImGui::Begin("FrameRate");
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+        const RenderGraphStats& graphStats = m_renderGraph.GetStats();
+        ImGui::Text("Render graph : %u passes, %u culled, %u barriers (%u split) in %u batches", graphStats.PassCount, graphStats.CulledPassCount,
+            graphStats.BarrierCount, graphStats.SplitBarrierCount, graphStats.BatchCount);
+        ImGui::Text("Transients : %u in %.1f MB, %.1f MB without aliasing", graphStats.TransientCount, graphStats.TransientHeapSize / (1024.0f * 1024.0f),
+            graphStats.TransientSize / (1024.0f * 1024.0f));
+        ImGui::End();
+
+        ImGui::Begin("Culling");
+        ImGui::Checkbox("Occlusion Culling", &m_enableOcclusionCulling);
+        const RenderWorldStats& stats = m_renderWorld->GetStats();
+        float toPercent = stats.InstanceCount > 0 ? 100.0f / stats.InstanceCount : 0.0f;
+        ImGui::Text("Instances %u", stats.InstanceCount);
+        ImGui::Text("Camera : %u drawn, frustum culled %.1f%%, occlusion culled %.1f%%", stats.CameraVisibleCount,
+            (stats.InstanceCount - stats.CameraVisibleCount - stats.CameraOccludedCount) * toPercent, stats.CameraOccludedCount * toPercent);
+        for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+        {
+            ImGui::Text("Cascade %u : %u drawn, frustum culled %.1f%%, occlusion culled %.1f%%", cascade, stats.CascadeVisibleCounts[cascade],
+                (stats.InstanceCount - stats.CascadeVisibleCounts[cascade] - stats.CascadeOccludedCounts[cascade]) * toPercent, stats.CascadeOccludedCounts[cascade] * toPercent);
+        }
+        ImGui::Text("Occluders %u, %u triangles", stats.OccluderCount, stats.OccluderTriangleCount);
+        const ShadowCacheStats& cacheStats = m_shadowRenderPass->GetCacheStats();
+        float toPassPercent = cacheStats.FrameCount > 0 ? 100.0f / (cacheStats.FrameCount * SHADOW_CASCADE_COUNT) : 0.0f;
+        ImGui::Text("Shadow cache : %u static, %u dynamic cascade passes drawn", cacheStats.StaticPassCount, cacheStats.DynamicPassCount);
+        ImGui::Text("Skipped %.1f%% of the static passes, %.1f%% of the dynamic ones", cacheStats.SkippedStaticPassCount * toPassPercent,
+            cacheStats.SkippedDynamicPassCount * toPassPercent);
         ImGui::End();
 
+        RenderProfilerUI();
+
         ImGui::Begin("Debug");
         ImGui::SliderFloat("FOV", &m_fov, 0.1f, 1.0f);
         ImGui::SliderFloat("Move Speed", &m_moveSpeed, 1.0f, 40.0f);
@@ -470,6 +561,7 @@ void CorvusEditor::RenderUI(float width, float height)
         ImGui::SliderFloat("Constant", &m_testLightConstAttenuation, 0.0f, 1.0f);
         ImGui::SliderFloat("Linear", &m_testLightLinearAttenuation, 0.0f, 0.5f);
         ImGui::SliderFloat("Quadratic", &m_testLightQuadraticAttenuation, 0.0f, 0.5f);
+        ImGui::Text("%u lights, %u cluster entries", (uint32_t)m_renderWorld->GetPointLights().size(), m_lightClustering->GetLightIndexCount());
         ImGui::End();
 
         ImGui::Begin("SceneHierarchy");
@@ -477,30 +569,44 @@ void CorvusEditor::RenderUI(float width, float height)
         {
             for(auto go : m_scene->m_gameObjects)
             {
-                bool isSelected = false;
-                if(m_selectedGo != nullptr)
-                {
-                    if(m_selectedGo->GetName() == go->GetName())
-                        isSelected = true;
-                }
+                bool isSelected = m_selectedGo == go;
         
-                if(ImGui::Selectable(go->GetName().c_str(), isSelected))
+                if(ImGui::Selectable(go.GetName().c_str(), isSelected))
                     m_selectedGo = go;
             }
 
             ImGui::EndListBox();
         }
         ImGui::Separator();
-        if(m_selectedGo != nullptr)
+        if(m_selectedGo.IsValid())
         {
-            ImGui::Text(m_selectedGo->GetName().c_str());
-            if(auto tfComp = m_selectedGo->GetComponent<TransformComponent>())
+            ImGui::Text(m_selectedGo.GetName().c_str());
+            if(m_selectedGo.GetComponent<TransformComponent>())
             {
-                float pos[3] = { tfComp->m_transform.m[3][0], tfComp->m_transform.m[3][1], tfComp->m_transform.m[3][2] };
-                ImGui::InputFloat3("Position", pos);
+                auto& transformHierarchy = m_scene->GetTransformHierarchy();
+                Entity entity = m_selectedGo.GetEntity();
+
+                auto position = transformHierarchy.GetLocalPosition(entity);
+                if(ImGui::InputFloat3("Position", &position.x))
+                    transformHierarchy.SetLocalPosition(entity, position);
+
+                auto scale = transformHierarchy.GetLocalScale(entity);
+                if(ImGui::InputFloat3("Scale", &scale.x))
+                    transformHierarchy.SetLocalScale(entity, scale);
+
+                GameObject parent(m_scene.get(), transformHierarchy.GetParent(entity));
+                if(ImGui::BeginCombo("Parent", parent.IsValid() ? parent.GetName().c_str() : "None"))
+                {
+                    if(ImGui::Selectable("None", !parent.IsValid()))
+                        transformHierarchy.SetParent(entity, Entity());
 
-                float scale[3] = { tfComp->m_transform.m[0][0], tfComp->m_transform.m[1][1], tfComp->m_transform.m[2][2] };
-                ImGui::InputFloat3("Scale", scale);
+                    for(auto go : m_scene->m_gameObjects)
+                    {
+                        if(go != m_selectedGo && ImGui::Selectable(go.GetName().c_str(), go == parent))
+                            transformHierarchy.SetParent(entity, go.GetEntity());
+                    }
+                    ImGui::EndCombo();
+                }
 
                 if (ImGui::RadioButton("Translate", m_gizmoOperation == ImGuizmo::TRANSLATE))
                     m_gizmoOperation = ImGuizmo::TRANSLATE;
@@ -539,7 +645,7 @@ void CorvusEditor::RenderUI(float width, float height)
             ImGui::End();
         }
 
-        if(m_enableSSAO)
+        if(m_enableSSAO && m_SSAORenderPass->GetSSAOTexture())
         {
             ImGui::Begin("Debug SSAO");
             ImGui::Image((ImTextureID)m_SSAORenderPass->GetSSAOTexture()->m_srvUav.GPU.ptr, ImVec2(320, 180));
@@ -559,17 +665,19 @@ void CorvusEditor::RenderUI(float width, float height)
             m_renderer->CreateShaderResourceView(m_sceneRenderTexture);
 
             m_GBufferRenderPass->OnResize(m_renderer, m_viewportCachedSize.x, m_viewportCachedSize.y);
-            m_SSAORenderPass->OnResize(m_renderer, m_viewportCachedSize.x / 2, m_viewportCachedSize.y / 2);
             m_deferredLightingPass->OnResize(m_renderer, m_viewportCachedSize.x, m_viewportCachedSize.y);
             m_skyboxPass->OnResize(m_renderer, m_viewportCachedSize.x, m_viewportCachedSize.y);
             UpdateProjMatrix(m_viewportCachedSize.x, m_viewportCachedSize.y);
         }
 
         ImGui::Image((ImTextureID)m_sceneRenderTexture->m_srvUav.GPU.ptr, ImVec2(m_viewportCachedSize.x , m_viewportCachedSize.y));
+        m_viewportPosition = ImGui::GetItemRectMin();
+        m_viewportHovered = ImGui::IsItemHovered();
+        m_gizmoHovered = false;
 
-        if(m_selectedGo != nullptr)
+        if(m_selectedGo.IsValid())
         {
-            if(auto tfComp = m_selectedGo->GetComponent<TransformComponent>())
+            if(auto tfComp = m_selectedGo.GetComponent<TransformComponent>())
             {
                 ImGuizmo::SetOrthographic(false);
                 ImGuizmo::SetDrawlist(); 
@@ -586,9 +694,30 @@ void CorvusEditor::RenderUI(float width, float height)
                 DirectX::XMStoreFloat4x4(&tfCopy, tfMat);
                 
                 ImGuizmo::Manipulate(view.m[0], projection.m[0], m_gizmoOperation, m_gizmoMode, tfCopy.m[0]);
+                m_gizmoHovered = ImGuizmo::IsOver() || ImGuizmo::IsUsing();
 
                 if(ImGuizmo::IsUsing())
-                    DirectX::XMStoreFloat4x4(&tfComp->m_transform, DirectX::XMLoadFloat4x4(&tfCopy));
+                {
+                    // The gizmo edits the world matrix, bring it back in the parent space before decomposing
+                    auto& transformHierarchy = m_scene->GetTransformHierarchy();
+                    Entity entity = m_selectedGo.GetEntity();
+
+                    DirectX::XMMATRIX local = DirectX::XMLoadFloat4x4(&tfCopy);
+                    Entity parent = transformHierarchy.GetParent(entity);
+                    if(parent.IsValid())
+                        local *= DirectX::XMMatrixInverse(nullptr, DirectX::XMLoadFloat4x4(&transformHierarchy.GetWorldMatrix(parent)));
+
+                    DirectX::XMVECTOR scale, rotation, translation;
+                    if(DirectX::XMMatrixDecompose(&scale, &rotation, &translation, local))
+                    {
+                        DirectX::XMFLOAT3 localPosition, localScale;
+                        DirectX::XMFLOAT4 localRotation;
+                        DirectX::XMStoreFloat3(&localPosition, translation);
+                        DirectX::XMStoreFloat4(&localRotation, rotation);
+                        DirectX::XMStoreFloat3(&localScale, scale);
+                        transformHierarchy.SetLocalTransform(entity, localPosition, localRotation, localScale);
+                    }
+                }
             }
         }
         
@@ -626,7 +755,7 @@ void CorvusEditor::OnKeyUp(int key)
         m_lastMousePos[1] = height/2.0f;
     }
     else if(key == 'R')
-        m_selectedGo.reset();
+        m_selectedGo = GameObject();
 }
 
 void CorvusEditor::OnMouseMove(const InputListener::Vec2& mousePosition)
@@ -646,6 +775,32 @@ void CorvusEditor::OnMouseMove(const InputListener::Vec2& mousePosition)
 
 void CorvusEditor::OnLeftMouseDown(const InputListener::Vec2& mousePos)
 {
+    // A locked cursor steers the camera and clicks on the gizmo belong to it
+    if(m_mouseLocked || !m_viewportHovered || m_gizmoHovered || m_viewportCachedSize.x <= 0.0f || m_viewportCachedSize.y <= 0.0f)
+        return;
+
+    PROFILE_FUNCTION();
+
+    POINT cursor = { (LONG)mousePos.X, (LONG)mousePos.Y };
+    ::ScreenToClient(m_window->GetHandle(), &cursor);
+    float ndcX = 2.0f * ((float)cursor.x - m_viewportPosition.x) / m_viewportCachedSize.x - 1.0f;
+    float ndcY = 1.0f - 2.0f * ((float)cursor.y - m_viewportPosition.y) / m_viewportCachedSize.y;
+
+    // From the near plane to the far one, the hit distance is then a fraction of the depth range
+    DirectX::XMMATRIX invViewProj = m_camera.GetInvViewProjMatrix();
+    DirectX::XMVECTOR nearPoint = DirectX::XMVector3TransformCoord(DirectX::XMVectorSet(ndcX, ndcY, 0.0f, 1.0f), invViewProj);
+    DirectX::XMVECTOR farPoint = DirectX::XMVector3TransformCoord(DirectX::XMVectorSet(ndcX, ndcY, 1.0f, 1.0f), invViewProj);
+
+    BVHRay ray;
+    DirectX::XMStoreFloat3(&ray.Origin, nearPoint);
+    DirectX::XMStoreFloat3(&ray.Direction, DirectX::XMVectorSubtract(farPoint, nearPoint));
+    ray.MaxDistance = 1.0f;
+
+    BVHRayHit hit;
+    if(m_renderWorld->Raycast(ray, hit))
+        m_selectedGo = GameObject(m_scene.get(), m_scene->GetEntity(hit.UserData));
+    else
+        m_selectedGo = GameObject();
 }
 
 void CorvusEditor::OnRightMouseDown(const InputListener::Vec2& mousePos)
@@ -665,3 +820,73 @@ void CorvusEditor::UpdateProjMatrix(float width, float height)
     float aspectRatio = width / height;
     m_camera.UpdatePerspectiveFOV(m_fov * 3.14159f, aspectRatio);
 }
+
+void CorvusEditor::RenderProfilerUI()
+{
+    ImGui::Begin("Profiler");
+
+    ImGui::Text("Scope overhead %.1f ns", Profiler::GetScopeOverheadNs());
+    ImGui::SameLine();
+    ImGui::Checkbox("Pause", &m_profilerPaused);
+    ImGui::SameLine();
+    if(ImGui::Button("Export Trace"))
+        Profiler::ExportChromeTrace("Log/Trace.json");
+
+    if(!m_profilerPaused)
+        Profiler::GetLastFrame(m_profilerFrame, m_profilerFrameBegin, m_profilerFrameEnd);
+
+    if(m_profilerFrameEnd <= m_profilerFrameBegin)
+    {
+        ImGui::End();
+        return;
+    }
+
+    // Flame view, one band per thread, one row per scope depth
+    constexpr float rowHeight = 18.0f;
+    auto drawList = ImGui::GetWindowDrawList();
+    float width = ImGui::GetContentRegionAvail().x;
+    double frameTicks = (double)(m_profilerFrameEnd - m_profilerFrameBegin);
+    ImGui::Text("Frame %.3f ms", Profiler::TicksToMicroseconds(m_profilerFrameEnd - m_profilerFrameBegin) / 1000.0);
+
+    for(const auto& thread : m_profilerFrame)
+    {
+        ImGui::TextUnformatted(thread.ThreadName.c_str());
+
+        uint32_t maxDepth = 0;
+        for(const auto& event : thread.Events)
+            maxDepth = std::max(maxDepth, event.Depth);
+
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        for(const auto& event : thread.Events)
+        {
+            uint64_t begin = std::max(event.Begin, m_profilerFrameBegin);
+            uint64_t end = std::min(event.End, m_profilerFrameEnd);
+            float x0 = origin.x + (float)((begin - m_profilerFrameBegin) / frameTicks) * width;
+            float x1 = origin.x + (float)((end - m_profilerFrameBegin) / frameTicks) * width;
+            float y0 = origin.y + event.Depth * rowHeight;
+            if(x1 - x0 < 1.0f)
+                x1 = x0 + 1.0f;
+
+            // Color from the name pointer, stable from one frame to the next
+            uint32_t hash = (uint32_t)(((uintptr_t)event.Name >> 4) * 2654435761u);
+            ImU32 color = IM_COL32(90 + (hash & 0x7F), 90 + ((hash >> 8) & 0x7F), 90 + ((hash >> 16) & 0x7F), 255);
+
+            ImVec2 min(x0, y0);
+            ImVec2 max(x1, y0 + rowHeight - 1.0f);
+            drawList->AddRectFilled(min, max, color);
+            if(x1 - x0 > 40.0f)
+            {
+                drawList->PushClipRect(min, max, true);
+                drawList->AddText(ImVec2(x0 + 2.0f, y0 + 2.0f), IM_COL32_BLACK, event.Name);
+                drawList->PopClipRect();
+            }
+
+            if(ImGui::IsMouseHoveringRect(min, max))
+                ImGui::SetTooltip("%s\n%.3f ms", event.Name, Profiler::TicksToMicroseconds(event.End - event.Begin) / 1000.0);
+        }
+
+        ImGui::Dummy(ImVec2(width, (maxDepth + 1) * rowHeight));
+    }
+
+    ImGui::End();
+}
@@ -8,9 +8,13 @@
 #include "ECS/Scene.h"
 #include "ImGui/ImGuizmo.h"
 #include "Rendering/GBufferRenderPass.h"
+#include "Rendering/LightClustering.h"
 #include "Rendering/LightingRenderPass.h"
+#include "Rendering/RenderGraph.h"
+#include "Rendering/RenderGraphExecutor.h"
 #include "RHI/D3D12Renderer.h"
 #include "Rendering/RenderPass.h"
+#include "Rendering/RenderWorld.h"
 #include "Rendering/ShadowRenderPass.h"
 #include "Rendering/SkyBoxRenderPass.h"
 #include "Rendering/SSAORenderPass.h"
@@ -39,6 +43,7 @@ public:
 
 private:
     void UpdateProjMatrix(float width, float height);
+    void RenderProfilerUI();
     
     std::shared_ptr<Window> m_window;
     std::shared_ptr<D3D12Renderer> m_renderer;
@@ -55,14 +60,17 @@ private:
     std::shared_ptr<LightingRenderPass> m_deferredLightingPass;
     std::shared_ptr<SkyBoxRenderPass> m_skyboxPass;
     std::shared_ptr<RenderPass> m_transparencyPass;
+
+    // Rebuilt every frame from the enabled passes
+    RenderGraph m_renderGraph;
+    std::shared_ptr<RenderGraphExecutor> m_renderGraphExecutor;
     
     std::shared_ptr<ResourcesManager> m_resourceManager;
 
     std::shared_ptr<Scene> m_scene;
-    std::shared_ptr<GameObject> m_selectedGo;
-
-    std::unordered_map<std::string, std::shared_ptr<Buffer>> m_meshesInstancesBuffers;
-    std::unordered_map<std::string, int> m_meshesInstancesCount;
+    std::shared_ptr<RenderWorld> m_renderWorld;
+    std::shared_ptr<LightClustering> m_lightClustering;
+    GameObject m_selectedGo;
 
     float m_startTime;
     float m_lastTime;
@@ -87,10 +95,11 @@ private:
     float m_testLightQuadraticAttenuation = 0.02f;
     // DirectX::XMFLOAT4 m_testLightColor = { 1.0f, 1.0f, 1.0f, 1.0f };
 
-    int m_shadowMapResolution = 2048;
+    int m_shadowMapResolution = 2048; // Per cascade, the atlas holds SHADOW_CASCADE_COUNT tiles
     bool m_enableShadows = true;
     bool m_enableSSAO = true;
     bool m_enableSkyBox = true;
+    bool m_enableOcclusionCulling = true;
     bool m_enablePointLights = false;
     bool m_movePointLights = false;
     float m_movePointLightsSpeed = 0.8f;
@@ -100,4 +109,13 @@ private:
     int m_viewMode;
 
     ImVec2 m_viewportCachedSize;
+    // Last UI frame state of the viewport image, in client coordinates, read by the picking
+    ImVec2 m_viewportPosition;
+    bool m_viewportHovered = false;
+    bool m_gizmoHovered = false;
+
+    bool m_profilerPaused = false;
+    std::vector<ProfileThreadEvents> m_profilerFrame;
+    uint64_t m_profilerFrameBegin = 0;
+    uint64_t m_profilerFrameEnd = 0;
 };
@@ -2,15 +2,32 @@
 
 #include "CorvusEditor.h"
 #include "Logger.h"
+#include "Rendering/MeshCooker.h"
 
 int main(int argc, char* argv[])
 {
+    Logger::Initialize();
     LOG(Debug, "Hello There !");
 
+    // CorvusEngine --cook mesh0 mesh1 ... : writes the .cmesh files next to the sources and exits
+    if(argc > 1 && std::string(argv[1]) == "--cook")
+    {
+        int failedCount = 0;
+        for(int i = 2; i < argc; i++)
+        {
+            if(!MeshCooker::Cook(argv[i], MeshCooker::GetCookedPath(argv[i])))
+                failedCount++;
+        }
+
+        Logger::Shutdown();
+        return failedCount == 0 ? 0 : 1;
+    }
+
     {
         CorvusEditor Editor;
         Editor.Run();
     }
 
+    Logger::Shutdown();
     return 0;
 }
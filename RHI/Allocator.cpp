@@ -34,4 +34,32 @@ GPUResource Allocator::Allocate(D3D12MA::ALLOCATION_DESC* allocDesc, D3D12_RESOU
         LOG(Error, errorMsg);
     }
     return resource;
+}
+
+D3D12MA::Allocation* Allocator::AllocateMemory(D3D12MA::ALLOCATION_DESC* allocDesc, D3D12_RESOURCE_ALLOCATION_INFO* allocInfo)
+{
+    D3D12MA::Allocation* allocation = nullptr;
+
+    HRESULT hr = m_allocator->AllocateMemory(allocDesc, allocInfo, &allocation);
+    if(FAILED(hr))
+    {
+        LOG(Error, "Allocator : failed to allocate memory !");
+        std::string errorMsg = std::system_category().message(hr);
+        LOG(Error, errorMsg);
+    }
+    return allocation;
+}
+
+GPUResource Allocator::AllocateAliasing(D3D12MA::Allocation* memory, uint64_t offset, D3D12_RESOURCE_DESC* resDesc, D3D12_RESOURCE_STATES states)
+{
+    GPUResource resource = {};
+
+    HRESULT hr = m_allocator->CreateAliasingResource(memory, offset, resDesc, states, nullptr, IID_PPV_ARGS(&resource.Resource));
+    if(FAILED(hr))
+    {
+        LOG(Error, "Allocator : failed to place aliasing resource !");
+        std::string errorMsg = std::system_category().message(hr);
+        LOG(Error, errorMsg);
+    }
+    return resource;
 }
\ No newline at end of file
@@ -16,6 +16,10 @@ public:
     ~Allocator();
 
     GPUResource Allocate(D3D12MA::ALLOCATION_DESC* allocDesc, D3D12_RESOURCE_DESC* resDesc, D3D12_RESOURCE_STATES states);
+    // Memory without a resource, for resources placed with AllocateAliasing
+    D3D12MA::Allocation* AllocateMemory(D3D12MA::ALLOCATION_DESC* allocDesc, D3D12_RESOURCE_ALLOCATION_INFO* allocInfo);
+    // The resource does not own the memory, Allocation is null
+    GPUResource AllocateAliasing(D3D12MA::Allocation* memory, uint64_t offset, D3D12_RESOURCE_DESC* resDesc, D3D12_RESOURCE_STATES states);
 
     D3D12MA::Allocator* GetAllocator() { return m_allocator; }
 
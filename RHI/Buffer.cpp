@@ -32,7 +32,7 @@ Buffer::Buffer(std::shared_ptr<Allocator> allocator, uint64_t size, uint64_t str
         case BufferType::Index: {
             m_IBV.BufferLocation = m_resource.Resource->GetGPUVirtualAddress();
             m_IBV.SizeInBytes = size;
-            m_IBV.Format = DXGI_FORMAT_R32_UINT;
+            m_IBV.Format = stride == sizeof(uint16_t) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
             break;
         }
         default: {
@@ -1,4 +1,4 @@
-#include "CommandList.h"
+﻿#include "CommandList.h"
 
 CommandList::CommandList(std::shared_ptr<Device> device, const Heaps& heaps, D3D12_COMMAND_LIST_TYPE commandQueueType) : m_type(commandQueueType), m_heaps(heaps)
 {
@@ -38,6 +38,7 @@ void CommandList::Begin()
 {
     m_commandAllocator->Reset();
     m_commandList->Reset(m_commandAllocator, nullptr);
+    m_stateTracker.Reset();
     if (m_type == D3D12_COMMAND_LIST_TYPE_DIRECT)
     {
         ID3D12DescriptorHeap* heaps[] = { m_heaps.ShaderHeap->GetHeap(), m_heaps.SamplerHeap->GetHeap() };
@@ -47,79 +48,75 @@ void CommandList::Begin()
 
 void CommandList::End()
 {
+    m_stateTracker.EndTransitions();
+    m_stateTracker.Flush(m_commandList);
     m_commandList->Close();
 }
 
 void CommandList::ImageBarrier(std::shared_ptr<Texture> texture, D3D12_RESOURCE_STATES state)
 {
-    D3D12_RESOURCE_BARRIER barrier = {};
-    barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-    barrier.Transition.pResource = texture->GetResource().Resource;
-    barrier.Transition.StateBefore = texture->GetState();
-    barrier.Transition.StateAfter = state;
-    barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-
-    if (barrier.Transition.StateBefore == barrier.Transition.StateAfter)
-        return;
+    m_stateTracker.Transition(texture->GetResource().Resource, texture->m_state, state);
+}
 
-    m_commandList->ResourceBarrier(1, &barrier);
+void CommandList::ImageBarrier(std::shared_ptr<TextureCube> texture, D3D12_RESOURCE_STATES state)
+{
+    m_stateTracker.Transition(texture->GetResource().Resource, texture->m_state, state);
+}
 
-    texture->SetState(state);
+void CommandList::ImageBarrier(std::shared_ptr<TextureCube> texture, D3D12_RESOURCE_STATES state, uint32_t mip)
+{
+    for(uint32_t face = 0; face < 6; face++)
+        m_stateTracker.Transition(texture->GetResource().Resource, texture->m_state, mip + face * texture->m_mipLevels, state);
 }
 
-void CommandList::ImageBarrier(std::shared_ptr<TextureCube> texture, D3D12_RESOURCE_STATES state)
+void CommandList::ImageBarrier(std::initializer_list<TextureBarrier> barriers)
 {
-    D3D12_RESOURCE_BARRIER barrier = {};
-    barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-    barrier.Transition.pResource = texture->GetResource().Resource;
-    barrier.Transition.StateBefore = texture->GetState();
-    barrier.Transition.StateAfter = state;
-    barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+    ImageBarrier(barriers.begin(), (uint32_t)barriers.size());
+}
 
-    if (barrier.Transition.StateBefore == barrier.Transition.StateAfter)
-        return;
+void CommandList::ImageBarrier(const TextureBarrier* barriers, uint32_t count)
+{
+    for(uint32_t i = 0; i < count; i++)
+        ImageBarrier(barriers[i].Texture, barriers[i].State);
+}
 
-    m_commandList->ResourceBarrier(1, &barrier);
+void CommandList::BeginImageBarrier(std::shared_ptr<Texture> texture, D3D12_RESOURCE_STATES state)
+{
+    m_stateTracker.BeginTransition(texture->GetResource().Resource, texture->m_state, state);
+}
 
-    texture->SetState(state);
+void CommandList::FlushBarriers()
+{
+    m_stateTracker.Flush(m_commandList);
 }
 
-void CommandList::ImageBarrier(std::unordered_map<std::shared_ptr<Texture>, D3D12_RESOURCE_STATES> texturesStates)
+void CommandList::AliasingBarrier(std::shared_ptr<Texture> before, std::shared_ptr<Texture> after)
 {
-    std::vector<D3D12_RESOURCE_BARRIER> barriers;
-    for(const auto pair : texturesStates)
-    {
-        auto texture = pair.first;
-        auto state = pair.second;
-        D3D12_RESOURCE_BARRIER barrier = {};
-        barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-        barrier.Transition.pResource = texture->GetResource().Resource;
-        barrier.Transition.StateBefore = texture->GetState();
-        barrier.Transition.StateAfter = state;
-        barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-
-        if (barrier.Transition.StateBefore == barrier.Transition.StateAfter)
-            return;
-
-        texture->SetState(state);
-        barriers.emplace_back(barrier);
-    }
+    m_stateTracker.Aliasing(before ? before->GetResource().Resource : nullptr, after->GetResource().Resource);
+}
 
-    m_commandList->ResourceBarrier(barriers.size(), barriers.data());
+void CommandList::DiscardTexture(std::shared_ptr<Texture> texture)
+{
+    m_stateTracker.Flush(m_commandList);
+    m_commandList->DiscardResource(texture->GetResource().Resource, nullptr);
 }
 
-void CommandList::BindRenderTargets(const std::vector<std::shared_ptr<Texture>>& renderTargets, std::shared_ptr<Texture> depthTarget)
+void CommandList::BindRenderTargets(std::initializer_list<std::shared_ptr<Texture>> renderTargets, std::shared_ptr<Texture> depthTarget, bool readOnlyDepth)
 {
-    std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> rtvDescriptors;
+    D3D12_CPU_DESCRIPTOR_HANDLE rtvDescriptors[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT];
     D3D12_CPU_DESCRIPTOR_HANDLE dsvDescriptor;
+    uint32_t rtvCount = 0;
 
     for (auto& renderTarget : renderTargets)
-        rtvDescriptors.push_back(renderTarget->m_rtv.CPU);
+    {
+        if (rtvCount < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT)
+            rtvDescriptors[rtvCount++] = renderTarget->m_rtv.CPU;
+    }
     
     if (depthTarget) 
-        dsvDescriptor = depthTarget->m_dsv.CPU;
+        dsvDescriptor = readOnlyDepth ? depthTarget->m_readOnlyDsv.CPU : depthTarget->m_dsv.CPU;
 
-    m_commandList->OMSetRenderTargets(rtvDescriptors.size(), rtvDescriptors.data(), false, depthTarget ? &dsvDescriptor : nullptr);
+    m_commandList->OMSetRenderTargets(rtvCount, rtvDescriptors, false, depthTarget ? &dsvDescriptor : nullptr);
 }
 
 void CommandList::BindDepthTarget(std::shared_ptr<Texture> depthTarget)
@@ -130,14 +127,28 @@ void CommandList::BindDepthTarget(std::shared_ptr<Texture> depthTarget)
 void CommandList::ClearRenderTarget(std::shared_ptr<Texture> renderTarget, float r, float g, float b, float a)
 {
     float clearValues[4] = { r, g, b, a };
+    m_stateTracker.Flush(m_commandList);
     m_commandList->ClearRenderTargetView(renderTarget->m_rtv.CPU, clearValues, 0, nullptr);
 }
 
 void CommandList::ClearDepthTarget(std::shared_ptr<Texture> depthTarget)
 {
+    m_stateTracker.Flush(m_commandList);
     m_commandList->ClearDepthStencilView(depthTarget->m_dsv.CPU, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
 }
 
+void CommandList::ClearDepthTarget(std::shared_ptr<Texture> depthTarget, int x, int y, int width, int height)
+{
+    D3D12_RECT Rect;
+    Rect.left = x;
+    Rect.top = y;
+    Rect.right = x + width;
+    Rect.bottom = y + height;
+
+    m_stateTracker.Flush(m_commandList);
+    m_commandList->ClearDepthStencilView(depthTarget->m_dsv.CPU, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 1, &Rect);
+}
+
 void CommandList::SetViewport(float x, float y, float width, float height)
 {
     D3D12_VIEWPORT Viewport = {};
@@ -149,10 +160,10 @@ void CommandList::SetViewport(float x, float y, float width, float height)
     Viewport.TopLeftY = y;
 
     D3D12_RECT Rect;
-    Rect.right = width;
-    Rect.bottom = height;
-    Rect.top = 0.0f;
-    Rect.left = 0.0f;
+    Rect.right = x + width;
+    Rect.bottom = y + height;
+    Rect.top = y;
+    Rect.left = x;
 
     m_commandList->RSSetViewports(1, &Viewport);
     m_commandList->RSSetScissorRects(1, &Rect);
@@ -235,24 +246,27 @@ void CommandList::BindComputeSampler(std::shared_ptr<Sampler> sampler, int idx)
     m_commandList->SetComputeRootDescriptorTable(idx, sampler->GetDescriptorHandle().GPU);
 }
 
-void CommandList::SetGraphicsShaderResource(std::shared_ptr<Buffer> buffer, int idx)
+void CommandList::SetGraphicsShaderResource(std::shared_ptr<Buffer> buffer, int idx, uint64_t offset)
 {
-    m_commandList->SetGraphicsRootShaderResourceView(idx, buffer->GetResource().Resource->GetGPUVirtualAddress());
+    m_commandList->SetGraphicsRootShaderResourceView(idx, buffer->GetResource().Resource->GetGPUVirtualAddress() + offset);
 }
 
 void CommandList::Draw(int vertexCount, int instanceCount)
 {
+    m_stateTracker.Flush(m_commandList);
     m_commandList->DrawInstanced(vertexCount, instanceCount, 0, 0);
 }
 
-void CommandList::DrawIndexed(int indexCount, int instanceCount)
+void CommandList::DrawIndexed(int indexCount, int instanceCount, int startIndex)
 {
-    m_commandList->DrawIndexedInstanced(indexCount, instanceCount, 0, 0, 0);
+    m_stateTracker.Flush(m_commandList);
+    m_commandList->DrawIndexedInstanced(indexCount, instanceCount, startIndex, 0, 0);
 }
 
 void CommandList::Dispatch(int x, int y, int z)
 {
-    m_commandList->Dispatch(x, y, z);    
+    m_stateTracker.Flush(m_commandList);
+    m_commandList->Dispatch(x, y, z);
 }
 
 void CommandList::CopyTextureToTexture(std::shared_ptr<Texture> dst, std::shared_ptr<Texture> src)
@@ -267,11 +281,13 @@ void CommandList::CopyTextureToTexture(std::shared_ptr<Texture> dst, std::shared
     BlitDest.pResource = dst->GetResource().Resource;
     BlitDest.SubresourceIndex = 0;
 
+    m_stateTracker.Flush(m_commandList);
     m_commandList->CopyTextureRegion(&BlitDest, 0, 0, 0, &BlitSource, nullptr);
 }
 
 void CommandList::CopyBufferToBuffer(std::shared_ptr<Buffer> dst, std::shared_ptr<Buffer> src)
 {
+    m_stateTracker.Flush(m_commandList);
     m_commandList->CopyResource(dst->GetResource().Resource, src->GetResource().Resource);
 }
 
@@ -293,5 +309,6 @@ void CommandList::CopyBufferToTexture(std::shared_ptr<Texture> dst, std::shared_
     CopyDest.pResource = dst->m_resource.Resource;
     CopyDest.SubresourceIndex = 0;
 
+    m_stateTracker.Flush(m_commandList);
     m_commandList->CopyTextureRegion(&CopyDest, 0, 0, 0, &CopySource, nullptr);
 }
@@ -1,14 +1,21 @@
-#pragma once
+﻿#pragma once
 #include <Core.h>
 
 #include "Buffer.h"
 #include "ComputePipeline.h"
 #include "Device.h"
 #include "GraphicsPipeline.h"
+#include "ResourceStateTracker.h"
 #include "Sampler.h"
 #include "Texture.h"
 #include "TextureCube.h"
 
+struct TextureBarrier
+{
+    std::shared_ptr<Texture> Texture;
+    D3D12_RESOURCE_STATES State;
+};
+
 enum class Topology
 {
     LineList = D3D_PRIMITIVE_TOPOLOGY_LINELIST,
@@ -27,13 +34,27 @@ public:
     void Begin();
     void End();
 
+    // Barriers are queued and flushed together before the next draw, dispatch, copy, clear or discard
     void ImageBarrier(std::shared_ptr<Texture> texture, D3D12_RESOURCE_STATES state);
     void ImageBarrier(std::shared_ptr<TextureCube> texture, D3D12_RESOURCE_STATES state);
-    void ImageBarrier(std::unordered_map<std::shared_ptr<Texture>, D3D12_RESOURCE_STATES> texturesStates);
-    void BindRenderTargets(const std::vector<std::shared_ptr<Texture>>& renderTargets, std::shared_ptr<Texture> depthTarget);
+    // All the faces of one mip
+    void ImageBarrier(std::shared_ptr<TextureCube> texture, D3D12_RESOURCE_STATES state, uint32_t mip);
+    void ImageBarrier(std::initializer_list<TextureBarrier> barriers);
+    void ImageBarrier(const TextureBarrier* barriers, uint32_t count);
+    // Split barrier, ends with the next ImageBarrier of the texture, which must not be used in between
+    void BeginImageBarrier(std::shared_ptr<Texture> texture, D3D12_RESOURCE_STATES state);
+    // Before recording with the command list directly
+    void FlushBarriers();
+    // Before the first use of a placed texture whose memory another one used, a null before stands for any of them
+    void AliasingBarrier(std::shared_ptr<Texture> before, std::shared_ptr<Texture> after);
+    // Render and depth targets must be discarded, cleared or copied to after an aliasing barrier
+    void DiscardTexture(std::shared_ptr<Texture> texture);
+    // A read only depth target can be sampled at the same time, in DEPTH_READ state
+    void BindRenderTargets(std::initializer_list<std::shared_ptr<Texture>> renderTargets, std::shared_ptr<Texture> depthTarget, bool readOnlyDepth = false);
     void BindDepthTarget(std::shared_ptr<Texture> depthTarget);
     void ClearRenderTarget(std::shared_ptr<Texture> renderTarget, float r, float g, float b, float a);
     void ClearDepthTarget(std::shared_ptr<Texture> depthTarget);
+    void ClearDepthTarget(std::shared_ptr<Texture> depthTarget, int x, int y, int width, int height);
     void SetViewport(float x, float y, float width, float height);
     void SetTopology(Topology topology);
     void BindVertexBuffer(std::shared_ptr<Buffer> buffer);
@@ -50,19 +71,21 @@ public:
     void BindComputeShaderResource(std::shared_ptr<Texture> texture, int idx);
     void BindGraphicsSampler(std::shared_ptr<Sampler> sampler, int idx);
     void BindComputeSampler(std::shared_ptr<Sampler> sampler, int idx);
-    void SetGraphicsShaderResource(std::shared_ptr<Buffer> buffer, int idx);
+    void SetGraphicsShaderResource(std::shared_ptr<Buffer> buffer, int idx, uint64_t offset = 0);
     void Draw(int vertexCount, int instanceCount = 1);
-    void DrawIndexed(int indexCount, int instanceCount = 1);
+    void DrawIndexed(int indexCount, int instanceCount = 1, int startIndex = 0);
     void Dispatch(int x, int y, int z);
     void CopyTextureToTexture(std::shared_ptr<Texture> dst, std::shared_ptr<Texture> src);
     void CopyBufferToBuffer(std::shared_ptr<Buffer> dst, std::shared_ptr<Buffer> src);
     void CopyBufferToTexture(std::shared_ptr<Texture> dst, std::shared_ptr<Buffer> src);
 
     ID3D12GraphicsCommandList* GetCommandList() { return m_commandList; }
+    ResourceStateTracker& GetStateTracker() { return m_stateTracker; }
 
 private:
     ID3D12CommandAllocator* m_commandAllocator;
     ID3D12GraphicsCommandList* m_commandList;
     D3D12_COMMAND_LIST_TYPE m_type;
     Heaps m_heaps;
+    ResourceStateTracker m_stateTracker;
 };
\ No newline at end of file
@@ -45,13 +45,14 @@ void CommandQueue::WaitForFenceValue(uint64_t target, uint64_t timeout)
     }
 }
 
-void CommandQueue::Submit(const std::vector<std::shared_ptr<CommandList>>& buffers)
+void CommandQueue::Submit(std::initializer_list<std::shared_ptr<CommandList>> buffers)
 {
-    std::vector<ID3D12CommandList*> lists;
-    lists.reserve(buffers.size());
+    ID3D12CommandList* lists[MAX_SUBMITTED_COMMAND_LISTS];
+    uint32_t listCount = 0;
     for (auto& buffer : buffers) {
-        lists.push_back(buffer->GetCommandList());
+        if (listCount < MAX_SUBMITTED_COMMAND_LISTS)
+            lists[listCount++] = buffer->GetCommandList();
     }
 
-    m_commandQueue->ExecuteCommandLists(lists.size(), lists.data());
+    m_commandQueue->ExecuteCommandLists(listCount, lists);
 }
\ No newline at end of file
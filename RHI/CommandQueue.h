@@ -4,6 +4,8 @@
 #include "CommandList.h"
 #include "Device.h"
 
+#define MAX_SUBMITTED_COMMAND_LISTS 8
+
 class CommandQueue
 {
 public:
@@ -12,7 +14,7 @@ public:
 
     void Signal(ID3D12Fence* fence, uint64_t value);
     void WaitForFenceValue(uint64_t target, uint64_t timeout);
-    void Submit(const std::vector<std::shared_ptr<CommandList>>& buffers);
+    void Submit(std::initializer_list<std::shared_ptr<CommandList>> buffers);
 
     ID3D12CommandQueue* GetCommandQueue() { return m_commandQueue; }
     D3D12_COMMAND_LIST_TYPE GetType() { return m_type; }
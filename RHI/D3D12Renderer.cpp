@@ -11,7 +11,7 @@ D3D12Renderer::D3D12Renderer(HWND hwnd) : m_frameIndex(0)
     m_computeCommandQueue = std::make_shared<CommandQueue>(m_device, D3D12_COMMAND_LIST_TYPE_COMPUTE);
     m_copyCommandQueue = std::make_shared<CommandQueue>(m_device, D3D12_COMMAND_LIST_TYPE_COPY);
     m_heaps.RtvHeap = std::make_shared<DescriptorHeap>(m_device, D3D12_DESCRIPTOR_HEAP_TYPE_RTV, 1024);
-    m_heaps.ShaderHeap = std::make_shared<DescriptorHeap>(m_device, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 1'000'000);
+    m_heaps.ShaderHeap = std::make_shared<DescriptorHeap>(m_device, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 1'000'000, SHADER_HEAP_TRANSIENT_SIZE);
     m_heaps.DsvHeap = std::make_shared<DescriptorHeap>(m_device, D3D12_DESCRIPTOR_HEAP_TYPE_DSV, 1024);
     m_heaps.SamplerHeap = std::make_shared<DescriptorHeap>(m_device, D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER, 512);
     m_allocator = std::make_shared<Allocator>(m_device);
@@ -119,6 +119,8 @@ void D3D12Renderer::Resize(uint32_t width, uint32_t height)
 
 void D3D12Renderer::EndFrame()
 {
+    PROFILE_FUNCTION();
+
     const UINT64 currentFenceValue = m_frameValues[m_frameIndex];
     m_directCommandQueue->Signal(m_directCommandQueue->GetFence(), currentFenceValue);
 
@@ -129,6 +131,8 @@ void D3D12Renderer::EndFrame()
     }
 
     m_frameValues[m_frameIndex] = currentFenceValue + 1;
+    m_frameArenas[m_frameIndex].Reset();
+    m_heaps.ShaderHeap->BeginFrame((uint32_t)m_frameIndex);
 }
 
 void D3D12Renderer::WaitForGPU()
@@ -140,6 +144,8 @@ void D3D12Renderer::WaitForGPU()
 
 void D3D12Renderer::Present(bool vsync)
 {
+    PROFILE_FUNCTION();
+
     m_swapChain->Present(vsync);
 }
 
@@ -153,6 +159,7 @@ void D3D12Renderer::BeginImGuiFrame()
 
 void D3D12Renderer::EndImGuiFrame()
 {
+    m_commandBuffers[m_frameIndex]->FlushBarriers();
     auto cmdList = m_commandBuffers[m_frameIndex]->GetCommandList();
 
     ID3D12DescriptorHeap* pHeaps[] = { m_heaps.ShaderHeap->GetHeap() };
@@ -162,7 +169,7 @@ void D3D12Renderer::EndImGuiFrame()
     ImGui_ImplDX12_RenderDrawData(ImGui::GetDrawData(), cmdList);
 }
 
-void D3D12Renderer::ExecuteCommandBuffers(const std::vector<std::shared_ptr<CommandList>>& buffers, D3D12_COMMAND_LIST_TYPE type)
+void D3D12Renderer::ExecuteCommandBuffers(std::initializer_list<std::shared_ptr<CommandList>> buffers, D3D12_COMMAND_LIST_TYPE type)
 {
     if(type == D3D12_COMMAND_LIST_TYPE_DIRECT)
     {
@@ -245,6 +252,27 @@ std::shared_ptr<Texture> D3D12Renderer::CreateTexture(int width, int height, Tex
     return std::make_shared<Texture>(m_device, m_allocator, width, height, format, type);
 }
 
+D3D12_RESOURCE_ALLOCATION_INFO D3D12Renderer::GetTextureAllocationInfo(int width, int height, TextureFormat format, TextureType type)
+{
+    D3D12_RESOURCE_DESC desc = Texture::GetResourceDesc(width, height, format, type);
+    return m_device->GetDevice()->GetResourceAllocationInfo(0, 1, &desc);
+}
+
+D3D12MA::Allocation* D3D12Renderer::AllocateTextureMemory(uint64_t size, uint64_t alignment)
+{
+    D3D12MA::ALLOCATION_DESC allocationDesc = {};
+    allocationDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+    allocationDesc.ExtraHeapFlags = D3D12_HEAP_FLAG_ALLOW_ALL_BUFFERS_AND_TEXTURES;
+
+    D3D12_RESOURCE_ALLOCATION_INFO allocationInfo = { size, alignment };
+    return m_allocator->AllocateMemory(&allocationDesc, &allocationInfo);
+}
+
+std::shared_ptr<Texture> D3D12Renderer::CreatePlacedTexture(D3D12MA::Allocation* memory, uint64_t offset, int width, int height, TextureFormat format, TextureType type)
+{
+    return std::make_shared<Texture>(m_device, m_allocator, memory, offset, width, height, format, type);
+}
+
 std::shared_ptr<Sampler> D3D12Renderer::CreateSampler(D3D12_TEXTURE_ADDRESS_MODE addressMode, D3D12_FILTER filter)
 {
     return std::make_shared<Sampler>(m_device, m_heaps.SamplerHeap, addressMode, filter);
@@ -13,6 +13,9 @@
 #include "Sampler.h"
 #include "TextureCube.h"
 
+// Shader visible descriptors recycled every frame, split between the frames in flight
+#define SHADER_HEAP_TRANSIENT_SIZE (FRAMES_IN_FLIGHT * 4096)
+
 struct VRAMStats
 {
     uint64_t Used;
@@ -32,10 +35,13 @@ public:
     void BeginImGuiFrame();
     void EndImGuiFrame();
 
-    void ExecuteCommandBuffers(const std::vector<std::shared_ptr<CommandList>>& buffers, D3D12_COMMAND_LIST_TYPE type);
+    void ExecuteCommandBuffers(std::initializer_list<std::shared_ptr<CommandList>> buffers, D3D12_COMMAND_LIST_TYPE type);
 
     std::shared_ptr<CommandList> GetCurrentCommandList() { return m_commandBuffers[m_frameIndex]; }
     std::shared_ptr<Texture> GetBackBuffer() { return m_swapChain->GetTexture(m_frameIndex); }
+    uint32_t GetFrameIndex() const { return (uint32_t)m_frameIndex; }
+    // Transient CPU memory for the current frame, reset when the frame comes back around in EndFrame
+    FrameArena& GetFrameArena() { return m_frameArenas[m_frameIndex]; }
     VRAMStats GetVRAMStats() const;
 
     std::shared_ptr<GraphicsPipeline> CreateGraphicsPipeline(GraphicsPipelineSpecs& specs);
@@ -48,6 +54,11 @@ public:
     void CreateUnorderedAccessView(std::shared_ptr<Texture> texture);
     Uploader CreateUploader();
     std::shared_ptr<Texture> CreateTexture(int width, int height, TextureFormat format, TextureType type);
+    // Size and alignment of a texture placed in memory from AllocateTextureMemory
+    D3D12_RESOURCE_ALLOCATION_INFO GetTextureAllocationInfo(int width, int height, TextureFormat format, TextureType type);
+    // Released by the caller, render targets and other textures share it (resource heap tier 2)
+    D3D12MA::Allocation* AllocateTextureMemory(uint64_t size, uint64_t alignment);
+    std::shared_ptr<Texture> CreatePlacedTexture(D3D12MA::Allocation* memory, uint64_t offset, int width, int height, TextureFormat format, TextureType type);
     std::shared_ptr<Sampler> CreateSampler(D3D12_TEXTURE_ADDRESS_MODE addressMode, D3D12_FILTER filter);
     std::shared_ptr<TextureCube> LoadTextureCube(const std::wstring& filePath);
     std::shared_ptr<TextureCube> CreateTextureCube(uint32_t width, uint32_t height, TextureFormat format);
@@ -68,6 +79,7 @@ private:
     uint64_t m_frameIndex;
     uint64_t m_frameValues[FRAMES_IN_FLIGHT];
     std::shared_ptr<CommandList> m_commandBuffers[FRAMES_IN_FLIGHT];
+    FrameArena m_frameArenas[FRAMES_IN_FLIGHT];
 
     DescriptorHandle m_fontDescriptor;
 };
\ No newline at end of file
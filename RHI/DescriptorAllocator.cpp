@@ -0,0 +1,208 @@
+﻿#include "DescriptorAllocator.h"
+
+#include <intrin.h>
+
+#include "Logger.h"
+
+namespace
+{
+    uint32_t FirstSetBit(uint64_t value)
+    {
+        return (uint32_t)_tzcnt_u64(value);
+    }
+
+    // Mask of count bits starting at bit first, count in [0, 64]
+    uint64_t BitRange(uint32_t first, uint32_t count)
+    {
+        uint64_t bits = count >= 64 ? ~0ull : ((1ull << count) - 1);
+        return bits << first;
+    }
+}
+
+DescriptorAllocator::DescriptorAllocator(uint32_t capacity, uint32_t transientCapacity, uint32_t frameCount)
+{
+    if(transientCapacity > capacity)
+        transientCapacity = capacity;
+
+    m_transientFrameSize = frameCount > 0 ? transientCapacity / frameCount : 0;
+    m_capacity = capacity - m_transientFrameSize * frameCount;
+    m_transientStart = m_capacity;
+
+    uint32_t wordCount = (m_capacity + 63) / 64;
+    m_freeBits.assign(wordCount, ~0ull);
+    if(m_capacity % 64 != 0)
+        m_freeBits.back() = BitRange(0, m_capacity % 64);
+
+    m_freeSummary.assign((wordCount + 63) / 64, 0);
+    for(uint32_t word = 0; word < wordCount; word++)
+        m_freeSummary[word / 64] |= 1ull << (word % 64);
+}
+
+uint32_t DescriptorAllocator::Allocate()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for(uint32_t summaryIdx = m_searchStart; summaryIdx < m_freeSummary.size(); summaryIdx++)
+    {
+        uint64_t summary = m_freeSummary[summaryIdx];
+        if(summary == 0)
+            continue;
+
+        m_searchStart = summaryIdx;
+        uint32_t word = summaryIdx * 64 + FirstSetBit(summary);
+        uint32_t index = word * 64 + FirstSetBit(m_freeBits[word]);
+        MarkAllocated(index, 1);
+        return index;
+    }
+
+    m_searchStart = (uint32_t)m_freeSummary.size();
+    return DESCRIPTOR_INVALID_INDEX;
+}
+
+uint32_t DescriptorAllocator::AllocateRange(uint32_t count)
+{
+    if(count == 0)
+        return DESCRIPTOR_INVALID_INDEX;
+
+    if(count == 1)
+        return Allocate();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint32_t index = FindFreeRange(count);
+    if(index != DESCRIPTOR_INVALID_INDEX)
+        MarkAllocated(index, count);
+
+    return index;
+}
+
+void DescriptorAllocator::Free(uint32_t index, uint32_t count)
+{
+    if(index == DESCRIPTOR_INVALID_INDEX)
+        return;
+
+    // Transient descriptors are recycled by BeginFrame
+    if(index >= m_transientStart)
+        return;
+
+    if(count > m_capacity - index)
+    {
+        LOG(Error, "DescriptorAllocator : trying to free an out of range descriptor");
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    MarkFree(index, count);
+}
+
+void DescriptorAllocator::BeginFrame(uint32_t frameIndex)
+{
+    m_transientFrameStart = m_transientStart + frameIndex * m_transientFrameSize;
+    m_transientOffset.store(0, std::memory_order_relaxed);
+}
+
+uint32_t DescriptorAllocator::AllocateTransient(uint32_t count)
+{
+    uint32_t offset = m_transientOffset.fetch_add(count, std::memory_order_relaxed);
+    if(offset + count > m_transientFrameSize)
+    {
+        LOG(Error, "DescriptorAllocator : out of transient descriptors for this frame");
+        return DESCRIPTOR_INVALID_INDEX;
+    }
+
+    return m_transientFrameStart + offset;
+}
+
+uint32_t DescriptorAllocator::GetAllocatedCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_allocatedCount;
+}
+
+void DescriptorAllocator::MarkAllocated(uint32_t index, uint32_t count)
+{
+    m_allocatedCount += count;
+
+    while(count > 0)
+    {
+        uint32_t word = index / 64;
+        uint32_t bit = index % 64;
+        uint32_t bitCount = count < 64 - bit ? count : 64 - bit;
+
+        m_freeBits[word] &= ~BitRange(bit, bitCount);
+        if(m_freeBits[word] == 0)
+            m_freeSummary[word / 64] &= ~(1ull << (word % 64));
+
+        index += bitCount;
+        count -= bitCount;
+    }
+}
+
+void DescriptorAllocator::MarkFree(uint32_t index, uint32_t count)
+{
+    uint32_t firstSummary = index / 4096;
+    if(firstSummary < m_searchStart)
+        m_searchStart = firstSummary;
+
+    while(count > 0)
+    {
+        uint32_t word = index / 64;
+        uint32_t bit = index % 64;
+        uint32_t bitCount = count < 64 - bit ? count : 64 - bit;
+        uint64_t bits = BitRange(bit, bitCount);
+
+        if(m_freeBits[word] & bits)
+            LOG(Warning, "DescriptorAllocator : descriptor freed twice");
+        else
+            m_allocatedCount -= bitCount;
+
+        m_freeBits[word] |= bits;
+        m_freeSummary[word / 64] |= 1ull << (word % 64);
+
+        index += bitCount;
+        count -= bitCount;
+    }
+}
+
+uint32_t DescriptorAllocator::FindFreeRange(uint32_t count) const
+{
+    // Walks the free runs only, words without any free slot are skipped through the summary
+    uint32_t runStart = 0;
+    uint32_t runLength = 0;
+
+    for(uint32_t summaryIdx = m_searchStart; summaryIdx < m_freeSummary.size(); summaryIdx++)
+    {
+        uint64_t summary = m_freeSummary[summaryIdx];
+        while(summary != 0)
+        {
+            uint32_t word = summaryIdx * 64 + FirstSetBit(summary);
+            summary &= summary - 1;
+
+            uint64_t bits = m_freeBits[word];
+            while(bits != 0)
+            {
+                uint32_t freeBit = FirstSetBit(bits);
+                uint64_t used = ~bits & ~BitRange(0, freeBit);
+                uint32_t freeEnd = used == 0 ? 64 : FirstSetBit(used);
+
+                uint32_t position = word * 64 + freeBit;
+                if(runLength > 0 && runStart + runLength == position)
+                {
+                    runLength += freeEnd - freeBit;
+                }
+                else
+                {
+                    runStart = position;
+                    runLength = freeEnd - freeBit;
+                }
+
+                if(runLength >= count)
+                    return runStart;
+
+                bits &= freeEnd == 64 ? 0 : ~BitRange(0, freeEnd);
+            }
+        }
+    }
+
+    return DESCRIPTOR_INVALID_INDEX;
+}
@@ -0,0 +1,47 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#define DESCRIPTOR_INVALID_INDEX UINT32_MAX
+
+// Index allocator behind DescriptorHeap, kept free of any D3D12 type.
+// Persistent descriptors come from a two level bitmap (set bit = free slot, one summary bit per 64 slots word),
+// the transient ones from a linear range split per frame in flight and recycled by BeginFrame.
+class DescriptorAllocator
+{
+public:
+    DescriptorAllocator(uint32_t capacity, uint32_t transientCapacity = 0, uint32_t frameCount = 1);
+
+    // Both return DESCRIPTOR_INVALID_INDEX when there's no room left
+    uint32_t Allocate();
+    uint32_t AllocateRange(uint32_t count);
+    void Free(uint32_t index, uint32_t count = 1);
+
+    // Transient ranges are only valid until the same frame index comes back
+    void BeginFrame(uint32_t frameIndex);
+    uint32_t AllocateTransient(uint32_t count);
+
+    uint32_t GetCapacity() const { return m_capacity; }
+    uint32_t GetAllocatedCount() const;
+
+private:
+    void MarkAllocated(uint32_t index, uint32_t count);
+    void MarkFree(uint32_t index, uint32_t count);
+    uint32_t FindFreeRange(uint32_t count) const;
+
+    uint32_t m_capacity;
+    uint32_t m_allocatedCount = 0;
+    // First summary word that may still have a free slot
+    uint32_t m_searchStart = 0;
+    std::vector<uint64_t> m_freeBits;
+    std::vector<uint64_t> m_freeSummary;
+    mutable std::mutex m_mutex;
+
+    uint32_t m_transientStart;
+    uint32_t m_transientFrameSize;
+    uint32_t m_transientFrameStart = 0;
+    std::atomic<uint32_t> m_transientOffset { 0 };
+};
@@ -1,10 +1,9 @@
 #include "DescriptorHeap.h"
+#include "SwapChain.h"
 
-DescriptorHeap::DescriptorHeap(std::shared_ptr<Device> device, D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t size)
-    : m_device(device), m_type(type), m_heapSize(size), m_isShaderVisible(false)
+DescriptorHeap::DescriptorHeap(std::shared_ptr<Device> device, D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t size, uint32_t transientSize)
+    : m_device(device), m_type(type), m_heapSize(size), m_isShaderVisible(false), m_allocator(size, transientSize, FRAMES_IN_FLIGHT)
 {
-    m_handlesTable = std::vector<bool>(size, false);
-    
     D3D12_DESCRIPTOR_HEAP_DESC desc = {};
     desc.Type = m_type;
     desc.NumDescriptors = m_heapSize;
@@ -30,48 +29,68 @@ DescriptorHeap::DescriptorHeap(std::shared_ptr<Device> device, D3D12_DESCRIPTOR_
 
 DescriptorHeap::~DescriptorHeap()
 {
-    m_handlesTable.clear();
     m_heap->Release();
 }
 
 DescriptorHandle DescriptorHeap::Allocate()
 {
-    int index = -1;
-    for(int i = 0; i < m_heapSize; i++)
-    {
-        if(m_handlesTable[i] == false)
-        {
-            m_handlesTable[i] = true;
-            index = i;
-            break;
-        }
-    }
-
-    if(index == -1)
+    uint32_t index = m_allocator.Allocate();
+    if(index == DESCRIPTOR_INVALID_INDEX)
     {
         LOG(Error, "DescriptorHeap : failed to create descriptor handle !");
         return DescriptorHandle();
     }
 
-    DescriptorHandle descriptorHandle = {};
-    descriptorHandle.HeapIdx = index;
-    descriptorHandle.CPU = m_heap->GetCPUDescriptorHandleForHeapStart();
-    descriptorHandle.CPU.ptr += index * m_incrementSize;
+    return GetHandle(index);
+}
 
-    if (m_type == D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV || m_type == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER)
+DescriptorHandle DescriptorHeap::AllocateRange(uint32_t count)
+{
+    uint32_t index = m_allocator.AllocateRange(count);
+    if(index == DESCRIPTOR_INVALID_INDEX)
     {
-        descriptorHandle.GPU = m_heap->GetGPUDescriptorHandleForHeapStart();
-        descriptorHandle.GPU.ptr += index * m_incrementSize;
+        LOG(Error, "DescriptorHeap : failed to allocate a range of " + std::to_string(count) + " descriptors !");
+        return DescriptorHandle();
     }
 
-    return descriptorHandle;
+    return GetHandle(index);
 }
 
-void DescriptorHeap::Free(DescriptorHandle& handle)
+void DescriptorHeap::Free(DescriptorHandle& handle, uint32_t count)
 {
     if(!handle.IsValid())
         return;
 
-    m_handlesTable[handle.HeapIdx] = false;
+    m_allocator.Free(handle.HeapIdx, count);
     handle.CPU.ptr = 0;
+}
+
+void DescriptorHeap::BeginFrame(uint32_t frameIndex)
+{
+    m_allocator.BeginFrame(frameIndex);
+}
+
+DescriptorHandle DescriptorHeap::AllocateTransient(uint32_t count)
+{
+    uint32_t index = m_allocator.AllocateTransient(count);
+    if(index == DESCRIPTOR_INVALID_INDEX)
+        return DescriptorHandle();
+
+    return GetHandle(index);
+}
+
+DescriptorHandle DescriptorHeap::GetHandle(uint32_t index)
+{
+    DescriptorHandle descriptorHandle = {};
+    descriptorHandle.HeapIdx = index;
+    descriptorHandle.CPU = m_heap->GetCPUDescriptorHandleForHeapStart();
+    descriptorHandle.CPU.ptr += (SIZE_T)index * m_incrementSize;
+
+    if (m_isShaderVisible)
+    {
+        descriptorHandle.GPU = m_heap->GetGPUDescriptorHandleForHeapStart();
+        descriptorHandle.GPU.ptr += (UINT64)index * m_incrementSize;
+    }
+
+    return descriptorHandle;
 }
\ No newline at end of file
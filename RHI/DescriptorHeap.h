@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Device.h"
+#include "DescriptorAllocator.h"
 #include <Core.h>
 
 class DescriptorHeap;
@@ -27,14 +28,22 @@ struct DescriptorHandle
 class DescriptorHeap 
 {
 public:
-    DescriptorHeap(std::shared_ptr<Device> device, D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t size);
+    // transientSize descriptors are taken from the end of the heap and shared by the frames in flight
+    DescriptorHeap(std::shared_ptr<Device> device, D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t size, uint32_t transientSize = 0);
     ~DescriptorHeap();
 
     ID3D12DescriptorHeap* GetHeap() { return m_heap; }
     DescriptorHandle Allocate();
-    void Free(DescriptorHandle& handle);
+    // Contiguous descriptors for tables, the returned handle is the first one
+    DescriptorHandle AllocateRange(uint32_t count);
+    void Free(DescriptorHandle& handle, uint32_t count = 1);
+
+    void BeginFrame(uint32_t frameIndex);
+    DescriptorHandle AllocateTransient(uint32_t count = 1);
 
 private:
+    DescriptorHandle GetHandle(uint32_t index);
+
     std::shared_ptr<Device> m_device;
     ID3D12DescriptorHeap* m_heap;
     D3D12_DESCRIPTOR_HEAP_TYPE m_type;
@@ -42,5 +51,5 @@ private:
     int m_incrementSize;
     int m_heapSize;
 
-    std::vector<bool> m_handlesTable;
+    DescriptorAllocator m_allocator;
 };
\ No newline at end of file
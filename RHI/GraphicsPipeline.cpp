@@ -174,7 +174,7 @@ GraphicsPipeline::GraphicsPipeline(std::shared_ptr<Device> device, GraphicsPipel
     Desc.RasterizerState.DepthClipEnable = specs.DepthEnabled;
     if(specs.DepthEnabled)
     {
-        Desc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
+        Desc.DepthStencilState.DepthWriteMask = specs.DepthWrite ? D3D12_DEPTH_WRITE_MASK_ALL : D3D12_DEPTH_WRITE_MASK_ZERO;
         Desc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC(specs.Depth);
         Desc.DSVFormat = DXGI_FORMAT(specs.DepthFormat);
     }
@@ -227,6 +227,10 @@ GraphicsPipeline::GraphicsPipeline(std::shared_ptr<Device> device, GraphicsPipel
             else if (ParameterDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) InputElement.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
         }
 
+        auto formatOverride = specs.InputFormats.find(ParameterDesc.SemanticName);
+        if (formatOverride != specs.InputFormats.end())
+            InputElement.Format = formatOverride->second;
+
         InputElementDescs.push_back(InputElement);
     }
     Desc.InputLayout.pInputElementDescs = InputElementDescs.data();
@@ -43,9 +43,13 @@ struct GraphicsPipelineSpecs
     int FormatCount;
     TextureFormat DepthFormat;
     bool DepthEnabled;
+    // Off to test against a depth buffer bound read only, in DEPTH_READ state
+    bool DepthWrite = true;
     BlendOperation BlendOperation;
 
     std::unordered_map<ShaderType, Shader> ShadersBytecodes;
+    // Overrides the input format deduced from the vertex shader reflection, by semantic name (packed vertex attributes)
+    std::unordered_map<std::string, DXGI_FORMAT> InputFormats;
 };
 
 class GraphicsPipeline
@@ -0,0 +1,195 @@
+﻿#include "ResourceStateTracker.h"
+
+void ResourceState::Set(D3D12_RESOURCE_STATES state)
+{
+    m_state = state;
+    m_subresources.clear();
+}
+
+void ResourceState::Set(uint32_t subresource, D3D12_RESOURCE_STATES state)
+{
+    if(m_subresources.empty())
+    {
+        if(m_state == state)
+            return;
+        m_subresources.assign(m_subresourceCount, m_state);
+    }
+
+    m_subresources[subresource] = state;
+    for(D3D12_RESOURCE_STATES subresourceState : m_subresources)
+    {
+        if(subresourceState != state)
+            return;
+    }
+    Set(state);
+}
+
+void ResourceStateTracker::Transition(ID3D12Resource* resource, ResourceState& state, D3D12_RESOURCE_STATES after)
+{
+    EndTransition(resource);
+
+    if(state.IsUniform())
+    {
+        if(state.Get() != after)
+            Queue(resource, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, state.Get(), after);
+    }
+    else
+    {
+        // An all subresources barrier needs them in the same state before
+        for(uint32_t i = 0; i < state.GetSubresourceCount(); i++)
+        {
+            if(state.Get(i) != after)
+                Queue(resource, i, state.Get(i), after);
+        }
+    }
+
+    state.Set(after);
+}
+
+void ResourceStateTracker::Transition(ID3D12Resource* resource, ResourceState& state, uint32_t subresource, D3D12_RESOURCE_STATES after)
+{
+    EndTransition(resource);
+
+    if(state.Get(subresource) != after)
+        Queue(resource, subresource, state.Get(subresource), after);
+
+    state.Set(subresource, after);
+}
+
+void ResourceStateTracker::BeginTransition(ID3D12Resource* resource, ResourceState& state, D3D12_RESOURCE_STATES after)
+{
+    EndTransition(resource);
+
+    if(!state.IsUniform())
+    {
+        Transition(resource, state, after);
+        return;
+    }
+
+    if(state.Get() == after)
+        return;
+
+    D3D12_RESOURCE_BARRIER barrier = {};
+    barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+    barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY;
+    barrier.Transition.pResource = resource;
+    barrier.Transition.StateBefore = state.Get();
+    barrier.Transition.StateAfter = after;
+    barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+    m_pending.push_back(barrier);
+
+    m_splits.push_back({ resource, state.Get(), after });
+    state.Set(after);
+}
+
+void ResourceStateTracker::EndTransitions()
+{
+    while(!m_splits.empty())
+        EndTransition((uint32_t)m_splits.size() - 1);
+}
+
+void ResourceStateTracker::Aliasing(ID3D12Resource* before, ID3D12Resource* after)
+{
+    D3D12_RESOURCE_BARRIER barrier = {};
+    barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+    barrier.Aliasing.pResourceBefore = before;
+    barrier.Aliasing.pResourceAfter = after;
+    m_pending.push_back(barrier);
+}
+
+void ResourceStateTracker::Flush(ID3D12GraphicsCommandList* commandList)
+{
+    if(m_pending.empty())
+        return;
+
+    if(m_recording)
+        m_recordedBatches.push_back(m_pending);
+    if(commandList)
+        commandList->ResourceBarrier((UINT)m_pending.size(), m_pending.data());
+
+    m_pending.clear();
+}
+
+void ResourceStateTracker::Reset()
+{
+    m_pending.clear();
+    m_splits.clear();
+}
+
+void ResourceStateTracker::Queue(ID3D12Resource* resource, uint32_t subresource, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after)
+{
+    // Barriers of other subresources in between do not depend on this one, anything else touching it keeps the order
+    for(size_t i = m_pending.size(); i-- > 0;)
+    {
+        D3D12_RESOURCE_BARRIER& pending = m_pending[i];
+        if(pending.Type == D3D12_RESOURCE_BARRIER_TYPE_ALIASING)
+        {
+            if(pending.Aliasing.pResourceAfter == resource || pending.Aliasing.pResourceBefore == resource)
+                break;
+            continue;
+        }
+
+        if(pending.Type != D3D12_RESOURCE_BARRIER_TYPE_TRANSITION || pending.Transition.pResource != resource)
+            continue;
+
+        bool sameSubresource = pending.Transition.Subresource == subresource;
+        bool allSubresources = pending.Transition.Subresource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES || subresource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+        if(!sameSubresource && !allSubresources)
+            continue;
+
+        if(!sameSubresource || pending.Flags != D3D12_RESOURCE_BARRIER_FLAG_NONE)
+            break;
+
+        if(pending.Transition.StateBefore == after)
+            m_pending.erase(m_pending.begin() + i);
+        else
+            pending.Transition.StateAfter = after;
+        return;
+    }
+
+    D3D12_RESOURCE_BARRIER barrier = {};
+    barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+    barrier.Transition.pResource = resource;
+    barrier.Transition.StateBefore = before;
+    barrier.Transition.StateAfter = after;
+    barrier.Transition.Subresource = subresource;
+    m_pending.push_back(barrier);
+}
+
+void ResourceStateTracker::EndTransition(ID3D12Resource* resource)
+{
+    for(uint32_t i = 0; i < m_splits.size(); i++)
+    {
+        if(m_splits[i].Resource == resource)
+        {
+            EndTransition(i);
+            return;
+        }
+    }
+}
+
+void ResourceStateTracker::EndTransition(uint32_t split)
+{
+    SplitTransition transition = m_splits[split];
+    m_splits.erase(m_splits.begin() + split);
+
+    // Not flushed yet, nothing to overlap with so it becomes a regular transition
+    for(D3D12_RESOURCE_BARRIER& pending : m_pending)
+    {
+        if(pending.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION && pending.Transition.pResource == transition.Resource &&
+            pending.Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY)
+        {
+            pending.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+            return;
+        }
+    }
+
+    D3D12_RESOURCE_BARRIER barrier = {};
+    barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+    barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_END_ONLY;
+    barrier.Transition.pResource = transition.Resource;
+    barrier.Transition.StateBefore = transition.Before;
+    barrier.Transition.StateAfter = transition.After;
+    barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+    m_pending.push_back(barrier);
+}
@@ -0,0 +1,65 @@
+﻿#pragma once
+#include <Core.h>
+
+// Subresource states of a texture, a single state while they are all the same
+class ResourceState
+{
+public:
+    ResourceState(D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_COMMON, uint32_t subresourceCount = 1) : m_state(state), m_subresourceCount(subresourceCount) {}
+
+    bool IsUniform() const { return m_subresources.empty(); }
+    uint32_t GetSubresourceCount() const { return m_subresourceCount; }
+    // The state of subresource 0 when they differ
+    D3D12_RESOURCE_STATES Get() const { return m_subresources.empty() ? m_state : m_subresources[0]; }
+    D3D12_RESOURCE_STATES Get(uint32_t subresource) const { return m_subresources.empty() ? m_state : m_subresources[subresource]; }
+    void Set(D3D12_RESOURCE_STATES state);
+    void Set(uint32_t subresource, D3D12_RESOURCE_STATES state);
+
+private:
+    D3D12_RESOURCE_STATES m_state;
+    uint32_t m_subresourceCount;
+    std::vector<D3D12_RESOURCE_STATES> m_subresources;
+};
+
+// Queues the barriers of a command list and submits them in one ResourceBarrier call right before the work that needs them.
+// A transition queued after another one of the same subresource is merged with it, dropped when it goes back to where it started.
+class ResourceStateTracker
+{
+public:
+    void Transition(ID3D12Resource* resource, ResourceState& state, D3D12_RESOURCE_STATES after);
+    void Transition(ID3D12Resource* resource, ResourceState& state, uint32_t subresource, D3D12_RESOURCE_STATES after);
+    // Split barrier : the begin half goes with the next flush, the end half with the next transition of the resource.
+    // The resource must not be used in between.
+    void BeginTransition(ID3D12Resource* resource, ResourceState& state, D3D12_RESOURCE_STATES after);
+    // Split barriers can not outlive the command list
+    void EndTransitions();
+    // Null before for any resource that used the memory
+    void Aliasing(ID3D12Resource* before, ID3D12Resource* after);
+
+    // Records the barriers instead of submitting them when commandList is null
+    void Flush(ID3D12GraphicsCommandList* commandList);
+    void Reset();
+
+    bool HasPendingBarriers() const { return !m_pending.empty(); }
+    // Every flushed batch is kept, to check the batching without a device
+    void SetRecording(bool recording) { m_recording = recording; m_recordedBatches.clear(); }
+    const std::vector<std::vector<D3D12_RESOURCE_BARRIER>>& GetRecordedBatches() const { return m_recordedBatches; }
+
+private:
+    struct SplitTransition
+    {
+        ID3D12Resource* Resource;
+        D3D12_RESOURCE_STATES Before;
+        D3D12_RESOURCE_STATES After;
+    };
+
+    void Queue(ID3D12Resource* resource, uint32_t subresource, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after);
+    void EndTransition(ID3D12Resource* resource);
+    void EndTransition(uint32_t split);
+
+    std::vector<D3D12_RESOURCE_BARRIER> m_pending;
+    std::vector<SplitTransition> m_splits;
+
+    bool m_recording = false;
+    std::vector<std::vector<D3D12_RESOURCE_BARRIER>> m_recordedBatches;
+};
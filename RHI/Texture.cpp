@@ -24,28 +24,39 @@ Texture::Texture(std::shared_ptr<Device> device) : m_device(device)
 Texture::Texture(std::shared_ptr<Device> device, std::shared_ptr<Allocator> allocator, uint32_t width, uint32_t height, TextureFormat format, TextureType type)
     : m_device(device), m_format(format), m_width(width), m_height(height)
 {
-    switch(type)
-    {
-        case TextureType::RenderTarget:
-            m_state = D3D12_RESOURCE_STATE_RENDER_TARGET;
-        break;
-        case TextureType::DepthTarget:
-            m_state = D3D12_RESOURCE_STATE_DEPTH_WRITE;
-        break;
-        case TextureType::Storage:
-            m_state = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
-        break;
-        case TextureType::ShaderResource:
-            m_state = D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE;
-        break;
-        case TextureType::Copy:
-            m_state = D3D12_RESOURCE_STATE_COPY_DEST;
-        break;
-    }
+    m_state = GetInitialState(type);
 
     D3D12MA::ALLOCATION_DESC AllocationDesc = {};
     AllocationDesc.HeapType = type == TextureType::Copy ? D3D12_HEAP_TYPE_UPLOAD : D3D12_HEAP_TYPE_DEFAULT;
 
+    D3D12_RESOURCE_DESC ResourceDesc = GetResourceDesc(width, height, format, type);
+
+    m_resource = allocator->Allocate(&AllocationDesc, &ResourceDesc, m_state.Get());
+    m_hasAlloc = true;
+}
+
+Texture::Texture(std::shared_ptr<Device> device, std::shared_ptr<Allocator> allocator, D3D12MA::Allocation* memory, uint64_t offset,
+    uint32_t width, uint32_t height, TextureFormat format, TextureType type)
+    : m_device(device), m_format(format), m_width(width), m_height(height)
+{
+    m_state = GetInitialState(type);
+
+    D3D12_RESOURCE_DESC ResourceDesc = GetResourceDesc(width, height, format, type);
+
+    m_resource = allocator->AllocateAliasing(memory, offset, &ResourceDesc, m_state.Get());
+    m_placed = true;
+}
+
+Texture::~Texture()
+{
+    if(m_hasAlloc)
+        m_resource.Allocation->Release();
+    if(m_placed)
+        m_resource.Resource->Release();
+}
+
+D3D12_RESOURCE_DESC Texture::GetResourceDesc(uint32_t width, uint32_t height, TextureFormat format, TextureType type)
+{
     D3D12_RESOURCE_DESC ResourceDesc = {};
     ResourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
     ResourceDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
@@ -59,14 +70,25 @@ Texture::Texture(std::shared_ptr<Device> device, std::shared_ptr<Allocator> allo
     ResourceDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
     ResourceDesc.Flags = GetResourceFlag(type);
 
-    m_resource = allocator->Allocate(&AllocationDesc, &ResourceDesc, m_state);
-    m_hasAlloc = true;
+    return ResourceDesc;
 }
 
-Texture::~Texture()
+D3D12_RESOURCE_STATES Texture::GetInitialState(TextureType type)
 {
-    if(m_hasAlloc)
-        m_resource.Allocation->Release();
+    switch(type)
+    {
+        case TextureType::RenderTarget:
+            return D3D12_RESOURCE_STATE_RENDER_TARGET;
+        case TextureType::DepthTarget:
+            return D3D12_RESOURCE_STATE_DEPTH_WRITE;
+        case TextureType::Storage:
+            return D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+        case TextureType::ShaderResource:
+            return D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE;
+        case TextureType::Copy:
+            return D3D12_RESOURCE_STATE_COPY_DEST;
+    }
+    return D3D12_RESOURCE_STATE_COMMON;
 }
 
 void Texture::CreateRenderTarget(std::shared_ptr<DescriptorHeap> heap)
@@ -88,6 +110,10 @@ void Texture::CreateDepthTarget(std::shared_ptr<DescriptorHeap> heap)
     dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
     dsvDesc.Flags = D3D12_DSV_FLAG_NONE;
     m_device->GetDevice()->CreateDepthStencilView(m_resource.Resource, &dsvDesc, m_dsv.CPU);
+
+    m_readOnlyDsv = heap->Allocate();
+    dsvDesc.Flags = D3D12_DSV_FLAG_READ_ONLY_DEPTH;
+    m_device->GetDevice()->CreateDepthStencilView(m_resource.Resource, &dsvDesc, m_readOnlyDsv.CPU);
 }
 
 void Texture::CreateShaderResource(std::shared_ptr<DescriptorHeap> heap)
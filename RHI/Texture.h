@@ -4,6 +4,7 @@
 #include "Allocator.h"
 #include "DescriptorHeap.h"
 #include "Device.h"
+#include "ResourceStateTracker.h"
 
 enum class TextureType
 {
@@ -32,21 +33,31 @@ class Texture
 public:
     Texture(std::shared_ptr<Device> device);
     Texture(std::shared_ptr<Device> device, std::shared_ptr<Allocator> allocator, uint32_t width, uint32_t height, TextureFormat format, TextureType type);
+    // Placed at offset in memory other textures may alias
+    Texture(std::shared_ptr<Device> device, std::shared_ptr<Allocator> allocator, D3D12MA::Allocation* memory, uint64_t offset,
+        uint32_t width, uint32_t height, TextureFormat format, TextureType type);
     ~Texture();
 
+    static D3D12_RESOURCE_DESC GetResourceDesc(uint32_t width, uint32_t height, TextureFormat format, TextureType type);
+    static D3D12_RESOURCE_STATES GetInitialState(TextureType type);
+
     void CreateRenderTarget(std::shared_ptr<DescriptorHeap> heap);
     void CreateDepthTarget(std::shared_ptr<DescriptorHeap> heap);
     void CreateShaderResource(std::shared_ptr<DescriptorHeap> heap);
     void CreateUnorderedAccessView(std::shared_ptr<DescriptorHeap> heap);
 
-    void SetState(D3D12_RESOURCE_STATES state) { m_state = state; }
-    D3D12_RESOURCE_STATES GetState() { return m_state; }
+    void SetState(D3D12_RESOURCE_STATES state) { m_state.Set(state); }
+    D3D12_RESOURCE_STATES GetState() { return m_state.Get(); }
+    ResourceState& GetResourceState() { return m_state; }
     GPUResource& GetResource() { return m_resource; }
     TextureFormat GetFormat() { return m_format; }
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
     void SetFormat(TextureFormat format) { m_format = format; }
 
     DescriptorHandle m_rtv;
     DescriptorHandle m_dsv;
+    DescriptorHandle m_readOnlyDsv;
     DescriptorHandle m_srvUav;
 
 private:
@@ -55,10 +66,11 @@ private:
 
     std::shared_ptr<Device> m_device;
     TextureFormat m_format;
-    D3D12_RESOURCE_STATES m_state;
-    int m_width;
-    int m_height;
+    ResourceState m_state;
+    int m_width = 0;
+    int m_height = 0;
 
     GPUResource m_resource;
     bool m_hasAlloc = false;
+    bool m_placed = false;
 };
\ No newline at end of file
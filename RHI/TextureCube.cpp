@@ -14,6 +14,9 @@ TextureCube::TextureCube(std::shared_ptr<Device> device, std::shared_ptr<Command
 
     m_width = m_resourceComPtr->GetDesc().Width;
     m_height = m_resourceComPtr->GetDesc().Height;
+    m_mipLevels = m_resourceComPtr->GetDesc().MipLevels;
+    // Left ready to sample by the loader
+    m_state = ResourceState(D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, m_mipLevels * 6);
 
     auto shaderHeap = heaps.ShaderHeap;
     m_srv = shaderHeap->Allocate();
@@ -48,9 +51,10 @@ TextureCube::TextureCube(std::shared_ptr<Device> device, std::shared_ptr<Allocat
     resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
     resourceDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
 
-    m_state = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    m_mipLevels = 5;
+    m_state = ResourceState(D3D12_RESOURCE_STATE_UNORDERED_ACCESS, m_mipLevels * 6);
 
-    m_resource = allocator->Allocate(&allocDesc, &resourceDesc, m_state);
+    m_resource = allocator->Allocate(&allocDesc, &resourceDesc, m_state.Get());
     m_hasAlloc = true;
 
     auto shaderHeap = heaps.ShaderHeap;
@@ -17,8 +17,10 @@ public:
     
     DescriptorHandle& GetSrvHandle() { return m_srv; }
     GPUResource& GetResource() { return m_resource; }
-    D3D12_RESOURCE_STATES GetState() { return m_state; }
-    void SetState(D3D12_RESOURCE_STATES state) { m_state = state; }
+    D3D12_RESOURCE_STATES GetState() { return m_state.Get(); }
+    void SetState(D3D12_RESOURCE_STATES state) { m_state.Set(state); }
+    ResourceState& GetResourceState() { return m_state; }
+    uint32_t GetMipLevels() { return m_mipLevels; }
 
 private:
     friend class CommandList;
@@ -26,7 +28,9 @@ private:
     DescriptorHandle m_uavs[6];
 
     uint32_t m_width, m_height;
-    D3D12_RESOURCE_STATES m_state;
+    uint32_t m_mipLevels;
+    // One subresource per mip and face
+    ResourceState m_state;
     GPUResource m_resource;
     bool m_hasAlloc = false;
     
@@ -0,0 +1,137 @@
+﻿#include "CascadedShadows.h"
+
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+    bool IsValid(const BVHBox& box)
+    {
+        return box.Min.x <= box.Max.x && box.Min.y <= box.Max.y && box.Min.z <= box.Max.z;
+    }
+
+    // Light space bounds of transformed points
+    void TransformBounds(const XMVECTOR* points, uint32_t count, FXMMATRIX transform, XMVECTOR& boundsMin, XMVECTOR& boundsMax)
+    {
+        boundsMin = XMVectorReplicate(FLT_MAX);
+        boundsMax = XMVectorReplicate(-FLT_MAX);
+        for(uint32_t i = 0; i < count; i++)
+        {
+            XMVECTOR point = XMVector3Transform(points[i], transform);
+            boundsMin = XMVectorMin(boundsMin, point);
+            boundsMax = XMVectorMax(boundsMax, point);
+        }
+    }
+
+    float QuantizeExtent(float extent)
+    {
+        float step = exp2f(floorf(log2f(extent))) / SHADOW_CASCADE_EXTENT_STEPS;
+        return ceilf(extent / step) * step;
+    }
+}
+
+void CascadedShadows::ComputeSplits(float nearZ, float farZ, uint32_t count, float lambda, float* splits)
+{
+    // Lambda blend of the logarithmic splits, even resolution along the depth, and the uniform ones which keep the near cascades from being too thin
+    for(uint32_t i = 0; i <= count; i++)
+    {
+        float t = (float)i / count;
+        float logSplit = nearZ * powf(farZ / nearZ, t);
+        float uniformSplit = nearZ + (farZ - nearZ) * t;
+        splits[i] = lambda * logSplit + (1.0f - lambda) * uniformSplit;
+    }
+
+    splits[0] = nearZ;
+    splits[count] = farZ;
+}
+
+XMMATRIX CascadedShadows::MakeLightView(const XMFLOAT3& direction)
+{
+    XMVECTOR lightDir = XMVector3Normalize(XMLoadFloat3(&direction));
+    XMVECTOR up = fabsf(XMVectorGetY(lightDir)) > 0.99f ? XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+    return XMMatrixLookAtLH(XMVectorZero(), lightDir, up);
+}
+
+ShadowCascade CascadedShadows::FitCascade(FXMMATRIX lightView, CXMMATRIX invCameraView, float projX, float projY,
+    float splitNear, float splitFar, const BVHBox& casterBounds, uint32_t resolution)
+{
+    // Frustum slice corners, camera view space then light space
+    XMVECTOR corners[8];
+    for(uint32_t i = 0; i < 8; i++)
+    {
+        float depth = i < 4 ? splitNear : splitFar;
+        float x = (i & 1) ? depth / projX : -depth / projX;
+        float y = (i & 2) ? depth / projY : -depth / projY;
+        corners[i] = XMVectorSet(x, y, depth, 1.0f);
+    }
+
+    XMVECTOR sliceMin, sliceMax;
+    TransformBounds(corners, 8, invCameraView * lightView, sliceMin, sliceMax);
+
+    // Nothing outside of the casters bounds casts or receives : the box shrinks to their overlap on x and y,
+    // reaches back to the farthest caster towards the light and stops at the farthest receiver
+    XMVECTOR boundsMin = sliceMin;
+    XMVECTOR boundsMax = sliceMax;
+    if(IsValid(casterBounds))
+    {
+        XMVECTOR casterCorners[8];
+        for(uint32_t i = 0; i < 8; i++)
+        {
+            casterCorners[i] = XMVectorSet((i & 1) ? casterBounds.Max.x : casterBounds.Min.x, (i & 2) ? casterBounds.Max.y : casterBounds.Min.y,
+                (i & 4) ? casterBounds.Max.z : casterBounds.Min.z, 1.0f);
+        }
+
+        XMVECTOR casterMin, casterMax;
+        TransformBounds(casterCorners, 8, lightView, casterMin, casterMax);
+
+        XMVECTOR overlapMin = XMVectorMax(sliceMin, casterMin);
+        XMVECTOR overlapMax = XMVectorMin(sliceMax, casterMax);
+        if(XMVector3LessOrEqual(overlapMin, overlapMax))
+        {
+            boundsMin = XMVectorSelect(overlapMin, casterMin, XMVectorSelectControl(0, 0, 1, 0));
+            boundsMax = overlapMax;
+        }
+    }
+
+    XMFLOAT3 lightMin, lightMax;
+    XMStoreFloat3(&lightMin, boundsMin);
+    XMStoreFloat3(&lightMax, boundsMax);
+
+    // Square texels : one extent for both axes, quantized so its texel size stays the same from frame to frame.
+    // One texel of margin lets the snapped origin move down without uncovering the max side.
+    uint32_t texelCount = (std::max)(resolution, 2u);
+    float extent = QuantizeExtent((std::max)((std::max)(lightMax.x - lightMin.x, lightMax.y - lightMin.y), 1e-3f));
+    float texelSize = extent / (texelCount - 1);
+    float width = texelSize * texelCount;
+    float left = floorf(lightMin.x / texelSize) * texelSize;
+    float bottom = floorf(lightMin.y / texelSize) * texelSize;
+    float nearZ = lightMin.z;
+    float farZ = (std::max)(lightMax.z, nearZ + 1e-3f);
+
+    ShadowCascade cascade;
+    XMStoreFloat4x4(&cascade.ViewProj, lightView * XMMatrixOrthographicOffCenterLH(left, left + width, bottom, bottom + width, nearZ, farZ));
+    cascade.SplitNear = splitNear;
+    cascade.SplitFar = splitFar;
+    cascade.TexelSize = texelSize;
+    cascade.TexelDepth = texelSize / (farZ - nearZ);
+    return cascade;
+}
+
+void CascadedShadows::Compute(FXMMATRIX cameraView, CXMMATRIX cameraProj, const XMFLOAT3& lightDirection,
+    const BVHBox& casterBounds, uint32_t resolution, ShadowCascade* cascades)
+{
+    // D3D left handed perspective : _33 = f / (f - n), _43 = -n * _33
+    XMFLOAT4X4 proj;
+    XMStoreFloat4x4(&proj, cameraProj);
+    float nearZ = -proj._43 / proj._33;
+    float farZ = (std::min)(proj._33 * nearZ / (proj._33 - 1.0f), (float)SHADOW_CASCADE_MAX_DISTANCE);
+
+    float splits[SHADOW_CASCADE_COUNT + 1];
+    ComputeSplits(nearZ, farZ, SHADOW_CASCADE_COUNT, SHADOW_CASCADE_SPLIT_LAMBDA, splits);
+
+    XMMATRIX invCameraView = XMMatrixInverse(nullptr, cameraView);
+    XMMATRIX lightView = MakeLightView(lightDirection);
+    for(uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++)
+        cascades[i] = FitCascade(lightView, invCameraView, proj._11, proj._22, splits[i], splits[i + 1], casterBounds, resolution);
+}
@@ -0,0 +1,43 @@
+﻿#pragma once
+#include "Core.h"
+#include "DynamicBVH.h"
+
+#define SHADOW_CASCADE_COUNT 4
+// Cascades are square tiles of one depth atlas, SHADOW_CASCADE_ATLAS_COLUMNS per row
+#define SHADOW_CASCADE_ATLAS_COLUMNS 2
+#define SHADOW_CASCADE_ATLAS_ROWS ((SHADOW_CASCADE_COUNT + SHADOW_CASCADE_ATLAS_COLUMNS - 1) / SHADOW_CASCADE_ATLAS_COLUMNS)
+// Practical split scheme blend, 0 is uniform and 1 logarithmic
+#define SHADOW_CASCADE_SPLIT_LAMBDA 0.8f
+// View depth where the shadows end, when nearer than the camera far plane
+#define SHADOW_CASCADE_MAX_DISTANCE 200.0f
+// Cascade extents are rounded up to this many steps per power of two, the texel size only changes when crossing a step
+#define SHADOW_CASCADE_EXTENT_STEPS 8.0f
+
+struct ShadowCascade
+{
+    DirectX::XMFLOAT4X4 ViewProj;
+    float SplitNear; // Camera view depths covered
+    float SplitFar;
+    float TexelSize; // World units per shadow map texel
+    float TexelDepth; // TexelSize in projected depth units, scales the depth bias
+};
+
+// CPU side of the cascaded shadow maps : splits of the camera depth range and a light space ortho projection per split.
+// Each projection is fitted to the bounds of its frustum slice clipped by the caster bounds, then snapped to its texel grid
+// so moving the camera does not make the shadow edges shimmer.
+class CascadedShadows
+{
+public:
+    // count + 1 depths from nearZ to farZ
+    static void ComputeSplits(float nearZ, float farZ, uint32_t count, float lambda, float* splits);
+    // Rotation only look to matrix along the light direction
+    static DirectX::XMMATRIX MakeLightView(const DirectX::XMFLOAT3& direction);
+    // Camera view depths [splitNear, splitFar], projX and projY are the camera projection scales (_11 and _22).
+    // Casters are expected inside casterBounds (world space), an inverted box fits the slice alone.
+    static ShadowCascade FitCascade(DirectX::FXMMATRIX lightView, DirectX::CXMMATRIX invCameraView, float projX, float projY,
+        float splitNear, float splitFar, const BVHBox& casterBounds, uint32_t resolution);
+
+    // SHADOW_CASCADE_COUNT cascades of the camera, resolution is the size of one cascade tile in texels
+    static void Compute(DirectX::FXMMATRIX cameraView, DirectX::CXMMATRIX cameraProj, const DirectX::XMFLOAT3& lightDirection,
+        const BVHBox& casterBounds, uint32_t resolution, ShadowCascade* cascades);
+};
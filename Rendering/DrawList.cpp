@@ -0,0 +1,97 @@
+﻿#include "DrawList.h"
+#include "Jobs/JobSystem.h"
+
+#include <cstring>
+
+static_assert(DRAW_KEY_PASS_BITS + DRAW_KEY_PIPELINE_BITS + DRAW_KEY_MATERIAL_BITS + DRAW_KEY_MESH_BITS + DRAW_KEY_DEPTH_BITS == 64, "The draw key fields do not fill 64 bits");
+
+uint64_t DrawList::MakeKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+{
+    // Positive floats order like their bits, the sign bit is always clear
+    depth = (std::max)(depth, 0.0f);
+    uint32_t depthBits;
+    memcpy(&depthBits, &depth, sizeof(float));
+    depthBits >>= 31 - DRAW_KEY_DEPTH_BITS;
+
+    uint64_t key = pass & ((1u << DRAW_KEY_PASS_BITS) - 1);
+    key = (key << DRAW_KEY_PIPELINE_BITS) | (pipeline & ((1u << DRAW_KEY_PIPELINE_BITS) - 1));
+    key = (key << DRAW_KEY_MATERIAL_BITS) | (material & ((1u << DRAW_KEY_MATERIAL_BITS) - 1));
+    key = (key << DRAW_KEY_MESH_BITS) | (mesh & ((1u << DRAW_KEY_MESH_BITS) - 1));
+    key = (key << DRAW_KEY_DEPTH_BITS) | (depthBits & ((1u << DRAW_KEY_DEPTH_BITS) - 1));
+    return key;
+}
+
+void DrawList::Sort()
+{
+    PROFILE_FUNCTION();
+
+    uint32_t count = (uint32_t)m_packets.size();
+    if(count < 2)
+        return;
+
+    uint64_t differingBits = 0;
+    for(const DrawPacket& packet : m_packets)
+        differingBits |= packet.Key ^ m_packets[0].Key;
+
+    uint32_t chunkCount = (count + DRAW_LIST_SORT_GRAIN_SIZE - 1) / DRAW_LIST_SORT_GRAIN_SIZE;
+    m_scratch.resize(count);
+    m_histograms.resize(chunkCount * 256);
+
+    DrawPacket* source = m_packets.data();
+    DrawPacket* destination = m_scratch.data();
+    for(uint32_t shift = 0; shift < 64; shift += 8)
+    {
+        if(((differingBits >> shift) & 0xFF) == 0)
+            continue;
+
+        auto CountDigits = [&](uint32_t begin, uint32_t end)
+        {
+            for(uint32_t chunk = begin; chunk < end; chunk++)
+            {
+                uint32_t* histogram = &m_histograms[chunk * 256];
+                memset(histogram, 0, 256 * sizeof(uint32_t));
+                uint32_t last = (std::min)((chunk + 1) * DRAW_LIST_SORT_GRAIN_SIZE, count);
+                for(uint32_t i = chunk * DRAW_LIST_SORT_GRAIN_SIZE; i < last; i++)
+                    histogram[(source[i].Key >> shift) & 0xFF]++;
+            }
+        };
+
+        auto Scatter = [&](uint32_t begin, uint32_t end)
+        {
+            for(uint32_t chunk = begin; chunk < end; chunk++)
+            {
+                uint32_t* offsets = &m_histograms[chunk * 256];
+                uint32_t last = (std::min)((chunk + 1) * DRAW_LIST_SORT_GRAIN_SIZE, count);
+                for(uint32_t i = chunk * DRAW_LIST_SORT_GRAIN_SIZE; i < last; i++)
+                    destination[offsets[(source[i].Key >> shift) & 0xFF]++] = source[i];
+            }
+        };
+
+        if(JobSystem::Get() && chunkCount > 1)
+            JobSystem::Get()->ParallelFor(chunkCount, 1, CountDigits);
+        else
+            CountDigits(0, chunkCount);
+
+        // Each chunk writes its packets of a digit after those of the previous chunks, which keeps the sort stable
+        uint32_t offset = 0;
+        for(uint32_t digit = 0; digit < 256; digit++)
+        {
+            for(uint32_t chunk = 0; chunk < chunkCount; chunk++)
+            {
+                uint32_t digitCount = m_histograms[chunk * 256 + digit];
+                m_histograms[chunk * 256 + digit] = offset;
+                offset += digitCount;
+            }
+        }
+
+        if(JobSystem::Get() && chunkCount > 1)
+            JobSystem::Get()->ParallelFor(chunkCount, 1, Scatter);
+        else
+            Scatter(0, chunkCount);
+
+        std::swap(source, destination);
+    }
+
+    if(source != m_packets.data())
+        m_packets.swap(m_scratch);
+}
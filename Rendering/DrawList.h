@@ -0,0 +1,41 @@
+﻿#pragma once
+#include "Core.h"
+
+// Sort key fields, most significant first. Material above mesh keeps the bindings of consecutive draws, the depth orders the draws of a mesh front to back.
+#define DRAW_KEY_PASS_BITS 4
+#define DRAW_KEY_PIPELINE_BITS 4
+#define DRAW_KEY_MATERIAL_BITS 16
+#define DRAW_KEY_MESH_BITS 16
+#define DRAW_KEY_DEPTH_BITS 24
+// Packets per radix sort job
+#define DRAW_LIST_SORT_GRAIN_SIZE 4096
+
+// One instanced draw : a run of the batch draw instances list, every primitive of the batch mesh is drawn with it
+struct DrawPacket
+{
+    uint64_t Key;
+    uint32_t Batch; // In RenderWorld::GetRenderMeshesData
+    uint32_t Lod;
+    uint32_t FirstInstance;
+    uint32_t InstanceCount;
+};
+
+class DrawList
+{
+public:
+    // Fields wider than their bits are truncated, which only affects the order. Negative depths count as 0.
+    static uint64_t MakeKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+
+    void Clear() { m_packets.clear(); }
+    void Add(const DrawPacket& packet) { m_packets.push_back(packet); }
+    // Stable LSD radix sort on the keys, 8 bits per pass. Digits all the keys share are skipped, the chunks of a pass are counted and scattered in parallel.
+    void Sort();
+
+    const std::vector<DrawPacket>& GetPackets() const { return m_packets; }
+    uint32_t GetPacketCount() const { return (uint32_t)m_packets.size(); }
+
+private:
+    std::vector<DrawPacket> m_packets;
+    std::vector<DrawPacket> m_scratch;
+    std::vector<uint32_t> m_histograms; // 256 digits per chunk
+};
@@ -18,6 +18,7 @@ void GBufferRenderPass::Initialize(std::shared_ptr<D3D12Renderer> renderer, int
     geomSpecs.BlendOperation = BlendOperation::None;
     ShaderCompiler::CompileShader("Shaders/SimpleVertex.hlsl", ShaderType::Vertex, geomSpecs.ShadersBytecodes[ShaderType::Vertex]);
     ShaderCompiler::CompileShader("Shaders/DeferredGBufferPixel.hlsl", ShaderType::Pixel, geomSpecs.ShadersBytecodes[ShaderType::Pixel]);
+    VertexCompression::SetInputFormats(geomSpecs);
 
     m_deferredGeometryPipeline = renderer->CreateGraphicsPipeline(geomSpecs);
 
@@ -55,6 +56,8 @@ void GBufferRenderPass::OnResize(std::shared_ptr<D3D12Renderer> renderer, int wi
 
 void GBufferRenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const GlobalPassData& globalPassData, const Camera& camera, const std::vector<RenderMeshData>& renderMeshesData, RenderTargetInfo renderTarget)
 {
+    PROFILE_FUNCTION();
+
     auto view = camera.GetViewMatrix();
     auto proj = camera.GetProjMatrix();
     auto invViewProj = camera.GetInvViewProjMatrix();
@@ -71,7 +74,6 @@ void GBufferRenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const Glob
     cbuf.ScreenDimensions[1] = globalPassData.ViewportSizeY;
     DirectX::XMStoreFloat4x4(&cbuf.ViewProj, viewProj);
     DirectX::XMStoreFloat4x4(&cbuf.InvViewProj, invViewProj);
-    cbuf.ShadowTransform = globalPassData.ShadowMap.ShadowTransform;
     cbuf.ShadowEnabled = globalPassData.EnableShadows;
         
     void* data;
@@ -79,17 +81,12 @@ void GBufferRenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const Glob
     memcpy(data, &cbuf, sizeof(SceneConstantBuffer));
     m_sceneConstantBuffer->Unmap(0, 0);
     
+    ClusterCullingView cullingView = ClusterCulling::MakeView(viewProj, camera.GetPosition());
+
     auto commandList = renderer->GetCurrentCommandList();
 
     commandList->SetViewport(0, 0, globalPassData.ViewportSizeX, globalPassData.ViewportSizeY);
 
-    std::unordered_map<std::shared_ptr<Texture>, D3D12_RESOURCE_STATES> renderTargetsBatchedBarriers;
-    renderTargetsBatchedBarriers.emplace(m_GBuffer.AlbedoRenderTarget, D3D12_RESOURCE_STATE_RENDER_TARGET);
-    renderTargetsBatchedBarriers.emplace(m_GBuffer.NormalRenderTarget, D3D12_RESOURCE_STATE_RENDER_TARGET);
-    renderTargetsBatchedBarriers.emplace(m_GBuffer.MetallicRoughnessRenderTarget, D3D12_RESOURCE_STATE_RENDER_TARGET);
-    renderTargetsBatchedBarriers.emplace(m_GBuffer.DepthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE);
-    commandList->ImageBarrier(renderTargetsBatchedBarriers);
-
     commandList->ClearRenderTarget(m_GBuffer.AlbedoRenderTarget, 0.0f, 0.0f, 0.0f, 1.0f);
     commandList->ClearRenderTarget(m_GBuffer.NormalRenderTarget, 0.0f, 0.0f, 0.0f, 1.0f);
     commandList->ClearRenderTarget(m_GBuffer.MetallicRoughnessRenderTarget, 0.0f, 0.0f, 0.0f, 1.0f);
@@ -105,50 +102,76 @@ void GBufferRenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const Glob
     commandList->BindGraphicsConstantBuffer(m_sceneConstantBuffer, 0);
     commandList->BindGraphicsSampler(m_textureSampler, 1);
 
-    for(const auto renderMeshData : renderMeshesData)
+    // Sorted by material then mesh, the bindings are only set when they change
+    uint32_t boundBatch = UINT32_MAX;
+    uint32_t boundMaterial = UINT32_MAX;
+    for(const DrawPacket& packet : globalPassData.CameraDrawList->GetPackets())
     {
-        auto& material = renderMeshData.Material;
-
-        std::vector<InstanceData> instancesData;
-        for(auto instanceTransform : renderMeshData.InstancesTransforms)
+        const auto& renderMeshData = renderMeshesData[packet.Batch];
+        if(packet.Batch != boundBatch)
         {
-            InstanceData instanceData;
-            instanceData.WorldMat = instanceTransform;
-            instanceData.HasAlbedo = material.HasAlbedo;
-            instanceData.HasNormalMap = material.HasNormal;
-            instanceData.HasMetallicRoughness = material.HasMetallicRoughness;
-            instancesData.emplace_back(instanceData);
+            commandList->SetGraphicsShaderResource(renderMeshData.InstancesDataBuffer, 5);
+            boundBatch = packet.Batch;
         }
 
-        void* dt;
-        renderMeshData.InstancesDataBuffer->Map(0, 0, &dt);
-        memcpy(dt, instancesData.data(), sizeof(InstanceData) * renderMeshData.InstancesTransforms.size());
-        renderMeshData.InstancesDataBuffer->Unmap(0, 0);
+        if(renderMeshData.MaterialIndex != boundMaterial)
+        {
+            auto& material = renderMeshData.Material;
+
+            if(material.HasAlbedo)
+                commandList->BindGraphicsShaderResource(material.Albedo, 2);
 
-        commandList->SetGraphicsShaderResource(renderMeshData.InstancesDataBuffer, 5);
+            if(material.HasNormal)
+                commandList->BindGraphicsShaderResource(material.Normal, 3);
 
-        if(material.HasAlbedo)
-            commandList->BindGraphicsShaderResource(material.Albedo, 2);
+            if(material.HasMetallicRoughness)
+                commandList->BindGraphicsShaderResource(material.MetallicRoughness, 4);
 
-        if(material.HasNormal)
-            commandList->BindGraphicsShaderResource(material.Normal, 3);
+            boundMaterial = renderMeshData.MaterialIndex;
+        }
 
-        if(material.HasMetallicRoughness)
-            commandList->BindGraphicsShaderResource(material.MetallicRoughness, 4);
-            
-        const auto primitives = renderMeshData.Primitives;
-        for(const auto& primitive : primitives)
+        // Each packet is one instanced draw per primitive, reading its run of the draw instances list
+        commandList->SetGraphicsShaderResource(renderMeshData.DrawInstancesBuffer, 7, sizeof(uint32_t) * packet.FirstInstance);
+        for(const auto& primitive : renderMeshData.Item->GetPrimitives())
         {
+            commandList->BindGraphicsConstantBuffer(primitive.m_constantBuffer, 6);
             commandList->BindVertexBuffer(primitive.m_vertexBuffer);
             commandList->BindIndexBuffer(primitive.m_indicesBuffer);
-            commandList->DrawIndexed(primitive.m_indexCount, renderMeshData.InstancesTransforms.size());
+
+            const MeshLod& meshLod = primitive.m_lods[std::min(packet.Lod, (uint32_t)primitive.m_lods.size() - 1)];
+
+            // Meshlets only split LOD 0, and instanced draws share the whole index range
+            if(packet.Lod == 0 && renderMeshData.VisibleInstanceCount == 1 && !primitive.m_meshlets.empty())
+                DrawVisibleMeshlets(renderer, primitive, renderMeshData.Instances[renderMeshData.DrawInstances[packet.FirstInstance]].WorldMat, cullingView);
+            else
+                commandList->DrawIndexed(meshLod.IndexCount, packet.InstanceCount, meshLod.IndexOffset);
+        }
+    }
+}
+
+void GBufferRenderPass::DrawVisibleMeshlets(std::shared_ptr<D3D12Renderer> renderer, const Primitive& primitive, const DirectX::XMFLOAT4X4& world, const ClusterCullingView& cullingView)
+{
+    auto commandList = renderer->GetCurrentCommandList();
+
+    uint32_t* visibleMeshlets = renderer->GetFrameArena().Allocate<uint32_t>(primitive.m_meshletCullingData.Count);
+    uint32_t visibleCount = ClusterCulling::Cull(primitive.m_meshletCullingData, world, cullingView, visibleMeshlets);
+
+    uint32_t rangeStart = 0;
+    uint32_t rangeCount = 0;
+    for(uint32_t i = 0; i < visibleCount; i++)
+    {
+        const Meshlet& meshlet = primitive.m_meshlets[visibleMeshlets[i]];
+        if(rangeCount > 0 && meshlet.IndexOffset != rangeStart + rangeCount)
+        {
+            commandList->DrawIndexed(rangeCount, 1, rangeStart);
+            rangeCount = 0;
         }
+
+        if(rangeCount == 0)
+            rangeStart = meshlet.IndexOffset;
+        rangeCount += meshlet.TriangleCount * 3;
     }
 
-    std::unordered_map<std::shared_ptr<Texture>, D3D12_RESOURCE_STATES> readBatchedBarriers;
-    readBatchedBarriers.emplace(m_GBuffer.AlbedoRenderTarget, D3D12_RESOURCE_STATE_GENERIC_READ);
-    readBatchedBarriers.emplace(m_GBuffer.NormalRenderTarget, D3D12_RESOURCE_STATE_GENERIC_READ);
-    readBatchedBarriers.emplace(m_GBuffer.MetallicRoughnessRenderTarget, D3D12_RESOURCE_STATE_GENERIC_READ);
-    readBatchedBarriers.emplace(m_GBuffer.DepthBuffer, D3D12_RESOURCE_STATE_GENERIC_READ);
-    commandList->ImageBarrier(readBatchedBarriers);
+    if(rangeCount > 0)
+        commandList->DrawIndexed(rangeCount, 1, rangeStart);
 }
\ No newline at end of file
@@ -11,6 +11,9 @@ public:
     GBuffer GetGBuffer() { return m_GBuffer; }
 
 private:
+    // One draw per run of consecutive visible meshlets
+    void DrawVisibleMeshlets(std::shared_ptr<D3D12Renderer> renderer, const Primitive& primitive, const DirectX::XMFLOAT4X4& world, const ClusterCullingView& cullingView);
+
     std::shared_ptr<GraphicsPipeline> m_deferredGeometryPipeline;
     std::shared_ptr<Buffer> m_sceneConstantBuffer;
     std::shared_ptr<Sampler> m_textureSampler;
@@ -0,0 +1,120 @@
+﻿#include "InstanceCulling.h"
+
+#include <cfloat>
+
+using namespace DirectX;
+
+void InstanceBounds::Resize(uint32_t count)
+{
+    uint32_t paddedCount = (count + 3) & ~3u;
+    for(auto* component : { &CenterX, &CenterY, &CenterZ })
+        component->resize(paddedCount, 0.0f);
+    for(auto* component : { &ExtentX, &ExtentY, &ExtentZ })
+        component->resize(paddedCount, -FLT_MAX);
+}
+
+void InstanceBounds::Set(uint32_t index, FXMVECTOR center, FXMVECTOR extent)
+{
+    CenterX[index] = XMVectorGetX(center);
+    CenterY[index] = XMVectorGetY(center);
+    CenterZ[index] = XMVectorGetZ(center);
+    ExtentX[index] = XMVectorGetX(extent);
+    ExtentY[index] = XMVectorGetY(extent);
+    ExtentZ[index] = XMVectorGetZ(extent);
+}
+
+void InstanceBounds::SetEmpty(uint32_t index)
+{
+    Set(index, XMVectorZero(), XMVectorReplicate(-FLT_MAX));
+}
+
+CullingFrustum InstanceCulling::MakeFrustum(FXMMATRIX viewProj)
+{
+    // Gribb/Hartmann, row vectors so the planes come from the columns, D3D depth range [0, 1]
+    XMMATRIX columns = XMMatrixTranspose(viewProj);
+    XMVECTOR planes[6] = {
+        XMVectorAdd(columns.r[3], columns.r[0]),
+        XMVectorSubtract(columns.r[3], columns.r[0]),
+        XMVectorAdd(columns.r[3], columns.r[1]),
+        XMVectorSubtract(columns.r[3], columns.r[1]),
+        columns.r[2],
+        XMVectorSubtract(columns.r[3], columns.r[2])
+    };
+
+    CullingFrustum frustum;
+    for(int i = 0; i < 6; i++)
+        XMStoreFloat4(&frustum.Planes[i], XMVectorDivide(planes[i], XMVector3Length(planes[i])));
+    return frustum;
+}
+
+void InstanceCulling::TransformBounds(const XMFLOAT3& localMin, const XMFLOAT3& localMax, const XMFLOAT4X4& world, XMVECTOR& center, XMVECTOR& extent)
+{
+    // Arvo : the new extent along each axis sums the absolute contributions of the rotated local extents
+    XMMATRIX worldMatrix = XMLoadFloat4x4(&world);
+    XMVECTOR boundsMin = XMLoadFloat3(&localMin);
+    XMVECTOR boundsMax = XMLoadFloat3(&localMax);
+    XMVECTOR localCenter = XMVectorScale(XMVectorAdd(boundsMin, boundsMax), 0.5f);
+    XMVECTOR localExtent = XMVectorScale(XMVectorSubtract(boundsMax, boundsMin), 0.5f);
+
+    center = XMVector3Transform(localCenter, worldMatrix);
+    extent = XMVectorMultiply(XMVectorSplatX(localExtent), XMVectorAbs(worldMatrix.r[0]));
+    extent = XMVectorMultiplyAdd(XMVectorSplatY(localExtent), XMVectorAbs(worldMatrix.r[1]), extent);
+    extent = XMVectorMultiplyAdd(XMVectorSplatZ(localExtent), XMVectorAbs(worldMatrix.r[2]), extent);
+}
+
+void InstanceCulling::Cull(const InstanceBounds& bounds, uint32_t begin, uint32_t end, const CullingFrustum* frustums, uint32_t frustumCount, uint8_t* visibility)
+{
+    frustumCount = (std::min)(frustumCount, (uint32_t)INSTANCE_CULLING_MAX_VIEWS);
+
+    // Plane components and their absolute normal splatted once, each iteration then tests 4 instances against every view
+    struct SplatPlane
+    {
+        XMVECTOR X, Y, Z, W;
+        XMVECTOR AbsX, AbsY, AbsZ;
+    };
+    SplatPlane planes[INSTANCE_CULLING_MAX_VIEWS][6];
+    XMVECTOR viewBits[INSTANCE_CULLING_MAX_VIEWS];
+    for(uint32_t view = 0; view < frustumCount; view++)
+    {
+        for(int i = 0; i < 6; i++)
+        {
+            XMVECTOR plane = XMLoadFloat4(&frustums[view].Planes[i]);
+            XMVECTOR absPlane = XMVectorAbs(plane);
+            planes[view][i] = { XMVectorSplatX(plane), XMVectorSplatY(plane), XMVectorSplatZ(plane), XMVectorSplatW(plane),
+                XMVectorSplatX(absPlane), XMVectorSplatY(absPlane), XMVectorSplatZ(absPlane) };
+        }
+        viewBits[view] = XMVectorReplicateInt(1u << view);
+    }
+
+    XMVECTOR zero = XMVectorZero();
+    for(uint32_t i = begin; i < end; i += 4)
+    {
+        XMVECTOR centerX = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&bounds.CenterX[i]));
+        XMVECTOR centerY = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&bounds.CenterY[i]));
+        XMVECTOR centerZ = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&bounds.CenterZ[i]));
+        XMVECTOR extentX = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&bounds.ExtentX[i]));
+        XMVECTOR extentY = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&bounds.ExtentY[i]));
+        XMVECTOR extentZ = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&bounds.ExtentZ[i]));
+
+        XMVECTOR masks = XMVectorZero();
+        for(uint32_t view = 0; view < frustumCount; view++)
+        {
+            // Outside as soon as the box lies fully behind one plane
+            XMVECTOR inside = XMVectorTrueInt();
+            for(const SplatPlane& plane : planes[view])
+            {
+                XMVECTOR distance = XMVectorMultiplyAdd(centerX, plane.X, XMVectorMultiplyAdd(centerY, plane.Y, XMVectorMultiplyAdd(centerZ, plane.Z, plane.W)));
+                XMVECTOR radius = XMVectorMultiplyAdd(extentX, plane.AbsX, XMVectorMultiplyAdd(extentY, plane.AbsY, XMVectorMultiply(extentZ, plane.AbsZ)));
+                inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(XMVectorAdd(distance, radius), zero));
+            }
+            masks = XMVectorOrInt(masks, XMVectorAndInt(inside, viewBits[view]));
+        }
+
+        XMUINT4 laneMasks;
+        XMStoreUInt4(&laneMasks, masks);
+        uint32_t lanes[4] = { laneMasks.x, laneMasks.y, laneMasks.z, laneMasks.w };
+        uint32_t laneCount = (std::min)(4u, end - i);
+        for(uint32_t lane = 0; lane < laneCount; lane++)
+            visibility[i + lane] = (uint8_t)lanes[lane];
+    }
+}
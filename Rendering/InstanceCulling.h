@@ -0,0 +1,40 @@
+﻿#pragma once
+#include "Core.h"
+
+// Views tested in one pass over the bounds, one visibility bit each
+#define INSTANCE_CULLING_MAX_VIEWS 8
+// Instances per culling job, a multiple of 4
+#define INSTANCE_CULLING_GRAIN_SIZE 4096
+
+// World space instance AABBs split per component and padded to a multiple of 4 for the SIMD culling
+struct InstanceBounds
+{
+    std::vector<float> CenterX;
+    std::vector<float> CenterY;
+    std::vector<float> CenterZ;
+    std::vector<float> ExtentX;
+    std::vector<float> ExtentY;
+    std::vector<float> ExtentZ;
+
+    void Resize(uint32_t count);
+    void Set(uint32_t index, DirectX::FXMVECTOR center, DirectX::FXMVECTOR extent);
+    // Negative extents, outside of every frustum
+    void SetEmpty(uint32_t index);
+};
+
+struct CullingFrustum
+{
+    DirectX::XMFLOAT4 Planes[6]; // World space, normals pointing inside
+};
+
+class InstanceCulling
+{
+public:
+    static CullingFrustum MakeFrustum(DirectX::FXMMATRIX viewProj);
+    // AABB enclosing the transformed local box
+    static void TransformBounds(const DirectX::XMFLOAT3& localMin, const DirectX::XMFLOAT3& localMax, const DirectX::XMFLOAT4X4& world, DirectX::XMVECTOR& center, DirectX::XMVECTOR& extent);
+
+    // Writes for every instance in [begin, end) a mask with bit v set when its bounds intersect frustums[v].
+    // begin must be a multiple of 4, the bounds are read up to end rounded up to 4.
+    static void Cull(const InstanceBounds& bounds, uint32_t begin, uint32_t end, const CullingFrustum* frustums, uint32_t frustumCount, uint8_t* visibility);
+};
@@ -0,0 +1,164 @@
+﻿#include "InstancePool.h"
+
+#include <algorithm>
+
+InstancePool::InstancePool(std::shared_ptr<D3D12Renderer> renderer, const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax, uint32_t initialCapacity)
+    : m_renderer(renderer), m_boundsMin(boundsMin), m_boundsMax(boundsMax)
+{
+    Grow(std::max(initialCapacity, 1u));
+}
+
+InstancePool::~InstancePool()
+{
+    for(auto& buffer : m_buffers)
+        buffer.reset();
+    for(auto& buffer : m_drawInstancesBuffers)
+        buffer.reset();
+}
+
+uint32_t InstancePool::Allocate(const InstanceData& instanceData)
+{
+    uint32_t slot;
+    if(!m_freeSlots.empty())
+    {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        m_instances[slot] = instanceData;
+        m_lods[slot] = 0;
+        m_changeFrames[slot] = m_frame;
+    }
+    else
+    {
+        slot = (uint32_t)m_instances.size();
+        if(slot >= m_capacity)
+            Grow(m_capacity * 2);
+
+        m_instances.emplace_back(instanceData);
+        m_lods.emplace_back(0);
+        m_changeFrames.emplace_back(m_frame);
+        m_dirtyMasks.emplace_back(0);
+    }
+
+    UpdateBounds(slot);
+    MarkDirty(slot);
+    return slot;
+}
+
+void InstancePool::Free(uint32_t slot)
+{
+    // Free slots are left out of the draw lists, zeroing only keeps stale data out of the buffers
+    m_instances[slot] = {};
+    m_lods[slot] = UINT8_MAX;
+    m_bounds.SetEmpty(slot);
+    m_freeSlots.push_back(slot);
+    MarkDirty(slot);
+}
+
+void InstancePool::SetWorldMatrix(uint32_t slot, const DirectX::XMFLOAT4X4& worldMat)
+{
+    m_instances[slot].WorldMat = worldMat;
+    m_changeFrames[slot] = m_frame;
+    UpdateBounds(slot);
+    MarkDirty(slot);
+}
+
+void InstancePool::Upload(uint32_t frameIndex)
+{
+    m_frame++;
+
+    auto& slots = m_dirtySlots[frameIndex];
+    if(slots.empty())
+        return;
+
+    std::sort(slots.begin(), slots.end());
+
+    void* data;
+    m_buffers[frameIndex]->Map(0, 0, &data);
+    InstanceData* instances = static_cast<InstanceData*>(data);
+    for(size_t i = 0; i < slots.size();)
+    {
+        // Consecutive slots go in one copy, the untouched ones between two runs are left alone
+        uint32_t begin = slots[i];
+        uint32_t end = begin + 1;
+        for(i++; i < slots.size() && slots[i] == end; i++)
+            end++;
+
+        memcpy(instances + begin, m_instances.data() + begin, sizeof(InstanceData) * (end - begin));
+    }
+    m_buffers[frameIndex]->Unmap(0, 0);
+
+    uint8_t frameBit = (uint8_t)(1u << frameIndex);
+    for(uint32_t slot : slots)
+        m_dirtyMasks[slot] &= ~frameBit;
+    slots.clear();
+}
+
+void InstancePool::Cull(uint32_t begin, uint32_t end, const CullingFrustum* frustums, uint32_t frustumCount)
+{
+    InstanceCulling::Cull(m_bounds, begin, end, frustums, frustumCount, m_visibility.data());
+}
+
+uint32_t InstancePool::CullOcclusion(uint32_t begin, uint32_t end, const MaskedOcclusionBuffer& buffer, uint8_t viewBit)
+{
+    return buffer.Cull(m_bounds, begin, end, viewBit, m_visibility.data());
+}
+
+void InstancePool::UploadDrawInstances(uint32_t frameIndex, const std::vector<uint32_t>& drawInstances)
+{
+    m_drawInstances = drawInstances;
+    if(drawInstances.empty())
+        return;
+
+    void* data;
+    m_drawInstancesBuffers[frameIndex]->Map(0, 0, &data);
+    memcpy(data, drawInstances.data(), sizeof(uint32_t) * drawInstances.size());
+    m_drawInstancesBuffers[frameIndex]->Unmap(0, 0);
+}
+
+void InstancePool::Grow(uint32_t capacity)
+{
+    // Buffers may still be read by the frames in flight
+    if(m_capacity > 0)
+        m_renderer->WaitForGPU();
+
+    m_capacity = capacity;
+    m_instances.reserve(m_capacity);
+    m_lods.reserve(m_capacity);
+    m_changeFrames.reserve(m_capacity);
+    m_dirtyMasks.reserve(m_capacity);
+    m_visibility.resize(m_capacity);
+    m_bounds.Resize(m_capacity);
+
+    for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        m_buffers[i] = m_renderer->CreateBuffer(sizeof(InstanceData) * m_capacity, sizeof(InstanceData), BufferType::Structured, false);
+        // Main view and shadow cascades lists
+        m_drawInstancesBuffers[i] = m_renderer->CreateBuffer(sizeof(uint32_t) * m_capacity * (1 + SHADOW_CASCADE_COUNT), sizeof(uint32_t), BufferType::Structured, false);
+        // Slots are listed once at most, the lists never grow past the capacity
+        m_dirtySlots[i].reserve(m_capacity);
+    }
+
+    // The new buffers start empty, every slot gets copied again
+    for(uint32_t slot = 0; slot < (uint32_t)m_instances.size(); slot++)
+        MarkDirty(slot);
+}
+
+void InstancePool::MarkDirty(uint32_t slot)
+{
+    // Each list holds a slot once however many times it changes before that frame uploads
+    uint8_t& mask = m_dirtyMasks[slot];
+    for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        if(!(mask & (1u << i)))
+            m_dirtySlots[i].push_back(slot);
+    }
+    mask = (uint8_t)((1u << FRAMES_IN_FLIGHT) - 1);
+}
+
+void InstancePool::UpdateBounds(uint32_t slot)
+{
+    DirectX::XMVECTOR center;
+    DirectX::XMVECTOR extent;
+    InstanceCulling::TransformBounds(m_boundsMin, m_boundsMax, m_instances[slot].WorldMat, center, extent);
+    m_bounds.Set(slot, center, extent);
+}
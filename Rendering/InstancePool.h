@@ -0,0 +1,75 @@
+﻿#pragma once
+#include "RenderingLayouts.h"
+#include "OcclusionCulling.h"
+#include "../RHI/D3D12Renderer.h"
+
+static_assert(FRAMES_IN_FLIGHT <= 8, "InstancePool keeps a dirty bit per frame in flight in a byte");
+
+// Per mesh instances storage with stable slots, freed slots are zeroed and recycled.
+// Every frame in flight owns its upload buffer, only the slots touched since that buffer was last written get copied,
+// one copy per run of consecutive slots.
+// The draws go through a per frame list of slots, the shaders read InstancesData[DrawInstances[SV_InstanceID]].
+// World space bounds are kept per slot for the culling, free slots have empty bounds.
+class InstancePool
+{
+public:
+    InstancePool(std::shared_ptr<D3D12Renderer> renderer, const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax, uint32_t initialCapacity = 16);
+    ~InstancePool();
+
+    uint32_t Allocate(const InstanceData& instanceData);
+    void Free(uint32_t slot);
+    void SetWorldMatrix(uint32_t slot, const DirectX::XMFLOAT4X4& worldMat);
+
+    // Once per frame, also ages the slots transforms
+    void Upload(uint32_t frameIndex);
+    // Fills the visibility masks of slots [begin, end), begin must be a multiple of 4. Ranges can be culled from several threads.
+    void Cull(uint32_t begin, uint32_t end, const CullingFrustum* frustums, uint32_t frustumCount);
+    // Then clears viewBit on the slots of [begin, end) hidden behind the buffer occluders, returns how many were
+    uint32_t CullOcclusion(uint32_t begin, uint32_t end, const MaskedOcclusionBuffer& buffer, uint8_t viewBit);
+    // Replaces the slot list drawn by the given frame, at most (1 + SHADOW_CASCADE_COUNT) times the capacity
+    void UploadDrawInstances(uint32_t frameIndex, const std::vector<uint32_t>& drawInstances);
+
+    std::shared_ptr<Buffer> GetBuffer(uint32_t frameIndex) const { return m_buffers[frameIndex]; }
+    std::shared_ptr<Buffer> GetDrawInstancesBuffer(uint32_t frameIndex) const { return m_drawInstancesBuffers[frameIndex]; }
+    const uint32_t* GetDrawInstances() const { return m_drawInstances.data(); }
+    // Highest used slot + 1, free slots in between are never drawn
+    uint32_t GetSlotCount() const { return (uint32_t)m_instances.size(); }
+    uint32_t GetInstanceCount() const { return (uint32_t)(m_instances.size() - m_freeSlots.size()); }
+    const InstanceData* GetInstances() const { return m_instances.data(); }
+    const InstanceBounds& GetBounds() const { return m_bounds; }
+    uint32_t GetCapacity() const { return m_capacity; }
+
+    bool IsUsed(uint32_t slot) const { return m_lods[slot] != UINT8_MAX; }
+    // LOD picked for the slot last frame, kept for the selection hysteresis
+    uint32_t GetLod(uint32_t slot) const { return m_lods[slot]; }
+    void SetLod(uint32_t slot, uint32_t lod) { m_lods[slot] = (uint8_t)lod; }
+    // Bit v set when the slot was inside frustum v at the last Cull
+    uint32_t GetVisibility(uint32_t slot) const { return m_visibility[slot]; }
+    // Uploads since the slot was allocated or moved
+    uint32_t GetStillFrames(uint32_t slot) const { return m_frame - m_changeFrames[slot]; }
+
+private:
+    void Grow(uint32_t capacity);
+    void MarkDirty(uint32_t slot);
+    void UpdateBounds(uint32_t slot);
+
+    std::shared_ptr<D3D12Renderer> m_renderer;
+
+    std::vector<InstanceData> m_instances;
+    std::vector<uint32_t> m_freeSlots;
+    std::vector<uint8_t> m_lods; // UINT8_MAX on free slots
+    std::vector<uint8_t> m_visibility;
+    std::vector<uint32_t> m_changeFrames; // m_frame of the last transform change
+    std::vector<uint8_t> m_dirtyMasks; // Bit f set while the slot is in m_dirtySlots[f]
+    uint32_t m_frame = 0;
+    InstanceBounds m_bounds;
+    DirectX::XMFLOAT3 m_boundsMin; // Object space, the mesh ones
+    DirectX::XMFLOAT3 m_boundsMax;
+    uint32_t m_capacity = 0;
+
+    std::shared_ptr<Buffer> m_buffers[FRAMES_IN_FLIGHT];
+    std::vector<uint32_t> m_dirtySlots[FRAMES_IN_FLIGHT]; // Unordered, sorted and merged into ranges on upload
+
+    std::vector<uint32_t> m_drawInstances;
+    std::shared_ptr<Buffer> m_drawInstancesBuffers[FRAMES_IN_FLIGHT];
+};
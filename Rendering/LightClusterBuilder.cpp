@@ -0,0 +1,291 @@
+﻿#include "LightClusterBuilder.h"
+#include "Jobs/JobSystem.h"
+
+#include <cfloat>
+
+using namespace DirectX;
+
+namespace
+{
+    // Light indices share the hit words with the tile of their slice
+    constexpr uint32_t LightIndexBits = 24;
+    constexpr uint32_t LightIndexMask = (1u << LightIndexBits) - 1;
+    constexpr uint32_t SliceClusterCount = LIGHT_CLUSTER_COUNT_X * LIGHT_CLUSTER_COUNT_Y;
+
+    uint8_t ToCluster(float position, uint32_t count)
+    {
+        return (uint8_t)(std::min)((std::max)(position, 0.0f), (float)(count - 1));
+    }
+}
+
+LightClusterBuilder::LightClusterBuilder()
+{
+    for(auto* component : { &m_clusterBounds.MinX, &m_clusterBounds.MinY, &m_clusterBounds.MinZ, &m_clusterBounds.MaxX, &m_clusterBounds.MaxY, &m_clusterBounds.MaxZ })
+        component->resize(LIGHT_CLUSTER_COUNT);
+    m_clusters.resize(LIGHT_CLUSTER_COUNT);
+
+    m_constants.ClusterCountX = LIGHT_CLUSTER_COUNT_X;
+    m_constants.ClusterCountY = LIGHT_CLUSTER_COUNT_Y;
+    m_constants.ClusterCountZ = LIGHT_CLUSTER_COUNT_Z;
+}
+
+float LightClusterBuilder::ComputeRange(const PointLight& light, float cutoff)
+{
+    float brightness = (std::max)((std::max)(light.Color.x, light.Color.y), light.Color.z);
+    if(brightness <= 0.0f || cutoff <= 0.0f)
+        return 0.0f;
+
+    // brightness / (constant + linear * d + quadratic * d^2) = cutoff
+    float c = light.ConstantAttenuation - brightness / cutoff;
+    if(c >= 0.0f)
+        return 0.0f;
+
+    float a = light.QuadraticAttenuation;
+    float b = light.LinearAttenuation;
+    if(a > 0.0f)
+        return (-b + sqrtf(b * b - 4.0f * a * c)) / (2.0f * a);
+    if(b > 0.0f)
+        return -c / b;
+
+    return FLT_MAX;
+}
+
+void LightClusterBuilder::Build(const PointLight* lights, uint32_t lightCount, const Camera& camera, float width, float height)
+{
+    PROFILE_FUNCTION();
+
+    if(lightCount > LightIndexMask)
+    {
+        LOG(Error, "LightClusterBuilder : too many point lights, only the first ones are clustered");
+        lightCount = LightIndexMask;
+    }
+
+    // D3D left handed perspective : _33 = f / (f - n), _43 = -n * _33
+    XMFLOAT4X4 proj, view;
+    XMStoreFloat4x4(&proj, camera.GetProjMatrix());
+    XMStoreFloat4x4(&view, camera.GetViewMatrix());
+    float nearZ = -proj._43 / proj._33;
+    float farZ = proj._33 * nearZ / (proj._33 - 1.0f);
+    if(m_clusterProjection.x != proj._11 || m_clusterProjection.y != proj._22 || m_clusterProjection.z != nearZ || m_clusterProjection.w != farZ)
+        UpdateClusterBounds(proj._11, proj._22, nearZ, farZ);
+
+    m_constants.ViewDepth = { view._13, view._23, view._33, view._43 };
+    m_constants.TileScale[0] = LIGHT_CLUSTER_COUNT_X / (std::max)(width, 1.0f);
+    m_constants.TileScale[1] = LIGHT_CLUSTER_COUNT_Y / (std::max)(height, 1.0f);
+
+    m_lights.assign(lights, lights + lightCount);
+    m_lightSpheres.resize(lightCount);
+    m_lightRanges.resize(lightCount);
+
+    XMMATRIX viewMatrix = camera.GetViewMatrix();
+    auto ComputeRangesJob = [&](uint32_t begin, uint32_t end)
+    {
+        ComputeRanges(begin, end, viewMatrix);
+    };
+    if(JobSystem::Get() && lightCount > LIGHT_CLUSTERING_GRAIN_SIZE)
+        JobSystem::Get()->ParallelFor(lightCount, LIGHT_CLUSTERING_GRAIN_SIZE, ComputeRangesJob);
+    else
+        ComputeRangesJob(0, lightCount);
+
+    // Lights bucketed by slice so each slice job only walks the lights reaching it
+    uint32_t sliceOffsets[LIGHT_CLUSTER_COUNT_Z + 1] = {};
+    for(const LightRange& range : m_lightRanges)
+    {
+        for(uint32_t slice = range.MinZ; slice <= range.MaxZ; slice++)
+            sliceOffsets[slice + 1]++;
+    }
+    for(uint32_t slice = 0; slice < LIGHT_CLUSTER_COUNT_Z; slice++)
+    {
+        sliceOffsets[slice + 1] += sliceOffsets[slice];
+        m_sliceLightOffsets[slice] = sliceOffsets[slice];
+    }
+    m_sliceLightOffsets[LIGHT_CLUSTER_COUNT_Z] = sliceOffsets[LIGHT_CLUSTER_COUNT_Z];
+
+    m_sliceLights.resize(sliceOffsets[LIGHT_CLUSTER_COUNT_Z]);
+    for(uint32_t lightIdx = 0; lightIdx < lightCount; lightIdx++)
+    {
+        const LightRange& range = m_lightRanges[lightIdx];
+        for(uint32_t slice = range.MinZ; slice <= range.MaxZ; slice++)
+            m_sliceLights[sliceOffsets[slice]++] = lightIdx;
+    }
+
+    auto FillSlices = [&](uint32_t begin, uint32_t end)
+    {
+        for(uint32_t slice = begin; slice < end; slice++)
+            FillSlice(slice);
+    };
+    if(JobSystem::Get() && lightCount > 0)
+        JobSystem::Get()->ParallelFor(LIGHT_CLUSTER_COUNT_Z, 1, FillSlices);
+    else
+        FillSlices(0, LIGHT_CLUSTER_COUNT_Z);
+
+    // Slices lists are laid out one after the other
+    uint32_t indexCount = 0;
+    for(uint32_t slice = 0; slice < LIGHT_CLUSTER_COUNT_Z; slice++)
+        indexCount += (uint32_t)m_sliceIndices[slice].size();
+
+    m_lightIndices.resize(indexCount);
+    uint32_t sliceOffset = 0;
+    for(uint32_t slice = 0; slice < LIGHT_CLUSTER_COUNT_Z; slice++)
+    {
+        LightCluster* clusters = m_clusters.data() + slice * SliceClusterCount;
+        for(uint32_t i = 0; i < SliceClusterCount; i++)
+            clusters[i].Offset += sliceOffset;
+
+        const auto& sliceIndices = m_sliceIndices[slice];
+        if(!sliceIndices.empty())
+            memcpy(m_lightIndices.data() + sliceOffset, sliceIndices.data(), sizeof(uint32_t) * sliceIndices.size());
+        sliceOffset += (uint32_t)sliceIndices.size();
+    }
+}
+
+void LightClusterBuilder::UpdateClusterBounds(float projX, float projY, float nearZ, float farZ)
+{
+    m_clusterProjection = { projX, projY, nearZ, farZ };
+
+    // Slice s spans [near * (far / near)^(s / count), near * (far / near)^((s + 1) / count)]
+    float depthRatio = logf(farZ / nearZ);
+    m_constants.SliceScale = LIGHT_CLUSTER_COUNT_Z / depthRatio;
+    m_constants.SliceBias = -LIGHT_CLUSTER_COUNT_Z * logf(nearZ) / depthRatio;
+
+    for(uint32_t z = 0; z < LIGHT_CLUSTER_COUNT_Z; z++)
+    {
+        float sliceNear = nearZ * powf(farZ / nearZ, (float)z / LIGHT_CLUSTER_COUNT_Z);
+        float sliceFar = nearZ * powf(farZ / nearZ, (float)(z + 1) / LIGHT_CLUSTER_COUNT_Z);
+        for(uint32_t y = 0; y < LIGHT_CLUSTER_COUNT_Y; y++)
+        {
+            // Tile rows go down the screen
+            float top = 1.0f - 2.0f * y / LIGHT_CLUSTER_COUNT_Y;
+            float bottom = 1.0f - 2.0f * (y + 1) / LIGHT_CLUSTER_COUNT_Y;
+            for(uint32_t x = 0; x < LIGHT_CLUSTER_COUNT_X; x++)
+            {
+                float left = -1.0f + 2.0f * x / LIGHT_CLUSTER_COUNT_X;
+                float right = -1.0f + 2.0f * (x + 1) / LIGHT_CLUSTER_COUNT_X;
+
+                // The tile frustum widens with the depth, its box is set by the near or far corners depending on the side
+                uint32_t cluster = (z * LIGHT_CLUSTER_COUNT_Y + y) * LIGHT_CLUSTER_COUNT_X + x;
+                m_clusterBounds.MinX[cluster] = (std::min)(left * sliceNear, left * sliceFar) / projX;
+                m_clusterBounds.MaxX[cluster] = (std::max)(right * sliceNear, right * sliceFar) / projX;
+                m_clusterBounds.MinY[cluster] = (std::min)(bottom * sliceNear, bottom * sliceFar) / projY;
+                m_clusterBounds.MaxY[cluster] = (std::max)(top * sliceNear, top * sliceFar) / projY;
+                m_clusterBounds.MinZ[cluster] = sliceNear;
+                m_clusterBounds.MaxZ[cluster] = sliceFar;
+            }
+        }
+    }
+}
+
+void LightClusterBuilder::ComputeRanges(uint32_t begin, uint32_t end, FXMMATRIX view)
+{
+    float projX = m_clusterProjection.x;
+    float projY = m_clusterProjection.y;
+    float nearZ = m_clusterProjection.z;
+    float farZ = m_clusterProjection.w;
+
+    for(uint32_t i = begin; i < end; i++)
+    {
+        PointLight& light = m_lights[i];
+        light.Radius = ComputeRange(light);
+
+        XMFLOAT3 center;
+        XMStoreFloat3(&center, XMVector3Transform(XMLoadFloat3(&light.Position), view));
+        float radius = light.Radius;
+        m_lightSpheres[i] = { center.x, center.y, center.z, radius * radius };
+
+        LightRange& range = m_lightRanges[i];
+        range = { 1, 0, 1, 0, 1, 0 };
+
+        float minZ = (std::max)(center.z - radius, nearZ);
+        float maxZ = (std::min)(center.z + radius, farZ);
+        if(radius <= 0.0f || minZ > maxZ)
+            continue;
+
+        // Projection of the sphere box clipped to the depth range, the nearest depth bounds the sides away from the view axis
+        float minX = center.x - radius;
+        float maxX = center.x + radius;
+        float minY = center.y - radius;
+        float maxY = center.y + radius;
+        float ndcMinX = projX * minX / (minX < 0.0f ? minZ : maxZ);
+        float ndcMaxX = projX * maxX / (maxX > 0.0f ? minZ : maxZ);
+        float ndcMinY = projY * minY / (minY < 0.0f ? minZ : maxZ);
+        float ndcMaxY = projY * maxY / (maxY > 0.0f ? minZ : maxZ);
+        if(ndcMaxX < -1.0f || ndcMinX > 1.0f || ndcMaxY < -1.0f || ndcMinY > 1.0f)
+            continue;
+
+        range.MinX = ToCluster((ndcMinX + 1.0f) * 0.5f * LIGHT_CLUSTER_COUNT_X, LIGHT_CLUSTER_COUNT_X);
+        range.MaxX = ToCluster((ndcMaxX + 1.0f) * 0.5f * LIGHT_CLUSTER_COUNT_X, LIGHT_CLUSTER_COUNT_X);
+        range.MinY = ToCluster((1.0f - ndcMaxY) * 0.5f * LIGHT_CLUSTER_COUNT_Y, LIGHT_CLUSTER_COUNT_Y);
+        range.MaxY = ToCluster((1.0f - ndcMinY) * 0.5f * LIGHT_CLUSTER_COUNT_Y, LIGHT_CLUSTER_COUNT_Y);
+        range.MinZ = ToCluster(logf(minZ) * m_constants.SliceScale + m_constants.SliceBias, LIGHT_CLUSTER_COUNT_Z);
+        range.MaxZ = ToCluster(logf(maxZ) * m_constants.SliceScale + m_constants.SliceBias, LIGHT_CLUSTER_COUNT_Z);
+    }
+}
+
+void LightClusterBuilder::FillSlice(uint32_t slice)
+{
+    auto& pairs = m_slicePairs[slice];
+    pairs.clear();
+
+    // Sphere against 4 tile boxes at a time : squared distance from the center to each box
+    XMVECTOR zero = XMVectorZero();
+    for(uint32_t i = m_sliceLightOffsets[slice]; i < m_sliceLightOffsets[slice + 1]; i++)
+    {
+        uint32_t lightIdx = m_sliceLights[i];
+        const LightRange& range = m_lightRanges[lightIdx];
+        XMVECTOR sphere = XMLoadFloat4(&m_lightSpheres[lightIdx]);
+        XMVECTOR centerX = XMVectorSplatX(sphere);
+        XMVECTOR centerY = XMVectorSplatY(sphere);
+        XMVECTOR centerZ = XMVectorSplatZ(sphere);
+        XMVECTOR radiusSq = XMVectorSplatW(sphere);
+
+        for(uint32_t y = range.MinY; y <= range.MaxY; y++)
+        {
+            uint32_t row = (slice * LIGHT_CLUSTER_COUNT_Y + y) * LIGHT_CLUSTER_COUNT_X;
+            for(uint32_t x = range.MinX & ~3u; x <= range.MaxX; x += 4)
+            {
+                uint32_t cluster = row + x;
+                XMVECTOR minX = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&m_clusterBounds.MinX[cluster]));
+                XMVECTOR minY = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&m_clusterBounds.MinY[cluster]));
+                XMVECTOR minZ = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&m_clusterBounds.MinZ[cluster]));
+                XMVECTOR maxX = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&m_clusterBounds.MaxX[cluster]));
+                XMVECTOR maxY = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&m_clusterBounds.MaxY[cluster]));
+                XMVECTOR maxZ = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&m_clusterBounds.MaxZ[cluster]));
+
+                XMVECTOR dx = XMVectorMax(XMVectorMax(XMVectorSubtract(minX, centerX), XMVectorSubtract(centerX, maxX)), zero);
+                XMVECTOR dy = XMVectorMax(XMVectorMax(XMVectorSubtract(minY, centerY), XMVectorSubtract(centerY, maxY)), zero);
+                XMVECTOR dz = XMVectorMax(XMVectorMax(XMVectorSubtract(minZ, centerZ), XMVectorSubtract(centerZ, maxZ)), zero);
+                XMVECTOR distanceSq = XMVectorMultiplyAdd(dx, dx, XMVectorMultiplyAdd(dy, dy, XMVectorMultiply(dz, dz)));
+
+                XMUINT4 laneMasks;
+                XMStoreUInt4(&laneMasks, XMVectorLessOrEqual(distanceSq, radiusSq));
+                uint32_t lanes[4] = { laneMasks.x, laneMasks.y, laneMasks.z, laneMasks.w };
+                uint32_t tile = y * LIGHT_CLUSTER_COUNT_X + x;
+                for(uint32_t lane = 0; lane < 4; lane++)
+                {
+                    if(lanes[lane])
+                        pairs.push_back(((tile + lane) << LightIndexBits) | lightIdx);
+                }
+            }
+        }
+    }
+
+    // Counting sort by tile, lights stay in increasing order within a tile
+    uint32_t offsets[SliceClusterCount] = {};
+    for(uint32_t pair : pairs)
+        offsets[pair >> LightIndexBits]++;
+
+    LightCluster* clusters = m_clusters.data() + slice * SliceClusterCount;
+    uint32_t offset = 0;
+    for(uint32_t tile = 0; tile < SliceClusterCount; tile++)
+    {
+        clusters[tile].Offset = offset;
+        clusters[tile].Count = offsets[tile];
+        offsets[tile] = offset;
+        offset += clusters[tile].Count;
+    }
+
+    auto& sliceIndices = m_sliceIndices[slice];
+    sliceIndices.resize(pairs.size());
+    for(uint32_t pair : pairs)
+        sliceIndices[offsets[pair >> LightIndexBits]++] = pair & LightIndexMask;
+}
@@ -0,0 +1,77 @@
+﻿#pragma once
+#include "Camera.h"
+#include "RenderingLayouts.h"
+
+// View froxels : screen tiles split in exponential depth slices between the camera near and far planes
+#define LIGHT_CLUSTER_COUNT_X 16
+#define LIGHT_CLUSTER_COUNT_Y 9
+#define LIGHT_CLUSTER_COUNT_Z 24
+#define LIGHT_CLUSTER_COUNT (LIGHT_CLUSTER_COUNT_X * LIGHT_CLUSTER_COUNT_Y * LIGHT_CLUSTER_COUNT_Z)
+// Fraction of its color under which a point light is cut, sets the light ranges
+#define LIGHT_ATTENUATION_CUTOFF (1.0f / 256.0f)
+// Lights per range job
+#define LIGHT_CLUSTERING_GRAIN_SIZE 1024
+
+static_assert(LIGHT_CLUSTER_COUNT_X % 4 == 0, "Clusters are tested 4 tiles at a time");
+
+// CPU light binning : every froxel gets the compact list of the point lights whose range sphere touches it.
+// Lights are bounded to their tiles and slices range, then each slice is filled by its own job testing 4 froxels at a time.
+// Renderer independent, LightClustering uploads its results.
+class LightClusterBuilder
+{
+public:
+    LightClusterBuilder();
+
+    // Distance at which the attenuated light falls under cutoff times its brightest channel
+    static float ComputeRange(const PointLight& light, float cutoff = LIGHT_ATTENUATION_CUTOFF);
+
+    // The light ranges are recomputed from their attenuations, lights outside of the camera depth range are left out
+    void Build(const PointLight* lights, uint32_t lightCount, const Camera& camera, float width, float height);
+
+    // Copies of the built lights with their Radius set
+    const std::vector<PointLight>& GetLights() const { return m_lights; }
+    const LightClusterConstantBuffer& GetConstants() const { return m_constants; }
+    // LIGHT_CLUSTER_COUNT clusters, x fastest then y then the depth slice
+    const LightCluster* GetClusters() const { return m_clusters.data(); }
+    const uint32_t* GetLightIndices() const { return m_lightIndices.data(); }
+    uint32_t GetLightIndexCount() const { return (uint32_t)m_lightIndices.size(); }
+
+private:
+    // Tiles and slices touched by a light, empty when MinZ > MaxZ
+    struct LightRange
+    {
+        uint8_t MinX, MaxX;
+        uint8_t MinY, MaxY;
+        uint8_t MinZ, MaxZ;
+    };
+
+    // View space froxel AABBs split per component, a slice row of tiles is contiguous
+    struct ClusterBounds
+    {
+        std::vector<float> MinX, MinY, MinZ;
+        std::vector<float> MaxX, MaxY, MaxZ;
+    };
+
+    void UpdateClusterBounds(float projX, float projY, float nearZ, float farZ);
+    void ComputeRanges(uint32_t begin, uint32_t end, DirectX::FXMMATRIX view);
+    void FillSlice(uint32_t slice);
+
+    ClusterBounds m_clusterBounds;
+    DirectX::XMFLOAT4 m_clusterProjection = {}; // Projection scales and depth range the bounds were built for
+    LightClusterConstantBuffer m_constants = {};
+
+    std::vector<PointLight> m_lights;
+    // View space light spheres, w holding the squared range
+    std::vector<DirectX::XMFLOAT4> m_lightSpheres;
+    std::vector<LightRange> m_lightRanges;
+    // Lights reaching each slice, m_sliceLights[m_sliceLightOffsets[s], m_sliceLightOffsets[s + 1])
+    std::vector<uint32_t> m_sliceLights;
+    uint32_t m_sliceLightOffsets[LIGHT_CLUSTER_COUNT_Z + 1] = {};
+
+    // Per slice (tile << 24 | light) hits and their lists sorted by tile, merged into m_lightIndices once every slice is filled
+    std::vector<uint32_t> m_sliceIndices[LIGHT_CLUSTER_COUNT_Z];
+    std::vector<uint32_t> m_slicePairs[LIGHT_CLUSTER_COUNT_Z];
+
+    std::vector<LightCluster> m_clusters;
+    std::vector<uint32_t> m_lightIndices;
+};
@@ -0,0 +1,87 @@
+﻿#include "LightClustering.h"
+
+LightClustering::LightClustering(std::shared_ptr<D3D12Renderer> renderer, uint32_t initialLightCapacity) : m_renderer(renderer)
+{
+    for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        m_clustersBuffers[i] = m_renderer->CreateBuffer(sizeof(LightCluster) * LIGHT_CLUSTER_COUNT, sizeof(LightCluster), BufferType::Structured, false);
+        m_constantBuffers[i] = m_renderer->CreateBuffer(256, 0, BufferType::Constant, false);
+        m_renderer->CreateConstantBuffer(m_constantBuffers[i]);
+    }
+
+    uint32_t lightCapacity = (std::max)(initialLightCapacity, 1u);
+    Grow(lightCapacity, lightCapacity * 8);
+}
+
+LightClustering::~LightClustering()
+{
+    for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        m_lightsBuffers[i].reset();
+        m_clustersBuffers[i].reset();
+        m_lightIndicesBuffers[i].reset();
+        m_constantBuffers[i].reset();
+    }
+}
+
+void LightClustering::Upload(uint32_t frameIndex)
+{
+    PROFILE_FUNCTION();
+
+    const std::vector<PointLight>& lights = m_builder.GetLights();
+    uint32_t lightCount = (uint32_t)lights.size();
+    uint32_t indexCount = m_builder.GetLightIndexCount();
+    if(lightCount > m_lightCapacity || indexCount > m_indexCapacity)
+        Grow((std::max)(m_lightCapacity * 2, lightCount), (std::max)(m_indexCapacity * 2, indexCount));
+
+    void* data;
+    if(lightCount > 0)
+    {
+        m_lightsBuffers[frameIndex]->Map(0, 0, &data);
+        memcpy(data, lights.data(), sizeof(PointLight) * lightCount);
+        m_lightsBuffers[frameIndex]->Unmap(0, 0);
+    }
+
+    if(indexCount > 0)
+    {
+        m_lightIndicesBuffers[frameIndex]->Map(0, 0, &data);
+        memcpy(data, m_builder.GetLightIndices(), sizeof(uint32_t) * indexCount);
+        m_lightIndicesBuffers[frameIndex]->Unmap(0, 0);
+    }
+
+    m_clustersBuffers[frameIndex]->Map(0, 0, &data);
+    memcpy(data, m_builder.GetClusters(), sizeof(LightCluster) * LIGHT_CLUSTER_COUNT);
+    m_clustersBuffers[frameIndex]->Unmap(0, 0);
+
+    m_constantBuffers[frameIndex]->Map(0, 0, &data);
+    memcpy(data, &m_builder.GetConstants(), sizeof(LightClusterConstantBuffer));
+    m_constantBuffers[frameIndex]->Unmap(0, 0);
+
+    m_uploadedLightCount[frameIndex] = lightCount;
+}
+
+LightClusterBuffers LightClustering::GetBuffers(uint32_t frameIndex) const
+{
+    LightClusterBuffers buffers;
+    buffers.PointLights = m_lightsBuffers[frameIndex];
+    buffers.Clusters = m_clustersBuffers[frameIndex];
+    buffers.LightIndices = m_lightIndicesBuffers[frameIndex];
+    buffers.ConstantBuffer = m_constantBuffers[frameIndex];
+    buffers.LightCount = m_uploadedLightCount[frameIndex];
+    return buffers;
+}
+
+void LightClustering::Grow(uint32_t lightCapacity, uint32_t indexCapacity)
+{
+    // Buffers may still be read by the frames in flight
+    if(m_lightCapacity > 0)
+        m_renderer->WaitForGPU();
+
+    m_lightCapacity = lightCapacity;
+    m_indexCapacity = indexCapacity;
+    for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        m_lightsBuffers[i] = m_renderer->CreateBuffer(sizeof(PointLight) * m_lightCapacity, sizeof(PointLight), BufferType::Structured, false);
+        m_lightIndicesBuffers[i] = m_renderer->CreateBuffer(sizeof(uint32_t) * m_indexCapacity, sizeof(uint32_t), BufferType::Structured, false);
+    }
+}
@@ -0,0 +1,44 @@
+﻿#pragma once
+#include "LightClusterBuilder.h"
+#include "../RHI/D3D12Renderer.h"
+
+// Current frame buffers read by the shading passes
+struct LightClusterBuffers
+{
+    std::shared_ptr<Buffer> PointLights;
+    std::shared_ptr<Buffer> Clusters;
+    std::shared_ptr<Buffer> LightIndices;
+    std::shared_ptr<Buffer> ConstantBuffer;
+    uint32_t LightCount = 0;
+};
+
+// GPU side of the light clustering : LightClusterBuilder bins the lights, every frame in flight owns buffers they are uploaded to.
+// The buffers grow with the light count.
+class LightClustering
+{
+public:
+    LightClustering(std::shared_ptr<D3D12Renderer> renderer, uint32_t initialLightCapacity = 256);
+    ~LightClustering();
+
+    void Build(const PointLight* lights, uint32_t lightCount, const Camera& camera, float width, float height) { m_builder.Build(lights, lightCount, camera, width, height); }
+    void Upload(uint32_t frameIndex);
+
+    LightClusterBuffers GetBuffers(uint32_t frameIndex) const;
+    const LightCluster* GetClusters() const { return m_builder.GetClusters(); }
+    const uint32_t* GetLightIndices() const { return m_builder.GetLightIndices(); }
+    uint32_t GetLightIndexCount() const { return m_builder.GetLightIndexCount(); }
+
+private:
+    void Grow(uint32_t lightCapacity, uint32_t indexCapacity);
+
+    std::shared_ptr<D3D12Renderer> m_renderer;
+    LightClusterBuilder m_builder;
+
+    uint32_t m_lightCapacity = 0;
+    uint32_t m_indexCapacity = 0;
+    std::shared_ptr<Buffer> m_lightsBuffers[FRAMES_IN_FLIGHT];
+    std::shared_ptr<Buffer> m_clustersBuffers[FRAMES_IN_FLIGHT];
+    std::shared_ptr<Buffer> m_lightIndicesBuffers[FRAMES_IN_FLIGHT];
+    std::shared_ptr<Buffer> m_constantBuffers[FRAMES_IN_FLIGHT];
+    uint32_t m_uploadedLightCount[FRAMES_IN_FLIGHT] = {};
+};
@@ -24,7 +24,7 @@ void LightingRenderPass::Initialize(std::shared_ptr<D3D12Renderer> renderer, int
     pointLightSpecs.Cull = CullMode::Back;
     pointLightSpecs.Fill = FillMode::Solid;
     pointLightSpecs.DepthEnabled = false;
-    ShaderCompiler::CompileShader("Shaders/DeferredPointLightVertex.hlsl", ShaderType::Vertex, pointLightSpecs.ShadersBytecodes[ShaderType::Vertex]);
+    ShaderCompiler::CompileShader("Shaders/ScreenQuadVertex.hlsl", ShaderType::Vertex, pointLightSpecs.ShadersBytecodes[ShaderType::Vertex]);
     ShaderCompiler::CompileShader("Shaders/DeferredPointLightPixel.hlsl", ShaderType::Pixel, pointLightSpecs.ShadersBytecodes[ShaderType::Pixel]);
 
     m_deferredPointLightPipeline = renderer->CreateGraphicsPipeline(pointLightSpecs);
@@ -33,11 +33,6 @@ void LightingRenderPass::Initialize(std::shared_ptr<D3D12Renderer> renderer, int
     renderer->CreateConstantBuffer(m_sceneConstantBuffer);
 
     OnResize(renderer, width, height);
-
-    m_pointLightMesh = std::make_shared<RenderItem>();
-    m_pointLightMesh->ImportMesh(renderer, "Assets/sphere.gltf");
-    m_instancedLightsInstanceDataTransformBuffer = renderer->CreateBuffer(sizeof(InstanceData) * MAX_LIGHTS, sizeof(InstanceData), BufferType::Structured, false);
-    m_instancedLightsInstanceDataInfoBuffer = renderer->CreateBuffer(sizeof(PointLight) * MAX_LIGHTS, sizeof(PointLight), BufferType::Structured, false);
 }
 
 void LightingRenderPass::OnResize(std::shared_ptr<D3D12Renderer> renderer, int width, int height)
@@ -46,6 +41,8 @@ void LightingRenderPass::OnResize(std::shared_ptr<D3D12Renderer> renderer, int w
 
 void LightingRenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const GlobalPassData& globalPassData, const Camera& camera, const std::vector<RenderMeshData>& renderMeshesData, RenderTargetInfo renderTarget)
 {
+    PROFILE_FUNCTION();
+
     auto view = camera.GetViewMatrix();
     auto proj = camera.GetProjMatrix();
     auto invViewProj = camera.GetInvViewProjMatrix();
@@ -62,7 +59,6 @@ void LightingRenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const Glo
     cbuf.ScreenDimensions[1] = globalPassData.ViewportSizeY;
     DirectX::XMStoreFloat4x4(&cbuf.ViewProj, viewProj);
     DirectX::XMStoreFloat4x4(&cbuf.InvViewProj, invViewProj);
-    cbuf.ShadowTransform = globalPassData.ShadowMap.ShadowTransform;
     cbuf.ShadowEnabled = globalPassData.EnableShadows;
 
     auto GBuffer = globalPassData.GBuffer;
@@ -77,7 +73,6 @@ void LightingRenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const Glo
 
     // ------------------------------------------------------------- Lighting Pass (directional) --------------------------------------------------------------------
 
-    commandList->ImageBarrier(renderTarget.RenderTexture, D3D12_RESOURCE_STATE_RENDER_TARGET);
     commandList->BindRenderTargets({ renderTarget.RenderTexture }, nullptr);
     
     commandList->SetTopology(Topology::TriangleList);
@@ -94,51 +89,27 @@ void LightingRenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const Glo
     {
         commandList->BindGraphicsShaderResource(globalPassData.ShadowMap.DepthBuffer, 8);
         commandList->BindGraphicsSampler(m_comparisonSampler, 9);
+        commandList->BindGraphicsConstantBuffer(globalPassData.ShadowMap.CascadesConstantBuffer, 10);
     }
     // commandList->BindGraphicsShaderResource(globalPassData.BRDFLut, 8);
     commandList->Draw(6);
 
-    // ------------------------------------------------------------- Lights Volumes --------------------------------------------------------------------
+    // ------------------------------------------------------------- Clustered Point Lights --------------------------------------------------------------------
 
-    if(globalPassData.PointLights.empty() /* || globalPassData.ViewMode > 0 */)
+    const auto& lightClusters = globalPassData.LightClusters;
+    if(lightClusters.LightCount == 0 /* || globalPassData.ViewMode > 0 */)
         return;
 
     commandList->SetTopology(Topology::TriangleList);
     commandList->BindGraphicsPipeline(m_deferredPointLightPipeline);
     commandList->BindGraphicsConstantBuffer(m_sceneConstantBuffer, 0);
+    commandList->SetGraphicsShaderResource(lightClusters.PointLights, 1);
     commandList->BindGraphicsShaderResource(GBuffer.AlbedoRenderTarget, 2);
     commandList->BindGraphicsShaderResource(GBuffer.NormalRenderTarget, 3);
     commandList->BindGraphicsShaderResource(GBuffer.MetallicRoughnessRenderTarget, 4);
     commandList->BindGraphicsShaderResource(GBuffer.DepthBuffer, 5);
-
-    std::vector<InstanceData> instancesData;
-    for(int i = 0; i < globalPassData.PointLights.size(); i++)
-    {
-        float radius = globalPassData.PointLights[i].Radius;
-
-        InstanceData instanceData;
-        DirectX::XMMATRIX mat = DirectX::XMMatrixIdentity();
-        mat *= DirectX::XMMatrixScaling(radius, radius, radius);
-        mat *= DirectX::XMMatrixTranslation(globalPassData.PointLights[i].Position.x, globalPassData.PointLights[i].Position.y, globalPassData.PointLights[i].Position.z);
-        DirectX::XMStoreFloat4x4(&instanceData.WorldMat, mat);
-        instancesData.emplace_back(instanceData);
-    }
-
-    void* dt;
-    m_instancedLightsInstanceDataTransformBuffer->Map(0, 0, &dt);
-    memcpy(dt, instancesData.data(), sizeof(InstanceData) * globalPassData.PointLights.size());
-    m_instancedLightsInstanceDataTransformBuffer->Unmap(0, 0);
-
-    void* dt2;
-    m_instancedLightsInstanceDataInfoBuffer->Map(0, 0, &dt2);
-    memcpy(dt2, globalPassData.PointLights.data(), sizeof(PointLight) * globalPassData.PointLights.size());
-    m_instancedLightsInstanceDataInfoBuffer->Unmap(0, 0);
-
-    commandList->SetGraphicsShaderResource(m_instancedLightsInstanceDataTransformBuffer, 1);
-    commandList->SetGraphicsShaderResource(m_instancedLightsInstanceDataInfoBuffer, 6);
-    commandList->BindVertexBuffer(m_pointLightMesh->GetPrimitives()[0].m_vertexBuffer);
-    commandList->BindIndexBuffer(m_pointLightMesh->GetPrimitives()[0].m_indicesBuffer);
-    commandList->DrawIndexed(m_pointLightMesh->GetPrimitives()[0].m_indexCount, globalPassData.PointLights.size());
-    
-    commandList->ImageBarrier(renderTarget.RenderTexture, D3D12_RESOURCE_STATE_GENERIC_READ);
+    commandList->SetGraphicsShaderResource(lightClusters.Clusters, 6);
+    commandList->SetGraphicsShaderResource(lightClusters.LightIndices, 7);
+    commandList->BindGraphicsConstantBuffer(lightClusters.ConstantBuffer, 8);
+    commandList->Draw(6);
 }
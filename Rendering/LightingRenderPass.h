@@ -14,7 +14,4 @@ private:
     std::shared_ptr<Buffer> m_sceneConstantBuffer;
     std::shared_ptr<Sampler> m_textureSampler;
     std::shared_ptr<Sampler> m_comparisonSampler;
-    std::shared_ptr<RenderItem> m_pointLightMesh;
-    std::shared_ptr<Buffer> m_instancedLightsInstanceDataTransformBuffer;
-    std::shared_ptr<Buffer> m_instancedLightsInstanceDataInfoBuffer;
 };
@@ -0,0 +1,401 @@
+﻿#include "MeshCooker.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+namespace
+{
+    // Simplified from LOD 0 under an error bound relative to the primitive size, the proxy must not cover much more than the mesh does
+    void BuildOccluder(const float* positions, uint32_t vertexCount, const std::vector<uint32_t>& indices, MeshPrimitiveData& out)
+    {
+        float diagonal = DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&out.BoundsMax), DirectX::XMLoadFloat3(&out.BoundsMin))));
+        std::vector<uint32_t> occluderIndices;
+        MeshSimplifier::Simplify(positions, sizeof(Vertex), vertexCount, indices, OCCLUDER_TRIANGLE_COUNT * 3, OCCLUDER_MAX_ERROR * diagonal, occluderIndices);
+        if(occluderIndices.empty() || occluderIndices.size() > OCCLUDER_MAX_TRIANGLE_COUNT * 3)
+            return;
+
+        // Only the positions the proxy uses are kept
+        std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+        out.OccluderIndices.reserve(occluderIndices.size());
+        for(uint32_t index : occluderIndices)
+        {
+            if(remap[index] == UINT32_MAX)
+            {
+                remap[index] = (uint32_t)out.OccluderPositions.size();
+                out.OccluderPositions.push_back(out.Vertices[index].Position);
+            }
+            out.OccluderIndices.push_back((uint16_t)remap[index]);
+        }
+    }
+
+    void ProcessPrimitive(aiMesh* mesh, const aiMatrix4x4& nodeTransform, std::vector<MeshPrimitiveData>& primitives)
+    {
+        MeshPrimitiveData& out = primitives.emplace_back();
+
+        // Assimp matrices are column major, transpose to get the row vector convention
+        DirectX::XMMATRIX transform = DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(reinterpret_cast<const DirectX::XMFLOAT4X4*>(&nodeTransform)));
+        DirectX::XMMATRIX normalTransform = DirectX::XMMatrixTranspose(DirectX::XMMatrixInverse(nullptr, transform));
+        bool flipWinding = DirectX::XMVectorGetX(DirectX::XMMatrixDeterminant(transform)) < 0.0f;
+        DirectX::XMStoreFloat4x4(&out.LocalPrimTransform, transform);
+
+        auto TransformDirection = [](const aiVector3D& direction, DirectX::FXMMATRIX matrix)
+        {
+            DirectX::XMFLOAT3 result;
+            DirectX::XMStoreFloat3(&result, DirectX::XMVector3Normalize(DirectX::XMVector3TransformNormal(DirectX::XMVectorSet(direction.x, direction.y, direction.z, 0.0f), matrix)));
+            return result;
+        };
+
+        DirectX::XMVECTOR boundsMin = DirectX::XMVectorReplicate(FLT_MAX);
+        DirectX::XMVECTOR boundsMax = DirectX::XMVectorReplicate(-FLT_MAX);
+
+        out.Vertices.resize(mesh->mNumVertices);
+        for (uint32_t i = 0; i < mesh->mNumVertices; i++)
+        {
+            Vertex& vertex = out.Vertices[i];
+            vertex = {};
+
+            DirectX::XMVECTOR position = DirectX::XMVector3TransformCoord(DirectX::XMVectorSet(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z, 1.0f), transform);
+            DirectX::XMStoreFloat3(&vertex.Position, position);
+            boundsMin = DirectX::XMVectorMin(boundsMin, position);
+            boundsMax = DirectX::XMVectorMax(boundsMax, position);
+
+            if (mesh->HasNormals())
+            {
+                vertex.Normal = TransformDirection(mesh->mNormals[i], normalTransform);
+                if (mesh->HasTangentsAndBitangents())
+                {
+                    vertex.Tangent = TransformDirection(mesh->mTangents[i], transform);
+                    vertex.Binormal = TransformDirection(mesh->mBitangents[i], transform);
+                }
+            }
+
+            if (mesh->mTextureCoords[0])
+                vertex.UV = DirectX::XMFLOAT2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+        }
+
+        if (mesh->mNumVertices == 0)
+        {
+            boundsMin = DirectX::XMVectorZero();
+            boundsMax = DirectX::XMVectorZero();
+        }
+        DirectX::XMStoreFloat3(&out.BoundsMin, boundsMin);
+        DirectX::XMStoreFloat3(&out.BoundsMax, boundsMax);
+
+        out.Indices.reserve(mesh->mNumFaces * 3);
+        for (uint32_t i = 0; i < mesh->mNumFaces; i++)
+        {
+            const aiFace& face = mesh->mFaces[i];
+            if (flipWinding)
+            {
+                for (int j = face.mNumIndices - 1; j >= 0; j--)
+                    out.Indices.push_back(face.mIndices[j]);
+            }
+            else
+            {
+                for (uint32_t j = 0; j < face.mNumIndices; j++)
+                    out.Indices.push_back(face.mIndices[j]);
+            }
+        }
+
+        MeshOptimizerStats stats = MeshOptimizer::Optimize(out.Vertices, out.Indices);
+        LOG(Debug, "MeshCooker : optimized primitive " + std::string(mesh->mName.C_Str()) + ", vertices " + std::to_string(stats.VertexCountBefore) + " -> " + std::to_string(stats.VertexCountAfter)
+            + ", ACMR " + std::to_string(stats.ACMRBefore) + " -> " + std::to_string(stats.ACMRAfter));
+
+        // Built on LOD 0 before the coarser levels get appended, any later index reordering would break the meshlet ranges
+        const float* positions = reinterpret_cast<const float*>(out.Vertices.data());
+        uint32_t vertexCount = (uint32_t)out.Vertices.size();
+        MeshletBuilder::Build(positions, sizeof(Vertex), vertexCount, out.Indices, out.Meshlets);
+
+        // Also simplified from LOD 0, before the coarser levels get appended to the indices
+        BuildOccluder(positions, vertexCount, out.Indices, out);
+        LOG(Debug, "MeshCooker : primitive " + std::string(mesh->mName.C_Str()) + " occluder triangles " + std::to_string(out.OccluderIndices.size() / 3));
+
+        MeshSimplifier::BuildLods(positions, sizeof(Vertex), vertexCount, out.Indices, out.Lods);
+
+        std::string lodTriangles;
+        for(const MeshLod& lod : out.Lods)
+            lodTriangles += " " + std::to_string(lod.IndexCount / 3) + " (" + std::to_string(lod.Error) + ")";
+        LOG(Debug, "MeshCooker : primitive " + std::string(mesh->mName.C_Str()) + " LOD triangles (error)" + lodTriangles);
+    }
+
+    void ProcessNode(aiNode* node, const aiScene* scene, const aiMatrix4x4& parentTransform, std::vector<MeshPrimitiveData>& primitives)
+    {
+        aiMatrix4x4 nodeTransform = parentTransform * node->mTransformation;
+
+        for (uint32_t i = 0; i < node->mNumMeshes; i++)
+            ProcessPrimitive(scene->mMeshes[node->mMeshes[i]], nodeTransform, primitives);
+
+        for (uint32_t i = 0; i < node->mNumChildren; i++)
+            ProcessNode(node->mChildren[i], scene, nodeTransform, primitives);
+    }
+
+    uint64_t AlignOffset(uint64_t offset)
+    {
+        return (offset + CMESH_BLOB_ALIGNMENT - 1) & ~(uint64_t)(CMESH_BLOB_ALIGNMENT - 1);
+    }
+
+    uint32_t GetIndexStride(size_t vertexCount)
+    {
+        return vertexCount <= 0x10000 ? sizeof(uint16_t) : sizeof(uint32_t);
+    }
+
+    // Dropped when it does not draw exactly the same triangles as the full stream, the depth passes then fall back to it
+    void BuildPositionStream(const std::vector<CompactVertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<MeshLod>& lods,
+        std::vector<CompactPosition>& positions, std::vector<uint32_t>& positionIndices)
+    {
+        positions.resize(vertices.size());
+        for(size_t i = 0; i < vertices.size(); i++)
+        {
+            positions[i].Position = vertices[i].Position;
+            positions[i].Position.w = 0;
+        }
+
+        std::vector<uint32_t> lodEnds;
+        for(const MeshLod& lod : lods)
+            lodEnds.push_back(lod.IndexOffset + lod.IndexCount);
+
+        positionIndices = indices;
+        MeshOptimizer::OptimizePositions(positions, positionIndices, lodEnds);
+
+        // Per LOD, each range is drawn on its own. xyz only, w is the bitangent sign in the full stream
+        std::vector<uint32_t> lodIndices;
+        std::vector<uint32_t> lodPositionIndices;
+        for(const MeshLod& lod : lods)
+        {
+            lodIndices.assign(indices.begin() + lod.IndexOffset, indices.begin() + lod.IndexOffset + lod.IndexCount);
+            lodPositionIndices.assign(positionIndices.begin() + lod.IndexOffset, positionIndices.begin() + lod.IndexOffset + lod.IndexCount);
+            if(!MeshOptimizer::VerifySameTriangles(vertices.data(), sizeof(CompactVertex), lodIndices, positions.data(), sizeof(CompactPosition), lodPositionIndices, 3 * sizeof(uint16_t)))
+            {
+                LOG(Error, "MeshCooker : position stream triangles differ from the primitive ones, skipping it");
+                positions.clear();
+                positionIndices.clear();
+                return;
+            }
+        }
+    }
+}
+
+std::string MeshCooker::GetCookedPath(const std::string& sourcePath)
+{
+    return sourcePath + CMESH_EXTENSION;
+}
+
+bool MeshCooker::IsCookedUpToDate(const std::string& sourcePath, const std::string& cookedPath)
+{
+    std::error_code error;
+    auto cookedTime = std::filesystem::last_write_time(cookedPath, error);
+    if(error)
+        return false;
+
+    // Shipping only the cooked file is fine
+    auto sourceTime = std::filesystem::last_write_time(sourcePath, error);
+    if(!error && sourceTime > cookedTime)
+        return false;
+
+    std::ifstream file(cookedPath, std::ios::binary);
+    CookedMeshHeader header = {};
+    if(!file.read(reinterpret_cast<char*>(&header), sizeof(CookedMeshHeader)))
+        return false;
+
+    return header.Magic == CMESH_MAGIC && header.Version == CMESH_VERSION && header.VertexStride == sizeof(CompactVertex);
+}
+
+bool MeshCooker::Import(const std::string& sourcePath, std::vector<MeshPrimitiveData>& primitives)
+{
+    PROFILE_FUNCTION();
+
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(sourcePath, aiProcess_FlipWindingOrder | aiProcess_CalcTangentSpace | aiProcess_Triangulate);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+        LOG(Error, "MeshCooker : Failed assimp import of " + sourcePath);
+        return false;
+    }
+
+    ProcessNode(scene->mRootNode, scene, aiMatrix4x4(), primitives);
+    return true;
+}
+
+bool MeshCooker::Cook(const std::string& sourcePath, const std::string& cookedPath)
+{
+    PROFILE_FUNCTION();
+
+    std::vector<MeshPrimitiveData> primitives;
+    if(!Import(sourcePath, primitives))
+        return false;
+
+    CookedMeshHeader header = {};
+    header.Magic = CMESH_MAGIC;
+    header.Version = CMESH_VERSION;
+    header.PrimitiveCount = (uint32_t)primitives.size();
+    header.VertexStride = sizeof(CompactVertex);
+    header.BoundsMin = primitives.empty() ? DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f) : primitives[0].BoundsMin;
+    header.BoundsMax = primitives.empty() ? DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f) : primitives[0].BoundsMax;
+
+    // Everything is encoded before the layout is computed, the position streams size is only known after welding
+    std::vector<std::vector<CompactVertex>> compactVertices(primitives.size());
+    std::vector<std::vector<CompactPosition>> positions(primitives.size());
+    std::vector<std::vector<uint32_t>> positionIndices(primitives.size());
+    std::vector<std::vector<TriangleBVHNode>> bvhNodes(primitives.size());
+    std::vector<std::vector<uint32_t>> bvhTriangles(primitives.size());
+    std::vector<DirectX::XMFLOAT3> decodedPositions;
+    for(size_t i = 0; i < primitives.size(); i++)
+    {
+        const auto& primitive = primitives[i];
+        compactVertices[i].resize(primitive.Vertices.size());
+        VertexCompression::EncodeVertices(primitive.Vertices.data(), (uint32_t)primitive.Vertices.size(), primitive.BoundsMin, primitive.BoundsMax, compactVertices[i].data());
+        BuildPositionStream(compactVertices[i], primitive.Indices, primitive.Lods, positions[i], positionIndices[i]);
+
+        // Built on the quantized positions, the loader rebuilds the same triangles from the cooked vertices
+        decodedPositions.resize(compactVertices[i].size());
+        for(size_t vertex = 0; vertex < compactVertices[i].size(); vertex++)
+            decodedPositions[vertex] = VertexCompression::DecodePosition(compactVertices[i][vertex], primitive.BoundsMin, primitive.BoundsMax);
+
+        auto buildStart = std::chrono::steady_clock::now();
+        TriangleBVH::Build(decodedPositions.data(), primitive.Indices.data(), primitive.Lods[0].IndexCount / 3, bvhNodes[i], bvhTriangles[i]);
+        double buildTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+        LOG(Debug, "MeshCooker : primitive " + std::to_string(i) + " triangle BVH nodes " + std::to_string(bvhNodes[i].size()) + " for "
+            + std::to_string(bvhTriangles[i].size()) + " triangles, built in " + std::to_string(buildTime) + " ms");
+    }
+
+    std::vector<CookedPrimitive> cookedPrimitives(primitives.size());
+    uint64_t offset = sizeof(CookedMeshHeader) + sizeof(CookedPrimitive) * primitives.size();
+    for(size_t i = 0; i < primitives.size(); i++)
+    {
+        const auto& primitive = primitives[i];
+        auto& cookedPrimitive = cookedPrimitives[i];
+        cookedPrimitive.LocalPrimTransform = primitive.LocalPrimTransform;
+        cookedPrimitive.BoundsMin = primitive.BoundsMin;
+        cookedPrimitive.BoundsMax = primitive.BoundsMax;
+        cookedPrimitive.VertexCount = (uint32_t)primitive.Vertices.size();
+        cookedPrimitive.IndexCount = (uint32_t)primitive.Indices.size();
+        cookedPrimitive.IndexStride = GetIndexStride(primitive.Vertices.size());
+        cookedPrimitive.PositionVertexCount = (uint32_t)positions[i].size();
+        cookedPrimitive.PositionIndexStride = GetIndexStride(positions[i].size());
+        cookedPrimitive.MeshletCount = (uint32_t)primitive.Meshlets.size();
+        cookedPrimitive.LodCount = (uint32_t)primitive.Lods.size();
+        std::copy(primitive.Lods.begin(), primitive.Lods.end(), cookedPrimitive.Lods);
+        cookedPrimitive.OccluderVertexCount = (uint32_t)primitive.OccluderPositions.size();
+        cookedPrimitive.OccluderIndexCount = (uint32_t)primitive.OccluderIndices.size();
+        cookedPrimitive.BVHNodeCount = (uint32_t)bvhNodes[i].size();
+
+        offset = AlignOffset(offset);
+        cookedPrimitive.VertexOffset = offset;
+        offset += sizeof(CompactVertex) * primitive.Vertices.size();
+
+        offset = AlignOffset(offset);
+        cookedPrimitive.IndexOffset = offset;
+        offset += (uint64_t)cookedPrimitive.IndexStride * primitive.Indices.size();
+
+        offset = AlignOffset(offset);
+        cookedPrimitive.PositionVertexOffset = offset;
+        offset += sizeof(CompactPosition) * positions[i].size();
+
+        offset = AlignOffset(offset);
+        cookedPrimitive.PositionIndexOffset = offset;
+        offset += (uint64_t)cookedPrimitive.PositionIndexStride * positionIndices[i].size();
+
+        offset = AlignOffset(offset);
+        cookedPrimitive.MeshletOffset = offset;
+        offset += sizeof(Meshlet) * primitive.Meshlets.size();
+
+        offset = AlignOffset(offset);
+        cookedPrimitive.OccluderVertexOffset = offset;
+        offset += sizeof(DirectX::XMFLOAT3) * primitive.OccluderPositions.size();
+
+        offset = AlignOffset(offset);
+        cookedPrimitive.OccluderIndexOffset = offset;
+        offset += sizeof(uint16_t) * primitive.OccluderIndices.size();
+
+        offset = AlignOffset(offset);
+        cookedPrimitive.BVHNodeOffset = offset;
+        offset += sizeof(TriangleBVHNode) * bvhNodes[i].size();
+
+        offset = AlignOffset(offset);
+        cookedPrimitive.BVHTriangleOffset = offset;
+        offset += sizeof(uint32_t) * bvhTriangles[i].size();
+
+        DirectX::XMStoreFloat3(&header.BoundsMin, DirectX::XMVectorMin(DirectX::XMLoadFloat3(&header.BoundsMin), DirectX::XMLoadFloat3(&primitive.BoundsMin)));
+        DirectX::XMStoreFloat3(&header.BoundsMax, DirectX::XMVectorMax(DirectX::XMLoadFloat3(&header.BoundsMax), DirectX::XMLoadFloat3(&primitive.BoundsMax)));
+    }
+    header.FileSize = offset;
+
+    // Written to a temporary file first so an interrupted cook never leaves a truncated .cmesh behind
+    std::string tempPath = cookedPath + ".tmp";
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if(!file.is_open())
+    {
+        LOG(Error, "MeshCooker : failed to open " + tempPath);
+        return false;
+    }
+
+    auto WritePadding = [&file]()
+    {
+        static const char zeros[CMESH_BLOB_ALIGNMENT] = {};
+        uint64_t position = (uint64_t)file.tellp();
+        file.write(zeros, AlignOffset(position) - position);
+    };
+
+    std::vector<uint16_t> shortIndices;
+    auto WriteIndices = [&file, &shortIndices](const std::vector<uint32_t>& indices, uint32_t stride)
+    {
+        if(stride == sizeof(uint16_t))
+        {
+            shortIndices.assign(indices.begin(), indices.end());
+            file.write(reinterpret_cast<const char*>(shortIndices.data()), sizeof(uint16_t) * shortIndices.size());
+        }
+        else
+        {
+            file.write(reinterpret_cast<const char*>(indices.data()), sizeof(uint32_t) * indices.size());
+        }
+    };
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(CookedMeshHeader));
+    file.write(reinterpret_cast<const char*>(cookedPrimitives.data()), sizeof(CookedPrimitive) * cookedPrimitives.size());
+    for(size_t i = 0; i < primitives.size(); i++)
+    {
+        WritePadding();
+        file.write(reinterpret_cast<const char*>(compactVertices[i].data()), sizeof(CompactVertex) * compactVertices[i].size());
+        WritePadding();
+        WriteIndices(primitives[i].Indices, cookedPrimitives[i].IndexStride);
+        WritePadding();
+        file.write(reinterpret_cast<const char*>(positions[i].data()), sizeof(CompactPosition) * positions[i].size());
+        WritePadding();
+        WriteIndices(positionIndices[i], cookedPrimitives[i].PositionIndexStride);
+        WritePadding();
+        file.write(reinterpret_cast<const char*>(primitives[i].Meshlets.data()), sizeof(Meshlet) * primitives[i].Meshlets.size());
+        WritePadding();
+        file.write(reinterpret_cast<const char*>(primitives[i].OccluderPositions.data()), sizeof(DirectX::XMFLOAT3) * primitives[i].OccluderPositions.size());
+        WritePadding();
+        file.write(reinterpret_cast<const char*>(primitives[i].OccluderIndices.data()), sizeof(uint16_t) * primitives[i].OccluderIndices.size());
+        WritePadding();
+        file.write(reinterpret_cast<const char*>(bvhNodes[i].data()), sizeof(TriangleBVHNode) * bvhNodes[i].size());
+        WritePadding();
+        file.write(reinterpret_cast<const char*>(bvhTriangles[i].data()), sizeof(uint32_t) * bvhTriangles[i].size());
+    }
+
+    bool success = file.good();
+    file.close();
+
+    std::error_code error;
+    if(success)
+        std::filesystem::rename(tempPath, cookedPath, error);
+
+    if(!success || error)
+    {
+        LOG(Error, "MeshCooker : failed to write " + cookedPath);
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+
+    LOG(Debug, "MeshCooker : cooked " + sourcePath + " to " + cookedPath);
+    return true;
+}
@@ -0,0 +1,84 @@
+﻿#pragma once
+#include "Core.h"
+#include "RenderItem.h"
+#include "VertexCompression.h"
+#include "Meshlet.h"
+#include "MeshLod.h"
+#include "OcclusionCulling.h"
+#include "TriangleBVH.h"
+
+// .cmesh layout : CookedMeshHeader, PrimitiveCount CookedPrimitive, then the vertex and index blobs, each aligned on CMESH_BLOB_ALIGNMENT.
+// Offsets are from the start of the file so a mapped file can be handed to the uploader as is.
+// Vertices are stored as CompactVertex quantized in the primitive bounds, indices as uint16_t whenever the primitive has at most 65536 vertices.
+// The index blob holds every LOD one after the other, all of them index the same vertices.
+// Primitives may add a CompactPosition stream and its index blob for the depth passes, followed by their Meshlet array,
+// their occluder proxy (XMFLOAT3 positions then uint16_t indices) and their triangle BVH (TriangleBVHNode array then
+// the uint32_t LOD 0 triangle of every leaf slot).
+#define CMESH_MAGIC 0x48534D43 // "CMSH"
+#define CMESH_VERSION 8
+#define CMESH_BLOB_ALIGNMENT 64
+#define CMESH_EXTENSION ".cmesh"
+
+struct CookedMeshHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t PrimitiveCount;
+    uint32_t VertexStride;
+    uint64_t FileSize;
+    DirectX::XMFLOAT3 BoundsMin;
+    DirectX::XMFLOAT3 BoundsMax;
+};
+
+struct CookedPrimitive
+{
+    DirectX::XMFLOAT4X4 LocalPrimTransform;
+    DirectX::XMFLOAT3 BoundsMin;
+    DirectX::XMFLOAT3 BoundsMax;
+    uint32_t VertexCount;
+    uint32_t IndexCount; // All LODs
+    uint32_t IndexStride; // sizeof(uint16_t) or sizeof(uint32_t)
+    uint32_t PositionVertexCount; // 0 without position stream, the position indices have the same count and LOD ranges
+    uint32_t PositionIndexStride;
+    uint32_t MeshletCount;
+    MeshLod Lods[MESH_LOD_MAX_COUNT];
+    uint32_t LodCount;
+    uint32_t OccluderVertexCount; // 0 without occluder proxy
+    uint32_t OccluderIndexCount;
+    uint32_t BVHNodeCount; // 0 without triangles, the slot blob always holds the LOD 0 triangle count
+    uint64_t VertexOffset;
+    uint64_t IndexOffset;
+    uint64_t PositionVertexOffset;
+    uint64_t PositionIndexOffset;
+    uint64_t MeshletOffset;
+    uint64_t OccluderVertexOffset;
+    uint64_t OccluderIndexOffset;
+    uint64_t BVHNodeOffset;
+    uint64_t BVHTriangleOffset;
+};
+
+struct MeshPrimitiveData
+{
+    DirectX::XMFLOAT4X4 LocalPrimTransform;
+    DirectX::XMFLOAT3 BoundsMin;
+    DirectX::XMFLOAT3 BoundsMax;
+    std::vector<Vertex> Vertices;
+    std::vector<uint32_t> Indices;
+    std::vector<MeshLod> Lods; // Index ranges of Indices, LOD 0 first
+    std::vector<Meshlet> Meshlets; // Index ranges of LOD 0
+    // Low poly stand in rasterized by the occlusion culling, empty when the error bound kept it too detailed
+    std::vector<DirectX::XMFLOAT3> OccluderPositions;
+    std::vector<uint16_t> OccluderIndices;
+};
+
+// Offline conversion of source models (anything assimp reads) to .cmesh, only used when the cooked file is missing or stale
+class MeshCooker
+{
+public:
+    static std::string GetCookedPath(const std::string& sourcePath);
+    // False when the cooked file is missing, older than the source or from another format version
+    static bool IsCookedUpToDate(const std::string& sourcePath, const std::string& cookedPath);
+
+    static bool Import(const std::string& sourcePath, std::vector<MeshPrimitiveData>& primitives);
+    static bool Cook(const std::string& sourcePath, const std::string& cookedPath);
+};
@@ -0,0 +1,34 @@
+﻿#include "MeshLod.h"
+
+#include <cfloat>
+
+using namespace DirectX;
+
+LodSelectionView LodSelection::MakeView(const XMFLOAT3& cameraPosition, FXMMATRIX proj, float viewportHeight)
+{
+    // proj._22 is cot(fovY / 2), the vertical clip range [-1, 1] spans the viewport height
+    LodSelectionView view;
+    view.CameraPosition = cameraPosition;
+    view.ProjectionScale = 0.5f * viewportHeight * XMVectorGetY(proj.r[1]);
+    return view;
+}
+
+float LodSelection::GetPixelsPerUnit(const XMFLOAT3& center, float radius, float worldScale, const LodSelectionView& view)
+{
+    float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&center), XMLoadFloat3(&view.CameraPosition)))) - radius;
+    if(distance <= 0.0f)
+        return FLT_MAX;
+
+    return view.ProjectionScale * worldScale / distance;
+}
+
+uint32_t LodSelection::SelectLod(const float* lodErrors, uint32_t lodCount, float pixelsPerUnit, uint32_t previousLod, float threshold, float hysteresis)
+{
+    for(uint32_t lod = lodCount; lod-- > 1;)
+    {
+        float limit = lod > previousLod ? threshold * (1.0f - hysteresis) : threshold;
+        if(lodErrors[lod] * pixelsPerUnit <= limit)
+            return lod;
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+﻿#pragma once
+#include "Core.h"
+
+#define MESH_LOD_MAX_COUNT 4
+// Triangle count of each LOD relative to the previous one, the chain stops once a level cannot get under MESH_LOD_MIN_REDUCTION of it
+#define MESH_LOD_REDUCTION 0.5f
+#define MESH_LOD_MIN_REDUCTION 0.8f
+// Largest geometric error allowed on screen, in pixels
+#define MESH_LOD_ERROR_THRESHOLD 1.0f
+// Going to a coarser LOD needs the error under threshold * (1 - hysteresis), instances sitting at a switch distance do not flicker
+#define MESH_LOD_HYSTERESIS 0.25f
+// Shadow passes draw this many levels coarser than the main view
+#define MESH_LOD_SHADOW_BIAS 1
+
+// Index range of one level of detail in the primitive index buffer, LOD 0 is the source mesh
+struct MeshLod
+{
+    uint32_t IndexOffset;
+    uint32_t IndexCount;
+    float Error; // Object space distance to the source surface, never decreases along the chain
+};
+
+struct LodSelectionView
+{
+    DirectX::XMFLOAT3 CameraPosition;
+    float ProjectionScale; // Pixels covered by one world unit at a distance of one
+};
+
+class LodSelection
+{
+public:
+    static LodSelectionView MakeView(const DirectX::XMFLOAT3& cameraPosition, DirectX::FXMMATRIX proj, float viewportHeight);
+
+    // Screen pixels per object space unit for an instance, measured at the nearest point of its world space bounding sphere
+    static float GetPixelsPerUnit(const DirectX::XMFLOAT3& center, float radius, float worldScale, const LodSelectionView& view);
+
+    // Coarsest LOD whose error stays under the threshold once projected, previousLod is the one picked last frame
+    static uint32_t SelectLod(const float* lodErrors, uint32_t lodCount, float pixelsPerUnit, uint32_t previousLod,
+        float threshold = MESH_LOD_ERROR_THRESHOLD, float hysteresis = MESH_LOD_HYSTERESIS);
+};
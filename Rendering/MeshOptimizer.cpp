@@ -0,0 +1,449 @@
+﻿#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    uint64_t HashVertex(const uint8_t* vertex, uint32_t stride)
+    {
+        // FNV-1a
+        uint64_t hash = 14695981039346656037ull;
+        for(uint32_t i = 0; i < stride; i++)
+        {
+            hash ^= vertex[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // FIFO cache emulation, a vertex is a hit while less than cacheSize misses happened since it was loaded
+    class FifoCache
+    {
+    public:
+        FifoCache(uint32_t vertexCount, uint32_t cacheSize) : m_timestamps(vertexCount, 0), m_cacheSize(cacheSize), m_timestamp(cacheSize + 1) {}
+
+        uint32_t Access(uint32_t vertex)
+        {
+            if(m_timestamp - m_timestamps[vertex] > m_cacheSize)
+            {
+                m_timestamps[vertex] = m_timestamp++;
+                return 1;
+            }
+            return 0;
+        }
+
+        uint32_t AccessTriangle(const uint32_t* triangle) { return Access(triangle[0]) + Access(triangle[1]) + Access(triangle[2]); }
+
+        void Flush() { m_timestamp += m_cacheSize + 1; }
+
+    private:
+        std::vector<uint32_t> m_timestamps;
+        uint32_t m_cacheSize;
+        uint32_t m_timestamp;
+    };
+
+    struct ForsythScores
+    {
+        float Cache[MESH_OPTIMIZER_CACHE_SIZE + 3];
+        float Valence[64];
+
+        ForsythScores()
+        {
+            // Constants from Tom Forsyth's article
+            const float cacheDecayPower = 1.5f;
+            const float lastTriangleScore = 0.75f;
+            const float valenceBoostScale = 2.0f;
+            const float valenceBoostPower = 0.5f;
+
+            for(int i = 0; i < MESH_OPTIMIZER_CACHE_SIZE + 3; i++)
+            {
+                if(i < 3)
+                    Cache[i] = lastTriangleScore;
+                else if(i < MESH_OPTIMIZER_CACHE_SIZE)
+                    Cache[i] = powf(1.0f - (float)(i - 3) / (MESH_OPTIMIZER_CACHE_SIZE - 3), cacheDecayPower);
+                else
+                    Cache[i] = 0.0f;
+            }
+
+            Valence[0] = 0.0f;
+            for(int i = 1; i < 64; i++)
+                Valence[i] = valenceBoostScale * powf((float)i, -valenceBoostPower);
+        }
+
+        float VertexScore(int cachePosition, uint32_t liveTriangles) const
+        {
+            if(liveTriangles == 0)
+                return -1.0f;
+
+            float score = cachePosition >= 0 ? Cache[cachePosition] : 0.0f;
+            score += liveTriangles < 64 ? Valence[liveTriangles] : 2.0f * powf((float)liveTriangles, -0.5f);
+            return score;
+        }
+    };
+}
+
+uint32_t MeshOptimizer::GenerateWeldRemap(const void* vertices, uint32_t vertexCount, uint32_t stride, std::vector<uint32_t>& remap)
+{
+    const uint8_t* vertexBytes = static_cast<const uint8_t*>(vertices);
+    remap.assign(vertexCount, UINT32_MAX);
+
+    uint32_t tableSize = 1;
+    while(tableSize < vertexCount * 2)
+        tableSize *= 2;
+
+    // Open addressing table of the first vertex of each unique value
+    std::vector<uint32_t> table(tableSize, UINT32_MAX);
+    uint32_t uniqueCount = 0;
+
+    for(uint32_t i = 0; i < vertexCount; i++)
+    {
+        const uint8_t* vertex = vertexBytes + (size_t)i * stride;
+        uint32_t bucket = (uint32_t)HashVertex(vertex, stride) & (tableSize - 1);
+        while(true)
+        {
+            uint32_t candidate = table[bucket];
+            if(candidate == UINT32_MAX)
+            {
+                table[bucket] = i;
+                remap[i] = uniqueCount++;
+                break;
+            }
+
+            if(memcmp(vertexBytes + (size_t)candidate * stride, vertex, stride) == 0)
+            {
+                remap[i] = remap[candidate];
+                break;
+            }
+
+            bucket = (bucket + 1) & (tableSize - 1);
+        }
+    }
+
+    return uniqueCount;
+}
+
+uint32_t MeshOptimizer::RemoveDegenerateTriangles(std::vector<uint32_t>& indices)
+{
+    size_t writeIndex = 0;
+    for(size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        uint32_t a = indices[t];
+        uint32_t b = indices[t + 1];
+        uint32_t c = indices[t + 2];
+        if(a == b || b == c || c == a)
+            continue;
+
+        indices[writeIndex++] = a;
+        indices[writeIndex++] = b;
+        indices[writeIndex++] = c;
+    }
+
+    uint32_t removedCount = (uint32_t)(indices.size() - writeIndex) / 3;
+    indices.resize(writeIndex);
+    return removedCount;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+    static const ForsythScores scores;
+
+    uint32_t triangleCount = (uint32_t)indices.size() / 3;
+    if(triangleCount == 0)
+        return;
+
+    // Vertex -> triangles adjacency, the live part of each list shrinks as triangles are emitted
+    std::vector<uint32_t> liveTriangles(vertexCount, 0);
+    for(uint32_t index : indices)
+        liveTriangles[index]++;
+
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for(uint32_t v = 0; v < vertexCount; v++)
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for(uint32_t t = 0; t < triangleCount; t++)
+        {
+            for(int k = 0; k < 3; k++)
+                adjacency[fill[indices[t * 3 + k]]++] = t;
+        }
+    }
+
+    std::vector<int> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for(uint32_t v = 0; v < vertexCount; v++)
+        vertexScores[v] = scores.VertexScore(-1, liveTriangles[v]);
+
+    std::vector<bool> emitted(triangleCount, false);
+    uint32_t bestTriangle = UINT32_MAX;
+    float bestScore = -1.0f;
+    for(uint32_t t = 0; t < triangleCount; t++)
+    {
+        float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+        if(score > bestScore)
+        {
+            bestScore = score;
+            bestTriangle = t;
+        }
+    }
+
+    uint32_t cache[MESH_OPTIMIZER_CACHE_SIZE + 3];
+    uint32_t newCache[MESH_OPTIMIZER_CACHE_SIZE + 3];
+    uint32_t cacheCount = 0;
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    uint32_t cursor = 0;
+
+    for(uint32_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+    {
+        if(bestTriangle == UINT32_MAX)
+        {
+            // Nothing left around the cache, restart from the next triangle in input order
+            while(emitted[cursor])
+                cursor++;
+            bestTriangle = cursor;
+        }
+
+        const uint32_t* triangle = &indices[bestTriangle * 3];
+        result.insert(result.end(), triangle, triangle + 3);
+        emitted[bestTriangle] = true;
+
+        // Emitted triangle goes to the front of the cache, the previous content follows
+        uint32_t newCacheCount = 0;
+        for(int k = 0; k < 3; k++)
+        {
+            uint32_t vertex = triangle[k];
+            newCache[newCacheCount++] = vertex;
+
+            uint32_t* first = &adjacency[adjacencyOffsets[vertex]];
+            uint32_t* last = first + liveTriangles[vertex];
+            uint32_t* it = std::find(first, last, bestTriangle);
+            if(it != last)
+            {
+                std::swap(*it, *(last - 1));
+                liveTriangles[vertex]--;
+            }
+        }
+
+        for(uint32_t i = 0; i < cacheCount; i++)
+        {
+            uint32_t vertex = cache[i];
+            if(vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2] && newCacheCount < MESH_OPTIMIZER_CACHE_SIZE + 3)
+                newCache[newCacheCount++] = vertex;
+        }
+
+        for(uint32_t i = 0; i < cacheCount; i++)
+            cachePositions[cache[i]] = -1;
+
+        cacheCount = newCacheCount < MESH_OPTIMIZER_CACHE_SIZE ? newCacheCount : MESH_OPTIMIZER_CACHE_SIZE;
+        for(uint32_t i = 0; i < newCacheCount; i++)
+        {
+            uint32_t vertex = newCache[i];
+            int position = i < cacheCount ? (int)i : -1;
+            cachePositions[vertex] = position;
+            vertexScores[vertex] = scores.VertexScore(position, liveTriangles[vertex]);
+        }
+        memcpy(cache, newCache, cacheCount * sizeof(uint32_t));
+
+        // Only triangles touching the cache changed score
+        bestTriangle = UINT32_MAX;
+        bestScore = -1.0f;
+        for(uint32_t i = 0; i < newCacheCount; i++)
+        {
+            uint32_t vertex = newCache[i];
+            for(uint32_t j = 0; j < liveTriangles[vertex]; j++)
+            {
+                uint32_t t = adjacency[adjacencyOffsets[vertex] + j];
+                float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+                if(score > bestScore)
+                {
+                    bestScore = score;
+                    bestTriangle = t;
+                }
+            }
+        }
+    }
+
+    indices.swap(result);
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::vector<uint32_t>& indices, const float* positions, uint32_t positionStride, uint32_t vertexCount, float threshold)
+{
+    uint32_t triangleCount = (uint32_t)indices.size() / 3;
+    if(triangleCount == 0)
+        return;
+
+    // Hard boundaries where the emulated cache missed all three vertices, the vertex cache pass restarted there.
+    // The first cluster always starts at 0, a degenerate first triangle misses only 2 vertices.
+    std::vector<uint32_t> clusters;
+    {
+        FifoCache cache(vertexCount, MESH_OPTIMIZER_FIFO_SIZE);
+        std::vector<uint32_t> hardBoundaries(1, 0);
+        for(uint32_t t = 0; t < triangleCount; t++)
+        {
+            if(cache.AccessTriangle(&indices[t * 3]) == 3 && t > 0)
+                hardBoundaries.push_back(t);
+        }
+        hardBoundaries.push_back(triangleCount);
+
+        // Soft boundaries split a hard cluster as soon as its running ACMR is within threshold of the whole cluster one
+        for(size_t i = 0; i + 1 < hardBoundaries.size(); i++)
+        {
+            uint32_t start = hardBoundaries[i];
+            uint32_t end = hardBoundaries[i + 1];
+
+            cache.Flush();
+            uint32_t clusterMisses = 0;
+            for(uint32_t t = start; t < end; t++)
+                clusterMisses += cache.AccessTriangle(&indices[t * 3]);
+            float clusterThreshold = threshold * (float)clusterMisses / (float)(end - start);
+
+            cache.Flush();
+            clusters.push_back(start);
+            uint32_t runningMisses = 0;
+            uint32_t runningStart = start;
+            for(uint32_t t = start; t < end; t++)
+            {
+                runningMisses += cache.AccessTriangle(&indices[t * 3]);
+                if(t + 1 < end && (float)runningMisses / (float)(t + 1 - runningStart) <= clusterThreshold)
+                {
+                    clusters.push_back(t + 1);
+                    runningStart = t + 1;
+                    runningMisses = 0;
+                    cache.Flush();
+                }
+            }
+        }
+        clusters.push_back(triangleCount);
+    }
+
+    auto GetPosition = [&](uint32_t vertex)
+    {
+        const float* position = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + (size_t)vertex * positionStride);
+        return DirectX::XMVectorSet(position[0], position[1], position[2], 0.0f);
+    };
+
+    // Area weighted centroids and normals, the mesh centroid is the reference for "outward"
+    uint32_t clusterCount = (uint32_t)clusters.size() - 1;
+    std::vector<DirectX::XMFLOAT3> clusterCentroids(clusterCount);
+    std::vector<DirectX::XMFLOAT3> clusterNormals(clusterCount);
+    DirectX::XMVECTOR meshCentroid = DirectX::XMVectorZero();
+    float meshArea = 0.0f;
+
+    for(uint32_t c = 0; c < clusterCount; c++)
+    {
+        DirectX::XMVECTOR centroid = DirectX::XMVectorZero();
+        DirectX::XMVECTOR normal = DirectX::XMVectorZero();
+        float area = 0.0f;
+
+        for(uint32_t t = clusters[c]; t < clusters[c + 1]; t++)
+        {
+            DirectX::XMVECTOR p0 = GetPosition(indices[t * 3]);
+            DirectX::XMVECTOR p1 = GetPosition(indices[t * 3 + 1]);
+            DirectX::XMVECTOR p2 = GetPosition(indices[t * 3 + 2]);
+            DirectX::XMVECTOR triangleNormal = DirectX::XMVector3Cross(DirectX::XMVectorSubtract(p1, p0), DirectX::XMVectorSubtract(p2, p0));
+            float triangleArea = DirectX::XMVectorGetX(DirectX::XMVector3Length(triangleNormal));
+
+            DirectX::XMVECTOR triangleCentroid = DirectX::XMVectorScale(DirectX::XMVectorAdd(DirectX::XMVectorAdd(p0, p1), p2), 1.0f / 3.0f);
+            centroid = DirectX::XMVectorAdd(centroid, DirectX::XMVectorScale(triangleCentroid, triangleArea));
+            normal = DirectX::XMVectorAdd(normal, triangleNormal);
+            area += triangleArea;
+        }
+
+        meshCentroid = DirectX::XMVectorAdd(meshCentroid, centroid);
+        meshArea += area;
+
+        DirectX::XMStoreFloat3(&clusterCentroids[c], area > 0.0f ? DirectX::XMVectorScale(centroid, 1.0f / area) : centroid);
+        DirectX::XMStoreFloat3(&clusterNormals[c], DirectX::XMVector3Normalize(normal));
+    }
+
+    if(meshArea > 0.0f)
+        meshCentroid = DirectX::XMVectorScale(meshCentroid, 1.0f / meshArea);
+
+    std::vector<float> sortKeys(clusterCount);
+    std::vector<uint32_t> clusterOrder(clusterCount);
+    for(uint32_t c = 0; c < clusterCount; c++)
+    {
+        DirectX::XMVECTOR toCluster = DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&clusterCentroids[c]), meshCentroid);
+        sortKeys[c] = DirectX::XMVectorGetX(DirectX::XMVector3Dot(toCluster, DirectX::XMLoadFloat3(&clusterNormals[c])));
+        clusterOrder[c] = c;
+    }
+
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&sortKeys](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for(uint32_t c : clusterOrder)
+        result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+
+    indices.swap(result);
+}
+
+uint32_t MeshOptimizer::GenerateFetchRemap(const std::vector<uint32_t>& indices, uint32_t vertexCount, std::vector<uint32_t>& remap)
+{
+    remap.assign(vertexCount, UINT32_MAX);
+
+    uint32_t nextVertex = 0;
+    for(uint32_t index : indices)
+    {
+        if(remap[index] == UINT32_MAX)
+            remap[index] = nextVertex++;
+    }
+
+    return nextVertex;
+}
+
+void MeshOptimizer::RemapIndices(std::vector<uint32_t>& indices, const std::vector<uint32_t>& remap)
+{
+    for(uint32_t& index : indices)
+        index = remap[index];
+}
+
+bool MeshOptimizer::VerifySameTriangles(const void* verticesA, uint32_t strideA, const std::vector<uint32_t>& indicesA,
+    const void* verticesB, uint32_t strideB, const std::vector<uint32_t>& indicesB, uint32_t keySize)
+{
+    if(indicesA.size() != indicesB.size() || keySize > sizeof(uint64_t))
+        return false;
+
+    using Triangle = std::array<uint64_t, 3>;
+    auto GatherTriangles = [keySize](const void* vertices, uint32_t stride, const std::vector<uint32_t>& indices)
+    {
+        std::vector<Triangle> triangles(indices.size() / 3);
+        for(size_t t = 0; t < triangles.size(); t++)
+        {
+            Triangle& triangle = triangles[t];
+            for(int corner = 0; corner < 3; corner++)
+            {
+                triangle[corner] = 0;
+                memcpy(&triangle[corner], static_cast<const uint8_t*>(vertices) + (size_t)indices[t * 3 + corner] * stride, keySize);
+            }
+
+            // Rotation keeps the winding
+            std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+        }
+
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    };
+
+    return GatherTriangles(verticesA, strideA, indicesA) == GatherTriangles(verticesB, strideB, indicesB);
+}
+
+float MeshOptimizer::ComputeACMR(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+    uint32_t triangleCount = (uint32_t)indices.size() / 3;
+    if(triangleCount == 0)
+        return 0.0f;
+
+    FifoCache cache(vertexCount, cacheSize);
+    uint32_t misses = 0;
+    for(uint32_t t = 0; t < triangleCount; t++)
+        misses += cache.AccessTriangle(&indices[t * 3]);
+
+    return (float)misses / (float)triangleCount;
+}
@@ -0,0 +1,105 @@
+﻿#pragma once
+#include "Core.h"
+
+// Cache size used by the Forsyth scoring, larger than any real post-transform cache on purpose
+#define MESH_OPTIMIZER_CACHE_SIZE 32
+// FIFO cache emulated to measure ACMR and to find the overdraw clusters
+#define MESH_OPTIMIZER_FIFO_SIZE 16
+// Allowed ACMR degradation when splitting clusters for the overdraw sort
+#define MESH_OPTIMIZER_OVERDRAW_THRESHOLD 1.05f
+
+struct MeshOptimizerStats
+{
+    uint32_t VertexCountBefore = 0;
+    uint32_t VertexCountAfter = 0;
+    float ACMRBefore = 0.0f; // Average cache miss ratio, transformed vertices per triangle
+    float ACMRAfter = 0.0f;
+};
+
+// Index and vertex reordering run on every primitive at cook time
+class MeshOptimizer
+{
+public:
+    // Weld, vertex cache, overdraw and vertex fetch passes in that order. Vertex must start with a float3 position.
+    template<typename Vertex>
+    static MeshOptimizerStats Optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+    {
+        MeshOptimizerStats stats;
+        stats.VertexCountBefore = (uint32_t)vertices.size();
+        stats.ACMRBefore = ComputeACMR(indices, (uint32_t)vertices.size());
+
+        std::vector<uint32_t> remap;
+        uint32_t uniqueCount = GenerateWeldRemap(vertices.data(), (uint32_t)vertices.size(), sizeof(Vertex), remap);
+        RemapIndices(indices, remap);
+        RemapVertices(vertices, remap, uniqueCount);
+        RemoveDegenerateTriangles(indices);
+
+        OptimizeVertexCache(indices, (uint32_t)vertices.size());
+        OptimizeOverdraw(indices, reinterpret_cast<const float*>(vertices.data()), sizeof(Vertex), (uint32_t)vertices.size(), MESH_OPTIMIZER_OVERDRAW_THRESHOLD);
+
+        uint32_t usedCount = GenerateFetchRemap(indices, (uint32_t)vertices.size(), remap);
+        RemapIndices(indices, remap);
+        RemapVertices(vertices, remap, usedCount);
+
+        stats.VertexCountAfter = (uint32_t)vertices.size();
+        stats.ACMRAfter = ComputeACMR(indices, (uint32_t)vertices.size());
+        return stats;
+    }
+
+    // Position only copy of an optimized primitive : welding on the position alone shares more vertices, so the cache pass runs again.
+    // The index ranges ending at rangeEnds (one per LOD) are drawn separately and keep their own triangles.
+    template<typename Position>
+    static void OptimizePositions(std::vector<Position>& positions, std::vector<uint32_t>& indices, const std::vector<uint32_t>& rangeEnds)
+    {
+        std::vector<uint32_t> remap;
+        uint32_t uniqueCount = GenerateWeldRemap(positions.data(), (uint32_t)positions.size(), sizeof(Position), remap);
+        RemapIndices(indices, remap);
+        RemapVertices(positions, remap, uniqueCount);
+
+        std::vector<uint32_t> range;
+        uint32_t rangeBegin = 0;
+        for(uint32_t rangeEnd : rangeEnds)
+        {
+            range.assign(indices.begin() + rangeBegin, indices.begin() + rangeEnd);
+            OptimizeVertexCache(range, (uint32_t)positions.size());
+            std::copy(range.begin(), range.end(), indices.begin() + rangeBegin);
+            rangeBegin = rangeEnd;
+        }
+
+        uint32_t usedCount = GenerateFetchRemap(indices, (uint32_t)positions.size(), remap);
+        RemapIndices(indices, remap);
+        RemapVertices(positions, remap, usedCount);
+    }
+
+    // True when both index sets draw the same triangles with the same winding, in any order.
+    // Corners are compared on the first keySize bytes (at most 8) of their vertex.
+    static bool VerifySameTriangles(const void* verticesA, uint32_t strideA, const std::vector<uint32_t>& indicesA,
+        const void* verticesB, uint32_t strideB, const std::vector<uint32_t>& indicesB, uint32_t keySize);
+
+    // Maps every vertex to the first bitwise identical one, returns the unique vertex count
+    static uint32_t GenerateWeldRemap(const void* vertices, uint32_t vertexCount, uint32_t stride, std::vector<uint32_t>& remap);
+    // Drops the triangles using a vertex twice, welding turns the ones with bitwise identical corners into those. Returns the removed count
+    static uint32_t RemoveDegenerateTriangles(std::vector<uint32_t>& indices);
+    // Tom Forsyth's linear speed vertex cache optimisation
+    static void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount);
+    // Splits the cache optimised triangles in clusters (Tipsify style) and draws the outward facing ones first
+    static void OptimizeOverdraw(std::vector<uint32_t>& indices, const float* positions, uint32_t positionStride, uint32_t vertexCount, float threshold);
+    // Maps vertices in first use order, unused ones are dropped, returns the used vertex count
+    static uint32_t GenerateFetchRemap(const std::vector<uint32_t>& indices, uint32_t vertexCount, std::vector<uint32_t>& remap);
+
+    static void RemapIndices(std::vector<uint32_t>& indices, const std::vector<uint32_t>& remap);
+
+    template<typename T>
+    static void RemapVertices(std::vector<T>& vertices, const std::vector<uint32_t>& remap, uint32_t newCount)
+    {
+        std::vector<T> remapped(newCount);
+        for(size_t i = 0; i < vertices.size(); i++)
+        {
+            if(remap[i] != UINT32_MAX)
+                remapped[remap[i]] = vertices[i];
+        }
+        vertices.swap(remapped);
+    }
+
+    static float ComputeACMR(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = MESH_OPTIMIZER_FIFO_SIZE);
+};
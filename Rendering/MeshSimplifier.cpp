@@ -0,0 +1,595 @@
+﻿#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+    // Quadrics are accumulated over many collapses, doubles keep the plane sums from cancelling out
+    struct Vector3d
+    {
+        double X = 0.0;
+        double Y = 0.0;
+        double Z = 0.0;
+    };
+
+    Vector3d Subtract(const Vector3d& a, const Vector3d& b) { return { a.X - b.X, a.Y - b.Y, a.Z - b.Z }; }
+    Vector3d Cross(const Vector3d& a, const Vector3d& b) { return { a.Y * b.Z - a.Z * b.Y, a.Z * b.X - a.X * b.Z, a.X * b.Y - a.Y * b.X }; }
+    double Dot(const Vector3d& a, const Vector3d& b) { return a.X * b.X + a.Y * b.Y + a.Z * b.Z; }
+    Vector3d MultiplyAdd(const Vector3d& a, double s, const Vector3d& b) { return { a.X + s * b.X, a.Y + s * b.Y, a.Z + s * b.Z }; }
+
+    // Closest point by Voronoi region of the triangle (Ericson, Real-Time Collision Detection 5.1.5)
+    double PointTriangleDistanceSquared(const Vector3d& p, const Vector3d& a, const Vector3d& b, const Vector3d& c)
+    {
+        Vector3d ab = Subtract(b, a);
+        Vector3d ac = Subtract(c, a);
+        Vector3d ap = Subtract(p, a);
+        double d1 = Dot(ab, ap);
+        double d2 = Dot(ac, ap);
+        Vector3d closest;
+        if(d1 <= 0.0 && d2 <= 0.0)
+            closest = a;
+        else
+        {
+            Vector3d bp = Subtract(p, b);
+            double d3 = Dot(ab, bp);
+            double d4 = Dot(ac, bp);
+            Vector3d cp = Subtract(p, c);
+            double d5 = Dot(ab, cp);
+            double d6 = Dot(ac, cp);
+            double vc = d1 * d4 - d3 * d2;
+            double vb = d5 * d2 - d1 * d6;
+            double va = d3 * d6 - d5 * d4;
+            if(d3 >= 0.0 && d4 <= d3)
+                closest = b;
+            else if(d6 >= 0.0 && d5 <= d6)
+                closest = c;
+            else if(vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+                closest = MultiplyAdd(a, d1 / (d1 - d3), ab);
+            else if(vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+                closest = MultiplyAdd(a, d2 / (d2 - d6), ac);
+            else if(va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0)
+                closest = MultiplyAdd(b, (d4 - d3) / ((d4 - d3) + (d5 - d6)), Subtract(c, b));
+            else
+            {
+                double denominator = 1.0 / (va + vb + vc);
+                closest = MultiplyAdd(MultiplyAdd(a, vb * denominator, ab), vc * denominator, ac);
+            }
+        }
+
+        Vector3d offset = Subtract(p, closest);
+        return Dot(offset, offset);
+    }
+
+    // Weighted sum of squared distances to planes, p^T A p + 2 B.p + C with A symmetric
+    struct Quadric
+    {
+        double A00 = 0.0, A01 = 0.0, A02 = 0.0, A11 = 0.0, A12 = 0.0, A22 = 0.0;
+        double B0 = 0.0, B1 = 0.0, B2 = 0.0;
+        double C = 0.0;
+        double Weight = 0.0;
+
+        void AddPlane(const Vector3d& normal, double distance, double weight)
+        {
+            A00 += weight * normal.X * normal.X;
+            A01 += weight * normal.X * normal.Y;
+            A02 += weight * normal.X * normal.Z;
+            A11 += weight * normal.Y * normal.Y;
+            A12 += weight * normal.Y * normal.Z;
+            A22 += weight * normal.Z * normal.Z;
+            B0 += weight * normal.X * distance;
+            B1 += weight * normal.Y * distance;
+            B2 += weight * normal.Z * distance;
+            C += weight * distance * distance;
+            Weight += weight;
+        }
+
+        void Add(const Quadric& other)
+        {
+            A00 += other.A00; A01 += other.A01; A02 += other.A02;
+            A11 += other.A11; A12 += other.A12; A22 += other.A22;
+            B0 += other.B0; B1 += other.B1; B2 += other.B2;
+            C += other.C;
+            Weight += other.Weight;
+        }
+
+        double Evaluate(const Vector3d& p) const
+        {
+            return A00 * p.X * p.X + A11 * p.Y * p.Y + A22 * p.Z * p.Z
+                + 2.0 * (A01 * p.X * p.Y + A02 * p.X * p.Z + A12 * p.Y * p.Z)
+                + 2.0 * (B0 * p.X + B1 * p.Y + B2 * p.Z) + C;
+        }
+    };
+
+    // Weighted mean squared distance to the planes of both vertices once merged at p
+    double CollapseCost(const Quadric& from, const Quadric& to, const Vector3d& p)
+    {
+        double weight = from.Weight + to.Weight;
+        return weight > 0.0 ? fabs(from.Evaluate(p) + to.Evaluate(p)) / weight : 0.0;
+    }
+
+    struct Collapse
+    {
+        double Cost;
+        uint32_t From;
+        uint32_t To;
+    };
+}
+
+float MeshSimplifier::Simplify(const float* positions, uint32_t positionStride, uint32_t vertexCount, const std::vector<uint32_t>& indices,
+    uint32_t targetIndexCount, float maxError, std::vector<uint32_t>& result)
+{
+    result.clear();
+
+    // Vertices welded on position alone, the corners of an attribute seam share one position vertex
+    std::vector<DirectX::XMFLOAT3> vertexPositions(vertexCount);
+    for(uint32_t v = 0; v < vertexCount; v++)
+        vertexPositions[v] = *reinterpret_cast<const DirectX::XMFLOAT3*>(reinterpret_cast<const uint8_t*>(positions) + (size_t)v * positionStride);
+
+    std::vector<uint32_t> positionRemap;
+    uint32_t positionCount = MeshOptimizer::GenerateWeldRemap(vertexPositions.data(), vertexCount, sizeof(DirectX::XMFLOAT3), positionRemap);
+
+    std::vector<Vector3d> points(positionCount);
+    for(uint32_t v = 0; v < vertexCount; v++)
+        points[positionRemap[v]] = { vertexPositions[v].x, vertexPositions[v].y, vertexPositions[v].z };
+
+    // Degenerate triangles are dropped up front, the three corners of a live triangle are then always distinct positions
+    std::vector<uint32_t> triangles;
+    triangles.reserve(indices.size());
+    for(size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        uint32_t p0 = positionRemap[indices[i]];
+        uint32_t p1 = positionRemap[indices[i + 1]];
+        uint32_t p2 = positionRemap[indices[i + 2]];
+        if(p0 != p1 && p1 != p2 && p2 != p0)
+            triangles.insert(triangles.end(), indices.begin() + i, indices.begin() + i + 3);
+    }
+
+    uint32_t triangleCount = (uint32_t)triangles.size() / 3;
+    auto Corner = [&](uint32_t triangle, uint32_t corner) { return positionRemap[triangles[triangle * 3 + corner]]; };
+
+    std::vector<uint64_t> edges;
+    edges.reserve(triangles.size());
+    for(uint32_t t = 0; t < triangleCount; t++)
+    {
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            uint32_t a = Corner(t, k);
+            uint32_t b = Corner(t, (k + 1) % 3);
+            edges.push_back((uint64_t)std::min(a, b) << 32 | std::max(a, b));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    // Area weighted triangle planes, plus planes perpendicular to the border edges so the outline does not shrink
+    std::vector<Quadric> quadrics(positionCount);
+    for(uint32_t t = 0; t < triangleCount; t++)
+    {
+        const Vector3d& p0 = points[Corner(t, 0)];
+        Vector3d normal = Cross(Subtract(points[Corner(t, 1)], p0), Subtract(points[Corner(t, 2)], p0));
+        double length = sqrt(Dot(normal, normal));
+        if(length <= 0.0)
+            continue;
+
+        normal = { normal.X / length, normal.Y / length, normal.Z / length };
+        for(uint32_t k = 0; k < 3; k++)
+            quadrics[Corner(t, k)].AddPlane(normal, -Dot(normal, p0), length * 0.5);
+
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            uint32_t a = Corner(t, k);
+            uint32_t b = Corner(t, (k + 1) % 3);
+            uint64_t edge = (uint64_t)std::min(a, b) << 32 | std::max(a, b);
+            auto range = std::equal_range(edges.begin(), edges.end(), edge);
+            if(range.second - range.first != 1)
+                continue;
+
+            Vector3d edgeVector = Subtract(points[b], points[a]);
+            Vector3d borderNormal = Cross(edgeVector, normal);
+            double borderLength = sqrt(Dot(borderNormal, borderNormal));
+            if(borderLength <= 0.0)
+                continue;
+
+            borderNormal = { borderNormal.X / borderLength, borderNormal.Y / borderLength, borderNormal.Z / borderLength };
+            double weight = Dot(edgeVector, edgeVector) * MESH_SIMPLIFIER_BORDER_WEIGHT;
+            quadrics[a].AddPlane(borderNormal, -Dot(borderNormal, points[a]), weight);
+            quadrics[b].AddPlane(borderNormal, -Dot(borderNormal, points[a]), weight);
+        }
+    }
+
+    std::vector<bool> alive(triangleCount, true);
+    uint32_t liveCount = triangleCount;
+    uint32_t targetTriangleCount = targetIndexCount / 3;
+    double maxCost = (double)maxError * (double)maxError;
+    // Position each position collapsed onto, followed to the end it gives the surviving position that replaced it
+    std::vector<uint32_t> collapsedInto(positionCount);
+    for(uint32_t p = 0; p < positionCount; p++)
+        collapsedInto[p] = p;
+
+    std::vector<uint32_t> adjacencyOffsets(positionCount + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> collapses;
+    std::vector<bool> locked(positionCount);
+    std::vector<std::pair<uint32_t, uint32_t>> wedgeMap;
+    std::vector<uint32_t> fromNeighbours;
+    std::vector<uint32_t> toNeighbours;
+    std::vector<uint32_t> opposites;
+
+    auto FindCorner = [&](uint32_t triangle, uint32_t position) -> int
+    {
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            if(Corner(triangle, k) == position)
+                return (int)k;
+        }
+        return -1;
+    };
+
+    // Every wedge (vertex) of 'from' has to merge into the wedge of 'to' it shares an edge triangle with, otherwise the seam tears
+    auto BuildWedgeMap = [&](uint32_t from, uint32_t to)
+    {
+        wedgeMap.clear();
+        for(uint32_t i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1]; i++)
+        {
+            uint32_t t = adjacency[i];
+            int toCorner = FindCorner(t, to);
+            if(toCorner < 0)
+                continue;
+
+            uint32_t fromWedge = triangles[t * 3 + FindCorner(t, from)];
+            uint32_t toWedge = triangles[t * 3 + toCorner];
+            auto it = std::find_if(wedgeMap.begin(), wedgeMap.end(), [fromWedge](const auto& pair) { return pair.first == fromWedge; });
+            if(it == wedgeMap.end())
+                wedgeMap.emplace_back(fromWedge, toWedge);
+            else if(it->second != toWedge)
+                return false;
+        }
+
+        for(uint32_t i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1]; i++)
+        {
+            uint32_t t = adjacency[i];
+            uint32_t fromWedge = triangles[t * 3 + FindCorner(t, from)];
+            if(std::find_if(wedgeMap.begin(), wedgeMap.end(), [fromWedge](const auto& pair) { return pair.first == fromWedge; }) == wedgeMap.end())
+                return false;
+        }
+
+        return !wedgeMap.empty();
+    };
+
+    auto GatherNeighbours = [&](uint32_t position, std::vector<uint32_t>& neighbours)
+    {
+        neighbours.clear();
+        for(uint32_t i = adjacencyOffsets[position]; i < adjacencyOffsets[position + 1]; i++)
+        {
+            for(uint32_t k = 0; k < 3; k++)
+            {
+                uint32_t corner = Corner(adjacency[i], k);
+                if(corner != position)
+                    neighbours.push_back(corner);
+            }
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    };
+
+    // Link condition : the only neighbours both ends share are the opposite corners of the edge triangles, anything else pinches the surface
+    auto IsManifoldCollapse = [&](uint32_t from, uint32_t to)
+    {
+        GatherNeighbours(from, fromNeighbours);
+        GatherNeighbours(to, toNeighbours);
+
+        opposites.clear();
+        for(uint32_t i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1]; i++)
+        {
+            uint32_t t = adjacency[i];
+            if(FindCorner(t, to) < 0)
+                continue;
+
+            for(uint32_t k = 0; k < 3; k++)
+            {
+                uint32_t corner = Corner(t, k);
+                if(corner != from && corner != to)
+                    opposites.push_back(corner);
+            }
+        }
+        std::sort(opposites.begin(), opposites.end());
+        opposites.erase(std::unique(opposites.begin(), opposites.end()), opposites.end());
+
+        size_t sharedCount = 0;
+        for(uint32_t neighbour : fromNeighbours)
+        {
+            if(std::binary_search(toNeighbours.begin(), toNeighbours.end(), neighbour))
+                sharedCount++;
+        }
+        return sharedCount == opposites.size();
+    };
+
+    // The triangles left around 'from' must not flip once their corner moves to 'to'
+    auto KeepsOrientation = [&](uint32_t from, uint32_t to)
+    {
+        for(uint32_t i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1]; i++)
+        {
+            uint32_t t = adjacency[i];
+            if(FindCorner(t, to) >= 0)
+                continue;
+
+            Vector3d oldPoints[3];
+            Vector3d newPoints[3];
+            for(uint32_t k = 0; k < 3; k++)
+            {
+                uint32_t corner = Corner(t, k);
+                oldPoints[k] = points[corner];
+                newPoints[k] = points[corner == from ? to : corner];
+            }
+
+            Vector3d oldNormal = Cross(Subtract(oldPoints[1], oldPoints[0]), Subtract(oldPoints[2], oldPoints[0]));
+            Vector3d newNormal = Cross(Subtract(newPoints[1], newPoints[0]), Subtract(newPoints[2], newPoints[0]));
+            if(Dot(oldNormal, newNormal) <= 0.0)
+                return false;
+        }
+        return true;
+    };
+
+    // Position -> live triangles
+    auto BuildAdjacency = [&]()
+    {
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for(uint32_t t = 0; t < triangleCount; t++)
+        {
+            if(alive[t])
+            {
+                for(uint32_t k = 0; k < 3; k++)
+                    adjacencyOffsets[Corner(t, k) + 1]++;
+            }
+        }
+        for(uint32_t p = 0; p < positionCount; p++)
+            adjacencyOffsets[p + 1] += adjacencyOffsets[p];
+
+        adjacency.resize(adjacencyOffsets[positionCount]);
+        {
+            std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for(uint32_t t = 0; t < triangleCount; t++)
+            {
+                if(alive[t])
+                {
+                    for(uint32_t k = 0; k < 3; k++)
+                        adjacency[fill[Corner(t, k)]++] = t;
+                }
+            }
+        }
+    };
+
+    for(uint32_t pass = 0; pass < MESH_SIMPLIFIER_MAX_PASSES && liveCount > targetTriangleCount; pass++)
+    {
+        BuildAdjacency();
+
+        // Cheapest valid collapse of every position onto one of its neighbours
+        collapses.clear();
+        for(uint32_t from = 0; from < positionCount; from++)
+        {
+            Collapse best = { maxCost, UINT32_MAX, UINT32_MAX };
+            for(uint32_t i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1]; i++)
+            {
+                for(uint32_t k = 0; k < 3; k++)
+                {
+                    uint32_t to = Corner(adjacency[i], k);
+                    if(to == from)
+                        continue;
+
+                    double cost = CollapseCost(quadrics[from], quadrics[to], points[to]);
+                    if(cost > best.Cost || (cost == best.Cost && best.To != UINT32_MAX))
+                        continue;
+
+                    if(BuildWedgeMap(from, to) && IsManifoldCollapse(from, to) && KeepsOrientation(from, to))
+                        best = { cost, from, to };
+                }
+            }
+
+            if(best.To != UINT32_MAX)
+                collapses.push_back(best);
+        }
+
+        if(collapses.empty())
+            break;
+
+        // Only the cheapest part of the candidates goes through, the rest gets re-evaluated on the simplified neighbourhood next pass
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.Cost < b.Cost; });
+        collapses.resize(collapses.size() / 3 + 1);
+
+        std::fill(locked.begin(), locked.end(), false);
+        uint32_t collapsedCount = 0;
+        for(const Collapse& collapse : collapses)
+        {
+            if(liveCount <= targetTriangleCount)
+                break;
+
+            // Both ends must still have the neighbourhood the collapse was validated on
+            if(locked[collapse.From] || locked[collapse.To])
+                continue;
+
+            BuildWedgeMap(collapse.From, collapse.To);
+            for(uint32_t i = adjacencyOffsets[collapse.From]; i < adjacencyOffsets[collapse.From + 1]; i++)
+            {
+                uint32_t t = adjacency[i];
+                for(uint32_t k = 0; k < 3; k++)
+                    locked[Corner(t, k)] = true;
+
+                if(FindCorner(t, collapse.To) >= 0)
+                {
+                    alive[t] = false;
+                    liveCount--;
+                    continue;
+                }
+
+                uint32_t& wedge = triangles[t * 3 + FindCorner(t, collapse.From)];
+                uint32_t fromWedge = wedge;
+                wedge = std::find_if(wedgeMap.begin(), wedgeMap.end(), [fromWedge](const auto& pair) { return pair.first == fromWedge; })->second;
+            }
+
+            quadrics[collapse.To].Add(quadrics[collapse.From]);
+            collapsedInto[collapse.From] = collapse.To;
+            collapsedCount++;
+        }
+
+        if(collapsedCount == 0)
+            break;
+    }
+
+    // The quadric cost is a mean over planes, the farthest source position can lie further : each collapsed position is measured
+    // against the result. The triangles within two rings of the position that replaced it give a first distance, a uniform grid of
+    // the result then finds any closer triangle within it, another part of the mesh can pass nearer than the local surface
+    BuildAdjacency();
+    Vector3d boundsMin = { DBL_MAX, DBL_MAX, DBL_MAX };
+    Vector3d boundsMax = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+    for(uint32_t p = 0; p < positionCount; p++)
+    {
+        if(adjacencyOffsets[p] == adjacencyOffsets[p + 1])
+            continue;
+
+        boundsMin = { std::min(boundsMin.X, points[p].X), std::min(boundsMin.Y, points[p].Y), std::min(boundsMin.Z, points[p].Z) };
+        boundsMax = { std::max(boundsMax.X, points[p].X), std::max(boundsMax.Y, points[p].Y), std::max(boundsMax.Z, points[p].Z) };
+    }
+
+    int gridSize = std::clamp((int)std::cbrt((double)liveCount), 1, MESH_SIMPLIFIER_MAX_GRID_SIZE);
+    Vector3d cellScale = Subtract(boundsMax, boundsMin);
+    cellScale = { cellScale.X > 0.0 ? gridSize / cellScale.X : 0.0, cellScale.Y > 0.0 ? gridSize / cellScale.Y : 0.0, cellScale.Z > 0.0 ? gridSize / cellScale.Z : 0.0 };
+    auto CellCoordinates = [&](const Vector3d& point, int coordinates[3])
+    {
+        Vector3d cell = Subtract(point, boundsMin);
+        coordinates[0] = (int)std::clamp(cell.X * cellScale.X, 0.0, gridSize - 1.0);
+        coordinates[1] = (int)std::clamp(cell.Y * cellScale.Y, 0.0, gridSize - 1.0);
+        coordinates[2] = (int)std::clamp(cell.Z * cellScale.Z, 0.0, gridSize - 1.0);
+    };
+
+    // Each live triangle goes in every cell its bounds overlap
+    std::vector<uint32_t> cellOffsets((size_t)gridSize * gridSize * gridSize + 1);
+    std::vector<uint32_t> cellTriangles;
+    for(int fill = 0; fill < 2; fill++)
+    {
+        for(uint32_t t = 0; t < triangleCount; t++)
+        {
+            if(!alive[t])
+                continue;
+
+            int cornerCells[3][3];
+            for(uint32_t k = 0; k < 3; k++)
+                CellCoordinates(points[Corner(t, k)], cornerCells[k]);
+
+            for(int z = std::min({ cornerCells[0][2], cornerCells[1][2], cornerCells[2][2] }); z <= std::max({ cornerCells[0][2], cornerCells[1][2], cornerCells[2][2] }); z++)
+            {
+                for(int y = std::min({ cornerCells[0][1], cornerCells[1][1], cornerCells[2][1] }); y <= std::max({ cornerCells[0][1], cornerCells[1][1], cornerCells[2][1] }); y++)
+                {
+                    for(int x = std::min({ cornerCells[0][0], cornerCells[1][0], cornerCells[2][0] }); x <= std::max({ cornerCells[0][0], cornerCells[1][0], cornerCells[2][0] }); x++)
+                    {
+                        size_t cell = ((size_t)z * gridSize + y) * gridSize + x;
+                        if(fill)
+                            cellTriangles[cellOffsets[cell]++] = t;
+                        else
+                            cellOffsets[cell + 1]++;
+                    }
+                }
+            }
+        }
+
+        // Prefix sum before the fill, the fill leaves every offset on the next cell start : shifted back once done
+        if(fill)
+        {
+            std::copy_backward(cellOffsets.begin(), cellOffsets.end() - 1, cellOffsets.end());
+            cellOffsets[0] = 0;
+        }
+        else
+        {
+            for(size_t cell = 1; cell < cellOffsets.size(); cell++)
+                cellOffsets[cell] += cellOffsets[cell - 1];
+            cellTriangles.resize(cellOffsets.back());
+        }
+    }
+
+    std::vector<uint32_t> triangleVisits(triangleCount, UINT32_MAX);
+    double errorSquared = 0.0;
+    for(uint32_t p = 0; p < positionCount; p++)
+    {
+        if(collapsedInto[p] == p)
+            continue;
+
+        uint32_t survivor = collapsedInto[p];
+        while(collapsedInto[survivor] != survivor)
+            survivor = collapsedInto[survivor];
+
+        auto DistanceSquared = [&](uint32_t t)
+        {
+            if(triangleVisits[t] == p)
+                return DBL_MAX;
+            triangleVisits[t] = p;
+            return PointTriangleDistanceSquared(points[p], points[Corner(t, 0)], points[Corner(t, 1)], points[Corner(t, 2)]);
+        };
+
+        double nearest = DBL_MAX;
+        for(uint32_t i = adjacencyOffsets[survivor]; i < adjacencyOffsets[survivor + 1]; i++)
+        {
+            for(uint32_t k = 0; k < 3; k++)
+            {
+                uint32_t corner = Corner(adjacency[i], k);
+                for(uint32_t j = adjacencyOffsets[corner]; j < adjacencyOffsets[corner + 1]; j++)
+                    nearest = std::min(nearest, DistanceSquared(adjacency[j]));
+            }
+        }
+
+        // The survivor lost all its triangles, the whole grid is searched
+        int cellMin[3] = { 0, 0, 0 };
+        int cellMax[3] = { gridSize - 1, gridSize - 1, gridSize - 1 };
+        if(nearest != DBL_MAX)
+        {
+            double radius = sqrt(nearest);
+            CellCoordinates(Subtract(points[p], { radius, radius, radius }), cellMin);
+            CellCoordinates(MultiplyAdd(points[p], radius, { 1.0, 1.0, 1.0 }), cellMax);
+        }
+
+        for(int z = cellMin[2]; z <= cellMax[2]; z++)
+        {
+            for(int y = cellMin[1]; y <= cellMax[1]; y++)
+            {
+                for(int x = cellMin[0]; x <= cellMax[0]; x++)
+                {
+                    size_t cell = ((size_t)z * gridSize + y) * gridSize + x;
+                    for(uint32_t i = cellOffsets[cell]; i < cellOffsets[cell + 1]; i++)
+                        nearest = std::min(nearest, DistanceSquared(cellTriangles[i]));
+                }
+            }
+        }
+
+        if(nearest != DBL_MAX)
+            errorSquared = std::max(errorSquared, nearest);
+    }
+
+    result.reserve(liveCount * 3);
+    for(uint32_t t = 0; t < triangleCount; t++)
+    {
+        if(alive[t])
+            result.insert(result.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+    }
+
+    return (float)sqrt(errorSquared);
+}
+
+void MeshSimplifier::BuildLods(const float* positions, uint32_t positionStride, uint32_t vertexCount, std::vector<uint32_t>& indices, std::vector<MeshLod>& lods)
+{
+    std::vector<uint32_t> sourceIndices = indices;
+    std::vector<uint32_t> lodIndices;
+    lods.assign(1, { 0, (uint32_t)indices.size(), 0.0f });
+    for(uint32_t lod = 1; lod < MESH_LOD_MAX_COUNT; lod++)
+    {
+        MeshLod previous = lods.back();
+        uint32_t targetIndexCount = (uint32_t)(previous.IndexCount * MESH_LOD_REDUCTION) / 3 * 3;
+        float error = Simplify(positions, positionStride, vertexCount, sourceIndices, targetIndexCount, FLT_MAX, lodIndices);
+        if(lodIndices.empty() || lodIndices.size() > previous.IndexCount * MESH_LOD_MIN_REDUCTION)
+            break;
+
+        // Errors never decrease along the chain, LOD selection walks it coarsest first
+        MeshOptimizer::OptimizeVertexCache(lodIndices, vertexCount);
+        lods.push_back({ (uint32_t)indices.size(), (uint32_t)lodIndices.size(), std::max(error, previous.Error) });
+        indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+    }
+}
@@ -0,0 +1,27 @@
+﻿#pragma once
+#include "Core.h"
+#include "MeshLod.h"
+
+// Border edges get constraint planes weighted this much more than the faces, open boundaries keep their outline
+#define MESH_SIMPLIFIER_BORDER_WEIGHT 10.0f
+// Each pass collapses an independent set of edges, this only guards against meshes that stop converging
+#define MESH_SIMPLIFIER_MAX_PASSES 256
+// Cells per axis of the grid the returned error is measured on, about one live triangle per cell below that
+#define MESH_SIMPLIFIER_MAX_GRID_SIZE 64
+
+// Quadric error metric edge collapse (Garland & Heckbert). A vertex only ever collapses onto one of its neighbours so the
+// remaining vertices, and their attributes, are the source ones : the simplified indices reuse the source vertex buffer.
+// Vertices sharing a position (attribute seams) move together, a collapse is refused when it would tear a seam.
+class MeshSimplifier
+{
+public:
+    // Collapses edges cheapest first until the index count reaches targetIndexCount or the next collapse would exceed maxError.
+    // maxError is compared to the quadric estimate of each collapse. Returns the largest distance from a source vertex to the
+    // result surface in position units, measured conservatively : the real distance is never larger.
+    static float Simplify(const float* positions, uint32_t positionStride, uint32_t vertexCount, const std::vector<uint32_t>& indices,
+        uint32_t targetIndexCount, float maxError, std::vector<uint32_t>& result);
+
+    // LOD chain of a mesh whose indices hold LOD 0 only : every coarser level is simplified from LOD 0, so its error is measured
+    // against the source surface, then cache optimized and appended to indices. lods receives LOD 0 and each level's range.
+    static void BuildLods(const float* positions, uint32_t positionStride, uint32_t vertexCount, std::vector<uint32_t>& indices, std::vector<MeshLod>& lods);
+};
@@ -0,0 +1,243 @@
+﻿#include "Meshlet.h"
+#include "InstanceCulling.h"
+
+#include <algorithm>
+#include <cfloat>
+
+using namespace DirectX;
+
+namespace
+{
+    XMVECTOR LoadPosition(const float* positions, uint32_t positionStride, uint32_t vertex)
+    {
+        return XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const uint8_t*>(positions) + (size_t)vertex * positionStride));
+    }
+
+    void ComputeBounds(Meshlet& meshlet, const float* positions, uint32_t positionStride, const uint32_t* indices)
+    {
+        uint32_t indexCount = meshlet.TriangleCount * 3;
+
+        XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+        XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+        for(uint32_t i = 0; i < indexCount; i++)
+        {
+            XMVECTOR position = LoadPosition(positions, positionStride, indices[i]);
+            boundsMin = XMVectorMin(boundsMin, position);
+            boundsMax = XMVectorMax(boundsMax, position);
+        }
+
+        XMVECTOR center = XMVectorScale(XMVectorAdd(boundsMin, boundsMax), 0.5f);
+        XMVECTOR radiusSq = XMVectorZero();
+        XMVECTOR normalSum = XMVectorZero();
+        for(uint32_t i = 0; i < indexCount; i += 3)
+        {
+            XMVECTOR p0 = LoadPosition(positions, positionStride, indices[i]);
+            XMVECTOR p1 = LoadPosition(positions, positionStride, indices[i + 1]);
+            XMVECTOR p2 = LoadPosition(positions, positionStride, indices[i + 2]);
+            radiusSq = XMVectorMax(radiusSq, XMVector3LengthSq(XMVectorSubtract(p0, center)));
+            radiusSq = XMVectorMax(radiusSq, XMVector3LengthSq(XMVectorSubtract(p1, center)));
+            radiusSq = XMVectorMax(radiusSq, XMVector3LengthSq(XMVectorSubtract(p2, center)));
+
+            // Clockwise front faces in a left handed space
+            XMVECTOR normal = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+            if(XMVectorGetX(XMVector3LengthSq(normal)) > 0.0f)
+                normalSum = XMVectorAdd(normalSum, XMVector3Normalize(normal));
+        }
+
+        XMStoreFloat3(&meshlet.Center, center);
+        meshlet.Radius = sqrtf(XMVectorGetX(radiusSq));
+        meshlet.ConeAxis = XMFLOAT3(0.0f, 0.0f, 0.0f);
+        meshlet.ConeCutoff = 1.0f;
+
+        if(XMVectorGetX(XMVector3LengthSq(normalSum)) == 0.0f)
+            return;
+
+        XMVECTOR axis = XMVector3Normalize(normalSum);
+        float minDot = 1.0f;
+        for(uint32_t i = 0; i < indexCount; i += 3)
+        {
+            XMVECTOR p0 = LoadPosition(positions, positionStride, indices[i]);
+            XMVECTOR normal = XMVector3Cross(XMVectorSubtract(LoadPosition(positions, positionStride, indices[i + 1]), p0), XMVectorSubtract(LoadPosition(positions, positionStride, indices[i + 2]), p0));
+            if(XMVectorGetX(XMVector3LengthSq(normal)) > 0.0f)
+                minDot = (std::min)(minDot, XMVectorGetX(XMVector3Dot(axis, XMVector3Normalize(normal))));
+        }
+
+        XMStoreFloat3(&meshlet.ConeAxis, axis);
+        if(minDot > MESHLET_CONE_MIN_SPREAD)
+            meshlet.ConeCutoff = sqrtf(1.0f - minDot * minDot);
+    }
+}
+
+void MeshletBuilder::Build(const float* positions, uint32_t positionStride, uint32_t vertexCount, const std::vector<uint32_t>& indices, std::vector<Meshlet>& meshlets)
+{
+    meshlets.clear();
+
+    // Last meshlet that referenced each vertex
+    std::vector<uint32_t> vertexOwner(vertexCount, UINT32_MAX);
+
+    Meshlet current = {};
+    uint32_t currentId = 0;
+    auto CountNewVertices = [&](uint32_t i)
+    {
+        uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        return (uint32_t)(vertexOwner[a] != currentId) + (uint32_t)(vertexOwner[b] != currentId && b != a) + (uint32_t)(vertexOwner[c] != currentId && c != a && c != b);
+    };
+
+    for(uint32_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        uint32_t newVertices = CountNewVertices(i);
+        if(current.VertexCount + newVertices > MESHLET_MAX_VERTICES || current.TriangleCount == MESHLET_MAX_TRIANGLES)
+        {
+            ComputeBounds(current, positions, positionStride, &indices[current.IndexOffset]);
+            meshlets.push_back(current);
+
+            current = {};
+            current.IndexOffset = i;
+            currentId++;
+            newVertices = CountNewVertices(i);
+        }
+
+        for(uint32_t corner = 0; corner < 3; corner++)
+            vertexOwner[indices[i + corner]] = currentId;
+
+        current.VertexCount += newVertices;
+        current.TriangleCount++;
+    }
+
+    if(current.TriangleCount > 0)
+    {
+        ComputeBounds(current, positions, positionStride, &indices[current.IndexOffset]);
+        meshlets.push_back(current);
+    }
+}
+
+MeshletCullingData MeshletBuilder::BuildCullingData(const std::vector<Meshlet>& meshlets)
+{
+    MeshletCullingData data;
+    data.Count = (uint32_t)meshlets.size();
+
+    // Padding lanes are never reported, Cull masks them out
+    size_t paddedCount = (meshlets.size() + 3) & ~(size_t)3;
+    for(auto* component : { &data.CenterX, &data.CenterY, &data.CenterZ, &data.Radius, &data.ConeAxisX, &data.ConeAxisY, &data.ConeAxisZ, &data.ConeCutoff })
+        component->assign(paddedCount, 0.0f);
+
+    for(size_t i = 0; i < meshlets.size(); i++)
+    {
+        const Meshlet& meshlet = meshlets[i];
+        data.CenterX[i] = meshlet.Center.x;
+        data.CenterY[i] = meshlet.Center.y;
+        data.CenterZ[i] = meshlet.Center.z;
+        data.Radius[i] = meshlet.Radius;
+        data.ConeAxisX[i] = meshlet.ConeAxis.x;
+        data.ConeAxisY[i] = meshlet.ConeAxis.y;
+        data.ConeAxisZ[i] = meshlet.ConeAxis.z;
+        data.ConeCutoff[i] = meshlet.ConeCutoff;
+    }
+
+    return data;
+}
+
+ClusterCullingView ClusterCulling::MakeView(FXMMATRIX viewProj, const XMFLOAT3& cameraPosition)
+{
+    CullingFrustum frustum = InstanceCulling::MakeFrustum(viewProj);
+
+    ClusterCullingView view;
+    std::copy(std::begin(frustum.Planes), std::end(frustum.Planes), view.FrustumPlanes);
+    view.CameraPosition = cameraPosition;
+    return view;
+}
+
+uint32_t ClusterCulling::Cull(const MeshletCullingData& data, const XMFLOAT4X4& world, const ClusterCullingView& view, uint32_t* visibleMeshlets)
+{
+    XMMATRIX worldMatrix = XMLoadFloat4x4(&world);
+
+    // Radii grow with the largest axis scale, the cone test only holds for rotations and uniform scales
+    float scaleX = XMVectorGetX(XMVector3Length(worldMatrix.r[0]));
+    float scaleY = XMVectorGetX(XMVector3Length(worldMatrix.r[1]));
+    float scaleZ = XMVectorGetX(XMVector3Length(worldMatrix.r[2]));
+    float maxScale = (std::max)(scaleX, (std::max)(scaleY, scaleZ));
+    float minScale = (std::min)(scaleX, (std::min)(scaleY, scaleZ));
+    float determinant = XMVectorGetX(XMVector3Dot(XMVector3Cross(worldMatrix.r[0], worldMatrix.r[1]), worldMatrix.r[2]));
+    bool coneCulling = determinant > 0.0f && maxScale - minScale <= maxScale * 1e-3f;
+    float invScale = maxScale > 0.0f ? 1.0f / maxScale : 0.0f;
+
+    // Every matrix and plane component splatted once, each iteration then handles 4 meshlets
+    XMVECTOR m[4][3];
+    for(int row = 0; row < 4; row++)
+    {
+        m[row][0] = XMVectorSplatX(worldMatrix.r[row]);
+        m[row][1] = XMVectorSplatY(worldMatrix.r[row]);
+        m[row][2] = XMVectorSplatZ(worldMatrix.r[row]);
+    }
+
+    XMVECTOR planes[6][4];
+    for(int p = 0; p < 6; p++)
+    {
+        XMVECTOR plane = XMLoadFloat4(&view.FrustumPlanes[p]);
+        planes[p][0] = XMVectorSplatX(plane);
+        planes[p][1] = XMVectorSplatY(plane);
+        planes[p][2] = XMVectorSplatZ(plane);
+        planes[p][3] = XMVectorSplatW(plane);
+    }
+
+    XMVECTOR cameraX = XMVectorReplicate(view.CameraPosition.x);
+    XMVECTOR cameraY = XMVectorReplicate(view.CameraPosition.y);
+    XMVECTOR cameraZ = XMVectorReplicate(view.CameraPosition.z);
+    XMVECTOR scale = XMVectorReplicate(maxScale);
+    XMVECTOR axisScale = XMVectorReplicate(invScale);
+
+    uint32_t visibleCount = 0;
+    for(uint32_t i = 0; i < data.Count; i += 4)
+    {
+        XMVECTOR centerX = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&data.CenterX[i]));
+        XMVECTOR centerY = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&data.CenterY[i]));
+        XMVECTOR centerZ = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&data.CenterZ[i]));
+        XMVECTOR radius = XMVectorMultiply(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&data.Radius[i])), scale);
+
+        XMVECTOR worldX = XMVectorMultiplyAdd(centerX, m[0][0], XMVectorMultiplyAdd(centerY, m[1][0], XMVectorMultiplyAdd(centerZ, m[2][0], m[3][0])));
+        XMVECTOR worldY = XMVectorMultiplyAdd(centerX, m[0][1], XMVectorMultiplyAdd(centerY, m[1][1], XMVectorMultiplyAdd(centerZ, m[2][1], m[3][1])));
+        XMVECTOR worldZ = XMVectorMultiplyAdd(centerX, m[0][2], XMVectorMultiplyAdd(centerY, m[1][2], XMVectorMultiplyAdd(centerZ, m[2][2], m[3][2])));
+
+        XMVECTOR visible = XMVectorTrueInt();
+        XMVECTOR negativeRadius = XMVectorNegate(radius);
+        for(int p = 0; p < 6; p++)
+        {
+            XMVECTOR distance = XMVectorMultiplyAdd(worldX, planes[p][0], XMVectorMultiplyAdd(worldY, planes[p][1], XMVectorMultiplyAdd(worldZ, planes[p][2], planes[p][3])));
+            visible = XMVectorAndInt(visible, XMVectorGreater(distance, negativeRadius));
+        }
+
+        if(coneCulling)
+        {
+            XMVECTOR axisX = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&data.ConeAxisX[i]));
+            XMVECTOR axisY = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&data.ConeAxisY[i]));
+            XMVECTOR axisZ = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&data.ConeAxisZ[i]));
+            XMVECTOR cutoff = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&data.ConeCutoff[i]));
+
+            XMVECTOR worldAxisX = XMVectorMultiply(XMVectorMultiplyAdd(axisX, m[0][0], XMVectorMultiplyAdd(axisY, m[1][0], XMVectorMultiply(axisZ, m[2][0]))), axisScale);
+            XMVECTOR worldAxisY = XMVectorMultiply(XMVectorMultiplyAdd(axisX, m[0][1], XMVectorMultiplyAdd(axisY, m[1][1], XMVectorMultiply(axisZ, m[2][1]))), axisScale);
+            XMVECTOR worldAxisZ = XMVectorMultiply(XMVectorMultiplyAdd(axisX, m[0][2], XMVectorMultiplyAdd(axisY, m[1][2], XMVectorMultiply(axisZ, m[2][2]))), axisScale);
+
+            XMVECTOR toCenterX = XMVectorSubtract(worldX, cameraX);
+            XMVECTOR toCenterY = XMVectorSubtract(worldY, cameraY);
+            XMVECTOR toCenterZ = XMVectorSubtract(worldZ, cameraZ);
+            XMVECTOR distance = XMVectorSqrt(XMVectorMultiplyAdd(toCenterX, toCenterX, XMVectorMultiplyAdd(toCenterY, toCenterY, XMVectorMultiply(toCenterZ, toCenterZ))));
+            XMVECTOR axisDot = XMVectorMultiplyAdd(toCenterX, worldAxisX, XMVectorMultiplyAdd(toCenterY, worldAxisY, XMVectorMultiply(toCenterZ, worldAxisZ)));
+
+            // Every normal of the cone faces away from any point of the sphere
+            XMVECTOR backfacing = XMVectorGreaterOrEqual(axisDot, XMVectorMultiplyAdd(cutoff, distance, radius));
+            visible = XMVectorAndCInt(visible, backfacing);
+        }
+
+        XMUINT4 mask;
+        XMStoreUInt4(&mask, visible);
+        uint32_t lanes[4] = { mask.x, mask.y, mask.z, mask.w };
+        uint32_t laneCount = (std::min)(4u, data.Count - i);
+        for(uint32_t lane = 0; lane < laneCount; lane++)
+        {
+            if(lanes[lane])
+                visibleMeshlets[visibleCount++] = i + lane;
+        }
+    }
+
+    return visibleCount;
+}
@@ -0,0 +1,59 @@
+﻿#pragma once
+#include "Core.h"
+
+// Same limits as a mesh shader path would use
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+// Below this spread the normal cone is too wide to ever cull (cos of the half angle)
+#define MESHLET_CONE_MIN_SPREAD 0.1f
+
+// Contiguous run of triangles in the primitive index buffer with its culling bounds, object space
+struct Meshlet
+{
+    DirectX::XMFLOAT3 Center; // Bounding sphere
+    float Radius;
+    DirectX::XMFLOAT3 ConeAxis; // Average triangle normal
+    float ConeCutoff; // Sine of the normal cone half angle, 1 when the cone cannot cull
+    uint32_t IndexOffset;
+    uint32_t TriangleCount;
+    uint32_t VertexCount;
+    uint32_t Padding;
+};
+
+// Meshlet bounds split per component and padded to a multiple of 4 for the SIMD culling
+struct MeshletCullingData
+{
+    std::vector<float> CenterX;
+    std::vector<float> CenterY;
+    std::vector<float> CenterZ;
+    std::vector<float> Radius;
+    std::vector<float> ConeAxisX;
+    std::vector<float> ConeAxisY;
+    std::vector<float> ConeAxisZ;
+    std::vector<float> ConeCutoff;
+    uint32_t Count = 0;
+};
+
+struct ClusterCullingView
+{
+    DirectX::XMFLOAT4 FrustumPlanes[6]; // World space, normals pointing inside
+    DirectX::XMFLOAT3 CameraPosition;
+};
+
+class MeshletBuilder
+{
+public:
+    // Greedy split of the index buffer in its current order, meshlets follow the vertex cache order and stay index ranges
+    static void Build(const float* positions, uint32_t positionStride, uint32_t vertexCount, const std::vector<uint32_t>& indices, std::vector<Meshlet>& meshlets);
+    static MeshletCullingData BuildCullingData(const std::vector<Meshlet>& meshlets);
+};
+
+class ClusterCulling
+{
+public:
+    static ClusterCullingView MakeView(DirectX::FXMMATRIX viewProj, const DirectX::XMFLOAT3& cameraPosition);
+
+    // Writes the meshlets of one instance that intersect the frustum and are not backfacing, returns their count.
+    // visibleMeshlets must hold data.Count entries.
+    static uint32_t Cull(const MeshletCullingData& data, const DirectX::XMFLOAT4X4& world, const ClusterCullingView& view, uint32_t* visibleMeshlets);
+};
@@ -0,0 +1,414 @@
+﻿#include "OcclusionCulling.h"
+#include "Jobs/JobSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+
+using namespace DirectX;
+
+namespace
+{
+    enum EdgeSide : uint32_t
+    {
+        EdgeNone = 0, // Horizontal, the triangle rows range bounds it
+        EdgeLeft,
+        EdgeRight
+    };
+
+    template<typename Function>
+    void RunParallel(uint32_t count, const Function& function)
+    {
+        if(JobSystem::Get() && count > 1)
+            JobSystem::Get()->ParallelFor(count, 1, function);
+        else
+            function(0, count);
+    }
+
+    // Bits [begin, end) set
+    uint32_t SpanMask(int32_t begin, int32_t end)
+    {
+        if(end <= begin)
+            return 0;
+        return (uint32_t)(((1ull << end) - 1) & ~((1ull << begin) - 1));
+    }
+}
+
+MaskedOcclusionBuffer::MaskedOcclusionBuffer()
+{
+    m_tiles.resize(TileCountX * TileCountY);
+    Clear(XMMatrixIdentity());
+}
+
+void MaskedOcclusionBuffer::Clear(FXMMATRIX viewProj, bool backFaces)
+{
+    XMStoreFloat4x4(&m_viewProj, viewProj);
+    m_backFaces = backFaces;
+
+    // Row vectors, the columns map world positions to clip space
+    XMMATRIX columns = XMMatrixTranspose(viewProj);
+    m_screenScale = (std::max)(XMVectorGetX(XMVector3Length(columns.r[0])) * OCCLUSION_BUFFER_WIDTH * 0.5f,
+        XMVectorGetX(XMVector3Length(columns.r[1])) * OCCLUSION_BUFFER_HEIGHT * 0.5f);
+
+    for(Tile& tile : m_tiles)
+    {
+        std::fill(std::begin(tile.Mask), std::end(tile.Mask), 0u);
+        tile.ZMax0 = 1.0f;
+        tile.ZMax1 = 0.0f;
+    }
+
+    m_occluders.clear();
+    m_triangleCount = 0;
+}
+
+void MaskedOcclusionBuffer::AddOccluder(const OccluderMesh* mesh, const XMFLOAT4X4& world)
+{
+    m_occluders.push_back({ mesh, world });
+}
+
+void MaskedOcclusionBuffer::Rasterize()
+{
+    PROFILE_FUNCTION();
+
+    uint32_t occluderCount = (uint32_t)m_occluders.size();
+    if(m_triangles.size() < occluderCount)
+    {
+        m_clipPositions.resize(occluderCount);
+        m_triangles.resize(occluderCount);
+    }
+
+    RunParallel(occluderCount, [this](uint32_t begin, uint32_t end)
+    {
+        for(uint32_t i = begin; i < end; i++)
+            SetupTriangles(m_occluders[i], m_clipPositions[i], m_triangles[i]);
+    });
+
+    // Binned in submission order so every tile row sees the occluders front to back whatever thread rasterizes it
+    for(auto& tileRow : m_tileRowTriangles)
+        tileRow.clear();
+
+    m_triangleCount = 0;
+    for(uint32_t occluder = 0; occluder < occluderCount; occluder++)
+    {
+        const auto& triangles = m_triangles[occluder];
+        for(uint32_t i = 0; i < triangles.size(); i++)
+        {
+            uint32_t rowBegin = (uint32_t)std::clamp(triangles[i].MinY, 0.0f, (float)OCCLUSION_BUFFER_HEIGHT - 1.0f) / OCCLUSION_TILE_HEIGHT;
+            uint32_t rowEnd = (uint32_t)std::clamp(triangles[i].MaxY, 0.0f, (float)OCCLUSION_BUFFER_HEIGHT - 1.0f) / OCCLUSION_TILE_HEIGHT;
+            for(uint32_t tileY = rowBegin; tileY <= rowEnd; tileY++)
+                m_tileRowTriangles[tileY].push_back({ occluder, i });
+        }
+        m_triangleCount += (uint32_t)triangles.size();
+    }
+
+    RunParallel(TileCountY, [this](uint32_t begin, uint32_t end)
+    {
+        for(uint32_t tileY = begin; tileY < end; tileY++)
+            RasterizeTileRow(tileY);
+    });
+}
+
+float MaskedOcclusionBuffer::GetScreenRadius(FXMVECTOR center, float radius) const
+{
+    // Perspective divide by the center depth, anything around or behind the eye counts as covering the screen
+    float w = XMVectorGetW(XMVector3Transform(center, XMLoadFloat4x4(&m_viewProj)));
+    return radius * m_screenScale / (std::max)(w, 1e-4f);
+}
+
+bool MaskedOcclusionBuffer::IsVisible(FXMVECTOR center, FXMVECTOR extent) const
+{
+    XMMATRIX viewProj = XMLoadFloat4x4(&m_viewProj);
+    XMVECTOR clipCenter = XMVector3Transform(center, viewProj);
+    XMVECTOR axisX = XMVectorMultiply(XMVectorSplatX(extent), viewProj.r[0]);
+    XMVECTOR axisY = XMVectorMultiply(XMVectorSplatY(extent), viewProj.r[1]);
+    XMVECTOR axisZ = XMVectorMultiply(XMVectorSplatZ(extent), viewProj.r[2]);
+
+    // Screen rectangle and nearest depth of the 8 projected corners
+    XMVECTOR clipMin = XMVectorReplicate(FLT_MAX);
+    XMVECTOR ndcMin = XMVectorReplicate(FLT_MAX);
+    XMVECTOR ndcMax = XMVectorReplicate(-FLT_MAX);
+    for(uint32_t corner = 0; corner < 8; corner++)
+    {
+        XMVECTOR clip = XMVectorAdd(clipCenter, (corner & 1) ? axisX : XMVectorNegate(axisX));
+        clip = XMVectorAdd(clip, (corner & 2) ? axisY : XMVectorNegate(axisY));
+        clip = XMVectorAdd(clip, (corner & 4) ? axisZ : XMVectorNegate(axisZ));
+        XMVECTOR ndc = XMVectorDivide(clip, XMVectorSplatW(clip));
+        clipMin = XMVectorMin(clipMin, clip);
+        ndcMin = XMVectorMin(ndcMin, ndc);
+        ndcMax = XMVectorMax(ndcMax, ndc);
+    }
+
+    // Crossing the near plane, the projection is not bounded
+    if(XMVectorGetZ(clipMin) < 0.0f)
+        return true;
+
+    XMFLOAT3 boxMin;
+    XMFLOAT3 boxMax;
+    XMStoreFloat3(&boxMin, ndcMin);
+    XMStoreFloat3(&boxMax, ndcMax);
+
+    // Every pixel the rectangle touches, clamped before the conversion
+    auto ToPixels = [](float ndc, float scale, float size) { return std::clamp(ndc * scale + 0.5f, 0.0f, 1.0f) * size; };
+    int32_t x0 = (int32_t)floorf(ToPixels(boxMin.x, 0.5f, OCCLUSION_BUFFER_WIDTH));
+    int32_t x1 = (int32_t)ceilf(ToPixels(boxMax.x, 0.5f, OCCLUSION_BUFFER_WIDTH));
+    int32_t y0 = (int32_t)floorf(ToPixels(boxMax.y, -0.5f, OCCLUSION_BUFFER_HEIGHT));
+    int32_t y1 = (int32_t)ceilf(ToPixels(boxMin.y, -0.5f, OCCLUSION_BUFFER_HEIGHT));
+    if(x0 >= x1 || y0 >= y1)
+        return true;
+
+    float z = boxMin.z - OCCLUSION_DEPTH_BIAS;
+    for(int32_t tileY = y0 / OCCLUSION_TILE_HEIGHT; tileY <= (y1 - 1) / OCCLUSION_TILE_HEIGHT; tileY++)
+    {
+        int32_t rowBegin = (std::max)(y0 - tileY * OCCLUSION_TILE_HEIGHT, 0);
+        int32_t rowEnd = (std::min)(y1 - tileY * OCCLUSION_TILE_HEIGHT, OCCLUSION_TILE_HEIGHT);
+        for(int32_t tileX = x0 / OCCLUSION_TILE_WIDTH; tileX <= (x1 - 1) / OCCLUSION_TILE_WIDTH; tileX++)
+        {
+            const Tile& tile = m_tiles[tileY * TileCountX + tileX];
+            if(z > tile.ZMax0)
+                continue;
+            if(z <= tile.ZMax1)
+                return true;
+
+            // In front of the far layer, only the masked pixels hide it
+            uint32_t columns = SpanMask((std::max)(x0 - tileX * OCCLUSION_TILE_WIDTH, 0), (std::min)(x1 - tileX * OCCLUSION_TILE_WIDTH, OCCLUSION_TILE_WIDTH));
+            for(int32_t row = rowBegin; row < rowEnd; row++)
+            {
+                if(columns & ~tile.Mask[row])
+                    return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+uint32_t MaskedOcclusionBuffer::Cull(const InstanceBounds& bounds, uint32_t begin, uint32_t end, uint8_t viewBit, uint8_t* visibility) const
+{
+    uint32_t occludedCount = 0;
+    for(uint32_t i = begin; i < end; i++)
+    {
+        if(!(visibility[i] & viewBit))
+            continue;
+
+        XMVECTOR center = XMVectorSet(bounds.CenterX[i], bounds.CenterY[i], bounds.CenterZ[i], 1.0f);
+        XMVECTOR extent = XMVectorSet(bounds.ExtentX[i], bounds.ExtentY[i], bounds.ExtentZ[i], 0.0f);
+        if(!IsVisible(center, extent))
+        {
+            visibility[i] &= ~viewBit;
+            occludedCount++;
+        }
+    }
+    return occludedCount;
+}
+
+void MaskedOcclusionBuffer::ResolveDepth(float* depth) const
+{
+    for(uint32_t y = 0; y < OCCLUSION_BUFFER_HEIGHT; y++)
+    {
+        for(uint32_t x = 0; x < OCCLUSION_BUFFER_WIDTH; x++)
+        {
+            const Tile& tile = m_tiles[(y / OCCLUSION_TILE_HEIGHT) * TileCountX + x / OCCLUSION_TILE_WIDTH];
+            bool masked = (tile.Mask[y % OCCLUSION_TILE_HEIGHT] >> (x % OCCLUSION_TILE_WIDTH)) & 1;
+            depth[y * OCCLUSION_BUFFER_WIDTH + x] = masked ? (std::min)(tile.ZMax1, tile.ZMax0) : tile.ZMax0;
+        }
+    }
+}
+
+void MaskedOcclusionBuffer::SetupTriangles(const QueuedOccluder& occluder, std::vector<XMFLOAT4>& clipPositions, std::vector<Triangle>& triangles) const
+{
+    const OccluderMesh& mesh = *occluder.Mesh;
+    XMMATRIX worldViewProj = XMMatrixMultiply(XMLoadFloat4x4(&occluder.World), XMLoadFloat4x4(&m_viewProj));
+
+    clipPositions.resize(mesh.Positions.size());
+    for(size_t i = 0; i < mesh.Positions.size(); i++)
+        XMStoreFloat4(&clipPositions[i], XMVector3Transform(XMLoadFloat3(&mesh.Positions[i]), worldViewProj));
+
+    triangles.clear();
+    for(size_t i = 0; i + 2 < mesh.Indices.size(); i += 3)
+    {
+        const XMFLOAT4* vertices[3] = { &clipPositions[mesh.Indices[i]], &clipPositions[mesh.Indices[i + 1]], &clipPositions[mesh.Indices[i + 2]] };
+        uint32_t insideCount = (vertices[0]->z >= 0.0f) + (vertices[1]->z >= 0.0f) + (vertices[2]->z >= 0.0f);
+        if(insideCount == 3)
+        {
+            SetupTriangle(*vertices[0], *vertices[1], *vertices[2], triangles);
+            continue;
+        }
+        if(insideCount == 0)
+            continue;
+
+        // Clipped against the near plane (z >= 0 in D3D clip space), the remaining polygon is drawn as a fan
+        XMFLOAT4 polygon[4];
+        uint32_t polygonSize = 0;
+        for(uint32_t edge = 0; edge < 3; edge++)
+        {
+            const XMFLOAT4& current = *vertices[edge];
+            const XMFLOAT4& next = *vertices[(edge + 1) % 3];
+            if(current.z >= 0.0f)
+                polygon[polygonSize++] = current;
+            if((current.z >= 0.0f) != (next.z >= 0.0f))
+            {
+                float t = current.z / (current.z - next.z);
+                XMStoreFloat4(&polygon[polygonSize++], XMVectorLerp(XMLoadFloat4(&current), XMLoadFloat4(&next), t));
+            }
+        }
+
+        for(uint32_t vertex = 1; vertex + 1 < polygonSize; vertex++)
+            SetupTriangle(polygon[0], polygon[vertex], polygon[vertex + 1], triangles);
+    }
+}
+
+void MaskedOcclusionBuffer::SetupTriangle(const XMFLOAT4& v0, const XMFLOAT4& v1, const XMFLOAT4& v2, std::vector<Triangle>& triangles) const
+{
+    const XMFLOAT4* clip[3] = { &v0, &v1, &v2 };
+    float x[3];
+    float y[3];
+    float z[3];
+    for(int i = 0; i < 3; i++)
+    {
+        float invW = 1.0f / clip[i]->w;
+        x[i] = (clip[i]->x * invW * 0.5f + 0.5f) * OCCLUSION_BUFFER_WIDTH;
+        y[i] = (0.5f - clip[i]->y * invW * 0.5f) * OCCLUSION_BUFFER_HEIGHT;
+        z[i] = clip[i]->z * invW;
+    }
+
+    // Positive when clockwise on screen (y down), front faces are the counter clockwise ones
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if(m_backFaces ? area <= 0.0f : area >= 0.0f)
+        return;
+    if(fabsf(area) < 1e-6f)
+        return;
+
+    // Made clockwise, edges going down then bound the covered spans on the right
+    if(area < 0.0f)
+    {
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        std::swap(z[1], z[2]);
+        area = -area;
+    }
+
+    Triangle triangle;
+    triangle.MinX = (std::min)({ x[0], x[1], x[2] });
+    triangle.MaxX = (std::max)({ x[0], x[1], x[2] });
+    triangle.MinY = (std::min)({ y[0], y[1], y[2] });
+    triangle.MaxY = (std::max)({ y[0], y[1], y[2] });
+    if(triangle.MaxX <= 0.0f || triangle.MinX >= OCCLUSION_BUFFER_WIDTH || triangle.MaxY <= 0.0f || triangle.MinY >= OCCLUSION_BUFFER_HEIGHT)
+        return;
+
+    for(int edge = 0; edge < 3; edge++)
+    {
+        int next = (edge + 1) % 3;
+        float dy = y[next] - y[edge];
+        triangle.EdgeSide[edge] = dy == 0.0f ? EdgeNone : (dy > 0.0f ? EdgeRight : EdgeLeft);
+        triangle.EdgeSlope[edge] = dy == 0.0f ? 0.0f : (x[next] - x[edge]) / dy;
+        triangle.EdgeX[edge] = x[edge] - triangle.EdgeSlope[edge] * y[edge];
+    }
+
+    // z / w is affine in screen space
+    triangle.ZDx = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+    triangle.ZDy = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+    triangle.Z = z[0] - triangle.ZDx * x[0] - triangle.ZDy * y[0];
+    triangle.ZMax = (std::max)({ z[0], z[1], z[2] });
+
+    triangles.push_back(triangle);
+}
+
+void MaskedOcclusionBuffer::RasterizeTileRow(uint32_t tileY)
+{
+    float rowTop = (float)(tileY * OCCLUSION_TILE_HEIGHT);
+    XMVECTOR rowCenters[2] = {
+        XMVectorSet(rowTop + 0.5f, rowTop + 1.5f, rowTop + 2.5f, rowTop + 3.5f),
+        XMVectorSet(rowTop + 4.5f, rowTop + 5.5f, rowTop + 6.5f, rowTop + 7.5f)
+    };
+    XMVECTOR halfPixel = XMVectorReplicate(0.5f);
+    XMVECTOR bufferWidth = XMVectorReplicate((float)OCCLUSION_BUFFER_WIDTH);
+
+    for(const TriangleRef& ref : m_tileRowTriangles[tileY])
+    {
+        const Triangle& triangle = m_triangles[ref.Occluder][ref.Triangle];
+
+        // Covered pixels [start, end) of the 8 rows, pixel centers inside every edge, 4 rows at a time
+        XMFLOAT4 spanStarts[2];
+        XMFLOAT4 spanEnds[2];
+        for(int half = 0; half < 2; half++)
+        {
+            XMVECTOR left = XMVectorZero();
+            XMVECTOR right = bufferWidth;
+            for(int edge = 0; edge < 3; edge++)
+            {
+                if(triangle.EdgeSide[edge] == EdgeNone)
+                    continue;
+
+                XMVECTOR edgeX = XMVectorMultiplyAdd(rowCenters[half], XMVectorReplicate(triangle.EdgeSlope[edge]), XMVectorReplicate(triangle.EdgeX[edge]));
+                if(triangle.EdgeSide[edge] == EdgeLeft)
+                    left = XMVectorMax(left, edgeX);
+                else
+                    right = XMVectorMin(right, edgeX);
+            }
+
+            XMVECTOR inside = XMVectorAndInt(XMVectorGreaterOrEqual(rowCenters[half], XMVectorReplicate(triangle.MinY)),
+                XMVectorLessOrEqual(rowCenters[half], XMVectorReplicate(triangle.MaxY)));
+            XMVECTOR start = XMVectorClamp(XMVectorCeiling(XMVectorSubtract(left, halfPixel)), XMVectorZero(), bufferWidth);
+            XMVECTOR end = XMVectorClamp(XMVectorCeiling(XMVectorSubtract(right, halfPixel)), XMVectorZero(), bufferWidth);
+            XMStoreFloat4(&spanStarts[half], start);
+            XMStoreFloat4(&spanEnds[half], XMVectorSelect(XMVectorZero(), end, inside));
+        }
+
+        int32_t starts[OCCLUSION_TILE_HEIGHT] = { (int32_t)spanStarts[0].x, (int32_t)spanStarts[0].y, (int32_t)spanStarts[0].z, (int32_t)spanStarts[0].w,
+            (int32_t)spanStarts[1].x, (int32_t)spanStarts[1].y, (int32_t)spanStarts[1].z, (int32_t)spanStarts[1].w };
+        int32_t ends[OCCLUSION_TILE_HEIGHT] = { (int32_t)spanEnds[0].x, (int32_t)spanEnds[0].y, (int32_t)spanEnds[0].z, (int32_t)spanEnds[0].w,
+            (int32_t)spanEnds[1].x, (int32_t)spanEnds[1].y, (int32_t)spanEnds[1].z, (int32_t)spanEnds[1].w };
+
+        uint32_t tileBegin = (uint32_t)std::clamp(triangle.MinX, 0.0f, (float)OCCLUSION_BUFFER_WIDTH - 1.0f) / OCCLUSION_TILE_WIDTH;
+        uint32_t tileEnd = (uint32_t)std::clamp(triangle.MaxX, 0.0f, (float)OCCLUSION_BUFFER_WIDTH - 1.0f) / OCCLUSION_TILE_WIDTH;
+        for(uint32_t tileX = tileBegin; tileX <= tileEnd; tileX++)
+        {
+            int32_t tileLeft = (int32_t)(tileX * OCCLUSION_TILE_WIDTH);
+            uint32_t mask[OCCLUSION_TILE_HEIGHT];
+            uint32_t covered = 0;
+            for(int row = 0; row < OCCLUSION_TILE_HEIGHT; row++)
+            {
+                mask[row] = SpanMask((std::max)(starts[row] - tileLeft, 0), (std::min)(ends[row] - tileLeft, OCCLUSION_TILE_WIDTH));
+                covered |= mask[row];
+            }
+            if(covered == 0)
+                continue;
+
+            // Farthest depth of the triangle plane over the part of the tile its bounds overlap, a linear function peaks at a corner
+            float rectX0 = (std::max)((float)tileLeft, triangle.MinX);
+            float rectX1 = (std::min)((float)(tileLeft + OCCLUSION_TILE_WIDTH), triangle.MaxX);
+            float rectY0 = (std::max)(rowTop, triangle.MinY);
+            float rectY1 = (std::min)(rowTop + OCCLUSION_TILE_HEIGHT, triangle.MaxY);
+            float z = triangle.Z + triangle.ZDx * (triangle.ZDx > 0.0f ? rectX1 : rectX0) + triangle.ZDy * (triangle.ZDy > 0.0f ? rectY1 : rectY0);
+            UpdateTile(m_tiles[tileY * TileCountX + tileX], mask, (std::min)(z, triangle.ZMax));
+        }
+    }
+}
+
+void MaskedOcclusionBuffer::UpdateTile(Tile& tile, const uint32_t* mask, float z)
+{
+    if(z >= tile.ZMax0)
+        return;
+
+    // Much nearer than the working layer : starting a new layer keeps the tighter depth instead of pushing the old one back
+    if(tile.ZMax1 - z > tile.ZMax0 - tile.ZMax1)
+    {
+        std::fill(std::begin(tile.Mask), std::end(tile.Mask), 0u);
+        tile.ZMax1 = 0.0f;
+    }
+
+    tile.ZMax1 = (std::max)(tile.ZMax1, z);
+    uint32_t full = ~0u;
+    for(int row = 0; row < OCCLUSION_TILE_HEIGHT; row++)
+    {
+        tile.Mask[row] |= mask[row];
+        full &= tile.Mask[row];
+    }
+
+    // Fully covered, the working layer becomes the whole tile depth
+    if(full == ~0u)
+    {
+        tile.ZMax0 = tile.ZMax1;
+        tile.ZMax1 = 0.0f;
+        std::fill(std::begin(tile.Mask), std::end(tile.Mask), 0u);
+    }
+}
@@ -0,0 +1,107 @@
+﻿#pragma once
+#include "Core.h"
+#include "InstanceCulling.h"
+
+// CPU depth buffer size in pixels, a multiple of the tile size. Tiles are 32x8 pixels, one 32 bits coverage mask per row.
+#define OCCLUSION_BUFFER_WIDTH 320
+#define OCCLUSION_BUFFER_HEIGHT 192
+#define OCCLUSION_TILE_WIDTH 32
+#define OCCLUSION_TILE_HEIGHT 8
+// Occluders rasterized per view each frame, the largest on screen are picked
+#define OCCLUSION_MAX_OCCLUDERS 64
+// Smallest bounding sphere radius on screen, in buffer pixels, for an instance to be picked as occluder
+#define OCCLUSION_MIN_OCCLUDER_RADIUS 8.0f
+// Tested boxes are moved this much nearer in NDC depth, a box never hides behind its own faces because of rounding
+#define OCCLUSION_DEPTH_BIAS 1e-6f
+
+// Cook time proxy : triangle count aimed for, the proxy is dropped when the error bound stops it above the max count.
+// The error is relative to the primitive bounds diagonal, a proxy never sticks out of the source surface by more than that.
+#define OCCLUDER_TRIANGLE_COUNT 256
+#define OCCLUDER_MAX_TRIANGLE_COUNT 1024
+#define OCCLUDER_MAX_ERROR 0.01f
+
+// Low poly stand in of a mesh, all primitives merged
+struct OccluderMesh
+{
+    std::vector<DirectX::XMFLOAT3> Positions; // Object space
+    std::vector<uint32_t> Indices;
+};
+
+// Masked software occlusion culling (Andersson et al.) : per tile, a far depth holding for the whole tile and a nearer one
+// holding for the pixels of a coverage mask. Both are conservative, a box is hidden when it lies behind them on every pixel it covers.
+// No GPU resource involved, it runs headless. The job system is used when there is one, results do not depend on the worker count.
+class MaskedOcclusionBuffer
+{
+public:
+    MaskedOcclusionBuffer();
+
+    // Resets to the far plane. Front faces are counter clockwise on screen like the GPU pipelines,
+    // backFaces rasterizes the other ones for views drawn with front face culling (shadows).
+    void Clear(DirectX::FXMMATRIX viewProj, bool backFaces = false);
+    // Queued, rasterized in submission order : front to back gives the tightest depths
+    void AddOccluder(const OccluderMesh* mesh, const DirectX::XMFLOAT4X4& world);
+    // Transforms and clips the occluders in parallel then rasterizes the tile rows in parallel
+    void Rasterize();
+
+    // Bounding sphere radius on screen in buffer pixels, used to rank the occluders
+    float GetScreenRadius(DirectX::FXMVECTOR center, float radius) const;
+    // False when the world space box is behind the occluders on every pixel it covers. Thread safe once Rasterize returned.
+    bool IsVisible(DirectX::FXMVECTOR center, DirectX::FXMVECTOR extent) const;
+    // Clears viewBit on the instances of [begin, end) hidden by the occluders, returns how many were
+    uint32_t Cull(const InstanceBounds& bounds, uint32_t begin, uint32_t end, uint8_t viewBit, uint8_t* visibility) const;
+
+    // Per pixel farthest depth the occluders can be at, row major OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT
+    void ResolveDepth(float* depth) const;
+    uint32_t GetOccluderCount() const { return (uint32_t)m_occluders.size(); }
+    uint32_t GetTriangleCount() const { return m_triangleCount; }
+
+private:
+    static constexpr uint32_t TileCountX = OCCLUSION_BUFFER_WIDTH / OCCLUSION_TILE_WIDTH;
+    static constexpr uint32_t TileCountY = OCCLUSION_BUFFER_HEIGHT / OCCLUSION_TILE_HEIGHT;
+
+    struct Tile
+    {
+        uint32_t Mask[OCCLUSION_TILE_HEIGHT]; // Pixels under ZMax1
+        float ZMax0; // Whole tile
+        float ZMax1;
+    };
+
+    // Screen space, pixels with y down. Edges are lines x = X + Slope * y bounding the triangle on the left or on the right.
+    struct Triangle
+    {
+        float EdgeX[3];
+        float EdgeSlope[3];
+        uint32_t EdgeSide[3];
+        float MinX, MinY, MaxX, MaxY;
+        float Z, ZDx, ZDy; // Depth plane, z = Z + ZDx * x + ZDy * y
+        float ZMax;
+    };
+
+    struct QueuedOccluder
+    {
+        const OccluderMesh* Mesh;
+        DirectX::XMFLOAT4X4 World;
+    };
+
+    struct TriangleRef
+    {
+        uint32_t Occluder;
+        uint32_t Triangle;
+    };
+
+    void SetupTriangles(const QueuedOccluder& occluder, std::vector<DirectX::XMFLOAT4>& clipPositions, std::vector<Triangle>& triangles) const;
+    void SetupTriangle(const DirectX::XMFLOAT4& v0, const DirectX::XMFLOAT4& v1, const DirectX::XMFLOAT4& v2, std::vector<Triangle>& triangles) const;
+    void RasterizeTileRow(uint32_t tileY);
+    void UpdateTile(Tile& tile, const uint32_t* mask, float z);
+
+    DirectX::XMFLOAT4X4 m_viewProj;
+    float m_screenScale = 0.0f; // Buffer pixels per world unit at w = 1
+    bool m_backFaces = false;
+    std::vector<Tile> m_tiles;
+
+    std::vector<QueuedOccluder> m_occluders;
+    std::vector<std::vector<DirectX::XMFLOAT4>> m_clipPositions; // Per occluder
+    std::vector<std::vector<Triangle>> m_triangles;
+    std::vector<TriangleRef> m_tileRowTriangles[TileCountY]; // In submission order
+    uint32_t m_triangleCount = 0;
+};
@@ -0,0 +1,421 @@
+﻿#include "RenderGraph.h"
+#include <algorithm>
+
+// Placement alignments are powers of two
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+    return alignment > 1 ? (value + alignment - 1) & ~(alignment - 1) : value;
+}
+
+void RenderGraph::Reset()
+{
+    m_passes.clear();
+    m_resources.clear();
+    m_accesses.clear();
+    m_passOrder.clear();
+    m_batches.clear();
+    m_barriers.clear();
+    m_stats = {};
+    m_arena.Reset();
+}
+
+uint32_t RenderGraph::ImportTexture(const char* name, const std::shared_ptr<Texture>& texture)
+{
+    return ImportTexture(name, texture, texture->GetState());
+}
+
+uint32_t RenderGraph::ImportTexture(const char* name, const std::shared_ptr<Texture>& texture, D3D12_RESOURCE_STATES state)
+{
+    Resource& resource = m_resources.emplace_back();
+    resource.Name = name;
+    resource.Texture = texture;
+    resource.Imported = true;
+    resource.InitialState = state;
+    return (uint32_t)m_resources.size() - 1;
+}
+
+uint32_t RenderGraph::CreateTexture(const char* name, const RenderGraphTextureDesc& desc)
+{
+    Resource& resource = m_resources.emplace_back();
+    resource.Name = name;
+    resource.Desc = desc;
+    return (uint32_t)m_resources.size() - 1;
+}
+
+void RenderGraph::MarkOutput(uint32_t resource, D3D12_RESOURCE_STATES finalState)
+{
+    m_resources[resource].Output = true;
+    m_resources[resource].FinalState = finalState;
+}
+
+uint32_t RenderGraph::AddPass(const char* name, PassExecute execute, const void* callback, bool sideEffect)
+{
+    Pass& pass = m_passes.emplace_back();
+    pass.Name = name;
+    pass.Execute = execute;
+    pass.Callback = callback;
+    pass.SideEffect = sideEffect;
+    return (uint32_t)m_passes.size() - 1;
+}
+
+void RenderGraph::Read(uint32_t pass, uint32_t resource, D3D12_RESOURCE_STATES state)
+{
+    m_accesses.push_back({ pass, resource, state, false, false, state });
+}
+
+void RenderGraph::Write(uint32_t pass, uint32_t resource, D3D12_RESOURCE_STATES state)
+{
+    m_accesses.push_back({ pass, resource, state, true, false, state });
+}
+
+void RenderGraph::Compile()
+{
+    PROFILE_FUNCTION();
+
+    m_passOrder.clear();
+    m_batches.clear();
+    m_barriers.clear();
+    m_stats = {};
+
+    BuildAccessLists();
+    CullPasses();
+    SortPasses();
+    PlaceTransients();
+    ComputeBarriers();
+
+    m_stats.PassCount = (uint32_t)m_passOrder.size();
+    m_stats.CulledPassCount = (uint32_t)m_passes.size() - m_stats.PassCount;
+    m_stats.BatchCount = (uint32_t)m_batches.size();
+    m_stats.BarrierCount = (uint32_t)m_barriers.size();
+}
+
+void RenderGraph::BuildAccessLists()
+{
+    // Counting sorts by pass then by resource, so the accesses of a resource are in pass declaration order
+    m_passFirst.assign(m_passes.size() + 1, 0);
+    m_resourceFirst.assign(m_resources.size() + 1, 0);
+    for(const Access& access : m_accesses)
+    {
+        m_passFirst[access.Pass + 1]++;
+        m_resourceFirst[access.Resource + 1]++;
+    }
+    for(size_t p = 0; p < m_passes.size(); p++)
+        m_passFirst[p + 1] += m_passFirst[p];
+    for(size_t r = 0; r < m_resources.size(); r++)
+        m_resourceFirst[r + 1] += m_resourceFirst[r];
+
+    m_passAccesses.resize(m_accesses.size());
+    m_stack.assign(m_passFirst.begin(), m_passFirst.end() - 1);
+    for(uint32_t i = 0; i < m_accesses.size(); i++)
+        m_passAccesses[m_stack[m_accesses[i].Pass]++] = i;
+
+    m_resourceAccesses.resize(m_accesses.size());
+    m_stack.assign(m_resourceFirst.begin(), m_resourceFirst.end() - 1);
+    for(uint32_t i : m_passAccesses)
+        m_resourceAccesses[m_stack[m_accesses[i].Resource]++] = i;
+
+    for(Access& access : m_accesses)
+    {
+        access.Feedback = false;
+        if(access.Write)
+            continue;
+
+        for(uint32_t i = m_passFirst[access.Pass]; i < m_passFirst[access.Pass + 1]; i++)
+        {
+            const Access& other = m_accesses[m_passAccesses[i]];
+            if(other.Write && other.Resource == access.Resource)
+                access.Feedback = true;
+        }
+    }
+}
+
+void RenderGraph::CullPasses()
+{
+    // A pass lives while one of the resources it writes is read or is an output, a resource while one of its readers lives
+    for(Pass& pass : m_passes)
+    {
+        pass.Culled = false;
+        pass.RefCount = 0;
+    }
+    for(Resource& resource : m_resources)
+        resource.RefCount = resource.Output ? 1 : 0;
+
+    for(const Access& access : m_accesses)
+    {
+        if(access.Write)
+            m_passes[access.Pass].RefCount++;
+        else if(!access.Feedback)
+            m_resources[access.Resource].RefCount++;
+    }
+
+    auto cull = [&](uint32_t p)
+    {
+        m_passes[p].Culled = true;
+        for(uint32_t i = m_passFirst[p]; i < m_passFirst[p + 1]; i++)
+        {
+            const Access& access = m_accesses[m_passAccesses[i]];
+            if(!access.Write && !access.Feedback && --m_resources[access.Resource].RefCount == 0)
+                m_stack.push_back(access.Resource);
+        }
+    };
+
+    m_stack.clear();
+    for(uint32_t p = 0; p < m_passes.size(); p++)
+    {
+        if(m_passes[p].RefCount == 0 && !m_passes[p].SideEffect)
+            cull(p);
+    }
+    m_stack.clear();
+    for(uint32_t r = 0; r < m_resources.size(); r++)
+    {
+        if(m_resources[r].RefCount == 0)
+            m_stack.push_back(r);
+    }
+
+    while(!m_stack.empty())
+    {
+        uint32_t r = m_stack.back();
+        m_stack.pop_back();
+
+        for(uint32_t i = m_resourceFirst[r]; i < m_resourceFirst[r + 1]; i++)
+        {
+            const Access& access = m_accesses[m_resourceAccesses[i]];
+            Pass& pass = m_passes[access.Pass];
+            if(access.Write && !pass.Culled && --pass.RefCount == 0 && !pass.SideEffect)
+                cull(access.Pass);
+        }
+    }
+}
+
+void RenderGraph::SortPasses()
+{
+    // A pass runs one level after the passes it depends on : the last write of what it reads, and for what it writes,
+    // the last write and the reads since. Passes of one level are independent, sorted by level then declaration order.
+    m_lastWriterLevels.assign(m_resources.size(), 0);
+    m_lastReaderLevels.assign(m_resources.size(), 0);
+    m_levelCounts.clear();
+
+    for(uint32_t p = 0; p < m_passes.size(); p++)
+    {
+        Pass& pass = m_passes[p];
+        if(pass.Culled)
+            continue;
+
+        uint32_t level = 0;
+        for(uint32_t i = m_passFirst[p]; i < m_passFirst[p + 1]; i++)
+        {
+            const Access& access = m_accesses[m_passAccesses[i]];
+            level = (std::max)(level, m_lastWriterLevels[access.Resource]);
+            if(access.Write)
+                level = (std::max)(level, m_lastReaderLevels[access.Resource]);
+        }
+        pass.Level = level;
+
+        for(uint32_t i = m_passFirst[p]; i < m_passFirst[p + 1]; i++)
+        {
+            const Access& access = m_accesses[m_passAccesses[i]];
+            if(access.Write)
+            {
+                m_lastWriterLevels[access.Resource] = level + 1;
+                m_lastReaderLevels[access.Resource] = 0;
+            }
+        }
+        for(uint32_t i = m_passFirst[p]; i < m_passFirst[p + 1]; i++)
+        {
+            const Access& access = m_accesses[m_passAccesses[i]];
+            if(!access.Write && !access.Feedback)
+                m_lastReaderLevels[access.Resource] = (std::max)(m_lastReaderLevels[access.Resource], level + 1);
+        }
+
+        if(m_levelCounts.size() <= level)
+            m_levelCounts.resize(level + 1, 0);
+        m_levelCounts[level]++;
+    }
+
+    m_batches.resize(m_levelCounts.size());
+    uint32_t first = 0;
+    for(size_t level = 0; level < m_levelCounts.size(); level++)
+    {
+        m_batches[level] = { first, 0, 0, 0 };
+        first += m_levelCounts[level];
+    }
+
+    m_passOrder.resize(first);
+    for(uint32_t p = 0; p < m_passes.size(); p++)
+    {
+        if(m_passes[p].Culled)
+            continue;
+
+        RenderGraphBatch& batch = m_batches[m_passes[p].Level];
+        m_passOrder[batch.FirstPass + batch.PassCount++] = p;
+    }
+}
+
+void RenderGraph::PlaceTransients()
+{
+    // Greedy interval packing : biggest first, each at the lowest offset free of the transients alive in the same levels
+    m_transients.clear();
+    for(uint32_t r = 0; r < m_resources.size(); r++)
+    {
+        Resource& resource = m_resources[r];
+        resource.FirstLevel = RENDER_GRAPH_INVALID;
+        resource.LastLevel = 0;
+        resource.HeapOffset = RENDER_GRAPH_INVALID;
+        resource.Aliases = false;
+
+        for(uint32_t i = m_resourceFirst[r]; i < m_resourceFirst[r + 1]; i++)
+        {
+            const Pass& pass = m_passes[m_accesses[m_resourceAccesses[i]].Pass];
+            if(pass.Culled)
+                continue;
+
+            resource.FirstLevel = (std::min)(resource.FirstLevel, pass.Level);
+            resource.LastLevel = (std::max)(resource.LastLevel, pass.Level);
+        }
+
+        if(!resource.Imported && resource.FirstLevel != RENDER_GRAPH_INVALID)
+            m_transients.push_back(r);
+    }
+
+    std::sort(m_transients.begin(), m_transients.end(), [&](uint32_t a, uint32_t b)
+    {
+        if(m_resources[a].Desc.Size != m_resources[b].Desc.Size)
+            return m_resources[a].Desc.Size > m_resources[b].Desc.Size;
+        return a < b;
+    });
+
+    uint64_t heapSize = 0;
+    m_placed.clear();
+    for(uint32_t r : m_transients)
+    {
+        Resource& resource = m_resources[r];
+
+        // Every alive transient before the cursor ends at or before it
+        uint64_t offset = 0;
+        for(const Placement& other : m_placed)
+        {
+            if(other.FirstLevel > resource.LastLevel || resource.FirstLevel > other.LastLevel)
+                continue;
+            if(offset + resource.Desc.Size <= other.Offset)
+                break;
+            if(other.End > offset)
+                offset = AlignUp(other.End, resource.Desc.Alignment);
+        }
+        Placement placement = { offset, 0, resource.FirstLevel, resource.LastLevel, r };
+        placement.End = placement.Offset + resource.Desc.Size;
+        resource.HeapOffset = placement.Offset;
+        heapSize = (std::max)(heapSize, placement.End);
+
+        // Sharing memory with a transient, the one used last in the frame needs an aliasing barrier
+        for(const Placement& other : m_placed)
+        {
+            if(other.Offset >= placement.End)
+                break;
+            if(other.End <= placement.Offset)
+                continue;
+
+            resource.Aliases |= other.LastLevel < resource.FirstLevel;
+            m_resources[other.Resource].Aliases |= resource.LastLevel < other.FirstLevel;
+        }
+
+        auto position = std::upper_bound(m_placed.begin(), m_placed.end(), placement.Offset,
+            [](uint64_t offset, const Placement& other) { return offset < other.Offset; });
+        m_placed.insert(position, placement);
+
+        m_stats.TransientSize += resource.Desc.Size;
+    }
+
+    m_stats.TransientCount = (uint32_t)m_transients.size();
+    m_stats.TransientHeapSize = heapSize;
+}
+
+void RenderGraph::ComputeBarriers()
+{
+    // The reads between two writes share the combined state, the first of them transitions to it
+    for(uint32_t r = 0; r < m_resources.size(); r++)
+    {
+        uint32_t runStart = m_resourceFirst[r];
+        D3D12_RESOURCE_STATES runState = D3D12_RESOURCE_STATE_COMMON;
+        for(uint32_t i = m_resourceFirst[r]; i <= m_resourceFirst[r + 1]; i++)
+        {
+            const Access* access = i < m_resourceFirst[r + 1] ? &m_accesses[m_resourceAccesses[i]] : nullptr;
+            if(access && m_passes[access->Pass].Culled)
+                continue;
+
+            if(!access || access->Write || access->Feedback)
+            {
+                for(uint32_t j = runStart; j < i; j++)
+                {
+                    Access& read = m_accesses[m_resourceAccesses[j]];
+                    if(!read.Write && !read.Feedback)
+                        read.BarrierState = runState;
+                }
+                runStart = i + 1;
+                runState = D3D12_RESOURCE_STATE_COMMON;
+                continue;
+            }
+
+            runState |= access->State;
+        }
+    }
+
+    m_states.resize(m_resources.size());
+    m_defined.resize(m_resources.size());
+    m_lastBatches.resize(m_resources.size());
+    for(uint32_t r = 0; r < m_resources.size(); r++)
+    {
+        m_states[r] = m_resources[r].InitialState;
+        m_defined[r] = m_resources[r].Imported;
+        m_lastBatches[r] = RENDER_GRAPH_INVALID;
+    }
+
+    auto beginBatch = [this](uint32_t resource, uint32_t batch)
+    {
+        uint32_t lastBatch = m_lastBatches[resource];
+        if(lastBatch == RENDER_GRAPH_INVALID || lastBatch + 1 >= batch)
+            return RENDER_GRAPH_INVALID;
+        m_stats.SplitBarrierCount++;
+        return lastBatch;
+    };
+
+    for(uint32_t b = 0; b < m_batches.size(); b++)
+    {
+        RenderGraphBatch& batch = m_batches[b];
+        batch.FirstBarrier = (uint32_t)m_barriers.size();
+        for(uint32_t p = batch.FirstPass; p < batch.FirstPass + batch.PassCount; p++)
+        {
+            uint32_t pass = m_passOrder[p];
+            for(uint32_t i = m_passFirst[pass]; i < m_passFirst[pass + 1]; i++)
+            {
+                const Access& access = m_accesses[m_passAccesses[i]];
+                if(access.Feedback)
+                    continue;
+
+                Resource& resource = m_resources[access.Resource];
+                bool firstUse = !m_defined[access.Resource];
+                if(firstUse && resource.Aliases)
+                    m_barriers.push_back({ RenderGraphBarrierType::Aliasing, access.Resource, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COMMON });
+
+                if(firstUse || m_states[access.Resource] != access.BarrierState)
+                {
+                    uint32_t begin = firstUse ? RENDER_GRAPH_INVALID : beginBatch(access.Resource, b);
+                    m_defined[access.Resource] = true;
+                    m_barriers.push_back({ RenderGraphBarrierType::Transition, access.Resource, m_states[access.Resource], access.BarrierState, begin });
+                    m_states[access.Resource] = access.BarrierState;
+                }
+                m_lastBatches[access.Resource] = b;
+            }
+        }
+        batch.BarrierCount = (uint32_t)m_barriers.size() - batch.FirstBarrier;
+    }
+
+    RenderGraphBatch outputs = { (uint32_t)m_passOrder.size(), 0, (uint32_t)m_barriers.size(), 0 };
+    for(uint32_t r = 0; r < m_resources.size(); r++)
+    {
+        const Resource& resource = m_resources[r];
+        if(resource.Output && m_states[r] != resource.FinalState)
+            m_barriers.push_back({ RenderGraphBarrierType::Transition, r, m_states[r], resource.FinalState, beginBatch(r, (uint32_t)m_batches.size()) });
+    }
+    outputs.BarrierCount = (uint32_t)m_barriers.size() - outputs.FirstBarrier;
+    m_batches.push_back(outputs);
+}
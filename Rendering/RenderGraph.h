@@ -0,0 +1,201 @@
+﻿#pragma once
+#include "Core.h"
+#include "../RHI/Texture.h"
+
+#include <type_traits>
+
+#define RENDER_GRAPH_INVALID UINT32_MAX
+// Pass callbacks of one graph, a larger frame spills to the heap once and the arena grows on the next Reset
+#define RENDER_GRAPH_ARENA_SIZE (16 * 1024)
+
+// Transient texture, Size and Alignment are the placement requirements from RenderGraphExecutor::MakeTextureDesc
+struct RenderGraphTextureDesc
+{
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    TextureFormat Format = TextureFormat::RGBA8;
+    TextureType Type = TextureType::RenderTarget;
+    uint64_t Size = 0;
+    uint64_t Alignment = 0;
+};
+
+enum class RenderGraphBarrierType
+{
+    Transition,
+    Aliasing // The transient takes over memory another transient used earlier in the frame
+};
+
+struct RenderGraphBarrier
+{
+    RenderGraphBarrierType Type;
+    uint32_t Resource;
+    // As tracked by the compile, COMMON for the first use of a transient. The executor transitions from the actual texture state.
+    D3D12_RESOURCE_STATES Before;
+    D3D12_RESOURCE_STATES After;
+    // Batch after which the transition can begin when batches that do not use the resource come before its own, split barrier
+    uint32_t BeginBatch = RENDER_GRAPH_INVALID;
+};
+
+// Passes without dependencies between them, their barriers are issued in one batch before the first one.
+// The last batch has no pass and leaves the outputs in their final state.
+struct RenderGraphBatch
+{
+    uint32_t FirstPass; // In GetPassOrder
+    uint32_t PassCount;
+    uint32_t FirstBarrier;
+    uint32_t BarrierCount;
+};
+
+struct RenderGraphStats
+{
+    uint32_t PassCount = 0;
+    uint32_t CulledPassCount = 0;
+    uint32_t BatchCount = 0;
+    uint32_t BarrierCount = 0;
+    uint32_t SplitBarrierCount = 0;
+    uint32_t TransientCount = 0;
+    uint64_t TransientHeapSize = 0;
+    uint64_t TransientSize = 0; // Summed sizes, what the heap would take without aliasing
+};
+
+// Frame graph : passes declare the textures they read and write, the accesses to a texture are ordered like the passes were added.
+// Compile culls the passes whose writes nothing reads, groups the others in dependency levels, computes the barriers before each level
+// and packs the transient textures in one heap, those whose lifetimes do not overlap share memory.
+// The compile is CPU only, RenderGraphExecutor creates the transient textures and records the passes.
+// Once the capacities are reached, building and compiling a graph does not allocate : names are not copied and the pass
+// callbacks live in an arena of the graph.
+class RenderGraph
+{
+public:
+    // Runs the callback AddPass copied
+    using PassExecute = void (*)(const void* callback);
+
+    // Keeps the capacity, a graph is built every frame. The pass callbacks are released without running their destructors
+    void Reset();
+
+    // Names are kept as pointers, they must outlive the graph (string literals)
+    uint32_t ImportTexture(const char* name, const std::shared_ptr<Texture>& texture);
+    // Null textures are only useful to compile, state is the one the texture is in when the graph starts
+    uint32_t ImportTexture(const char* name, const std::shared_ptr<Texture>& texture, D3D12_RESOURCE_STATES state);
+    // Content undefined until its first write in the frame
+    uint32_t CreateTexture(const char* name, const RenderGraphTextureDesc& desc);
+    // Outputs are used outside of the graph, their producers are never culled and they end in finalState
+    void MarkOutput(uint32_t resource, D3D12_RESOURCE_STATES finalState);
+
+    // Side effect passes (presenting, readbacks) are never culled. The callback is copied in the graph arena until the next Reset,
+    // it can capture references and plain values only
+    template<typename Callback>
+    uint32_t AddPass(const char* name, const Callback& callback, bool sideEffect = false)
+    {
+        static_assert(std::is_trivially_destructible<Callback>::value, "Pass callbacks are released by RenderGraph::Reset without running their destructors");
+        void* storage = m_arena.Allocate(sizeof(Callback), alignof(Callback));
+        new(storage) Callback(callback);
+        return AddPass(name, [](const void* data) { (*static_cast<const Callback*>(data))(); }, storage, sideEffect);
+    }
+    uint32_t AddPass(const char* name, PassExecute execute, const void* callback, bool sideEffect);
+    // Several reads of the same texture in a row share one barrier to the combined read states
+    void Read(uint32_t pass, uint32_t resource, D3D12_RESOURCE_STATES state);
+    // Writes in the same state in a row get no barrier, passes writing the same UAV order their accesses themselves
+    void Write(uint32_t pass, uint32_t resource, D3D12_RESOURCE_STATES state);
+
+    void Compile();
+
+    // Compile results
+    const std::vector<uint32_t>& GetPassOrder() const { return m_passOrder; }
+    const std::vector<RenderGraphBatch>& GetBatches() const { return m_batches; }
+    const std::vector<RenderGraphBarrier>& GetBarriers() const { return m_barriers; }
+    bool IsCulled(uint32_t pass) const { return m_passes[pass].Culled; }
+    // RENDER_GRAPH_INVALID for the imported textures and the transients of culled passes only
+    uint64_t GetTransientOffset(uint32_t resource) const { return m_resources[resource].HeapOffset; }
+    const RenderGraphStats& GetStats() const { return m_stats; }
+
+    uint32_t GetResourceCount() const { return (uint32_t)m_resources.size(); }
+    bool IsTransient(uint32_t resource) const { return !m_resources[resource].Imported; }
+    const RenderGraphTextureDesc& GetTextureDesc(uint32_t resource) const { return m_resources[resource].Desc; }
+    std::shared_ptr<Texture> GetTexture(uint32_t resource) const { return m_resources[resource].Texture; }
+    // The executor binds the transient textures before running the passes
+    void SetTexture(uint32_t resource, std::shared_ptr<Texture> texture) { m_resources[resource].Texture = texture; }
+
+    uint32_t GetPassCount() const { return (uint32_t)m_passes.size(); }
+    const char* GetPassName(uint32_t pass) const { return m_passes[pass].Name; }
+    void ExecutePass(uint32_t pass) const { m_passes[pass].Execute(m_passes[pass].Callback); }
+
+private:
+    struct Access
+    {
+        uint32_t Pass;
+        uint32_t Resource;
+        D3D12_RESOURCE_STATES State;
+        bool Write;
+        bool Feedback; // Read of a texture the same pass writes, ordered and culled as the write
+        D3D12_RESOURCE_STATES BarrierState; // Reads in a row combine their states
+    };
+
+    struct Pass
+    {
+        const char* Name = nullptr;
+        PassExecute Execute = nullptr;
+        const void* Callback = nullptr;
+        bool SideEffect = false;
+        bool Culled = false;
+        uint32_t Level = 0;
+        uint32_t RefCount = 0; // Resources written and still used, during the culling
+    };
+
+    struct Resource
+    {
+        const char* Name = nullptr;
+        std::shared_ptr<Texture> Texture;
+        RenderGraphTextureDesc Desc;
+        bool Imported = false;
+        bool Output = false;
+        D3D12_RESOURCE_STATES InitialState = D3D12_RESOURCE_STATE_COMMON;
+        D3D12_RESOURCE_STATES FinalState = D3D12_RESOURCE_STATE_COMMON;
+        uint32_t RefCount = 0; // Passes reading it, during the culling
+        uint32_t FirstLevel = RENDER_GRAPH_INVALID; // Lifetime in dependency levels
+        uint32_t LastLevel = 0;
+        uint64_t HeapOffset = RENDER_GRAPH_INVALID;
+        bool Aliases = false; // Memory used by another transient earlier in the frame
+    };
+
+    // Transient placed in the heap, compact for the packing scans
+    struct Placement
+    {
+        uint64_t Offset;
+        uint64_t End;
+        uint32_t FirstLevel;
+        uint32_t LastLevel;
+        uint32_t Resource;
+    };
+
+    void BuildAccessLists();
+    void CullPasses();
+    void SortPasses();
+    void PlaceTransients();
+    void ComputeBarriers();
+
+    std::vector<Pass> m_passes;
+    std::vector<Resource> m_resources;
+    std::vector<Access> m_accesses; // In declaration order
+    FrameArena m_arena { RENDER_GRAPH_ARENA_SIZE };
+
+    std::vector<uint32_t> m_passOrder;
+    std::vector<RenderGraphBatch> m_batches;
+    std::vector<RenderGraphBarrier> m_barriers;
+    RenderGraphStats m_stats;
+
+    // Compile scratch, accesses grouped by pass and by resource in declaration order
+    std::vector<uint32_t> m_passFirst;
+    std::vector<uint32_t> m_passAccesses;
+    std::vector<uint32_t> m_resourceFirst;
+    std::vector<uint32_t> m_resourceAccesses;
+    std::vector<uint32_t> m_stack;
+    std::vector<uint32_t> m_levelCounts;
+    std::vector<uint32_t> m_lastWriterLevels; // Level + 1 of the last write, 0 when none
+    std::vector<uint32_t> m_lastReaderLevels; // Highest level + 1 of the reads since
+    std::vector<D3D12_RESOURCE_STATES> m_states;
+    std::vector<bool> m_defined; // Imported, or a transient already used this frame
+    std::vector<uint32_t> m_lastBatches; // Of the last access so far
+    std::vector<uint32_t> m_transients;
+    std::vector<Placement> m_placed; // By heap offset
+};
@@ -0,0 +1,162 @@
+﻿#include "RenderGraphExecutor.h"
+
+RenderGraphExecutor::RenderGraphExecutor(std::shared_ptr<D3D12Renderer> renderer) : m_renderer(renderer)
+{
+}
+
+RenderGraphExecutor::~RenderGraphExecutor()
+{
+    m_placements.clear();
+    if(m_memory)
+        m_memory->Release();
+}
+
+RenderGraphTextureDesc RenderGraphExecutor::MakeTextureDesc(uint32_t width, uint32_t height, TextureFormat format, TextureType type)
+{
+    D3D12_RESOURCE_ALLOCATION_INFO info = m_renderer->GetTextureAllocationInfo(width, height, format, type);
+
+    RenderGraphTextureDesc desc;
+    desc.Width = width;
+    desc.Height = height;
+    desc.Format = format;
+    desc.Type = type;
+    desc.Size = info.SizeInBytes;
+    desc.Alignment = info.Alignment;
+    return desc;
+}
+
+std::shared_ptr<Texture> RenderGraphExecutor::FindPlacedTexture(const RenderGraphTextureDesc& desc, uint64_t offset)
+{
+    for(const Placement& placement : m_placements)
+    {
+        if(placement.Offset == offset && placement.Desc.Width == desc.Width && placement.Desc.Height == desc.Height &&
+            placement.Desc.Format == desc.Format && placement.Desc.Type == desc.Type)
+            return placement.Texture;
+    }
+
+    return nullptr;
+}
+
+void RenderGraphExecutor::PlaceTransients(RenderGraph& graph)
+{
+    bool changed = graph.GetStats().TransientHeapSize > m_memorySize;
+    for(uint32_t r = 0; r < graph.GetResourceCount() && !changed; r++)
+    {
+        if(graph.IsTransient(r) && graph.GetTransientOffset(r) != RENDER_GRAPH_INVALID)
+            changed = FindPlacedTexture(graph.GetTextureDesc(r), graph.GetTransientOffset(r)) == nullptr;
+    }
+
+    if(changed)
+    {
+        // Frames in flight may still use the previous textures
+        m_renderer->WaitForGPU();
+        m_placements.clear();
+
+        if(graph.GetStats().TransientHeapSize > m_memorySize)
+        {
+            if(m_memory)
+                m_memory->Release();
+
+            m_memorySize = graph.GetStats().TransientHeapSize;
+            m_memory = m_renderer->AllocateTextureMemory(m_memorySize, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+        }
+
+        for(uint32_t r = 0; r < graph.GetResourceCount(); r++)
+        {
+            uint64_t offset = graph.GetTransientOffset(r);
+            if(!graph.IsTransient(r) || offset == RENDER_GRAPH_INVALID)
+                continue;
+
+            const RenderGraphTextureDesc& desc = graph.GetTextureDesc(r);
+            auto texture = m_renderer->CreatePlacedTexture(m_memory, offset, desc.Width, desc.Height, desc.Format, desc.Type);
+            switch(desc.Type)
+            {
+                case TextureType::RenderTarget:
+                    m_renderer->CreateRenderTargetView(texture);
+                    m_renderer->CreateShaderResourceView(texture);
+                break;
+                case TextureType::DepthTarget:
+                    m_renderer->CreateDepthView(texture);
+                    texture->SetFormat(TextureFormat::R32Float);
+                    m_renderer->CreateShaderResourceView(texture);
+                    texture->SetFormat(desc.Format);
+                break;
+                case TextureType::Storage:
+                    m_renderer->CreateUnorderedAccessView(texture);
+                    m_renderer->CreateShaderResourceView(texture);
+                break;
+                default:
+                    m_renderer->CreateShaderResourceView(texture);
+                break;
+            }
+
+            m_placements.push_back({ desc, offset, texture });
+        }
+    }
+
+    for(uint32_t r = 0; r < graph.GetResourceCount(); r++)
+    {
+        if(graph.IsTransient(r) && graph.GetTransientOffset(r) != RENDER_GRAPH_INVALID)
+            graph.SetTexture(r, FindPlacedTexture(graph.GetTextureDesc(r), graph.GetTransientOffset(r)));
+    }
+}
+
+void RenderGraphExecutor::Execute(RenderGraph& graph)
+{
+    PROFILE_FUNCTION();
+
+    graph.Compile();
+    PlaceTransients(graph);
+
+    auto commandList = m_renderer->GetCurrentCommandList();
+    const auto& passOrder = graph.GetPassOrder();
+    const auto& barriers = graph.GetBarriers();
+    const auto& batches = graph.GetBatches();
+
+    m_splitBarriers.clear();
+    for(uint32_t i = 0; i < barriers.size(); i++)
+    {
+        if(barriers[i].BeginBatch != RENDER_GRAPH_INVALID)
+            m_splitBarriers.push_back(i);
+    }
+    std::stable_sort(m_splitBarriers.begin(), m_splitBarriers.end(), [&barriers](uint32_t a, uint32_t b) { return barriers[a].BeginBatch < barriers[b].BeginBatch; });
+
+    uint32_t split = 0;
+    for(uint32_t b = 0; b < batches.size(); b++)
+    {
+        const RenderGraphBatch& batch = batches[b];
+        // Aliasing barriers first, then the transitions, which end the split ones, then the discards the aliased targets need.
+        // The command list submits them all at once.
+        m_transitions.clear();
+        for(uint32_t i = batch.FirstBarrier; i < batch.FirstBarrier + batch.BarrierCount; i++)
+        {
+            const RenderGraphBarrier& barrier = barriers[i];
+            auto texture = graph.GetTexture(barrier.Resource);
+            if(barrier.Type == RenderGraphBarrierType::Aliasing)
+                commandList->AliasingBarrier(nullptr, texture);
+            else
+                m_transitions.push_back({ texture, barrier.After });
+        }
+        commandList->ImageBarrier(m_transitions.data(), (uint32_t)m_transitions.size());
+
+        for(uint32_t i = batch.FirstBarrier; i < batch.FirstBarrier + batch.BarrierCount; i++)
+        {
+            if(barriers[i].Type != RenderGraphBarrierType::Aliasing)
+                continue;
+
+            auto texture = graph.GetTexture(barriers[i].Resource);
+            if(texture->GetState() == D3D12_RESOURCE_STATE_RENDER_TARGET || texture->GetState() == D3D12_RESOURCE_STATE_DEPTH_WRITE)
+                commandList->DiscardTexture(texture);
+        }
+
+        for(uint32_t p = batch.FirstPass; p < batch.FirstPass + batch.PassCount; p++)
+            graph.ExecutePass(passOrder[p]);
+
+        // Overlaps the batches until the texture is used again
+        for(; split < m_splitBarriers.size() && barriers[m_splitBarriers[split]].BeginBatch == b; split++)
+        {
+            const RenderGraphBarrier& barrier = barriers[m_splitBarriers[split]];
+            commandList->BeginImageBarrier(graph.GetTexture(barrier.Resource), barrier.After);
+        }
+    }
+}
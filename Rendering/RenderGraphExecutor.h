@@ -0,0 +1,33 @@
+﻿#pragma once
+#include "RenderGraph.h"
+#include "../RHI/D3D12Renderer.h"
+
+// Places the transients of a compiled graph in one heap and records its barriers and passes into the current command list.
+// The textures are kept while the layout does not change, a new layout waits for the GPU before replacing them.
+class RenderGraphExecutor
+{
+public:
+    RenderGraphExecutor(std::shared_ptr<D3D12Renderer> renderer);
+    ~RenderGraphExecutor();
+
+    RenderGraphTextureDesc MakeTextureDesc(uint32_t width, uint32_t height, TextureFormat format, TextureType type);
+    void Execute(RenderGraph& graph);
+
+private:
+    struct Placement
+    {
+        RenderGraphTextureDesc Desc;
+        uint64_t Offset;
+        std::shared_ptr<Texture> Texture;
+    };
+
+    void PlaceTransients(RenderGraph& graph);
+    std::shared_ptr<Texture> FindPlacedTexture(const RenderGraphTextureDesc& desc, uint64_t offset);
+
+    std::shared_ptr<D3D12Renderer> m_renderer;
+    D3D12MA::Allocation* m_memory = nullptr;
+    uint64_t m_memorySize = 0;
+    std::vector<Placement> m_placements;
+    std::vector<TextureBarrier> m_transitions;
+    std::vector<uint32_t> m_splitBarriers; // By begin batch
+};
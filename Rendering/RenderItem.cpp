@@ -1,4 +1,7 @@
 ﻿#include "RenderItem.h"
+#include "MeshCooker.h"
+#include "MappedFile.h"
+#include "RenderingLayouts.h"
 
 RenderItem::RenderItem()
 {
@@ -10,73 +13,210 @@ RenderItem::~RenderItem()
 
 void RenderItem::ImportMesh(std::shared_ptr<D3D12Renderer> renderer, std::string filePath)
 {
-    Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(filePath, aiProcess_FlipWindingOrder | aiProcess_CalcTangentSpace);
-    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-        LOG(Error, "RenderItem : Failed assimp import");
+    PROFILE_FUNCTION();
+
+    std::string cookedPath = MeshCooker::GetCookedPath(filePath);
+    if(!MeshCooker::IsCookedUpToDate(filePath, cookedPath) && !MeshCooker::Cook(filePath, cookedPath))
+    {
+        LOG(Error, "RenderItem : failed to cook mesh " + filePath);
         return;
     }
-    
-    ProcessNode(renderer, scene->mRootNode, scene);
+
+    if(!LoadCookedMesh(renderer, cookedPath))
+        return;
+
     LOG(Debug, "RenderItem : Imported mesh " + filePath);
     m_path = filePath;
 }
 
-void RenderItem::ProcessPrimitive(std::shared_ptr<D3D12Renderer> renderer, aiMesh* mesh, const aiScene* scene)
+bool RenderItem::LoadCookedMesh(std::shared_ptr<D3D12Renderer> renderer, const std::string& cookedPath)
 {
-    Primitive out;
-    DirectX::XMMATRIX identityMatrix = DirectX::XMMatrixIdentity();
-    DirectX::XMStoreFloat4x4(&out.LocalPrimTransform, identityMatrix);
+    MappedFile file;
+    if(!file.Open(cookedPath))
+        return false;
+
+    const uint8_t* data = file.GetData();
+    uint64_t size = file.GetSize();
 
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
-    for (int i = 0; i < mesh->mNumVertices; i++)
+    const auto* header = reinterpret_cast<const CookedMeshHeader*>(data);
+    if(size < sizeof(CookedMeshHeader) || header->Magic != CMESH_MAGIC || header->Version != CMESH_VERSION
+        || header->VertexStride != sizeof(CompactVertex) || header->FileSize != size
+        || sizeof(CookedMeshHeader) + (uint64_t)header->PrimitiveCount * sizeof(CookedPrimitive) > size)
     {
-        Vertex vertex;
+        LOG(Error, "RenderItem : invalid cooked mesh " + cookedPath);
+        return false;
+    }
+
+    const auto* cookedPrimitives = reinterpret_cast<const CookedPrimitive*>(data + sizeof(CookedMeshHeader));
+    for(uint32_t i = 0; i < header->PrimitiveCount; i++)
+    {
+        const auto& cookedPrimitive = cookedPrimitives[i];
+        if((cookedPrimitive.IndexStride != sizeof(uint16_t) && cookedPrimitive.IndexStride != sizeof(uint32_t))
+            || (cookedPrimitive.PositionIndexStride != sizeof(uint16_t) && cookedPrimitive.PositionIndexStride != sizeof(uint32_t))
+            || cookedPrimitive.LodCount == 0 || cookedPrimitive.LodCount > MESH_LOD_MAX_COUNT
+            || cookedPrimitive.VertexOffset + (uint64_t)cookedPrimitive.VertexCount * sizeof(CompactVertex) > size
+            || cookedPrimitive.IndexOffset + (uint64_t)cookedPrimitive.IndexCount * cookedPrimitive.IndexStride > size
+            || cookedPrimitive.PositionVertexOffset + (uint64_t)cookedPrimitive.PositionVertexCount * sizeof(CompactPosition) > size
+            || (cookedPrimitive.PositionVertexCount > 0 && cookedPrimitive.PositionIndexOffset + (uint64_t)cookedPrimitive.IndexCount * cookedPrimitive.PositionIndexStride > size)
+            || cookedPrimitive.MeshletOffset + (uint64_t)cookedPrimitive.MeshletCount * sizeof(Meshlet) > size
+            || cookedPrimitive.OccluderVertexOffset + (uint64_t)cookedPrimitive.OccluderVertexCount * sizeof(DirectX::XMFLOAT3) > size
+            || cookedPrimitive.OccluderIndexOffset + (uint64_t)cookedPrimitive.OccluderIndexCount * sizeof(uint16_t) > size
+            || cookedPrimitive.BVHNodeOffset + (uint64_t)cookedPrimitive.BVHNodeCount * sizeof(TriangleBVHNode) > size
+            || cookedPrimitive.BVHTriangleOffset + (uint64_t)cookedPrimitive.Lods[0].IndexCount / 3 * sizeof(uint32_t) > size)
+        {
+            LOG(Error, "RenderItem : primitive out of the file bounds in " + cookedPath);
+            return false;
+        }
+
+        for(uint32_t lod = 0; lod < cookedPrimitive.LodCount; lod++)
+        {
+            if((uint64_t)cookedPrimitive.Lods[lod].IndexOffset + cookedPrimitive.Lods[lod].IndexCount > cookedPrimitive.IndexCount)
+            {
+                LOG(Error, "RenderItem : primitive LOD out of its index buffer in " + cookedPath);
+                return false;
+            }
+        }
+
+        // Meshlets are drawn as ranges of LOD 0
+        const auto* meshlets = reinterpret_cast<const Meshlet*>(data + cookedPrimitive.MeshletOffset);
+        for(uint32_t meshlet = 0; meshlet < cookedPrimitive.MeshletCount; meshlet++)
+        {
+            if(meshlets[meshlet].IndexOffset % 3 != 0
+                || (uint64_t)meshlets[meshlet].IndexOffset + meshlets[meshlet].TriangleCount * 3ull > cookedPrimitive.Lods[0].IndexCount)
+            {
+                LOG(Error, "RenderItem : meshlet out of the LOD 0 indices in " + cookedPath);
+                return false;
+            }
+        }
+
+        // LOD 0 and its BVH are walked on the CPU by the ray queries, the traversal follows the links without checks
+        uint32_t triangleCount = cookedPrimitive.Lods[0].IndexCount / 3;
+        const auto* bvhNodes = reinterpret_cast<const TriangleBVHNode*>(data + cookedPrimitive.BVHNodeOffset);
+        for(uint32_t node = 0; node < cookedPrimitive.BVHNodeCount; node++)
+        {
+            const TriangleBVHNode& bvhNode = bvhNodes[node];
+            bool invalid = bvhNode.TriangleCount == 0
+                ? bvhNode.LeftFirst <= node || (uint64_t)bvhNode.LeftFirst + 1 >= cookedPrimitive.BVHNodeCount
+                : (uint64_t)bvhNode.LeftFirst + bvhNode.TriangleCount > triangleCount;
+            if(invalid)
+            {
+                LOG(Error, "RenderItem : triangle BVH node out of range in " + cookedPath);
+                return false;
+            }
+        }
+
+        const auto* bvhTriangles = reinterpret_cast<const uint32_t*>(data + cookedPrimitive.BVHTriangleOffset);
+        for(uint32_t slot = 0; slot < triangleCount; slot++)
+        {
+            if(bvhTriangles[slot] >= triangleCount)
+            {
+                LOG(Error, "RenderItem : triangle BVH slot out of the LOD 0 triangles in " + cookedPath);
+                return false;
+            }
+        }
 
-        vertex.Position = DirectX::XMFLOAT3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
-        if (mesh->HasNormals())
+        const uint8_t* lodIndices = data + cookedPrimitive.IndexOffset + (uint64_t)cookedPrimitive.Lods[0].IndexOffset * cookedPrimitive.IndexStride;
+        for(uint32_t index = 0; index < cookedPrimitive.Lods[0].IndexCount; index++)
         {
-            vertex.Normal = DirectX::XMFLOAT3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
-            vertex.Tangent = DirectX::XMFLOAT3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
-            vertex.Binormal = DirectX::XMFLOAT3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
+            uint32_t vertex = cookedPrimitive.IndexStride == sizeof(uint16_t) ? reinterpret_cast<const uint16_t*>(lodIndices)[index] : reinterpret_cast<const uint32_t*>(lodIndices)[index];
+            if(vertex >= cookedPrimitive.VertexCount)
+            {
+                LOG(Error, "RenderItem : index out of the vertices in " + cookedPath);
+                return false;
+            }
+        }
+
+        // Read on the CPU every frame, checked once here
+        const auto* occluderIndices = reinterpret_cast<const uint16_t*>(data + cookedPrimitive.OccluderIndexOffset);
+        for(uint32_t index = 0; index < cookedPrimitive.OccluderIndexCount; index++)
+        {
+            if(occluderIndices[index] >= cookedPrimitive.OccluderVertexCount)
+            {
+                LOG(Error, "RenderItem : occluder index out of its positions in " + cookedPath);
+                return false;
+            }
         }
-        
-        if (mesh->mTextureCoords[0])
-            vertex.UV = DirectX::XMFLOAT2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
-        
-        vertices.push_back(vertex);
     }
 
-    for (int i = 0; i < mesh->mNumFaces; i++)
+    // The blobs are copied straight from the mapping into the staging buffers, the file has to stay mapped until the flush
+    Uploader uploader = renderer->CreateUploader();
+    for(uint32_t i = 0; i < header->PrimitiveCount; i++)
     {
-        aiFace face = mesh->mFaces[i];
-        for (int j = 0; j < face.mNumIndices; j++)
-            indices.push_back(face.mIndices[j]);
-    }
+        const auto& cookedPrimitive = cookedPrimitives[i];
+        if(cookedPrimitive.VertexCount == 0 || cookedPrimitive.IndexCount == 0)
+            continue;
 
-    out.m_vertexCount = vertices.size();
-    out.m_indexCount = indices.size();
+        Primitive primitive;
+        primitive.LocalPrimTransform = cookedPrimitive.LocalPrimTransform;
+        primitive.BoundsMin = cookedPrimitive.BoundsMin;
+        primitive.BoundsMax = cookedPrimitive.BoundsMax;
+        primitive.m_vertexCount = cookedPrimitive.VertexCount;
+        primitive.m_indexCount = cookedPrimitive.Lods[0].IndexCount;
+        primitive.m_lods.assign(cookedPrimitive.Lods, cookedPrimitive.Lods + cookedPrimitive.LodCount);
 
-    out.m_vertexBuffer = renderer->CreateBuffer(out.m_vertexCount * sizeof(Vertex), sizeof(Vertex), BufferType::Vertex, false);
-    out.m_indicesBuffer = renderer->CreateBuffer(out.m_indexCount * sizeof(uint32_t), 0, BufferType::Index, false);
+        uint64_t vertexSize = (uint64_t)primitive.m_vertexCount * sizeof(CompactVertex);
+        uint64_t indexSize = (uint64_t)cookedPrimitive.IndexCount * cookedPrimitive.IndexStride;
+        primitive.m_vertexBuffer = renderer->CreateBuffer(vertexSize, sizeof(CompactVertex), BufferType::Vertex, false);
+        primitive.m_indicesBuffer = renderer->CreateBuffer(indexSize, cookedPrimitive.IndexStride, BufferType::Index, false);
 
-    Uploader uploader = renderer->CreateUploader();
-    uploader.CopyHostToDeviceLocal(vertices.data(), vertices.size() * sizeof(Vertex), out.m_vertexBuffer);
-    uploader.CopyHostToDeviceLocal(indices.data(), indices.size() * sizeof(uint32_t), out.m_indicesBuffer);
-    renderer->FlushUploader(uploader);
+        PrimitiveConstantBuffer cbuf = {};
+        cbuf.PositionOffset = primitive.BoundsMin;
+        DirectX::XMStoreFloat3(&cbuf.PositionScale, DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&primitive.BoundsMax), DirectX::XMLoadFloat3(&primitive.BoundsMin)));
 
-    m_primitives.push_back(out);
-}
+        primitive.m_constantBuffer = renderer->CreateBuffer(256, 0, BufferType::Constant, false);
+        renderer->CreateConstantBuffer(primitive.m_constantBuffer);
+        void* constantData;
+        primitive.m_constantBuffer->Map(0, 0, &constantData);
+        memcpy(constantData, &cbuf, sizeof(PrimitiveConstantBuffer));
+        primitive.m_constantBuffer->Unmap(0, 0);
 
-void RenderItem::ProcessNode(std::shared_ptr<D3D12Renderer> renderer, aiNode* node, const aiScene* scene)
-{
-    for (int i = 0; i < node->mNumMeshes; i++)
-    {
-        aiMesh *mesh = scene->mMeshes[node->mMeshes[i]]; // TODO compute transform
-        ProcessPrimitive(renderer, mesh, scene);
+        uploader.CopyHostToDeviceLocal(const_cast<uint8_t*>(data + cookedPrimitive.VertexOffset), vertexSize, primitive.m_vertexBuffer);
+        uploader.CopyHostToDeviceLocal(const_cast<uint8_t*>(data + cookedPrimitive.IndexOffset), indexSize, primitive.m_indicesBuffer);
+
+        if(cookedPrimitive.PositionVertexCount > 0)
+        {
+            primitive.m_positionVertexCount = cookedPrimitive.PositionVertexCount;
+
+            uint64_t positionSize = (uint64_t)primitive.m_positionVertexCount * sizeof(CompactPosition);
+            uint64_t positionIndexSize = (uint64_t)cookedPrimitive.IndexCount * cookedPrimitive.PositionIndexStride;
+            primitive.m_positionBuffer = renderer->CreateBuffer(positionSize, sizeof(CompactPosition), BufferType::Vertex, false);
+            primitive.m_positionIndicesBuffer = renderer->CreateBuffer(positionIndexSize, cookedPrimitive.PositionIndexStride, BufferType::Index, false);
+
+            uploader.CopyHostToDeviceLocal(const_cast<uint8_t*>(data + cookedPrimitive.PositionVertexOffset), positionSize, primitive.m_positionBuffer);
+            uploader.CopyHostToDeviceLocal(const_cast<uint8_t*>(data + cookedPrimitive.PositionIndexOffset), positionIndexSize, primitive.m_positionIndicesBuffer);
+        }
+
+        // Decoded like the positions the cooker built the BVH on, the ray queries hit what is drawn
+        const auto* compactVertices = reinterpret_cast<const CompactVertex*>(data + cookedPrimitive.VertexOffset);
+        std::vector<DirectX::XMFLOAT3> positions(cookedPrimitive.VertexCount);
+        for(uint32_t vertex = 0; vertex < cookedPrimitive.VertexCount; vertex++)
+            positions[vertex] = VertexCompression::DecodePosition(compactVertices[vertex], primitive.BoundsMin, primitive.BoundsMax);
+
+        std::vector<uint32_t> lodIndices;
+        const uint8_t* lodIndexData = data + cookedPrimitive.IndexOffset + (uint64_t)cookedPrimitive.Lods[0].IndexOffset * cookedPrimitive.IndexStride;
+        if(cookedPrimitive.IndexStride == sizeof(uint16_t))
+            lodIndices.assign(reinterpret_cast<const uint16_t*>(lodIndexData), reinterpret_cast<const uint16_t*>(lodIndexData) + cookedPrimitive.Lods[0].IndexCount);
+        else
+            lodIndices.assign(reinterpret_cast<const uint32_t*>(lodIndexData), reinterpret_cast<const uint32_t*>(lodIndexData) + cookedPrimitive.Lods[0].IndexCount);
+
+        primitive.m_triangleBVH.Initialize(reinterpret_cast<const TriangleBVHNode*>(data + cookedPrimitive.BVHNodeOffset), cookedPrimitive.BVHNodeCount,
+            reinterpret_cast<const uint32_t*>(data + cookedPrimitive.BVHTriangleOffset), cookedPrimitive.Lods[0].IndexCount / 3, positions.data(), lodIndices.data());
+
+        const auto* meshlets = reinterpret_cast<const Meshlet*>(data + cookedPrimitive.MeshletOffset);
+        primitive.m_meshlets.assign(meshlets, meshlets + cookedPrimitive.MeshletCount);
+        primitive.m_meshletCullingData = MeshletBuilder::BuildCullingData(primitive.m_meshlets);
+
+        const auto* occluderPositions = reinterpret_cast<const DirectX::XMFLOAT3*>(data + cookedPrimitive.OccluderVertexOffset);
+        const auto* occluderIndices = reinterpret_cast<const uint16_t*>(data + cookedPrimitive.OccluderIndexOffset);
+        primitive.m_occluderPositions.assign(occluderPositions, occluderPositions + cookedPrimitive.OccluderVertexCount);
+        primitive.m_occluderIndices.assign(occluderIndices, occluderIndices + cookedPrimitive.OccluderIndexCount);
+
+        m_primitives.push_back(std::move(primitive));
     }
+    renderer->FlushUploader(uploader);
 
-    for (int i = 0; i < node->mNumChildren; i++)
-        ProcessNode(renderer, node->mChildren[i], scene);
-}
\ No newline at end of file
+    m_boundsMin = header->BoundsMin;
+    m_boundsMax = header->BoundsMax;
+
+    return true;
+}
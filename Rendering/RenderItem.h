@@ -1,10 +1,9 @@
 ﻿#pragma once
 #include "Core.h"
 #include "../RHI/D3D12Renderer.h"
-
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
+#include "Meshlet.h"
+#include "MeshLod.h"
+#include "TriangleBVH.h"
 
 struct Material
 {
@@ -27,11 +26,28 @@ struct Vertex
 
 struct Primitive
 {
-    DirectX::XMFLOAT4X4 LocalPrimTransform; // Local Prim Transform, in Object Space
+    DirectX::XMFLOAT4X4 LocalPrimTransform; // Node transform in Object Space, already baked into the vertices
+    DirectX::XMFLOAT3 BoundsMin; // Object Space
+    DirectX::XMFLOAT3 BoundsMax;
     std::shared_ptr<Buffer> m_vertexBuffer;
-    std::shared_ptr<Buffer> m_indicesBuffer;
+    std::shared_ptr<Buffer> m_indicesBuffer; // 16 bits indices when the vertex count allows it
+    std::shared_ptr<Buffer> m_constantBuffer; // PrimitiveConstantBuffer
+    // Optional position only stream with its own welded indices for the depth passes, same index count
+    std::shared_ptr<Buffer> m_positionBuffer;
+    std::shared_ptr<Buffer> m_positionIndicesBuffer;
     int m_vertexCount;
-    int m_indexCount;
+    int m_indexCount; // LOD 0
+    int m_positionVertexCount = 0;
+    // Index ranges shared by both index buffers, primitives drawn at a LOD they lack use their last one
+    std::vector<MeshLod> m_lods;
+    // CPU side only, LOD 0 triangles for the ray queries
+    TriangleBVH m_triangleBVH;
+    // CPU side only, each meshlet is an index range of m_indicesBuffer
+    std::vector<Meshlet> m_meshlets;
+    MeshletCullingData m_meshletCullingData;
+    // CPU side only, low poly proxy for the occlusion culling, empty when the cooker could not make one
+    std::vector<DirectX::XMFLOAT3> m_occluderPositions;
+    std::vector<uint16_t> m_occluderIndices;
 };
 
 class RenderItem
@@ -40,20 +56,25 @@ public:
     RenderItem();
     ~RenderItem();
     
+    // Loads the cooked version of the file, cooking it first when it is missing or out of date
     void ImportMesh(std::shared_ptr<D3D12Renderer> renderer, std::string filePath);
 
     std::string GetPath() { return m_path; }
     std::vector<Primitive>& GetPrimitives() { return m_primitives; }
+    const std::vector<Primitive>& GetPrimitives() const { return m_primitives; }
     Material& GetMaterial() { return m_material; }
+    const DirectX::XMFLOAT3& GetBoundsMin() const { return m_boundsMin; }
+    const DirectX::XMFLOAT3& GetBoundsMax() const { return m_boundsMax; }
     std::string GetMeshIdentifier() { return m_path; }
     
 private:
-    void ProcessPrimitive(std::shared_ptr<D3D12Renderer> renderer, aiMesh *mesh, const aiScene *scene);
-    void ProcessNode(std::shared_ptr<D3D12Renderer> renderer, aiNode *node, const aiScene *scene);
+    bool LoadCookedMesh(std::shared_ptr<D3D12Renderer> renderer, const std::string& cookedPath);
 
     std::string m_path;
     std::vector<Primitive> m_primitives;
     Material m_material;
+    DirectX::XMFLOAT3 m_boundsMin = {};
+    DirectX::XMFLOAT3 m_boundsMax = {};
     
     int m_instanceCount = 1;
 };
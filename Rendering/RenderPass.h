@@ -1,7 +1,12 @@
 ﻿#pragma once
 #include "Camera.h"
+#include "CascadedShadows.h"
+#include "DrawList.h"
+#include "LightClustering.h"
+#include "ShadowCache.h"
 #include "RenderingLayouts.h"
 #include "RenderItem.h"
+#include "VertexCompression.h"
 
 struct DirectionalLightInfo
 {
@@ -9,10 +14,11 @@ struct DirectionalLightInfo
     float Intensity = 1.0f;
 };
 
+// SHADOW_CASCADE_COUNT depth tiles in one atlas, CascadesConstantBuffer holds the ShadowCascadeConstantBuffer that samples them
 struct ShadowMap
 {
-    DirectX::XMFLOAT4X4 ShadowTransform = {};
     std::shared_ptr<Texture> DepthBuffer;
+    std::shared_ptr<Buffer> CascadesConstantBuffer;
 };
 
 struct GBuffer
@@ -28,7 +34,8 @@ struct GlobalPassData
     float DeltaTime;
     float ElapsedTime;
     int ViewMode;
-    std::vector<PointLight> PointLights;
+    FrameVector<PointLight> PointLights;
+    LightClusterBuffers LightClusters;
     DirectionalLightInfo DirectionalInfo;
     float ViewportSizeX;
     float ViewportSizeY;
@@ -36,17 +43,37 @@ struct GlobalPassData
     std::shared_ptr<TextureCube> PrefilterEnvMap;
     std::shared_ptr<Texture> BRDFLut;
     bool EnableShadows;
+    ShadowCascade ShadowCascades[SHADOW_CASCADE_COUNT];
+    ShadowCacheKeys ShadowCacheKeys;
     ShadowMap ShadowMap;
     GBuffer GBuffer;
+    const DrawList* CameraDrawList = nullptr; // Sorted, its batches index the render meshes data
 };
 
+// One batch per mesh and material pair, its instances are drawn together
 struct RenderMeshData
 {
     std::string MeshIdentifier;
-    std::vector<Primitive> Primitives;
-    std::vector<DirectX::XMFLOAT4X4> InstancesTransforms;
+    std::shared_ptr<RenderItem> Item; // Primitives are shared with the item, every material batch of the mesh reads the same ones
     Material Material;
-    std::shared_ptr<Buffer> InstancesDataBuffer;
+    uint32_t MeshIndex = 0; // Shared by the batches of the same mesh
+    uint32_t MaterialIndex = 0; // Shared by the batches of the same material
+    DirectX::XMFLOAT3 BoundsMin; // Object space, all primitives
+    DirectX::XMFLOAT3 BoundsMax;
+    uint32_t LodCount = 1; // Longest primitive LOD chain
+    float LodErrors[MESH_LOD_MAX_COUNT] = {}; // Largest primitive error of each level
+    std::shared_ptr<Buffer> InstancesDataBuffer; // Current frame instances, indexed by slot
+    uint32_t InstanceCount = 0;
+    const InstanceData* Instances = nullptr; // CPU copy of the instances, valid until the next RenderWorld::Sync
+    // Current frame visible slots grouped by LOD : VisibleInstanceCount entries for the camera, then CascadeVisibleInstanceCounts[c] for each shadow cascade,
+    // static casters first then the dynamic ones
+    std::shared_ptr<Buffer> DrawInstancesBuffer;
+    const uint32_t* DrawInstances = nullptr; // CPU copy, valid until the next RenderWorld::Upload
+    uint32_t VisibleInstanceCount = 0;
+    uint32_t CascadeVisibleInstanceCounts[SHADOW_CASCADE_COUNT] = {};
+    uint32_t LodInstanceCounts[MESH_LOD_MAX_COUNT] = {};
+    float LodNearestDepths[MESH_LOD_MAX_COUNT] = {}; // Camera depth of the nearest visible instance of each LOD, for the draw sort keys
+    uint32_t CascadeLodInstanceCounts[SHADOW_CASCADE_COUNT][(uint32_t)ShadowCasterLayer::Count][MESH_LOD_MAX_COUNT] = {};
 };
 
 struct RenderTargetInfo
@@ -0,0 +1,560 @@
+﻿#include "RenderWorld.h"
+#include "Jobs/JobSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+
+RenderWorld::RenderWorld(std::shared_ptr<D3D12Renderer> renderer) : m_renderer(renderer)
+{
+}
+
+RenderWorld::~RenderWorld()
+{
+    m_renderMeshesData.clear();
+    m_meshesIndices.clear();
+    m_batchesIndices.clear();
+    m_materials.clear();
+}
+
+void RenderWorld::Sync(Scene& scene)
+{
+    PROFILE_FUNCTION();
+
+    // Destroyed first, a freed entity index may already be reused by a newly created entity
+    for(auto entity : scene.GetDestroyedEntities())
+    {
+        RemoveMeshInstance(entity.Index);
+        RemovePointLight(entity.Index);
+    }
+
+    for(auto entity : scene.GetChangedEntities())
+    {
+        if(scene.IsAlive(entity))
+            SyncEntity(scene, entity, scene.GetChangeFlags(entity));
+    }
+
+    scene.ClearChanges();
+}
+
+void RenderWorld::Upload(uint32_t frameIndex, const RenderWorldView& view)
+{
+    PROFILE_FUNCTION();
+
+    CullInstances(view);
+    if(view.OcclusionCulling)
+        CullOcclusion(view);
+
+    // Every mesh appends its cascade lists to the keys
+    for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+    {
+        for(uint64_t& key : m_shadowCacheKeys.Layers[cascade])
+            key = ShadowCache::Hash(ShadowCache::HashSeed, &view.CascadeViewProjs[cascade], sizeof(DirectX::XMFLOAT4X4));
+    }
+
+    m_stats = RenderWorldStats();
+    for(uint32_t meshIdx = 0; meshIdx < m_renderMeshesData.size(); meshIdx++)
+    {
+        auto& pool = m_instancePools[meshIdx];
+        pool->Upload(frameIndex);
+        BuildDrawLists(meshIdx, frameIndex, view);
+
+        auto& rmd = m_renderMeshesData[meshIdx];
+        rmd.InstancesDataBuffer = pool->GetBuffer(frameIndex);
+        rmd.InstanceCount = pool->GetInstanceCount();
+        rmd.Instances = pool->GetInstances();
+        rmd.DrawInstancesBuffer = pool->GetDrawInstancesBuffer(frameIndex);
+        rmd.DrawInstances = pool->GetDrawInstances();
+
+        m_stats.InstanceCount += rmd.InstanceCount;
+        m_stats.CameraVisibleCount += rmd.VisibleInstanceCount;
+        for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+            m_stats.CascadeVisibleCounts[cascade] += rmd.CascadeVisibleInstanceCounts[cascade];
+    }
+
+    BuildCameraDrawList();
+
+    for(const CullingRange& range : m_cullingRanges)
+    {
+        m_stats.CameraOccludedCount += range.CameraOccludedCount;
+        for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+            m_stats.CascadeOccludedCounts[cascade] += range.CascadeOccludedCounts[cascade];
+    }
+
+    if(view.OcclusionCulling)
+    {
+        m_stats.OccluderCount = m_cameraOcclusion.GetOccluderCount();
+        m_stats.OccluderTriangleCount = m_cameraOcclusion.GetTriangleCount();
+        for(const MaskedOcclusionBuffer& buffer : m_cascadeOcclusion)
+        {
+            m_stats.OccluderCount += buffer.GetOccluderCount();
+            m_stats.OccluderTriangleCount += buffer.GetTriangleCount();
+        }
+    }
+}
+
+void RenderWorld::SyncEntity(Scene& scene, Entity entity, uint32_t changeFlags)
+{
+    if(entity.Index >= m_entitiesInstances.size())
+    {
+        m_entitiesInstances.resize(entity.Index + 1);
+        m_entitiesPointLights.resize(entity.Index + 1, UINT32_MAX);
+    }
+
+    auto tfComp = scene.GetComponent<TransformComponent>(entity);
+
+    if(changeFlags & (uint32_t)EntityChange::Components)
+    {
+        RemoveMeshInstance(entity.Index);
+        RemovePointLight(entity.Index);
+
+        if(tfComp == nullptr)
+            return;
+
+        auto meshComp = scene.GetComponent<MeshComponent>(entity);
+        if(meshComp && meshComp->GetRenderItem())
+            AddMeshInstance(entity.Index, meshComp->GetRenderItem(), meshComp->GetMaterial(), tfComp->m_transform);
+
+        if(auto pointLightComp = scene.GetComponent<PointLightComponent>(entity))
+            AddPointLight(entity.Index, pointLightComp->m_pointLight);
+    }
+
+    if(tfComp == nullptr)
+        return;
+
+    // Freshly added items already hold the current transform, this only patches the existing slots
+    auto& slot = m_entitiesInstances[entity.Index];
+    if(slot.Mesh != UINT32_MAX)
+    {
+        m_instancePools[slot.Mesh]->SetWorldMatrix(slot.Instance, tfComp->m_transform);
+        m_bvh.Update(slot.Proxy, GetInstanceBox(slot));
+    }
+
+    uint32_t lightIdx = m_entitiesPointLights[entity.Index];
+    if(lightIdx != UINT32_MAX)
+        m_pointLights[lightIdx].Position = { tfComp->m_transform.m[3][0], tfComp->m_transform.m[3][1], tfComp->m_transform.m[3][2] };
+}
+
+void RenderWorld::AddMeshInstance(uint32_t entityIndex, const std::shared_ptr<RenderItem>& renderItem, const Material& material, const DirectX::XMFLOAT4X4& transform)
+{
+    uint32_t meshIdx = GetOrCreateBatch(renderItem, material);
+
+    InstanceData instanceData;
+    instanceData.WorldMat = transform;
+    instanceData.HasAlbedo = material.HasAlbedo;
+    instanceData.HasNormalMap = material.HasNormal;
+    instanceData.HasMetallicRoughness = material.HasMetallicRoughness;
+
+    auto& slot = m_entitiesInstances[entityIndex];
+    slot.Mesh = meshIdx;
+    slot.Instance = m_instancePools[meshIdx]->Allocate(instanceData);
+    slot.Proxy = m_bvh.Insert(GetInstanceBox(slot), entityIndex);
+}
+
+void RenderWorld::RemoveMeshInstance(uint32_t entityIndex)
+{
+    if(entityIndex >= m_entitiesInstances.size())
+        return;
+
+    auto& slot = m_entitiesInstances[entityIndex];
+    if(slot.Mesh == UINT32_MAX)
+        return;
+
+    m_instancePools[slot.Mesh]->Free(slot.Instance);
+    m_bvh.Remove(slot.Proxy);
+    slot = InstanceSlot();
+}
+
+void RenderWorld::AddPointLight(uint32_t entityIndex, const PointLight& pointLight)
+{
+    m_entitiesPointLights[entityIndex] = (uint32_t)m_pointLights.size();
+    m_pointLights.emplace_back(pointLight);
+    m_pointLightsOwners.emplace_back(entityIndex);
+}
+
+void RenderWorld::RemovePointLight(uint32_t entityIndex)
+{
+    if(entityIndex >= m_entitiesPointLights.size())
+        return;
+
+    uint32_t lightIdx = m_entitiesPointLights[entityIndex];
+    if(lightIdx == UINT32_MAX)
+        return;
+
+    uint32_t last = (uint32_t)m_pointLights.size() - 1;
+    if(lightIdx != last)
+    {
+        m_pointLights[lightIdx] = m_pointLights[last];
+        m_pointLightsOwners[lightIdx] = m_pointLightsOwners[last];
+        m_entitiesPointLights[m_pointLightsOwners[last]] = lightIdx;
+    }
+
+    m_pointLights.pop_back();
+    m_pointLightsOwners.pop_back();
+    m_entitiesPointLights[entityIndex] = UINT32_MAX;
+}
+
+BVHBox RenderWorld::GetInstanceBox(const InstanceSlot& slot) const
+{
+    // The pool already keeps the world bounds up to date for the culling
+    const InstanceBounds& bounds = m_instancePools[slot.Mesh]->GetBounds();
+    uint32_t i = slot.Instance;
+    return {
+        { bounds.CenterX[i] - bounds.ExtentX[i], bounds.CenterY[i] - bounds.ExtentY[i], bounds.CenterZ[i] - bounds.ExtentZ[i] },
+        { bounds.CenterX[i] + bounds.ExtentX[i], bounds.CenterY[i] + bounds.ExtentY[i], bounds.CenterZ[i] + bounds.ExtentZ[i] }
+    };
+}
+
+bool RenderWorld::Raycast(const BVHRay& ray, BVHRayHit& hit) const
+{
+    PROFILE_FUNCTION();
+
+    return m_bvh.Raycast(ray, [this](const BVHRay& leafRay, uint32_t entityIndex, float maxDistance) { return RaycastInstance(leafRay, entityIndex, maxDistance); }, hit);
+}
+
+void RenderWorld::Raycast(const BVHRay* rays, uint32_t count, BVHRayHit* hits) const
+{
+    m_bvh.Raycast(rays, count, [this](const BVHRay& leafRay, uint32_t entityIndex, float maxDistance) { return RaycastInstance(leafRay, entityIndex, maxDistance); }, hits);
+}
+
+float RenderWorld::RaycastInstance(const BVHRay& ray, uint32_t entityIndex, float maxDistance) const
+{
+    using namespace DirectX;
+
+    const InstanceSlot& slot = m_entitiesInstances[entityIndex];
+    XMVECTOR determinant;
+    XMMATRIX invWorld = XMMatrixInverse(&determinant, XMLoadFloat4x4(&m_instancePools[slot.Mesh]->GetInstances()[slot.Instance].WorldMat));
+    if(XMVectorGetX(determinant) == 0.0f)
+        return maxDistance;
+
+    // The direction is not renormalized so the object space distances are the world space ones
+    BVHRay objectRay;
+    XMStoreFloat3(&objectRay.Origin, XMVector3TransformCoord(XMLoadFloat3(&ray.Origin), invWorld));
+    XMStoreFloat3(&objectRay.Direction, XMVector3TransformNormal(XMLoadFloat3(&ray.Direction), invWorld));
+    objectRay.MaxDistance = maxDistance;
+
+    for(const Primitive& primitive : m_renderMeshesData[slot.Mesh].Item->GetPrimitives())
+    {
+        TriangleRayHit hit;
+        if(primitive.m_triangleBVH.Raycast(objectRay, hit))
+            objectRay.MaxDistance = hit.Distance;
+    }
+    return objectRay.MaxDistance;
+}
+
+uint32_t RenderWorld::GetOrCreateMaterial(const Material& material)
+{
+    // Few materials, they are told apart by their textures
+    for(uint32_t materialIdx = 0; materialIdx < m_materials.size(); materialIdx++)
+    {
+        const Material& other = m_materials[materialIdx];
+        if(other.HasAlbedo == material.HasAlbedo && other.Albedo == material.Albedo && other.HasNormal == material.HasNormal && other.Normal == material.Normal &&
+            other.HasMetallicRoughness == material.HasMetallicRoughness && other.MetallicRoughness == material.MetallicRoughness)
+            return materialIdx;
+    }
+
+    m_materials.push_back(material);
+    return (uint32_t)m_materials.size() - 1;
+}
+
+uint32_t RenderWorld::GetOrCreateBatch(const std::shared_ptr<RenderItem>& renderItem, const Material& material)
+{
+    // Mesh indices follow the occluder meshes, there is one per mesh
+    auto meshIt = m_meshesIndices.emplace(renderItem->GetMeshIdentifier(), (uint32_t)m_occluderMeshes.size()).first;
+    uint32_t meshIndex = meshIt->second;
+    uint32_t materialIndex = GetOrCreateMaterial(material);
+
+    uint64_t batchKey = ((uint64_t)meshIndex << 32) | materialIndex;
+    auto it = m_batchesIndices.find(batchKey);
+    if(it != m_batchesIndices.end())
+        return it->second;
+
+    RenderMeshData rmd;
+    rmd.MeshIdentifier = renderItem->GetMeshIdentifier();
+    rmd.Material = material;
+    rmd.MeshIndex = meshIndex;
+    rmd.MaterialIndex = materialIndex;
+    rmd.Item = renderItem;
+    rmd.BoundsMin = renderItem->GetBoundsMin();
+    rmd.BoundsMax = renderItem->GetBoundsMax();
+
+    // One LOD index for the whole mesh, it has to hold for the primitive that simplified the worst
+    for(const auto& primitive : renderItem->GetPrimitives())
+    {
+        rmd.LodCount = std::max(rmd.LodCount, (uint32_t)primitive.m_lods.size());
+        for(uint32_t lod = 0; lod < MESH_LOD_MAX_COUNT; lod++)
+        {
+            if(!primitive.m_lods.empty())
+                rmd.LodErrors[lod] = std::max(rmd.LodErrors[lod], primitive.m_lods[std::min(lod, (uint32_t)primitive.m_lods.size() - 1)].Error);
+        }
+    }
+
+    // Every primitive proxy merged, primitives without one are simply not occluding
+    if(meshIndex == m_occluderMeshes.size())
+    {
+        OccluderMesh occluder;
+        for(const auto& primitive : renderItem->GetPrimitives())
+        {
+            uint32_t baseVertex = (uint32_t)occluder.Positions.size();
+            occluder.Positions.insert(occluder.Positions.end(), primitive.m_occluderPositions.begin(), primitive.m_occluderPositions.end());
+            for(uint16_t index : primitive.m_occluderIndices)
+                occluder.Indices.push_back(baseVertex + index);
+        }
+        m_occluderMeshes.emplace_back(std::move(occluder));
+    }
+
+    uint32_t meshIdx = (uint32_t)m_renderMeshesData.size();
+    m_renderMeshesData.emplace_back(rmd);
+    m_instancePools.emplace_back(std::make_shared<InstancePool>(m_renderer, rmd.BoundsMin, rmd.BoundsMax));
+    m_batchesIndices.emplace(batchKey, meshIdx);
+
+    return meshIdx;
+}
+
+void RenderWorld::CullInstances(const RenderWorldView& view)
+{
+    PROFILE_FUNCTION();
+
+    // Every pool split in ranges of at most INSTANCE_CULLING_GRAIN_SIZE slots, all of them go through one parallel loop
+    m_cullingRanges.clear();
+    for(uint32_t meshIdx = 0; meshIdx < m_instancePools.size(); meshIdx++)
+    {
+        uint32_t slotCount = m_instancePools[meshIdx]->GetSlotCount();
+        for(uint32_t begin = 0; begin < slotCount; begin += INSTANCE_CULLING_GRAIN_SIZE)
+            m_cullingRanges.push_back({ meshIdx, begin, std::min(begin + INSTANCE_CULLING_GRAIN_SIZE, slotCount), 0, {} });
+    }
+
+    static_assert(1 + SHADOW_CASCADE_COUNT <= INSTANCE_CULLING_MAX_VIEWS, "The camera and the shadow cascades do not fit in the visibility bits");
+    CullingFrustum frustums[1 + SHADOW_CASCADE_COUNT];
+    frustums[0] = InstanceCulling::MakeFrustum(DirectX::XMLoadFloat4x4(&view.CameraViewProj));
+    for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+        frustums[1 + cascade] = InstanceCulling::MakeFrustum(DirectX::XMLoadFloat4x4(&view.CascadeViewProjs[cascade]));
+
+    auto CullRanges = [this, &frustums](uint32_t begin, uint32_t end)
+    {
+        for(uint32_t i = begin; i < end; i++)
+        {
+            const CullingRange& range = m_cullingRanges[i];
+            m_instancePools[range.Mesh]->Cull(range.Begin, range.End, frustums, 1 + SHADOW_CASCADE_COUNT);
+        }
+    };
+
+    uint32_t rangeCount = (uint32_t)m_cullingRanges.size();
+    if(JobSystem::Get() && rangeCount > 1)
+        JobSystem::Get()->ParallelFor(rangeCount, 1, CullRanges);
+    else
+        CullRanges(0, rangeCount);
+}
+
+void RenderWorld::CullOcclusion(const RenderWorldView& view)
+{
+    PROFILE_FUNCTION();
+
+    // The shadow pass draws with front face culling, its occluders are rasterized the same way
+    m_cameraOcclusion.Clear(DirectX::XMLoadFloat4x4(&view.CameraViewProj));
+    SelectOccluders(m_cameraOcclusion, CameraViewBit);
+    m_cameraOcclusion.Rasterize();
+
+    for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+    {
+        m_cascadeOcclusion[cascade].Clear(DirectX::XMLoadFloat4x4(&view.CascadeViewProjs[cascade]), true);
+        SelectOccluders(m_cascadeOcclusion[cascade], GetCascadeViewBit(cascade));
+        m_cascadeOcclusion[cascade].Rasterize();
+    }
+
+    // Same ranges as the frustum culling, only the instances still inside a view get tested against its buffer
+    auto CullRanges = [this](uint32_t begin, uint32_t end)
+    {
+        for(uint32_t i = begin; i < end; i++)
+        {
+            CullingRange& range = m_cullingRanges[i];
+            auto& pool = m_instancePools[range.Mesh];
+            range.CameraOccludedCount = pool->CullOcclusion(range.Begin, range.End, m_cameraOcclusion, CameraViewBit);
+            for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+                range.CascadeOccludedCounts[cascade] = pool->CullOcclusion(range.Begin, range.End, m_cascadeOcclusion[cascade], GetCascadeViewBit(cascade));
+        }
+    };
+
+    uint32_t rangeCount = (uint32_t)m_cullingRanges.size();
+    if(JobSystem::Get() && rangeCount > 1)
+        JobSystem::Get()->ParallelFor(rangeCount, 1, CullRanges);
+    else
+        CullRanges(0, rangeCount);
+}
+
+void RenderWorld::SelectOccluders(MaskedOcclusionBuffer& buffer, uint32_t viewBit)
+{
+    using namespace DirectX;
+
+    m_occluderCandidates.clear();
+    for(uint32_t meshIdx = 0; meshIdx < m_instancePools.size(); meshIdx++)
+    {
+        if(m_occluderMeshes[m_renderMeshesData[meshIdx].MeshIndex].Indices.empty())
+            continue;
+
+        auto& pool = m_instancePools[meshIdx];
+        const InstanceBounds& bounds = pool->GetBounds();
+        for(uint32_t slot = 0; slot < pool->GetSlotCount(); slot++)
+        {
+            if(!(pool->GetVisibility(slot) & viewBit))
+                continue;
+
+            XMVECTOR center = XMVectorSet(bounds.CenterX[slot], bounds.CenterY[slot], bounds.CenterZ[slot], 1.0f);
+            float radius = XMVectorGetX(XMVector3Length(XMVectorSet(bounds.ExtentX[slot], bounds.ExtentY[slot], bounds.ExtentZ[slot], 0.0f)));
+            float screenRadius = buffer.GetScreenRadius(center, radius);
+            if(screenRadius >= OCCLUSION_MIN_OCCLUDER_RADIUS)
+                m_occluderCandidates.push_back({ meshIdx, slot, radius, screenRadius });
+        }
+    }
+
+    // The largest on screen, then sorted front to back : radius / screen radius grows with the distance
+    uint32_t occluderCount = std::min((uint32_t)m_occluderCandidates.size(), (uint32_t)OCCLUSION_MAX_OCCLUDERS);
+    std::partial_sort(m_occluderCandidates.begin(), m_occluderCandidates.begin() + occluderCount, m_occluderCandidates.end(),
+        [](const OccluderCandidate& a, const OccluderCandidate& b) { return a.ScreenRadius > b.ScreenRadius; });
+    std::sort(m_occluderCandidates.begin(), m_occluderCandidates.begin() + occluderCount,
+        [](const OccluderCandidate& a, const OccluderCandidate& b) { return a.Radius * b.ScreenRadius < b.Radius * a.ScreenRadius; });
+
+    for(uint32_t i = 0; i < occluderCount; i++)
+    {
+        const OccluderCandidate& candidate = m_occluderCandidates[i];
+        buffer.AddOccluder(&m_occluderMeshes[m_renderMeshesData[candidate.Mesh].MeshIndex], m_instancePools[candidate.Mesh]->GetInstances()[candidate.Slot].WorldMat);
+    }
+}
+
+void RenderWorld::BuildDrawLists(uint32_t meshIdx, uint32_t frameIndex, const RenderWorldView& view)
+{
+    using namespace DirectX;
+
+    auto& rmd = m_renderMeshesData[meshIdx];
+    auto& pool = m_instancePools[meshIdx];
+    const InstanceData* instances = pool->GetInstances();
+
+    XMVECTOR boundsMin = XMLoadFloat3(&rmd.BoundsMin);
+    XMVECTOR boundsMax = XMLoadFloat3(&rmd.BoundsMax);
+    XMVECTOR localCenter = XMVectorScale(XMVectorAdd(boundsMin, boundsMax), 0.5f);
+    float localRadius = 0.5f * XMVectorGetX(XMVector3Length(XMVectorSubtract(boundsMax, boundsMin)));
+    XMMATRIX cameraViewProj = XMLoadFloat4x4(&view.CameraViewProj);
+
+    uint32_t lodOffsets[MESH_LOD_MAX_COUNT];
+    uint32_t cascadeLodOffsets[SHADOW_CASCADE_COUNT][(uint32_t)ShadowCasterLayer::Count][MESH_LOD_MAX_COUNT];
+    std::fill(std::begin(rmd.LodInstanceCounts), std::end(rmd.LodInstanceCounts), 0);
+    std::fill(std::begin(rmd.LodNearestDepths), std::end(rmd.LodNearestDepths), FLT_MAX);
+    memset(rmd.CascadeLodInstanceCounts, 0, sizeof(rmd.CascadeLodInstanceCounts));
+
+    // Free slots have empty bounds and are never visible. Instances culled from every view keep their last LOD.
+    for(uint32_t slot = 0; slot < pool->GetSlotCount(); slot++)
+    {
+        uint32_t visibility = pool->GetVisibility(slot);
+        if(visibility == 0)
+            continue;
+
+        XMMATRIX world = XMLoadFloat4x4(&instances[slot].WorldMat);
+        float worldScale = sqrtf(std::max(std::max(XMVectorGetX(XMVector3LengthSq(world.r[0])), XMVectorGetX(XMVector3LengthSq(world.r[1]))), XMVectorGetX(XMVector3LengthSq(world.r[2]))));
+        XMFLOAT3 center;
+        XMStoreFloat3(&center, XMVector3Transform(localCenter, world));
+
+        float pixelsPerUnit = LodSelection::GetPixelsPerUnit(center, localRadius * worldScale, worldScale, view.Lod);
+        uint32_t lod = LodSelection::SelectLod(rmd.LodErrors, rmd.LodCount, pixelsPerUnit, pool->GetLod(slot));
+        pool->SetLod(slot, lod);
+
+        if(visibility & CameraViewBit)
+        {
+            rmd.LodInstanceCounts[lod]++;
+            // Clip space w is the view depth
+            float depth = XMVectorGetW(XMVector3Transform(XMLoadFloat3(&center), cameraViewProj));
+            rmd.LodNearestDepths[lod] = std::min(rmd.LodNearestDepths[lod], depth);
+        }
+        uint32_t shadowLod = std::min(lod + MESH_LOD_SHADOW_BIAS, rmd.LodCount - 1);
+        uint32_t layer = GetShadowCasterLayer(*pool, slot);
+        for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+        {
+            if(visibility & GetCascadeViewBit(cascade))
+                rmd.CascadeLodInstanceCounts[cascade][layer][shadowLod]++;
+        }
+    }
+
+    // Counting sort of the visible slots by LOD, camera list first then one list per cascade and caster layer
+    rmd.VisibleInstanceCount = 0;
+    for(uint32_t lod = 0; lod < MESH_LOD_MAX_COUNT; lod++)
+    {
+        lodOffsets[lod] = rmd.VisibleInstanceCount;
+        rmd.VisibleInstanceCount += rmd.LodInstanceCounts[lod];
+    }
+
+    uint32_t drawInstanceCount = rmd.VisibleInstanceCount;
+    for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+    {
+        rmd.CascadeVisibleInstanceCounts[cascade] = 0;
+        for(uint32_t layer = 0; layer < (uint32_t)ShadowCasterLayer::Count; layer++)
+        {
+            for(uint32_t lod = 0; lod < MESH_LOD_MAX_COUNT; lod++)
+            {
+                cascadeLodOffsets[cascade][layer][lod] = drawInstanceCount + rmd.CascadeVisibleInstanceCounts[cascade];
+                rmd.CascadeVisibleInstanceCounts[cascade] += rmd.CascadeLodInstanceCounts[cascade][layer][lod];
+            }
+        }
+        drawInstanceCount += rmd.CascadeVisibleInstanceCounts[cascade];
+    }
+
+    m_drawInstances.resize(drawInstanceCount);
+    for(uint32_t slot = 0; slot < pool->GetSlotCount(); slot++)
+    {
+        uint32_t visibility = pool->GetVisibility(slot);
+        uint32_t lod = pool->GetLod(slot);
+        if(visibility & CameraViewBit)
+            m_drawInstances[lodOffsets[lod]++] = slot;
+
+        uint32_t shadowLod = std::min(lod + MESH_LOD_SHADOW_BIAS, rmd.LodCount - 1);
+        uint32_t layer = GetShadowCasterLayer(*pool, slot);
+        for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+        {
+            if(visibility & GetCascadeViewBit(cascade))
+                m_drawInstances[cascadeLodOffsets[cascade][layer][shadowLod]++] = slot;
+        }
+    }
+
+    uint32_t firstInstance = rmd.VisibleInstanceCount;
+    for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+    {
+        for(uint32_t layer = 0; layer < (uint32_t)ShadowCasterLayer::Count; layer++)
+        {
+            uint64_t& key = m_shadowCacheKeys.Layers[cascade][layer];
+            for(uint32_t lod = 0; lod < MESH_LOD_MAX_COUNT; lod++)
+            {
+                uint32_t instanceCount = rmd.CascadeLodInstanceCounts[cascade][layer][lod];
+                if(instanceCount == 0)
+                    continue;
+
+                key = ShadowCache::HashCasters(key, meshIdx, lod, &m_drawInstances[firstInstance], instanceCount, instances,
+                    layer == (uint32_t)ShadowCasterLayer::Dynamic);
+                firstInstance += instanceCount;
+            }
+        }
+    }
+
+    pool->UploadDrawInstances(frameIndex, m_drawInstances);
+}
+
+void RenderWorld::BuildCameraDrawList()
+{
+    PROFILE_FUNCTION();
+
+    // One packet per LOD run of every batch, the GBuffer is the only pass and pipeline using the list
+    m_cameraDrawList.Clear();
+    for(uint32_t meshIdx = 0; meshIdx < m_renderMeshesData.size(); meshIdx++)
+    {
+        const auto& rmd = m_renderMeshesData[meshIdx];
+        uint32_t firstInstance = 0;
+        for(uint32_t lod = 0; lod < rmd.LodCount; lod++)
+        {
+            uint32_t instanceCount = rmd.LodInstanceCounts[lod];
+            if(instanceCount == 0)
+                continue;
+
+            uint64_t key = DrawList::MakeKey(0, 0, rmd.MaterialIndex, rmd.MeshIndex, rmd.LodNearestDepths[lod]);
+            m_cameraDrawList.Add({ key, meshIdx, lod, firstInstance, instanceCount });
+            firstInstance += instanceCount;
+        }
+    }
+
+    m_cameraDrawList.Sort();
+}
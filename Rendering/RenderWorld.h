@@ -0,0 +1,130 @@
+﻿#pragma once
+#include "RenderPass.h"
+#include "InstancePool.h"
+#include "DynamicBVH.h"
+#include "ECS/Scene.h"
+
+// What the instances are culled and their LOD selected against this frame
+struct RenderWorldView
+{
+    LodSelectionView Lod;
+    DirectX::XMFLOAT4X4 CameraViewProj;
+    DirectX::XMFLOAT4X4 CascadeViewProjs[SHADOW_CASCADE_COUNT];
+    bool OcclusionCulling = true;
+};
+
+// Instance counts of the last Upload, the culled ones are the instances minus the visible and the occluded ones
+struct RenderWorldStats
+{
+    uint32_t InstanceCount = 0;
+    uint32_t CameraVisibleCount = 0;
+    uint32_t CameraOccludedCount = 0;
+    uint32_t CascadeVisibleCounts[SHADOW_CASCADE_COUNT] = {};
+    uint32_t CascadeOccludedCounts[SHADOW_CASCADE_COUNT] = {};
+    uint32_t OccluderCount = 0; // All views
+    uint32_t OccluderTriangleCount = 0;
+};
+
+// Persistent renderer side copy of the scene, only the entities flagged as changed are synced each frame
+class RenderWorld
+{
+public:
+    RenderWorld(std::shared_ptr<D3D12Renderer> renderer);
+    ~RenderWorld();
+
+    void Sync(Scene& scene);
+    // Copies the instances changed since the given frame buffers were last written, culls them and builds the frame draw lists
+    void Upload(uint32_t frameIndex, const RenderWorldView& view);
+
+    const std::vector<RenderMeshData>& GetRenderMeshesData() const { return m_renderMeshesData; }
+    // Camera draws of the last Upload, sorted by material then mesh
+    const DrawList& GetCameraDrawList() const { return m_cameraDrawList; }
+    const std::vector<PointLight>& GetPointLights() const { return m_pointLights; }
+    const RenderWorldStats& GetStats() const { return m_stats; }
+    // Keys of the cascade layers drawn from the last Upload lists
+    const ShadowCacheKeys& GetShadowCacheKeys() const { return m_shadowCacheKeys; }
+
+    // Closest mesh instance along the ray, exact against the LOD 0 triangles. Hits carry entity indices, batched rays are traced in parallel.
+    bool Raycast(const BVHRay& ray, BVHRayHit& hit) const;
+    void Raycast(const BVHRay* rays, uint32_t count, BVHRayHit* hits) const;
+    // World bounds of the mesh instances for the box and sphere queries, the leaves user data are entity indices
+    const DynamicBVH& GetBVH() const { return m_bvh; }
+
+private:
+    struct InstanceSlot
+    {
+        uint32_t Mesh = UINT32_MAX; // Batch
+        uint32_t Instance = UINT32_MAX;
+        uint32_t Proxy = UINT32_MAX; // In m_bvh
+    };
+
+    struct CullingRange
+    {
+        uint32_t Mesh;
+        uint32_t Begin;
+        uint32_t End;
+        uint32_t CameraOccludedCount;
+        uint32_t CascadeOccludedCounts[SHADOW_CASCADE_COUNT];
+    };
+
+    struct OccluderCandidate
+    {
+        uint32_t Mesh;
+        uint32_t Slot;
+        float Radius;
+        float ScreenRadius;
+    };
+
+    // Visibility bits, in the order of the frustums handed to the culling : the camera then every shadow cascade
+    static constexpr uint32_t CameraViewBit = 1 << 0;
+    static constexpr uint32_t GetCascadeViewBit(uint32_t cascade) { return 1 << (1 + cascade); }
+    static uint32_t GetShadowCasterLayer(const InstancePool& pool, uint32_t slot)
+    {
+        return (uint32_t)(pool.GetStillFrames(slot) >= SHADOW_CACHE_STATIC_FRAMES ? ShadowCasterLayer::Static : ShadowCasterLayer::Dynamic);
+    }
+
+    void SyncEntity(Scene& scene, Entity entity, uint32_t changeFlags);
+
+    void AddMeshInstance(uint32_t entityIndex, const std::shared_ptr<RenderItem>& renderItem, const Material& material, const DirectX::XMFLOAT4X4& transform);
+    void RemoveMeshInstance(uint32_t entityIndex);
+    void AddPointLight(uint32_t entityIndex, const PointLight& pointLight);
+    void RemovePointLight(uint32_t entityIndex);
+    BVHBox GetInstanceBox(const InstanceSlot& slot) const;
+    float RaycastInstance(const BVHRay& ray, uint32_t entityIndex, float maxDistance) const;
+
+    uint32_t GetOrCreateMaterial(const Material& material);
+    uint32_t GetOrCreateBatch(const std::shared_ptr<RenderItem>& renderItem, const Material& material);
+    void CullInstances(const RenderWorldView& view);
+    void CullOcclusion(const RenderWorldView& view);
+    void SelectOccluders(MaskedOcclusionBuffer& buffer, uint32_t viewBit);
+    void BuildDrawLists(uint32_t meshIdx, uint32_t frameIndex, const RenderWorldView& view);
+    void BuildCameraDrawList();
+
+    std::shared_ptr<D3D12Renderer> m_renderer;
+
+    std::unordered_map<std::string, uint32_t> m_meshesIndices;
+    std::vector<Material> m_materials;
+    std::unordered_map<uint64_t, uint32_t> m_batchesIndices; // Mesh index in the high bits, material index in the low ones
+    // Indexed by batch
+    std::vector<RenderMeshData> m_renderMeshesData;
+    std::vector<std::shared_ptr<InstancePool>> m_instancePools;
+    std::vector<uint32_t> m_drawInstances;
+    std::vector<CullingRange> m_cullingRanges;
+    DrawList m_cameraDrawList;
+
+    std::vector<OccluderMesh> m_occluderMeshes; // Indexed by mesh, empty without proxy
+    std::vector<OccluderCandidate> m_occluderCandidates;
+    MaskedOcclusionBuffer m_cameraOcclusion;
+    MaskedOcclusionBuffer m_cascadeOcclusion[SHADOW_CASCADE_COUNT];
+    RenderWorldStats m_stats;
+    ShadowCacheKeys m_shadowCacheKeys;
+
+    DynamicBVH m_bvh;
+
+    std::vector<PointLight> m_pointLights;
+    std::vector<uint32_t> m_pointLightsOwners;
+
+    // Indexed by entity index
+    std::vector<InstanceSlot> m_entitiesInstances;
+    std::vector<uint32_t> m_entitiesPointLights;
+};
@@ -1,14 +1,13 @@
 ﻿#pragma once
 #include "Core.h"
-
-#define MAX_LIGHTS 150
+#include "CascadedShadows.h"
 
 #define MAX_INSTANCES 300
 
 struct PointLight
 {
     DirectX::XMFLOAT3 Position;
-    float Radius = 20.0f;
+    float Radius = 0.0f; // Set from the attenuation by LightClustering::Build
     // 16 bytes boundary 
     DirectX::XMFLOAT4 Color = { 1.0, 1.0, 1.0, 1.0 };
     // 16 bytes boundary 
@@ -18,9 +17,25 @@ struct PointLight
     float Padding3 = 0.0f;
 };
 
-struct PointLightsConstantBuffer
+// Point lights of one view froxel : LightIndices[Offset, Offset + Count) index the point lights buffer
+struct LightCluster
 {
-    PointLight PointLights[MAX_LIGHTS];
+    uint32_t Offset;
+    uint32_t Count;
+};
+
+struct LightClusterConstantBuffer
+{
+    DirectX::XMFLOAT4 ViewDepth; // View matrix third column, view space depth = dot(float4(positionWS, 1), ViewDepth)
+    // 16 bytes boundary
+    uint32_t ClusterCountX;
+    uint32_t ClusterCountY;
+    uint32_t ClusterCountZ;
+    float SliceScale;
+    // 16 bytes boundary
+    float SliceBias; // slice = log(depth) * SliceScale + SliceBias
+    float TileScale[2]; // Clusters per pixel
+    float Padding;
 };
 
 struct SceneConstantBuffer
@@ -39,8 +54,6 @@ struct SceneConstantBuffer
     // 16 bytes boundary
     DirectX::XMFLOAT4X4 InvViewProj;
     // 16 bytes boundary
-    DirectX::XMFLOAT4X4 ShadowTransform;
-    // 16 bytes boundary
     int ShadowEnabled;
     float Paddin2[3];
 };
@@ -54,6 +67,16 @@ struct ObjectConstantBuffer
     int HasMetallicRoughness = false;
 };
 
+// Dequantization of the CompactVertex positions : position = quantized * PositionScale + PositionOffset
+struct PrimitiveConstantBuffer
+{
+    DirectX::XMFLOAT3 PositionScale;
+    float Padding0;
+    // 16 bytes boundary
+    DirectX::XMFLOAT3 PositionOffset;
+    float Padding1;
+};
+
 struct ScreenQuadVertex
 {
     DirectX::XMFLOAT4 Position;
@@ -85,6 +108,19 @@ struct ShadowMapConstantBuffer
     DirectX::XMFLOAT4X4 ViewProj;
 };
 
+// One float per cascade in the float4 members
+static_assert(SHADOW_CASCADE_COUNT <= 4, "ShadowCascadeConstantBuffer packs the cascades in float4");
+
+struct ShadowCascadeConstantBuffer
+{
+    DirectX::XMFLOAT4X4 Transforms[SHADOW_CASCADE_COUNT]; // World space to atlas uv and depth
+    DirectX::XMFLOAT4 UvRects[SHADOW_CASCADE_COUNT]; // Atlas tile of each cascade, min uv then max uv
+    // 16 bytes boundary
+    DirectX::XMFLOAT4 Splits; // Farthest view depth of each cascade, none beyond the last one
+    DirectX::XMFLOAT4 TexelDepths;
+    DirectX::XMFLOAT4 ViewDepth; // View matrix third column, view space depth = dot(float4(positionWS, 1), ViewDepth)
+};
+
 struct SSAOConstantBuffer
 {
     float Value = 0.5f;
@@ -10,21 +10,17 @@ void SSAORenderPass::Initialize(std::shared_ptr<D3D12Renderer> renderer, int wid
 
     m_constantBuffer = renderer->CreateBuffer(256, 0, BufferType::Constant, false);
     renderer->CreateConstantBuffer(m_constantBuffer);
-
-    OnResize(renderer, width, height);
 }
 
 void SSAORenderPass::OnResize(std::shared_ptr<D3D12Renderer> renderer, int width, int height)
 {
-    m_SSAOTexture.reset();
-    
-    m_SSAOTexture = renderer->CreateTexture(width, height, TextureFormat::R16Norm, TextureType::Storage);
-    renderer->CreateUnorderedAccessView(m_SSAOTexture);
-    renderer->CreateShaderResourceView(m_SSAOTexture);
+    // Nothing to resize, the render graph transient the pass writes is sized by the editor each frame
 }
 
 void SSAORenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const GlobalPassData& globalPassData, const Camera& camera, const std::vector<RenderMeshData>& renderMeshesData, RenderTargetInfo renderTarget)
 {
+    PROFILE_FUNCTION();
+
     SSAOConstantBuffer constantBuffer;
     constantBuffer.Value = 0.7f;
 
@@ -33,16 +29,19 @@ void SSAORenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const GlobalP
     memcpy(data, &constantBuffer, sizeof(SSAOConstantBuffer));
     m_constantBuffer->Unmap(0, 0);
 
+    // Render graph transient, created with SSAO_TEXTURE_FORMAT
+    m_SSAOTexture = renderTarget.RenderTexture;
+
     auto commandList = renderer->GetCurrentCommandList();
 
     commandList->BindComputePipeline(m_SSAOPipeline);
-    commandList->ImageBarrier(m_SSAOTexture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
     commandList->BindComputeUnorderedAccessView(m_SSAOTexture, 0);
     // commandList->BindComputeConstantBuffer(m_constantBuffer, 1);
     commandList->BindComputeShaderResource(globalPassData.GBuffer.DepthBuffer, 1);
     commandList->BindComputeSampler(m_sampler, 2);
     
-    commandList->Dispatch(m_width / 32, m_height / 32, 6);
-    
-    commandList->ImageBarrier(m_SSAOTexture, D3D12_RESOURCE_STATE_GENERIC_READ);
+    // One 32x32 group per tile of the transient, partial tiles at the edges included
+    int groupCountX = (m_SSAOTexture->GetWidth() + 31) / 32;
+    int groupCountY = (m_SSAOTexture->GetHeight() + 31) / 32;
+    commandList->Dispatch(groupCountX, groupCountY, 1);
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 ﻿#pragma once
 #include "RenderPass.h"
 
+#define SSAO_TEXTURE_FORMAT TextureFormat::R16Norm
+
 class SSAORenderPass : public RenderPass
 {
 public:
@@ -8,12 +10,10 @@ public:
     void Pass(std::shared_ptr<D3D12Renderer> renderer, const GlobalPassData& globalPassData, const Camera& camera, const std::vector<RenderMeshData>& renderMeshesData, RenderTargetInfo renderTarget) override;
     void OnResize(std::shared_ptr<D3D12Renderer> renderer, int width, int height) override;
 
+    // Last texture written, the pass renders into the one it is given
     std::shared_ptr<Texture> GetSSAOTexture() { return m_SSAOTexture; }
 
 private:
-    int m_width = 512;
-    int m_height = 512;
-    
     std::shared_ptr<ComputePipeline> m_SSAOPipeline;
     std::shared_ptr<Texture> m_SSAOTexture;
     std::shared_ptr<Buffer> m_constantBuffer;
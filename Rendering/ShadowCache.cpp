@@ -0,0 +1,64 @@
+﻿#include "ShadowCache.h"
+
+uint64_t ShadowCache::Hash(uint64_t hash, const void* data, size_t size)
+{
+    const uint32_t* words = static_cast<const uint32_t*>(data);
+    for(size_t i = 0; i < size / sizeof(uint32_t); i++)
+    {
+        hash ^= words[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+uint64_t ShadowCache::HashCasters(uint64_t hash, uint32_t mesh, uint32_t lod, const uint32_t* slots, uint32_t count,
+    const InstanceData* instances, bool withTransforms)
+{
+    uint32_t header[] = { mesh, lod, count };
+    hash = Hash(hash, header, sizeof(header));
+    hash = Hash(hash, slots, sizeof(uint32_t) * count);
+    if(withTransforms)
+    {
+        for(uint32_t i = 0; i < count; i++)
+            hash = Hash(hash, &instances[slots[i]].WorldMat, sizeof(DirectX::XMFLOAT4X4));
+    }
+
+    return hash;
+}
+
+ShadowCacheUpdate ShadowCache::Update(const ShadowCacheKeys& keys)
+{
+    constexpr uint32_t staticLayer = (uint32_t)ShadowCasterLayer::Static;
+    constexpr uint32_t dynamicLayer = (uint32_t)ShadowCasterLayer::Dynamic;
+
+    ShadowCacheUpdate update;
+    m_stats.StaticPassCount = 0;
+    m_stats.DynamicPassCount = 0;
+    for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+    {
+        update.RedrawStatic[cascade] = !m_valid || keys.Layers[cascade][staticLayer] != m_keys.Layers[cascade][staticLayer];
+        if(update.RedrawStatic[cascade] || keys.Layers[cascade][dynamicLayer] != m_keys.Layers[cascade][dynamicLayer])
+            update.RestoreDynamic = true;
+        if(update.RedrawStatic[cascade])
+            m_stats.StaticPassCount++;
+    }
+
+    // The copy of the static layers wipes every dynamic one
+    if(update.RestoreDynamic)
+        m_stats.DynamicPassCount = SHADOW_CASCADE_COUNT;
+
+    m_stats.FrameCount++;
+    m_stats.SkippedStaticPassCount += SHADOW_CASCADE_COUNT - m_stats.StaticPassCount;
+    m_stats.SkippedDynamicPassCount += SHADOW_CASCADE_COUNT - m_stats.DynamicPassCount;
+
+    m_keys = keys;
+    m_valid = true;
+    return update;
+}
+
+void ShadowCache::Invalidate()
+{
+    m_valid = false;
+    m_stats = ShadowCacheStats();
+}
@@ -0,0 +1,62 @@
+﻿#pragma once
+#include "CascadedShadows.h"
+#include "RenderingLayouts.h"
+
+// Casters whose transform did not change for this many frames are drawn into the cached static layer
+#define SHADOW_CACHE_STATIC_FRAMES 30
+
+// The static layer of a cascade is only redrawn when its key changes. The dynamic casters are drawn over a copy
+// of the static layers, only when a static layer was redrawn or a dynamic key changed.
+enum class ShadowCasterLayer : uint32_t
+{
+    Static = 0,
+    Dynamic = 1,
+    Count = 2
+};
+
+// Hashes of everything drawn into each cascade layer : the cascade projection, which carries the light direction,
+// and the caster lists. The static lists hash their slots and LODs, their transforms have not changed by definition.
+struct ShadowCacheKeys
+{
+    uint64_t Layers[SHADOW_CASCADE_COUNT][(uint32_t)ShadowCasterLayer::Count] = {};
+};
+
+// What the shadow pass draws this frame
+struct ShadowCacheUpdate
+{
+    bool RedrawStatic[SHADOW_CASCADE_COUNT] = {};
+    bool RestoreDynamic = false; // Copy the static layers over the sampled atlas, then draw every dynamic layer
+};
+
+struct ShadowCacheStats
+{
+    uint32_t StaticPassCount = 0; // Last Update
+    uint32_t DynamicPassCount = 0;
+    uint64_t FrameCount = 0; // Since the last Invalidate
+    uint64_t SkippedStaticPassCount = 0;
+    uint64_t SkippedDynamicPassCount = 0;
+};
+
+// CPU side of the shadow map caching, remembers the keys the atlas layers were last drawn with
+class ShadowCache
+{
+public:
+    static constexpr uint64_t HashSeed = 14695981039346656037ull;
+
+    // FNV-1a over 32 bits words, size must be a multiple of 4
+    static uint64_t Hash(uint64_t hash, const void* data, size_t size);
+    // Appends the casters drawn from one mesh list : mesh, LOD, slots and when withTransforms the world matrices
+    static uint64_t HashCasters(uint64_t hash, uint32_t mesh, uint32_t lod, const uint32_t* slots, uint32_t count,
+        const InstanceData* instances, bool withTransforms);
+
+    ShadowCacheUpdate Update(const ShadowCacheKeys& keys);
+    // The layers content is lost (resize), everything is redrawn at the next Update
+    void Invalidate();
+
+    const ShadowCacheStats& GetStats() const { return m_stats; }
+
+private:
+    ShadowCacheKeys m_keys;
+    bool m_valid = false;
+    ShadowCacheStats m_stats;
+};
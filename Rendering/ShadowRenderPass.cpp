@@ -1,5 +1,7 @@
 ﻿#include "ShadowRenderPass.h"
 
+#include <numeric>
+
 void ShadowRenderPass::Initialize(std::shared_ptr<D3D12Renderer> renderer, int width, int height)
 {
     GraphicsPipelineSpecs shadowSpecs;
@@ -12,39 +14,25 @@ void ShadowRenderPass::Initialize(std::shared_ptr<D3D12Renderer> renderer, int w
     shadowSpecs.BlendOperation = BlendOperation::None;
     ShaderCompiler::CompileShader("Shaders/ShadowMapVertex.hlsl", ShaderType::Vertex, shadowSpecs.ShadersBytecodes[ShaderType::Vertex]);
     ShaderCompiler::CompileShader("Shaders/ShadowMapPixel.hlsl", ShaderType::Pixel, shadowSpecs.ShadersBytecodes[ShaderType::Pixel]);
+    VertexCompression::SetInputFormats(shadowSpecs);
 
     m_shadowPipeline = renderer->CreateGraphicsPipeline(shadowSpecs);
 
-    m_constantBuffer = renderer->CreateBuffer(256, 0, BufferType::Constant, false);
-    renderer->CreateConstantBuffer(m_constantBuffer);
+    for(auto& constantBuffer : m_constantBuffers)
+    {
+        constantBuffer = renderer->CreateBuffer(256, 0, BufferType::Constant, false);
+        renderer->CreateConstantBuffer(constantBuffer);
+    }
+
+    m_shadowMap.CascadesConstantBuffer = renderer->CreateBuffer((sizeof(ShadowCascadeConstantBuffer) + 255) & ~255, 0, BufferType::Constant, false);
+    renderer->CreateConstantBuffer(m_shadowMap.CascadesConstantBuffer);
 
     OnResize(renderer, width, height);
 }
 
 void ShadowRenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const GlobalPassData& globalPassData, const Camera& camera, const std::vector<RenderMeshData>& renderMeshesData, RenderTargetInfo renderTarget)
 {
-    float sceneBoundsRadius = 15.0f;
-    
-    DirectX::XMVECTOR lightDir = DirectX::XMLoadFloat3(&globalPassData.DirectionalInfo.Direction);
-    DirectX::XMVECTOR lightPos = DirectX::XMVectorScale(lightDir, -2.0f * sceneBoundsRadius);
-    DirectX::XMFLOAT3 worldOrigin = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
-    DirectX::XMVECTOR targetPos = DirectX::XMLoadFloat3(&worldOrigin);
-    DirectX::XMVECTOR lightUp = DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-    DirectX::XMMATRIX lightView = DirectX::XMMatrixLookAtLH(lightPos, targetPos, lightUp);
-
-    // Transform bounding sphere to light space.
-    DirectX::XMFLOAT3 sphereCenterLS;
-    DirectX::XMStoreFloat3(&sphereCenterLS, XMVector3TransformCoord(targetPos, lightView));
-
-    // Ortho frustum in light space encloses scene.
-    float l = sphereCenterLS.x - sceneBoundsRadius;
-    float b = sphereCenterLS.y - sceneBoundsRadius;
-    float n = sphereCenterLS.z - sceneBoundsRadius;
-    float r = sphereCenterLS.x + sceneBoundsRadius;
-    float t = sphereCenterLS.y + sceneBoundsRadius;
-    float f = sphereCenterLS.z + sceneBoundsRadius;
-
-    DirectX::XMMATRIX lightProj = DirectX::XMMatrixOrthographicOffCenterLH(l, r, b, t, n, f);
+    PROFILE_FUNCTION();
 
     // Transform NDC space [-1,+1]^2 to texture space [0,1]^2
     DirectX::XMMATRIX T(
@@ -53,76 +41,141 @@ void ShadowRenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const Globa
         0.0f, 0.0f, 1.0f, 0.0f,
         0.5f, 0.5f, 0.0f, 1.0f);
 
-    DirectX::XMMATRIX S = lightView * lightProj * T;
-    DirectX::XMStoreFloat4x4(&m_shadowMap.ShadowTransform, S);
+    float tileScaleX = 1.0f / SHADOW_CASCADE_ATLAS_COLUMNS;
+    float tileScaleY = 1.0f / SHADOW_CASCADE_ATLAS_ROWS;
 
-    DirectX::XMMATRIX viewProj = lightView * lightProj;
+    ShadowCascadeConstantBuffer cascadesCbuf = {};
+    for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+    {
+        const ShadowCascade& shadowCascade = globalPassData.ShadowCascades[cascade];
+
+        ShadowMapConstantBuffer cbuf;
+        cbuf.ViewProj = shadowCascade.ViewProj;
+
+        void* data;
+        m_constantBuffers[cascade]->Map(0, 0, &data);
+        memcpy(data, &cbuf, sizeof(ShadowMapConstantBuffer));
+        m_constantBuffers[cascade]->Unmap(0, 0);
+
+        // Texture space then the cascade tile of the atlas
+        float tileX = (cascade % SHADOW_CASCADE_ATLAS_COLUMNS) * tileScaleX;
+        float tileY = (cascade / SHADOW_CASCADE_ATLAS_COLUMNS) * tileScaleY;
+        DirectX::XMMATRIX tile = DirectX::XMMatrixScaling(tileScaleX, tileScaleY, 1.0f) * DirectX::XMMatrixTranslation(tileX, tileY, 0.0f);
+        DirectX::XMStoreFloat4x4(&cascadesCbuf.Transforms[cascade], DirectX::XMLoadFloat4x4(&shadowCascade.ViewProj) * T * tile);
+        cascadesCbuf.UvRects[cascade] = { tileX, tileY, tileX + tileScaleX, tileY + tileScaleY };
+        (&cascadesCbuf.Splits.x)[cascade] = shadowCascade.SplitFar;
+        (&cascadesCbuf.TexelDepths.x)[cascade] = shadowCascade.TexelDepth;
+    }
 
-    ShadowMapConstantBuffer cbuf;
-    DirectX::XMStoreFloat4x4(&cbuf.ViewProj, viewProj);
+    DirectX::XMFLOAT4X4 view;
+    DirectX::XMStoreFloat4x4(&view, camera.GetViewMatrix());
+    cascadesCbuf.ViewDepth = { view._13, view._23, view._33, view._43 };
 
     void* data;
-    m_constantBuffer->Map(0, 0, &data);
-    memcpy(data, &cbuf, sizeof(ShadowMapConstantBuffer));
-    m_constantBuffer->Unmap(0, 0);
-    
-    auto commandList = renderer->GetCurrentCommandList();
-
-    commandList->ImageBarrier(m_shadowMap.DepthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE);
-    commandList->ClearDepthTarget(m_shadowMap.DepthBuffer);
-    commandList->SetViewport(0, 0, m_shadowMapWidth, m_shadowMapHeight);
+    m_shadowMap.CascadesConstantBuffer->Map(0, 0, &data);
+    memcpy(data, &cascadesCbuf, sizeof(ShadowCascadeConstantBuffer));
+    m_shadowMap.CascadesConstantBuffer->Unmap(0, 0);
 
-    commandList->BindDepthTarget(m_shadowMap.DepthBuffer);
+    ShadowCacheUpdate update = m_cache.Update(globalPassData.ShadowCacheKeys);
+    bool redrawStatic = std::find(std::begin(update.RedrawStatic), std::end(update.RedrawStatic), true) != std::end(update.RedrawStatic);
+    if(!redrawStatic && !update.RestoreDynamic)
+        return;
 
+    auto commandList = renderer->GetCurrentCommandList();
     commandList->SetTopology(Topology::TriangleList);
     commandList->BindGraphicsPipeline(m_shadowPipeline);
-    commandList->BindGraphicsConstantBuffer(m_constantBuffer, 0);
 
-    for(const auto renderMeshData : renderMeshesData)
+    if(redrawStatic)
     {
-        auto& material = renderMeshData.Material;
-        
-        std::vector<InstanceData> instancesData;
-        for(auto instanceTransform : renderMeshData.InstancesTransforms)
+        commandList->ImageBarrier(m_staticDepthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+        commandList->BindDepthTarget(m_staticDepthBuffer);
+
+        for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
         {
-            InstanceData instanceData;
-            instanceData.WorldMat = instanceTransform;
-            instanceData.WorldMat = instanceTransform;
-            instanceData.HasAlbedo = material.HasAlbedo;
-            instanceData.HasNormalMap = material.HasNormal;
-            instanceData.HasMetallicRoughness = material.HasMetallicRoughness;
-            instancesData.emplace_back(instanceData);
+            if(!update.RedrawStatic[cascade])
+                continue;
+
+            commandList->ClearDepthTarget(m_staticDepthBuffer, (cascade % SHADOW_CASCADE_ATLAS_COLUMNS) * m_cascadeWidth, (cascade / SHADOW_CASCADE_ATLAS_COLUMNS) * m_cascadeHeight,
+                m_cascadeWidth, m_cascadeHeight);
+            DrawCascadeLayer(commandList, renderMeshesData, cascade, ShadowCasterLayer::Static);
         }
+    }
+
+    // Depth buffers can only be copied whole, every dynamic layer is drawn again over the copy
+    commandList->ImageBarrier(m_staticDepthBuffer, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    commandList->ImageBarrier(m_shadowMap.DepthBuffer, D3D12_RESOURCE_STATE_COPY_DEST);
+    commandList->CopyTextureToTexture(m_shadowMap.DepthBuffer, m_staticDepthBuffer);
+
+    commandList->ImageBarrier(m_shadowMap.DepthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+    commandList->BindDepthTarget(m_shadowMap.DepthBuffer);
+    for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+        DrawCascadeLayer(commandList, renderMeshesData, cascade, ShadowCasterLayer::Dynamic);
+}
+
+void ShadowRenderPass::DrawCascadeLayer(std::shared_ptr<CommandList> commandList, const std::vector<RenderMeshData>& renderMeshesData, uint32_t cascade, ShadowCasterLayer layer)
+{
+    commandList->SetViewport((float)((cascade % SHADOW_CASCADE_ATLAS_COLUMNS) * m_cascadeWidth), (float)((cascade / SHADOW_CASCADE_ATLAS_COLUMNS) * m_cascadeHeight),
+        (float)m_cascadeWidth, (float)m_cascadeHeight);
+    commandList->BindGraphicsConstantBuffer(m_constantBuffers[cascade], 0);
 
-        void* dt;
-        renderMeshData.InstancesDataBuffer->Map(0, 0, &dt);
-        memcpy(dt, instancesData.data(), sizeof(InstanceData) * renderMeshData.InstancesTransforms.size());
-        renderMeshData.InstancesDataBuffer->Unmap(0, 0);
+    for(const auto& renderMeshData : renderMeshesData)
+    {
+        const uint32_t* lodInstanceCounts = renderMeshData.CascadeLodInstanceCounts[cascade][(uint32_t)layer];
+        if(std::all_of(lodInstanceCounts, lodInstanceCounts + MESH_LOD_MAX_COUNT, [](uint32_t count) { return count == 0; }))
+            continue;
+
+        // The cascade lists follow the camera one in cascade order, static casters first, and are biased towards coarser LODs
+        uint32_t layerFirstInstance = renderMeshData.VisibleInstanceCount;
+        for(uint32_t previous = 0; previous < cascade; previous++)
+            layerFirstInstance += renderMeshData.CascadeVisibleInstanceCounts[previous];
+        if(layer == ShadowCasterLayer::Dynamic)
+        {
+            const uint32_t* staticCounts = renderMeshData.CascadeLodInstanceCounts[cascade][(uint32_t)ShadowCasterLayer::Static];
+            layerFirstInstance += std::accumulate(staticCounts, staticCounts + MESH_LOD_MAX_COUNT, 0u);
+        }
 
         commandList->SetGraphicsShaderResource(renderMeshData.InstancesDataBuffer, 1);
 
-        const auto primitives = renderMeshData.Primitives;
-        for(const auto& primitive : primitives)
+        for(const auto& primitive : renderMeshData.Item->GetPrimitives())
         {
-            commandList->BindVertexBuffer(primitive.m_vertexBuffer);
-            commandList->BindIndexBuffer(primitive.m_indicesBuffer);
-            commandList->DrawIndexed(primitive.m_indexCount, renderMeshData.InstancesTransforms.size());
+            commandList->BindGraphicsConstantBuffer(primitive.m_constantBuffer, 2);
+            // The position only input layout reads the full stream as well when the primitive has no position stream
+            bool hasPositionStream = primitive.m_positionBuffer != nullptr;
+            commandList->BindVertexBuffer(hasPositionStream ? primitive.m_positionBuffer : primitive.m_vertexBuffer);
+            commandList->BindIndexBuffer(hasPositionStream ? primitive.m_positionIndicesBuffer : primitive.m_indicesBuffer);
+
+            uint32_t firstInstance = layerFirstInstance;
+            for(uint32_t lod = 0; lod < renderMeshData.LodCount; lod++)
+            {
+                uint32_t instanceCount = lodInstanceCounts[lod];
+                if(instanceCount == 0)
+                    continue;
+
+                const MeshLod& meshLod = primitive.m_lods[std::min(lod, (uint32_t)primitive.m_lods.size() - 1)];
+                commandList->SetGraphicsShaderResource(renderMeshData.DrawInstancesBuffer, 3, sizeof(uint32_t) * firstInstance);
+                commandList->DrawIndexed(meshLod.IndexCount, instanceCount, meshLod.IndexOffset);
+                firstInstance += instanceCount;
+            }
         }
     }
-
-    commandList->ImageBarrier(m_shadowMap.DepthBuffer, D3D12_RESOURCE_STATE_GENERIC_READ);
 }
 
 void ShadowRenderPass::OnResize(std::shared_ptr<D3D12Renderer> renderer, int width, int height)
 {
-    m_shadowMapWidth = width;
-    m_shadowMapHeight = height;
+    m_cascadeWidth = width;
+    m_cascadeHeight = height;
     
     m_shadowMap.DepthBuffer.reset();
 
-    m_shadowMap.DepthBuffer = renderer->CreateTexture(width, height, TextureFormat::R32Depth, TextureType::DepthTarget);
+    m_shadowMap.DepthBuffer = renderer->CreateTexture(width * SHADOW_CASCADE_ATLAS_COLUMNS, height * SHADOW_CASCADE_ATLAS_ROWS, TextureFormat::R32Depth, TextureType::DepthTarget);
     renderer->CreateDepthView(m_shadowMap.DepthBuffer);
     m_shadowMap.DepthBuffer->SetFormat(TextureFormat::R32Float);
     renderer->CreateShaderResourceView(m_shadowMap.DepthBuffer);
     m_shadowMap.DepthBuffer->SetFormat(TextureFormat::R32Depth);
+
+    m_staticDepthBuffer.reset();
+    m_staticDepthBuffer = renderer->CreateTexture(width * SHADOW_CASCADE_ATLAS_COLUMNS, height * SHADOW_CASCADE_ATLAS_ROWS, TextureFormat::R32Depth, TextureType::DepthTarget);
+    renderer->CreateDepthView(m_staticDepthBuffer);
+
+    m_cache.Invalidate();
 }
@@ -9,12 +9,19 @@ public:
     void OnResize(std::shared_ptr<D3D12Renderer> renderer, int width, int height) override;
 
     ShadowMap GetShadowMap() { return m_shadowMap; }
+    const ShadowCacheStats& GetCacheStats() const { return m_cache.GetStats(); }
 
 private:
+    void DrawCascadeLayer(std::shared_ptr<CommandList> commandList, const std::vector<RenderMeshData>& renderMeshesData, uint32_t cascade, ShadowCasterLayer layer);
+
     std::shared_ptr<GraphicsPipeline> m_shadowPipeline;
-    std::shared_ptr<Buffer> m_constantBuffer;
+    std::shared_ptr<Buffer> m_constantBuffers[SHADOW_CASCADE_COUNT];
     ShadowMap m_shadowMap;
+    // Static casters only, copied over the sampled atlas before the dynamic ones are drawn
+    std::shared_ptr<Texture> m_staticDepthBuffer;
+    ShadowCache m_cache;
 
-    int m_shadowMapWidth = 1920;
-    int m_shadowMapHeight = 1080;
+    // Size of one cascade tile, the atlas is SHADOW_CASCADE_ATLAS_COLUMNS x SHADOW_CASCADE_ATLAS_ROWS tiles
+    int m_cascadeWidth = 2048;
+    int m_cascadeHeight = 2048;
 };
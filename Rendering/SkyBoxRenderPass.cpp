@@ -11,12 +11,14 @@ void SkyBoxRenderPass::Initialize(std::shared_ptr<D3D12Renderer> renderer, int w
     skyboxSpecs.Formats[0] = TextureFormat::RGBA8;
     skyboxSpecs.BlendOperation = BlendOperation::None;
     skyboxSpecs.DepthEnabled = true;
+    skyboxSpecs.DepthWrite = false;
     skyboxSpecs.Depth = DepthOperation::LEqual;
     skyboxSpecs.DepthFormat = TextureFormat::R32Depth;
     skyboxSpecs.Cull = CullMode::None;
     skyboxSpecs.Fill = FillMode::Solid;
     ShaderCompiler::CompileShader("Shaders/SkyBoxVertex.hlsl", ShaderType::Vertex, skyboxSpecs.ShadersBytecodes[ShaderType::Vertex]);
     ShaderCompiler::CompileShader("Shaders/SkyBoxPixel.hlsl", ShaderType::Pixel, skyboxSpecs.ShadersBytecodes[ShaderType::Pixel]);
+    VertexCompression::SetInputFormats(skyboxSpecs);
 
     m_skyboxPipeline = renderer->CreateGraphicsPipeline(skyboxSpecs);
 
@@ -58,7 +60,6 @@ void SkyBoxRenderPass::Initialize(std::shared_ptr<D3D12Renderer> renderer, int w
     auto prefilterCSPipeline = renderer->CreateComputePipeline(prefilterCS);
 
     cmdList->BindComputePipeline(prefilterCSPipeline);
-    cmdList->ImageBarrier(m_enviroMaps.PrefilterEnvMap, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
     cmdList->BindComputeShaderResource(m_enviroMaps.SkyBox, 1);
     cmdList->BindComputeSampler(m_textureSampler, 2);
     for(int i = 0; i < 5; i++)
@@ -76,10 +77,12 @@ void SkyBoxRenderPass::Initialize(std::shared_ptr<D3D12Renderer> renderer, int w
         m_prefilterConstantBuffers[i]->Unmap(0, 0);
         
         cmdList->BindComputeConstantBuffer(m_prefilterConstantBuffers[i], 3);
+        // Each mip is readable as soon as it is filtered, its barrier goes with the next dispatch
+        cmdList->ImageBarrier(m_enviroMaps.PrefilterEnvMap, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, i);
         cmdList->BindComputeUnorderedAccessView(m_enviroMaps.PrefilterEnvMap, 0, i);
         cmdList->Dispatch(mipWidth / 32, mipHeigth / 32, 6);
+        cmdList->ImageBarrier(m_enviroMaps.PrefilterEnvMap, D3D12_RESOURCE_STATE_GENERIC_READ, i);
     }
-    cmdList->ImageBarrier(m_enviroMaps.PrefilterEnvMap, D3D12_RESOURCE_STATE_GENERIC_READ);
 
     /*
     Shader brdfCs;
@@ -100,6 +103,8 @@ void SkyBoxRenderPass::Initialize(std::shared_ptr<D3D12Renderer> renderer, int w
 
 void SkyBoxRenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const GlobalPassData& globalPassData, const Camera& camera, const std::vector<RenderMeshData>& renderMeshesData, RenderTargetInfo renderTarget)
 {
+    PROFILE_FUNCTION();
+
     auto view = camera.GetViewMatrix();
     auto proj = camera.GetProjMatrix();
     DirectX::XMMATRIX viewProj = view * proj;
@@ -117,8 +122,7 @@ void SkyBoxRenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const Globa
 
     commandList->SetViewport(0, 0, globalPassData.ViewportSizeX, globalPassData.ViewportSizeY);
 
-    commandList->ImageBarrier(renderTarget.RenderTexture, D3D12_RESOURCE_STATE_RENDER_TARGET);
-    commandList->BindRenderTargets({ renderTarget.RenderTexture }, renderTarget.DepthBuffer);
+    commandList->BindRenderTargets({ renderTarget.RenderTexture }, renderTarget.DepthBuffer, true);
 
     commandList->SetTopology(Topology::TriangleList);
     commandList->BindGraphicsPipeline(m_skyboxPipeline);
@@ -126,11 +130,10 @@ void SkyBoxRenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const Globa
     commandList->BindGraphicsSampler(m_textureSampler, 2);
     commandList->BindGraphicsShaderResource(m_enviroMaps.SkyBox, 1);
 
+    commandList->BindGraphicsConstantBuffer(m_sphereMesh->GetPrimitives()[0].m_constantBuffer, 3);
     commandList->BindVertexBuffer(m_sphereMesh->GetPrimitives()[0].m_vertexBuffer);
     commandList->BindIndexBuffer(m_sphereMesh->GetPrimitives()[0].m_indicesBuffer);
     commandList->DrawIndexed(m_sphereMesh->GetPrimitives()[0].m_indexCount);
-    
-    commandList->ImageBarrier(renderTarget.RenderTexture, D3D12_RESOURCE_STATE_GENERIC_READ);
 }
 
 void SkyBoxRenderPass::OnResize(std::shared_ptr<D3D12Renderer> renderer, int width, int height)
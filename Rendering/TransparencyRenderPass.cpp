@@ -15,6 +15,7 @@ void TransparencyRenderPass::Initialize(std::shared_ptr<D3D12Renderer> renderer,
     specs.Fill = FillMode::Solid;
     ShaderCompiler::CompileShader("Shaders/SimpleVertex.hlsl", ShaderType::Vertex, specs.ShadersBytecodes[ShaderType::Vertex]);
     ShaderCompiler::CompileShader("Shaders/SimplePixel.hlsl", ShaderType::Pixel, specs.ShadersBytecodes[ShaderType::Pixel]);
+    VertexCompression::SetInputFormats(specs);
 
     m_forwardTransparencyPipeline = renderer->CreateGraphicsPipeline(specs);
 
@@ -34,6 +35,8 @@ void TransparencyRenderPass::OnResize(std::shared_ptr<D3D12Renderer> renderer, i
 
 void TransparencyRenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const GlobalPassData& globalPassData, const Camera& camera, const std::vector<RenderMeshData>& renderMeshesData, RenderTargetInfo renderTargetInfo)
 {
+    PROFILE_FUNCTION();
+
     auto view = camera.GetViewMatrix();
     auto proj = camera.GetProjMatrix();
 
@@ -60,6 +63,15 @@ void TransparencyRenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const
     commandList->BindGraphicsConstantBuffer(m_constantBuffer, 0);
     commandList->BindGraphicsSampler(m_textureSampler, 2);
 
+    const auto& lightClusters = globalPassData.LightClusters;
+    if(lightClusters.PointLights)
+    {
+        commandList->SetGraphicsShaderResource(lightClusters.PointLights, 8);
+        commandList->SetGraphicsShaderResource(lightClusters.Clusters, 9);
+        commandList->SetGraphicsShaderResource(lightClusters.LightIndices, 10);
+        commandList->BindGraphicsConstantBuffer(lightClusters.ConstantBuffer, 11);
+    }
+
     // for(const auto renderItem : renderItems)
     // {
     //     auto& material = renderItem->GetMaterial();
@@ -73,6 +85,7 @@ void TransparencyRenderPass::Pass(std::shared_ptr<D3D12Renderer> renderer, const
     //     const auto primitives = renderItem->GetPrimitives();
     //     for(const auto& primitive : primitives)
     //     {
+    //         commandList->BindGraphicsConstantBuffer(primitive.m_constantBuffer, 6);
     //         commandList->BindVertexBuffer(primitive.m_vertexBuffer);
     //         commandList->BindIndexBuffer(primitive.m_indicesBuffer);
     //         commandList->DrawIndexed(primitive.m_indexCount);
@@ -0,0 +1,568 @@
+﻿#include "TriangleBVH.h"
+#include "Jobs/JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+
+using namespace DirectX;
+
+namespace
+{
+    struct RangeBounds
+    {
+        XMVECTOR Min = XMVectorReplicate(FLT_MAX);
+        XMVECTOR Max = XMVectorReplicate(-FLT_MAX);
+        XMVECTOR CentroidMin = XMVectorReplicate(FLT_MAX);
+        XMVECTOR CentroidMax = XMVectorReplicate(-FLT_MAX);
+
+        void Merge(const RangeBounds& other)
+        {
+            Min = XMVectorMin(Min, other.Min);
+            Max = XMVectorMax(Max, other.Max);
+            CentroidMin = XMVectorMin(CentroidMin, other.CentroidMin);
+            CentroidMax = XMVectorMax(CentroidMax, other.CentroidMax);
+        }
+    };
+
+    struct Bin
+    {
+        XMVECTOR Min = XMVectorReplicate(FLT_MAX);
+        XMVECTOR Max = XMVectorReplicate(-FLT_MAX);
+        uint32_t Count = 0;
+    };
+
+    struct AxisBins
+    {
+        Bin Bins[3][TRIANGLE_BVH_BIN_COUNT];
+    };
+
+    struct BuildContext
+    {
+        std::vector<XMFLOAT4> TriangleMin;
+        std::vector<XMFLOAT4> TriangleMax;
+        std::vector<XMFLOAT4> Centroids;
+        std::vector<uint32_t> Triangles;
+        // Sized for the worst case, the children pairs are allocated from several threads
+        std::vector<TriangleBVHNode> Nodes;
+        std::atomic<uint32_t> NodeCount { 1 };
+    };
+
+    // Half the surface area, only ever compared
+    float Area(FXMVECTOR min, FXMVECTOR max)
+    {
+        XMVECTOR extent = XMVectorMax(XMVectorSubtract(max, min), XMVectorZero());
+        return XMVectorGetX(XMVector3Dot(extent, XMVectorSwizzle<XM_SWIZZLE_Y, XM_SWIZZLE_Z, XM_SWIZZLE_X, XM_SWIZZLE_W>(extent)));
+    }
+
+    uint32_t GetChunkCount(uint32_t begin, uint32_t end)
+    {
+        return (end - begin + TRIANGLE_BVH_PARALLEL_SIZE - 1) / TRIANGLE_BVH_PARALLEL_SIZE;
+    }
+
+    // Calls function on consecutive ranges of at most TRIANGLE_BVH_PARALLEL_SIZE triangles, spread over the job system
+    void ForEachChunk(uint32_t begin, uint32_t end, const std::function<void(uint32_t chunk, uint32_t begin, uint32_t end)>& function)
+    {
+        uint32_t chunkCount = GetChunkCount(begin, end);
+        auto RunChunks = [&](uint32_t chunkBegin, uint32_t chunkEnd)
+        {
+            for(uint32_t chunk = chunkBegin; chunk < chunkEnd; chunk++)
+                function(chunk, begin + chunk * TRIANGLE_BVH_PARALLEL_SIZE, (std::min)(end, begin + (chunk + 1) * TRIANGLE_BVH_PARALLEL_SIZE));
+        };
+
+        if(JobSystem::Get() && chunkCount > 1)
+            JobSystem::Get()->ParallelFor(chunkCount, 1, RunChunks);
+        else
+            RunChunks(0, chunkCount);
+    }
+
+    RangeBounds ComputeBounds(const BuildContext& context, uint32_t begin, uint32_t end)
+    {
+        RangeBounds bounds;
+        if(end - begin > TRIANGLE_BVH_PARALLEL_SIZE)
+        {
+            std::vector<RangeBounds> chunkBounds(GetChunkCount(begin, end));
+            ForEachChunk(begin, end, [&](uint32_t chunk, uint32_t chunkBegin, uint32_t chunkEnd) { chunkBounds[chunk] = ComputeBounds(context, chunkBegin, chunkEnd); });
+            for(const RangeBounds& chunk : chunkBounds)
+                bounds.Merge(chunk);
+            return bounds;
+        }
+
+        for(uint32_t i = begin; i < end; i++)
+        {
+            uint32_t triangle = context.Triangles[i];
+            XMVECTOR centroid = XMLoadFloat4(&context.Centroids[triangle]);
+            bounds.Min = XMVectorMin(bounds.Min, XMLoadFloat4(&context.TriangleMin[triangle]));
+            bounds.Max = XMVectorMax(bounds.Max, XMLoadFloat4(&context.TriangleMax[triangle]));
+            bounds.CentroidMin = XMVectorMin(bounds.CentroidMin, centroid);
+            bounds.CentroidMax = XMVectorMax(bounds.CentroidMax, centroid);
+        }
+        return bounds;
+    }
+
+    uint32_t GetBin(float centroid, float centroidMin, float scale, uint32_t binCount)
+    {
+        return (std::min)((uint32_t)((centroid - centroidMin) * scale), binCount - 1);
+    }
+
+    // The three axes in one pass over the triangles, scale maps the centroid bounds to the bins (0 on flat axes)
+    void BinCentroids(const BuildContext& context, uint32_t begin, uint32_t end, const float centroidMin[3], const float scale[3], uint32_t binCount, AxisBins& bins)
+    {
+        if(end - begin > TRIANGLE_BVH_PARALLEL_SIZE)
+        {
+            std::vector<AxisBins> chunkBins(GetChunkCount(begin, end));
+            ForEachChunk(begin, end, [&](uint32_t chunk, uint32_t chunkBegin, uint32_t chunkEnd) { BinCentroids(context, chunkBegin, chunkEnd, centroidMin, scale, binCount, chunkBins[chunk]); });
+            for(const AxisBins& chunk : chunkBins)
+            {
+                for(int axis = 0; axis < 3; axis++)
+                {
+                    for(uint32_t bin = 0; bin < binCount; bin++)
+                    {
+                        Bin& target = bins.Bins[axis][bin];
+                        target.Min = XMVectorMin(target.Min, chunk.Bins[axis][bin].Min);
+                        target.Max = XMVectorMax(target.Max, chunk.Bins[axis][bin].Max);
+                        target.Count += chunk.Bins[axis][bin].Count;
+                    }
+                }
+            }
+            return;
+        }
+
+        for(uint32_t i = begin; i < end; i++)
+        {
+            uint32_t triangle = context.Triangles[i];
+            const float* centroid = &context.Centroids[triangle].x;
+            XMVECTOR triangleMin = XMLoadFloat4(&context.TriangleMin[triangle]);
+            XMVECTOR triangleMax = XMLoadFloat4(&context.TriangleMax[triangle]);
+            for(int axis = 0; axis < 3; axis++)
+            {
+                Bin& bin = bins.Bins[axis][GetBin(centroid[axis], centroidMin[axis], scale[axis], binCount)];
+                bin.Min = XMVectorMin(bin.Min, triangleMin);
+                bin.Max = XMVectorMax(bin.Max, triangleMax);
+                bin.Count++;
+            }
+        }
+    }
+
+    void BuildNode(BuildContext& context, uint32_t nodeIndex, uint32_t begin, uint32_t end, const RangeBounds& bounds)
+    {
+        uint32_t count = end - begin;
+        TriangleBVHNode& node = context.Nodes[nodeIndex];
+        XMStoreFloat3(&node.BoundsMin, bounds.Min);
+        XMStoreFloat3(&node.BoundsMax, bounds.Max);
+
+        XMFLOAT3 centroidBoundsMin;
+        XMFLOAT3 centroidBoundsMax;
+        XMStoreFloat3(&centroidBoundsMin, bounds.CentroidMin);
+        XMStoreFloat3(&centroidBoundsMax, bounds.CentroidMax);
+        const float* centroidMin = &centroidBoundsMin.x;
+        const float* centroidMax = &centroidBoundsMax.x;
+
+        // Small nodes don't need more bins than triangles, most of the nodes are small
+        uint32_t binCount = (std::min)(count, (uint32_t)TRIANGLE_BVH_BIN_COUNT);
+        float scale[3];
+        for(int axis = 0; axis < 3; axis++)
+        {
+            float extent = centroidMax[axis] - centroidMin[axis];
+            scale[axis] = extent > 0.0f ? binCount / extent : 0.0f;
+        }
+
+        // Split between the bins with the lowest SAH cost, each side weighted by its triangle count
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        uint32_t bestSplit = 0;
+        if(count > 1)
+        {
+            AxisBins bins;
+            BinCentroids(context, begin, end, centroidMin, scale, binCount, bins);
+            for(int axis = 0; axis < 3; axis++)
+            {
+                if(scale[axis] == 0.0f)
+                    continue;
+
+                const Bin* axisBins = bins.Bins[axis];
+                float leftCosts[TRIANGLE_BVH_BIN_COUNT];
+                uint32_t leftCounts[TRIANGLE_BVH_BIN_COUNT];
+                XMVECTOR min = XMVectorReplicate(FLT_MAX);
+                XMVECTOR max = XMVectorReplicate(-FLT_MAX);
+                uint32_t leftCount = 0;
+                for(uint32_t bin = 0; bin < binCount - 1; bin++)
+                {
+                    min = XMVectorMin(min, axisBins[bin].Min);
+                    max = XMVectorMax(max, axisBins[bin].Max);
+                    leftCount += axisBins[bin].Count;
+                    leftCounts[bin] = leftCount;
+                    leftCosts[bin] = Area(min, max) * leftCount;
+                }
+
+                min = XMVectorReplicate(FLT_MAX);
+                max = XMVectorReplicate(-FLT_MAX);
+                uint32_t rightCount = 0;
+                for(uint32_t split = binCount - 1; split > 0; split--)
+                {
+                    min = XMVectorMin(min, axisBins[split].Min);
+                    max = XMVectorMax(max, axisBins[split].Max);
+                    rightCount += axisBins[split].Count;
+                    if(leftCounts[split - 1] == 0 || rightCount == 0)
+                        continue;
+
+                    float cost = leftCosts[split - 1] + Area(min, max) * rightCount;
+                    if(cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = split;
+                    }
+                }
+            }
+        }
+
+        float area = Area(bounds.Min, bounds.Max);
+        if(count <= TRIANGLE_BVH_MAX_LEAF_SIZE && (bestAxis < 0 || TRIANGLE_BVH_TRAVERSAL_COST * area + bestCost >= count * area))
+        {
+            node.LeftFirst = begin;
+            node.TriangleCount = count;
+            return;
+        }
+
+        // Triangles sharing the same centroid are just split in half
+        uint32_t middle = begin + count / 2;
+        if(bestAxis >= 0)
+        {
+            float axisMin = centroidMin[bestAxis];
+            float axisScale = scale[bestAxis];
+            auto it = std::partition(context.Triangles.begin() + begin, context.Triangles.begin() + end, [&](uint32_t triangle)
+            {
+                return GetBin((&context.Centroids[triangle].x)[bestAxis], axisMin, axisScale, binCount) < bestSplit;
+            });
+            middle = (uint32_t)(it - context.Triangles.begin());
+        }
+        RangeBounds leftBounds = ComputeBounds(context, begin, middle);
+        RangeBounds rightBounds = ComputeBounds(context, middle, end);
+
+        uint32_t left = context.NodeCount.fetch_add(2, std::memory_order_relaxed);
+        node.LeftFirst = left;
+        node.TriangleCount = 0;
+
+        if(count > TRIANGLE_BVH_PARALLEL_SIZE && JobSystem::Get())
+        {
+            JobCounter counter;
+            JobSystem::Get()->Run([&context, left, begin, middle, leftBounds]() { BuildNode(context, left, begin, middle, leftBounds); }, &counter);
+            BuildNode(context, left + 1, middle, end, rightBounds);
+            JobSystem::Get()->Wait(counter);
+        }
+        else
+        {
+            BuildNode(context, left, begin, middle, leftBounds);
+            BuildNode(context, left + 1, middle, end, rightBounds);
+        }
+    }
+
+    uint32_t GetLaneMask(FXMVECTOR mask)
+    {
+        XMUINT4 lanes;
+        XMStoreUInt4(&lanes, mask);
+        return (lanes.x ? 1u : 0u) | (lanes.y ? 2u : 0u) | (lanes.z ? 4u : 0u) | (lanes.w ? 8u : 0u);
+    }
+
+    float GetMinLane(FXMVECTOR values, uint32_t laneMask)
+    {
+        XMFLOAT4 lanes;
+        XMStoreFloat4(&lanes, values);
+        const float* laneValues = &lanes.x;
+        float result = FLT_MAX;
+        for(uint32_t lane = 0; lane < 4; lane++)
+        {
+            if(laneMask & (1u << lane))
+                result = (std::min)(result, laneValues[lane]);
+        }
+        return result;
+    }
+
+    float GetMaxLane(FXMVECTOR values)
+    {
+        XMFLOAT4 lanes;
+        XMStoreFloat4(&lanes, values);
+        return (std::max)((std::max)(lanes.x, lanes.y), (std::max)(lanes.z, lanes.w));
+    }
+}
+
+void TriangleBVH::Build(const XMFLOAT3* positions, const uint32_t* indices, uint32_t triangleCount, std::vector<TriangleBVHNode>& nodes, std::vector<uint32_t>& triangles)
+{
+    PROFILE_FUNCTION();
+
+    nodes.clear();
+    triangles.clear();
+    if(triangleCount == 0)
+        return;
+
+    BuildContext context;
+    context.TriangleMin.resize(triangleCount);
+    context.TriangleMax.resize(triangleCount);
+    context.Centroids.resize(triangleCount);
+    ForEachChunk(0, triangleCount, [&](uint32_t, uint32_t begin, uint32_t end)
+    {
+        for(uint32_t triangle = begin; triangle < end; triangle++)
+        {
+            XMVECTOR v0 = XMLoadFloat3(&positions[indices[triangle * 3 + 0]]);
+            XMVECTOR v1 = XMLoadFloat3(&positions[indices[triangle * 3 + 1]]);
+            XMVECTOR v2 = XMLoadFloat3(&positions[indices[triangle * 3 + 2]]);
+            XMVECTOR min = XMVectorMin(XMVectorMin(v0, v1), v2);
+            XMVECTOR max = XMVectorMax(XMVectorMax(v0, v1), v2);
+            XMStoreFloat4(&context.TriangleMin[triangle], min);
+            XMStoreFloat4(&context.TriangleMax[triangle], max);
+            XMStoreFloat4(&context.Centroids[triangle], XMVectorScale(XMVectorAdd(min, max), 0.5f));
+        }
+    });
+
+    context.Triangles.resize(triangleCount);
+    std::iota(context.Triangles.begin(), context.Triangles.end(), 0u);
+    context.Nodes.resize(triangleCount * 2 - 1);
+    BuildNode(context, 0, 0, triangleCount, ComputeBounds(context, 0, triangleCount));
+
+    // The parallel build allocates the nodes in whatever order the jobs ran, they are laid out depth first so the cooked file
+    // does not depend on the scheduling
+    uint32_t nodeCount = context.NodeCount.load();
+    nodes.reserve(nodeCount);
+    nodes.push_back(context.Nodes[0]);
+    std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 0 } };
+    while(!stack.empty())
+    {
+        auto [node, builtNode] = stack.back();
+        stack.pop_back();
+        const TriangleBVHNode& built = context.Nodes[builtNode];
+        if(built.TriangleCount > 0)
+            continue;
+
+        uint32_t left = (uint32_t)nodes.size();
+        nodes[node].LeftFirst = left;
+        nodes.push_back(context.Nodes[built.LeftFirst]);
+        nodes.push_back(context.Nodes[built.LeftFirst + 1]);
+        stack.push_back({ left + 1, built.LeftFirst + 1 });
+        stack.push_back({ left, built.LeftFirst });
+    }
+
+    triangles = std::move(context.Triangles);
+}
+
+void TriangleBVH::Initialize(const TriangleBVHNode* nodes, uint32_t nodeCount, const uint32_t* triangles, uint32_t triangleCount, const XMFLOAT3* positions, const uint32_t* indices)
+{
+    m_nodes.assign(nodes, nodes + nodeCount);
+    m_triangleIndices.assign(triangles, triangles + triangleCount);
+
+    m_triangles.resize(triangleCount);
+    for(uint32_t slot = 0; slot < triangleCount; slot++)
+    {
+        uint32_t triangle = triangles[slot];
+        XMVECTOR v0 = XMLoadFloat3(&positions[indices[triangle * 3 + 0]]);
+        XMStoreFloat3(&m_triangles[slot].Vertex0, v0);
+        XMStoreFloat3(&m_triangles[slot].Edge1, XMVectorSubtract(XMLoadFloat3(&positions[indices[triangle * 3 + 1]]), v0));
+        XMStoreFloat3(&m_triangles[slot].Edge2, XMVectorSubtract(XMLoadFloat3(&positions[indices[triangle * 3 + 2]]), v0));
+    }
+
+    // Children come after their parent, one pass in order sizes the traversal stack
+    std::vector<uint32_t> depths(nodeCount, 0);
+    m_depth = 0;
+    for(uint32_t node = 0; node < nodeCount; node++)
+    {
+        if(m_nodes[node].TriangleCount > 0)
+            continue;
+
+        uint32_t childDepth = depths[node] + 1;
+        depths[m_nodes[node].LeftFirst] = (std::max)(depths[m_nodes[node].LeftFirst], childDepth);
+        depths[m_nodes[node].LeftFirst + 1] = (std::max)(depths[m_nodes[node].LeftFirst + 1], childDepth);
+        m_depth = (std::max)(m_depth, childDepth);
+    }
+}
+
+bool TriangleBVH::Raycast(const BVHRay& ray, TriangleRayHit& hit) const
+{
+    return RaycastPacket(&ray, 1, &hit) != 0;
+}
+
+void TriangleBVH::Raycast(const BVHRay* rays, uint32_t count, TriangleRayHit* hits) const
+{
+    PROFILE_FUNCTION();
+
+    uint32_t packetCount = (count + 3) / 4;
+    auto RaycastPackets = [&](uint32_t begin, uint32_t end)
+    {
+        for(uint32_t packet = begin; packet < end; packet++)
+            RaycastPacket(rays + packet * 4, (std::min)(4u, count - packet * 4), hits + packet * 4);
+    };
+
+    if(JobSystem::Get() && packetCount > TRIANGLE_BVH_PACKET_GRAIN_SIZE)
+        JobSystem::Get()->ParallelFor(packetCount, TRIANGLE_BVH_PACKET_GRAIN_SIZE, RaycastPackets);
+    else
+        RaycastPackets(0, packetCount);
+}
+
+uint32_t TriangleBVH::RaycastPacket(const BVHRay* rays, uint32_t count, TriangleRayHit* hits) const
+{
+    // One ray per lane split per component, the missing lanes repeat the first ray with a negative max distance so they never hit
+    float origins[3][4];
+    float directions[3][4];
+    float invDirections[3][4];
+    float maxDistances[4];
+    for(uint32_t lane = 0; lane < 4; lane++)
+    {
+        const BVHRay& ray = rays[lane < count ? lane : 0];
+        const float* origin = &ray.Origin.x;
+        const float* direction = &ray.Direction.x;
+        for(int axis = 0; axis < 3; axis++)
+        {
+            // Zero direction components would turn the slabs into NaNs, a tiny one gives the same answer
+            float component = fabsf(direction[axis]) < 1e-20f ? (direction[axis] < 0.0f ? -1e-20f : 1e-20f) : direction[axis];
+            origins[axis][lane] = origin[axis];
+            directions[axis][lane] = direction[axis];
+            invDirections[axis][lane] = 1.0f / component;
+        }
+        maxDistances[lane] = lane < count ? ray.MaxDistance : -1.0f;
+    }
+
+    XMVECTOR originX = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(origins[0]));
+    XMVECTOR originY = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(origins[1]));
+    XMVECTOR originZ = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(origins[2]));
+    XMVECTOR directionX = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(directions[0]));
+    XMVECTOR directionY = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(directions[1]));
+    XMVECTOR directionZ = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(directions[2]));
+    XMVECTOR invDirectionX = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(invDirections[0]));
+    XMVECTOR invDirectionY = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(invDirections[1]));
+    XMVECTOR invDirectionZ = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(invDirections[2]));
+    // Slab distances as one multiply add, boundsMin * invDirection - origin * invDirection
+    XMVECTOR slabOffsetX = XMVectorNegate(XMVectorMultiply(originX, invDirectionX));
+    XMVECTOR slabOffsetY = XMVectorNegate(XMVectorMultiply(originY, invDirectionY));
+    XMVECTOR slabOffsetZ = XMVectorNegate(XMVectorMultiply(originZ, invDirectionZ));
+    XMVECTOR closest = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(maxDistances));
+    XMVECTOR closestSlots = XMVectorReplicateInt(UINT32_MAX);
+
+    // Entry distance clamped to the ray start, the mask holds the lanes entering before their closest hit
+    auto IntersectBox = [&](const TriangleBVHNode& node, XMVECTOR& entry)
+    {
+        XMVECTOR t0X = XMVectorMultiplyAdd(XMVectorReplicate(node.BoundsMin.x), invDirectionX, slabOffsetX);
+        XMVECTOR t0Y = XMVectorMultiplyAdd(XMVectorReplicate(node.BoundsMin.y), invDirectionY, slabOffsetY);
+        XMVECTOR t0Z = XMVectorMultiplyAdd(XMVectorReplicate(node.BoundsMin.z), invDirectionZ, slabOffsetZ);
+        XMVECTOR t1X = XMVectorMultiplyAdd(XMVectorReplicate(node.BoundsMax.x), invDirectionX, slabOffsetX);
+        XMVECTOR t1Y = XMVectorMultiplyAdd(XMVectorReplicate(node.BoundsMax.y), invDirectionY, slabOffsetY);
+        XMVECTOR t1Z = XMVectorMultiplyAdd(XMVectorReplicate(node.BoundsMax.z), invDirectionZ, slabOffsetZ);
+        entry = XMVectorMax(XMVectorMax(XMVectorMin(t0X, t1X), XMVectorMin(t0Y, t1Y)), XMVectorMax(XMVectorMin(t0Z, t1Z), XMVectorZero()));
+        XMVECTOR exit = XMVectorMin(XMVectorMin(XMVectorMax(t0X, t1X), XMVectorMax(t0Y, t1Y)), XMVectorMin(XMVectorMax(t0Z, t1Z), closest));
+        return GetLaneMask(XMVectorLessOrEqual(entry, exit));
+    };
+
+    // Moller-Trumbore, both faces, the triangle is splat over the 4 rays
+    auto IntersectTriangle = [&](uint32_t slot)
+    {
+        const Triangle& triangle = m_triangles[slot];
+        XMVECTOR edge1X = XMVectorReplicate(triangle.Edge1.x);
+        XMVECTOR edge1Y = XMVectorReplicate(triangle.Edge1.y);
+        XMVECTOR edge1Z = XMVectorReplicate(triangle.Edge1.z);
+        XMVECTOR edge2X = XMVectorReplicate(triangle.Edge2.x);
+        XMVECTOR edge2Y = XMVectorReplicate(triangle.Edge2.y);
+        XMVECTOR edge2Z = XMVectorReplicate(triangle.Edge2.z);
+
+        XMVECTOR pX = XMVectorSubtract(XMVectorMultiply(directionY, edge2Z), XMVectorMultiply(directionZ, edge2Y));
+        XMVECTOR pY = XMVectorSubtract(XMVectorMultiply(directionZ, edge2X), XMVectorMultiply(directionX, edge2Z));
+        XMVECTOR pZ = XMVectorSubtract(XMVectorMultiply(directionX, edge2Y), XMVectorMultiply(directionY, edge2X));
+        XMVECTOR determinant = XMVectorMultiplyAdd(edge1X, pX, XMVectorMultiplyAdd(edge1Y, pY, XMVectorMultiply(edge1Z, pZ)));
+        XMVECTOR invDeterminant = XMVectorReciprocal(determinant);
+
+        XMVECTOR sX = XMVectorSubtract(originX, XMVectorReplicate(triangle.Vertex0.x));
+        XMVECTOR sY = XMVectorSubtract(originY, XMVectorReplicate(triangle.Vertex0.y));
+        XMVECTOR sZ = XMVectorSubtract(originZ, XMVectorReplicate(triangle.Vertex0.z));
+        XMVECTOR u = XMVectorMultiply(XMVectorMultiplyAdd(sX, pX, XMVectorMultiplyAdd(sY, pY, XMVectorMultiply(sZ, pZ))), invDeterminant);
+
+        XMVECTOR qX = XMVectorSubtract(XMVectorMultiply(sY, edge1Z), XMVectorMultiply(sZ, edge1Y));
+        XMVECTOR qY = XMVectorSubtract(XMVectorMultiply(sZ, edge1X), XMVectorMultiply(sX, edge1Z));
+        XMVECTOR qZ = XMVectorSubtract(XMVectorMultiply(sX, edge1Y), XMVectorMultiply(sY, edge1X));
+        XMVECTOR v = XMVectorMultiply(XMVectorMultiplyAdd(directionX, qX, XMVectorMultiplyAdd(directionY, qY, XMVectorMultiply(directionZ, qZ))), invDeterminant);
+        XMVECTOR t = XMVectorMultiply(XMVectorMultiplyAdd(edge2X, qX, XMVectorMultiplyAdd(edge2Y, qY, XMVectorMultiply(edge2Z, qZ))), invDeterminant);
+
+        XMVECTOR hit = XMVectorAndInt(XMVectorNotEqual(determinant, XMVectorZero()), XMVectorGreaterOrEqual(u, XMVectorZero()));
+        hit = XMVectorAndInt(hit, XMVectorAndInt(XMVectorGreaterOrEqual(v, XMVectorZero()), XMVectorLessOrEqual(XMVectorAdd(u, v), XMVectorSplatOne())));
+        hit = XMVectorAndInt(hit, XMVectorAndInt(XMVectorGreaterOrEqual(t, XMVectorZero()), XMVectorLess(t, closest)));
+        closest = XMVectorSelect(closest, t, hit);
+        closestSlots = XMVectorSelect(closestSlots, XMVectorReplicateInt(slot), hit);
+    };
+
+    struct Entry
+    {
+        uint32_t Node;
+        float Distance; // Closest entry of the packet
+    };
+
+    // A depth first traversal never holds more than depth + 1 nodes
+    Entry localStack[BVH_STACK_SIZE];
+    std::vector<Entry> heapStack;
+    Entry* stack = localStack;
+    if(m_depth + 1 > BVH_STACK_SIZE)
+    {
+        heapStack.resize(m_depth + 1);
+        stack = heapStack.data();
+    }
+    uint32_t stackSize = 0;
+
+    XMVECTOR entry;
+    uint32_t rootMask = m_nodes.empty() ? 0 : IntersectBox(m_nodes[0], entry);
+    if(rootMask)
+        stack[stackSize++] = { 0, GetMinLane(entry, rootMask) };
+
+    float farthest = GetMaxLane(closest);
+    while(stackSize > 0)
+    {
+        Entry current = stack[--stackSize];
+        if(current.Distance > farthest)
+            continue;
+
+        const TriangleBVHNode& node = m_nodes[current.Node];
+        if(node.TriangleCount > 0)
+        {
+            for(uint32_t slot = node.LeftFirst; slot < node.LeftFirst + node.TriangleCount; slot++)
+                IntersectTriangle(slot);
+            farthest = GetMaxLane(closest);
+            continue;
+        }
+
+        // Both children are tested now so the nearest one is visited first
+        XMVECTOR leftEntry;
+        XMVECTOR rightEntry;
+        uint32_t leftMask = IntersectBox(m_nodes[node.LeftFirst], leftEntry);
+        uint32_t rightMask = IntersectBox(m_nodes[node.LeftFirst + 1], rightEntry);
+        Entry left = { node.LeftFirst, GetMinLane(leftEntry, leftMask) };
+        Entry right = { node.LeftFirst + 1, GetMinLane(rightEntry, rightMask) };
+        if(leftMask && rightMask)
+        {
+            if(left.Distance <= right.Distance)
+                std::swap(left, right);
+            stack[stackSize++] = left;
+            stack[stackSize++] = right;
+        }
+        else if(leftMask)
+        {
+            stack[stackSize++] = left;
+        }
+        else if(rightMask)
+        {
+            stack[stackSize++] = right;
+        }
+    }
+
+    XMFLOAT4 distances;
+    XMUINT4 slots;
+    XMStoreFloat4(&distances, closest);
+    XMStoreUInt4(&slots, closestSlots);
+    const float* laneDistances = &distances.x;
+    const uint32_t* laneSlots = &slots.x;
+    uint32_t hitMask = 0;
+    for(uint32_t lane = 0; lane < count; lane++)
+    {
+        hits[lane] = TriangleRayHit();
+        if(laneSlots[lane] == UINT32_MAX)
+            continue;
+
+        hits[lane].Distance = laneDistances[lane];
+        hits[lane].Triangle = m_triangleIndices[laneSlots[lane]];
+        hitMask |= 1u << lane;
+    }
+    return hitMask;
+}
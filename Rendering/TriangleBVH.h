@@ -0,0 +1,70 @@
+﻿#pragma once
+#include "Core.h"
+#include "DynamicBVH.h"
+
+#include <cfloat>
+
+// Centroid bins per axis of the SAH split search
+#define TRIANGLE_BVH_BIN_COUNT 16
+// Cost of visiting a node relative to a triangle test
+#define TRIANGLE_BVH_TRAVERSAL_COST 1.0f
+// Larger leaves are only made when the triangle centroids can't be told apart
+#define TRIANGLE_BVH_MAX_LEAF_SIZE 4
+// Nodes holding more triangles are binned over the job system and build their two children in parallel
+#define TRIANGLE_BVH_PARALLEL_SIZE 8192
+// Ray packets per job of the bulk raycast
+#define TRIANGLE_BVH_PACKET_GRAIN_SIZE 16
+
+// Two nodes per cache line, siblings are stored next to each other so a node only references its left child
+struct TriangleBVHNode
+{
+    DirectX::XMFLOAT3 BoundsMin;
+    uint32_t LeftFirst; // Left child on internal nodes, the right one follows it. First triangle slot on leaves
+    DirectX::XMFLOAT3 BoundsMax;
+    uint32_t TriangleCount; // 0 on internal nodes
+};
+
+static_assert(sizeof(TriangleBVHNode) == 32, "TriangleBVHNode is stored as is in the cooked meshes");
+
+struct TriangleRayHit
+{
+    float Distance = FLT_MAX;
+    uint32_t Triangle = UINT32_MAX; // In the LOD 0 index range
+};
+
+// Static BVH over the LOD 0 triangles of a primitive, built once by the cooker with a binned SAH.
+// Rays are traced 4 at a time, one per SIMD lane, and share the node visits.
+class TriangleBVH
+{
+public:
+    // triangles receives the triangle of every leaf slot, leaves are ranges of it
+    static void Build(const DirectX::XMFLOAT3* positions, const uint32_t* indices, uint32_t triangleCount, std::vector<TriangleBVHNode>& nodes, std::vector<uint32_t>& triangles);
+
+    // Nodes must come after their parent. The triangle vertices are copied in slot order so the traversal never reads the indices
+    void Initialize(const TriangleBVHNode* nodes, uint32_t nodeCount, const uint32_t* triangles, uint32_t triangleCount, const DirectX::XMFLOAT3* positions, const uint32_t* indices);
+
+    bool IsEmpty() const { return m_nodes.empty(); }
+    uint32_t GetNodeCount() const { return (uint32_t)m_nodes.size(); }
+    uint32_t GetDepth() const { return m_depth; }
+
+    // Object space rays with the BVHRay conventions, triangles are double sided and only hits closer than MaxDistance are reported
+    bool Raycast(const BVHRay& ray, TriangleRayHit& hit) const;
+    // Rays without hit keep a default TriangleRayHit. Consecutive rays are packed together, they should be coherent. Spread over the job system
+    void Raycast(const BVHRay* rays, uint32_t count, TriangleRayHit* hits) const;
+
+private:
+    struct Triangle
+    {
+        DirectX::XMFLOAT3 Vertex0;
+        DirectX::XMFLOAT3 Edge1;
+        DirectX::XMFLOAT3 Edge2;
+    };
+
+    // Up to 4 rays, returns the mask of the ones that hit
+    uint32_t RaycastPacket(const BVHRay* rays, uint32_t count, TriangleRayHit* hits) const;
+
+    std::vector<TriangleBVHNode> m_nodes;
+    std::vector<Triangle> m_triangles;
+    std::vector<uint32_t> m_triangleIndices; // LOD 0 triangle of every slot
+    uint32_t m_depth = 0;
+};
@@ -0,0 +1,85 @@
+﻿#include "VertexCompression.h"
+
+using namespace DirectX;
+
+void VertexCompression::EncodeVertices(const Vertex* vertices, uint32_t count, const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, CompactVertex* compactVertices)
+{
+    XMVECTOR offset = XMLoadFloat3(&boundsMin);
+    XMVECTOR extent = XMVectorSubtract(XMLoadFloat3(&boundsMax), offset);
+    // Flat axes quantize to 0, the decode scale is 0 there as well
+    XMVECTOR invExtent = XMVectorSelect(XMVectorReciprocal(extent), XMVectorZero(), XMVectorLessOrEqual(extent, XMVectorZero()));
+
+    for(uint32_t i = 0; i < count; i++)
+    {
+        const Vertex& vertex = vertices[i];
+        CompactVertex& compactVertex = compactVertices[i];
+
+        XMVECTOR normal = XMLoadFloat3(&vertex.Normal);
+        XMVECTOR tangent = XMLoadFloat3(&vertex.Tangent);
+        XMVECTOR binormal = XMLoadFloat3(&vertex.Binormal);
+        float bitangentSign = XMVectorGetX(XMVector3Dot(XMVector3Cross(normal, tangent), binormal)) < 0.0f ? 0.0f : 1.0f;
+
+        XMVECTOR position = XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&vertex.Position), offset), invExtent);
+        XMStoreUShortN4(&compactVertex.Position, XMVectorSetW(position, bitangentSign));
+        XMStoreShortN2(&compactVertex.Normal, EncodeOctahedral(normal));
+        XMStoreShortN2(&compactVertex.Tangent, EncodeOctahedral(tangent));
+        XMStoreHalf2(&compactVertex.UV, XMLoadFloat2(&vertex.UV));
+    }
+}
+
+Vertex VertexCompression::DecodeVertex(const CompactVertex& compactVertex, const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax)
+{
+    XMVECTOR position = XMLoadUShortN4(&compactVertex.Position);
+    XMVECTOR normal = DecodeOctahedral(XMLoadShortN2(&compactVertex.Normal));
+    XMVECTOR tangent = DecodeOctahedral(XMLoadShortN2(&compactVertex.Tangent));
+    float bitangentSign = XMVectorGetW(position) > 0.5f ? 1.0f : -1.0f;
+
+    Vertex vertex;
+    vertex.Position = DecodePosition(compactVertex, boundsMin, boundsMax);
+    XMStoreFloat3(&vertex.Normal, normal);
+    XMStoreFloat3(&vertex.Tangent, tangent);
+    XMStoreFloat3(&vertex.Binormal, XMVectorScale(XMVector3Cross(normal, tangent), bitangentSign));
+    XMStoreFloat2(&vertex.UV, XMLoadHalf2(&compactVertex.UV));
+    return vertex;
+}
+
+XMFLOAT3 VertexCompression::DecodePosition(const CompactVertex& compactVertex, const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax)
+{
+    XMVECTOR offset = XMLoadFloat3(&boundsMin);
+    XMVECTOR extent = XMVectorSubtract(XMLoadFloat3(&boundsMax), offset);
+
+    XMFLOAT3 position;
+    XMStoreFloat3(&position, XMVectorMultiplyAdd(XMLoadUShortN4(&compactVertex.Position), extent, offset));
+    return position;
+}
+
+XMVECTOR XM_CALLCONV VertexCompression::EncodeOctahedral(FXMVECTOR direction)
+{
+    XMVECTOR l1Norm = XMVector3Dot(XMVectorAbs(direction), XMVectorSplatOne());
+    XMVECTOR octahedron = XMVectorSelect(XMVectorDivide(direction, l1Norm), XMVectorZero(), XMVectorEqual(l1Norm, XMVectorZero()));
+
+    // The lower hemisphere is folded over the diagonals
+    XMVECTOR signNotZero = XMVectorSelect(XMVectorReplicate(-1.0f), XMVectorSplatOne(), XMVectorGreaterOrEqual(octahedron, XMVectorZero()));
+    XMVECTOR folded = XMVectorMultiply(XMVectorSubtract(XMVectorSplatOne(), XMVectorAbs(XMVectorSwizzle<XM_SWIZZLE_Y, XM_SWIZZLE_X, XM_SWIZZLE_Z, XM_SWIZZLE_W>(octahedron))), signNotZero);
+
+    return XMVectorSelect(octahedron, folded, XMVectorLess(XMVectorSplatZ(octahedron), XMVectorZero()));
+}
+
+XMVECTOR XM_CALLCONV VertexCompression::DecodeOctahedral(FXMVECTOR encoded)
+{
+    XMVECTOR absolute = XMVectorAbs(encoded);
+    XMVECTOR z = XMVectorSubtract(XMVectorSubtract(XMVectorSplatOne(), XMVectorSplatX(absolute)), XMVectorSplatY(absolute));
+    XMVECTOR fold = XMVectorSaturate(XMVectorNegate(z));
+
+    XMVECTOR xy = XMVectorAdd(encoded, XMVectorSelect(fold, XMVectorNegate(fold), XMVectorGreaterOrEqual(encoded, XMVectorZero())));
+    XMVECTOR direction = XMVectorPermute<XM_PERMUTE_0X, XM_PERMUTE_0Y, XM_PERMUTE_1Z, XM_PERMUTE_1W>(xy, z);
+    return XMVector3Normalize(XMVectorSetW(direction, 0.0f));
+}
+
+void VertexCompression::SetInputFormats(GraphicsPipelineSpecs& specs)
+{
+    specs.InputFormats["POSITION"] = DXGI_FORMAT_R16G16B16A16_UNORM;
+    specs.InputFormats["NORMAL"] = DXGI_FORMAT_R16G16_SNORM;
+    specs.InputFormats["TANGENT"] = DXGI_FORMAT_R16G16_SNORM;
+    specs.InputFormats["TEXCOORD"] = DXGI_FORMAT_R16G16_FLOAT;
+}
@@ -0,0 +1,36 @@
+﻿#pragma once
+#include "Core.h"
+#include "RenderItem.h"
+
+// GPU vertex layout, decoded in Shaders/VertexCompression.hlsl
+struct CompactVertex
+{
+    DirectX::PackedVector::XMUSHORTN4 Position; // xyz quantized in the primitive bounds, w is the bitangent sign (0 : -1, 1 : +1)
+    DirectX::PackedVector::XMSHORTN2 Normal; // Octahedral
+    DirectX::PackedVector::XMSHORTN2 Tangent; // Octahedral
+    DirectX::PackedVector::XMHALF2 UV;
+};
+
+// Position only stream of the depth passes, same quantization as CompactVertex::Position with w left to 0
+struct CompactPosition
+{
+    DirectX::PackedVector::XMUSHORTN4 Position;
+};
+
+static_assert(sizeof(CompactVertex) == 20, "CompactVertex must match the input layout set by VertexCompression::SetInputFormats");
+
+class VertexCompression
+{
+public:
+    static void EncodeVertices(const Vertex* vertices, uint32_t count, const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax, CompactVertex* compactVertices);
+    static Vertex DecodeVertex(const CompactVertex& compactVertex, const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax);
+    // Position as the shaders decode it, the cooker and the loader both go through it so their CPU side geometry is bit identical
+    static DirectX::XMFLOAT3 DecodePosition(const CompactVertex& compactVertex, const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax);
+
+    // Unit vector to the [-1, 1]^2 octahedral map
+    static DirectX::XMVECTOR XM_CALLCONV EncodeOctahedral(DirectX::FXMVECTOR direction);
+    static DirectX::XMVECTOR XM_CALLCONV DecodeOctahedral(DirectX::FXMVECTOR encoded);
+
+    // Reflection only sees float inputs, pipelines drawing meshes need the packed formats
+    static void SetInputFormats(GraphicsPipelineSpecs& specs);
+};
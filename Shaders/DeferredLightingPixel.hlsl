@@ -16,7 +16,6 @@ cbuffer CBuf : register(b0)
     float DirLightIntensity;
     float3 Padding;
     row_major float4x4 InvViewProj;
-    row_major float4x4 ShadowTransform;
     bool ShadowEnabled;
     float3 Padding2;
 };
@@ -32,18 +31,38 @@ TextureCube PrefilterEnvMap : register(t7);
 Texture2D ShadowMap : register(t8);
 SamplerComparisonState CmpSampler : register(s9);
 
-float CalcShadowFactor(float4 shadowPos, float3 normal, float3 lightDir)
+#define SHADOW_CASCADE_COUNT 4
+
+cbuffer ShadowCascades : register(b10)
 {
-    // Complete projection by doing division by w.
-    shadowPos.xyz /= shadowPos.w;
+    row_major float4x4 CascadeTransforms[SHADOW_CASCADE_COUNT];
+    float4 CascadeUvRects[SHADOW_CASCADE_COUNT];
+    float4 CascadeSplits;
+    float4 CascadeTexelDepths;
+    float4 ViewDepth;
+};
 
+float CalcShadowFactor(float4 worldSpacePosition, float3 normal, float3 lightDir)
+{
+    // First cascade whose slice reaches the pixel, nothing is shadowed past the last one
+    float viewDepth = dot(worldSpacePosition, ViewDepth);
+    uint cascade = 0;
+    [unroll]
+    for(uint i = 0; i < SHADOW_CASCADE_COUNT; i++)
+        cascade += viewDepth > CascadeSplits[i] ? 1 : 0;
+    if(cascade >= SHADOW_CASCADE_COUNT)
+        return 1.0f;
+
+    // Orthographic projection, no division by w
+    float4 shadowPos = mul(worldSpacePosition, CascadeTransforms[cascade]);
     if(shadowPos.z > 1.0)
         return 0.0f;
 
     // Depth in NDC space.
     float depth = shadowPos.z;
 
-    float bias = max(0.005 * (1.0 - dot(normal, lightDir)), 0.002);
+    // A few texels of world depth, more on the surfaces facing away from the light
+    float bias = CascadeTexelDepths[cascade] * max(4.0 * (1.0 - dot(normal, lightDir)), 1.5);
 
     uint width, height, numMips;
     ShadowMap.GetDimensions(0, width, height, numMips);
@@ -58,10 +77,15 @@ float CalcShadowFactor(float4 shadowPos, float3 normal, float3 lightDir)
         float2(-dx,  +dx), float2(0.0f,  +dx), float2(dx,  +dx)
     };
 
+    // The taps stay inside the cascade tile, the neighbouring ones belong to other projections
+    float4 uvRect = CascadeUvRects[cascade];
+    float2 uvMin = uvRect.xy + 0.5 * dx;
+    float2 uvMax = uvRect.zw - 0.5 * dx;
+
     float percentLit = 0.0f;
     for(int i = 0; i < 9; ++i)
     {
-        float pcf = ShadowMap.SampleCmpLevelZero(CmpSampler, shadowPos.xy + offsets[i], depth).r;
+        float pcf = ShadowMap.SampleCmpLevelZero(CmpSampler, clamp(shadowPos.xy + offsets[i], uvMin, uvMax), depth).r;
         percentLit += depth - bias > pcf ? 1.0 : 0.0f;
     }
 
@@ -94,8 +118,7 @@ float4 Main(VertexOut Input) : SV_TARGET
     float shadowFactor = 1.0f;
     if(ShadowEnabled)
     {
-        float4 shadowPos = mul(worldSpacePosition, ShadowTransform);
-        shadowFactor = CalcShadowFactor(shadowPos, normal, dirLightVec);
+        shadowFactor = CalcShadowFactor(worldSpacePosition, normal, dirLightVec);
     }
     
     float3 finalLight = PBR(F0, normal, view, dirLightVec, normalize(dirLightVec + view), lightColor.xyz, albedo.xyz, roughness, metallic);
@@ -1,4 +1,5 @@
 ﻿#include "Shaders/PBR.hlsl"
+#include "Shaders/LightClusters.hlsl"
 
 Texture2D Albedo : register(t2);
 Texture2D Normal : register(t3);
@@ -18,62 +19,63 @@ cbuffer CBuf : register(b0)
     row_major float4x4 InvViewProj;
 };
 
-struct PointLight
+StructuredBuffer<PointLight> PointLights : register(t1, space1);
+StructuredBuffer<LightCluster> LightClusters : register(t6, space1);
+StructuredBuffer<uint> LightIndices : register(t7, space1);
+
+cbuffer LightClusterCBuf : register(b8)
 {
-    float3 Position;
-    float Radius;
-    // 16 bytes boundary 
-    float4 Color;
-    // 16 bytes boundary 
-    float ConstantAttenuation;
-    float LinearAttenuation;
-    float QuadraticAttenuation;
-    float Padding3;
+    float4 ViewDepth;
+    uint3 ClusterCounts;
+    float SliceScale;
+    float SliceBias;
+    float2 TileScale;
+    float Padding1;
 };
 
-StructuredBuffer<PointLight> InstancesData2 : register(t6, space2);
-
 struct PixelIn
 {
     float4 Position : SV_POSITION;
-    float3 CameraPosition : TEXCOORD0;
-    float3 ObjectPosition : TEXCOORD1;
-    int InstanceIdx : TEXCOORD2;
+    float2 Texcoord : TEXCOORD;
 };
 
-float DoAttenuation(PointLight light, float distance)
-{
-    return 1.0f / (light.ConstantAttenuation + light.LinearAttenuation * distance + light.QuadraticAttenuation * distance * distance);
-}
-
 float4 Main(PixelIn Input) : SV_TARGET
 {
-    PointLight lightInfo = InstancesData2[Input.InstanceIdx];
+    float depth = Depth.Load(int3(Input.Position.xy, 0)).x;
+    if(depth == 1.0f)
+        discard;
+
     float4 albedo = float4(Albedo.Load(int3(Input.Position.xy, 0)).xyz, 1.0);
     float3 normal = normalize(Normal.Load(int3(Input.Position.xy, 0)).xyz);
     float3 metallicRoughness = MetallicRoughness.Load(int3(Input.Position.xy, 0)).xyz;
-    float depth = Depth.Load(int3(Input.Position.xy, 0)).x;
 
-    float2 Texcoord = Input.Position.xy / ScreenDimensions;
-    float4 clipSpacePosition = float4(Texcoord * 2.0 - 1.0, depth, 1.0);
+    float4 clipSpacePosition = float4(Input.Texcoord * 2.0 - 1.0, depth, 1.0);
     clipSpacePosition.y *= -1.0;
 
     float4 worldSpacePosition = mul(clipSpacePosition, InvViewProj);
     worldSpacePosition /= worldSpacePosition.w;
 
-    float3 view = normalize(Input.CameraPosition - worldSpacePosition.xyz);
+    float3 view = normalize(CameraPosition - worldSpacePosition.xyz);
+    float3 F0 = lerp(Fdielectric, albedo.xyz, metallicRoughness.b);
 
-    float3 l = Input.ObjectPosition - worldSpacePosition.xyz;
-    float d = length(l);
-    if(d > lightInfo.Radius)
-        discard;
+    LightCluster cluster = LightClusters[GetLightClusterIndex(Input.Position.xy, worldSpacePosition.xyz, ViewDepth, ClusterCounts, TileScale, SliceScale, SliceBias)];
 
-    float3 lightVector = normalize(l);
-    float attenuation = DoAttenuation(lightInfo, d);
-    float3 radiance = lightInfo.Color.xyz * attenuation;
-    float3 F0 = lerp(Fdielectric, albedo.xyz, metallicRoughness.b);
+    float3 finalLight = float3(0.0, 0.0, 0.0);
+    for(uint i = 0; i < cluster.Count; i++)
+    {
+        PointLight lightInfo = PointLights[LightIndices[cluster.Offset + i]];
 
-    float3 finalLight = PBR(F0, normal, view, lightVector, normalize(lightVector + view), radiance, albedo.xyz, metallicRoughness.g, metallicRoughness.b);
+        float3 l = lightInfo.Position - worldSpacePosition.xyz;
+        float d = length(l);
+        if(d > lightInfo.Radius)
+            continue;
+
+        float3 lightVector = l / d;
+        float attenuation = DoAttenuation(lightInfo, d);
+        float3 radiance = lightInfo.Color.xyz * attenuation;
+
+        finalLight += PBR(F0, normal, view, lightVector, normalize(lightVector + view), radiance, albedo.xyz, metallicRoughness.g, metallicRoughness.b);
+    }
 
     return float4(finalLight, 1.0);
-}
\ No newline at end of file
+}
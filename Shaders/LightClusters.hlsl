@@ -0,0 +1,35 @@
+﻿// Clustered point lights, see LightClustering.h : the including shader declares the point lights, clusters and light indices
+// buffers and a LightClusterCBuf, then walks LightIndices[cluster.Offset, cluster.Offset + cluster.Count)
+
+struct PointLight
+{
+    float3 Position;
+    float Radius;
+    // 16 bytes boundary 
+    float4 Color;
+    // 16 bytes boundary 
+    float ConstantAttenuation;
+    float LinearAttenuation;
+    float QuadraticAttenuation;
+    float Padding3;
+};
+
+struct LightCluster
+{
+    uint Offset;
+    uint Count;
+};
+
+float DoAttenuation(PointLight light, float distance)
+{
+    return 1.0f / (light.ConstantAttenuation + light.LinearAttenuation * distance + light.QuadraticAttenuation * distance * distance);
+}
+
+// Froxel of a pixel, tiles from its screen position and exponential slices from its view space depth
+uint GetLightClusterIndex(float2 pixelPosition, float3 positionWS, float4 viewDepth, uint3 clusterCounts, float2 tileScale, float sliceScale, float sliceBias)
+{
+    float depth = dot(float4(positionWS, 1.0f), viewDepth);
+    uint slice = (uint)clamp(floor(log(max(depth, 0.0001f)) * sliceScale + sliceBias), 0.0f, (float)(clusterCounts.z - 1));
+    uint2 tile = min((uint2)(pixelPosition * tileScale), clusterCounts.xy - 1);
+    return (slice * clusterCounts.y + tile.y) * clusterCounts.x + tile.x;
+}
@@ -1,4 +1,6 @@
-﻿cbuffer Cbuf : register(b0)
+﻿#include "Shaders/VertexCompression.hlsl"
+
+cbuffer Cbuf : register(b0)
 {
     row_major float4x4 ViewProj;
 }
@@ -12,14 +14,15 @@ struct InstanceData
 };
 
 StructuredBuffer<InstanceData> InstancesData : register(t1, space1);
+// Instance slots of the current LOD draw
+StructuredBuffer<uint> DrawInstances : register(t3, space1);
 
-struct VertexIn
+cbuffer PrimitiveCBuf : register(b2)
 {
-    float3 position : POSITION;
-    float2 texcoord : TEXCOORD;
-    float3 normal : NORMAL;
-    float3 tangent : TANGENT;
-    float3 binormal : BINORMAL;
+    float3 PositionScale;
+    float Padding0;
+    float3 PositionOffset;
+    float Padding1;
 };
 
 struct VertexOut
@@ -27,10 +30,10 @@ struct VertexOut
     float4 Position : SV_POSITION;
 };
 
-VertexOut Main(VertexIn Input, uint InstanceID : SV_InstanceID)
+VertexOut Main(PositionVertexIn Input, uint InstanceID : SV_InstanceID)
 {
     VertexOut Output;
-    float3 positionWS = mul(float4(Input.position, 1.0), InstancesData[InstanceID].WorldMat).xyz;
+    float3 positionWS = mul(float4(DecodePosition(Input.position, PositionScale, PositionOffset), 1.0), InstancesData[DrawInstances[InstanceID]].WorldMat).xyz;
     Output.Position = mul(float4(positionWS, 1.0), ViewProj);
     return Output;
 }
\ No newline at end of file
@@ -2,28 +2,20 @@ SamplerState Sampler : register(s2);
 Texture2D Albedo : register(t3);
 Texture2D Normal : register(t4);
 
-#define MAX_LIGHTS 50
+#include "Shaders/LightClusters.hlsl"
 
-struct PointLight
-{
-    float3 Position;
-    float Padding1;
-    // 16 bytes boundary 
-    float4 Color;
-    // 16 bytes boundary 
-    float ConstantAttenuation;
-    float LinearAttenuation;
-    float QuadraticAttenuation;
-    float Padding3;
-    // 16 bytes boundary
-    bool Enabled;
-    float3 Padding4;
-    // 16 bytes boundary
-}; // size 48 bytes (16 * 3)
-
-cbuffer LightsCbuf : register(b5)
+StructuredBuffer<PointLight> PointLights : register(t8, space2);
+StructuredBuffer<LightCluster> LightClusters : register(t9, space2);
+StructuredBuffer<uint> LightIndices : register(t10, space2);
+
+cbuffer LightClusterCBuf : register(b11)
 {
-    PointLight PointLights[MAX_LIGHTS];
+    float4 ViewDepth;
+    uint3 ClusterCounts;
+    float SliceScale;
+    float SliceBias;
+    float2 TileScale;
+    float Padding;
 };
 
 struct PixelIn
@@ -55,11 +47,6 @@ float3 DoSpecular(float4 lightColor, float3 lightVector, float3 normal, float3 v
     return amountSpecularLight * lightColor.xyz;
 }
 
-float DoAttenuation(PointLight light, float distance)
-{
-    return 1.0f / (light.ConstantAttenuation + light.LinearAttenuation * distance + light.QuadraticAttenuation * distance * distance);
-}
-
 float4 Main(PixelIn Input) : SV_TARGET
 {
     float4 lightColor = float4(1.0, 1.0, 1.0, 1.0);
@@ -90,17 +77,17 @@ float4 Main(PixelIn Input) : SV_TARGET
     float3 dirLight = dirDiffuse + dirSpecular + ambiant;
     float3 lightSum = float3(0.0, 0.0, 0.0);
 
-    // Point Lights
-    for(int i = 0; i < MAX_LIGHTS; i++)
+    // Point Lights of the pixel cluster
+    LightCluster cluster = LightClusters[GetLightClusterIndex(Input.Position.xy, Input.PositionWS, ViewDepth, ClusterCounts, TileScale, SliceScale, SliceBias)];
+    for(uint i = 0; i < cluster.Count; i++)
     {
-        PointLight light = PointLights[i];
-        
-        if(!light.Enabled)
-            continue;
+        PointLight light = PointLights[LightIndices[cluster.Offset + i]];
         
         float3 l = (light.Position - Input.PositionWS);
         float3 lightVector = normalize(l);
         float distance = length(l);
+        if(distance > light.Radius)
+            continue;
         
         float attenuation = DoAttenuation(light, distance);
         float3 diffuse = DoDiffuse(light.Color, lightVector, normal) * attenuation;
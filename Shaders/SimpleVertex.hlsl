@@ -1,3 +1,5 @@
+#include "Shaders/VertexCompression.hlsl"
+
 cbuffer CBuf : register(b0)
 {
     row_major float4x4 ViewProj;
@@ -15,14 +17,15 @@ struct InstanceData
 };
 
 StructuredBuffer<InstanceData> InstancesData : register(t5, space1);
+// Instance slots of the current LOD draw
+StructuredBuffer<uint> DrawInstances : register(t7, space1);
 
-struct VertexIn
+cbuffer PrimitiveCBuf : register(b6)
 {
-    float3 position : POSITION;
-    float2 texcoord : TEXCOORD;
-    float3 normal : NORMAL;
-    float3 tangent : TANGENT;
-    float3 binormal : BINORMAL;
+    float3 PositionScale;
+    float Padding0;
+    float3 PositionOffset;
+    float Padding1;
 };
 
 struct VertexOut
@@ -40,15 +43,20 @@ struct VertexOut
 VertexOut Main(VertexIn Input, uint InstanceID : SV_InstanceID)
 {
     VertexOut Output;
-    InstanceData instanceData = InstancesData[InstanceID];
-    Output.PositionWS = mul(float4(Input.position, 1.0), instanceData.WorldMat).xyz;
+    InstanceData instanceData = InstancesData[DrawInstances[InstanceID]];
+    float3 position = DecodePosition(Input.position, PositionScale, PositionOffset);
+    float3 normal = DecodeOctahedral(Input.normal);
+    float3 tangent = DecodeOctahedral(Input.tangent);
+    float3 binormal = cross(normal, tangent) * DecodeBitangentSign(Input.position);
+
+    Output.PositionWS = mul(float4(position, 1.0), instanceData.WorldMat).xyz;
     Output.Position = mul(float4(Output.PositionWS, 1.0), ViewProj);
-    Output.normal = normalize(mul(Input.normal, (float3x3)instanceData.WorldMat));
+    Output.normal = normalize(mul(normal, (float3x3)instanceData.WorldMat));
     Output.uv = Input.texcoord;
     
-    Output.tbn[0] = normalize(mul(Input.tangent, (float3x3)instanceData.WorldMat));
-    Output.tbn[1] = normalize(mul(Input.binormal, (float3x3)instanceData.WorldMat));
-    Output.tbn[2] = normalize(mul(Input.normal, (float3x3)instanceData.WorldMat));
+    Output.tbn[0] = normalize(mul(tangent, (float3x3)instanceData.WorldMat));
+    Output.tbn[1] = normalize(mul(binormal, (float3x3)instanceData.WorldMat));
+    Output.tbn[2] = Output.normal;
 
     Output.HasAlbedo = instanceData.HasAlbedo;
     Output.HasNormalMap = instanceData.HasNormalMap;
@@ -1,11 +1,4 @@
-﻿struct VertexIn
-{
-    float3 position : POSITION;
-    float2 texcoord : TEXCOORD;
-    float3 normal : NORMAL;
-    float3 tangent : TANGENT;
-    float3 binormal : BINORMAL;
-};
+﻿#include "Shaders/VertexCompression.hlsl"
 
 struct VertexOut
 {
@@ -19,15 +12,25 @@ cbuffer CBuf : register(b0)
     float3 CameraPosition;
 };
 
+cbuffer PrimitiveCBuf : register(b3)
+{
+    float3 PositionScale;
+    float Padding0;
+    float3 PositionOffset;
+    float Padding1;
+};
+
 VertexOut Main(VertexIn vertexIn)
 {
     VertexOut vertexOut;
 
+    float3 position = DecodePosition(vertexIn.position, PositionScale, PositionOffset);
+
     // Use local vertex position as cubemap lookup vector.
-    vertexOut.LookUpVector = vertexIn.position;
+    vertexOut.LookUpVector = position;
 
     // Always center sky about camera.
-    float4 posW = float4(vertexIn.position, 1.0f);
+    float4 posW = float4(position, 1.0f);
     posW.xyz += CameraPosition;
 
     // Set z = w so that z/w = 1 (i.e., skydome always on far plane).
@@ -0,0 +1,32 @@
+// Decoding of CompactVertex (Rendering/VertexCompression.h), members in the same order for the input layout
+struct VertexIn
+{
+    float4 position : POSITION; // xyz unorm in the primitive bounds, w is the bitangent sign (0 : -1, 1 : +1)
+    float2 normal : NORMAL; // Octahedral
+    float2 tangent : TANGENT; // Octahedral
+    float2 texcoord : TEXCOORD;
+};
+
+// Layout of CompactPosition, also valid on a CompactVertex buffer since the position comes first
+struct PositionVertexIn
+{
+    float4 position : POSITION;
+};
+
+float3 DecodePosition(float4 position, float3 scale, float3 offset)
+{
+    return position.xyz * scale + offset;
+}
+
+float3 DecodeOctahedral(float2 encoded)
+{
+    float3 direction = float3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = saturate(-direction.z);
+    direction.xy += direction.xy >= 0.0 ? -fold : fold;
+    return normalize(direction);
+}
+
+float DecodeBitangentSign(float4 position)
+{
+    return position.w > 0.5 ? 1.0 : -1.0;
+}
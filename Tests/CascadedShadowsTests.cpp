@@ -0,0 +1,181 @@
+﻿#include <random>
+
+#include "Rendering/CascadedShadows.h"
+#include "TestFramework.h"
+
+using namespace DirectX;
+
+namespace
+{
+    const float FieldOfView = 0.8f;
+    const float AspectRatio = 16.0f / 9.0f;
+    const uint32_t CascadeResolution = 2048;
+
+    const BVHBox SceneBounds = { { -150.0f, -10.0f, -150.0f }, { 150.0f, 40.0f, 150.0f } };
+    const BVHBox NoCasterBounds = { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+
+    bool IsInside(const BVHBox& box, const XMFLOAT3& point)
+    {
+        return point.x >= box.Min.x && point.x <= box.Max.x && point.y >= box.Min.y && point.y <= box.Max.y
+            && point.z >= box.Min.z && point.z <= box.Max.z;
+    }
+
+    // Where the world origin lands in the cascade, in texels
+    XMFLOAT2 GetOriginTexel(const ShadowCascade& cascade)
+    {
+        XMFLOAT4 clip;
+        XMStoreFloat4(&clip, XMVector4Transform(XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), XMLoadFloat4x4(&cascade.ViewProj)));
+        return XMFLOAT2(clip.x * 0.5f * CascadeResolution, clip.y * 0.5f * CascadeResolution);
+    }
+}
+
+TEST(CascadedShadows_PracticalSplits)
+{
+    float splits[SHADOW_CASCADE_COUNT + 1];
+
+    for(float lambda : { 0.0f, 0.5f, SHADOW_CASCADE_SPLIT_LAMBDA, 1.0f })
+    {
+        CascadedShadows::ComputeSplits(0.1f, 1000.0f, SHADOW_CASCADE_COUNT, lambda, splits);
+        CHECK(splits[0] == 0.1f && splits[SHADOW_CASCADE_COUNT] == 1000.0f);
+        for(uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++)
+            CHECK(splits[i] < splits[i + 1]);
+    }
+
+    // Lambda 0 is uniform and 1 logarithmic, anything between is between the two
+    float uniform[5];
+    float logarithmic[5];
+    float practical[5];
+    CascadedShadows::ComputeSplits(1.0f, 201.0f, 4, 0.0f, uniform);
+    CascadedShadows::ComputeSplits(1.0f, 201.0f, 4, 1.0f, logarithmic);
+    CascadedShadows::ComputeSplits(1.0f, 201.0f, 4, 0.5f, practical);
+    CHECK_NEAR(uniform[2], 101.0f, 1e-3f);
+    CHECK_NEAR(logarithmic[2], std::sqrt(201.0f), 1e-3f);
+    for(uint32_t i = 1; i < 4; i++)
+        CHECK(practical[i] > logarithmic[i] && practical[i] < uniform[i]);
+}
+
+TEST(CascadedShadows_SlicesInsideCascades)
+{
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+    XMMATRIX proj = XMMatrixPerspectiveFovLH(FieldOfView, AspectRatio, 1.0f, 1000.0f);
+    float projX = XMVectorGetX(proj.r[0]);
+    float projY = XMVectorGetY(proj.r[1]);
+
+    bool slicesInside = true;
+    bool castersInside = true;
+    for(uint32_t trial = 0; trial < 100; trial++)
+    {
+        XMVECTOR eye = XMVectorSet(distribution(random) * 100.0f, 5.0f + distribution(random) * 5.0f, distribution(random) * 100.0f, 1.0f);
+        XMVECTOR direction = XMVector3Normalize(XMVectorSet(distribution(random), distribution(random) * 0.3f, distribution(random), 0.0f));
+        XMMATRIX view = XMMatrixLookAtLH(eye, XMVectorAdd(eye, direction), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+        XMMATRIX invView = XMMatrixInverse(nullptr, view);
+        XMFLOAT3 lightDirection(distribution(random), -1.0f, distribution(random));
+
+        // Every other trial without casters, the cascades then fit their slices alone
+        bool hasCasters = trial % 2 == 1;
+        ShadowCascade cascades[SHADOW_CASCADE_COUNT];
+        CascadedShadows::Compute(view, proj, lightDirection, hasCasters ? SceneBounds : NoCasterBounds, CascadeResolution, cascades);
+
+        for(const ShadowCascade& cascade : cascades)
+        {
+            XMMATRIX viewProj = XMLoadFloat4x4(&cascade.ViewProj);
+
+            // Points of the frustum slice, those in the caster bounds when there are casters, land in the clip volume
+            for(uint32_t i = 0; i < 200; i++)
+            {
+                float depth = cascade.SplitNear + (cascade.SplitFar - cascade.SplitNear) * (distribution(random) * 0.5f + 0.5f);
+                XMVECTOR viewPoint = XMVectorSet(distribution(random) * depth / projX, distribution(random) * depth / projY, depth, 1.0f);
+                XMVECTOR worldPoint = XMVector3TransformCoord(viewPoint, invView);
+
+                XMFLOAT3 world;
+                XMStoreFloat3(&world, worldPoint);
+                if(hasCasters && !IsInside(SceneBounds, world))
+                    continue;
+
+                XMFLOAT4 clip;
+                XMStoreFloat4(&clip, XMVector4Transform(XMVectorSetW(worldPoint, 1.0f), viewProj));
+                slicesInside &= std::fabs(clip.x) <= 1.0001f && std::fabs(clip.y) <= 1.0001f && clip.z >= -1e-4f && clip.z <= 1.0001f;
+            }
+
+            // Casters above the slice, towards the light, are not clipped by the near plane
+            if(hasCasters)
+            {
+                XMFLOAT4 clip;
+                XMStoreFloat4(&clip, XMVector4Transform(XMVectorSet(0.0f, SceneBounds.Max.y, 0.0f, 1.0f), viewProj));
+                castersInside &= clip.z >= -1e-4f || std::fabs(clip.x) > 1.0f || std::fabs(clip.y) > 1.0f;
+            }
+        }
+    }
+
+    CHECK(slicesInside);
+    CHECK(castersInside);
+}
+
+TEST(CascadedShadows_SubTexelMotionIsStable)
+{
+    std::mt19937 random(2);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+    XMMATRIX proj = XMMatrixPerspectiveFovLH(FieldOfView, AspectRatio, 1.0f, 1000.0f);
+    XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+
+    uint32_t comparedCount = 0;
+    bool movesWholeTexels = true;
+    for(uint32_t trial = 0; trial < 100; trial++)
+    {
+        XMVECTOR eye = XMVectorSet(distribution(random) * 100.0f, 5.0f, distribution(random) * 100.0f, 1.0f);
+        XMVECTOR direction = XMVector3Normalize(XMVectorSet(distribution(random), distribution(random) * 0.3f, distribution(random), 0.0f));
+        XMFLOAT3 lightDirection(distribution(random), -1.0f, distribution(random));
+
+        // A fraction of the texel size of the first cascade
+        XMVECTOR offset = XMVectorSet(0.013f, 0.0f, 0.007f, 0.0f);
+        XMVECTOR movedEye = XMVectorAdd(eye, offset);
+
+        ShadowCascade cascades[SHADOW_CASCADE_COUNT];
+        ShadowCascade movedCascades[SHADOW_CASCADE_COUNT];
+        CascadedShadows::Compute(XMMatrixLookAtLH(eye, XMVectorAdd(eye, direction), up), proj, lightDirection, SceneBounds, CascadeResolution, cascades);
+        CascadedShadows::Compute(XMMatrixLookAtLH(movedEye, XMVectorAdd(movedEye, direction), up), proj, lightDirection, SceneBounds, CascadeResolution, movedCascades);
+
+        for(uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++)
+        {
+            // The extent may cross a quantization step, the texel grid then changes on purpose
+            if(cascades[i].TexelSize != movedCascades[i].TexelSize)
+                continue;
+
+            // Same texel size, the projection may only move by whole texels
+            XMFLOAT2 origin = GetOriginTexel(cascades[i]);
+            XMFLOAT2 movedOrigin = GetOriginTexel(movedCascades[i]);
+            float deltaX = origin.x - movedOrigin.x;
+            float deltaY = origin.y - movedOrigin.y;
+            movesWholeTexels &= std::fabs(deltaX - std::round(deltaX)) < 2e-2f && std::fabs(deltaY - std::round(deltaY)) < 2e-2f;
+            comparedCount++;
+        }
+    }
+
+    CHECK(movesWholeTexels);
+    CHECK(comparedCount > SHADOW_CASCADE_COUNT * 100 / 2);
+}
+
+BENCHMARK(CascadedShadows_Compute)
+{
+    XMMATRIX proj = XMMatrixPerspectiveFovLH(FieldOfView, AspectRatio, 1.0f, 1000.0f);
+    XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(3.0f, 5.0f, -10.0f, 1.0f), XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    ShadowCascade cascades[SHADOW_CASCADE_COUNT];
+
+    const uint32_t computeCount = 10000;
+    double computeMs = MeasureMilliseconds(10, [&]
+    {
+        for(uint32_t i = 0; i < computeCount; i++)
+        {
+            XMFLOAT3 lightDirection(0.5f + i * 1e-6f, -1.0f, 0.2f);
+            CascadedShadows::Compute(view, proj, lightDirection, SceneBounds, CascadeResolution, cascades);
+        }
+    });
+    DoNotOptimize(cascades[SHADOW_CASCADE_COUNT - 1].TexelSize);
+
+    printf("    %u cascades computed in %.3f us\n", SHADOW_CASCADE_COUNT, computeMs * 1000.0 / computeCount);
+    for(const ShadowCascade& cascade : cascades)
+        printf("    [%.1f, %.1f] texel %.4f\n", cascade.SplitNear, cascade.SplitFar, cascade.TexelSize);
+}
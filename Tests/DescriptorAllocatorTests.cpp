@@ -0,0 +1,225 @@
+﻿#include <algorithm>
+#include <random>
+#include <thread>
+
+#include "RHI/DescriptorAllocator.h"
+#include "TestFramework.h"
+
+namespace
+{
+    // First fit over a plain table, what DescriptorHeap used before the bitmap
+    class LinearScanAllocator
+    {
+    public:
+        LinearScanAllocator(uint32_t capacity, uint32_t allocatedCount) : m_handlesTable(capacity, false)
+        {
+            std::fill(m_handlesTable.begin(), m_handlesTable.begin() + allocatedCount, true);
+        }
+
+        uint32_t Allocate()
+        {
+            for(uint32_t i = 0; i < (uint32_t)m_handlesTable.size(); i++)
+            {
+                if(m_handlesTable[i] == false)
+                {
+                    m_handlesTable[i] = true;
+                    return i;
+                }
+            }
+
+            return DESCRIPTOR_INVALID_INDEX;
+        }
+
+        void Free(uint32_t index) { m_handlesTable[index] = false; }
+
+    private:
+        std::vector<bool> m_handlesTable;
+    };
+
+    uint32_t FindFirstFit(const std::vector<bool>& used, uint32_t count)
+    {
+        uint32_t runLength = 0;
+        for(uint32_t i = 0; i < (uint32_t)used.size(); i++)
+        {
+            runLength = used[i] ? 0 : runLength + 1;
+            if(runLength == count)
+                return i + 1 - count;
+        }
+
+        return DESCRIPTOR_INVALID_INDEX;
+    }
+}
+
+TEST(DescriptorAllocator_SingleAllocations)
+{
+    DescriptorAllocator allocator(130);
+    CHECK(allocator.GetCapacity() == 130);
+
+    for(uint32_t i = 0; i < 130; i++)
+        CHECK(allocator.Allocate() == i);
+    CHECK(allocator.Allocate() == DESCRIPTOR_INVALID_INDEX);
+    CHECK(allocator.GetAllocatedCount() == 130);
+
+    // Freed slots come back lowest first, across the 64 slots words
+    allocator.Free(100);
+    allocator.Free(3);
+    CHECK(allocator.GetAllocatedCount() == 128);
+    CHECK(allocator.Allocate() == 3);
+    CHECK(allocator.Allocate() == 100);
+    CHECK(allocator.Allocate() == DESCRIPTOR_INVALID_INDEX);
+
+    // Double free is reported and not counted twice
+    allocator.Free(7);
+    allocator.Free(7);
+    CHECK(allocator.GetAllocatedCount() == 129);
+}
+
+TEST(DescriptorAllocator_RangesMatchFirstFit)
+{
+    const uint32_t capacity = 700;
+    DescriptorAllocator allocator(capacity);
+    std::vector<bool> used(capacity, false);
+    std::vector<std::pair<uint32_t, uint32_t>> liveRanges;
+    std::mt19937 random(1);
+
+    for(uint32_t iteration = 0; iteration < 20000; iteration++)
+    {
+        if(random() % 3 != 2)
+        {
+            uint32_t count = random() % 2 == 0 ? 1 : 1 + random() % 130;
+            uint32_t index = allocator.AllocateRange(count);
+            CHECK(index == FindFirstFit(used, count));
+            if(index == DESCRIPTOR_INVALID_INDEX)
+                continue;
+
+            for(uint32_t i = index; i < index + count; i++)
+                used[i] = true;
+            liveRanges.push_back({ index, count });
+        }
+        else if(!liveRanges.empty())
+        {
+            size_t rangeIdx = random() % liveRanges.size();
+            auto [index, count] = liveRanges[rangeIdx];
+            liveRanges[rangeIdx] = liveRanges.back();
+            liveRanges.pop_back();
+
+            allocator.Free(index, count);
+            for(uint32_t i = index; i < index + count; i++)
+                used[i] = false;
+        }
+    }
+
+    uint32_t usedCount = 0;
+    for(bool isUsed : used)
+        usedCount += isUsed ? 1 : 0;
+    CHECK(allocator.GetAllocatedCount() == usedCount);
+
+    CHECK(allocator.AllocateRange(0) == DESCRIPTOR_INVALID_INDEX);
+    CHECK(allocator.AllocateRange(capacity + 1) == DESCRIPTOR_INVALID_INDEX);
+}
+
+TEST(DescriptorAllocator_Transient)
+{
+    // 300 transient descriptors split over 3 frames, after the 700 persistent ones
+    DescriptorAllocator allocator(1000, 300, 3);
+    CHECK(allocator.GetCapacity() == 700);
+
+    allocator.BeginFrame(1);
+    CHECK(allocator.AllocateTransient(50) == 800);
+    CHECK(allocator.AllocateTransient(50) == 850);
+    CHECK(allocator.AllocateTransient(1) == DESCRIPTOR_INVALID_INDEX);
+
+    // Same frame index again, its range is recycled
+    allocator.BeginFrame(2);
+    CHECK(allocator.AllocateTransient(100) == 900);
+    allocator.BeginFrame(1);
+    CHECK(allocator.AllocateTransient(10) == 800);
+
+    // Freeing a transient descriptor is a no-op
+    allocator.Free(800, 10);
+    CHECK(allocator.GetAllocatedCount() == 0);
+}
+
+TEST(DescriptorAllocator_Threads)
+{
+    const uint32_t threadCount = 8;
+    const uint32_t allocationCount = 20000;
+    DescriptorAllocator allocator(threadCount * allocationCount);
+
+    std::vector<std::vector<uint32_t>> indices(threadCount);
+    std::vector<std::thread> threads;
+    for(uint32_t threadIdx = 0; threadIdx < threadCount; threadIdx++)
+    {
+        threads.emplace_back([&, threadIdx]
+        {
+            for(uint32_t i = 0; i < allocationCount; i++)
+            {
+                indices[threadIdx].push_back(allocator.Allocate());
+                if(i % 3 == 0)
+                {
+                    allocator.Free(indices[threadIdx].back());
+                    indices[threadIdx].pop_back();
+                }
+            }
+        });
+    }
+    for(auto& thread : threads)
+        thread.join();
+
+    std::vector<bool> seen(allocator.GetCapacity(), false);
+    uint32_t liveCount = 0;
+    bool isUnique = true;
+    for(const auto& threadIndices : indices)
+    {
+        for(uint32_t index : threadIndices)
+        {
+            if(index == DESCRIPTOR_INVALID_INDEX || seen[index])
+            {
+                isUnique = false;
+                continue;
+            }
+
+            seen[index] = true;
+            liveCount++;
+        }
+    }
+
+    CHECK(isUnique);
+    CHECK(allocator.GetAllocatedCount() == liveCount);
+}
+
+// Allocate + Free pairs with the heap 90% full, the worst case of the first fit scan
+BENCHMARK(DescriptorAllocator_AllocateFree)
+{
+    const uint32_t capacity = 1000000;
+    const uint32_t filledCount = capacity / 10 * 9;
+
+    DescriptorAllocator allocator(capacity);
+    LinearScanAllocator linearAllocator(capacity, filledCount);
+    for(uint32_t i = 0; i < filledCount; i++)
+        allocator.Allocate();
+
+    const uint32_t bitmapPairCount = 1000000;
+    double bitmapMs = MeasureMilliseconds(5, [&]
+    {
+        for(uint32_t i = 0; i < bitmapPairCount; i++)
+            allocator.Free(allocator.Allocate());
+    });
+
+    const uint32_t linearPairCount = 100;
+    double linearMs = MeasureMilliseconds(5, [&]
+    {
+        for(uint32_t i = 0; i < linearPairCount; i++)
+            linearAllocator.Free(linearAllocator.Allocate());
+    });
+
+    DescriptorAllocator rangeAllocator(capacity);
+    double rangeMs = MeasureMilliseconds(5, [&]
+    {
+        for(uint32_t i = 0; i < 1000; i++)
+            rangeAllocator.Free(rangeAllocator.AllocateRange(64), 64);
+    });
+
+    printf("    bitmap %.1f ns, vector<bool> scan %.1f ns, 64 descriptors range %.1f ns per allocate + free\n",
+        bitmapMs * 1e6 / bitmapPairCount, linearMs * 1e6 / linearPairCount, rangeMs * 1e6 / 1000);
+}
@@ -0,0 +1,167 @@
+﻿#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include "Jobs/JobSystem.h"
+#include "Rendering/DrawList.h"
+#include "TestFramework.h"
+
+namespace
+{
+    enum class KeyDistribution { Random, FewKeys, HighByteOnly, HighNibbles, Equal };
+
+    // FirstInstance holds the insertion order, equal keys must keep it
+    std::vector<DrawPacket> MakePackets(uint32_t count, KeyDistribution distribution, std::mt19937_64& random)
+    {
+        std::vector<uint64_t> fewKeys(7);
+        for(uint64_t& key : fewKeys)
+            key = random();
+
+        std::vector<DrawPacket> packets(count);
+        for(uint32_t i = 0; i < count; i++)
+        {
+            uint64_t key = 0;
+            switch(distribution)
+            {
+            case KeyDistribution::Random: key = random(); break;
+            case KeyDistribution::FewKeys: key = fewKeys[random() % fewKeys.size()]; break;
+            case KeyDistribution::HighByteOnly: key = (random() & 0xFF00000000000000ull) | 0x1234; break;
+            case KeyDistribution::HighNibbles: key = random() & 0xF0F0F0F0F0F0F0F0ull; break;
+            case KeyDistribution::Equal: key = 42; break;
+            }
+            packets[i] = { key, (uint32_t)(random() % 100), (uint32_t)(random() % 4), i, 1 };
+        }
+        return packets;
+    }
+
+    bool SamePackets(const std::vector<DrawPacket>& a, const std::vector<DrawPacket>& b)
+    {
+        return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(DrawPacket)) == 0);
+    }
+
+    void CheckSortMatchesStableSort()
+    {
+        std::mt19937_64 random(25);
+        DrawList drawList;
+        for(uint32_t count : { 0u, 1u, 2u, 100u, DRAW_LIST_SORT_GRAIN_SIZE - 1u, DRAW_LIST_SORT_GRAIN_SIZE + 0u, DRAW_LIST_SORT_GRAIN_SIZE + 1u, 3u * DRAW_LIST_SORT_GRAIN_SIZE + 17u, 100000u })
+        {
+            for(KeyDistribution distribution : { KeyDistribution::Random, KeyDistribution::FewKeys, KeyDistribution::HighByteOnly, KeyDistribution::HighNibbles, KeyDistribution::Equal })
+            {
+                std::vector<DrawPacket> packets = MakePackets(count, distribution, random);
+                drawList.Clear();
+                for(const DrawPacket& packet : packets)
+                    drawList.Add(packet);
+                drawList.Sort();
+
+                std::stable_sort(packets.begin(), packets.end(), [](const DrawPacket& a, const DrawPacket& b) { return a.Key < b.Key; });
+                CHECK(SamePackets(drawList.GetPackets(), packets));
+            }
+        }
+    }
+}
+
+TEST(DrawList_KeyFieldOrder)
+{
+    const uint32_t all = UINT32_MAX;
+
+    // Each field outweighs every field below it
+    CHECK(DrawList::MakeKey(1, 0, 0, 0, 0.0f) > DrawList::MakeKey(0, all, all, all, FLT_MAX));
+    CHECK(DrawList::MakeKey(0, 1, 0, 0, 0.0f) > DrawList::MakeKey(0, 0, all, all, FLT_MAX));
+    CHECK(DrawList::MakeKey(0, 0, 1, 0, 0.0f) > DrawList::MakeKey(0, 0, 0, all, FLT_MAX));
+    CHECK(DrawList::MakeKey(0, 0, 0, 1, 0.0f) > DrawList::MakeKey(0, 0, 0, 0, FLT_MAX));
+
+    // Fields land at their bit offsets, wider values are truncated without touching their neighbours
+    uint64_t key = DrawList::MakeKey(0x5, 0xA, 0x1234, 0xBEEF, 0.0f);
+    CHECK(key >> (64 - DRAW_KEY_PASS_BITS) == 0x5);
+    CHECK((key >> (DRAW_KEY_MATERIAL_BITS + DRAW_KEY_MESH_BITS + DRAW_KEY_DEPTH_BITS) & ((1u << DRAW_KEY_PIPELINE_BITS) - 1)) == 0xA);
+    CHECK((key >> (DRAW_KEY_MESH_BITS + DRAW_KEY_DEPTH_BITS) & ((1u << DRAW_KEY_MATERIAL_BITS) - 1)) == 0x1234);
+    CHECK((key >> DRAW_KEY_DEPTH_BITS & ((1u << DRAW_KEY_MESH_BITS) - 1)) == 0xBEEF);
+    CHECK(DrawList::MakeKey(0x15, 0x1A, 0x11234, 0x1BEEF, 0.0f) == key);
+    CHECK(DrawList::MakeKey(0, 0, 0, 0, -5.0f) == DrawList::MakeKey(0, 0, 0, 0, 0.0f));
+
+    // Depth orders front to back, 8 exponent and 16 mantissa bits are kept : depths 2^-16 apart relative to each other get different keys
+    std::mt19937 random(25);
+    std::uniform_real_distribution<float> exponent(-10.0f, 12.0f);
+    for(uint32_t i = 0; i < 10000; i++)
+    {
+        float depth = std::exp2(exponent(random));
+        float further = std::exp2(exponent(random));
+        uint64_t depthKey = DrawList::MakeKey(3, 2, 7, 9, depth);
+        uint64_t furtherKey = DrawList::MakeKey(3, 2, 7, 9, further);
+        CHECK((depth < further) ? depthKey <= furtherKey : depthKey >= furtherKey);
+        CHECK(DrawList::MakeKey(3, 2, 7, 9, depth * (1.0f + std::exp2(-16.0f))) > depthKey);
+        CHECK(depthKey >> DRAW_KEY_DEPTH_BITS == DrawList::MakeKey(3, 2, 7, 9, 0.0f) >> DRAW_KEY_DEPTH_BITS);
+    }
+}
+
+TEST(DrawList_SortMatchesStableSort)
+{
+    CheckSortMatchesStableSort();
+}
+
+TEST(DrawList_SortMatchesStableSortWithoutJobSystem)
+{
+    JobSystem::Release();
+    CheckSortMatchesStableSort();
+    JobSystem::Create(TestRegistry::GetWorkerCount());
+}
+
+TEST(DrawList_StableOnEqualKeys)
+{
+    // Two interleaved keys over several chunks : each keeps the insertion order of its packets
+    DrawList drawList;
+    uint32_t count = 5 * DRAW_LIST_SORT_GRAIN_SIZE + 3;
+    uint64_t keys[2] = { DrawList::MakeKey(2, 1, 5, 8, 3.0f), DrawList::MakeKey(1, 3, 5, 8, 3.0f) };
+    for(uint32_t i = 0; i < count; i++)
+        drawList.Add({ keys[i % 2], 0, 0, i, 1 });
+    drawList.Sort();
+
+    const std::vector<DrawPacket>& packets = drawList.GetPackets();
+    CHECK(packets.size() == count);
+    for(uint32_t i = 0; i < count; i++)
+    {
+        bool first = i < count / 2;
+        CHECK(packets[i].Key == keys[first ? 1 : 0]);
+        CHECK(packets[i].FirstInstance == (first ? 2 * i + 1 : 2 * (i - count / 2)));
+    }
+}
+
+BENCHMARK(DrawList_Sort)
+{
+    // Keys as the passes build them : few passes and pipelines, a material and mesh per batch, any depth
+    std::mt19937 random(25);
+    std::uniform_int_distribution<uint32_t> batch(0, 2047);
+    std::uniform_real_distribution<float> depth(0.5f, 500.0f);
+    for(uint32_t count : { 10000u, 100000u, 1000000u })
+    {
+        std::vector<DrawPacket> packets(count);
+        for(uint32_t i = 0; i < count; i++)
+        {
+            uint32_t b = batch(random);
+            packets[i] = { DrawList::MakeKey(random() % 3, random() % 4, b / 8, b, depth(random)), b, 0, i, 1 };
+        }
+
+        DrawList drawList;
+        double radixMs = MeasureMilliseconds(5, [&]
+        {
+            drawList.Clear();
+            for(const DrawPacket& packet : packets)
+                drawList.Add(packet);
+            drawList.Sort();
+            DoNotOptimize(drawList);
+        });
+
+        std::vector<DrawPacket> sorted;
+        double stableSortMs = MeasureMilliseconds(5, [&]
+        {
+            sorted = packets;
+            std::stable_sort(sorted.begin(), sorted.end(), [](const DrawPacket& a, const DrawPacket& b) { return a.Key < b.Key; });
+            DoNotOptimize(sorted);
+        });
+
+        CHECK(SamePackets(drawList.GetPackets(), sorted));
+        printf("    %u packets : radix sort %.2f ms, std::stable_sort %.2f ms (%.1fx)\n", count, radixMs, stableSortMs, stableSortMs / radixMs);
+    }
+}
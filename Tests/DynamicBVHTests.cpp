@@ -0,0 +1,365 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "DynamicBVH.h"
+#include "Jobs/JobSystem.h"
+#include "TestFramework.h"
+
+using namespace DirectX;
+
+namespace
+{
+    // Objects tracked next to the tree, UINT32_MAX proxies are removed ones
+    struct TestObjects
+    {
+        std::vector<BVHBox> Boxes;
+        std::vector<uint32_t> Proxies;
+    };
+
+    BVHBox MakeBox(std::mt19937& random, float worldSize, float maxSize)
+    {
+        std::uniform_real_distribution<float> position(-worldSize, worldSize);
+        std::uniform_real_distribution<float> size(0.1f, maxSize);
+        XMFLOAT3 center(position(random), position(random) * 0.1f, position(random));
+        XMFLOAT3 extent(size(random), size(random), size(random));
+        return { XMFLOAT3(center.x - extent.x, center.y - extent.y, center.z - extent.z), XMFLOAT3(center.x + extent.x, center.y + extent.y, center.z + extent.z) };
+    }
+
+    BVHBox Translate(const BVHBox& box, float x, float y, float z)
+    {
+        return { XMFLOAT3(box.Min.x + x, box.Min.y + y, box.Min.z + z), XMFLOAT3(box.Max.x + x, box.Max.y + y, box.Max.z + z) };
+    }
+
+    void InsertObjects(DynamicBVH& bvh, TestObjects& objects, std::mt19937& random, uint32_t count, float worldSize)
+    {
+        for(uint32_t i = 0; i < count; i++)
+        {
+            BVHBox box = MakeBox(random, worldSize, 2.0f);
+            objects.Proxies.push_back(bvh.Insert(box, (uint32_t)objects.Boxes.size()));
+            objects.Boxes.push_back(box);
+        }
+    }
+
+    // Gizmo drags, teleports, removals and insertions, as the editor does them
+    void Churn(DynamicBVH& bvh, TestObjects& objects, std::mt19937& random, float worldSize)
+    {
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        uint32_t count = (uint32_t)objects.Boxes.size();
+        for(uint32_t i = 0; i < count; i++)
+        {
+            if(objects.Proxies[i] == UINT32_MAX)
+                continue;
+
+            float action = unit(random);
+            if(action < 0.2f)
+                objects.Boxes[i] = Translate(objects.Boxes[i], unit(random) * 0.2f - 0.1f, 0.0f, unit(random) * 0.2f - 0.1f);
+            else if(action < 0.3f)
+                objects.Boxes[i] = MakeBox(random, worldSize, 2.0f);
+            else if(action < 0.35f)
+            {
+                bvh.Remove(objects.Proxies[i]);
+                objects.Proxies[i] = UINT32_MAX;
+                continue;
+            }
+            else
+                continue;
+
+            bvh.Update(objects.Proxies[i], objects.Boxes[i]);
+        }
+        InsertObjects(bvh, objects, random, count / 20, worldSize);
+    }
+
+    bool BruteOverlaps(const BVHBox& a, const BVHBox& b)
+    {
+        return a.Min.x <= b.Max.x && a.Min.y <= b.Max.y && a.Min.z <= b.Max.z && a.Max.x >= b.Min.x && a.Max.y >= b.Min.y && a.Max.z >= b.Min.z;
+    }
+
+    bool BruteOverlaps(const BVHSphere& sphere, const BVHBox& box)
+    {
+        float x = sphere.Center.x - (std::clamp)(sphere.Center.x, box.Min.x, box.Max.x);
+        float y = sphere.Center.y - (std::clamp)(sphere.Center.y, box.Min.y, box.Max.y);
+        float z = sphere.Center.z - (std::clamp)(sphere.Center.z, box.Min.z, box.Max.z);
+        return x * x + y * y + z * z <= sphere.Radius * sphere.Radius;
+    }
+
+    // Entry distance of the ray in the box, maxDistance when it misses. Used as the exact leaf test and by the brute force reference
+    float RayBoxDistance(const BVHRay& ray, const BVHBox& box, float maxDistance)
+    {
+        const float* origin = &ray.Origin.x;
+        const float* direction = &ray.Direction.x;
+        const float* boxMin = &box.Min.x;
+        const float* boxMax = &box.Max.x;
+        float tMin = 0.0f;
+        float tMax = maxDistance;
+        for(int axis = 0; axis < 3; axis++)
+        {
+            float invDirection = 1.0f / direction[axis];
+            float t0 = (boxMin[axis] - origin[axis]) * invDirection;
+            float t1 = (boxMax[axis] - origin[axis]) * invDirection;
+            tMin = (std::max)(tMin, (std::min)(t0, t1));
+            tMax = (std::min)(tMax, (std::max)(t0, t1));
+        }
+        return tMin <= tMax ? tMin : maxDistance;
+    }
+
+    BVHRay MakeRay(std::mt19937& random, float worldSize)
+    {
+        std::uniform_real_distribution<float> position(-worldSize, worldSize);
+        std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+        BVHRay ray;
+        ray.Origin = XMFLOAT3(position(random), position(random) * 0.1f, position(random));
+        // No zero components, the reference slab test does not guard them
+        ray.Direction = XMFLOAT3(direction(random) + 1e-3f, direction(random) * 0.2f + 1e-3f, direction(random) + 1e-3f);
+        return ray;
+    }
+
+    std::vector<uint32_t> Sorted(std::vector<uint32_t> values)
+    {
+        std::sort(values.begin(), values.end());
+        return values;
+    }
+
+    template<typename Shape>
+    std::vector<uint32_t> BruteQuery(const TestObjects& objects, const Shape& shape)
+    {
+        std::vector<uint32_t> results;
+        for(uint32_t i = 0; i < objects.Boxes.size(); i++)
+        {
+            if(objects.Proxies[i] != UINT32_MAX && BruteOverlaps(shape, objects.Boxes[i]))
+                results.push_back(i);
+        }
+        return results;
+    }
+
+    BVHRayHit BruteRaycast(const TestObjects& objects, const BVHRay& ray)
+    {
+        BVHRayHit hit;
+        for(uint32_t i = 0; i < objects.Boxes.size(); i++)
+        {
+            if(objects.Proxies[i] == UINT32_MAX)
+                continue;
+            float distance = RayBoxDistance(ray, objects.Boxes[i], (std::min)(hit.Distance, ray.MaxDistance));
+            if(distance < hit.Distance && distance < ray.MaxDistance)
+            {
+                hit.Distance = distance;
+                hit.UserData = i;
+            }
+        }
+        return hit;
+    }
+
+    BVHLeafRaycast MakeLeafRaycast(const TestObjects& objects)
+    {
+        return [&objects](const BVHRay& ray, uint32_t userData, float maxDistance) { return RayBoxDistance(ray, objects.Boxes[userData], maxDistance); };
+    }
+
+    void CheckQueries(const DynamicBVH& bvh, const TestObjects& objects, std::mt19937& random, float worldSize)
+    {
+        const uint32_t queryCount = 300;
+        std::vector<BVHBox> boxes;
+        std::vector<BVHSphere> spheres;
+        std::vector<BVHRay> rays;
+        std::uniform_real_distribution<float> radius(0.5f, 20.0f);
+        for(uint32_t i = 0; i < queryCount; i++)
+        {
+            boxes.push_back(MakeBox(random, worldSize, 15.0f));
+            BVHBox sphereBox = MakeBox(random, worldSize, 1.0f);
+            spheres.push_back({ sphereBox.Min, radius(random) });
+            rays.push_back(MakeRay(random, worldSize));
+            if(i % 3 == 0)
+                rays.back().MaxDistance = radius(random);
+        }
+
+        std::vector<uint32_t> boxResults, boxOffsets, sphereResults, sphereOffsets;
+        bvh.QueryBoxes(boxes.data(), queryCount, boxResults, boxOffsets);
+        bvh.QuerySpheres(spheres.data(), queryCount, sphereResults, sphereOffsets);
+        std::vector<BVHRayHit> hits(queryCount);
+        BVHLeafRaycast leafRaycast = MakeLeafRaycast(objects);
+        bvh.Raycast(rays.data(), queryCount, leafRaycast, hits.data());
+
+        CHECK(boxOffsets.size() == queryCount + 1 && boxOffsets.back() == boxResults.size());
+        CHECK(sphereOffsets.size() == queryCount + 1 && sphereOffsets.back() == sphereResults.size());
+
+        uint32_t overlapCount = 0;
+        uint32_t hitCount = 0;
+        for(uint32_t i = 0; i < queryCount; i++)
+        {
+            std::vector<uint32_t> single;
+            bvh.QueryBox(boxes[i], single);
+            CHECK(Sorted(single) == BruteQuery(objects, boxes[i]));
+            // Batched results come in the order of the single query
+            CHECK(std::equal(single.begin(), single.end(), boxResults.begin() + boxOffsets[i], boxResults.begin() + boxOffsets[i + 1]));
+            overlapCount += (uint32_t)single.size();
+
+            single.clear();
+            bvh.QuerySphere(spheres[i], single);
+            CHECK(Sorted(single) == BruteQuery(objects, spheres[i]));
+            CHECK(std::equal(single.begin(), single.end(), sphereResults.begin() + sphereOffsets[i], sphereResults.begin() + sphereOffsets[i + 1]));
+
+            BVHRayHit hit;
+            bool isHit = bvh.Raycast(rays[i], leafRaycast, hit);
+            BVHRayHit reference = BruteRaycast(objects, rays[i]);
+            CHECK(isHit == (reference.UserData != UINT32_MAX));
+            CHECK(hit.Distance == reference.Distance);
+            // Overlapping boxes may share the entry distance
+            CHECK(hit.UserData == reference.UserData || (hit.UserData != UINT32_MAX && RayBoxDistance(rays[i], objects.Boxes[hit.UserData], FLT_MAX) == reference.Distance));
+            CHECK(hits[i].UserData == hit.UserData && hits[i].Distance == hit.Distance);
+            hitCount += isHit ? 1 : 0;
+        }
+
+        // The random queries must exercise both outcomes
+        CHECK(overlapCount > queryCount);
+        CHECK(hitCount > queryCount / 10 && hitCount < queryCount);
+    }
+
+    void CheckBounds(const DynamicBVH& bvh, const TestObjects& objects)
+    {
+        uint32_t liveCount = 0;
+        BVHBox bounds = bvh.GetBounds();
+        for(uint32_t i = 0; i < objects.Boxes.size(); i++)
+        {
+            if(objects.Proxies[i] == UINT32_MAX)
+                continue;
+            liveCount++;
+            CHECK(bvh.GetUserData(objects.Proxies[i]) == i);
+            CHECK(BruteOverlaps(bounds, objects.Boxes[i]));
+            CHECK(bounds.Min.x <= objects.Boxes[i].Min.x && bounds.Max.z >= objects.Boxes[i].Max.z);
+        }
+        CHECK(bvh.GetProxyCount() == liveCount);
+    }
+}
+
+TEST(DynamicBVH_QueriesMatchBruteForce)
+{
+    const float worldSize = 200.0f;
+    std::mt19937 random(18);
+    DynamicBVH bvh;
+    TestObjects objects;
+
+    InsertObjects(bvh, objects, random, 3000, worldSize);
+    CheckBounds(bvh, objects);
+    CheckQueries(bvh, objects, random, worldSize);
+
+    for(uint32_t round = 0; round < 5; round++)
+    {
+        Churn(bvh, objects, random, worldSize);
+        CheckBounds(bvh, objects);
+        CheckQueries(bvh, objects, random, worldSize);
+    }
+
+    // Rotations keep the tree balanced enough without any rebuild
+    CHECK(bvh.GetHeight() < 4 * (uint32_t)std::log2((float)bvh.GetProxyCount()));
+}
+
+TEST(DynamicBVH_SameWithoutJobSystem)
+{
+    const float worldSize = 100.0f;
+    std::mt19937 random(19);
+    DynamicBVH bvh;
+    TestObjects objects;
+    InsertObjects(bvh, objects, random, 1000, worldSize);
+    Churn(bvh, objects, random, worldSize);
+
+    JobSystem::Release();
+    CheckQueries(bvh, objects, random, worldSize);
+    JobSystem::Create(TestRegistry::GetWorkerCount());
+}
+
+TEST(DynamicBVH_RemoveAndClear)
+{
+    std::mt19937 random(20);
+    DynamicBVH bvh;
+    TestObjects objects;
+    InsertObjects(bvh, objects, random, 100, 50.0f);
+
+    for(uint32_t i = 0; i < 100; i++)
+    {
+        bvh.Remove(objects.Proxies[i]);
+        objects.Proxies[i] = UINT32_MAX;
+    }
+    CHECK(bvh.GetProxyCount() == 0);
+    CHECK(bvh.GetHeight() == 0);
+    CHECK(bvh.GetBounds().Min.x > bvh.GetBounds().Max.x);
+
+    std::vector<uint32_t> results;
+    bvh.QueryBox({ XMFLOAT3(-100.0f, -100.0f, -100.0f), XMFLOAT3(100.0f, 100.0f, 100.0f) }, results);
+    CHECK(results.empty());
+
+    // Freed nodes are reused
+    InsertObjects(bvh, objects, random, 100, 50.0f);
+    CheckBounds(bvh, objects);
+    bvh.Clear();
+    CHECK(bvh.GetProxyCount() == 0);
+}
+
+BENCHMARK(DynamicBVH_100kObjects)
+{
+    const uint32_t objectCount = 100000;
+    const float worldSize = 1000.0f;
+    std::mt19937 random(21);
+    DynamicBVH bvh;
+    TestObjects objects;
+
+    double insertMs = MeasureMilliseconds(1, [&]
+    {
+        bvh.Clear();
+        objects = TestObjects();
+        InsertObjects(bvh, objects, random, objectCount, worldSize);
+    });
+
+    // A frame of 1% gizmo drags
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    double dragMs = MeasureMilliseconds(10, [&]
+    {
+        for(uint32_t i = 0; i < objectCount; i += 100)
+        {
+            objects.Boxes[i] = Translate(objects.Boxes[i], unit(random) * 0.2f - 0.1f, 0.0f, unit(random) * 0.2f - 0.1f);
+            bvh.Update(objects.Proxies[i], objects.Boxes[i]);
+        }
+    });
+
+    // Picking : one ray at a time, the latency that matters, worst case over the rays
+    const uint32_t queryCount = 10000;
+    std::vector<BVHRay> rays;
+    std::vector<BVHBox> boxes;
+    std::vector<BVHSphere> spheres;
+    for(uint32_t i = 0; i < queryCount; i++)
+    {
+        rays.push_back(MakeRay(random, worldSize));
+        boxes.push_back(MakeBox(random, worldSize, 10.0f));
+        spheres.push_back({ boxes.back().Min, 10.0f });
+    }
+
+    BVHLeafRaycast leafRaycast = MakeLeafRaycast(objects);
+    double worstPickMs = 0.0;
+    for(uint32_t i = 0; i < 1000; i++)
+    {
+        BVHRayHit hit;
+        auto begin = std::chrono::high_resolution_clock::now();
+        bvh.Raycast(rays[i], leafRaycast, hit);
+        auto end = std::chrono::high_resolution_clock::now();
+        worstPickMs = (std::max)(worstPickMs, std::chrono::duration<double, std::milli>(end - begin).count());
+    }
+    double singleRaysMs = MeasureMilliseconds(5, [&]
+    {
+        BVHRayHit hit;
+        for(const BVHRay& ray : rays)
+            bvh.Raycast(ray, leafRaycast, hit);
+    });
+
+    std::vector<BVHRayHit> hits(queryCount);
+    std::vector<uint32_t> results, offsets;
+    double batchRaysMs = MeasureMilliseconds(5, [&] { bvh.Raycast(rays.data(), queryCount, leafRaycast, hits.data()); });
+    double batchBoxesMs = MeasureMilliseconds(5, [&] { bvh.QueryBoxes(boxes.data(), queryCount, results, offsets); });
+    double batchSpheresMs = MeasureMilliseconds(5, [&] { bvh.QuerySpheres(spheres.data(), queryCount, results, offsets); });
+    DoNotOptimize(results.size());
+
+    CHECK(worstPickMs < 1.0);
+
+    printf("    %u objects : insert %.1f ms, height %u, area ratio %.1f, %u drags %.3f ms\n",
+        objectCount, insertMs, bvh.GetHeight(), bvh.GetAreaRatio(), objectCount / 100, dragMs);
+    printf("    pick %.2f us average, %.3f ms worst (1 ms budget)\n", singleRaysMs * 1000.0 / queryCount, worstPickMs);
+    printf("    %u queries batched : rays %.2f ms (%.2f ms one by one), boxes %.2f ms, spheres %.2f ms\n",
+        queryCount, batchRaysMs, singleRaysMs, batchBoxesMs, batchSpheresMs);
+}
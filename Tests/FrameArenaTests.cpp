@@ -0,0 +1,262 @@
+﻿#include <random>
+
+#include "FrameArena.h"
+#include "ECS/Scene.h"
+#include "Jobs/JobSystem.h"
+#include "Rendering/CascadedShadows.h"
+#include "Rendering/InstanceCulling.h"
+#include "Rendering/LightClusterBuilder.h"
+#include "TestFramework.h"
+
+using namespace DirectX;
+
+namespace
+{
+    const uint32_t EntityCount = 20000;
+    const uint32_t LightEvery = 10;
+    const uint32_t BatchCount = 64;
+    const uint32_t ShadowMapResolution = 2048;
+    // The camera and the hierarchies move back and forth over this many frames
+    const uint32_t MotionPeriod = 32;
+
+    // CPU side of the editor frame on a scene of moving meshes and lights, the transient containers are the caller's
+    class FrameSimulation
+    {
+    public:
+        FrameSimulation()
+        {
+            std::mt19937 random(8);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+            Entity parent;
+            for(uint32_t i = 0; i < EntityCount; i++)
+            {
+                Entity entity = m_scene.CreateEntity("Entity");
+                m_scene.AddComponent<TransformComponent>(entity);
+                m_scene.AddComponent<MeshComponent>(entity);
+                if(i % LightEvery == 0)
+                {
+                    PointLight& light = m_scene.AddComponent<PointLightComponent>(entity)->m_pointLight;
+                    light.Color = XMFLOAT4(unit(random), unit(random), unit(random), 1.0f);
+                    light.LinearAttenuation = 0.7f;
+                    light.QuadraticAttenuation = 1.8f;
+                }
+
+                // Small hierarchies of 4 nodes
+                auto& hierarchy = m_scene.GetTransformHierarchy();
+                if(i % 4 == 0)
+                {
+                    hierarchy.SetLocalPosition(entity, XMFLOAT3(unit(random) * 400.0f - 200.0f, unit(random) * 40.0f - 20.0f, unit(random) * 400.0f - 50.0f));
+                    m_roots.push_back(entity);
+                    parent = entity;
+                }
+                else
+                {
+                    hierarchy.SetParent(entity, parent);
+                    hierarchy.SetLocalPosition(entity, XMFLOAT3(unit(random), unit(random), unit(random)));
+                }
+            }
+
+            m_bounds.Resize(EntityCount);
+
+            m_camera.UpdatePerspectiveFOV(0.35f * XM_PI, 1600.0f / 900.0f);
+            m_camera.UpdateViewMatrix();
+        }
+
+        // Checksum of what the frame produced, identical whatever the containers
+        template<typename LightVector, typename VisibilityVector, typename BatchMap>
+        uint64_t RunFrame(LightVector& pointLights, VisibilityVector& visibility, BatchMap& batches)
+        {
+            // Game side : some hierarchies move, the camera walks
+            auto& hierarchy = m_scene.GetTransformHierarchy();
+            for(size_t i = m_frameIndex % 8; i < m_roots.size(); i += 8)
+            {
+                XMFLOAT3 position = hierarchy.GetLocalPosition(m_roots[i]);
+                position.y += (m_frameIndex % MotionPeriod < MotionPeriod / 2) ? 0.1f : -0.1f;
+                hierarchy.SetLocalPosition(m_roots[i], position);
+            }
+            m_scene.UpdateTransforms();
+            m_scene.ClearChanges();
+
+            m_camera.Walk((m_frameIndex % MotionPeriod < MotionPeriod / 2) ? 0.05f : -0.05f);
+            m_camera.UpdateViewMatrix();
+            m_frameIndex++;
+
+            // Extraction
+            m_scene.Each<TransformComponent, PointLightComponent>([&](TransformComponent& transform, PointLightComponent& light)
+            {
+                PointLight pointLight = light.m_pointLight;
+                pointLight.Position = XMFLOAT3(transform.m_transform._41, transform.m_transform._42, transform.m_transform._43);
+                pointLights.push_back(pointLight);
+            });
+
+            uint32_t instance = 0;
+            m_scene.Each<TransformComponent, MeshComponent>([&](TransformComponent& transform, MeshComponent&)
+            {
+                XMVECTOR center;
+                XMVECTOR extent;
+                InstanceCulling::TransformBounds(XMFLOAT3(-0.5f, -0.5f, -0.5f), XMFLOAT3(0.5f, 0.5f, 0.5f), transform.m_transform, center, extent);
+                m_bounds.Set(instance++, center, extent);
+            });
+
+            m_lightClusters.Build(pointLights.data(), (uint32_t)pointLights.size(), m_camera, 1600.0f, 900.0f);
+
+            BVHBox casterBounds = { XMFLOAT3(-210.0f, -30.0f, -60.0f), XMFLOAT3(210.0f, 30.0f, 360.0f) };
+            ShadowCascade cascades[SHADOW_CASCADE_COUNT];
+            CascadedShadows::Compute(m_camera.GetViewMatrix(), m_camera.GetProjMatrix(), XMFLOAT3(0.3f, -1.0f, 0.2f), casterBounds, ShadowMapResolution, cascades);
+
+            // Camera and cascades culled in one pass, visible instances counted per batch
+            CullingFrustum frustums[1 + SHADOW_CASCADE_COUNT];
+            frustums[0] = InstanceCulling::MakeFrustum(m_camera.GetViewMatrix() * m_camera.GetProjMatrix());
+            for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+                frustums[1 + cascade] = InstanceCulling::MakeFrustum(XMLoadFloat4x4(&cascades[cascade].ViewProj));
+
+            visibility.resize(EntityCount);
+            JobSystem::Get()->ParallelFor(EntityCount, INSTANCE_CULLING_GRAIN_SIZE, [&](uint32_t begin, uint32_t end)
+            {
+                InstanceCulling::Cull(m_bounds, begin, end, frustums, 1 + SHADOW_CASCADE_COUNT, visibility.data());
+            });
+
+            for(uint32_t i = 0; i < EntityCount; i++)
+            {
+                if(visibility[i])
+                    batches[i % BatchCount] += visibility[i];
+            }
+
+            uint64_t checksum = pointLights.size() + m_lightClusters.GetLightIndexCount();
+            for(const auto& [batch, count] : batches)
+                checksum = checksum * 31 + batch * count;
+            return checksum;
+        }
+
+    private:
+        Scene m_scene { "FrameArenaTests" };
+        std::vector<Entity> m_roots;
+        Camera m_camera;
+        InstanceBounds m_bounds;
+        LightClusterBuilder m_lightClusters;
+        uint32_t m_frameIndex = 0;
+    };
+
+    uint64_t RunArenaFrame(FrameSimulation& simulation, FrameArena& arena)
+    {
+        arena.Reset();
+        FrameVector<PointLight> pointLights(arena);
+        FrameVector<uint8_t> visibility(arena);
+        FrameHashMap<uint32_t, uint32_t> batches(arena);
+        return simulation.RunFrame(pointLights, visibility, batches);
+    }
+
+    uint64_t RunHeapFrame(FrameSimulation& simulation)
+    {
+        std::vector<PointLight> pointLights;
+        std::vector<uint8_t> visibility;
+        std::unordered_map<uint32_t, uint32_t> batches;
+        return simulation.RunFrame(pointLights, visibility, batches);
+    }
+}
+
+TEST(FrameArena_AllocateAndReset)
+{
+    FrameArena arena(16384);
+
+    uint8_t* bytes = arena.Allocate<uint8_t>(3);
+    double* doubles = arena.Allocate<double>(4);
+    void* aligned = arena.Allocate(16, 64);
+    CHECK(bytes && doubles && aligned);
+    CHECK((uintptr_t)doubles % alignof(double) == 0);
+    CHECK((uintptr_t)aligned % 64 == 0);
+    CHECK((uint8_t*)doubles >= bytes + 3);
+    CHECK((uint8_t*)aligned >= (uint8_t*)(doubles + 4));
+    CHECK(arena.GetUsedBytes() >= 3 + 4 * sizeof(double) + 16);
+
+    // Alignments above the one of the block itself
+    void* page = arena.Allocate(16, 4096);
+    CHECK((uintptr_t)page % 4096 == 0);
+    CHECK(arena.GetUsedBytes() <= arena.GetCapacity());
+
+    // Reset hands the same memory out again
+    arena.Reset();
+    CHECK(arena.GetUsedBytes() == 0);
+    CHECK(arena.Allocate<uint8_t>(3) == bytes);
+}
+
+TEST(FrameArena_OverflowGrowsOnReset)
+{
+    FrameArena arena(1024);
+
+    // A frame larger than the arena spills to the heap
+    uint64_t allocationCount = TestRegistry::GetAllocationCount();
+    for(uint32_t i = 0; i < 10; i++)
+    {
+        uint32_t* values = arena.Allocate<uint32_t>(100);
+        values[99] = i;
+    }
+    CHECK(TestRegistry::GetAllocationCount() > allocationCount);
+    CHECK(arena.GetUsedBytes() >= 4000);
+
+    // The next frames of the same size fit in the grown block
+    arena.Reset();
+    CHECK(arena.GetCapacity() >= 4000);
+    allocationCount = TestRegistry::GetAllocationCount();
+    for(uint32_t frame = 0; frame < 3; frame++)
+    {
+        for(uint32_t i = 0; i < 10; i++)
+            arena.Allocate<uint32_t>(100);
+        arena.Reset();
+    }
+    CHECK(TestRegistry::GetAllocationCount() == allocationCount);
+}
+
+TEST(FrameArena_SteadyStateFrameDoesNotAllocate)
+{
+    FrameSimulation arenaSimulation;
+    FrameSimulation heapSimulation;
+    FrameArena arena;
+
+    // A full motion period sizes the arena, the job pool and the high water mark of every persistent vector
+    for(uint32_t frame = 0; frame < MotionPeriod; frame++)
+        CHECK(RunArenaFrame(arenaSimulation, arena) == RunHeapFrame(heapSimulation));
+
+    for(uint32_t frame = 0; frame < 2 * MotionPeriod; frame++)
+    {
+        uint64_t allocationCount = TestRegistry::GetAllocationCount();
+        uint64_t checksum = RunArenaFrame(arenaSimulation, arena);
+        CHECK(TestRegistry::GetAllocationCount() == allocationCount);
+
+        CHECK(checksum == RunHeapFrame(heapSimulation));
+    }
+}
+
+BENCHMARK(FrameArena_SteadyStateFrame)
+{
+    FrameSimulation arenaSimulation;
+    FrameSimulation heapSimulation;
+    FrameArena arena;
+
+    uint64_t checksum = 0;
+    const uint32_t frameCount = MotionPeriod;
+
+    uint64_t allocationCount = 0;
+    double arenaMs = MeasureMilliseconds(5, [&]
+    {
+        allocationCount = TestRegistry::GetAllocationCount();
+        for(uint32_t frame = 0; frame < frameCount; frame++)
+            checksum += RunArenaFrame(arenaSimulation, arena);
+        allocationCount = TestRegistry::GetAllocationCount() - allocationCount;
+    });
+    uint64_t arenaAllocations = allocationCount;
+    CHECK(arenaAllocations == 0);
+
+    double heapMs = MeasureMilliseconds(5, [&]
+    {
+        allocationCount = TestRegistry::GetAllocationCount();
+        for(uint32_t frame = 0; frame < frameCount; frame++)
+            checksum += RunHeapFrame(heapSimulation);
+        allocationCount = TestRegistry::GetAllocationCount() - allocationCount;
+    });
+    DoNotOptimize(checksum);
+
+    printf("    %u entities : %.3f ms and %.1f allocations per frame with the arena, %.3f ms and %.1f allocations with heap containers\n",
+        EntityCount, arenaMs / frameCount, (double)arenaAllocations / frameCount, heapMs / frameCount, (double)allocationCount / frameCount);
+}
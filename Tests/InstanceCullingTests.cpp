@@ -0,0 +1,239 @@
+﻿#include <cfloat>
+#include <random>
+
+#include "JobSystem.h"
+#include "Rendering/InstanceCulling.h"
+#include "TestFramework.h"
+
+using namespace DirectX;
+
+namespace
+{
+    // Boxes this close to a plane may land on either side depending on the rounding of the SIMD path
+    const float PlaneTolerance = 1e-3f;
+
+    // A camera and cascade like orthographic views looking elsewhere, INSTANCE_CULLING_MAX_VIEWS of them
+    std::vector<CullingFrustum> MakeFrustums()
+    {
+        std::vector<CullingFrustum> frustums;
+        XMMATRIX proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 150.0f);
+        frustums.push_back(InstanceCulling::MakeFrustum(XMMatrixLookAtLH(XMVectorSet(0.0f, 5.0f, -20.0f, 1.0f), XMVectorSet(0.0f, 0.0f, 30.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)) * proj));
+        for(uint32_t cascade = 0; cascade < 4; cascade++)
+        {
+            float size = 10.0f * (float)(1u << (cascade * 2));
+            XMMATRIX light = XMMatrixLookAtLH(XMVectorSet(50.0f, 100.0f, -30.0f, 1.0f), XMVectorSet(0.0f, 0.0f, 10.0f * cascade, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+            frustums.push_back(InstanceCulling::MakeFrustum(light * XMMatrixOrthographicLH(size, size, 1.0f, 300.0f)));
+        }
+        for(uint32_t view = 0; view < 3; view++)
+        {
+            XMVECTOR target = XMVectorSet(view == 0 ? 100.0f : -50.0f, view == 1 ? -80.0f : 0.0f, view == 2 ? -100.0f : 20.0f, 1.0f);
+            frustums.push_back(InstanceCulling::MakeFrustum(XMMatrixLookAtLH(XMVectorZero(), target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f))
+                * XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, 0.5f, 60.0f)));
+        }
+        return frustums;
+    }
+
+    // One in 16 slots left empty, the others scattered around the views
+    InstanceBounds MakeBounds(uint32_t count)
+    {
+        std::mt19937 random(3);
+        std::uniform_real_distribution<float> position(-120.0f, 120.0f);
+        std::uniform_real_distribution<float> size(0.0f, 4.0f);
+
+        InstanceBounds bounds;
+        bounds.Resize(count);
+        for(uint32_t i = 0; i < count; i++)
+        {
+            if(i % 16 == 5)
+                bounds.SetEmpty(i);
+            else
+                bounds.Set(i, XMVectorSet(position(random), position(random), position(random), 0.0f), XMVectorSet(size(random), size(random), size(random), 0.0f));
+        }
+        return bounds;
+    }
+
+    // One instance and one view at a time, same plane test as InstanceCulling::Cull. Sets ambiguous when a plane is within the tolerance
+    bool IsVisibleReference(const InstanceBounds& bounds, uint32_t i, const CullingFrustum& frustum, bool& ambiguous)
+    {
+        bool inside = true;
+        ambiguous = false;
+        for(const XMFLOAT4& plane : frustum.Planes)
+        {
+            float distance = bounds.CenterX[i] * plane.x + bounds.CenterY[i] * plane.y + bounds.CenterZ[i] * plane.z + plane.w;
+            float radius = bounds.ExtentX[i] * std::fabs(plane.x) + bounds.ExtentY[i] * std::fabs(plane.y) + bounds.ExtentZ[i] * std::fabs(plane.z);
+            inside &= distance + radius >= 0.0f;
+            ambiguous |= std::fabs(distance + radius) < PlaneTolerance;
+        }
+        return inside;
+    }
+
+    void CullReference(const InstanceBounds& bounds, uint32_t begin, uint32_t end, const CullingFrustum* frustums, uint32_t frustumCount, uint8_t* visibility)
+    {
+        bool ambiguous;
+        for(uint32_t i = begin; i < end; i++)
+        {
+            uint8_t mask = 0;
+            for(uint32_t view = 0; view < frustumCount; view++)
+                mask |= IsVisibleReference(bounds, i, frustums[view], ambiguous) ? 1u << view : 0u;
+            visibility[i] = mask;
+        }
+    }
+}
+
+TEST(InstanceCulling_FrustumPlanes)
+{
+    XMMATRIX viewProj = XMMatrixLookAtLH(XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f))
+        * XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, 1.0f, 100.0f);
+    CullingFrustum frustum = InstanceCulling::MakeFrustum(viewProj);
+
+    auto Distances = [&](float x, float y, float z)
+    {
+        std::vector<float> distances;
+        for(const XMFLOAT4& plane : frustum.Planes)
+        {
+            CHECK_NEAR(XMVectorGetX(XMVector3Length(XMLoadFloat4(&plane))), 1.0f, 1e-5f);
+            distances.push_back(plane.x * x + plane.y * y + plane.z * z + plane.w);
+        }
+        return distances;
+    };
+
+    // 90 degrees field of view : the side planes go through the diagonals, near and far at 1 and 100
+    for(float distance : Distances(0.0f, 0.0f, 50.0f))
+        CHECK(distance > 0.0f);
+    std::vector<float> corner = Distances(9.0f, -9.0f, 10.0f);
+    CHECK(corner[0] > 0.0f && corner[1] > 0.0f && corner[2] > 0.0f && corner[3] > 0.0f);
+    CHECK(Distances(0.0f, 0.0f, 0.5f)[4] < 0.0f);
+    CHECK(Distances(0.0f, 0.0f, 101.0f)[5] < 0.0f);
+    CHECK(Distances(11.0f, 0.0f, 10.0f)[1] < 0.0f);
+    CHECK_NEAR(Distances(0.0f, 0.0f, 1.0f)[4], 0.0f, 1e-4f);
+}
+
+TEST(InstanceCulling_TransformBoundsEnclosesCorners)
+{
+    std::mt19937 random(4);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    for(uint32_t test = 0; test < 1000; test++)
+    {
+        XMFLOAT3 localMin(distribution(random), distribution(random), distribution(random));
+        XMFLOAT3 localMax(localMin.x + 1.0f + distribution(random), localMin.y + 1.0f + distribution(random), localMin.z + 1.0f + distribution(random));
+        XMMATRIX world = XMMatrixScaling(1.0f + distribution(random), 2.0f + distribution(random), 1.5f + distribution(random))
+            * XMMatrixRotationRollPitchYaw(distribution(random) * XM_PI, distribution(random) * XM_PI, distribution(random) * XM_PI)
+            * XMMatrixTranslation(distribution(random) * 50.0f, distribution(random) * 50.0f, distribution(random) * 50.0f);
+        XMFLOAT4X4 worldFloats;
+        XMStoreFloat4x4(&worldFloats, world);
+
+        XMVECTOR center, extent;
+        InstanceCulling::TransformBounds(localMin, localMax, worldFloats, center, extent);
+
+        // Arvo's box is exactly the box of the transformed corners
+        XMVECTOR cornerMin = XMVectorReplicate(FLT_MAX);
+        XMVECTOR cornerMax = XMVectorReplicate(-FLT_MAX);
+        for(uint32_t i = 0; i < 8; i++)
+        {
+            XMVECTOR corner = XMVector3Transform(XMVectorSet((i & 1) ? localMax.x : localMin.x, (i & 2) ? localMax.y : localMin.y, (i & 4) ? localMax.z : localMin.z, 1.0f), world);
+            cornerMin = XMVectorMin(cornerMin, corner);
+            cornerMax = XMVectorMax(cornerMax, corner);
+        }
+        CHECK(XMVector3NearEqual(XMVectorSubtract(center, extent), cornerMin, XMVectorReplicate(1e-3f)));
+        CHECK(XMVector3NearEqual(XMVectorAdd(center, extent), cornerMax, XMVectorReplicate(1e-3f)));
+    }
+}
+
+TEST(InstanceCulling_MatchesScalarReference)
+{
+    const uint32_t count = 100003;
+    InstanceBounds bounds = MakeBounds(count);
+    std::vector<CullingFrustum> frustums = MakeFrustums();
+
+    for(uint32_t frustumCount : { 1u, 5u, (uint32_t)INSTANCE_CULLING_MAX_VIEWS })
+    {
+        std::vector<uint8_t> visibility(count, 0xCD);
+        InstanceCulling::Cull(bounds, 0, count, frustums.data(), frustumCount, visibility.data());
+
+        uint32_t mismatchCount = 0;
+        uint32_t visibleCount = 0;
+        for(uint32_t i = 0; i < count; i++)
+        {
+            for(uint32_t view = 0; view < frustumCount; view++)
+            {
+                bool ambiguous;
+                bool expected = IsVisibleReference(bounds, i, frustums[view], ambiguous);
+                bool visible = (visibility[i] >> view) & 1;
+                mismatchCount += visible != expected && !ambiguous;
+                visibleCount += visible;
+            }
+            // Empty slots are outside of everything, bits past the view count stay clear
+            if(i % 16 == 5)
+                CHECK(visibility[i] == 0);
+            CHECK((visibility[i] >> frustumCount) == 0);
+        }
+        CHECK(mismatchCount == 0);
+        CHECK(visibleCount > 0);
+    }
+}
+
+TEST(InstanceCulling_PartialRanges)
+{
+    // Ranges as RenderWorld splits them, plus an end that is not a multiple of 4 : nothing outside [begin, end) gets written
+    const uint32_t count = 3 * INSTANCE_CULLING_GRAIN_SIZE + 7;
+    InstanceBounds bounds = MakeBounds(count);
+    std::vector<CullingFrustum> frustums = MakeFrustums();
+
+    std::vector<uint8_t> expected(count);
+    CullReference(bounds, 0, count, frustums.data(), (uint32_t)frustums.size(), expected.data());
+
+    std::vector<uint8_t> visibility(count + 1, 0xCD);
+    JobSystem::Get()->ParallelFor(count, INSTANCE_CULLING_GRAIN_SIZE, [&](uint32_t begin, uint32_t end)
+    {
+        InstanceCulling::Cull(bounds, begin, end, frustums.data(), (uint32_t)frustums.size(), visibility.data());
+    });
+    CHECK(visibility[count] == 0xCD);
+
+    uint32_t mismatchCount = 0;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        bool ambiguous = false;
+        for(uint32_t view = 0; view < frustums.size(); view++)
+        {
+            bool viewAmbiguous;
+            IsVisibleReference(bounds, i, frustums[view], viewAmbiguous);
+            ambiguous |= viewAmbiguous;
+        }
+        mismatchCount += visibility[i] != expected[i] && !ambiguous;
+    }
+    CHECK(mismatchCount == 0);
+}
+
+BENCHMARK(InstanceCulling_Cull)
+{
+    const uint32_t count = 1000000;
+    InstanceBounds bounds = MakeBounds(count);
+    std::vector<CullingFrustum> frustums = MakeFrustums();
+    std::vector<uint8_t> visibility(count);
+
+    for(uint32_t frustumCount : { 1u, 5u, (uint32_t)INSTANCE_CULLING_MAX_VIEWS })
+    {
+        double referenceMs = MeasureMilliseconds(3, [&]
+        {
+            CullReference(bounds, 0, count, frustums.data(), frustumCount, visibility.data());
+            DoNotOptimize(visibility);
+        });
+
+        double simdMs = MeasureMilliseconds(5, [&]
+        {
+            InstanceCulling::Cull(bounds, 0, count, frustums.data(), frustumCount, visibility.data());
+            DoNotOptimize(visibility);
+        });
+
+        double parallelMs = MeasureMilliseconds(5, [&]
+        {
+            JobSystem::Get()->ParallelFor(count, INSTANCE_CULLING_GRAIN_SIZE, [&](uint32_t begin, uint32_t end)
+            {
+                InstanceCulling::Cull(bounds, begin, end, frustums.data(), frustumCount, visibility.data());
+            });
+        });
+
+        printf("    %u instances, %u views : scalar %.2f ms, SIMD %.2f ms (%.1fx), SIMD on the job system %.2f ms\n",
+            count, frustumCount, referenceMs, simdMs, referenceMs / simdMs, parallelMs);
+    }
+}
@@ -0,0 +1,117 @@
+﻿#include <algorithm>
+#include <numeric>
+#include <thread>
+
+#include "JobSystem.h"
+#include "TestFramework.h"
+
+namespace
+{
+    constexpr uint32_t ParallelForCount = 1 << 22;
+    constexpr uint32_t TaskGroupJobCount = 2048;
+
+    void ParallelForWork(std::vector<float>& values)
+    {
+        JobSystem::Get()->ParallelFor((uint32_t)values.size(), 4096, [&](uint32_t begin, uint32_t end)
+        {
+            for(uint32_t i = begin; i < end; i++)
+                values[i] = std::sqrt(values[i] * 1.0001f + 1.0f);
+        });
+    }
+
+    // Half of the jobs depend on the first half, each of them spawning a nested job
+    void TaskGroupWork(std::atomic<uint32_t>& counter)
+    {
+        JobSystem* jobSystem = JobSystem::Get();
+
+        JobCounter first;
+        JobCounter second;
+        for(uint32_t i = 0; i < TaskGroupJobCount / 2; i++)
+            jobSystem->Run([&] { counter.fetch_add(1, std::memory_order_relaxed); }, &first);
+        for(uint32_t i = 0; i < TaskGroupJobCount / 4; i++)
+        {
+            jobSystem->Run([&]
+            {
+                counter.fetch_add(1, std::memory_order_relaxed);
+                jobSystem->Run([&] { counter.fetch_add(1, std::memory_order_relaxed); }, &second);
+            }, &second, &first);
+        }
+
+        jobSystem->Wait(second);
+    }
+}
+
+TEST(JobSystem_ParallelForCoversRange)
+{
+    for(uint32_t count : { 0u, 1u, 4095u, 4096u, 100000u })
+    {
+        std::vector<uint32_t> hits(count, 0);
+        JobSystem::Get()->ParallelFor(count, 777, [&](uint32_t begin, uint32_t end)
+        {
+            CHECK(end - begin <= 777);
+            for(uint32_t i = begin; i < end; i++)
+                hits[i]++;
+        });
+
+        CHECK(std::all_of(hits.begin(), hits.end(), [](uint32_t hit) { return hit == 1; }));
+    }
+}
+
+TEST(JobSystem_DependenciesRunAfterGroup)
+{
+    JobSystem* jobSystem = JobSystem::Get();
+
+    for(uint32_t iteration = 0; iteration < 50; iteration++)
+    {
+        JobCounter first;
+        JobCounter second;
+        std::atomic<uint32_t> firstDone { 0 };
+        std::atomic<uint32_t> earlyCount { 0 };
+
+        for(uint32_t i = 0; i < 100; i++)
+            jobSystem->Run([&] { firstDone++; }, &first);
+        for(uint32_t i = 0; i < 50; i++)
+        {
+            jobSystem->Run([&]
+            {
+                if(firstDone.load() != 100)
+                    earlyCount++;
+            }, &second, &first);
+        }
+
+        jobSystem->Wait(second);
+        CHECK(first.IsDone());
+        CHECK(earlyCount.load() == 0);
+    }
+}
+
+// Recreates the job system with 1..N workers, N being --workers or every hardware thread but this one
+BENCHMARK(JobSystem_Scaling)
+{
+    uint32_t maxWorkerCount = TestRegistry::GetWorkerCount();
+    if(maxWorkerCount == 0)
+        maxWorkerCount = (std::max)(2u, std::thread::hardware_concurrency()) - 1;
+
+    std::vector<float> values(ParallelForCount);
+    std::iota(values.begin(), values.end(), 0.0f);
+
+    JobSystem::Release();
+    for(uint32_t workerCount = 1; workerCount <= maxWorkerCount; workerCount++)
+    {
+        JobSystem::Create(workerCount);
+
+        double parallelForMs = MeasureMilliseconds(20, [&] { ParallelForWork(values); });
+        double emptyParallelForUs = MeasureMilliseconds(1000, [] { JobSystem::Get()->ParallelFor(64, 1, [](uint32_t, uint32_t) {}); }) * 1000.0;
+
+        std::atomic<uint32_t> counter { 0 };
+        double taskGroupMs = MeasureMilliseconds(20, [&] { TaskGroupWork(counter); });
+
+        printf("    %2u workers : ParallelFor %u floats %.3f ms, 64 empty ranges %.2f us, task groups %u jobs %.3f ms\n",
+            workerCount, ParallelForCount, parallelForMs, emptyParallelForUs, TaskGroupJobCount, taskGroupMs);
+
+        JobSystem::Release();
+    }
+    JobSystem::Create(TestRegistry::GetWorkerCount());
+
+    DoNotOptimize(values[ParallelForCount / 2]);
+}
@@ -0,0 +1,338 @@
+﻿#include <cfloat>
+#include <cstring>
+#include <random>
+
+#include "JobSystem.h"
+#include "Rendering/LightClusterBuilder.h"
+#include "TestFramework.h"
+#include "TestMeshes.h"
+
+using namespace DirectX;
+
+namespace
+{
+    const float ViewportWidth = 1600.0f;
+    const float ViewportHeight = 900.0f;
+
+    // Spheres this close to a froxel box may land on either side depending on the rounding of the SIMD path
+    const double RangeTolerance = 1e-3;
+
+    Camera MakeCamera()
+    {
+        Camera camera;
+        camera.UpdatePerspectiveFOV(0.35f * XM_PI, ViewportWidth / ViewportHeight);
+        camera.Pitch(0.1f);
+        camera.RotateY(0.3f);
+        camera.UpdateViewMatrix();
+        return camera;
+    }
+
+    // Lights of about 12 units of range spread over a large level around the camera, some of them black or behind it
+    std::vector<PointLight> MakeLights(uint32_t count)
+    {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        std::vector<PointLight> lights(count);
+        for(uint32_t i = 0; i < count; i++)
+        {
+            PointLight& light = lights[i];
+            light.Position = XMFLOAT3(unit(random) * 600.0f - 300.0f, unit(random) * 100.0f - 50.0f, unit(random) * 600.0f - 100.0f);
+            light.Color = i % 97 == 0 ? XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f) : XMFLOAT4(unit(random), unit(random), unit(random), 1.0f);
+            light.LinearAttenuation = 0.7f;
+            light.QuadraticAttenuation = 1.8f;
+        }
+        return lights;
+    }
+
+    struct ReferenceFrustum
+    {
+        double ProjX, ProjY, NearZ, FarZ;
+        XMFLOAT4X4 View;
+    };
+
+    ReferenceFrustum GetReferenceFrustum(const Camera& camera)
+    {
+        XMFLOAT4X4 proj;
+        XMStoreFloat4x4(&proj, camera.GetProjMatrix());
+        ReferenceFrustum frustum;
+        frustum.ProjX = proj._11;
+        frustum.ProjY = proj._22;
+        frustum.NearZ = -(double)proj._43 / proj._33;
+        frustum.FarZ = proj._33 * frustum.NearZ / (proj._33 - 1.0);
+        XMStoreFloat4x4(&frustum.View, camera.GetViewMatrix());
+        return frustum;
+    }
+
+    // View space froxel (x, y, z) : the tile frustum between the slice depths, in doubles
+    struct Froxel
+    {
+        double Left, Right, Bottom, Top; // NDC
+        double Near, Far;
+        double BoxMin[3], BoxMax[3];
+        XMFLOAT3 Corners[8]; // Bit 0 right, bit 1 top, bit 2 far
+    };
+
+    Froxel GetFroxel(const ReferenceFrustum& frustum, uint32_t x, uint32_t y, uint32_t z)
+    {
+        Froxel froxel;
+        froxel.Near = frustum.NearZ * pow(frustum.FarZ / frustum.NearZ, (double)z / LIGHT_CLUSTER_COUNT_Z);
+        froxel.Far = frustum.NearZ * pow(frustum.FarZ / frustum.NearZ, (double)(z + 1) / LIGHT_CLUSTER_COUNT_Z);
+        froxel.Left = -1.0 + 2.0 * x / LIGHT_CLUSTER_COUNT_X;
+        froxel.Right = -1.0 + 2.0 * (x + 1) / LIGHT_CLUSTER_COUNT_X;
+        froxel.Top = 1.0 - 2.0 * y / LIGHT_CLUSTER_COUNT_Y;
+        froxel.Bottom = 1.0 - 2.0 * (y + 1) / LIGHT_CLUSTER_COUNT_Y;
+
+        for(uint32_t axis = 0; axis < 3; axis++)
+        {
+            froxel.BoxMin[axis] = DBL_MAX;
+            froxel.BoxMax[axis] = -DBL_MAX;
+        }
+        for(uint32_t i = 0; i < 8; i++)
+        {
+            double depth = (i & 4) ? froxel.Far : froxel.Near;
+            double corner[3] = { ((i & 1) ? froxel.Right : froxel.Left) * depth / frustum.ProjX, ((i & 2) ? froxel.Top : froxel.Bottom) * depth / frustum.ProjY, depth };
+            froxel.Corners[i] = XMFLOAT3((float)corner[0], (float)corner[1], (float)corner[2]);
+            for(uint32_t axis = 0; axis < 3; axis++)
+            {
+                froxel.BoxMin[axis] = (std::min)(froxel.BoxMin[axis], corner[axis]);
+                froxel.BoxMax[axis] = (std::max)(froxel.BoxMax[axis], corner[axis]);
+            }
+        }
+        return froxel;
+    }
+
+    double BoxDistanceSq(const Froxel& froxel, const double center[3])
+    {
+        double distanceSq = 0.0;
+        for(uint32_t axis = 0; axis < 3; axis++)
+        {
+            double d = (std::max)((std::max)(froxel.BoxMin[axis] - center[axis], center[axis] - froxel.BoxMax[axis]), 0.0);
+            distanceSq += d * d;
+        }
+        return distanceSq;
+    }
+
+    // Exact distance to the truncated pyramid : 0 inside, else the nearest of its 6 faces
+    double FroxelDistanceSq(const ReferenceFrustum& frustum, const Froxel& froxel, const double center[3])
+    {
+        double depth = center[2];
+        if(depth >= froxel.Near && depth <= froxel.Far)
+        {
+            double ndcX = center[0] * frustum.ProjX / depth;
+            double ndcY = center[1] * frustum.ProjY / depth;
+            if(ndcX >= froxel.Left && ndcX <= froxel.Right && ndcY >= froxel.Bottom && ndcY <= froxel.Top)
+                return 0.0;
+        }
+
+        const uint32_t faces[6][4] = { { 0, 1, 3, 2 }, { 4, 5, 7, 6 }, { 0, 2, 6, 4 }, { 1, 3, 7, 5 }, { 0, 1, 5, 4 }, { 2, 3, 7, 6 } };
+        XMVECTOR point = XMVectorSet((float)center[0], (float)center[1], (float)center[2], 0.0f);
+        float distance = FLT_MAX;
+        for(const auto& face : faces)
+        {
+            XMVECTOR corners[4];
+            for(uint32_t k = 0; k < 4; k++)
+                corners[k] = XMLoadFloat3(&froxel.Corners[face[k]]);
+            distance = (std::min)(distance, PointTriangleDistance(point, corners[0], corners[1], corners[2]));
+            distance = (std::min)(distance, PointTriangleDistance(point, corners[0], corners[2], corners[3]));
+        }
+        return (double)distance * distance;
+    }
+
+    void ToView(const ReferenceFrustum& frustum, const XMFLOAT3& position, double center[3])
+    {
+        const XMFLOAT4X4& view = frustum.View;
+        center[0] = position.x * (double)view._11 + position.y * (double)view._21 + position.z * (double)view._31 + view._41;
+        center[1] = position.x * (double)view._12 + position.y * (double)view._22 + position.z * (double)view._32 + view._42;
+        center[2] = position.x * (double)view._13 + position.y * (double)view._23 + position.z * (double)view._33 + view._43;
+    }
+
+    std::vector<uint32_t> GetClusterLights(const LightClusterBuilder& builder, uint32_t cluster)
+    {
+        const LightCluster& lightCluster = builder.GetClusters()[cluster];
+        return std::vector<uint32_t>(builder.GetLightIndices() + lightCluster.Offset, builder.GetLightIndices() + lightCluster.Offset + lightCluster.Count);
+    }
+}
+
+TEST(LightClustering_ComputeRange)
+{
+    // 1 / (1 + 0.7 d + 1.8 d^2) = 1 / 256 for a white light
+    PointLight light;
+    light.LinearAttenuation = 0.7f;
+    light.QuadraticAttenuation = 1.8f;
+    float range = LightClusterBuilder::ComputeRange(light);
+    CHECK_NEAR(1.0f + 0.7f * range + 1.8f * range * range, 256.0f, 1e-2f);
+
+    light.QuadraticAttenuation = 0.0f;
+    CHECK_NEAR(LightClusterBuilder::ComputeRange(light), 255.0f / 0.7f, 1e-2f);
+
+    light.Color = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+    CHECK(LightClusterBuilder::ComputeRange(light) == 0.0f);
+}
+
+TEST(LightClustering_MatchesBruteForce)
+{
+    const uint32_t lightCount = 10000;
+    std::vector<PointLight> lights = MakeLights(lightCount);
+    Camera camera = MakeCamera();
+    LightClusterBuilder builder;
+    builder.Build(lights.data(), lightCount, camera, ViewportWidth, ViewportHeight);
+
+    ReferenceFrustum frustum = GetReferenceFrustum(camera);
+    std::vector<double> centers(lightCount * 3);
+    std::vector<double> ranges(lightCount);
+    for(uint32_t i = 0; i < lightCount; i++)
+    {
+        ToView(frustum, lights[i].Position, &centers[i * 3]);
+        ranges[i] = LightClusterBuilder::ComputeRange(lights[i]);
+        CHECK(builder.GetLights()[i].Radius == (float)ranges[i]);
+    }
+
+    // Every light whose range sphere touches the froxel is listed, in increasing order. The binning tests the froxel box so
+    // it may add lights touching the box only, never one past it
+    uint32_t missingCount = 0;
+    uint32_t extraCount = 0;
+    uint32_t unsortedCount = 0;
+    uint32_t expectedCount = 0;
+    std::vector<uint8_t> listed(lightCount);
+    for(uint32_t z = 0; z < LIGHT_CLUSTER_COUNT_Z; z++)
+    {
+        for(uint32_t y = 0; y < LIGHT_CLUSTER_COUNT_Y; y++)
+        {
+            for(uint32_t x = 0; x < LIGHT_CLUSTER_COUNT_X; x++)
+            {
+                uint32_t cluster = (z * LIGHT_CLUSTER_COUNT_Y + y) * LIGHT_CLUSTER_COUNT_X + x;
+                std::vector<uint32_t> clusterLights = GetClusterLights(builder, cluster);
+                std::fill(listed.begin(), listed.end(), 0);
+                for(size_t k = 0; k < clusterLights.size(); k++)
+                {
+                    listed[clusterLights[k]] = 1;
+                    unsortedCount += k > 0 && clusterLights[k] <= clusterLights[k - 1];
+                }
+
+                Froxel froxel = GetFroxel(frustum, x, y, z);
+                for(uint32_t i = 0; i < lightCount; i++)
+                {
+                    double rangeSq = ranges[i] * ranges[i];
+                    double boxDistanceSq = BoxDistanceSq(froxel, &centers[i * 3]);
+                    bool touchesBox = ranges[i] > 0.0 && boxDistanceSq <= rangeSq * (1.0 + RangeTolerance);
+                    extraCount += listed[i] && !touchesBox;
+
+                    // The box encloses the froxel, the exact distance is only needed for the lights touching it
+                    if(touchesBox && FroxelDistanceSq(frustum, froxel, &centers[i * 3]) <= rangeSq * (1.0 - RangeTolerance))
+                    {
+                        missingCount += !listed[i];
+                        expectedCount++;
+                    }
+                }
+            }
+        }
+    }
+    CHECK(missingCount == 0);
+    CHECK(extraCount == 0);
+    CHECK(unsortedCount == 0);
+    CHECK(expectedCount > LIGHT_CLUSTER_COUNT);
+}
+
+TEST(LightClustering_PointsSeeTheirLights)
+{
+    // Shading point of view : a point lit by a light finds it in the list of the froxel it falls in
+    const uint32_t lightCount = 2000;
+    std::vector<PointLight> lights = MakeLights(lightCount);
+    Camera camera = MakeCamera();
+    LightClusterBuilder builder;
+    builder.Build(lights.data(), lightCount, camera, ViewportWidth, ViewportHeight);
+
+    ReferenceFrustum frustum = GetReferenceFrustum(camera);
+    XMMATRIX inverseView = XMMatrixInverse(nullptr, camera.GetViewMatrix());
+    const LightClusterConstantBuffer& constants = builder.GetConstants();
+
+    std::mt19937 random(2);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    uint32_t missingCount = 0;
+    uint32_t litCount = 0;
+    std::vector<uint8_t> listed(lightCount);
+    for(uint32_t sample = 0; sample < 20000; sample++)
+    {
+        float pixelX = unit(random) * ViewportWidth;
+        float pixelY = unit(random) * ViewportHeight;
+        float depth = (float)(frustum.NearZ * pow(frustum.FarZ / frustum.NearZ, unit(random)));
+        XMVECTOR positionVS = XMVectorSet((pixelX / ViewportWidth * 2.0f - 1.0f) * depth / (float)frustum.ProjX,
+            (1.0f - pixelY / ViewportHeight * 2.0f) * depth / (float)frustum.ProjY, depth, 1.0f);
+        XMFLOAT3 position;
+        XMStoreFloat3(&position, XMVector3TransformCoord(positionVS, inverseView));
+
+        // Same froxel lookup as the clustered shading
+        uint32_t x = (std::min)((uint32_t)(pixelX * constants.TileScale[0]), (uint32_t)LIGHT_CLUSTER_COUNT_X - 1);
+        uint32_t y = (std::min)((uint32_t)(pixelY * constants.TileScale[1]), (uint32_t)LIGHT_CLUSTER_COUNT_Y - 1);
+        int z = (int)std::floor(std::log(depth) * constants.SliceScale + constants.SliceBias);
+        z = (std::max)(0, (std::min)(z, LIGHT_CLUSTER_COUNT_Z - 1));
+
+        std::fill(listed.begin(), listed.end(), 0);
+        for(uint32_t light : GetClusterLights(builder, (z * LIGHT_CLUSTER_COUNT_Y + y) * LIGHT_CLUSTER_COUNT_X + x))
+            listed[light] = 1;
+
+        for(uint32_t i = 0; i < lightCount; i++)
+        {
+            float range = builder.GetLights()[i].Radius;
+            float distanceSq = XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(XMLoadFloat3(&lights[i].Position), XMLoadFloat3(&position))));
+            if(distanceSq <= range * range * (1.0f - (float)RangeTolerance))
+            {
+                litCount++;
+                missingCount += !listed[i];
+            }
+        }
+    }
+    CHECK(missingCount == 0);
+    CHECK(litCount > 0);
+}
+
+TEST(LightClustering_SameWithoutJobSystem)
+{
+    const uint32_t lightCount = 5000;
+    std::vector<PointLight> lights = MakeLights(lightCount);
+    Camera camera = MakeCamera();
+    LightClusterBuilder builder;
+    builder.Build(lights.data(), lightCount, camera, ViewportWidth, ViewportHeight);
+
+    JobSystem::Release();
+    LightClusterBuilder serialBuilder;
+    serialBuilder.Build(lights.data(), lightCount, camera, ViewportWidth, ViewportHeight);
+    JobSystem::Create(TestRegistry::GetWorkerCount());
+
+    CHECK(memcmp(builder.GetClusters(), serialBuilder.GetClusters(), sizeof(LightCluster) * LIGHT_CLUSTER_COUNT) == 0);
+    CHECK(builder.GetLightIndexCount() == serialBuilder.GetLightIndexCount());
+    CHECK(memcmp(builder.GetLightIndices(), serialBuilder.GetLightIndices(), sizeof(uint32_t) * builder.GetLightIndexCount()) == 0);
+
+    // Rebuilding over the previous frame leaves no stale lists
+    builder.Build(lights.data(), 100, camera, ViewportWidth, ViewportHeight);
+    serialBuilder = LightClusterBuilder();
+    serialBuilder.Build(lights.data(), 100, camera, ViewportWidth, ViewportHeight);
+    CHECK(builder.GetLightIndexCount() == serialBuilder.GetLightIndexCount());
+    CHECK(memcmp(builder.GetClusters(), serialBuilder.GetClusters(), sizeof(LightCluster) * LIGHT_CLUSTER_COUNT) == 0);
+}
+
+BENCHMARK(LightClustering_Build)
+{
+    Camera camera = MakeCamera();
+    for(uint32_t lightCount : { 1000u, 10000u, 50000u })
+    {
+        std::vector<PointLight> lights = MakeLights(lightCount);
+        LightClusterBuilder builder;
+
+        double parallelMs = MeasureMilliseconds(20, [&]
+        {
+            builder.Build(lights.data(), lightCount, camera, ViewportWidth, ViewportHeight);
+        });
+
+        JobSystem::Release();
+        double serialMs = MeasureMilliseconds(20, [&]
+        {
+            builder.Build(lights.data(), lightCount, camera, ViewportWidth, ViewportHeight);
+        });
+        JobSystem::Create(TestRegistry::GetWorkerCount());
+
+        printf("    %u lights, %u cluster entries : %.3f ms on the job system (1 ms budget), %.3f ms on one thread\n",
+            lightCount, builder.GetLightIndexCount(), parallelMs, serialMs);
+    }
+}
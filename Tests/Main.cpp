@@ -0,0 +1,92 @@
+﻿#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+#include <new>
+#include <string>
+
+#include "JobSystem.h"
+#include "Logger.h"
+#include "TestFramework.h"
+
+std::vector<TestCase>& TestRegistry::GetTests()
+{
+    static std::vector<TestCase> s_tests;
+    return s_tests;
+}
+
+void TestRegistry::ReportFailure(const char* file, int line, const char* expression)
+{
+    m_failureCount++;
+    printf("    %s(%d): CHECK(%s) failed\n", file, line, expression);
+}
+
+// Every global heap allocation of the test binary goes through here, tests compare the count around the code they check
+void* operator new(size_t size)
+{
+    TestRegistry::CountAllocation();
+    if(void* memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    TestRegistry::CountAllocation();
+    if(void* memory = _aligned_malloc(size ? size : 1, (size_t)alignment))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+    _aligned_free(memory);
+}
+
+// CorvusTests [--bench] [--workers N] [prefix] : runs the tests, or the benchmarks, whose name starts with prefix
+int main(int argc, char* argv[])
+{
+    Logger::Initialize();
+    Logger::SetLevel(LogType::Error);
+
+    bool runBenchmarks = false;
+    std::string prefix;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--bench") == 0)
+            runBenchmarks = true;
+        else if(strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+            TestRegistry::SetWorkerCount((uint32_t)atoi(argv[++i]));
+        else
+            prefix = argv[i];
+    }
+
+    JobSystem::Create(TestRegistry::GetWorkerCount());
+
+    uint32_t runCount = 0;
+    uint32_t failedCount = 0;
+    for(const TestCase& test : TestRegistry::GetTests())
+    {
+        if(test.IsBenchmark != runBenchmarks || strncmp(test.Name, prefix.c_str(), prefix.size()) != 0)
+            continue;
+
+        printf("%s\n", test.Name);
+
+        uint32_t failuresBefore = TestRegistry::GetFailureCount();
+        test.Function();
+        runCount++;
+
+        if(TestRegistry::GetFailureCount() != failuresBefore)
+            failedCount++;
+    }
+
+    printf("%u run, %u failed\n", runCount, failedCount);
+
+    JobSystem::Release();
+    Logger::Shutdown();
+    return failedCount == 0 ? 0 : 1;
+}
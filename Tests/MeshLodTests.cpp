@@ -0,0 +1,263 @@
+﻿#include <array>
+#include <cfloat>
+#include <cmath>
+#include <map>
+
+#include "Rendering/MeshLod.h"
+#include "Rendering/MeshSimplifier.h"
+#include "Rendering/RenderItem.h"
+#include "TestFramework.h"
+#include "TestMeshes.h"
+
+using namespace DirectX;
+
+namespace
+{
+    // MeshSimplifier::Simplify returns the largest source vertex to LOD distance, only float rounding sets it apart from the measured one
+    const float ErrorTolerance = 1e-3f;
+
+    struct LodMesh
+    {
+        std::vector<Vertex> Vertices;
+        std::vector<uint32_t> Indices;
+        std::vector<MeshLod> Lods;
+    };
+
+    // Bumpy sphere, the u = 0 and u = 1 columns share their positions : an attribute seam the simplifier must keep closed
+    LodMesh MakeSeamSphere(uint32_t rings, uint32_t segments)
+    {
+        LodMesh mesh;
+        auto AddVertex = [&](float theta, float phi, float u)
+        {
+            float radius = 1.0f + 0.05f * std::sin(5.0f * theta) * std::sin(4.0f * phi);
+            Vertex vertex = {};
+            vertex.Position = XMFLOAT3(radius * std::sin(theta) * std::cos(phi), radius * std::cos(theta), radius * std::sin(theta) * std::sin(phi));
+            vertex.UV = XMFLOAT2(u, theta / XM_PI);
+            vertex.Normal = XMFLOAT3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            mesh.Vertices.push_back(vertex);
+        };
+
+        AddVertex(0.0f, 0.0f, 0.5f);
+        for(uint32_t ring = 1; ring < rings; ring++)
+        {
+            for(uint32_t segment = 0; segment <= segments; segment++)
+                AddVertex(XM_PI * ring / rings, XM_2PI * (segment % segments) / segments, (float)segment / segments);
+        }
+        AddVertex(XM_PI, 0.0f, 0.5f);
+
+        auto RingVertex = [&](uint32_t ring, uint32_t segment) { return 1 + (ring - 1) * (segments + 1) + segment; };
+        uint32_t bottom = (uint32_t)mesh.Vertices.size() - 1;
+        for(uint32_t segment = 0; segment < segments; segment++)
+        {
+            mesh.Indices.insert(mesh.Indices.end(), { 0, RingVertex(1, segment + 1), RingVertex(1, segment) });
+            for(uint32_t ring = 1; ring + 1 < rings; ring++)
+            {
+                uint32_t a = RingVertex(ring, segment);
+                uint32_t b = RingVertex(ring, segment + 1);
+                uint32_t c = RingVertex(ring + 1, segment);
+                uint32_t d = RingVertex(ring + 1, segment + 1);
+                mesh.Indices.insert(mesh.Indices.end(), { a, b, c, b, d, c });
+            }
+            mesh.Indices.insert(mesh.Indices.end(), { bottom, RingVertex(rings - 1, segment), RingVertex(rings - 1, segment + 1) });
+        }
+
+        return mesh;
+    }
+
+    // The chain MeshCooker builds
+    void BuildLods(LodMesh& mesh)
+    {
+        MeshSimplifier::BuildLods(reinterpret_cast<const float*>(mesh.Vertices.data()), sizeof(Vertex), (uint32_t)mesh.Vertices.size(), mesh.Indices, mesh.Lods);
+    }
+
+    // Largest distance from a source vertex to the LOD surface, the LOD vertices are source ones so this is the Hausdorff distance at the vertices
+    float MeasureLodDistance(const LodMesh& mesh, const MeshLod& lod)
+    {
+        float largest = 0.0f;
+        for(const Vertex& vertex : mesh.Vertices)
+        {
+            XMVECTOR point = XMLoadFloat3(&vertex.Position);
+            float nearest = FLT_MAX;
+            for(uint32_t i = lod.IndexOffset; i < lod.IndexOffset + lod.IndexCount; i += 3)
+            {
+                nearest = (std::min)(nearest, PointTriangleDistance(point, XMLoadFloat3(&mesh.Vertices[mesh.Indices[i]].Position),
+                    XMLoadFloat3(&mesh.Vertices[mesh.Indices[i + 1]].Position), XMLoadFloat3(&mesh.Vertices[mesh.Indices[i + 2]].Position)));
+            }
+            largest = (std::max)(largest, nearest);
+        }
+        return largest;
+    }
+
+    const char* LoadBenchmarkLodMesh(LodMesh& mesh)
+    {
+        std::vector<XMFLOAT3> positions;
+        const char* path = LoadBenchmarkMesh(positions, mesh.Indices);
+        mesh.Vertices.resize(positions.size());
+        for(size_t i = 0; i < positions.size(); i++)
+            mesh.Vertices[i] = { positions[i] };
+        return path;
+    }
+
+    std::vector<float> GetErrors(const LodMesh& mesh)
+    {
+        std::vector<float> errors;
+        for(const MeshLod& lod : mesh.Lods)
+            errors.push_back(lod.Error);
+        return errors;
+    }
+}
+
+TEST(MeshLod_ErrorBoundsEachLevel)
+{
+    std::vector<LodMesh> meshes = { MakeSeamSphere(48, 96) };
+    // Separate shells passing through each other, the nearest LOD triangle of a vertex may belong to another part
+    LodMesh loaded;
+    if(LoadBenchmarkLodMesh(loaded))
+        meshes.push_back(std::move(loaded));
+
+    for(LodMesh& mesh : meshes)
+    {
+        BuildLods(mesh);
+        CHECK(mesh.Lods.size() == MESH_LOD_MAX_COUNT);
+
+        for(size_t lod = 1; lod < mesh.Lods.size(); lod++)
+        {
+            float error = mesh.Lods[lod].Error;
+            CHECK(mesh.Lods[lod].IndexCount <= mesh.Lods[lod - 1].IndexCount * MESH_LOD_MIN_REDUCTION);
+            CHECK(error >= mesh.Lods[lod - 1].Error);
+
+            // The measured distance, unless raised to the previous level error
+            float distance = MeasureLodDistance(mesh, mesh.Lods[lod]);
+            CHECK(error > 0.0f);
+            CHECK(distance <= (1.0f + ErrorTolerance) * error);
+            CHECK(distance >= (1.0f - ErrorTolerance) * error || error == mesh.Lods[lod - 1].Error);
+        }
+    }
+}
+
+TEST(MeshLod_SeamsStayClosed)
+{
+    LodMesh mesh = MakeSeamSphere(48, 96);
+    BuildLods(mesh);
+
+    for(const MeshLod& lod : mesh.Lods)
+    {
+        // Welded by position, every edge of a closed mesh is shared by exactly two triangles : a torn seam leaves a crack
+        std::map<std::array<float, 6>, int> edges;
+
+        uint32_t mixedTriangles = 0;
+        for(uint32_t i = lod.IndexOffset; i < lod.IndexOffset + lod.IndexCount; i += 3)
+        {
+            float uMin = FLT_MAX;
+            float uMax = -FLT_MAX;
+            for(uint32_t corner = 0; corner < 3; corner++)
+            {
+                const Vertex& from = mesh.Vertices[mesh.Indices[i + corner]];
+                const Vertex& to = mesh.Vertices[mesh.Indices[i + (corner + 1) % 3]];
+                std::array<float, 6> edge = { from.Position.x, from.Position.y, from.Position.z, to.Position.x, to.Position.y, to.Position.z };
+                if(std::tie(edge[3], edge[4], edge[5]) < std::tie(edge[0], edge[1], edge[2]))
+                    std::swap_ranges(edge.begin(), edge.begin() + 3, edge.begin() + 3);
+                edges[edge]++;
+
+                // The poles are on both sides
+                if(from.UV.y > 0.0f && from.UV.y < 1.0f)
+                {
+                    uMin = (std::min)(uMin, from.UV.x);
+                    uMax = (std::max)(uMax, from.UV.x);
+                }
+            }
+
+            // A wedge collapsed onto the wrong seam copy stretches the triangle across the whole texture
+            if(uMax - uMin > 0.5f)
+                mixedTriangles++;
+        }
+
+        CHECK(mixedTriangles == 0);
+        bool closed = true;
+        for(const auto& edge : edges)
+            closed &= edge.second == 2;
+        CHECK(closed);
+    }
+}
+
+TEST(MeshLod_SelectionHysteresis)
+{
+    LodMesh mesh = MakeSeamSphere(48, 96);
+    BuildLods(mesh);
+    std::vector<float> errors = GetErrors(mesh);
+    uint32_t lodCount = (uint32_t)errors.size();
+
+    LodSelectionView view = LodSelection::MakeView(XMFLOAT3(0.0f, 0.0f, 0.0f), XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 1000.0f), 1080.0f);
+    auto Select = [&](float distance, uint32_t previousLod)
+    {
+        return LodSelection::SelectLod(errors.data(), lodCount, LodSelection::GetPixelsPerUnit(XMFLOAT3(0.0f, 0.0f, distance), 1.0f, 1.0f, view), previousLod);
+    };
+
+    // Moving away only ever coarsens, switching under the reduced threshold, coming back refines at the plain threshold
+    std::vector<float> outDistances(lodCount, 0.0f);
+    std::vector<float> inDistances(lodCount, 0.0f);
+    uint32_t lod = 0;
+    for(float distance = 1.5f; distance < 2000.0f; distance *= 1.01f)
+    {
+        uint32_t next = Select(distance, lod);
+        CHECK(next >= lod);
+        if(next > lod)
+        {
+            float pixelsPerUnit = LodSelection::GetPixelsPerUnit(XMFLOAT3(0.0f, 0.0f, distance), 1.0f, 1.0f, view);
+            CHECK(errors[next] * pixelsPerUnit <= MESH_LOD_ERROR_THRESHOLD * (1.0f - MESH_LOD_HYSTERESIS));
+            outDistances[next] = distance;
+        }
+        lod = next;
+    }
+    CHECK(lod == lodCount - 1);
+
+    for(float distance = 2000.0f; distance > 1.5f; distance /= 1.01f)
+    {
+        uint32_t next = Select(distance, lod);
+        CHECK(next <= lod);
+        if(next < lod)
+            inDistances[lod] = distance;
+        lod = next;
+    }
+    CHECK(lod == 0);
+
+    for(uint32_t level = 1; level < lodCount; level++)
+    {
+        CHECK(outDistances[level] > 0.0f && inDistances[level] > 0.0f);
+        CHECK(inDistances[level] < outDistances[level]);
+
+        // Jittering around the switch distance does not flip back and forth
+        uint32_t previous = Select(outDistances[level], level - 1);
+        uint32_t flips = 0;
+        for(uint32_t frame = 0; frame < 100; frame++)
+        {
+            uint32_t next = Select(outDistances[level] * (frame % 2 ? 1.005f : 0.995f), previous);
+            flips += next != previous;
+            previous = next;
+        }
+        CHECK(flips == 0);
+    }
+}
+
+BENCHMARK(MeshLod_Simplify)
+{
+    LodMesh source;
+    const char* path = LoadBenchmarkLodMesh(source);
+    if(!path)
+    {
+        path = "procedural sphere";
+        source = MakeSeamSphere(256, 512);
+    }
+
+    LodMesh mesh;
+    double milliseconds = MeasureMilliseconds(3, [&]
+    {
+        mesh = source;
+        BuildLods(mesh);
+    });
+
+    printf("    %s, %zu vertices : LOD chain in %.2f ms, triangles (error)", path, source.Vertices.size(), milliseconds);
+    for(const MeshLod& lod : mesh.Lods)
+        printf(" %u (%g)", lod.IndexCount / 3, lod.Error);
+    printf("\n");
+}
@@ -0,0 +1,245 @@
+﻿#include <array>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include "Rendering/MeshOptimizer.h"
+#include "TestFramework.h"
+#include "TestMeshes.h"
+
+using namespace DirectX;
+
+namespace
+{
+    struct TestVertex
+    {
+        XMFLOAT3 Position;
+        XMFLOAT2 UV;
+    };
+
+    using Corner = std::array<float, 5>;
+    using Triangle = std::array<Corner, 3>;
+
+    // Bumpy sphere as an unindexed triangle soup in random order, as the OBJ importer hands it over.
+    // Every degenerateEvery triangle is followed by a copy with two bitwise identical corners.
+    std::vector<TestVertex> MakeSphereSoup(uint32_t rings, uint32_t segments, uint32_t degenerateEvery, std::vector<uint32_t>& indices)
+    {
+        auto MakeVertex = [&](uint32_t ring, uint32_t segment)
+        {
+            float theta = XM_PI * ring / rings;
+            float phi = XM_2PI * (segment % segments) / segments;
+            float radius = 1.0f + 0.05f * std::sin(5.0f * theta) * std::sin(4.0f * phi);
+            return TestVertex { XMFLOAT3(radius * std::sin(theta) * std::cos(phi), radius * std::cos(theta), radius * std::sin(theta) * std::sin(phi)),
+                XMFLOAT2((float)segment / segments, (float)ring / rings) };
+        };
+
+        std::vector<std::array<TestVertex, 3>> triangles;
+        for(uint32_t ring = 0; ring < rings; ring++)
+        {
+            for(uint32_t segment = 0; segment < segments; segment++)
+            {
+                TestVertex a = MakeVertex(ring, segment);
+                TestVertex b = MakeVertex(ring, segment + 1);
+                TestVertex c = MakeVertex(ring + 1, segment);
+                TestVertex d = MakeVertex(ring + 1, segment + 1);
+                if(ring > 0)
+                    triangles.push_back({ a, b, c });
+                if(ring + 1 < rings)
+                    triangles.push_back({ b, d, c });
+            }
+        }
+
+        std::shuffle(triangles.begin(), triangles.end(), std::mt19937(11));
+
+        std::vector<TestVertex> vertices;
+        indices.clear();
+        for(size_t t = 0; t < triangles.size(); t++)
+        {
+            for(const TestVertex& vertex : triangles[t])
+            {
+                indices.push_back((uint32_t)vertices.size());
+                vertices.push_back(vertex);
+            }
+            if(degenerateEvery && t % degenerateEvery == 0)
+            {
+                for(const TestVertex& vertex : { triangles[t][0], triangles[t][0], triangles[t][1] })
+                {
+                    indices.push_back((uint32_t)vertices.size());
+                    vertices.push_back(vertex);
+                }
+            }
+        }
+        return vertices;
+    }
+
+    Corner GetCorner(const TestVertex& vertex)
+    {
+        return { vertex.Position.x, vertex.Position.y, vertex.Position.z, vertex.UV.x, vertex.UV.y };
+    }
+
+    // Triangles by value, rotated to their smallest corner so the winding is kept, sorted. Degenerate ones are skipped on request
+    std::vector<Triangle> GatherTriangles(const std::vector<TestVertex>& vertices, const std::vector<uint32_t>& indices, bool skipDegenerate = false)
+    {
+        std::vector<Triangle> triangles;
+        for(size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            Triangle triangle = { GetCorner(vertices[indices[i]]), GetCorner(vertices[indices[i + 1]]), GetCorner(vertices[indices[i + 2]]) };
+            if(skipDegenerate && (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[2] == triangle[0]))
+                continue;
+            std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+            triangles.push_back(triangle);
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    }
+
+    // Soup welded and stripped of its degenerate triangles, the input of the cache pass in MeshOptimizer::Optimize
+    std::vector<TestVertex> MakeWeldedSphere(std::vector<uint32_t>& indices)
+    {
+        std::vector<TestVertex> vertices = MakeSphereSoup(32, 64, 0, indices);
+        std::vector<uint32_t> remap;
+        uint32_t uniqueCount = MeshOptimizer::GenerateWeldRemap(vertices.data(), (uint32_t)vertices.size(), sizeof(TestVertex), remap);
+        MeshOptimizer::RemapIndices(indices, remap);
+        MeshOptimizer::RemapVertices(vertices, remap, uniqueCount);
+        return vertices;
+    }
+}
+
+TEST(MeshOptimizer_Weld)
+{
+    std::vector<uint32_t> indices;
+    std::vector<TestVertex> vertices = MakeSphereSoup(32, 64, 7, indices);
+    std::vector<Triangle> sourceTriangles = GatherTriangles(vertices, indices);
+
+    std::vector<uint32_t> remap;
+    uint32_t uniqueCount = MeshOptimizer::GenerateWeldRemap(vertices.data(), (uint32_t)vertices.size(), sizeof(TestVertex), remap);
+
+    // 31 inner rings of 65 vertices (the u = 1 column keeps its own UVs) and 64 vertices at each pole, one per triangle touching it
+    CHECK(uniqueCount == 31 * 65 + 2 * 64);
+
+    std::vector<TestVertex> welded = vertices;
+    MeshOptimizer::RemapVertices(welded, remap, uniqueCount);
+    for(size_t i = 0; i < vertices.size(); i++)
+        CHECK(memcmp(&welded[remap[i]], &vertices[i], sizeof(TestVertex)) == 0);
+
+    std::vector<uint32_t> weldedIndices = indices;
+    MeshOptimizer::RemapIndices(weldedIndices, remap);
+    CHECK(GatherTriangles(welded, weldedIndices) == sourceTriangles);
+
+    // Only the triangles with identical corners go away
+    uint32_t sourceTriangleCount = (uint32_t)weldedIndices.size() / 3;
+    uint32_t removedCount = MeshOptimizer::RemoveDegenerateTriangles(weldedIndices);
+    CHECK(removedCount > 0);
+    CHECK(weldedIndices.size() / 3 + removedCount == sourceTriangleCount);
+    CHECK(GatherTriangles(welded, weldedIndices) == GatherTriangles(vertices, indices, true));
+}
+
+TEST(MeshOptimizer_VertexCache)
+{
+    std::vector<uint32_t> indices;
+    std::vector<TestVertex> vertices = MakeWeldedSphere(indices);
+    std::vector<Triangle> sourceTriangles = GatherTriangles(vertices, indices);
+
+    float sourceACMR = MeshOptimizer::ComputeACMR(indices, (uint32_t)vertices.size());
+    MeshOptimizer::OptimizeVertexCache(indices, (uint32_t)vertices.size());
+    float optimizedACMR = MeshOptimizer::ComputeACMR(indices, (uint32_t)vertices.size());
+
+    CHECK(GatherTriangles(vertices, indices) == sourceTriangles);
+    // Shuffled triangles miss nearly every vertex, a regular grid optimises to about 0.6
+    CHECK(optimizedACMR < sourceACMR);
+    CHECK(optimizedACMR < 0.8f);
+
+    // Running it again on a good order does not make it worse
+    MeshOptimizer::OptimizeVertexCache(indices, (uint32_t)vertices.size());
+    CHECK(GatherTriangles(vertices, indices) == sourceTriangles);
+    CHECK(MeshOptimizer::ComputeACMR(indices, (uint32_t)vertices.size()) <= optimizedACMR * 1.01f);
+}
+
+TEST(MeshOptimizer_Overdraw)
+{
+    std::vector<uint32_t> indices;
+    std::vector<TestVertex> vertices = MakeWeldedSphere(indices);
+    MeshOptimizer::OptimizeVertexCache(indices, (uint32_t)vertices.size());
+    std::vector<Triangle> sourceTriangles = GatherTriangles(vertices, indices);
+    float cacheACMR = MeshOptimizer::ComputeACMR(indices, (uint32_t)vertices.size());
+
+    std::vector<uint32_t> overdrawIndices = indices;
+    MeshOptimizer::OptimizeOverdraw(overdrawIndices, &vertices[0].Position.x, sizeof(TestVertex), (uint32_t)vertices.size(), MESH_OPTIMIZER_OVERDRAW_THRESHOLD);
+    CHECK(GatherTriangles(vertices, overdrawIndices) == sourceTriangles);
+    // Clusters only split where the cache order stays within the threshold
+    CHECK(MeshOptimizer::ComputeACMR(overdrawIndices, (uint32_t)vertices.size()) <= cacheACMR * MESH_OPTIMIZER_OVERDRAW_THRESHOLD);
+
+    // A degenerate first triangle misses only 2 vertices, the triangles up to the next full miss must still be kept
+    std::vector<uint32_t> degenerateFirst = { indices[0], indices[0], indices[1] };
+    degenerateFirst.insert(degenerateFirst.end(), indices.begin(), indices.end());
+    std::vector<Triangle> degenerateTriangles = GatherTriangles(vertices, degenerateFirst);
+    MeshOptimizer::OptimizeOverdraw(degenerateFirst, &vertices[0].Position.x, sizeof(TestVertex), (uint32_t)vertices.size(), MESH_OPTIMIZER_OVERDRAW_THRESHOLD);
+    CHECK(degenerateFirst.size() == indices.size() + 3);
+    CHECK(GatherTriangles(vertices, degenerateFirst) == degenerateTriangles);
+
+    // A strip of degenerate triangles alone never misses 3 vertices
+    std::vector<uint32_t> degenerateOnly = { 0, 0, 1, 1, 1, 2, 2, 3, 3 };
+    MeshOptimizer::OptimizeOverdraw(degenerateOnly, &vertices[0].Position.x, sizeof(TestVertex), (uint32_t)vertices.size(), MESH_OPTIMIZER_OVERDRAW_THRESHOLD);
+    CHECK(degenerateOnly.size() == 9);
+}
+
+TEST(MeshOptimizer_FetchRemap)
+{
+    std::vector<uint32_t> indices;
+    std::vector<TestVertex> vertices = MakeWeldedSphere(indices);
+    MeshOptimizer::OptimizeVertexCache(indices, (uint32_t)vertices.size());
+
+    // An unused vertex is dropped
+    vertices.push_back({ XMFLOAT3(5.0f, 5.0f, 5.0f), XMFLOAT2(0.0f, 0.0f) });
+    std::vector<Triangle> sourceTriangles = GatherTriangles(vertices, indices);
+    float sourceACMR = MeshOptimizer::ComputeACMR(indices, (uint32_t)vertices.size());
+
+    std::vector<uint32_t> remap;
+    uint32_t usedCount = MeshOptimizer::GenerateFetchRemap(indices, (uint32_t)vertices.size(), remap);
+    CHECK(usedCount == vertices.size() - 1);
+    CHECK(remap.back() == UINT32_MAX);
+
+    MeshOptimizer::RemapIndices(indices, remap);
+    MeshOptimizer::RemapVertices(vertices, remap, usedCount);
+    CHECK(vertices.size() == usedCount);
+    CHECK(GatherTriangles(vertices, indices) == sourceTriangles);
+    CHECK(MeshOptimizer::ComputeACMR(indices, usedCount) == sourceACMR);
+
+    // Vertices come in first use order
+    uint32_t nextVertex = 0;
+    for(uint32_t index : indices)
+    {
+        CHECK(index <= nextVertex);
+        if(index == nextVertex)
+            nextVertex++;
+    }
+    CHECK(nextVertex == usedCount);
+}
+
+TEST(MeshOptimizer_Optimize)
+{
+    std::vector<uint32_t> indices;
+    std::vector<TestVertex> vertices = MakeSphereSoup(32, 64, 5, indices);
+    std::vector<Triangle> sourceTriangles = GatherTriangles(vertices, indices, true);
+
+    MeshOptimizerStats stats = MeshOptimizer::Optimize(vertices, indices);
+    CHECK(GatherTriangles(vertices, indices) == sourceTriangles);
+    CHECK(stats.ACMRAfter <= stats.ACMRBefore);
+    CHECK(stats.VertexCountAfter == vertices.size());
+    CHECK(stats.VertexCountAfter < stats.VertexCountBefore);
+
+    // Same on a real mesh, its positions indexed as loaded
+    std::vector<XMFLOAT3> positions;
+    std::vector<uint32_t> meshIndices;
+    if(!LoadBenchmarkMesh(positions, meshIndices))
+        return;
+
+    std::vector<TestVertex> meshVertices(positions.size());
+    for(size_t i = 0; i < positions.size(); i++)
+        meshVertices[i] = { positions[i], XMFLOAT2(0.0f, 0.0f) };
+    std::vector<Triangle> meshTriangles = GatherTriangles(meshVertices, meshIndices, true);
+
+    stats = MeshOptimizer::Optimize(meshVertices, meshIndices);
+    CHECK(GatherTriangles(meshVertices, meshIndices) == meshTriangles);
+    CHECK(stats.ACMRAfter <= stats.ACMRBefore);
+}
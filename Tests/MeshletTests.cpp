@@ -0,0 +1,373 @@
+﻿#include <cfloat>
+#include <cmath>
+#include <random>
+
+#include "Rendering/Meshlet.h"
+#include "Rendering/MeshOptimizer.h"
+#include "TestFramework.h"
+#include "TestMeshes.h"
+
+using namespace DirectX;
+
+namespace
+{
+    // Sphere tests this close to a plane or cone boundary may go either way depending on the rounding of the SIMD path
+    const double CullTolerance = 1e-3;
+
+    struct MeshletMesh
+    {
+        std::vector<XMFLOAT3> Positions;
+        std::vector<uint32_t> Indices;
+        std::vector<Meshlet> Meshlets;
+    };
+
+    // Bumpy sphere with clockwise front faces seen from outside, as the engine draws them
+    MeshletMesh MakeBumpySphere(uint32_t rings, uint32_t segments)
+    {
+        MeshletMesh mesh;
+        for(uint32_t ring = 0; ring <= rings; ring++)
+        {
+            for(uint32_t segment = 0; segment < segments; segment++)
+            {
+                float theta = XM_PI * ring / rings;
+                float phi = XM_2PI * segment / segments;
+                float radius = 1.0f + 0.1f * std::sin(6.0f * theta) * std::sin(5.0f * phi);
+                mesh.Positions.emplace_back(radius * std::sin(theta) * std::cos(phi), radius * std::cos(theta), radius * std::sin(theta) * std::sin(phi));
+            }
+        }
+
+        auto Index = [&](uint32_t ring, uint32_t segment) { return ring * segments + segment % segments; };
+        for(uint32_t ring = 0; ring < rings; ring++)
+        {
+            for(uint32_t segment = 0; segment < segments; segment++)
+            {
+                uint32_t a = Index(ring, segment);
+                uint32_t b = Index(ring, segment + 1);
+                uint32_t c = Index(ring + 1, segment);
+                uint32_t d = Index(ring + 1, segment + 1);
+                if(ring > 0)
+                    mesh.Indices.insert(mesh.Indices.end(), { a, b, c });
+                if(ring + 1 < rings)
+                    mesh.Indices.insert(mesh.Indices.end(), { b, d, c });
+            }
+        }
+
+        // Flip the triangles whose normal points inside
+        for(size_t i = 0; i < mesh.Indices.size(); i += 3)
+        {
+            XMVECTOR p0 = XMLoadFloat3(&mesh.Positions[mesh.Indices[i]]);
+            XMVECTOR p1 = XMLoadFloat3(&mesh.Positions[mesh.Indices[i + 1]]);
+            XMVECTOR p2 = XMLoadFloat3(&mesh.Positions[mesh.Indices[i + 2]]);
+            XMVECTOR normal = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+            if(XMVectorGetX(XMVector3Dot(normal, XMVectorAdd(XMVectorAdd(p0, p1), p2))) < 0.0f)
+                std::swap(mesh.Indices[i + 1], mesh.Indices[i + 2]);
+        }
+        return mesh;
+    }
+
+    // Same order as the cooker : cache optimized indices split in meshlets
+    void BuildMeshlets(MeshletMesh& mesh)
+    {
+        MeshOptimizer::OptimizeVertexCache(mesh.Indices, (uint32_t)mesh.Positions.size());
+        MeshletBuilder::Build(&mesh.Positions[0].x, sizeof(XMFLOAT3), (uint32_t)mesh.Positions.size(), mesh.Indices, mesh.Meshlets);
+    }
+
+    std::vector<MeshletMesh> MakeMeshes()
+    {
+        std::vector<MeshletMesh> meshes;
+        meshes.push_back(MakeBumpySphere(40, 80));
+        MeshletMesh loaded;
+        if(LoadBenchmarkMesh(loaded.Positions, loaded.Indices))
+        {
+            // Brought to about the size of the sphere
+            XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+            XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+            for(const XMFLOAT3& position : loaded.Positions)
+            {
+                boundsMin = XMVectorMin(boundsMin, XMLoadFloat3(&position));
+                boundsMax = XMVectorMax(boundsMax, XMLoadFloat3(&position));
+            }
+            XMVECTOR center = XMVectorScale(XMVectorAdd(boundsMin, boundsMax), 0.5f);
+            float scale = 2.0f / XMVectorGetX(XMVector3Length(XMVectorSubtract(boundsMax, boundsMin)));
+            for(XMFLOAT3& position : loaded.Positions)
+                XMStoreFloat3(&position, XMVectorScale(XMVectorSubtract(XMLoadFloat3(&position), center), scale));
+            meshes.push_back(std::move(loaded));
+        }
+
+        for(MeshletMesh& mesh : meshes)
+            BuildMeshlets(mesh);
+        return meshes;
+    }
+
+    std::vector<XMFLOAT4X4> MakeTransforms()
+    {
+        std::vector<XMMATRIX> matrices = {
+            XMMatrixIdentity(),
+            XMMatrixRotationRollPitchYaw(0.3f, 1.1f, -0.4f) * XMMatrixTranslation(0.2f, -0.1f, 0.3f),
+            XMMatrixScaling(1.7f, 1.7f, 1.7f) * XMMatrixRotationRollPitchYaw(-0.7f, 0.2f, 0.9f) * XMMatrixTranslation(-0.3f, 0.0f, 0.1f),
+            // Non uniform and mirrored : sphere tests only
+            XMMatrixScaling(0.6f, 1.8f, 1.1f) * XMMatrixRotationRollPitchYaw(0.5f, -0.3f, 0.2f),
+            XMMatrixScaling(-1.0f, 1.0f, 1.0f) * XMMatrixTranslation(0.1f, 0.2f, 0.0f),
+        };
+
+        std::vector<XMFLOAT4X4> transforms(matrices.size());
+        for(size_t i = 0; i < matrices.size(); i++)
+            XMStoreFloat4x4(&transforms[i], matrices[i]);
+        return transforms;
+    }
+
+    struct TestView
+    {
+        XMFLOAT4X4 ViewProj;
+        XMFLOAT3 Position;
+        ClusterCullingView CullingView;
+    };
+
+    // Cameras around the mesh, some close enough for the frustum to clip it
+    std::vector<TestView> MakeViews(uint32_t count)
+    {
+        std::mt19937 random(14);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> distance(1.5f, 6.0f);
+
+        std::vector<TestView> views;
+        for(uint32_t i = 0; i < count; i++)
+        {
+            XMVECTOR direction = XMVector3Normalize(XMVectorSet(unit(random), unit(random), unit(random), 0.0f));
+            XMVECTOR position = XMVectorScale(direction, distance(random));
+            XMVECTOR target = XMVectorSet(unit(random) * 0.8f, unit(random) * 0.8f, unit(random) * 0.8f, 1.0f);
+            XMMATRIX viewProj = XMMatrixLookAtLH(position, target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)) * XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 100.0f);
+
+            TestView view;
+            XMStoreFloat4x4(&view.ViewProj, viewProj);
+            XMStoreFloat3(&view.Position, position);
+            view.CullingView = ClusterCulling::MakeView(viewProj, view.Position);
+            views.push_back(view);
+        }
+        return views;
+    }
+
+    enum class Expected { Visible, Culled, Either };
+
+    // Scalar double precision version of ClusterCulling::Cull for one meshlet
+    Expected CullReference(const MeshletCullingData& data, uint32_t i, const XMFLOAT4X4& world, const ClusterCullingView& view)
+    {
+        const double m[4][3] = {
+            { world._11, world._12, world._13 }, { world._21, world._22, world._23 }, { world._31, world._32, world._33 }, { world._41, world._42, world._43 } };
+        double scales[3];
+        for(int row = 0; row < 3; row++)
+            scales[row] = std::sqrt(m[row][0] * m[row][0] + m[row][1] * m[row][1] + m[row][2] * m[row][2]);
+        double maxScale = (std::max)(scales[0], (std::max)(scales[1], scales[2]));
+        double minScale = (std::min)(scales[0], (std::min)(scales[1], scales[2]));
+        double determinant = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+        bool coneCulling = determinant > 0.0 && maxScale - minScale <= maxScale * 1e-3;
+
+        double local[3] = { data.CenterX[i], data.CenterY[i], data.CenterZ[i] };
+        double center[3];
+        for(int axis = 0; axis < 3; axis++)
+            center[axis] = local[0] * m[0][axis] + local[1] * m[1][axis] + local[2] * m[2][axis] + m[3][axis];
+        double radius = data.Radius[i] * maxScale;
+
+        bool ambiguous = false;
+        for(const XMFLOAT4& plane : view.FrustumPlanes)
+        {
+            double distance = plane.x * center[0] + plane.y * center[1] + plane.z * center[2] + plane.w + radius;
+            if(distance < -CullTolerance)
+                return Expected::Culled;
+            ambiguous |= distance <= CullTolerance;
+        }
+
+        if(coneCulling)
+        {
+            double localAxis[3] = { data.ConeAxisX[i], data.ConeAxisY[i], data.ConeAxisZ[i] };
+            double toCenter[3] = { center[0] - view.CameraPosition.x, center[1] - view.CameraPosition.y, center[2] - view.CameraPosition.z };
+            double axisDot = 0.0;
+            for(int axis = 0; axis < 3; axis++)
+                axisDot += toCenter[axis] * (localAxis[0] * m[0][axis] + localAxis[1] * m[1][axis] + localAxis[2] * m[2][axis]) / maxScale;
+            double distance = std::sqrt(toCenter[0] * toCenter[0] + toCenter[1] * toCenter[1] + toCenter[2] * toCenter[2]);
+            double margin = axisDot - (data.ConeCutoff[i] * distance + radius);
+            if(margin > CullTolerance)
+                return Expected::Culled;
+            ambiguous |= margin >= -CullTolerance;
+        }
+
+        return ambiguous ? Expected::Either : Expected::Visible;
+    }
+
+    // Culling data of the first count meshlets
+    MeshletCullingData BuildCullingData(const std::vector<Meshlet>& meshlets, uint32_t count)
+    {
+        return MeshletBuilder::BuildCullingData(std::vector<Meshlet>(meshlets.begin(), meshlets.begin() + count));
+    }
+}
+
+TEST(Meshlet_LimitsAndCoverage)
+{
+    for(const MeshletMesh& mesh : MakeMeshes())
+    {
+        CHECK(!mesh.Meshlets.empty());
+
+        std::vector<uint32_t> vertexMeshlet(mesh.Positions.size(), UINT32_MAX);
+        uint32_t nextIndex = 0;
+        for(uint32_t m = 0; m < mesh.Meshlets.size(); m++)
+        {
+            const Meshlet& meshlet = mesh.Meshlets[m];
+
+            // Contiguous ranges covering the whole index buffer
+            CHECK(meshlet.IndexOffset == nextIndex);
+            CHECK(meshlet.TriangleCount > 0 && meshlet.TriangleCount <= MESHLET_MAX_TRIANGLES);
+            nextIndex += meshlet.TriangleCount * 3;
+
+            uint32_t vertexCount = 0;
+            XMVECTOR center = XMLoadFloat3(&meshlet.Center);
+            XMVECTOR axis = XMLoadFloat3(&meshlet.ConeAxis);
+            float minDot = std::sqrt((std::max)(0.0f, 1.0f - meshlet.ConeCutoff * meshlet.ConeCutoff));
+            for(uint32_t i = meshlet.IndexOffset; i < meshlet.IndexOffset + meshlet.TriangleCount * 3 && i < mesh.Indices.size(); i++)
+            {
+                uint32_t vertex = mesh.Indices[i];
+                if(vertexMeshlet[vertex] != m)
+                {
+                    vertexMeshlet[vertex] = m;
+                    vertexCount++;
+                }
+                CHECK(XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&mesh.Positions[vertex]), center))) <= meshlet.Radius * 1.0001f + 1e-6f);
+
+                // Every triangle normal inside the cone
+                if((i - meshlet.IndexOffset) % 3 == 0 && meshlet.ConeCutoff < 1.0f)
+                {
+                    XMVECTOR p0 = XMLoadFloat3(&mesh.Positions[mesh.Indices[i]]);
+                    XMVECTOR normal = XMVector3Cross(XMVectorSubtract(XMLoadFloat3(&mesh.Positions[mesh.Indices[i + 1]]), p0), XMVectorSubtract(XMLoadFloat3(&mesh.Positions[mesh.Indices[i + 2]]), p0));
+                    if(XMVectorGetX(XMVector3LengthSq(normal)) > 0.0f)
+                        CHECK(XMVectorGetX(XMVector3Dot(XMVector3Normalize(normal), axis)) >= minDot - 1e-4f);
+                }
+            }
+            CHECK(meshlet.VertexCount == vertexCount);
+            CHECK(vertexCount <= MESHLET_MAX_VERTICES);
+        }
+        CHECK(nextIndex == mesh.Indices.size());
+    }
+}
+
+TEST(Meshlet_CullMatchesScalarReference)
+{
+    std::vector<MeshletMesh> meshes = MakeMeshes();
+    std::vector<XMFLOAT4X4> transforms = MakeTransforms();
+    std::vector<TestView> views = MakeViews(40);
+
+    uint32_t visibleCount = 0;
+    uint32_t culledCount = 0;
+    for(const MeshletMesh& mesh : meshes)
+    {
+        uint32_t totalCount = (uint32_t)mesh.Meshlets.size();
+        for(uint32_t count : { 1u, 2u, 3u, 5u, 6u, 7u, totalCount })
+        {
+            if(count > totalCount)
+                continue;
+
+            MeshletCullingData data = BuildCullingData(mesh.Meshlets, count);
+            // Padding lanes made visible from anywhere, they must still never be reported
+            for(size_t lane = count; lane < data.Radius.size(); lane++)
+                data.Radius[lane] = 1e6f;
+
+            std::vector<uint32_t> visibleMeshlets(count);
+            for(const XMFLOAT4X4& world : transforms)
+            {
+                for(const TestView& view : views)
+                {
+                    uint32_t reportedCount = ClusterCulling::Cull(data, world, view.CullingView, visibleMeshlets.data());
+                    CHECK(reportedCount <= count);
+
+                    std::vector<bool> reported(count, false);
+                    for(uint32_t i = 0; i < reportedCount; i++)
+                    {
+                        CHECK(visibleMeshlets[i] < count);
+                        CHECK(i == 0 || visibleMeshlets[i] > visibleMeshlets[i - 1]);
+                        if(visibleMeshlets[i] < count)
+                            reported[visibleMeshlets[i]] = true;
+                    }
+
+                    for(uint32_t i = 0; i < count; i++)
+                    {
+                        Expected expected = CullReference(data, i, world, view.CullingView);
+                        if(expected == Expected::Visible)
+                            CHECK(reported[i]);
+                        else if(expected == Expected::Culled)
+                            CHECK(!reported[i]);
+                        visibleCount += expected == Expected::Visible ? 1 : 0;
+                        culledCount += expected == Expected::Culled ? 1 : 0;
+                    }
+                }
+            }
+        }
+    }
+
+    // Both outcomes must be exercised
+    CHECK(visibleCount > 1000 && culledCount > 1000);
+}
+
+TEST(Meshlet_NoFalseCull)
+{
+    std::vector<MeshletMesh> meshes = MakeMeshes();
+    std::vector<XMFLOAT4X4> transforms = MakeTransforms();
+    std::vector<TestView> views = MakeViews(40);
+
+    uint32_t frontCount = 0;
+    uint32_t skippedCount = 0;
+    for(const MeshletMesh& mesh : meshes)
+    {
+        MeshletCullingData data = MeshletBuilder::BuildCullingData(mesh.Meshlets);
+        std::vector<uint32_t> triangleMeshlets;
+        for(uint32_t m = 0; m < mesh.Meshlets.size(); m++)
+            triangleMeshlets.insert(triangleMeshlets.end(), mesh.Meshlets[m].TriangleCount, m);
+
+        std::vector<uint32_t> visibleMeshlets(data.Count);
+        for(const XMFLOAT4X4& world : transforms)
+        {
+            XMMATRIX worldMatrix = XMLoadFloat4x4(&world);
+            std::vector<XMFLOAT3> worldPositions(mesh.Positions.size());
+            for(size_t i = 0; i < mesh.Positions.size(); i++)
+                XMStoreFloat3(&worldPositions[i], XMVector3TransformCoord(XMLoadFloat3(&mesh.Positions[i]), worldMatrix));
+
+            for(const TestView& view : views)
+            {
+                std::vector<bool> reported(data.Count, false);
+                uint32_t reportedCount = ClusterCulling::Cull(data, world, view.CullingView, visibleMeshlets.data());
+                for(uint32_t i = 0; i < reportedCount; i++)
+                    reported[visibleMeshlets[i]] = true;
+
+                XMMATRIX viewProj = XMLoadFloat4x4(&view.ViewProj);
+                XMVECTOR camera = XMLoadFloat3(&view.Position);
+                for(uint32_t t = 0; t < triangleMeshlets.size(); t++)
+                {
+                    XMVECTOR p[3];
+                    bool inside = false;
+                    for(int corner = 0; corner < 3; corner++)
+                    {
+                        p[corner] = XMLoadFloat3(&worldPositions[mesh.Indices[t * 3 + corner]]);
+                        XMFLOAT4 clip;
+                        XMStoreFloat4(&clip, XMVector4Transform(XMVectorSetW(p[corner], 1.0f), viewProj));
+                        inside |= clip.w > 0.0f && std::fabs(clip.x) < clip.w && std::fabs(clip.y) < clip.w && clip.z > 0.0f && clip.z < clip.w;
+                    }
+                    if(!inside)
+                        continue;
+
+                    // Clockwise front faces, the winding flips with mirrored transforms
+                    XMVECTOR normal = XMVector3Cross(XMVectorSubtract(p[1], p[0]), XMVectorSubtract(p[2], p[0]));
+                    float facing = XMVectorGetX(XMVector3Dot(normal, XMVectorSubtract(camera, p[0])));
+                    if(XMVectorGetX(XMMatrixDeterminant(worldMatrix)) < 0.0f)
+                        facing = -facing;
+                    if(facing <= 0.0f)
+                    {
+                        skippedCount++;
+                        continue;
+                    }
+
+                    CHECK(reported[triangleMeshlets[t]]);
+                    frontCount++;
+                }
+            }
+        }
+    }
+
+    CHECK(frontCount > 10000 && skippedCount > 10000);
+}
@@ -0,0 +1,425 @@
+﻿#include <algorithm>
+#include <random>
+
+#include "JobSystem.h"
+#include "Rendering/OcclusionCulling.h"
+#include "TestFramework.h"
+
+using namespace DirectX;
+
+namespace
+{
+    const uint32_t PixelCount = OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT;
+
+    // Outward faces counter clockwise on screen, what MaskedOcclusionBuffer rasterizes without backFaces
+    OccluderMesh MakeCube()
+    {
+        OccluderMesh mesh;
+        for(uint32_t i = 0; i < 8; i++)
+            mesh.Positions.push_back({ (i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f });
+
+        const uint32_t faces[6][4] = { { 0, 1, 3, 2 }, { 4, 6, 7, 5 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 }, { 0, 2, 6, 4 }, { 1, 5, 7, 3 } };
+        for(const auto& face : faces)
+            mesh.Indices.insert(mesh.Indices.end(), { face[0], face[1], face[2], face[0], face[2], face[3] });
+
+        return mesh;
+    }
+
+    OccluderMesh MakeSphere(uint32_t segmentCount)
+    {
+        OccluderMesh mesh;
+        for(uint32_t j = 0; j <= segmentCount; j++)
+        {
+            for(uint32_t i = 0; i <= segmentCount * 2; i++)
+            {
+                float theta = XM_PI * j / segmentCount;
+                float phi = XM_PI * i / segmentCount;
+                mesh.Positions.push_back({ std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) });
+            }
+        }
+
+        uint32_t rowSize = segmentCount * 2 + 1;
+        for(uint32_t j = 0; j < segmentCount; j++)
+        {
+            for(uint32_t i = 0; i < segmentCount * 2; i++)
+            {
+                uint32_t a = j * rowSize + i;
+                uint32_t c = a + rowSize;
+                mesh.Indices.insert(mesh.Indices.end(), { a, a + 1, c, a + 1, c + 1, c });
+            }
+        }
+
+        return mesh;
+    }
+
+    OccluderMesh FlipWinding(OccluderMesh mesh)
+    {
+        for(size_t i = 0; i < mesh.Indices.size(); i += 3)
+            std::swap(mesh.Indices[i + 1], mesh.Indices[i + 2]);
+        return mesh;
+    }
+
+    // Exact per pixel nearest depth at the pixel centers, homogeneous rasterization (Olano and Greer) so nothing is clipped
+    void RasterizeReference(const OccluderMesh& mesh, const XMFLOAT4X4& world, FXMMATRIX viewProj, bool backFaces, float* depth)
+    {
+        XMMATRIX worldViewProj = XMLoadFloat4x4(&world) * viewProj;
+
+        for(size_t i = 0; i < mesh.Indices.size(); i += 3)
+        {
+            XMFLOAT4 clip[3];
+            for(uint32_t k = 0; k < 3; k++)
+                XMStoreFloat4(&clip[k], XMVector3Transform(XMLoadFloat3(&mesh.Positions[mesh.Indices[i + k]]), worldViewProj));
+
+            double m[3][3];
+            for(uint32_t k = 0; k < 3; k++)
+            {
+                m[k][0] = clip[k].x;
+                m[k][1] = clip[k].y;
+                m[k][2] = clip[k].w;
+            }
+
+            double determinant = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+                + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+            if(std::fabs(determinant) < 1e-12)
+                continue;
+
+            // Counter clockwise on screen, y points down
+            bool counterClockwise = determinant > 0.0;
+            if(counterClockwise == backFaces)
+                continue;
+
+            double inverse[3][3];
+            for(uint32_t row = 0; row < 3; row++)
+            {
+                for(uint32_t column = 0; column < 3; column++)
+                {
+                    uint32_t i1 = (column + 1) % 3, i2 = (column + 2) % 3, j1 = (row + 1) % 3, j2 = (row + 2) % 3;
+                    inverse[row][column] = (m[i1][j1] * m[i2][j2] - m[i1][j2] * m[i2][j1]) / determinant;
+                }
+            }
+
+            // Screen bounds when the triangle is in front of the eye, else every pixel
+            uint32_t minX = 0, minY = 0, maxX = OCCLUSION_BUFFER_WIDTH, maxY = OCCLUSION_BUFFER_HEIGHT;
+            if(clip[0].w > 0.0f && clip[1].w > 0.0f && clip[2].w > 0.0f)
+            {
+                float left = FLT_MAX, right = -FLT_MAX, top = FLT_MAX, bottom = -FLT_MAX;
+                for(const XMFLOAT4& vertex : clip)
+                {
+                    float screenX = (vertex.x / vertex.w * 0.5f + 0.5f) * OCCLUSION_BUFFER_WIDTH;
+                    float screenY = (0.5f - vertex.y / vertex.w * 0.5f) * OCCLUSION_BUFFER_HEIGHT;
+                    left = (std::min)(left, screenX);
+                    right = (std::max)(right, screenX);
+                    top = (std::min)(top, screenY);
+                    bottom = (std::max)(bottom, screenY);
+                }
+
+                minX = (uint32_t)std::clamp(std::floor(left), 0.0f, (float)OCCLUSION_BUFFER_WIDTH);
+                maxX = (uint32_t)std::clamp(std::ceil(right) + 1.0f, 0.0f, (float)OCCLUSION_BUFFER_WIDTH);
+                minY = (uint32_t)std::clamp(std::floor(top), 0.0f, (float)OCCLUSION_BUFFER_HEIGHT);
+                maxY = (uint32_t)std::clamp(std::ceil(bottom) + 1.0f, 0.0f, (float)OCCLUSION_BUFFER_HEIGHT);
+            }
+
+            for(uint32_t y = minY; y < maxY; y++)
+            {
+                for(uint32_t x = minX; x < maxX; x++)
+                {
+                    float ndcX = (x + 0.5f) / OCCLUSION_BUFFER_WIDTH * 2.0f - 1.0f;
+                    float ndcY = 1.0f - (y + 0.5f) / OCCLUSION_BUFFER_HEIGHT * 2.0f;
+
+                    // Edge functions, they sum to 1 / w
+                    double edges[3];
+                    for(uint32_t k = 0; k < 3; k++)
+                        edges[k] = ndcX * inverse[0][k] + ndcY * inverse[1][k] + inverse[2][k];
+                    if(edges[0] < 0.0 || edges[1] < 0.0 || edges[2] < 0.0 || edges[0] + edges[1] + edges[2] <= 0.0)
+                        continue;
+
+                    float z = (float)(edges[0] * clip[0].z + edges[1] * clip[1].z + edges[2] * clip[2].z);
+                    if(z >= 0.0f && z < depth[y * OCCLUSION_BUFFER_WIDTH + x])
+                        depth[y * OCCLUSION_BUFFER_WIDTH + x] = z;
+                }
+            }
+        }
+    }
+
+    struct OcclusionScene
+    {
+        XMFLOAT4X4 ViewProj;
+        bool BackFaces;
+        std::vector<const OccluderMesh*> Meshes;
+        std::vector<XMFLOAT4X4> Worlds;
+    };
+
+    // Random cubes and spheres, a perspective camera and every fourth scene an orthographic shadow view
+    std::vector<OcclusionScene> MakeScenes(const OccluderMesh* meshes[2][2], uint32_t sceneCount)
+    {
+        std::mt19937 random(7);
+        std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+        XMMATRIX cameraViewProj = XMMatrixLookAtLH(XMVectorSet(0.0f, 5.0f, -30.0f, 0.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f))
+            * XMMatrixPerspectiveFovLH(1.0f, 16.0f / 9.0f, 1.0f, 1000.0f);
+        XMMATRIX lightViewProj = XMMatrixLookAtLH(XMVectorSet(30.0f, 30.0f, -10.0f, 0.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f))
+            * XMMatrixOrthographicOffCenterLH(-60.0f, 60.0f, -60.0f, 60.0f, 0.0f, 100.0f);
+
+        std::vector<OcclusionScene> scenes(sceneCount);
+        for(uint32_t sceneIdx = 0; sceneIdx < sceneCount; sceneIdx++)
+        {
+            OcclusionScene& scene = scenes[sceneIdx];
+            XMStoreFloat4x4(&scene.ViewProj, sceneIdx % 4 == 3 ? lightViewProj : cameraViewProj);
+            scene.BackFaces = sceneIdx % 2 == 1;
+
+            uint32_t occluderCount = 3 + sceneIdx % 10;
+            for(uint32_t i = 0; i < occluderCount; i++)
+            {
+                float scale = 1.0f + std::fabs(distribution(random)) * 4.0f;
+                float stretch = 1.0f + std::fabs(distribution(random)) * 2.0f;
+                XMMATRIX rotation = XMMatrixRotationRollPitchYaw(distribution(random) * 3.0f, distribution(random) * 3.0f, distribution(random) * 3.0f);
+                // Some scenes put occluders across the camera near plane
+                XMMATRIX translation = XMMatrixTranslation(distribution(random) * 15.0f, distribution(random) * 6.0f,
+                    distribution(random) * 15.0f + (sceneIdx % 5 == 0 ? -28.0f : 0.0f));
+
+                XMFLOAT4X4 world;
+                XMStoreFloat4x4(&world, XMMatrixScaling(scale * stretch, scale, scale) * rotation * translation);
+                scene.Worlds.push_back(world);
+                scene.Meshes.push_back(meshes[i % 2][scene.BackFaces ? 1 : 0]);
+            }
+        }
+
+        return scenes;
+    }
+
+    void RasterizeScene(const OcclusionScene& scene, MaskedOcclusionBuffer& buffer)
+    {
+        buffer.Clear(XMLoadFloat4x4(&scene.ViewProj), scene.BackFaces);
+        for(size_t i = 0; i < scene.Meshes.size(); i++)
+            buffer.AddOccluder(scene.Meshes[i], scene.Worlds[i]);
+        buffer.Rasterize();
+    }
+
+    struct OccluderMeshes
+    {
+        OccluderMesh Cube = MakeCube();
+        OccluderMesh Sphere = MakeSphere(8);
+        OccluderMesh CubeBack = FlipWinding(Cube);
+        OccluderMesh SphereBack = FlipWinding(Sphere);
+        // Shape, then front or back faces
+        const OccluderMesh* Meshes[2][2] = { { &Cube, &CubeBack }, { &Sphere, &SphereBack } };
+    };
+}
+
+TEST(OcclusionCulling_ResolveDepthGolden)
+{
+    // Quad facing the camera, covering a known rectangle at a constant depth
+    OccluderMesh quad;
+    quad.Positions = { { -1.0f, -1.0f, 0.0f }, { 1.0f, -1.0f, 0.0f }, { 1.0f, 1.0f, 0.0f }, { -1.0f, 1.0f, 0.0f } };
+    quad.Indices = { 0, 1, 2, 0, 2, 3 };
+
+    XMMATRIX viewProj = XMMatrixOrthographicOffCenterLH(-4.0f, 4.0f, -3.0f, 3.0f, 0.0f, 10.0f);
+    XMFLOAT4X4 world;
+    XMStoreFloat4x4(&world, XMMatrixTranslation(0.0f, 0.0f, 2.5f));
+
+    MaskedOcclusionBuffer buffer;
+    buffer.Clear(viewProj);
+    buffer.AddOccluder(&quad, world);
+    buffer.Rasterize();
+    CHECK(buffer.GetTriangleCount() == 2);
+
+    std::vector<float> depth(PixelCount);
+    buffer.ResolveDepth(depth.data());
+
+    // The quad spans the middle quarter of the width and third of the height, pixels on its edges are skipped
+    const float quadDepth = 0.25f;
+    bool insideMatches = true;
+    bool outsideFar = true;
+    for(uint32_t y = 0; y < OCCLUSION_BUFFER_HEIGHT; y++)
+    {
+        for(uint32_t x = 0; x < OCCLUSION_BUFFER_WIDTH; x++)
+        {
+            float pixelX = (x + 0.5f) / OCCLUSION_BUFFER_WIDTH * 8.0f - 4.0f;
+            float pixelY = 3.0f - (y + 0.5f) / OCCLUSION_BUFFER_HEIGHT * 6.0f;
+            float edgeDistance = (std::max)(std::fabs(pixelX), std::fabs(pixelY)) - 1.0f;
+
+            float value = depth[y * OCCLUSION_BUFFER_WIDTH + x];
+            if(edgeDistance < -0.05f)
+                insideMatches &= std::fabs(value - quadDepth) < 1e-5f;
+            else if(edgeDistance > 0.05f)
+                outsideFar &= value == 1.0f;
+        }
+    }
+    CHECK(insideMatches);
+    CHECK(outsideFar);
+
+    // Boxes behind the quad are hidden, in front or beside it they are not
+    CHECK(!buffer.IsVisible(XMVectorSet(0.0f, 0.0f, 5.0f, 1.0f), XMVectorSet(0.5f, 0.5f, 0.5f, 0.0f)));
+    CHECK(buffer.IsVisible(XMVectorSet(0.0f, 0.0f, 1.0f, 1.0f), XMVectorSet(0.5f, 0.5f, 0.5f, 0.0f)));
+    CHECK(buffer.IsVisible(XMVectorSet(2.0f, 0.0f, 5.0f, 1.0f), XMVectorSet(0.5f, 0.5f, 0.5f, 0.0f)));
+}
+
+TEST(OcclusionCulling_ResolveDepthIsConservative)
+{
+    OccluderMeshes meshes;
+    std::vector<OcclusionScene> scenes = MakeScenes(meshes.Meshes, 24);
+
+    std::vector<float> depth(PixelCount);
+    std::vector<float> referenceDepth(PixelCount);
+    uint32_t nearerCount = 0;
+    uint32_t coveredCount = 0;
+    uint32_t resolvedCount = 0;
+    for(const OcclusionScene& scene : scenes)
+    {
+        MaskedOcclusionBuffer buffer;
+        RasterizeScene(scene, buffer);
+        buffer.ResolveDepth(depth.data());
+
+        std::fill(referenceDepth.begin(), referenceDepth.end(), 1.0f);
+        for(size_t i = 0; i < scene.Meshes.size(); i++)
+            RasterizeReference(*scene.Meshes[i], scene.Worlds[i], XMLoadFloat4x4(&scene.ViewProj), scene.BackFaces, referenceDepth.data());
+
+        // Never nearer than the occluders, a box behind the resolved depth is behind the actual surfaces
+        for(uint32_t i = 0; i < PixelCount; i++)
+        {
+            nearerCount += depth[i] < referenceDepth[i] - 1e-5f ? 1 : 0;
+            coveredCount += referenceDepth[i] < 1.0f ? 1 : 0;
+            resolvedCount += referenceDepth[i] < 1.0f && depth[i] < 1.0f ? 1 : 0;
+        }
+    }
+
+    CHECK(nearerCount == 0);
+    // And still useful, most of the covered pixels get a depth
+    CHECK(resolvedCount > coveredCount / 10 * 9);
+}
+
+TEST(OcclusionCulling_SameDepthWithoutJobSystem)
+{
+    OccluderMeshes meshes;
+    std::vector<OcclusionScene> scenes = MakeScenes(meshes.Meshes, 8);
+
+    std::vector<std::vector<float>> depths(scenes.size(), std::vector<float>(PixelCount));
+    for(size_t i = 0; i < scenes.size(); i++)
+    {
+        MaskedOcclusionBuffer buffer;
+        RasterizeScene(scenes[i], buffer);
+        buffer.ResolveDepth(depths[i].data());
+    }
+
+    JobSystem::Release();
+
+    bool isSame = true;
+    std::vector<float> depth(PixelCount);
+    for(size_t i = 0; i < scenes.size(); i++)
+    {
+        MaskedOcclusionBuffer buffer;
+        RasterizeScene(scenes[i], buffer);
+        buffer.ResolveDepth(depth.data());
+        isSame &= depth == depths[i];
+    }
+
+    JobSystem::Create(TestRegistry::GetWorkerCount());
+    CHECK(isSame);
+}
+
+TEST(OcclusionCulling_NoFalseCulls)
+{
+    OccluderMeshes meshes;
+    std::vector<OcclusionScene> scenes = MakeScenes(meshes.Meshes, 24);
+
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+    std::vector<float> referenceDepth(PixelCount);
+    uint32_t falseCullCount = 0;
+    uint32_t culledCount = 0;
+    for(const OcclusionScene& scene : scenes)
+    {
+        MaskedOcclusionBuffer buffer;
+        RasterizeScene(scene, buffer);
+
+        XMMATRIX viewProj = XMLoadFloat4x4(&scene.ViewProj);
+        std::fill(referenceDepth.begin(), referenceDepth.end(), 1.0f);
+        for(size_t i = 0; i < scene.Meshes.size(); i++)
+            RasterizeReference(*scene.Meshes[i], scene.Worlds[i], viewProj, scene.BackFaces, referenceDepth.data());
+
+        for(uint32_t boxIdx = 0; boxIdx < 500; boxIdx++)
+        {
+            XMVECTOR center = XMVectorSet(distribution(random) * 25.0f, distribution(random) * 8.0f, distribution(random) * 25.0f, 1.0f);
+            XMVECTOR extent = XMVectorSet(0.2f + std::fabs(distribution(random)), 0.2f + std::fabs(distribution(random)), 0.2f + std::fabs(distribution(random)), 0.0f);
+            if(buffer.IsVisible(center, extent))
+                continue;
+
+            culledCount++;
+
+            // Hidden only when its screen rectangle is behind the reference depth at its nearest point
+            XMFLOAT3 boxMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+            XMFLOAT3 boxMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+            bool crossesNear = false;
+            for(uint32_t corner = 0; corner < 8; corner++)
+            {
+                XMVECTOR sign = XMVectorSet(corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, corner & 4 ? 1.0f : -1.0f, 0.0f);
+                XMFLOAT4 clip;
+                XMStoreFloat4(&clip, XMVector4Transform(XMVectorMultiplyAdd(extent, sign, center), viewProj));
+                crossesNear |= clip.z < 0.0f;
+
+                XMFLOAT3 ndc(clip.x / clip.w, clip.y / clip.w, clip.z / clip.w);
+                boxMin = XMFLOAT3((std::min)(boxMin.x, ndc.x), (std::min)(boxMin.y, ndc.y), (std::min)(boxMin.z, ndc.z));
+                boxMax = XMFLOAT3((std::max)(boxMax.x, ndc.x), (std::max)(boxMax.y, ndc.y), (std::max)(boxMax.z, ndc.z));
+            }
+
+            bool isHidden = !crossesNear;
+            int x0 = (std::max)(0, (int)std::floor((boxMin.x * 0.5f + 0.5f) * OCCLUSION_BUFFER_WIDTH));
+            int x1 = (std::min)(OCCLUSION_BUFFER_WIDTH, (int)std::ceil((boxMax.x * 0.5f + 0.5f) * OCCLUSION_BUFFER_WIDTH));
+            int y0 = (std::max)(0, (int)std::floor((0.5f - boxMax.y * 0.5f) * OCCLUSION_BUFFER_HEIGHT));
+            int y1 = (std::min)(OCCLUSION_BUFFER_HEIGHT, (int)std::ceil((0.5f - boxMin.y * 0.5f) * OCCLUSION_BUFFER_HEIGHT));
+            for(int y = y0; y < y1 && isHidden; y++)
+            {
+                for(int x = x0; x < x1 && isHidden; x++)
+                    isHidden = referenceDepth[y * OCCLUSION_BUFFER_WIDTH + x] <= boxMin.z;
+            }
+
+            falseCullCount += isHidden ? 0 : 1;
+        }
+    }
+
+    CHECK(falseCullCount == 0);
+    CHECK(culledCount > 0);
+}
+
+BENCHMARK(OcclusionCulling_RasterizeAndCull)
+{
+    XMMATRIX viewProj = XMMatrixLookAtLH(XMVectorSet(0.0f, 5.0f, -30.0f, 0.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f))
+        * XMMatrixPerspectiveFovLH(1.0f, 16.0f / 9.0f, 1.0f, 1000.0f);
+
+    OccluderMesh sphere = MakeSphere(11);
+    std::vector<XMFLOAT4X4> worlds(OCCLUSION_MAX_OCCLUDERS);
+    for(uint32_t i = 0; i < OCCLUSION_MAX_OCCLUDERS; i++)
+        XMStoreFloat4x4(&worlds[i], XMMatrixScaling(2.0f, 2.0f, 2.0f) * XMMatrixTranslation((i % 8 - 4.0f) * 5.0f, 0.0f, (i / 8) * 5.0f));
+
+    MaskedOcclusionBuffer buffer;
+    double rasterizeMs = MeasureMilliseconds(20, [&]
+    {
+        buffer.Clear(viewProj);
+        for(const XMFLOAT4X4& world : worlds)
+            buffer.AddOccluder(&sphere, world);
+        buffer.Rasterize();
+    });
+
+    const uint32_t instanceCount = 100000;
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    InstanceBounds bounds;
+    bounds.Resize(instanceCount);
+    for(uint32_t i = 0; i < instanceCount; i++)
+    {
+        XMVECTOR center = XMVectorSet(distribution(random) * 25.0f, distribution(random) * 3.0f, 10.0f + std::fabs(distribution(random)) * 60.0f, 1.0f);
+        bounds.Set(i, center, XMVectorSet(0.5f, 0.5f, 0.5f, 0.0f));
+    }
+
+    std::vector<uint8_t> visibility(instanceCount);
+    uint32_t occludedCount = 0;
+    double cullMs = MeasureMilliseconds(10, [&]
+    {
+        std::fill(visibility.begin(), visibility.end(), 1);
+        occludedCount = buffer.Cull(bounds, 0, instanceCount, 1, visibility.data());
+    });
+
+    printf("    rasterize %u occluders of %u triangles %.3f ms, cull %u boxes %.3f ms, %u occluded\n",
+        OCCLUSION_MAX_OCCLUDERS, (uint32_t)sphere.Indices.size() / 3, rasterizeMs, instanceCount, cullMs, occludedCount);
+}
@@ -0,0 +1,175 @@
+﻿#include <fstream>
+#include <sstream>
+
+#include "Profiler.h"
+#include "TestFramework.h"
+
+namespace
+{
+    const char* OuterName = "ProfilerTests Outer";
+    const char* InnerName = "ProfilerTests Inner";
+
+    void InitializeOnce()
+    {
+        static bool initialized = false;
+        if(!initialized)
+        {
+            Profiler::Initialize();
+            initialized = true;
+        }
+    }
+
+    const ProfileEvent* FindEvent(const std::vector<ProfileThreadEvents>& threads, const char* name)
+    {
+        for(const auto& thread : threads)
+        {
+            for(const auto& event : thread.Events)
+            {
+                if(event.Name == name)
+                    return &event;
+            }
+        }
+        return nullptr;
+    }
+}
+
+TEST(Profiler_NestedScopes)
+{
+    InitializeOnce();
+
+    Profiler::BeginFrame();
+    {
+        ProfileScope outer(OuterName);
+        for(uint32_t i = 0; i < 3; i++)
+        {
+            ProfileScope inner(InnerName);
+        }
+    }
+    Profiler::BeginFrame();
+
+    std::vector<ProfileThreadEvents> threads;
+    uint64_t frameBegin = 0;
+    uint64_t frameEnd = 0;
+    CHECK(Profiler::GetLastFrame(threads, frameBegin, frameEnd));
+
+    const ProfileEvent* outer = FindEvent(threads, OuterName);
+    const ProfileEvent* inner = FindEvent(threads, InnerName);
+    CHECK(outer && inner);
+    if(!outer || !inner)
+        return;
+
+    // Inner scopes are recorded one level deeper, inside the outer one and inside the frame
+    uint32_t innerCount = 0;
+    for(const auto& thread : threads)
+    {
+        for(const auto& event : thread.Events)
+        {
+            if(event.Name != InnerName)
+                continue;
+            CHECK(event.Depth == outer->Depth + 1);
+            CHECK(event.Begin >= outer->Begin && event.End <= outer->End);
+            innerCount++;
+        }
+    }
+    CHECK(innerCount == 3);
+    CHECK(outer->Begin >= frameBegin && outer->End <= frameEnd);
+
+    // Scopes after the frame marker belong to the next frame
+    {
+        ProfileScope late("ProfilerTests Late");
+    }
+    CHECK(Profiler::GetLastFrame(threads, frameBegin, frameEnd));
+    CHECK(FindEvent(threads, "ProfilerTests Late") == nullptr);
+}
+
+TEST(Profiler_RingKeepsNewestEvents)
+{
+    InitializeOnce();
+
+    // Overflowing the ring drops the oldest events, never the newest
+    Profiler::BeginFrame();
+    for(uint32_t i = 0; i < PROFILER_EVENTS_PER_THREAD + 100; i++)
+    {
+        ProfileScope scope(i < 100 ? OuterName : InnerName);
+    }
+    Profiler::BeginFrame();
+
+    std::vector<ProfileThreadEvents> threads;
+    uint64_t frameBegin = 0;
+    uint64_t frameEnd = 0;
+    CHECK(Profiler::GetLastFrame(threads, frameBegin, frameEnd));
+    CHECK(FindEvent(threads, OuterName) == nullptr);
+
+    size_t innerCount = 0;
+    for(const auto& thread : threads)
+    {
+        for(const auto& event : thread.Events)
+            innerCount += event.Name == InnerName ? 1 : 0;
+    }
+    CHECK(innerCount == PROFILER_EVENTS_PER_THREAD);
+}
+
+TEST(Profiler_ExportChromeTrace)
+{
+    InitializeOnce();
+
+    Profiler::BeginFrame();
+    {
+        ProfileScope scope("ProfilerTests \"Quoted\"");
+    }
+    Profiler::BeginFrame();
+
+    const char* filePath = "ProfilerTests.json";
+    Profiler::ExportChromeTrace(filePath);
+
+    std::ifstream file(filePath);
+    CHECK(file.is_open());
+    std::stringstream content;
+    content << file.rdbuf();
+    file.close();
+    std::remove(filePath);
+
+    std::string trace = content.str();
+    CHECK(trace.rfind("{\"traceEvents\":[", 0) == 0);
+    CHECK(trace.find("\"name\":\"ProfilerTests \\\"Quoted\\\"\",\"ph\":\"X\"") != std::string::npos);
+    CHECK(trace.find("\"ph\":\"M\"") != std::string::npos);
+    CHECK(trace.find("\"ph\":\"i\"") != std::string::npos);
+    CHECK(trace.find("\n]}\n") == trace.size() - 4);
+}
+
+BENCHMARK(Profiler_ScopeOverhead)
+{
+    InitializeOnce();
+
+    // Back to back BeginScope / EndScope pairs, the cost every PROFILE_SCOPE adds
+    const uint32_t scopeCount = 1000000;
+    double scopeMs = MeasureMilliseconds(5, [&]
+    {
+        for(uint32_t i = 0; i < scopeCount; i++)
+        {
+            Profiler::BeginScope();
+            Profiler::EndScope(OuterName, Profiler::Now());
+        }
+    });
+
+    // Nested inside an outer scope, as in a real frame
+    double nestedMs = MeasureMilliseconds(5, [&]
+    {
+        ProfileScope outer(OuterName);
+        for(uint32_t i = 0; i < scopeCount; i++)
+        {
+            ProfileScope inner(InnerName);
+        }
+    });
+
+    double emptyMs = MeasureMilliseconds(5, [&]
+    {
+        uint64_t sum = 0;
+        for(uint32_t i = 0; i < scopeCount; i++)
+            sum += Profiler::Now();
+        DoNotOptimize(sum);
+    });
+
+    printf("    %.1f ns per scope, %.1f ns nested (50 ns budget), %.1f ns per timestamp, %.1f ns calibrated at startup\n",
+        scopeMs * 1000000.0 / scopeCount, nestedMs * 1000000.0 / scopeCount, emptyMs * 1000000.0 / scopeCount, Profiler::GetScopeOverheadNs());
+}
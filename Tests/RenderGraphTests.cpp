@@ -0,0 +1,515 @@
+﻿#include <algorithm>
+#include <array>
+#include <cstring>
+#include <random>
+
+#include "Rendering/RenderGraph.h"
+#include "TestFramework.h"
+
+namespace
+{
+    const D3D12_RESOURCE_STATES RenderTarget = D3D12_RESOURCE_STATE_RENDER_TARGET;
+    const D3D12_RESOURCE_STATES PixelShader = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+    const D3D12_RESOURCE_STATES NonPixelShader = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+    const D3D12_RESOURCE_STATES DepthWrite = D3D12_RESOURCE_STATE_DEPTH_WRITE;
+    const D3D12_RESOURCE_STATES DepthRead = D3D12_RESOURCE_STATE_DEPTH_READ;
+    const D3D12_RESOURCE_STATES UnorderedAccess = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    const D3D12_RESOURCE_STATES WriteStates = RenderTarget | DepthWrite | UnorderedAccess;
+    constexpr uint64_t TransientAlignment = 65536;
+
+    RenderGraphTextureDesc MakeDesc(uint64_t size)
+    {
+        RenderGraphTextureDesc desc;
+        desc.Size = size;
+        desc.Alignment = TransientAlignment;
+        return desc;
+    }
+
+    // Records the declared accesses next to the graph to check the compile results against them
+    struct GraphRecorder
+    {
+        struct Access
+        {
+            uint32_t Pass;
+            uint32_t Resource;
+            D3D12_RESOURCE_STATES State;
+            bool Write;
+        };
+
+        RenderGraph Graph;
+        std::vector<Access> Accesses;
+        std::vector<D3D12_RESOURCE_STATES> InitialStates;
+
+        uint32_t Import(D3D12_RESOURCE_STATES state)
+        {
+            InitialStates.push_back(state);
+            return Graph.ImportTexture("Imported", nullptr, state);
+        }
+
+        uint32_t Create(uint64_t size)
+        {
+            InitialStates.push_back(D3D12_RESOURCE_STATE_COMMON);
+            return Graph.CreateTexture("Transient", MakeDesc(size));
+        }
+
+        void Read(uint32_t pass, uint32_t resource, D3D12_RESOURCE_STATES state)
+        {
+            Graph.Read(pass, resource, state);
+            Accesses.push_back({ pass, resource, state, false });
+        }
+
+        void Write(uint32_t pass, uint32_t resource, D3D12_RESOURCE_STATES state)
+        {
+            Graph.Write(pass, resource, state);
+            Accesses.push_back({ pass, resource, state, true });
+        }
+
+        void Reset()
+        {
+            Graph.Reset();
+            Accesses.clear();
+            InitialStates.clear();
+        }
+    };
+
+    // Dependent accesses land in increasing levels, replaying the barriers batch by batch puts every access in its state
+    // and transients alive in the same levels never share memory
+    void ValidateCompile(const GraphRecorder& recorder)
+    {
+        const RenderGraph& graph = recorder.Graph;
+        const std::vector<uint32_t>& order = graph.GetPassOrder();
+        const std::vector<RenderGraphBatch>& batches = graph.GetBatches();
+        const std::vector<RenderGraphBarrier>& barriers = graph.GetBarriers();
+
+        std::vector<uint32_t> passLevels(graph.GetPassCount(), RENDER_GRAPH_INVALID);
+        for(uint32_t batchIdx = 0; batchIdx < (uint32_t)batches.size(); batchIdx++)
+        {
+            for(uint32_t i = batches[batchIdx].FirstPass; i < batches[batchIdx].FirstPass + batches[batchIdx].PassCount; i++)
+                passLevels[order[i]] = batchIdx;
+        }
+
+        for(uint32_t pass = 0; pass < graph.GetPassCount(); pass++)
+            CHECK(graph.IsCulled(pass) == (passLevels[pass] == RENDER_GRAPH_INVALID));
+
+        bool isOrdered = true;
+        for(const auto& first : recorder.Accesses)
+        {
+            for(const auto& second : recorder.Accesses)
+            {
+                if(first.Pass >= second.Pass || first.Resource != second.Resource || (!first.Write && !second.Write))
+                    continue;
+                if(graph.IsCulled(first.Pass) || graph.IsCulled(second.Pass))
+                    continue;
+
+                isOrdered &= passLevels[first.Pass] < passLevels[second.Pass];
+            }
+        }
+        CHECK(isOrdered);
+
+        // Reads of a texture written by the same pass are feedback, their state is the write one
+        std::vector<bool> passWrites(graph.GetPassCount() * graph.GetResourceCount(), false);
+        for(const auto& access : recorder.Accesses)
+        {
+            if(access.Write)
+                passWrites[access.Pass * graph.GetResourceCount() + access.Resource] = true;
+        }
+
+        std::vector<D3D12_RESOURCE_STATES> states = recorder.InitialStates;
+        std::vector<bool> defined(graph.GetResourceCount());
+        for(uint32_t resource = 0; resource < graph.GetResourceCount(); resource++)
+            defined[resource] = !graph.IsTransient(resource);
+
+        bool barriersMatch = true;
+        bool accessesInState = true;
+        for(const RenderGraphBatch& batch : batches)
+        {
+            for(uint32_t i = batch.FirstBarrier; i < batch.FirstBarrier + batch.BarrierCount; i++)
+            {
+                const RenderGraphBarrier& barrier = barriers[i];
+                if(barrier.Type != RenderGraphBarrierType::Transition)
+                    continue;
+
+                if(defined[barrier.Resource])
+                    barriersMatch &= barrier.Before == states[barrier.Resource] && barrier.Before != barrier.After;
+                states[barrier.Resource] = barrier.After;
+                defined[barrier.Resource] = true;
+            }
+
+            for(uint32_t i = batch.FirstPass; i < batch.FirstPass + batch.PassCount; i++)
+            {
+                for(const auto& access : recorder.Accesses)
+                {
+                    if(access.Pass != order[i])
+                        continue;
+
+                    D3D12_RESOURCE_STATES state = states[access.Resource];
+                    if(access.Write)
+                        accessesInState &= state == access.State;
+                    else if(!passWrites[access.Pass * graph.GetResourceCount() + access.Resource])
+                        accessesInState &= state == access.State || ((state & access.State) == access.State && (state & WriteStates) == 0);
+                }
+            }
+        }
+        CHECK(barriersMatch);
+        CHECK(accessesInState);
+
+        // Split barriers begin right after the last batch using the resource, nothing uses it until they end
+        bool splitsValid = true;
+        for(uint32_t batchIdx = 0; batchIdx < (uint32_t)batches.size(); batchIdx++)
+        {
+            for(uint32_t i = batches[batchIdx].FirstBarrier; i < batches[batchIdx].FirstBarrier + batches[batchIdx].BarrierCount; i++)
+            {
+                const RenderGraphBarrier& barrier = barriers[i];
+                if(barrier.BeginBatch == RENDER_GRAPH_INVALID)
+                    continue;
+
+                bool usedInBeginBatch = false;
+                for(const auto& access : recorder.Accesses)
+                {
+                    if(access.Resource != barrier.Resource || graph.IsCulled(access.Pass))
+                        continue;
+
+                    uint32_t level = passLevels[access.Pass];
+                    usedInBeginBatch |= level == barrier.BeginBatch;
+                    splitsValid &= level <= barrier.BeginBatch || level >= batchIdx;
+                }
+                splitsValid &= usedInBeginBatch && barrier.BeginBatch + 1 < batchIdx;
+            }
+        }
+        CHECK(splitsValid);
+
+        std::vector<uint32_t> firstLevels(graph.GetResourceCount(), RENDER_GRAPH_INVALID);
+        std::vector<uint32_t> lastLevels(graph.GetResourceCount(), 0);
+        for(const auto& access : recorder.Accesses)
+        {
+            if(graph.IsCulled(access.Pass))
+                continue;
+
+            firstLevels[access.Resource] = (std::min)(firstLevels[access.Resource], passLevels[access.Pass]);
+            lastLevels[access.Resource] = (std::max)(lastLevels[access.Resource], passLevels[access.Pass]);
+        }
+
+        bool isPlacementValid = true;
+        for(uint32_t a = 0; a < graph.GetResourceCount(); a++)
+        {
+            if(!graph.IsTransient(a) || firstLevels[a] == RENDER_GRAPH_INVALID)
+                continue;
+
+            uint64_t offsetA = graph.GetTransientOffset(a);
+            uint64_t endA = offsetA + graph.GetTextureDesc(a).Size;
+            isPlacementValid &= offsetA % TransientAlignment == 0 && endA <= graph.GetStats().TransientHeapSize;
+
+            for(uint32_t b = a + 1; b < graph.GetResourceCount(); b++)
+            {
+                if(!graph.IsTransient(b) || firstLevels[b] == RENDER_GRAPH_INVALID)
+                    continue;
+
+                uint64_t offsetB = graph.GetTransientOffset(b);
+                bool memoryOverlaps = offsetA < offsetB + graph.GetTextureDesc(b).Size && offsetB < endA;
+                bool lifetimeOverlaps = firstLevels[a] <= lastLevels[b] && firstLevels[b] <= lastLevels[a];
+                isPlacementValid &= !(memoryOverlaps && lifetimeOverlaps);
+            }
+        }
+        CHECK(isPlacementValid);
+    }
+
+    // Mostly chains of nearby resources, a few imported outputs and side effect passes
+    void BuildRandomGraph(GraphRecorder& recorder, uint32_t passCount)
+    {
+        const D3D12_RESOURCE_STATES readStates[] = { PixelShader, NonPixelShader, PixelShader | NonPixelShader, DepthRead };
+        std::mt19937 random(passCount);
+
+        recorder.Reset();
+
+        uint32_t resourceCount = passCount;
+        uint32_t importedCount = passCount / 10;
+        for(uint32_t i = 0; i < importedCount; i++)
+            recorder.Import(PixelShader);
+        for(uint32_t i = importedCount; i < resourceCount; i++)
+            recorder.Create(TransientAlignment * (1 + random() % 64));
+        for(uint32_t i = 0; i < importedCount; i += 3)
+            recorder.Graph.MarkOutput(i, PixelShader);
+
+        for(uint32_t pass = 0; pass < passCount; pass++)
+        {
+            recorder.Graph.AddPass("Pass", [] {}, random() % 50 == 0);
+
+            uint32_t readCount = random() % 4;
+            uint32_t writeCount = 1 + random() % 2;
+            for(uint32_t i = 0; i < readCount; i++)
+            {
+                uint32_t resource = random() % resourceCount;
+                recorder.Read(pass, resource, readStates[random() % 4]);
+            }
+            for(uint32_t i = 0; i < writeCount; i++)
+            {
+                uint32_t resource = (pass * resourceCount / passCount + random() % 8 + i * 8) % resourceCount;
+                recorder.Write(pass, resource, random() % 3 == 0 ? UnorderedAccess : RenderTarget);
+            }
+        }
+    }
+}
+
+TEST(RenderGraph_DeferredFrame)
+{
+    GraphRecorder recorder;
+    RenderGraph& graph = recorder.Graph;
+
+    uint32_t backBuffer = recorder.Import(D3D12_RESOURCE_STATE_PRESENT);
+    uint32_t scene = recorder.Import(PixelShader);
+    uint32_t gbuffer = recorder.Import(PixelShader);
+    uint32_t depth = recorder.Import(PixelShader);
+    uint32_t shadowAtlas = recorder.Import(PixelShader);
+    uint32_t ssao = recorder.Create(1 << 20);
+    uint32_t unused = recorder.Create(1 << 20);
+    graph.MarkOutput(backBuffer, D3D12_RESOURCE_STATE_PRESENT);
+
+    uint32_t shadows = graph.AddPass("Shadows", [] {});
+    recorder.Write(shadows, shadowAtlas, DepthWrite);
+    uint32_t gbufferPass = graph.AddPass("GBuffer", [] {});
+    recorder.Write(gbufferPass, gbuffer, RenderTarget);
+    recorder.Write(gbufferPass, depth, DepthWrite);
+    uint32_t ssaoPass = graph.AddPass("SSAO", [] {});
+    recorder.Read(ssaoPass, depth, NonPixelShader);
+    recorder.Write(ssaoPass, ssao, UnorderedAccess);
+    uint32_t lighting = graph.AddPass("Lighting", [] {});
+    recorder.Read(lighting, gbuffer, PixelShader);
+    recorder.Read(lighting, depth, PixelShader);
+    recorder.Read(lighting, shadowAtlas, PixelShader);
+    recorder.Write(lighting, scene, RenderTarget);
+    uint32_t skyBox = graph.AddPass("SkyBox", [] {});
+    recorder.Read(skyBox, depth, DepthRead);
+    recorder.Write(skyBox, scene, RenderTarget);
+    uint32_t dead = graph.AddPass("Dead", [] {});
+    recorder.Read(dead, scene, PixelShader);
+    recorder.Write(dead, unused, RenderTarget);
+    uint32_t ui = graph.AddPass("UI", [] {}, true);
+    recorder.Read(ui, scene, PixelShader);
+    recorder.Read(ui, ssao, PixelShader);
+    recorder.Write(ui, backBuffer, RenderTarget);
+
+    graph.Compile();
+    ValidateCompile(recorder);
+
+    CHECK(graph.IsCulled(dead));
+    CHECK(!graph.IsCulled(shadows) && !graph.IsCulled(ssaoPass));
+    CHECK(graph.GetStats().PassCount == 6 && graph.GetStats().CulledPassCount == 1);
+    CHECK(graph.GetTransientOffset(unused) == RENDER_GRAPH_INVALID);
+
+    // Shadows, GBuffer : SSAO, Lighting : SkyBox : UI
+    CHECK(graph.GetBatches().size() == 5);
+    CHECK(graph.GetBatches()[0].PassCount == 2);
+    CHECK(graph.GetBatches()[1].PassCount == 2);
+
+    // The depth reads of SSAO, Lighting and SkyBox share one barrier to the combined states
+    uint32_t depthReadBarrierCount = 0;
+    for(const RenderGraphBarrier& barrier : graph.GetBarriers())
+    {
+        if(barrier.Resource == depth && barrier.After != DepthWrite)
+        {
+            depthReadBarrierCount++;
+            CHECK(barrier.After == (NonPixelShader | PixelShader | DepthRead));
+        }
+    }
+    CHECK(depthReadBarrierCount == 1);
+
+    const RenderGraphBarrier& lastBarrier = graph.GetBarriers().back();
+    CHECK(lastBarrier.Resource == backBuffer && lastBarrier.After == D3D12_RESOURCE_STATE_PRESENT);
+
+    // Nothing reads SSAO anymore, it is culled and its transient not placed
+    recorder.Reset();
+    backBuffer = recorder.Import(D3D12_RESOURCE_STATE_PRESENT);
+    depth = recorder.Import(PixelShader);
+    ssao = recorder.Create(100);
+    graph.MarkOutput(backBuffer, D3D12_RESOURCE_STATE_PRESENT);
+    ssaoPass = graph.AddPass("SSAO", [] {});
+    recorder.Read(ssaoPass, depth, NonPixelShader);
+    recorder.Write(ssaoPass, ssao, UnorderedAccess);
+    ui = graph.AddPass("UI", [] {}, true);
+    recorder.Write(ui, backBuffer, RenderTarget);
+
+    graph.Compile();
+    ValidateCompile(recorder);
+
+    CHECK(graph.IsCulled(ssaoPass));
+    CHECK(graph.GetTransientOffset(ssao) == RENDER_GRAPH_INVALID);
+    CHECK(graph.GetStats().TransientHeapSize == 0);
+}
+
+TEST(RenderGraph_TransientChain)
+{
+    // Each transient is only read by the next pass, two of them alive at a time
+    GraphRecorder recorder;
+    RenderGraph& graph = recorder.Graph;
+
+    uint32_t output = recorder.Import(PixelShader);
+    graph.MarkOutput(output, PixelShader);
+
+    const uint32_t transientCount = 6;
+    const uint64_t transientSize = 1 << 20;
+    uint32_t transients[transientCount];
+    for(uint32_t i = 0; i < transientCount; i++)
+        transients[i] = recorder.Create(transientSize);
+
+    for(uint32_t i = 0; i < transientCount; i++)
+    {
+        uint32_t pass = graph.AddPass("Chain", [] {});
+        if(i > 0)
+            recorder.Read(pass, transients[i - 1], PixelShader);
+        recorder.Write(pass, transients[i], RenderTarget);
+    }
+    uint32_t last = graph.AddPass("Last", [] {});
+    recorder.Read(last, transients[transientCount - 1], PixelShader);
+    recorder.Write(last, output, RenderTarget);
+
+    graph.Compile();
+    ValidateCompile(recorder);
+
+    CHECK(graph.GetBatches().size() == transientCount + 2);
+    CHECK(graph.GetStats().TransientSize == transientCount * transientSize);
+    CHECK(graph.GetStats().TransientHeapSize == 2 * transientSize);
+
+    uint32_t aliasingCount = 0;
+    for(const RenderGraphBarrier& barrier : graph.GetBarriers())
+        aliasingCount += barrier.Type == RenderGraphBarrierType::Aliasing ? 1 : 0;
+    CHECK(aliasingCount == transientCount - 2);
+}
+
+TEST(RenderGraph_SplitBarriers)
+{
+    // A is written first and only read at the end of a chain, its transition can begin right after its write
+    GraphRecorder recorder;
+    RenderGraph& graph = recorder.Graph;
+
+    uint32_t a = recorder.Import(RenderTarget);
+    uint32_t b = recorder.Import(RenderTarget);
+    uint32_t first = graph.AddPass("First", [] {});
+    recorder.Write(first, a, RenderTarget);
+    recorder.Write(first, b, RenderTarget);
+    uint32_t second = graph.AddPass("Second", [] {});
+    uint32_t c = recorder.Create(1024);
+    recorder.Read(second, b, PixelShader);
+    recorder.Write(second, c, RenderTarget);
+    uint32_t third = graph.AddPass("Third", [] {});
+    uint32_t d = recorder.Create(1024);
+    recorder.Read(third, c, PixelShader);
+    recorder.Write(third, d, RenderTarget);
+    uint32_t last = graph.AddPass("Last", [] {});
+    recorder.Read(last, d, PixelShader);
+    recorder.Read(last, a, PixelShader);
+    recorder.Write(last, b, RenderTarget);
+    graph.MarkOutput(b, PixelShader);
+
+    graph.Compile();
+    ValidateCompile(recorder);
+
+    // A begins after the batch of First, B after the one of Second. The end halves are the barriers themselves.
+    uint32_t splitCount = 0;
+    for(const RenderGraphBarrier& barrier : graph.GetBarriers())
+    {
+        if(barrier.BeginBatch == RENDER_GRAPH_INVALID)
+            continue;
+
+        splitCount++;
+        CHECK((barrier.Resource == a && barrier.BeginBatch == 0 && barrier.After == PixelShader)
+            || (barrier.Resource == b && barrier.BeginBatch == 1 && barrier.After == RenderTarget));
+    }
+    CHECK(splitCount == 2 && graph.GetStats().SplitBarrierCount == 2);
+}
+
+TEST(RenderGraph_RandomGraphs)
+{
+    GraphRecorder recorder;
+    for(uint32_t passCount : { 100u, 300u, 1000u })
+    {
+        BuildRandomGraph(recorder, passCount);
+        recorder.Graph.Compile();
+        ValidateCompile(recorder);
+
+        const RenderGraphStats& stats = recorder.Graph.GetStats();
+        CHECK(stats.PassCount + stats.CulledPassCount == passCount);
+        CHECK(stats.TransientHeapSize <= stats.TransientSize);
+    }
+}
+
+TEST(RenderGraph_FrameWithoutAllocations)
+{
+    // The editor frame rebuilt every frame : long names, callbacks capturing references and values, one larger than the arena
+    RenderGraph graph;
+    uint32_t executed[6] = {};
+    uint32_t capturedResource = RENDER_GRAPH_INVALID;
+    uint64_t capturedSum = 0;
+    std::array<uint32_t, RENDER_GRAPH_ARENA_SIZE / sizeof(uint32_t) * 2> table;
+    for(uint32_t i = 0; i < table.size(); i++)
+        table[i] = i;
+
+    auto BuildFrame = [&]()
+    {
+        graph.Reset();
+        uint32_t backBuffer = graph.ImportTexture("Backbuffer", nullptr, D3D12_RESOURCE_STATE_PRESENT);
+        uint32_t metallicRoughness = graph.ImportTexture("MetallicRoughness", nullptr, PixelShader);
+        uint32_t depth = graph.ImportTexture("DepthStencilBuffer", nullptr, PixelShader);
+        uint32_t ssao = graph.CreateTexture("ScreenSpaceAmbientOcclusion", MakeDesc(1 << 20));
+        graph.MarkOutput(backBuffer, D3D12_RESOURCE_STATE_PRESENT);
+
+        uint32_t gbufferPass = graph.AddPass("GBufferGeometryPass", [&]() { executed[0]++; });
+        graph.Write(gbufferPass, metallicRoughness, RenderTarget);
+        graph.Write(gbufferPass, depth, DepthWrite);
+        uint32_t ssaoPass = graph.AddPass("ScreenSpaceAmbientOcclusion", [&, ssao]() { executed[1]++; capturedResource = ssao; });
+        graph.Read(ssaoPass, depth, NonPixelShader);
+        graph.Write(ssaoPass, ssao, UnorderedAccess);
+        uint32_t tablePass = graph.AddPass("LargeCapture", [&capturedSum, table]()
+        {
+            capturedSum = 0;
+            for(uint32_t value : table)
+                capturedSum += value;
+        });
+        graph.Read(tablePass, ssao, NonPixelShader);
+        graph.Write(tablePass, metallicRoughness, RenderTarget);
+        uint32_t dead = graph.AddPass("NeverReadByAnything", [&]() { executed[3]++; });
+        graph.Read(dead, depth, PixelShader);
+        uint32_t ui = graph.AddPass("UserInterface", [&]() { executed[4]++; }, true);
+        graph.Read(ui, metallicRoughness, PixelShader);
+        graph.Write(ui, backBuffer, RenderTarget);
+
+        graph.Compile();
+        for(uint32_t pass : graph.GetPassOrder())
+            graph.ExecutePass(pass);
+        CHECK(strcmp(graph.GetPassName(ssaoPass), "ScreenSpaceAmbientOcclusion") == 0);
+        return ssao;
+    };
+
+    // Until the capacities settle, the first frame also spills the large callback out of the arena
+    for(uint32_t frame = 0; frame < 3; frame++)
+        BuildFrame();
+
+    const uint32_t frameCount = 10;
+    uint64_t allocationCount = TestRegistry::GetAllocationCount();
+    for(uint32_t frame = 0; frame < frameCount; frame++)
+    {
+        capturedResource = RENDER_GRAPH_INVALID;
+        capturedSum = 0;
+        uint32_t ssao = BuildFrame();
+        CHECK(capturedResource == ssao);
+        CHECK(capturedSum == (uint64_t)table.size() * (table.size() - 1) / 2);
+    }
+    CHECK(TestRegistry::GetAllocationCount() == allocationCount);
+
+    CHECK(executed[0] == 3 + frameCount && executed[1] == 3 + frameCount && executed[4] == 3 + frameCount);
+    CHECK(executed[3] == 0);
+}
+
+BENCHMARK(RenderGraph_Compile)
+{
+    GraphRecorder recorder;
+    for(uint32_t passCount : { 100u, 300u, 1000u })
+    {
+        BuildRandomGraph(recorder, passCount);
+        double compileUs = MeasureMilliseconds(20, [&] { recorder.Graph.Compile(); }) * 1000.0;
+
+        const RenderGraphStats& stats = recorder.Graph.GetStats();
+        printf("    %4u passes : compile %.1f us, %u culled, %u batches, %u barriers, transient heap %.1f MB of %.1f MB\n",
+            passCount, compileUs, stats.CulledPassCount, stats.BatchCount, stats.BarrierCount,
+            stats.TransientHeapSize / 1048576.0, stats.TransientSize / 1048576.0);
+    }
+}
@@ -0,0 +1,197 @@
+﻿#include "RHI/ResourceStateTracker.h"
+#include "TestFramework.h"
+
+namespace
+{
+    const D3D12_RESOURCE_STATES RenderTarget = D3D12_RESOURCE_STATE_RENDER_TARGET;
+    const D3D12_RESOURCE_STATES PixelShader = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+    const D3D12_RESOURCE_STATES UnorderedAccess = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    const D3D12_RESOURCE_STATES GenericRead = D3D12_RESOURCE_STATE_GENERIC_READ;
+    const D3D12_RESOURCE_STATES CopyDest = D3D12_RESOURCE_STATE_COPY_DEST;
+
+    // Only compared, never dereferenced
+    ID3D12Resource* FakeResource(uint32_t index)
+    {
+        return (ID3D12Resource*)(uintptr_t)(0x1000 * index);
+    }
+
+    bool IsTransition(const D3D12_RESOURCE_BARRIER& barrier, ID3D12Resource* resource, uint32_t subresource,
+        D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after, D3D12_RESOURCE_BARRIER_FLAGS flags = D3D12_RESOURCE_BARRIER_FLAG_NONE)
+    {
+        return barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION && barrier.Flags == flags && barrier.Transition.pResource == resource
+            && barrier.Transition.Subresource == subresource && barrier.Transition.StateBefore == before && barrier.Transition.StateAfter == after;
+    }
+}
+
+TEST(ResourceStateTracker_MergesAndDropsRoundTrips)
+{
+    ResourceStateTracker tracker;
+    tracker.SetRecording(true);
+    const auto& batches = tracker.GetRecordedBatches();
+
+    // RT -> PS -> COPY_DEST becomes RT -> COPY_DEST, PS -> UAV -> PS is dropped
+    ResourceState first(RenderTarget);
+    ResourceState second(PixelShader);
+    tracker.Transition(FakeResource(1), first, PixelShader);
+    tracker.Transition(FakeResource(2), second, UnorderedAccess);
+    tracker.Transition(FakeResource(1), first, CopyDest);
+    tracker.Transition(FakeResource(2), second, PixelShader);
+    tracker.Flush(nullptr);
+
+    CHECK(batches.size() == 1 && batches[0].size() == 1);
+    CHECK(IsTransition(batches[0][0], FakeResource(1), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, RenderTarget, CopyDest));
+    CHECK(first.Get() == CopyDest && second.Get() == PixelShader);
+
+    // Already in the state, nothing queued and an empty flush records nothing
+    tracker.Transition(FakeResource(1), first, CopyDest);
+    CHECK(!tracker.HasPendingBarriers());
+    tracker.Flush(nullptr);
+    CHECK(batches.size() == 1);
+
+    // A whole resource transition of a non uniform texture only moves the subresources that differ
+    ResourceState mips(PixelShader, 4);
+    tracker.Transition(FakeResource(3), mips, 2, UnorderedAccess);
+    tracker.Flush(nullptr);
+    CHECK(!mips.IsUniform());
+    tracker.Transition(FakeResource(3), mips, PixelShader);
+    tracker.Flush(nullptr);
+    CHECK(batches.size() == 3 && batches[2].size() == 1);
+    CHECK(IsTransition(batches[2][0], FakeResource(3), 2, UnorderedAccess, PixelShader));
+    CHECK(mips.IsUniform());
+
+    // Whole after per subresource in the same batch is not merged, each subresource gets its barrier
+    tracker.Transition(FakeResource(3), mips, 1, UnorderedAccess);
+    tracker.Transition(FakeResource(3), mips, RenderTarget);
+    tracker.Flush(nullptr);
+    CHECK(batches.size() == 4 && batches[3].size() == 4);
+    for(const D3D12_RESOURCE_BARRIER& barrier : batches[3])
+    {
+        CHECK(barrier.Transition.Subresource != D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+        CHECK(barrier.Transition.StateBefore == PixelShader && barrier.Transition.StateAfter == RenderTarget);
+    }
+}
+
+TEST(ResourceStateTracker_CubeMipPattern)
+{
+    // Prefilter pattern : 5 mips x 6 faces, each mip written as UAV then read by the next one
+    const uint32_t mipCount = 5;
+    const uint32_t faceCount = 6;
+
+    ResourceStateTracker tracker;
+    tracker.SetRecording(true);
+    const auto& batches = tracker.GetRecordedBatches();
+
+    ResourceState cube(UnorderedAccess, mipCount * faceCount);
+    for(uint32_t mip = 0; mip < mipCount; mip++)
+    {
+        for(uint32_t face = 0; face < faceCount; face++)
+            tracker.Transition(FakeResource(1), cube, mip + face * mipCount, UnorderedAccess);
+
+        // Dispatch
+        tracker.Flush(nullptr);
+
+        for(uint32_t face = 0; face < faceCount; face++)
+            tracker.Transition(FakeResource(1), cube, mip + face * mipCount, GenericRead);
+    }
+    tracker.Flush(nullptr);
+
+    CHECK(cube.IsUniform() && cube.Get() == GenericRead);
+    // The first flush had nothing to do, then one batch of the 6 faces per mip
+    CHECK(batches.size() == mipCount);
+    for(uint32_t mip = 0; mip < (uint32_t)batches.size(); mip++)
+    {
+        CHECK(batches[mip].size() == faceCount);
+        for(uint32_t face = 0; face < (uint32_t)batches[mip].size(); face++)
+            CHECK(IsTransition(batches[mip][face], FakeResource(1), mip + face * mipCount, UnorderedAccess, GenericRead));
+    }
+}
+
+TEST(ResourceStateTracker_SplitBarriers)
+{
+    ResourceStateTracker tracker;
+    tracker.SetRecording(true);
+    const auto& batches = tracker.GetRecordedBatches();
+
+    ResourceState split(RenderTarget);
+    ResourceState other(RenderTarget);
+
+    // The begin half goes with the next flush, the state is already the final one
+    tracker.BeginTransition(FakeResource(1), split, PixelShader);
+    CHECK(split.Get() == PixelShader);
+    tracker.Transition(FakeResource(2), other, PixelShader);
+    tracker.Flush(nullptr);
+    CHECK(batches.size() == 1 && batches[0].size() == 2);
+    CHECK(IsTransition(batches[0][0], FakeResource(1), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, RenderTarget, PixelShader, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY));
+
+    // The end half with the next transition of the resource, even to the state it is already in
+    tracker.Transition(FakeResource(1), split, PixelShader);
+    tracker.Flush(nullptr);
+    CHECK(batches.size() == 2 && batches[1].size() == 1);
+    CHECK(IsTransition(batches[1][0], FakeResource(1), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, RenderTarget, PixelShader, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY));
+
+    // Ended before its begin half was flushed, it becomes a regular barrier merged with what follows
+    tracker.BeginTransition(FakeResource(1), split, RenderTarget);
+    tracker.Transition(FakeResource(1), split, CopyDest);
+    tracker.Flush(nullptr);
+    CHECK(batches.size() == 3 && batches[2].size() == 1);
+    CHECK(IsTransition(batches[2][0], FakeResource(1), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, PixelShader, CopyDest));
+
+    // Left open, it is ended with the command list
+    tracker.BeginTransition(FakeResource(1), split, PixelShader);
+    tracker.Flush(nullptr);
+    tracker.EndTransitions();
+    tracker.Flush(nullptr);
+    CHECK(batches.size() == 5 && batches[4].size() == 1);
+    CHECK(IsTransition(batches[3][0], FakeResource(1), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, CopyDest, PixelShader, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY));
+    CHECK(IsTransition(batches[4][0], FakeResource(1), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, CopyDest, PixelShader, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY));
+
+    // Every begin half was paired with exactly one end half
+    uint32_t beginCount = 0;
+    uint32_t endCount = 0;
+    for(const auto& batch : batches)
+    {
+        for(const D3D12_RESOURCE_BARRIER& barrier : batch)
+        {
+            beginCount += barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY ? 1 : 0;
+            endCount += barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY ? 1 : 0;
+        }
+    }
+    CHECK(beginCount == 2 && endCount == 2);
+}
+
+TEST(ResourceStateTracker_AliasingKeepsOrder)
+{
+    ResourceStateTracker tracker;
+    tracker.SetRecording(true);
+    const auto& batches = tracker.GetRecordedBatches();
+
+    // The round trip after the aliasing barrier is dropped, the aliasing barrier itself stays
+    ResourceState state(RenderTarget);
+    tracker.Aliasing(nullptr, FakeResource(1));
+    tracker.Transition(FakeResource(1), state, PixelShader);
+    tracker.Transition(FakeResource(1), state, RenderTarget);
+    tracker.Flush(nullptr);
+
+    CHECK(batches.size() == 1 && batches[0].size() == 1);
+    CHECK(batches[0][0].Type == D3D12_RESOURCE_BARRIER_TYPE_ALIASING && batches[0][0].Aliasing.pResourceAfter == FakeResource(1));
+}
+
+BENCHMARK(ResourceStateTracker_QueueAndFlush)
+{
+    const uint32_t resourceCount = 64;
+    std::vector<ResourceState> states(resourceCount, ResourceState(RenderTarget));
+
+    ResourceStateTracker tracker;
+    const uint32_t flushCount = 10000;
+    double flushMs = MeasureMilliseconds(5, [&]
+    {
+        for(uint32_t i = 0; i < flushCount; i++)
+        {
+            for(uint32_t resource = 0; resource < resourceCount; resource++)
+                tracker.Transition(FakeResource(100 + resource), states[resource], (i + resource) & 1 ? PixelShader : RenderTarget);
+            tracker.Flush(nullptr);
+        }
+    });
+
+    printf("    %u transitions queued and flushed in %.2f us\n", resourceCount, flushMs * 1000.0 / flushCount);
+}
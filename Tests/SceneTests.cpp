@@ -0,0 +1,250 @@
+﻿#include <algorithm>
+#include <random>
+
+#include "ECS/Scene.h"
+#include "TestFramework.h"
+
+using namespace DirectX;
+
+namespace
+{
+    // The scene layout before the archetypes : every object owns its components, found by dynamic cast
+    namespace Legacy
+    {
+        class Component
+        {
+        public:
+            virtual ~Component() = default;
+        };
+
+        class TransformComponent : public Component
+        {
+        public:
+            XMFLOAT4X4 m_transform;
+        };
+
+        class MeshComponent : public Component
+        {
+        public:
+            std::shared_ptr<RenderItem> m_renderItem;
+            Material m_material;
+        };
+
+        class PointLightComponent : public Component
+        {
+        public:
+            PointLight m_pointLight;
+        };
+
+        class GameObject
+        {
+        public:
+            template<typename T>
+            std::shared_ptr<T> AddComponent()
+            {
+                std::shared_ptr<T> newComp = std::make_shared<T>();
+                m_components.emplace_back(newComp);
+                return newComp;
+            }
+
+            template<typename T>
+            std::shared_ptr<T> GetComponent()
+            {
+                for(auto component : m_components)
+                {
+                    if(auto typedComponent = std::dynamic_pointer_cast<T>(component))
+                        return typedComponent;
+                }
+                return nullptr;
+            }
+
+        private:
+            std::vector<std::shared_ptr<Component>> m_components;
+        };
+    }
+
+    // Every entity has a transform and a mesh, one in LightEvery a point light
+    const uint32_t LightEvery = 100;
+
+    XMFLOAT4X4 MakeTransform(uint32_t i)
+    {
+        XMFLOAT4X4 transform;
+        XMStoreFloat4x4(&transform, XMMatrixTranslation((float)(i % 1000), (float)(i / 1000), 1.0f));
+        return transform;
+    }
+
+    void PopulateScene(Scene& scene, uint32_t count)
+    {
+        for(uint32_t i = 0; i < count; i++)
+        {
+            Entity entity = scene.CreateEntity("Entity");
+            scene.AddComponent<TransformComponent>(entity)->m_transform = MakeTransform(i);
+            scene.AddComponent<MeshComponent>(entity);
+            if(i % LightEvery == 0)
+                scene.AddComponent<PointLightComponent>(entity)->m_pointLight.Position = XMFLOAT3((float)i, 0.0f, 0.0f);
+        }
+    }
+
+    void PopulateLegacy(std::vector<std::shared_ptr<Legacy::GameObject>>& gameObjects, uint32_t count)
+    {
+        for(uint32_t i = 0; i < count; i++)
+        {
+            auto gameObject = std::make_shared<Legacy::GameObject>();
+            gameObject->AddComponent<Legacy::TransformComponent>()->m_transform = MakeTransform(i);
+            gameObject->AddComponent<Legacy::MeshComponent>();
+            if(i % LightEvery == 0)
+                gameObject->AddComponent<Legacy::PointLightComponent>()->m_pointLight.Position = XMFLOAT3((float)i, 0.0f, 0.0f);
+            gameObjects.push_back(gameObject);
+        }
+    }
+
+    // What the editor extraction reads every frame : the mesh transforms and the point lights
+    double ExtractScene(Scene& scene)
+    {
+        double checksum = 0.0;
+        scene.Each<TransformComponent, MeshComponent>([&](TransformComponent& transform, MeshComponent& mesh)
+        {
+            checksum += transform.m_transform._41 + transform.m_transform._42 + (mesh.GetRenderItem() ? 1.0 : 0.0);
+        });
+        scene.Each<PointLightComponent>([&](PointLightComponent& light)
+        {
+            checksum += light.m_pointLight.Position.x;
+        });
+        return checksum;
+    }
+
+    // Population can't be repeated on the same scene, so no warm up run as in MeasureMilliseconds
+    template<typename Function>
+    double MeasureOnceMilliseconds(const Function& function)
+    {
+        auto begin = std::chrono::high_resolution_clock::now();
+        function();
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(end - begin).count();
+    }
+
+    double ExtractLegacy(const std::vector<std::shared_ptr<Legacy::GameObject>>& gameObjects)
+    {
+        double checksum = 0.0;
+        for(const auto& gameObject : gameObjects)
+        {
+            if(const auto transform = gameObject->GetComponent<Legacy::TransformComponent>())
+            {
+                if(const auto mesh = gameObject->GetComponent<Legacy::MeshComponent>())
+                    checksum += transform->m_transform._41 + transform->m_transform._42 + (mesh->m_renderItem ? 1.0 : 0.0);
+            }
+            if(const auto light = gameObject->GetComponent<Legacy::PointLightComponent>())
+                checksum += light->m_pointLight.Position.x;
+        }
+        return checksum;
+    }
+}
+
+TEST(Scene_EachVisitsMatchingEntities)
+{
+    // Enough entities to span several chunks of every archetype
+    const uint32_t count = 20000;
+    Scene scene("Test");
+    PopulateScene(scene, count);
+    Entity bare = scene.CreateEntity("Bare");
+
+    uint32_t transformCount = 0;
+    uint32_t lightCount = 0;
+    double expected = 0.0;
+    scene.Each<TransformComponent>([&](Entity entity, TransformComponent& transform)
+    {
+        CHECK(scene.GetComponent<TransformComponent>(entity) == &transform);
+        CHECK(entity != bare);
+        transformCount++;
+    });
+    scene.Each<TransformComponent, PointLightComponent>([&](Entity entity, TransformComponent& transform, PointLightComponent& light)
+    {
+        CHECK(scene.GetComponent<MeshComponent>(entity) != nullptr);
+        CHECK(transform.m_transform._41 + transform.m_transform._42 * 1000.0f == light.m_pointLight.Position.x);
+        lightCount++;
+    });
+    CHECK(transformCount == count);
+    CHECK(lightCount == count / LightEvery);
+
+    for(uint32_t i = 0; i < count; i++)
+        expected += MakeTransform(i)._41 + MakeTransform(i)._42 + (i % LightEvery == 0 ? (double)i : 0.0);
+    CHECK(ExtractScene(scene) == expected);
+}
+
+TEST(Scene_ComponentsSurviveArchetypeMoves)
+{
+    Scene scene("Test");
+    std::vector<Entity> entities;
+    for(uint32_t i = 0; i < 1000; i++)
+    {
+        Entity entity = scene.CreateEntity("Entity");
+        scene.AddComponent<TransformComponent>(entity)->m_transform = MakeTransform(i);
+        entities.push_back(entity);
+    }
+
+    // Moving every other entity to other archetypes swaps rows around, every component must follow its entity
+    std::mt19937 random(5);
+    for(uint32_t i = 0; i < 1000; i += 2)
+    {
+        scene.AddComponent<PointLightComponent>(entities[i])->m_pointLight.Position = XMFLOAT3((float)i, 0.0f, 0.0f);
+        if(random() % 2)
+            scene.AddComponent<MeshComponent>(entities[i]);
+    }
+    for(uint32_t i = 0; i < 1000; i += 4)
+        scene.RemoveComponent<MeshComponent>(entities[i]);
+
+    for(uint32_t i = 0; i < 1000; i++)
+    {
+        CHECK(scene.GetComponent<TransformComponent>(entities[i])->m_transform._41 == MakeTransform(i)._41);
+        CHECK(scene.GetComponent<TransformComponent>(entities[i])->m_transform._42 == MakeTransform(i)._42);
+        PointLightComponent* light = scene.GetComponent<PointLightComponent>(entities[i]);
+        CHECK((light != nullptr) == (i % 2 == 0));
+        if(light)
+            CHECK(light->m_pointLight.Position.x == (float)i);
+        if(i % 4 == 0)
+            CHECK(scene.GetComponent<MeshComponent>(entities[i]) == nullptr);
+    }
+
+    // Destroyed handles go stale, their index is reused under a new generation
+    scene.DestroyEntity(entities[10]);
+    CHECK(!scene.IsAlive(entities[10]));
+    CHECK(scene.GetComponent<TransformComponent>(entities[10]) == nullptr);
+    Entity reused = scene.CreateEntity("Reused");
+    CHECK(reused.Index == entities[10].Index && reused.Generation != entities[10].Generation);
+    CHECK(scene.GetComponent<TransformComponent>(reused) == nullptr);
+    CHECK(scene.GetComponent<TransformComponent>(entities[11])->m_transform._41 == MakeTransform(11)._41);
+}
+
+BENCHMARK(Scene_ExtractVsLegacy)
+{
+    const uint32_t count = 100000;
+
+    Scene scene("Benchmark");
+    std::vector<std::shared_ptr<Legacy::GameObject>> legacyObjects;
+    double sceneCreateMs = MeasureOnceMilliseconds([&] { PopulateScene(scene, count); });
+    double legacyCreateMs = MeasureOnceMilliseconds([&] { PopulateLegacy(legacyObjects, count); });
+    CHECK(legacyObjects.size() == count);
+
+    double sceneChecksum = 0.0;
+    double legacyChecksum = 0.0;
+    double sceneMs = MeasureMilliseconds(10, [&] { sceneChecksum = ExtractScene(scene); });
+    double legacyMs = MeasureMilliseconds(10, [&] { legacyChecksum = ExtractLegacy(legacyObjects); });
+    CHECK(sceneChecksum == legacyChecksum);
+
+    // Random access through the handles, what the editor does for the selected objects
+    std::vector<Entity> entities;
+    for(uint32_t i = 0; i < count; i++)
+        entities.push_back(scene.GetEntity(i));
+    std::shuffle(entities.begin(), entities.end(), std::mt19937(6));
+    double lookupChecksum = 0.0;
+    double lookupMs = MeasureMilliseconds(10, [&]
+    {
+        lookupChecksum = 0.0;
+        for(Entity entity : entities)
+            lookupChecksum += scene.GetComponent<TransformComponent>(entity)->m_transform._41;
+    });
+    DoNotOptimize(lookupChecksum);
+
+    printf("    %u entities : create %.2f ms (legacy %.2f ms), extraction %.3f ms (legacy %.3f ms, %.1fx), %u random GetComponent %.3f ms\n",
+        count, sceneCreateMs, legacyCreateMs, sceneMs, legacyMs, legacyMs / sceneMs, count, lookupMs);
+}
@@ -0,0 +1,141 @@
+﻿#include "Rendering/ShadowCache.h"
+#include "TestFramework.h"
+
+using namespace DirectX;
+
+namespace
+{
+    constexpr uint32_t StaticLayer = (uint32_t)ShadowCasterLayer::Static;
+    constexpr uint32_t DynamicLayer = (uint32_t)ShadowCasterLayer::Dynamic;
+
+    ShadowCacheKeys MakeKeys(uint64_t base)
+    {
+        ShadowCacheKeys keys;
+        for(uint32_t cascade = 0; cascade < SHADOW_CASCADE_COUNT; cascade++)
+        {
+            keys.Layers[cascade][StaticLayer] = base + cascade * 2;
+            keys.Layers[cascade][DynamicLayer] = base + cascade * 2 + 1;
+        }
+        return keys;
+    }
+
+    uint32_t CountStaticRedraws(const ShadowCacheUpdate& update)
+    {
+        uint32_t count = 0;
+        for(bool redraw : update.RedrawStatic)
+            count += redraw ? 1 : 0;
+        return count;
+    }
+}
+
+TEST(ShadowCache_Update)
+{
+    ShadowCache cache;
+    ShadowCacheKeys keys = MakeKeys(100);
+
+    // First frame : everything is drawn
+    ShadowCacheUpdate update = cache.Update(keys);
+    CHECK(CountStaticRedraws(update) == SHADOW_CASCADE_COUNT);
+    CHECK(update.RestoreDynamic);
+    CHECK(cache.GetStats().StaticPassCount == SHADOW_CASCADE_COUNT);
+    CHECK(cache.GetStats().DynamicPassCount == SHADOW_CASCADE_COUNT);
+
+    // Nothing changed : both layers are skipped
+    update = cache.Update(keys);
+    CHECK(CountStaticRedraws(update) == 0);
+    CHECK(!update.RestoreDynamic);
+    CHECK(cache.GetStats().StaticPassCount == 0);
+    CHECK(cache.GetStats().DynamicPassCount == 0);
+
+    // A dynamic caster moved in one cascade : the static layers are kept, every dynamic layer is redrawn over their copy
+    keys.Layers[2][DynamicLayer]++;
+    update = cache.Update(keys);
+    CHECK(CountStaticRedraws(update) == 0);
+    CHECK(update.RestoreDynamic);
+    CHECK(cache.GetStats().StaticPassCount == 0);
+    CHECK(cache.GetStats().DynamicPassCount == SHADOW_CASCADE_COUNT);
+
+    // A single static cascade changed : only that one is redrawn, the copy then wipes the dynamic layers
+    keys.Layers[1][StaticLayer]++;
+    update = cache.Update(keys);
+    CHECK(CountStaticRedraws(update) == 1 && update.RedrawStatic[1]);
+    CHECK(update.RestoreDynamic);
+    CHECK(cache.GetStats().StaticPassCount == 1);
+    CHECK(cache.GetStats().DynamicPassCount == SHADOW_CASCADE_COUNT);
+
+    CHECK(CountStaticRedraws(cache.Update(keys)) == 0);
+
+    // Lost layers : everything is redrawn even with the same keys
+    cache.Invalidate();
+    update = cache.Update(keys);
+    CHECK(CountStaticRedraws(update) == SHADOW_CASCADE_COUNT);
+    CHECK(update.RestoreDynamic);
+    CHECK(CountStaticRedraws(cache.Update(keys)) == 0);
+}
+
+TEST(ShadowCache_Stats)
+{
+    ShadowCache cache;
+    ShadowCacheKeys keys = MakeKeys(7);
+
+    cache.Update(keys); // Draws everything
+    cache.Update(keys); // Skips everything
+    keys.Layers[0][DynamicLayer]++;
+    cache.Update(keys); // Dynamic layers only
+    keys.Layers[3][StaticLayer]++;
+    cache.Update(keys); // One static cascade and the dynamic layers
+
+    const ShadowCacheStats& stats = cache.GetStats();
+    CHECK(stats.FrameCount == 4);
+    CHECK(stats.SkippedStaticPassCount == 0 + SHADOW_CASCADE_COUNT + SHADOW_CASCADE_COUNT + (SHADOW_CASCADE_COUNT - 1));
+    CHECK(stats.SkippedDynamicPassCount == SHADOW_CASCADE_COUNT);
+
+    // Invalidate starts the counters over
+    cache.Invalidate();
+    CHECK(cache.GetStats().FrameCount == 0);
+    CHECK(cache.GetStats().SkippedStaticPassCount == 0 && cache.GetStats().SkippedDynamicPassCount == 0);
+    cache.Update(keys);
+    CHECK(cache.GetStats().FrameCount == 1 && cache.GetStats().SkippedStaticPassCount == 0);
+}
+
+TEST(ShadowCache_HashCasters)
+{
+    InstanceData instances[4] = {};
+    for(uint32_t i = 0; i < 4; i++)
+        XMStoreFloat4x4(&instances[i].WorldMat, XMMatrixTranslation((float)i, 0.0f, 0.0f));
+
+    uint32_t slots[] = { 0, 2, 3 };
+    auto HashStatic = [&](uint32_t mesh, uint32_t lod, const uint32_t* hashedSlots, uint32_t count)
+    {
+        return ShadowCache::HashCasters(ShadowCache::HashSeed, mesh, lod, hashedSlots, count, instances, false);
+    };
+    auto HashDynamic = [&](const uint32_t* hashedSlots, uint32_t count)
+    {
+        return ShadowCache::HashCasters(ShadowCache::HashSeed, 5, 1, hashedSlots, count, instances, true);
+    };
+
+    uint64_t reference = HashStatic(5, 1, slots, 3);
+    CHECK(HashStatic(5, 1, slots, 3) == reference);
+    CHECK(HashStatic(6, 1, slots, 3) != reference);
+    CHECK(HashStatic(5, 2, slots, 3) != reference);
+    CHECK(HashStatic(5, 1, slots, 2) != reference);
+    uint32_t otherSlots[] = { 0, 1, 3 };
+    CHECK(HashStatic(5, 1, otherSlots, 3) != reference);
+    // Nothing drawn still hashes the mesh and LOD
+    CHECK(HashStatic(5, 1, slots, 0) != HashStatic(5, 2, slots, 0));
+
+    // Static keys ignore the transforms, dynamic ones follow them
+    uint64_t dynamicReference = HashDynamic(slots, 3);
+    instances[2].WorldMat._42 = 0.5f;
+    CHECK(HashStatic(5, 1, slots, 3) == reference);
+    CHECK(HashDynamic(slots, 3) != dynamicReference);
+
+    // Instances that are not drawn don't matter
+    uint64_t moved = HashDynamic(slots, 3);
+    instances[1].WorldMat._41 = 10.0f;
+    CHECK(HashDynamic(slots, 3) == moved);
+
+    // Lists are chained : the same casters under another list change the key
+    uint64_t chained = ShadowCache::HashCasters(reference, 7, 0, slots, 1, instances, false);
+    CHECK(chained != ShadowCache::HashCasters(ShadowCache::HashSeed, 7, 0, slots, 1, instances, false));
+}
@@ -0,0 +1,93 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// CPU only tests and benchmarks, registered at static init and run by the CorvusTests console project.
+// Tests run by default, benchmarks with --bench, both can be filtered by a name prefix.
+struct TestCase
+{
+    const char* Name;
+    void (*Function)();
+    bool IsBenchmark;
+};
+
+class TestRegistry
+{
+public:
+    static std::vector<TestCase>& GetTests();
+    static void ReportFailure(const char* file, int line, const char* expression);
+    static uint32_t GetFailureCount() { return m_failureCount.load(); }
+
+    // Global operator new calls since the start, from every thread
+    static uint64_t GetAllocationCount() { return m_allocationCount.load(std::memory_order_relaxed); }
+    static void CountAllocation() { m_allocationCount.fetch_add(1, std::memory_order_relaxed); }
+
+    // Workers the job system is created with, 0 uses every hardware thread but the calling one
+    static uint32_t GetWorkerCount() { return m_workerCount; }
+    static void SetWorkerCount(uint32_t workerCount) { m_workerCount = workerCount; }
+
+private:
+    inline static std::atomic<uint32_t> m_failureCount { 0 };
+    inline static std::atomic<uint64_t> m_allocationCount { 0 };
+    inline static uint32_t m_workerCount = 0;
+};
+
+struct TestRegistrar
+{
+    TestRegistrar(const char* name, void (*function)(), bool isBenchmark)
+    {
+        TestRegistry::GetTests().push_back({ name, function, isBenchmark });
+    }
+};
+
+#define TEST(name) \
+    static void Test_##name(); \
+    static TestRegistrar s_testRegistrar_##name(#name, Test_##name, false); \
+    static void Test_##name()
+
+#define BENCHMARK(name) \
+    static void Benchmark_##name(); \
+    static TestRegistrar s_benchmarkRegistrar_##name(#name, Benchmark_##name, true); \
+    static void Benchmark_##name()
+
+#define CHECK(expression) \
+do { \
+    if(!(expression)) \
+        TestRegistry::ReportFailure(__FILE__, __LINE__, #expression); \
+} while(0)
+
+#define CHECK_NEAR(a, b, tolerance) CHECK(std::fabs((double)(a) - (double)(b)) <= (double)(tolerance))
+
+// Best of the runs in milliseconds, the first run is a warm up
+template<typename Function>
+double MeasureMilliseconds(uint32_t runCount, const Function& function)
+{
+    function();
+
+    double best = 1e30;
+    for(uint32_t i = 0; i < runCount; i++)
+    {
+        auto begin = std::chrono::high_resolution_clock::now();
+        function();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        double milliseconds = std::chrono::duration<double, std::milli>(end - begin).count();
+        if(milliseconds < best)
+            best = milliseconds;
+    }
+
+    return best;
+}
+
+// Keeps the optimizer from dropping benchmarked work whose result is unused
+template<typename T>
+void DoNotOptimize(const T& value)
+{
+    static volatile const void* s_sink;
+    s_sink = &value;
+}
@@ -0,0 +1,91 @@
+﻿#pragma once
+
+#include <DirectXMath.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Positions of a Wavefront OBJ welded by their index, polygons are fanned into triangles. False when the file can't be read
+inline bool LoadObjPositions(const char* path, std::vector<DirectX::XMFLOAT3>& positions, std::vector<uint32_t>& indices)
+{
+    positions.clear();
+    indices.clear();
+
+    std::ifstream file(path);
+    std::string line;
+    while(std::getline(file, line))
+    {
+        std::istringstream stream(line);
+        std::string type;
+        stream >> type;
+        if(type == "v")
+        {
+            DirectX::XMFLOAT3& position = positions.emplace_back();
+            stream >> position.x >> position.y >> position.z;
+        }
+        else if(type == "f")
+        {
+            std::vector<uint32_t> face;
+            std::string corner;
+            while(stream >> corner)
+                face.push_back((uint32_t)std::stoi(corner) - 1);
+            for(size_t i = 1; i + 1 < face.size(); i++)
+                indices.insert(indices.end(), { face[0], face[i], face[i + 1] });
+        }
+    }
+
+    return !indices.empty();
+}
+
+inline float PointTriangleDistance(DirectX::FXMVECTOR point, DirectX::FXMVECTOR a, DirectX::FXMVECTOR b, DirectX::GXMVECTOR c)
+{
+    // Closest point by Voronoi region (Ericson, Real-Time Collision Detection 5.1.5)
+    DirectX::XMVECTOR ab = DirectX::XMVectorSubtract(b, a);
+    DirectX::XMVECTOR ac = DirectX::XMVectorSubtract(c, a);
+    DirectX::XMVECTOR ap = DirectX::XMVectorSubtract(point, a);
+    float d1 = DirectX::XMVectorGetX(DirectX::XMVector3Dot(ab, ap));
+    float d2 = DirectX::XMVectorGetX(DirectX::XMVector3Dot(ac, ap));
+    DirectX::XMVECTOR closest;
+    if(d1 <= 0.0f && d2 <= 0.0f)
+        closest = a;
+    else
+    {
+        DirectX::XMVECTOR bp = DirectX::XMVectorSubtract(point, b);
+        float d3 = DirectX::XMVectorGetX(DirectX::XMVector3Dot(ab, bp));
+        float d4 = DirectX::XMVectorGetX(DirectX::XMVector3Dot(ac, bp));
+        DirectX::XMVECTOR cp = DirectX::XMVectorSubtract(point, c);
+        float d5 = DirectX::XMVectorGetX(DirectX::XMVector3Dot(ab, cp));
+        float d6 = DirectX::XMVectorGetX(DirectX::XMVector3Dot(ac, cp));
+        float vc = d1 * d4 - d3 * d2;
+        float vb = d5 * d2 - d1 * d6;
+        float va = d3 * d6 - d5 * d4;
+        if(d3 >= 0.0f && d4 <= d3)
+            closest = b;
+        else if(d6 >= 0.0f && d5 <= d6)
+            closest = c;
+        else if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+            closest = DirectX::XMVectorAdd(a, DirectX::XMVectorScale(ab, d1 / (d1 - d3)));
+        else if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+            closest = DirectX::XMVectorAdd(a, DirectX::XMVectorScale(ac, d2 / (d2 - d6)));
+        else if(va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+            closest = DirectX::XMVectorAdd(b, DirectX::XMVectorScale(DirectX::XMVectorSubtract(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6))));
+        else
+        {
+            float denominator = 1.0f / (va + vb + vc);
+            closest = DirectX::XMVectorAdd(a, DirectX::XMVectorAdd(DirectX::XMVectorScale(ab, vb * denominator), DirectX::XMVectorScale(ac, vc * denominator)));
+        }
+    }
+    return DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(point, closest)));
+}
+
+// The editor's dragon is not shipped with the repo, the teapot stands in when it is missing. Returns the loaded path, null without any
+inline const char* LoadBenchmarkMesh(std::vector<DirectX::XMFLOAT3>& positions, std::vector<uint32_t>& indices)
+{
+    for(const char* path : { "Assets/dragon.obj", "Assets/teapot.obj" })
+    {
+        if(LoadObjPositions(path, positions, indices))
+            return path;
+    }
+    return nullptr;
+}
@@ -0,0 +1,303 @@
+﻿#include <algorithm>
+#include <cstring>
+#include <random>
+
+#include "JobSystem.h"
+#include "Rendering/TriangleBVH.h"
+#include "TestFramework.h"
+#include "TestMeshes.h"
+
+using namespace DirectX;
+
+namespace
+{
+    struct TriangleMesh
+    {
+        std::vector<XMFLOAT3> Positions;
+        std::vector<uint32_t> Indices;
+
+        uint32_t GetTriangleCount() const { return (uint32_t)Indices.size() / 3; }
+    };
+
+    // Bumpy closed torus, no sliver triangles the reference and the BVH could round differently.
+    // 2 * segmentCount^2 triangles, more than TRIANGLE_BVH_PARALLEL_SIZE from 64 segments so the build goes through the job system
+    TriangleMesh MakeTorus(uint32_t segmentCount)
+    {
+        TriangleMesh mesh;
+        for(uint32_t j = 0; j < segmentCount; j++)
+        {
+            for(uint32_t i = 0; i < segmentCount; i++)
+            {
+                float theta = XM_2PI * j / segmentCount;
+                float phi = XM_2PI * i / segmentCount;
+                float tube = 0.4f + 0.03f * std::sin(13.0f * theta) * std::cos(7.0f * phi);
+                float ring = 1.0f + tube * std::cos(phi);
+                mesh.Positions.push_back({ ring * std::cos(theta), tube * std::sin(phi), ring * std::sin(theta) });
+            }
+        }
+
+        for(uint32_t j = 0; j < segmentCount; j++)
+        {
+            for(uint32_t i = 0; i < segmentCount; i++)
+            {
+                uint32_t a = j * segmentCount + i;
+                uint32_t b = j * segmentCount + (i + 1) % segmentCount;
+                uint32_t c = (j + 1) % segmentCount * segmentCount + i;
+                uint32_t d = (j + 1) % segmentCount * segmentCount + (i + 1) % segmentCount;
+                mesh.Indices.insert(mesh.Indices.end(), { a, c, b, b, c, d });
+            }
+        }
+
+        return mesh;
+    }
+
+    TriangleBVH BuildBVH(const TriangleMesh& mesh, std::vector<TriangleBVHNode>& nodes, std::vector<uint32_t>& triangles)
+    {
+        TriangleBVH::Build(mesh.Positions.data(), mesh.Indices.data(), mesh.GetTriangleCount(), nodes, triangles);
+        TriangleBVH bvh;
+        bvh.Initialize(nodes.data(), (uint32_t)nodes.size(), triangles.data(), (uint32_t)triangles.size(), mesh.Positions.data(), mesh.Indices.data());
+        return bvh;
+    }
+
+    // Every triangle, double sided Moller-Trumbore
+    bool RaycastReference(const TriangleMesh& mesh, const BVHRay& ray, TriangleRayHit& hit)
+    {
+        XMVECTOR origin = XMLoadFloat3(&ray.Origin);
+        XMVECTOR direction = XMLoadFloat3(&ray.Direction);
+        hit = TriangleRayHit();
+        float closest = ray.MaxDistance;
+        for(uint32_t t = 0; t < mesh.GetTriangleCount(); t++)
+        {
+            XMVECTOR vertex0 = XMLoadFloat3(&mesh.Positions[mesh.Indices[t * 3]]);
+            XMVECTOR edge1 = XMVectorSubtract(XMLoadFloat3(&mesh.Positions[mesh.Indices[t * 3 + 1]]), vertex0);
+            XMVECTOR edge2 = XMVectorSubtract(XMLoadFloat3(&mesh.Positions[mesh.Indices[t * 3 + 2]]), vertex0);
+            XMVECTOR p = XMVector3Cross(direction, edge2);
+            float determinant = XMVectorGetX(XMVector3Dot(edge1, p));
+            if(determinant == 0.0f)
+                continue;
+
+            float inverse = 1.0f / determinant;
+            XMVECTOR s = XMVectorSubtract(origin, vertex0);
+            float u = XMVectorGetX(XMVector3Dot(s, p)) * inverse;
+            if(u < 0.0f || u > 1.0f)
+                continue;
+
+            XMVECTOR q = XMVector3Cross(s, edge1);
+            float v = XMVectorGetX(XMVector3Dot(direction, q)) * inverse;
+            if(v < 0.0f || u + v > 1.0f)
+                continue;
+
+            float distance = XMVectorGetX(XMVector3Dot(edge2, q)) * inverse;
+            if(distance >= 0.0f && distance < closest)
+            {
+                closest = distance;
+                hit.Distance = distance;
+                hit.Triangle = t;
+            }
+        }
+        return hit.Triangle != UINT32_MAX;
+    }
+
+    // Rays aimed at points inside random triangles from around the mesh, some with a short MaxDistance or an axis aligned direction
+    std::vector<BVHRay> MakeRandomRays(const TriangleMesh& mesh, uint32_t count)
+    {
+        std::mt19937 random(3);
+        auto Uniform = [&](float low, float high) { return std::uniform_real_distribution<float>(low, high)(random); };
+
+        std::vector<BVHRay> rays(count);
+        for(BVHRay& ray : rays)
+        {
+            uint32_t t = random() % mesh.GetTriangleCount();
+            float u = Uniform(0.01f, 0.98f);
+            float v = Uniform(0.01f, 0.99f - u);
+            XMVECTOR target = XMVectorAdd(XMVectorScale(XMLoadFloat3(&mesh.Positions[mesh.Indices[t * 3]]), 1.0f - u - v),
+                XMVectorAdd(XMVectorScale(XMLoadFloat3(&mesh.Positions[mesh.Indices[t * 3 + 1]]), u), XMVectorScale(XMLoadFloat3(&mesh.Positions[mesh.Indices[t * 3 + 2]]), v)));
+            XMVECTOR origin = XMVectorAdd(target, XMVectorSet(Uniform(-4.0f, 4.0f), Uniform(-4.0f, 4.0f), Uniform(-4.0f, 4.0f), 0.0f));
+            XMStoreFloat3(&ray.Origin, origin);
+            XMStoreFloat3(&ray.Direction, XMVectorScale(XMVectorSubtract(target, origin), Uniform(0.2f, 3.0f)));
+            ray.MaxDistance = random() % 3 ? FLT_MAX : Uniform(0.1f, 2.0f);
+            if(random() % 50 == 0)
+                ray.Direction.x = 0.0f;
+        }
+        return rays;
+    }
+
+    // Pinhole camera framing the mesh, rays in 2x2 pixel tiles so consecutive ones make coherent packets
+    std::vector<BVHRay> MakePrimaryRays(const TriangleMesh& mesh, uint32_t resolution)
+    {
+        XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+        XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+        for(const XMFLOAT3& position : mesh.Positions)
+        {
+            boundsMin = XMVectorMin(boundsMin, XMLoadFloat3(&position));
+            boundsMax = XMVectorMax(boundsMax, XMLoadFloat3(&position));
+        }
+        XMVECTOR center = XMVectorScale(XMVectorAdd(boundsMin, boundsMax), 0.5f);
+        float radius = 0.5f * XMVectorGetX(XMVector3Length(XMVectorSubtract(boundsMax, boundsMin)));
+
+        XMVECTOR eye = XMVectorAdd(center, XMVectorScale(XMVectorSet(0.3f, 0.4f, -1.0f, 0.0f), radius * 1.5f));
+        XMVECTOR forward = XMVector3Normalize(XMVectorSubtract(center, eye));
+        XMVECTOR right = XMVector3Normalize(XMVector3Cross(XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), forward));
+        XMVECTOR up = XMVector3Cross(forward, right);
+
+        std::vector<BVHRay> rays(resolution * resolution);
+        for(uint32_t y = 0; y < resolution; y++)
+        {
+            for(uint32_t x = 0; x < resolution; x++)
+            {
+                BVHRay& ray = rays[((y / 2) * (resolution / 2) + x / 2) * 4 + (y & 1) * 2 + (x & 1)];
+                float screenX = ((x + 0.5f) / resolution * 2.0f - 1.0f) * 0.5f;
+                float screenY = ((y + 0.5f) / resolution * 2.0f - 1.0f) * 0.5f;
+                XMStoreFloat3(&ray.Origin, eye);
+                XMStoreFloat3(&ray.Direction, XMVectorAdd(forward, XMVectorAdd(XMVectorScale(right, screenX), XMVectorScale(up, screenY))));
+            }
+        }
+        return rays;
+    }
+
+    bool SameHit(const TriangleRayHit& a, const TriangleRayHit& b)
+    {
+        return a.Triangle == b.Triangle && a.Distance == b.Distance;
+    }
+}
+
+TEST(TriangleBVH_BuildCoversTriangles)
+{
+    TriangleMesh mesh = MakeTorus(96);
+    std::vector<TriangleBVHNode> nodes;
+    std::vector<uint32_t> triangles;
+    TriangleBVH bvh = BuildBVH(mesh, nodes, triangles);
+    CHECK(mesh.GetTriangleCount() > TRIANGLE_BVH_PARALLEL_SIZE);
+
+    // Leaf slots are a permutation of the triangles, inside the bounds of their leaf
+    std::vector<uint32_t> seen(mesh.GetTriangleCount(), 0);
+    uint32_t outsideCount = 0;
+    for(const TriangleBVHNode& node : nodes)
+    {
+        for(uint32_t slot = node.LeftFirst; slot < node.LeftFirst + node.TriangleCount; slot++)
+        {
+            seen[triangles[slot]]++;
+            for(uint32_t k = 0; k < 3; k++)
+            {
+                XMVECTOR position = XMLoadFloat3(&mesh.Positions[mesh.Indices[triangles[slot] * 3 + k]]);
+                outsideCount += !XMVector3LessOrEqual(XMLoadFloat3(&node.BoundsMin), position) || !XMVector3LessOrEqual(position, XMLoadFloat3(&node.BoundsMax));
+            }
+        }
+    }
+    CHECK(outsideCount == 0);
+    CHECK(std::all_of(seen.begin(), seen.end(), [](uint32_t count) { return count == 1; }));
+    CHECK(bvh.GetDepth() < 64);
+
+    // The parallel build makes the same tree as the serial one
+    JobSystem::Release();
+    std::vector<TriangleBVHNode> serialNodes;
+    std::vector<uint32_t> serialTriangles;
+    TriangleBVH::Build(mesh.Positions.data(), mesh.Indices.data(), mesh.GetTriangleCount(), serialNodes, serialTriangles);
+    JobSystem::Create(TestRegistry::GetWorkerCount());
+    CHECK(serialNodes.size() == nodes.size() && memcmp(serialNodes.data(), nodes.data(), nodes.size() * sizeof(TriangleBVHNode)) == 0);
+    CHECK(serialTriangles == triangles);
+}
+
+TEST(TriangleBVH_RaycastMatchesReference)
+{
+    TriangleMesh mesh = MakeTorus(48);
+    std::vector<TriangleBVHNode> nodes;
+    std::vector<uint32_t> triangles;
+    TriangleBVH bvh = BuildBVH(mesh, nodes, triangles);
+
+    std::vector<BVHRay> rays = MakeRandomRays(mesh, 5000);
+    std::vector<TriangleRayHit> packetHits(rays.size());
+    bvh.Raycast(rays.data(), (uint32_t)rays.size(), packetHits.data());
+
+    uint32_t mismatchCount = 0;
+    uint32_t hitCount = 0;
+    for(size_t i = 0; i < rays.size(); i++)
+    {
+        TriangleRayHit hit;
+        TriangleRayHit expected;
+        bool hasHit = bvh.Raycast(rays[i], hit);
+        bool expectedHit = RaycastReference(mesh, rays[i], expected);
+        // Grazing rays lose some distance precision, and on a shared edge rounding may pick the neighbour at the same distance
+        float tolerance = (hit.Triangle == expected.Triangle ? 1e-4f : 1e-5f) * expected.Distance + 1e-6f;
+        bool match = hasHit == expectedHit && (!hasHit || std::fabs(hit.Distance - expected.Distance) <= tolerance);
+        mismatchCount += !match || !SameHit(hit, packetHits[i]);
+        hitCount += hasHit;
+    }
+    CHECK(mismatchCount == 0);
+    CHECK(hitCount > rays.size() / 2);
+}
+
+TEST(TriangleBVH_PacketsMatchSingleRays)
+{
+    TriangleMesh mesh = MakeTorus(96);
+    std::vector<TriangleBVHNode> nodes;
+    std::vector<uint32_t> triangles;
+    TriangleBVH bvh = BuildBVH(mesh, nodes, triangles);
+
+    // Odd count, the last packet is partial
+    std::vector<BVHRay> rays = MakePrimaryRays(mesh, 256);
+    rays.resize(rays.size() - 3);
+    std::vector<TriangleRayHit> packetHits(rays.size());
+    bvh.Raycast(rays.data(), (uint32_t)rays.size(), packetHits.data());
+
+    uint32_t mismatchCount = 0;
+    uint32_t hitCount = 0;
+    for(size_t i = 0; i < rays.size(); i++)
+    {
+        TriangleRayHit hit;
+        hitCount += bvh.Raycast(rays[i], hit);
+        mismatchCount += !SameHit(hit, packetHits[i]);
+    }
+    CHECK(mismatchCount == 0);
+    CHECK(hitCount > 0 && hitCount < rays.size());
+}
+
+BENCHMARK(TriangleBVH_BuildAndRaycast)
+{
+    TriangleMesh mesh;
+    const char* path = LoadBenchmarkMesh(mesh.Positions, mesh.Indices);
+    if(!path)
+    {
+        path = "procedural torus";
+        mesh = MakeTorus(512);
+    }
+
+    std::vector<TriangleBVHNode> nodes;
+    std::vector<uint32_t> triangles;
+    double buildMs = MeasureMilliseconds(3, [&]
+    {
+        TriangleBVH::Build(mesh.Positions.data(), mesh.Indices.data(), mesh.GetTriangleCount(), nodes, triangles);
+    });
+    TriangleBVH bvh;
+    bvh.Initialize(nodes.data(), (uint32_t)nodes.size(), triangles.data(), (uint32_t)triangles.size(), mesh.Positions.data(), mesh.Indices.data());
+
+    const uint32_t resolution = 1024;
+    std::vector<BVHRay> rays = MakePrimaryRays(mesh, resolution);
+    std::vector<TriangleRayHit> singleHits(rays.size());
+    std::vector<TriangleRayHit> packetHits(rays.size());
+
+    double singleMs = MeasureMilliseconds(3, [&]
+    {
+        for(size_t i = 0; i < rays.size(); i++)
+            bvh.Raycast(rays[i], singleHits[i]);
+    });
+
+    double packetMs = MeasureMilliseconds(3, [&]
+    {
+        bvh.Raycast(rays.data(), (uint32_t)rays.size(), packetHits.data());
+    });
+
+    uint32_t hitCount = 0;
+    uint32_t mismatchCount = 0;
+    for(size_t i = 0; i < rays.size(); i++)
+    {
+        hitCount += singleHits[i].Triangle != UINT32_MAX;
+        mismatchCount += !SameHit(singleHits[i], packetHits[i]);
+    }
+    CHECK(mismatchCount == 0);
+
+    double rayCount = (double)rays.size();
+    printf("    %s, %u triangles : build %.2f ms (%zu nodes, depth %u)\n", path, mesh.GetTriangleCount(), buildMs, nodes.size(), bvh.GetDepth());
+    printf("    %u primary rays, %u hits : single rays %.2f Mrays/s, packets on the job system %.2f Mrays/s, %u packet hits differ\n",
+        (uint32_t)rays.size(), hitCount, rayCount / singleMs / 1000.0, rayCount / packetMs / 1000.0, mismatchCount);
+}
@@ -0,0 +1,188 @@
+﻿#include <random>
+
+#include "Rendering/VertexCompression.h"
+#include "TestFramework.h"
+
+using namespace DirectX;
+
+namespace
+{
+    // Documented round trip bounds of CompactVertex
+    // Positions : half a 16 bits step of the bounds extent per axis, plus float rounding of the decode
+    const float PositionStepError = 0.5f / 65535.0f;
+    // Octahedral 16 bits normals and tangents, in degrees (0.0037 measured)
+    const float DirectionMaxErrorDegrees = 0.005f;
+    // Half floats keep 11 significant bits
+    const float UVRelativeError = 1.0f / 2048.0f;
+
+    float AngleDegrees(const XMFLOAT3& a, const XMFLOAT3& b)
+    {
+        // atan2 keeps the precision of the small angles acos loses
+        XMVECTOR directionA = XMVector3Normalize(XMLoadFloat3(&a));
+        XMVECTOR directionB = XMVector3Normalize(XMLoadFloat3(&b));
+        float sine = XMVectorGetX(XMVector3Length(XMVector3Cross(directionA, directionB)));
+        float cosine = XMVectorGetX(XMVector3Dot(directionA, directionB));
+        return XMConvertToDegrees(std::atan2(sine, cosine));
+    }
+
+    std::vector<Vertex> MakeRandomVertices(uint32_t count, const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax)
+    {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+        std::vector<Vertex> vertices(count);
+        for(Vertex& vertex : vertices)
+        {
+            vertex.Position = XMFLOAT3(boundsMin.x + unit(random) * (boundsMax.x - boundsMin.x), boundsMin.y + unit(random) * (boundsMax.y - boundsMin.y),
+                boundsMin.z + unit(random) * (boundsMax.z - boundsMin.z));
+
+            XMVECTOR normal = XMVector3Normalize(XMVectorSet(distribution(random), distribution(random), distribution(random), 0.0f));
+            XMVECTOR tangent = XMVector3Normalize(XMVector3Cross(normal, XMVectorSet(distribution(random), distribution(random), distribution(random), 0.0f)));
+            XMVECTOR binormal = XMVectorScale(XMVector3Cross(normal, tangent), distribution(random) < 0.0f ? -1.0f : 1.0f);
+            XMStoreFloat3(&vertex.Normal, normal);
+            XMStoreFloat3(&vertex.Tangent, tangent);
+            XMStoreFloat3(&vertex.Binormal, binormal);
+
+            vertex.UV = XMFLOAT2(distribution(random) * 4.0f, distribution(random));
+        }
+
+        return vertices;
+    }
+}
+
+TEST(VertexCompression_PositionsWithinHalfStep)
+{
+    // One flat axis, it decodes exactly to the bounds
+    const XMFLOAT3 boundsMin(-3.0f, -0.5f, 10.0f);
+    const XMFLOAT3 boundsMax(7.0f, 0.5f, 10.0f);
+    std::vector<Vertex> vertices = MakeRandomVertices(100000, boundsMin, boundsMax);
+    vertices[0].Position = boundsMin;
+    vertices[1].Position = boundsMax;
+
+    std::vector<CompactVertex> compactVertices(vertices.size());
+    VertexCompression::EncodeVertices(vertices.data(), (uint32_t)vertices.size(), boundsMin, boundsMax, compactVertices.data());
+
+    float maxErrors[3] = {};
+    bool cookedMatchesDecode = true;
+    for(size_t i = 0; i < vertices.size(); i++)
+    {
+        Vertex decoded = VertexCompression::DecodeVertex(compactVertices[i], boundsMin, boundsMax);
+        maxErrors[0] = (std::max)(maxErrors[0], std::fabs(decoded.Position.x - vertices[i].Position.x));
+        maxErrors[1] = (std::max)(maxErrors[1], std::fabs(decoded.Position.y - vertices[i].Position.y));
+        maxErrors[2] = (std::max)(maxErrors[2], std::fabs(decoded.Position.z - vertices[i].Position.z));
+
+        XMFLOAT3 position = VertexCompression::DecodePosition(compactVertices[i], boundsMin, boundsMax);
+        cookedMatchesDecode &= position.x == decoded.Position.x && position.y == decoded.Position.y && position.z == decoded.Position.z;
+    }
+
+    CHECK(maxErrors[0] <= (boundsMax.x - boundsMin.x) * PositionStepError + 1e-6f);
+    CHECK(maxErrors[1] <= (boundsMax.y - boundsMin.y) * PositionStepError + 1e-6f);
+    CHECK(maxErrors[2] == 0.0f);
+    CHECK(cookedMatchesDecode);
+
+    // The bounds corners are exact
+    Vertex decodedMin = VertexCompression::DecodeVertex(compactVertices[0], boundsMin, boundsMax);
+    Vertex decodedMax = VertexCompression::DecodeVertex(compactVertices[1], boundsMin, boundsMax);
+    CHECK(decodedMin.Position.x == boundsMin.x && decodedMin.Position.y == boundsMin.y);
+    CHECK_NEAR(decodedMax.Position.x, boundsMax.x, 1e-6f);
+    CHECK_NEAR(decodedMax.Position.y, boundsMax.y, 1e-6f);
+}
+
+TEST(VertexCompression_OctahedralDirections)
+{
+    const XMFLOAT3 boundsMin(-1.0f, -1.0f, -1.0f);
+    const XMFLOAT3 boundsMax(1.0f, 1.0f, 1.0f);
+    std::vector<Vertex> vertices = MakeRandomVertices(100000, boundsMin, boundsMax);
+
+    // Normal and tangent pairs on the axes and the octahedron folds, where the encoding is the least smooth
+    const XMFLOAT3 edgeCases[][2] = { { { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, 0.0f } }, { { 0.0f, 0.0f, 1.0f }, { 0.0f, -1.0f, 0.0f } },
+        { { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f } }, { { 0.0f, -1.0f, 0.0f }, { 0.70710678f, 0.0f, 0.70710678f } },
+        { { 0.70710678f, 0.70710678f, 0.0f }, { 0.0f, 0.0f, 1.0f } }, { { -0.70710678f, 0.0f, -0.70710678f }, { 0.0f, 1.0f, 0.0f } } };
+    for(uint32_t i = 0; i < ARRAYSIZE(edgeCases); i++)
+    {
+        vertices[i].Normal = edgeCases[i][0];
+        vertices[i].Tangent = edgeCases[i][1];
+        XMStoreFloat3(&vertices[i].Binormal, XMVectorScale(XMVector3Cross(XMLoadFloat3(&edgeCases[i][0]), XMLoadFloat3(&edgeCases[i][1])), i % 2 ? -1.0f : 1.0f));
+    }
+
+    std::vector<CompactVertex> compactVertices(vertices.size());
+    VertexCompression::EncodeVertices(vertices.data(), (uint32_t)vertices.size(), boundsMin, boundsMax, compactVertices.data());
+
+    float maxNormalError = 0.0f;
+    float maxTangentError = 0.0f;
+    uint32_t bitangentSignErrors = 0;
+    for(size_t i = 0; i < vertices.size(); i++)
+    {
+        Vertex decoded = VertexCompression::DecodeVertex(compactVertices[i], boundsMin, boundsMax);
+        maxNormalError = (std::max)(maxNormalError, AngleDegrees(decoded.Normal, vertices[i].Normal));
+        maxTangentError = (std::max)(maxTangentError, AngleDegrees(decoded.Tangent, vertices[i].Tangent));
+
+        // The bitangent is rebuilt from the normal, the tangent and the sign stored in position w
+        float orientation = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&decoded.Binormal), XMLoadFloat3(&vertices[i].Binormal)));
+        bitangentSignErrors += orientation < 0.99f ? 1 : 0;
+    }
+
+    CHECK(maxNormalError <= DirectionMaxErrorDegrees);
+    CHECK(maxTangentError <= DirectionMaxErrorDegrees);
+    CHECK(bitangentSignErrors == 0);
+
+    // Encoded values stay in the octahedral square and decode to unit vectors
+    for(const auto& edgeCase : edgeCases)
+    {
+        XMVECTOR encoded = VertexCompression::EncodeOctahedral(XMLoadFloat3(&edgeCase[0]));
+        CHECK(std::fabs(XMVectorGetX(encoded)) <= 1.0f && std::fabs(XMVectorGetY(encoded)) <= 1.0f);
+        CHECK_NEAR(XMVectorGetX(XMVector3Length(VertexCompression::DecodeOctahedral(encoded))), 1.0f, 1e-5f);
+    }
+}
+
+TEST(VertexCompression_HalfUVs)
+{
+    const XMFLOAT3 boundsMin(-1.0f, -1.0f, -1.0f);
+    const XMFLOAT3 boundsMax(1.0f, 1.0f, 1.0f);
+    std::vector<Vertex> vertices = MakeRandomVertices(100000, boundsMin, boundsMax);
+    // Exactly representable values survive as they are
+    vertices[0].UV = XMFLOAT2(0.0f, 1.0f);
+    vertices[1].UV = XMFLOAT2(0.5f, -2.0f);
+
+    std::vector<CompactVertex> compactVertices(vertices.size());
+    VertexCompression::EncodeVertices(vertices.data(), (uint32_t)vertices.size(), boundsMin, boundsMax, compactVertices.data());
+
+    bool withinBound = true;
+    for(size_t i = 0; i < vertices.size(); i++)
+    {
+        Vertex decoded = VertexCompression::DecodeVertex(compactVertices[i], boundsMin, boundsMax);
+        // Relative to the value, with an absolute floor for the half subnormals
+        withinBound &= std::fabs(decoded.UV.x - vertices[i].UV.x) <= (std::max)(std::fabs(vertices[i].UV.x) * UVRelativeError, 1e-7f);
+        withinBound &= std::fabs(decoded.UV.y - vertices[i].UV.y) <= (std::max)(std::fabs(vertices[i].UV.y) * UVRelativeError, 1e-7f);
+    }
+    CHECK(withinBound);
+
+    Vertex exact0 = VertexCompression::DecodeVertex(compactVertices[0], boundsMin, boundsMax);
+    Vertex exact1 = VertexCompression::DecodeVertex(compactVertices[1], boundsMin, boundsMax);
+    CHECK(exact0.UV.x == 0.0f && exact0.UV.y == 1.0f);
+    CHECK(exact1.UV.x == 0.5f && exact1.UV.y == -2.0f);
+}
+
+BENCHMARK(VertexCompression_EncodeDecode)
+{
+    const XMFLOAT3 boundsMin(-1.0f, -1.0f, -1.0f);
+    const XMFLOAT3 boundsMax(1.0f, 1.0f, 1.0f);
+    const uint32_t vertexCount = 1000000;
+    std::vector<Vertex> vertices = MakeRandomVertices(vertexCount, boundsMin, boundsMax);
+    std::vector<CompactVertex> compactVertices(vertexCount);
+
+    double encodeMs = MeasureMilliseconds(5, [&]
+    {
+        VertexCompression::EncodeVertices(vertices.data(), vertexCount, boundsMin, boundsMax, compactVertices.data());
+    });
+
+    double decodeMs = MeasureMilliseconds(5, [&]
+    {
+        for(uint32_t i = 0; i < vertexCount; i++)
+            vertices[i] = VertexCompression::DecodeVertex(compactVertices[i], boundsMin, boundsMax);
+    });
+
+    printf("    %u vertices : encode %.2f ms, decode %.2f ms, %zu bytes instead of %zu\n",
+        vertexCount, encodeMs, decodeMs, sizeof(CompactVertex), sizeof(Vertex));
+}